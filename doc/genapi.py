@@ -57,6 +57,7 @@ def genfiles(package, package_name, modules, dir='api'):
 modules = [
     ('__init__', 'Sasmodels package'),
     #('alignment', 'GPU data alignment [unused]'),
+    ('bench', 'Benchmark kernels on different compute engines'),
     ('bumps_model', 'Bumps interface'),
     ('compare', 'Compare models on different compute engines'),
     ('compare_many', 'Batch compare models on different compute engines'),
@@ -70,28 +71,40 @@ modules = [
     ('exception', 'Annotate exceptions'),
     ('generate', 'Model parser'),
     ('gengauss', 'Generate Gauss-Legendre integration points'),
+    ('gputune', 'Work group sizes for GPU kernels'),
     ('guyou', 'Guyou map projection'),
     ('jitter', 'Orientation explorer'),
     ('kernel', 'Evaluator type definitions'),
+    ('kernelcache', 'Disk cache for compiled GPU programs'),
     ('kernelcl', 'OpenCL model evaluator'),
     ('kernelcuda', 'CUDA model evaluator'),
     ('kerneldll', 'Ctypes model evaluator'),
     ('kernelpy', 'Python model evaluator'),
+    ('kerneltile', 'Tiled kernels for large q sets'),
     ('list_pars', 'Identify all parameters in all models'),
     ('mixture', 'Mixture model evaluator'),
     # Docs for models are generated by Makefile + genmodel.py, and don't
     # need to be managed by autodoc.
     #('models.__init__', 'Builtin models'),
     ('model_test', 'Unit test support'),
+    ('modelindex', 'Index of model metadata'),
     ('modelinfo', 'Parameter and model definitions'),
     ('multiscat', 'Multiple scattering support'),
     ('product', 'Product model evaluator'),
+    ('profiling', 'Stage timing for model evaluation'),
+    ('qmc', 'Quasi-Monte Carlo dispersity integration'),
+    ('realspace', 'Real space scattering from point clouds'),
     ('resolution', '1-D resolution functions'),
     ('resolution2d', '2-D resolution functions'),
     ('rst2html', 'Convert doc strings the web pages'),
     ('sasview_model', 'Sasview interface'),
+    ('selection', 'Rank candidate models against a dataset'),
+    ('series', 'Fit a series of frames'),
     ('sesans', 'SESANS calculation routines'),
+    ('sftable', 'Interpolation tables for structure factors'),
     ('special', 'Special functions library'),
+    ('surrogate', 'Fast interpolants for parameter exploration'),
+    ('watch', 'Rebuild plugin models when they change'),
     ('weights', 'Distribution functions'),
 ]
 package = 'sasmodels'
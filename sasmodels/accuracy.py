@@ -0,0 +1,461 @@
+#!/usr/bin/env python
+"""
+Accuracy tiers for reduced precision kernels
+============================================
+
+Single precision and fast math kernels are much faster on most GPUs, but
+whether they are accurate enough depends on the model.  This module checks
+each reduced precision variant of a model against the double precision DLL
+and records which variants stay within tolerance, so that
+:func:`.core.build_model` can pick the fastest approved variant when called
+with *dtype='auto'*.
+
+Each variant is compared with the reference on the q points and parameter
+values from the model tests (as in :mod:`.model_test`), then on random
+parameter sets over the 1D q range used by :mod:`.compare_many`, and over
+a 2D grid if the model has orientation parameters.  A variant is approved
+if the maximum relative difference over all points is below the
+tolerance.
+
+Results are stored in *SAS_ACCURACY_PATH*, which defaults to
+*~/.sasmodels/accuracy.json*.  Each record is tagged with the model source
+and the compute device, so a change to either of these means the model
+must be checked again.  Models without a record fall back to the default
+precision for the model.
+
+For coarse screening of parameter space, where three digits are enough,
+the half precision variant from :data:`SCREENING` is checked as well
+against the looser :data:`SCREENING_TOLERANCE` on devices which support
+it.  It is never chosen by *dtype='auto'*; use *dtype='screen'* to get
+half precision where it is approved and the 'auto' choice elsewhere.
+
+Usage::
+
+    python -m sasmodels.accuracy [-count=N] [-tol=TOL] model...
+
+where *model* is a model name or a model type such as "all" or "c", as
+accepted by :func:`.core.list_models`.
+"""
+from __future__ import print_function, division
+
+import sys
+import os
+from os.path import join as joinpath, exists, dirname
+import json
+import logging
+import tempfile
+
+import numpy as np  # type: ignore
+
+from . import core
+from . import generate
+from .modelinfo import expand_pars
+from .direct_model import call_kernel
+
+# pylint: disable=unused-import
+try:
+    from typing import Dict, List, Optional, Sequence, Tuple, Any
+    from .modelinfo import ModelInfo
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+if "SAS_ACCURACY_PATH" in os.environ:
+    SAS_ACCURACY_PATH = os.environ["SAS_ACCURACY_PATH"]
+else:
+    SAS_ACCURACY_PATH = joinpath(
+        os.path.expanduser("~"), ".sasmodels", "accuracy.json")
+
+#: Candidate variants for each platform, fastest first.  The last entry is
+#: used if none of the others are approved.
+TIERS = {
+    "ocl": ("fast", "single", "mixed", "double"),
+    "cuda": ("fast", "single", "mixed", "double"),
+    "dll": ("single!", "double!"),
+}
+
+#: Screening variant for each platform, checked separately from the tiers.
+SCREENING = {
+    "ocl": "half",
+}
+
+#: Maximum relative difference for the screening variant, which matches
+#: the target for half precision in :mod:`.compare_many`.
+SCREENING_TOLERANCE = 1e-3
+
+#: Reference calculation for the comparisons.
+REFERENCE = "double!"
+
+#: Default maximum relative difference from the reference, which matches
+#: the target for single precision in :mod:`.compare_many`.
+TOLERANCE = 5e-5
+
+#: Default number of random parameter sets for each variant.
+COUNT = 20
+
+
+def platform_identity(platform):
+    # type: (str) -> str
+    """
+    Return a string identifying the compute device for *platform*, which
+    is one of the keys in :data:`TIERS`.
+    """
+    if platform == "ocl":
+        from . import kernelcl
+        env = kernelcl.environment()
+        devices = []
+        for context in env.context.values():
+            if context is not None:
+                devices.extend(kernelcl._device_identity(d)
+                               for d in context.devices)
+        return "ocl|" + ";".join(sorted(set(devices)))
+    elif platform == "cuda":
+        from . import kernelcuda
+        device = kernelcuda.environment().context.get_device()
+        return "cuda|%s|%d.%d" % ((device.name(),)
+                                  + device.compute_capability())
+    else:
+        from . import kerneldll
+        return "dll|" + kerneldll.compiler_tag()
+
+
+def _source_tag(model_info):
+    # type: (ModelInfo) -> str
+    """
+    Return a tag for the model source so that records for old versions
+    of the model are ignored.
+    """
+    return generate.tag_source(generate.make_source(model_info)['dll'])
+
+
+def _default_platform():
+    # type: () -> str
+    """
+    Return the platform that :func:`.core.build_model` would use.
+    """
+    from . import kernelcl, kernelcuda
+    if kernelcl.use_opencl():
+        return "ocl"
+    elif kernelcuda.use_cuda():
+        return "cuda"
+    return "dll"
+
+
+def load_records(path=None):
+    # type: (Optional[str]) -> Dict[str, Any]
+    """
+    Return the accuracy records from *path*, or from
+    :data:`SAS_ACCURACY_PATH` if *path* is None.
+
+    Any failure to read the file is logged and gives no records.
+    """
+    path = SAS_ACCURACY_PATH if path is None else path
+    if not exists(path):
+        return {}
+    try:
+        with open(path) as fid:
+            return json.load(fid)
+    except Exception as exc:
+        logging.warning("could not read accuracy records %r: %s", path, exc)
+        return {}
+
+
+def save_records(records, path=None):
+    # type: (Dict[str, Any], Optional[str]) -> None
+    """
+    Write the accuracy *records* to *path*, or to :data:`SAS_ACCURACY_PATH`
+    if *path* is None.
+
+    The file is replaced atomically so that concurrent readers never see
+    a partial file.
+    """
+    path = SAS_ACCURACY_PATH if path is None else path
+    os.makedirs(os.path.abspath(dirname(path)) or ".", exist_ok=True)
+    fd, tmp = tempfile.mkstemp(dir=dirname(os.path.abspath(path)),
+                               suffix=".tmp")
+    try:
+        with os.fdopen(fd, "w") as fid:
+            json.dump(records, fid, indent=2, sort_keys=True)
+        os.replace(tmp, path)
+    except Exception:
+        os.unlink(tmp)
+        raise
+
+
+def _record_key(model_info, platform):
+    # type: (ModelInfo, str) -> str
+    return "%s@%s" % (model_info.id, platform_identity(platform))
+
+
+def _approved(model_info, platform, records):
+    # type: (ModelInfo, str, Optional[Dict[str, Any]]) -> List[str]
+    """
+    Return the approved variants in the current record for the model.
+    """
+    if records is None:
+        records = load_records()
+    record = records.get(_record_key(model_info, platform), None)
+    if record is None or record.get("tag") != _source_tag(model_info):
+        return []
+    return record.get("approved", [])
+
+
+def approved_dtype(model_info, platform=None, records=None):
+    # type: (ModelInfo, Optional[str], Optional[Dict[str, Any]]) -> Optional[str]
+    """
+    Return the fastest approved dtype for the model on *platform*, or None
+    if the model has not been checked, or was checked for a different
+    version of the model.
+
+    If *records* is None, then they are loaded from
+    :data:`SAS_ACCURACY_PATH`.
+    """
+    if platform is None:
+        platform = _default_platform()
+    approved = _approved(model_info, platform, records)
+    for dtype in TIERS[platform]:
+        if dtype in approved:
+            return dtype
+    return None
+
+
+def screening_dtype(model_info, platform=None, records=None):
+    # type: (ModelInfo, Optional[str], Optional[Dict[str, Any]]) -> Optional[str]
+    """
+    Return the screening variant for the model on *platform* if it is
+    approved, otherwise the result of :func:`approved_dtype`.
+    """
+    if platform is None:
+        platform = _default_platform()
+    approved = _approved(model_info, platform, records)
+    screen = SCREENING.get(platform, None)
+    if screen is not None and screen in approved:
+        return screen
+    return approved_dtype(model_info, platform, records)
+
+
+def _has_half(platform):
+    # type: (str) -> bool
+    """
+    Return True if *platform* can run half precision model code.
+    """
+    if platform == "ocl":
+        from . import kernelcl
+        return kernelcl.environment().has_half()
+    elif platform == "cuda":
+        from . import kernelcuda
+        return kernelcuda.environment().has_half()
+    return False
+
+
+def _relative_error(target, actual):
+    # type: (np.ndarray, np.ndarray) -> float
+    """
+    Return the maximum relative difference between *actual* and *target*,
+    ignoring points where the target is zero or not finite.  Non-finite
+    values in *actual* where the target is finite give an infinite error.
+    """
+    target, actual = np.asarray(target, 'd'), np.asarray(actual, 'd')
+    index = np.isfinite(target) & (target != 0.)
+    if not index.any():
+        return 0.
+    with np.errstate(invalid='ignore'):
+        err = abs(actual[index] - target[index])/abs(target[index])
+    err[~np.isfinite(err)] = np.inf
+    return float(np.max(err))
+
+
+def _test_error(model_info, dtype):
+    # type: (ModelInfo, str) -> float
+    """
+    Return the maximum relative difference between the *dtype* variant of
+    the model and the reference for the parameters and q values in the
+    model tests.
+    """
+    tests = model_info.tests or []
+    if not tests:
+        return 0.
+    model = core.build_model(model_info, dtype=dtype)
+    reference = core.build_model(model_info, dtype=REFERENCE)
+    worst = 0.
+    for test in tests:
+        user_pars, x = test[0], test[1]
+        pars = expand_pars(model_info.parameters, user_pars)
+        x = x if isinstance(x, list) else [x]
+        if isinstance(x[0], tuple):
+            qx, qy = zip(*x)
+            q_vectors = [np.array(qx), np.array(qy)]
+        else:
+            q_vectors = [np.array(x)]
+        target = call_kernel(reference.make_kernel(q_vectors), pars)
+        actual = call_kernel(model.make_kernel(q_vectors), pars)
+        worst = max(worst, _relative_error(target, actual))
+    return worst
+
+
+def _random_error(model_info, dtype, count, seed=1, mono=True):
+    # type: (ModelInfo, str, int, int, bool) -> float
+    """
+    Return the maximum relative difference between the *dtype* variant of
+    the model and the reference for *count* random parameter sets, using
+    the same parameter generator as :mod:`.compare_many`.
+    """
+    from .compare import (
+        randomize_pars, suppress_pd, make_data, make_engine, get_pars,
+        constrain_pars)
+
+    dims = [False]
+    if model_info.parameters.has_2d:
+        dims.append(True)
+    base_pars = get_pars(model_info)
+    state = np.random.get_state()
+    worst = 0.
+    try:
+        np.random.seed(seed)
+        for is2d in dims:
+            data, index = make_data({
+                'qmin': 0.001, 'qmax': 1.0, 'is2d': is2d,
+                'nq': 32 if is2d else 100, 'res': 0., 'accuracy': 'Low',
+                'view': 'log', 'zero': False, 'sesans': False,
+            })
+            calc_model = make_engine(model_info, data, dtype, cutoff=0.)
+            calc_reference = make_engine(model_info, data, REFERENCE, cutoff=0.)
+            for _ in range(count):
+                pars = randomize_pars(model_info, base_pars, is2d=is2d)
+                constrain_pars(model_info, pars)
+                if mono:
+                    pars = suppress_pd(pars)
+                target = calc_reference(**pars)
+                actual = calc_model(**pars)
+                worst = max(worst, _relative_error(target[index], actual[index]))
+    finally:
+        np.random.set_state(state)
+    return worst
+
+
+def _variant_error(model_info, dtype, count, tolerance):
+    # type: (ModelInfo, str, int, float) -> float
+    """
+    Return the maximum relative difference for the *dtype* variant, or
+    infinity if it fails to run.  The random parameter sets are skipped
+    if the model tests already exceed *tolerance*.
+    """
+    try:
+        err = _test_error(model_info, dtype)
+        if err <= tolerance:
+            err = max(err, _random_error(model_info, dtype, count))
+    except Exception as exc:
+        logging.warning("accuracy check for %s %s failed: %s",
+                        model_info.id, dtype, exc)
+        err = np.inf
+    return err
+
+
+def check_model(model_info, platform=None, count=COUNT, tolerance=TOLERANCE,
+                records=None):
+    # type: (ModelInfo, Optional[str], int, float, Optional[Dict[str, Any]]) -> Dict[str, Any]
+    """
+    Check each variant in :data:`TIERS` for *platform* against the double
+    precision reference, returning the record for the model.
+
+    If *records* is given, then the record is also stored in it.
+
+    The variants are checked from the most precise to the fastest, and
+    the check stops at the first failure since the faster variants trade
+    away more precision.  The :data:`SCREENING` variant is then checked
+    against :data:`SCREENING_TOLERANCE` if the device supports it.
+    """
+    if platform is None:
+        platform = _default_platform()
+    maxrel = {}  # type: Dict[str, float]
+    approved = []  # type: List[str]
+    for dtype in reversed(TIERS[platform]):
+        err = _variant_error(model_info, dtype, count, tolerance)
+        maxrel[dtype] = err
+        if err > tolerance:
+            break
+        approved.append(dtype)
+    screen = SCREENING.get(platform, None)
+    if screen is not None and _has_half(platform):
+        err = _variant_error(model_info, screen, count, SCREENING_TOLERANCE)
+        maxrel[screen] = err
+        if err <= SCREENING_TOLERANCE:
+            approved.append(screen)
+    record = {
+        "tag": _source_tag(model_info),
+        "tolerance": tolerance,
+        "screening_tolerance": SCREENING_TOLERANCE,
+        "count": count,
+        "maxrel": maxrel,
+        "approved": approved,
+    }
+    if records is not None:
+        records[_record_key(model_info, platform)] = record
+    return record
+
+
+def main(argv):
+    # type: (List[str]) -> None
+    """
+    Check the models named on the command line and update the records.
+    """
+    count, tolerance = COUNT, TOLERANCE
+    names = []
+    for arg in argv:
+        if arg.startswith("-count="):
+            count = int(arg[7:])
+        elif arg.startswith("-tol="):
+            tolerance = float(arg[5:])
+        else:
+            names.append(arg)
+    if not names:
+        print(__doc__.split("Usage::")[1].strip(), file=sys.stderr)
+        sys.exit(1)
+
+    models = []
+    for name in names:
+        try:
+            models.extend(core.list_models(name))
+        except ValueError:
+            models.append(name)
+
+    platform = _default_platform()
+    records = load_records()
+    for name in models:
+        model_info = core.load_model_info(name)
+        record = check_model(model_info, platform=platform, count=count,
+                             tolerance=tolerance, records=records)
+        # Save after each model so that an interrupted run keeps its work.
+        save_records(records)
+        print("%s: %s (%s)" % (
+            name, " ".join(record["approved"]) or "none",
+            ", ".join("%s=%.2g" % (k, v)
+                      for k, v in sorted(record["maxrel"].items()))))
+
+
+def test_records():
+    # type: () -> None
+    """
+    Check that records survive a round trip and give the fastest approved
+    variant, and that stale records are ignored.
+    """
+    model_info = core.load_model_info("sphere")
+    platform = "dll"
+    key = _record_key(model_info, platform)
+    records = {key: {"tag": _source_tag(model_info),
+                     "approved": ["double!", "single!"]}}
+    path = joinpath(tempfile.mkdtemp(), "accuracy.json")
+    save_records(records, path)
+    records = load_records(path)
+    assert approved_dtype(model_info, platform, records) == "single!"
+    assert screening_dtype(model_info, platform, records) == "single!"
+    records[key]["approved"] = ["double!"]
+    assert approved_dtype(model_info, platform, records) == "double!"
+    records[key]["tag"] = "stale"
+    assert approved_dtype(model_info, platform, records) is None
+    assert approved_dtype(model_info, platform, {}) is None
+    os.unlink(path)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,431 @@
+#!/usr/bin/env python
+"""
+Kernel benchmarks
+=================
+
+Times the 1D and 2D kernels for each model on each available compute
+engine (dll, OpenCL and CUDA) and precision, at standard problem sizes
+with and without polydispersity.  For each case the report gives the
+number of kernel evaluations per second and the number of points per
+second, where a point is one q value at one point of the dispersity mesh.
+
+The problem sizes are *nq* log spaced q values from 0.001 to 1 in 1D and
+a *grid x grid* mesh of linearly spaced $q_x$, $q_y$ in $[-0.5, 0.5]$ in 2D.
+The polydispersity level *pd_n* is the number of points in the dispersity
+distribution for each volume parameter, with a relative width of 10%,
+or zero for monodisperse.  The parameters are otherwise the model
+defaults.  Python models are only timed with the python engine in double
+precision.
+
+Each case is warmed up with one call, so that compile time is excluded,
+and then evaluated until *-time* seconds have passed.
+
+With *-save*, the results are added to the history in *SAS_BENCH_PATH*,
+which defaults to *~/.sasmodels/bench.json*.  Each run records the date,
+the sasmodels version, the host and the compute device for each engine.
+With *-compare*, each result is compared with the most recent result for
+the same case on the same device in the history, and cases which are
+slower than :data:`REGRESSION` times the previous rate are flagged.
+
+Usage::
+
+    python -m sasmodels.bench [options] model...
+
+where *model* is a model name or a model type such as "all" or "c", as
+accepted by :func:`.core.list_models`, and the options are::
+
+    -engine=dll,ocl,cuda  engines to time (default: those available)
+    -dtype=single,double  precisions to time
+    -dim=1d,2d            dimensions to time
+    -nq=100,1000          number of q points for 1D
+    -grid=32,128          width of the q grid for 2D
+    -pd=0,11              dispersity points per volume parameter
+    -time=0.2             minimum time in seconds for each case
+    -save[=path]          add the results to the history
+    -compare[=path]       compare the results to the history
+"""
+from __future__ import print_function, division
+
+import sys
+import os
+from os.path import join as joinpath, exists, dirname
+import json
+import logging
+import platform as host_platform
+import tempfile
+import time
+from time import perf_counter
+
+import numpy as np  # type: ignore
+
+from . import __version__
+from . import core
+from .details import make_kernel_args
+from .direct_model import get_mesh
+
+# pylint: disable=unused-import
+try:
+    from typing import Dict, List, Optional, Sequence, Tuple, Any
+    from .kernel import Kernel
+    from .modelinfo import ModelInfo
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+if "SAS_BENCH_PATH" in os.environ:
+    SAS_BENCH_PATH = os.environ["SAS_BENCH_PATH"]
+else:
+    SAS_BENCH_PATH = joinpath(
+        os.path.expanduser("~"), ".sasmodels", "bench.json")
+
+#: Compute engines, as accepted by the *platform* argument of
+#: :func:`.core.build_model`.
+ENGINES = ("dll", "ocl", "cuda")
+
+#: Precisions to time by default.
+DTYPES = ("single", "double")
+
+#: Default number of q points for 1D.
+NQ_1D = (100, 1000)
+
+#: Default width of the q grid for 2D.
+GRID_2D = (32, 128)
+
+#: Default number of dispersity points for each volume parameter.
+PD_LEVELS = (0, 11)
+
+#: Default minimum time in seconds for each case.
+MIN_TIME = 0.2
+
+#: Maximum number of evaluations for each case, so that very fast cases
+#: don't spend all their time in the python overhead.
+MAX_EVALS = 1000
+
+#: Flag cases running at less than this fraction of the previous rate.
+REGRESSION = 0.8
+
+
+def available_engines():
+    # type: () -> List[str]
+    """
+    Return the engines in :data:`ENGINES` which are available.
+    """
+    from . import kernelcl, kernelcuda
+    engines = ["dll"]
+    if kernelcl.use_opencl():
+        engines.append("ocl")
+    if kernelcuda.use_cuda():
+        engines.append("cuda")
+    return engines
+
+
+def bench_pars(model_info, pd_n):
+    # type: (ModelInfo, int) -> Dict[str, float]
+    """
+    Return the parameters for dispersity level *pd_n*, which sets a 10%
+    dispersity with *pd_n* points on each polydisperse volume parameter.
+    """
+    pars = {}
+    if pd_n:
+        for p in model_info.parameters.call_parameters:
+            if p.type == 'volume' and p.polydisperse:
+                pars[p.id + '_pd'] = 0.1
+                pars[p.id + '_pd_n'] = pd_n
+    return pars
+
+
+def bench_q(dim, size):
+    # type: (str, int) -> List[np.ndarray]
+    """
+    Return the q vectors for *dim* ('1d' or '2d') with *size* points in
+    1D or a *size x size* grid in 2D.
+    """
+    if dim == '1d':
+        return [np.logspace(-3, 0, size)]
+    q = np.linspace(-0.5, 0.5, size)
+    qx, qy = np.meshgrid(q, q)
+    return [qx.flatten(), qy.flatten()]
+
+
+def time_kernel(kernel, pars, min_time=MIN_TIME):
+    # type: (Kernel, Dict[str, float], float) -> Tuple[int, float, int]
+    """
+    Time *kernel* evaluated with *pars*, returning the number of evaluations,
+    the elapsed time in seconds and the size of the dispersity mesh.
+
+    The parameters are packed once before timing, so the time is for the
+    kernel call alone.
+    """
+    mesh = get_mesh(kernel.info, pars, dim=kernel.dim)
+    call_details, values, is_magnetic = make_kernel_args(kernel, mesh)
+    # Warm up, which includes the compile for the lazily built programs.
+    kernel.Iq(call_details, values, 0., is_magnetic)
+    evals = 0
+    start = perf_counter()
+    while True:
+        kernel.Iq(call_details, values, 0., is_magnetic)
+        evals += 1
+        elapsed = perf_counter() - start
+        if elapsed >= min_time or evals >= MAX_EVALS:
+            break
+    return evals, elapsed, int(call_details.num_eval)
+
+
+def bench_model(model_info, engines, dtypes, dims=('1d', '2d'),
+                nq_1d=NQ_1D, grid_2d=GRID_2D, pd_levels=PD_LEVELS,
+                min_time=MIN_TIME):
+    # type: (ModelInfo, Sequence[str], Sequence[str], Sequence[str], Sequence[int], Sequence[int], Sequence[int], float) -> List[Dict[str, Any]]
+    """
+    Time *model_info* for each combination of engine, dtype, dimension,
+    problem size and dispersity level, returning one result for each.
+
+    Engines which can't build the model are logged and skipped.
+    """
+    if callable(model_info.Iq):
+        cases = [("py", "double")]
+    else:
+        cases = [(engine, dtype) for engine in engines for dtype in dtypes
+                 if engine == "dll" or model_info.opencl]
+    results = []
+    for engine, dtype in cases:
+        try:
+            model = core.build_model(
+                model_info, dtype=dtype,
+                platform="dll" if engine == "py" else engine)
+        except Exception as exc:
+            logging.warning("could not build %s for %s %s: %s",
+                            model_info.id, engine, dtype, exc)
+            continue
+        for dim in dims:
+            sizes = nq_1d if dim == '1d' else grid_2d
+            for size in sizes:
+                q_vectors = bench_q(dim, size)
+                kernel = model.make_kernel(q_vectors)
+                for pd_n in pd_levels:
+                    pars = bench_pars(model_info, pd_n)
+                    evals, elapsed, num_eval = time_kernel(
+                        kernel, pars, min_time=min_time)
+                    nq = len(q_vectors[0])
+                    results.append({
+                        "model": model_info.id,
+                        "engine": engine,
+                        "dtype": dtype,
+                        "dim": dim,
+                        "nq": nq,
+                        "pd_n": pd_n,
+                        "mesh": num_eval,
+                        "evals": evals,
+                        "seconds": elapsed,
+                        "evals_per_sec": evals/elapsed,
+                        "points_per_sec": evals*nq*num_eval/elapsed,
+                    })
+                kernel.release()
+        model.release()
+    return results
+
+
+def run_info(engines):
+    # type: (Sequence[str]) -> Dict[str, Any]
+    """
+    Return the description of the current run for the history, including
+    the device identity for each of the *engines*.
+    """
+    from .accuracy import platform_identity
+    devices = dict((engine, platform_identity(engine)) for engine in engines)
+    devices["py"] = "py|" + sys.version.split()[0]
+    return {
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "version": __version__,
+        "host": host_platform.node(),
+        "machine": host_platform.machine(),
+        "numpy": np.__version__,
+        "devices": devices,
+    }
+
+
+def load_history(path=None):
+    # type: (Optional[str]) -> List[Dict[str, Any]]
+    """
+    Return the list of runs from *path*, or from :data:`SAS_BENCH_PATH` if
+    *path* is None, oldest first.
+
+    Any failure to read the file is logged and gives an empty history.
+    """
+    path = SAS_BENCH_PATH if path is None else path
+    if not exists(path):
+        return []
+    try:
+        with open(path) as fid:
+            return json.load(fid)
+    except Exception as exc:
+        logging.warning("could not read benchmark history %r: %s", path, exc)
+        return []
+
+
+def save_history(history, path=None):
+    # type: (List[Dict[str, Any]], Optional[str]) -> None
+    """
+    Write the benchmark *history* to *path*, or to :data:`SAS_BENCH_PATH`
+    if *path* is None.
+
+    The file is replaced atomically so that concurrent readers never see
+    a partial file.
+    """
+    path = SAS_BENCH_PATH if path is None else path
+    os.makedirs(os.path.abspath(dirname(path)) or ".", exist_ok=True)
+    fd, tmp = tempfile.mkstemp(dir=dirname(os.path.abspath(path)),
+                               suffix=".tmp")
+    try:
+        with os.fdopen(fd, "w") as fid:
+            json.dump(history, fid, indent=1, sort_keys=True)
+        os.replace(tmp, path)
+    except Exception:
+        os.unlink(tmp)
+        raise
+
+
+def _case_key(result):
+    # type: (Dict[str, Any]) -> Tuple
+    return tuple(result[k] for k in
+                 ("model", "engine", "dtype", "dim", "nq", "pd_n"))
+
+
+def previous_rates(history, devices):
+    # type: (List[Dict[str, Any]], Dict[str, str]) -> Dict[Tuple, float]
+    """
+    Return the most recent *evals_per_sec* in *history* for each case run
+    on the same device as given in *devices* for the engine.
+    """
+    rates = {}
+    for run in history:
+        for result in run.get("results", []):
+            engine = result["engine"]
+            if run["devices"].get(engine, None) == devices.get(engine, ""):
+                rates[_case_key(result)] = result["evals_per_sec"]
+    return rates
+
+
+def format_result(result, previous=None):
+    # type: (Dict[str, Any], Optional[float]) -> str
+    """
+    Format *result* as a line of the report.  If the *previous* rate
+    is given, then the ratio to the previous rate is included, marked
+    with "SLOWER" if it is below :data:`REGRESSION`.
+    """
+    line = "%-24s %-4s %-6s %-2s %6d %4d %7d %10.4g %10.4g" % (
+        result["model"], result["engine"], result["dtype"], result["dim"],
+        result["nq"], result["pd_n"], result["mesh"],
+        result["evals_per_sec"], result["points_per_sec"])
+    if previous:
+        ratio = result["evals_per_sec"]/previous
+        line += " %6.2f%s" % (ratio, " SLOWER" if ratio < REGRESSION else "")
+    return line
+
+
+HEADER = "%-24s %-4s %-6s %-2s %6s %4s %7s %10s %10s" % (
+    "model", "eng", "dtype", "", "nq", "pd_n", "mesh", "evals/s", "points/s")
+
+
+def main(argv):
+    # type: (List[str]) -> None
+    """
+    Time the models named on the command line and print the report.
+    """
+    engines, dtypes, dims = None, DTYPES, ('1d', '2d')
+    nq_1d, grid_2d, pd_levels = NQ_1D, GRID_2D, PD_LEVELS
+    min_time = MIN_TIME
+    save_path = compare_path = None  # type: Optional[str]
+    save = compare = False
+    names = []
+    split = lambda arg: arg.split("=", 1)[1].split(",")
+    for arg in argv:
+        if arg.startswith("-engine="):
+            engines = split(arg)
+        elif arg.startswith("-dtype="):
+            dtypes = split(arg)
+        elif arg.startswith("-dim="):
+            dims = split(arg)
+        elif arg.startswith("-nq="):
+            nq_1d = [int(v) for v in split(arg)]
+        elif arg.startswith("-grid="):
+            grid_2d = [int(v) for v in split(arg)]
+        elif arg.startswith("-pd="):
+            pd_levels = [int(v) for v in split(arg)]
+        elif arg.startswith("-time="):
+            min_time = float(arg[6:])
+        elif arg == "-save" or arg.startswith("-save="):
+            save, save_path = True, (arg[6:] or None)
+        elif arg == "-compare" or arg.startswith("-compare="):
+            compare, compare_path = True, (arg[9:] or None)
+        elif arg.startswith("-"):
+            print("unknown option %r" % arg, file=sys.stderr)
+            sys.exit(1)
+        else:
+            names.append(arg)
+    if not names:
+        print(__doc__.split("Usage::")[1].strip(), file=sys.stderr)
+        sys.exit(1)
+
+    available = available_engines()
+    if engines is None:
+        engines = available
+    for engine in engines:
+        if engine not in available:
+            print("engine %r is not available" % engine, file=sys.stderr)
+            sys.exit(1)
+
+    models = []
+    for name in names:
+        try:
+            models.extend(core.list_models(name))
+        except ValueError:
+            models.append(name)
+
+    run = run_info(engines)
+    rates = (previous_rates(load_history(compare_path), run["devices"])
+             if compare else {})
+    results = []
+    print(HEADER + (" vs last" if compare else ""))
+    for name in models:
+        model_info = core.load_model_info(name)
+        for result in bench_model(model_info, engines, dtypes, dims=dims,
+                                  nq_1d=nq_1d, grid_2d=grid_2d,
+                                  pd_levels=pd_levels, min_time=min_time):
+            print(format_result(result, rates.get(_case_key(result), None)))
+            sys.stdout.flush()
+            results.append(result)
+
+    if save:
+        history = load_history(save_path)
+        run["results"] = results
+        history.append(run)
+        save_history(history, save_path)
+
+
+def test_bench():
+    # type: () -> None
+    """
+    Check that a short benchmark produces results which survive a round
+    trip through the history and compare against themselves.
+    """
+    model_info = core.load_model_info("sphere")
+    results = bench_model(model_info, ["dll"], ["double"], dims=['1d'],
+                          nq_1d=[10], pd_levels=[0, 3], min_time=0.)
+    assert [r["mesh"] for r in results] == [1, 3]
+    assert all(r["evals"] == 1 and r["points_per_sec"] > 0 for r in results)
+
+    run = run_info(["dll"])
+    run["results"] = results
+    path = joinpath(tempfile.mkdtemp(), "bench.json")
+    save_history([run], path)
+    history = load_history(path)
+    assert len(history) == 1 and history[0]["results"] == results
+    rates = previous_rates(history, run["devices"])
+    assert rates[_case_key(results[0])] == results[0]["evals_per_sec"]
+    assert previous_rates(history, {"dll": "other"}) == {}
+    assert "SLOWER" in format_result(results[0], 2*results[0]["evals_per_sec"])
+    os.unlink(path)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
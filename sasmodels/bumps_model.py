@@ -19,11 +19,13 @@ import numpy as np  # type: ignore
 
 from .data import plot_theory
 from .direct_model import DataMixin
+from .resolution import ADAPTIVE_TOLERANCE
 
 # pylint: disable=unused-import
 try:
-    from typing import Dict, Union, Tuple, Any, Optional
+    from typing import Dict, List, Union, Tuple, Any, Optional
     from .data import Data1D, Data2D
+    from .direct_model import SharedQ
     from .kernel import KernelModel
     from .modelinfo import ModelInfo
     from .resolution import Resolution
@@ -136,11 +138,17 @@ class Experiment(DataMixin):
     *cutoff* is the integration cutoff, which avoids computing the
     the SAS model where the polydispersity weight is low.
 
+    *shared* is an optional :class:`.direct_model.SharedQ` registry for
+    *model.sasmodel*.  Experiments which share a registry merge their
+    calculation points into one kernel, which is evaluated once for each
+    distinct set of parameter values.
+
     The resulting model can be used directly in a Bumps FitProblem call.
     """
     _cache = None # type: Dict[str, np.ndarray]
-    def __init__(self, data, model, cutoff=1e-5, name=None, extra_pars=None):
-        # type: (Data, Model, float, Optional[str], Optional[Dict[str, BumpsParameter]]) -> None
+    def __init__(self, data, model, cutoff=1e-5, name=None, extra_pars=None,
+                 shared=None):
+        # type: (Data, Model, float, Optional[str], Optional[Dict[str, BumpsParameter]], Optional[SharedQ]) -> None
         # Allow resolution function to define fittable parameters.  We do this
         # by creating reference parameters within the resolution object rather
         # than modifying the object itself to use bumps parameters.  We need
@@ -157,7 +165,7 @@ class Experiment(DataMixin):
         self.name = data.filename if name is None else name
         self.model = model
         self.cutoff = cutoff
-        self._interpret_data(data, model.sasmodel)
+        self._interpret_data(data, model.sasmodel, shared=shared)
         self._cache = {}
         # CRUFT: no longer need extra parameters
         # Multiple scattering probability is now retrieved directly from the
@@ -242,6 +250,76 @@ class Experiment(DataMixin):
         #if np.any(self.err ==0): print("zeros in err")
         return (self.theory() - self.Iq) / self.dIq
 
+    def jacobian(self, parameters=None, step=1e-6, central=False):
+        # type: (Optional[List[BumpsParameter]], float, bool) -> np.ndarray
+        """
+        Return the derivatives of the residuals with respect to each of the
+        bumps *parameters* as an array of shape (npoints, nparameters).
+
+        *parameters* defaults to the fitted parameters of the model.  The
+        derivatives are forward differences with a step of *step* times
+        the parameter value, or *step* if the value is zero, or central
+        differences if *central* is True.  The theory for all the steps is
+        evaluated with a single batch call to the kernel, rather than one
+        call for each parameter as needed for numerical derivatives of
+        :meth:`residuals`.  GPU kernels evaluate the batch in one launch,
+        and DLL kernels spread it over *num_threads* threads.
+
+        The theory is linear in *scale* and *background*, so steps which
+        only change those are computed from the current theory without
+        calling the kernel.  Parameters which are expressions of the
+        stepped parameters are updated along with them.  Resolution
+        parameters are not supported since the resolution is shared by all
+        the steps.
+        """
+        if parameters is None:
+            parameters = [p for p in self.model.parameters().values()
+                          if not getattr(p, 'fixed', True)]
+        base = self.model.state()
+        stencil = (-1., 1.) if central else (1.,)
+        pars_list, rows, columns = [base], [], []
+        for p in parameters:
+            value = p.value
+            h = step*abs(value) if value != 0. else step
+            stepped = []
+            try:
+                for sign in stencil:
+                    p.value = value + sign*h
+                    stepped.append(self.model.state())
+            finally:
+                p.value = value
+            changed = set(k for k in base if stepped[-1][k] != base[k])
+            linear = (not changed or changed == set(('background',))
+                      or (changed == set(('scale',)) and base['scale'] != 0.))
+            if linear:
+                rows.append(None)
+            else:
+                rows.append(list(range(len(pars_list),
+                                       len(pars_list) + len(stepped))))
+                pars_list.extend(stepped)
+            columns.append((h, changed, stepped))
+        theory = self._calc_theory_batch(pars_list, cutoff=self.cutoff)
+
+        background = (base.get('background', 0.)
+                      if self.data_type != 'sesans' else 0.)
+        derivatives = []
+        for row, (h, changed, stepped) in zip(rows, columns):
+            if row is not None:
+                delta = theory[row[-1]] - theory[row[0] if central else 0]
+                derivatives.append(delta/(h*len(stepped)))
+            elif 'scale' in changed:
+                scale = stepped[-1]['scale'] - base['scale']
+                derivatives.append((theory[0] - background)/base['scale']
+                                   * (scale/h))
+            elif 'background' in changed and self.data_type != 'sesans':
+                shift = stepped[-1]['background'] - base['background']
+                derivatives.append(np.full_like(theory[0], shift/h))
+            else:
+                derivatives.append(np.zeros_like(theory[0]))
+        if not derivatives:
+            return np.empty((len(self.Iq), 0))
+        return np.array(derivatives).T / self.dIq[:, None]
+
     def nllf(self):
         # type: () -> float
         """
@@ -274,6 +352,16 @@ class Experiment(DataMixin):
         Iq = self.theory()
         self._set_data(Iq, noise)
 
+    def adapt_q_calc(self, tol=ADAPTIVE_TOLERANCE):
+        # type: (float) -> None
+        """
+        Choose the points at which the model is evaluated for the current
+        parameter values, such as the starting point of a fit.  See
+        :meth:`.direct_model.DirectModel.adapt_q_calc`.
+        """
+        self._adapt_resolution(self.model.state(), tol=tol)
+        self.update()
+
     def save(self, basename):
         # type: (str) -> None
         """
@@ -289,6 +377,9 @@ class Experiment(DataMixin):
         # Can't pickle gpu functions, so instead make them lazy
         state = self.__dict__.copy()
         state['_kernel'] = None
+        state['_full_kernel'] = None
+        state['_inputs'] = None
+        state['_kernel_args'] = None
         return state
 
     def __setstate__(self, state):
@@ -44,7 +44,7 @@ from . import kernelcl
 from . import kernelcuda
 from .data import plot_theory, empty_data1D, empty_data2D, empty_sesans, load_data
 from .direct_model import DirectModel, get_mesh
-from .generate import FLOAT_RE, set_integration_size
+from .generate import FLOAT_RE, gauss_order, set_integration_size
 
 # pylint: disable=unused-import
 from typing import Optional, Dict, Any, Callable, Tuple, List
@@ -103,6 +103,7 @@ Options (* for default):
     === precision options ===
     -engine=default uses the default calcution precision
     -single/-double/-half/-fast sets an OpenCL calculation engine
+    -mixed evaluates the model in single precision with double precision sums
     -single!/-double!/-quad! sets an OpenMP calculation engine
 
     === plotting ===
@@ -116,6 +117,7 @@ Options (* for default):
 
     === output options ===
     -edit starts the parameter explorer
+    -surrogate=p1,p2 explores with an interpolant trained over the listed parameters
     -help/-html shows the model docs instead of running the model
 
     === help ===
@@ -726,7 +728,10 @@ def make_engine(
     Datatypes with '!' appended are evaluated using external C DLLs rather
     than OpenCL.
     """
-    if ngauss:
+    # Models with a run time gauss table change the order after building,
+    # so they don't need a new build for each order.
+    runtime_gauss = ngauss and gauss_order(model_info)
+    if ngauss and not runtime_gauss:
         set_integration_size(model_info, ngauss)
 
     if (dtype != "default" and not dtype.endswith('!')
@@ -734,6 +739,8 @@ def make_engine(
         raise RuntimeError("OpenCL not available " + kernelcl.OPENCL_ERROR)
 
     model = core.build_model(model_info, dtype=dtype, platform="ocl")
+    if runtime_gauss:
+        model.set_integration_order(ngauss)
     calculator = DirectModel(data, model, cutoff=cutoff)
     engine_type = calculator._model.__class__.__name__.replace('Model', '').upper()
     bits = calculator._model.dtype.itemsize*8
@@ -1042,10 +1049,10 @@ OPTIONS = [
 
     # Precision options
     'engine=',
-    'half', 'fast', 'single', 'double', 'single!', 'double!', 'quad!',
+    'half', 'fast', 'single', 'double', 'mixed', 'single!', 'double!', 'quad!',
 
     # Output options
-    'help', 'html', 'edit',
+    'help', 'html', 'edit', 'surrogate=',
 
     # Help options
     'h', '?', 'models', 'models='
@@ -1200,6 +1207,7 @@ def parse_opts(argv):
         'show_hist' : False,
         'rel_err'   : True,
         'explore'   : False,
+        'surrogate' : '',
         'zero'      : False,
         'html'      : False,
         'title'     : None,
@@ -1239,6 +1247,7 @@ def parse_opts(argv):
         elif arg.startswith('-engine='):   opts['engine'] = arg[8:]
         elif arg.startswith('-neval='):    opts['count'] = arg[7:]
         elif arg.startswith('-ngauss='):   opts['ngauss'] = arg[8:]
+        elif arg.startswith('-surrogate='): opts['surrogate'] = arg[11:]
         elif arg.startswith('-random='):
             opts['seed'] = int(arg[8:])
             opts['sets'] = 0
@@ -1265,6 +1274,7 @@ def parse_opts(argv):
         elif arg == '-fast':    opts['engine'] = 'fast'
         elif arg == '-single':  opts['engine'] = 'single'
         elif arg == '-double':  opts['engine'] = 'double'
+        elif arg == '-mixed':   opts['engine'] = 'mixed'
         elif arg == '-single!': opts['engine'] = 'single!'
         elif arg == '-double!': opts['engine'] = 'double!'
         elif arg == '-quad!':   opts['engine'] = 'quad!'
@@ -1634,6 +1644,23 @@ class Explore(object):
         self.starting_values = dict((k, v.value) for k, v in pars.items())
         self.pd_types = pd_types
         self.limits = None
+        if opts['surrogate']:
+            self._train_surrogate(opts['surrogate'].split(','))
+
+    def _train_surrogate(self, names):
+        # type: (List[str]) -> None
+        """
+        Replace the base engine with a surrogate over the slider ranges of
+        the parameters in *names*.
+        """
+        from .surrogate import Surrogate
+        box = dict((k, self.pars[k].bounds.limits) for k in names)
+        fixed = dict(self.starting_values)
+        fixed.update(self.pd_types)
+        base, comp = self.opts['engines']
+        surrogate = Surrogate(base, box, fixed=fixed)
+        print("%s max relative error %.2g" % (surrogate.engine, surrogate.error))
+        self.opts['engines'] = [surrogate, comp]
 
     def revert_values(self):
         # type: () -> None
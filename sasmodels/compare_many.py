@@ -10,11 +10,22 @@ greater than expected for that precision, the parameter set is labeled
 as bad and written to the output, along with the random seed used to
 generate that parameter value.  This seed can be used with :mod:`.compare`
 to reload and display the details of the model.
+
+The kernels for each engine are built once for each model, and the random
+parameter sets are evaluated in batches.  Use *-workers=N* to compare N
+models at once in separate processes, and *-stats=path* to save the
+accuracy and throughput for each model as lines of JSON, which makes the
+program usable as an acceptance test for a new driver or device over all
+the models.
 """
 from __future__ import print_function
 
 import sys
+import json
 import traceback
+from io import StringIO
+from multiprocessing import Pool
+from time import perf_counter
 
 import numpy as np  # type: ignore
 
@@ -65,11 +76,11 @@ def calc_stats(target, value, index):
     maxval = np.max(value[sorted_rel_index[p95:]])
     return maxrel, rel95, maxabs, maxval
 
-def print_column_headers(pars, parts):
-    # type: (Dict[str, float], List[str]) -> None
+def print_column_headers(pars, parts, out=None):
+    # type: (Dict[str, float], List[str], Any) -> None
     """
     Generate column headers for the differences and for the parameters,
-    and print them to standard output.
+    and print them to *out*, which defaults to standard output.
     """
     stats = list('Max rel err|95% rel err|Max abs err above 90% rel'
                  '|Max value above 90% rel'.split('|'))
@@ -79,8 +90,8 @@ def print_column_headers(pars, parts):
         groups.extend(['']*(len(stats)-1))
     groups.append("Parameters")
     columns = ['Seed'] + stats*len(parts) +  list(sorted(pars.keys()))
-    print(','.join('"%s"'%c for c in groups))
-    print(','.join('"%s"'%c for c in columns))
+    print(','.join('"%s"'%c for c in groups), file=out)
+    print(','.join('"%s"'%c for c in columns), file=out)
 
 # Target 'good' value for various precision levels.
 PRECISION = {
@@ -88,13 +99,18 @@ PRECISION = {
     'half': 1e-3,
     'single': 5e-5,
     'double': 5e-14,
+    'mixed': 5e-5,
     'single!': 5e-5,
     'double!': 5e-14,
     'quad!': 5e-18,
 }
+#: Number of parameter sets evaluated together by each engine.
+COMPARE_BATCH = 32
+
 def compare_instance(name, data, index, N=1, mono=True, cutoff=1e-5,
-                     base='single', comp='double'):
-    # type: (str, Data, Any, int, bool, float, str, str) -> None
+                     base='single', comp='double', batch=COMPARE_BATCH,
+                     out=None):
+    # type: (str, Data, Any, int, bool, float, str, str, int, Any) -> Dict[str, Any]
     r"""
     Compare the model under different calculation engines.
 
@@ -110,89 +126,146 @@ def compare_instance(name, data, index, N=1, mono=True, cutoff=1e-5,
     a little bit faster.
 
     *base* and *comp* are the names of the calculation engines to compare.
-    """
 
+    The parameter sets are evaluated *batch* at a time by each engine with
+    a single batch call (see :func:`.direct_model.call_kernel_batch`), using
+    the kernels built once for the model.  The table is printed to *out*,
+    which defaults to standard output.
+
+    Returns a dictionary with the accuracy and throughput statistics for
+    the model: the number of *good* parameter sets, the largest relative
+    difference *max_diff* and the *seed* which produced it, and the
+    evaluation rate of each engine in *base_rate* and *comp_rate* in
+    parameter sets per second.  If the model can't be compared, *error*
+    gives the reason.
+    """
+    out = sys.stdout if out is None else out
     is_2d = hasattr(data, 'qx_data')
     model_info = core.load_model_info(name)
     pars = get_pars(model_info)
+    summary = {
+        'model': name, 'count': N, 'dimension': "2D" if is_2d else "1D",
+        'cutoff': None if mono else cutoff, 'base': base, 'comp': comp,
+    }  # type: Dict[str, Any]
     header = ('\n"Model","%s","Count","%d","Dimension","%s"'
               % (name, N, "2D" if is_2d else "1D"))
     if not mono:
         header += ',"Cutoff",%g'%(cutoff,)
-    print(header)
+    print(header, file=out)
 
     if is_2d:
         if not model_info.parameters.has_2d:
-            print(',"1-D only"')
-            return
-
-    # Some not very clean macros for evaluating the models and checking the
-    # results.  They freely use variables from the current scope, even some
-    # which have not been defined yet, complete with abuse of mutable lists
-    # to allow them to update values in the current scope since nonlocal
-    # declarations are not available in python 2.7.
-    def try_model(fn, pars):
+            print(',"1-D only"', file=out)
+            summary['error'] = "1-D only"
+            return summary
+
+    def try_model(calculator, pars, seed):
         """
         Return the model evaluated at *pars*.  If there is an exception,
         print it and return NaN of the right shape.
         """
         try:
-            result = fn(**pars)
+            result = calculator(**pars)
         except Exception:
             traceback.print_exc()
-            print("when comparing %s for %d"%(name, seed))
+            print("when comparing %s for %d"%(name, seed), file=out)
             if hasattr(data, 'qx_data'):
                 result = np.NaN*data.data
             else:
                 result = np.NaN*data.x
         return result
-    def check_model(pars):
+    def evaluate(calculator, pars_list, seeds):
         """
-        Run the two calculators against *pars*, returning statistics
-        on the differences.  See :func:`calc_stats` for the list of stats.
+        Return the model evaluated for every parameter set in *pars_list*
+        and the time taken.  If the batch fails then evaluate the sets one
+        at a time so that the failures are reported for each seed.
         """
-        base_value = try_model(calc_base, pars)
-        comp_value = try_model(calc_comp, pars)
-        stats = calc_stats(base_value, comp_value, index)
-        max_diff[0] = max(max_diff[0], stats[0])
-        good[0] = good[0] and (stats[0] < expected)
-        return list(stats)
-
+        start = perf_counter()
+        try:
+            values = calculator._calc_theory_batch(pars_list, cutoff=cutoff)
+        except Exception:
+            values = [try_model(calculator, p, seed)
+                      for p, seed in zip(pars_list, seeds)]
+        return values, perf_counter() - start
 
     try:
         calc_base = make_engine(model_info, data, base, cutoff)
         calc_comp = make_engine(model_info, data, comp, cutoff)
     except Exception as exc:
         #raise
-        print('"Error: %s"'%str(exc).replace('"', "'"))
-        print('"good","%d of %d","max diff",%g' % (0, N, np.NaN))
-        return
+        print('"Error: %s"'%str(exc).replace('"', "'"), file=out)
+        print('"good","%d of %d","max diff",%g' % (0, N, np.NaN), file=out)
+        summary['error'] = str(exc)
+        return summary
     expected = max(PRECISION[base], PRECISION[comp])
+    summary['base_engine'] = calc_base.engine
+    summary['comp_engine'] = calc_comp.engine
 
-    num_good = 0
-    first = True
-    max_diff = [0]
-    for k in range(N):
-        print("Model %s %d"%(name, k+1), file=sys.stderr)
+    # Draw all the parameter sets first, in the same sequence as when they
+    # were drawn one at a time, so that each seed still gives its set.
+    seeds, pars_list = [], []
+    for _ in range(N):
         seed = np.random.randint(1e6)  # type: int
         np.random.seed(seed)
         pars_i = randomize_pars(model_info, pars)
         constrain_pars(model_info, pars_i)
         if mono:
             pars_i = suppress_pd(pars_i)
+        seeds.append(seed)
+        pars_list.append(pars_i)
 
-        good = [True]
-        columns = check_model(pars_i)
-        columns += [v for _, v in sorted(pars_i.items())]
-        if first:
-            labels = [" vs. ".join((calc_base.engine, calc_comp.engine))]
-            print_column_headers(pars_i, labels)
-            first = False
-        if good[0]:
-            num_good += 1
-        else:
-            print(("%d,"%seed)+','.join("%s"%v for v in columns))
-    print('"good","%d of %d","max diff",%g'%(num_good, N, max_diff[0]))
+    num_good = 0
+    first = True
+    max_diff, worst_seed = 0., None
+    base_time = comp_time = 0.
+    for start in range(0, N, batch):
+        stop = min(start + batch, N)
+        print("Model %s %d-%d"%(name, start+1, stop), file=sys.stderr)
+        batch_pars, batch_seeds = pars_list[start:stop], seeds[start:stop]
+        base_values, elapsed = evaluate(calc_base, batch_pars, batch_seeds)
+        base_time += elapsed
+        comp_values, elapsed = evaluate(calc_comp, batch_pars, batch_seeds)
+        comp_time += elapsed
+        for seed, pars_i, base_value, comp_value in zip(
+                batch_seeds, batch_pars, base_values, comp_values):
+            columns = list(calc_stats(base_value, comp_value, index))
+            if columns[0] > max_diff:
+                max_diff, worst_seed = columns[0], seed
+            columns += [v for _, v in sorted(pars_i.items())]
+            if first:
+                labels = [" vs. ".join((calc_base.engine, calc_comp.engine))]
+                print_column_headers(pars_i, labels, out=out)
+                first = False
+            if columns[0] < expected:
+                num_good += 1
+            else:
+                print(("%d,"%seed)+','.join("%s"%v for v in columns),
+                      file=out)
+    print('"good","%d of %d","max diff",%g'%(num_good, N, max_diff),
+          file=out)
+    summary.update(
+        good=num_good,
+        max_diff=float(max_diff),
+        seed=worst_seed,
+        base_rate=N/base_time if base_time > 0 else None,
+        comp_rate=N/comp_time if comp_time > 0 else None,
+    )
+    return summary
+
+
+def _compare_model(task):
+    # type: (Tuple[str, Dict[str, Any], Dict[str, Any]]) -> Tuple[str, Dict[str, Any]]
+    """
+    Compare one model in a worker process, returning the table as text
+    along with the statistics.
+    """
+    name, data_opts, options = task
+    # Forked workers start with the same random state, so reseed.
+    np.random.seed()
+    data, index = make_data(data_opts)
+    out = StringIO()
+    summary = compare_instance(name, data, index, out=out, **options)
+    return out.getvalue(), summary
 
 
 def print_usage():
@@ -200,7 +273,8 @@ def print_usage():
     """
     Print the command usage string.
     """
-    print("usage: compare_many.py MODEL COUNT (1dNQ|2dNQ) (CUTOFF|mono) (single|double|quad)",
+    print("usage: compare_many.py [-workers=N] [-batch=N] [-stats=path] "
+          "MODEL COUNT (1dNQ|2dNQ) (CUTOFF|mono) (single|double|quad)",
           file=sys.stderr)
 
 
@@ -235,13 +309,25 @@ PRECISION is the floating point precision to use for comparisons.  If two
 precisions are given, then compare one to the other.  Precision is one of
 fast, single, double for GPU or single!, double!, quad! for DLL.  If no
 precision is given, then use single and double! respectively.
-""")
+
+-workers=N compares N models at a time in separate processes.  The tables
+are printed in model order as each model completes.
+
+-batch=N evaluates N parameter sets at a time with each engine.  The
+default is %d.
+
+-stats=path writes a line of JSON for each model to path, giving the
+number of good parameter sets, the largest difference and its seed, and
+the rate for each engine in parameter sets per second.
+""" % COMPARE_BATCH)
 
 def main(argv):
     # type: (List[str]) -> None
     """
     Main program.
     """
+    options = [arg for arg in argv if arg.startswith('-')]
+    argv = [arg for arg in argv if not arg.startswith('-')]
     if len(argv) not in (3, 4, 5, 6):
         print_help()
         return
@@ -266,18 +352,51 @@ Bad model {target}. Use available model or model type.
         cutoff = float(argv[3]) if not mono else 0
         base = argv[4] if len(argv) > 4 else "single"
         comp = argv[5] if len(argv) > 5 else "double!"
+        workers, batch, stats_path = 1, COMPARE_BATCH, None
+        for opt in options:
+            key, _, value = opt[1:].partition('=')
+            if key == 'workers':
+                workers = int(value)
+            elif key == 'batch':
+                batch = int(value)
+            elif key == 'stats':
+                stats_path = value
+            else:
+                raise ValueError("unknown option " + opt)
     except Exception:
         traceback.print_exc()
         print_usage()
         return
 
-    data, index = make_data({
+    data_opts = {
         'qmin': 0.001, 'qmax': 1.0, 'is2d': is2D, 'nq': Nq, 'res': 0.,
         'accuracy': 'Low', 'view':'log', 'zero': False
-        })
-    for model in model_list:
-        compare_instance(model, data, index, N=count, mono=mono,
-                         cutoff=cutoff, base=base, comp=comp)
+        }
+    options = {'N': count, 'mono': mono, 'cutoff': cutoff,
+               'base': base, 'comp': comp, 'batch': batch}
+    stats = open(stats_path, 'w') if stats_path else None
+    try:
+        if workers > 1:
+            tasks = [(model, data_opts, options) for model in model_list]
+            pool = Pool(workers)
+            try:
+                for table, summary in pool.imap(_compare_model, tasks):
+                    sys.stdout.write(table)
+                    sys.stdout.flush()
+                    if stats is not None:
+                        print(json.dumps(summary, sort_keys=True), file=stats)
+            finally:
+                pool.close()
+                pool.join()
+        else:
+            data, index = make_data(data_opts)
+            for model in model_list:
+                summary = compare_instance(model, data, index, **options)
+                if stats is not None:
+                    print(json.dumps(summary, sort_keys=True), file=stats)
+    finally:
+        if stats is not None:
+            stats.close()
 
 if __name__ == "__main__":
     #from .compare import push_seed
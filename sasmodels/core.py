@@ -21,6 +21,7 @@ import numpy as np # type: ignore
 # connection with the card to verify that the environment works.
 from . import generate
 from . import modelinfo
+from . import modelindex
 from . import product
 from . import mixture
 from . import custom
@@ -86,6 +87,9 @@ def list_models(kind=None):
         condition = lambda name: all(_matches(name, k) for k in all_kinds)
     else:
         condition = lambda name: _matches(name, kind)
+    if kind and kind != "all":
+        # Prime the index with all the models so it is saved once.
+        modelindex.summaries(available_models)
     selected = [name for name in available_models if condition(name)]
 
     return selected
@@ -93,10 +97,10 @@ def list_models(kind=None):
 def _matches(name, kind):
     if kind is None or kind == "all":
         return True
-    info = load_model_info(name)
+    info = modelindex.summary(name)
     pars = info.parameters.kernel_parameters
     # TODO: may be adding Fq to the list at some point
-    is_pure_py = callable(info.Iq)
+    is_pure_py = info.python
     if kind == "py":
         return is_pure_py
     elif kind == "c":
@@ -308,21 +312,34 @@ def build_model(model_info, dtype=None, platform="ocl"):
 
     *dtype* indicates whether the model should use single or double precision
     for the calculation.  Choices are 'single', 'double', 'quad', 'half',
-    or 'fast'.  If *dtype* ends with '!', then force the use of the DLL rather
-    than OpenCL for the calculation.
+    'fast' or 'mixed'.  If *dtype* ends with '!', then force the use of the
+    DLL rather than OpenCL for the calculation.  If *dtype* is 'auto', then
+    use the fastest precision approved for the model and device by
+    :mod:`.accuracy`, or the default precision if the model has not been
+    checked.  If *dtype* is 'screen', then use half precision if it is
+    approved for screening, otherwise behave as 'auto'.
 
     *platform* should be "dll" to force the dll to be used for C models,
     otherwise it uses the default "ocl".
     """
     composition = model_info.composition
-    if composition is not None:
+    # Fused compositions are compiled as a single C model below.
+    if composition is not None and not composition[0].startswith('fused'):
         composition_type, parts = composition
         models = [build_model(p, dtype=dtype, platform=platform) for p in parts]
         if composition_type == 'mixture':
-            return mixture.MixtureModel(model_info, models)
+            fused_info = mixture.make_fused_info(model_info)
+            fused = (None if fused_info is None else
+                     lambda: build_model(fused_info, dtype=dtype,
+                                         platform=platform))
+            return mixture.MixtureModel(model_info, models, fused=fused)
         elif composition_type == 'product':
             P, S = models
-            return product.ProductModel(model_info, P, S)
+            fused_info = product.make_fused_info(model_info)
+            fused = (None if fused_info is None else
+                     lambda: build_model(fused_info, dtype=dtype,
+                                         platform=platform))
+            return product.ProductModel(model_info, P, S, fused=fused)
         else:
             raise ValueError('unknown mixture type %s'%composition_type)
 
@@ -331,8 +348,19 @@ def build_model(model_info, dtype=None, platform="ocl"):
         from . import kernelpy
         return kernelpy.PyModel(model_info)
 
-    numpy_dtype, fast, platform = parse_dtype(model_info, dtype, platform)
-    source = generate.make_source(model_info)
+    if dtype == "screen":
+        from . import accuracy
+        dtype = accuracy.screening_dtype(
+            model_info, platform="dll" if platform == "dll" else None)
+    elif dtype == "auto":
+        from . import accuracy
+        dtype = accuracy.approved_dtype(
+            model_info, platform="dll" if platform == "dll" else None)
+    numpy_dtype, fast, platform, mixed = parse_dtype(
+        model_info, dtype, platform)
+    # The GPU models only need the source when the program is compiled on
+    # first evaluation, so generate it then.
+    source = generate.LazySource(model_info, mixed=mixed)
     if platform == "dll":
         from . import kerneldll
         #print("building dll", numpy_dtype)
@@ -345,47 +373,71 @@ def build_model(model_info, dtype=None, platform="ocl"):
         #print("building ocl", numpy_dtype)
         return kernelcl.GpuModel(source, model_info, numpy_dtype, fast=fast)
 
-def precompile_dlls(path, dtype="double"):
-    # type: (str, str) -> List[str]
+def precompile_dlls(path, dtype="double", num_workers=None):
+    # type: (str, str, Optional[int]) -> List[str]
     """
     Precompile the dlls for all builtin models, returning a list of dll paths.
 
     *path* is the directory in which to save the dlls.  It will be created if
     it does not already exist.
 
+    The dll names include a hash of the model source and the compiler
+    command, so only the models which have changed since the last build
+    are compiled.  *num_workers* is the number of compilers to run at
+    once, defaulting to the number of cores.
+
     This can be used when build the windows distribution of sasmodels
     which may be missing the OpenCL driver and the dll compiler.
     """
+    from concurrent.futures import ThreadPoolExecutor
     from . import kerneldll
 
     numpy_dtype = np.dtype(dtype)
     if not os.path.exists(path):
         os.makedirs(path)
-    compiled_dlls = []
+    # Generate the sources up front since model loading isn't thread safe.
+    # The compiles run as subprocesses, so threads are enough to keep all
+    # the cores busy.
+    sources = []
     for model_name in list_models():
         model_info = load_model_info(model_name)
         if not callable(model_info.Iq):
             source = generate.make_source(model_info)['dll']
-            old_path = kerneldll.SAS_DLL_PATH
-            try:
-                kerneldll.SAS_DLL_PATH = path
-                dll = kerneldll.make_dll(source, model_info,
-                                         dtype=numpy_dtype, system=True)
-            finally:
-                kerneldll.SAS_DLL_PATH = old_path
-            compiled_dlls.append(dll)
+            sources.append((source, model_info))
+    def build(item):
+        # type: (Tuple[str, ModelInfo]) -> str
+        source, model_info = item
+        return kerneldll.make_dll(source, model_info,
+                                  dtype=numpy_dtype, system=True)
+    old_path = kerneldll.SAS_DLL_PATH
+    try:
+        kerneldll.SAS_DLL_PATH = path
+        num_workers = num_workers or os.cpu_count() or 1
+        with ThreadPoolExecutor(max_workers=num_workers) as pool:
+            compiled_dlls = list(pool.map(build, sources))
+    finally:
+        kerneldll.SAS_DLL_PATH = old_path
     return compiled_dlls
 
 def parse_dtype(model_info, dtype=None, platform=None):
-    # type: (ModelInfo, str, str) -> Tuple[np.dtype, bool, str]
+    # type: (ModelInfo, str, str) -> Tuple[np.dtype, bool, str, Union[bool, str]]
     """
-    Interpret dtype string, returning np.dtype, fast flag and platform.
+    Interpret dtype string, returning np.dtype, fast flag, platform and
+    mixed flag.
 
     Possible types include 'half', 'single', 'double' and 'quad'.  If the
     type is 'fast', then this is equivalent to dtype 'single' but using
     fast native functions rather than those with the precision level
-    guaranteed by the OpenCL standard.  'default' will choose the appropriate
-    default for the model and platform.
+    guaranteed by the OpenCL standard.  If the type is 'mixed', then the
+    model functions are evaluated in single precision but the weights and
+    the dispersity sums are kept in double precision, so the kernel is
+    built as a double precision kernel from mixed source (see
+    :func:`.generate.make_source`).  If the type is 'half', then the model
+    functions are evaluated in half precision with the sums in single
+    precision, and mixed is returned as 'half'.  This needs an OpenCL device
+    with the cl_khr_fp16 extension; other platforms use single precision
+    instead.  'default' will choose the appropriate default for the model
+    and platform.
 
     Platform preference can be specfied ("ocl", "cuda", "dll"), with the
     default being OpenCL or CUDA if available, otherwise DLL.  If the dtype
@@ -421,14 +473,18 @@ def parse_dtype(model_info, dtype=None, platform=None):
             from . import kernelcuda
             platform = "cuda" if kernelcuda.use_cuda() else "dll"
 
-    # Convert special type names "half", "fast", and "quad"
+    # Convert special type names "half", "fast", "mixed" and "quad"
     fast = (dtype == "fast")
+    mixed = (dtype == "mixed")
     if fast:
         dtype = "single"
+    elif mixed:
+        dtype = "double"
     elif dtype == "quad":
         dtype = "longdouble"
     elif dtype == "half":
-        dtype = "float16"
+        dtype = "single"
+        mixed = "half"
 
     # Convert dtype string to numpy dtype.  Use single precision for GPU
     # if model allows it, otherwise use double precision.
@@ -452,7 +508,12 @@ def parse_dtype(model_info, dtype=None, platform=None):
         if dtype is None:
             numpy_dtype = generate.F64
 
-    return numpy_dtype, fast, platform
+    # Half precision model code needs device support; use single otherwise.
+    if mixed == "half" and (env is None or platform == "dll"
+                            or not env.has_half()):
+        mixed = False
+
+    return numpy_dtype, fast, platform, mixed
 
 def test_composite_order():
     """
@@ -521,6 +582,19 @@ def test_composite():
     target = [*(f"A_{p}" for p in a_parts), *(f"B_{p}" for p in b_parts)]
     assert target == actual, "%s != %s"%(target, actual)
 
+def test_mixed_vector_parameters():
+    # type: () -> None
+    """Check that mixed precision converts the vector parameters"""
+    from .direct_model import call_kernel
+    q = np.logspace(-3, -0.5, 20)
+    pars = dict(radius=50., n=3, sld1=1., sld2=3., sld3=2., thickness1=20.,
+                thickness2=40., thickness3=30., background=0.)
+    target, actual = [
+        call_kernel(load_model("core_multi_shell", dtype=dtype).make_kernel([q]),
+                    pars)
+        for dtype in ("double", "mixed")]
+    assert np.allclose(actual, target, rtol=1e-3, atol=0)
+
 
 def list_models_main():
     # type: () -> int
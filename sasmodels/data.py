@@ -19,6 +19,15 @@ Wrappers for the sasview data loader and data manipulations:
 
     :func:`set_top` cuts the top part off the data.
 
+Memory-mapped storage for sequences of 2D frames on one detector, such as
+from time-resolved measurements:
+
+    :func:`save_frames` writes the frames to a directory of NPY files or to
+    an HDF5 file.
+
+    :func:`load_frames` maps the stored frames into a :class:`Data2DFrames`
+    without reading them.
+
 
 Empty data sets for evaluating models without data:
 
@@ -32,6 +41,7 @@ objects so that models can be run without SasView on the path.  You could
 also use these for your own data loader.
 
 """
+import os
 import traceback
 from functools import wraps
 
@@ -40,7 +50,7 @@ from numpy import sqrt, sin, cos, pi
 
 # pylint: disable=unused-import
 try:
-    from typing import Union, Dict, List, Optional, Tuple, Callable
+    from typing import Any, Union, Dict, List, Optional, Tuple, Callable
     Data = Union["Data1D", "Data2D", "SesansData"]
     OptArray = Optional[np.ndarray]
     OptLimits = Optional[Tuple[float, float]]
@@ -84,15 +94,17 @@ def set_beam_stop(data, radius, outer=None):
     # type: (Data, float, Optional[float]) -> None
     """
     Add a beam stop of the given *radius*.  If *outer*, make an annulus.
+
+    For 2D data the mask is replaced rather than updated in place, so masks
+    shared with other data sets, such as the frames of a
+    :class:`Data2DFrames`, are left alone.
     """
-    try:
-        from sasdata.data_util.manipulations import Ringcut
-    except ImportError as ie:
-        raise ImportError(f"{ie.name} is not available. Add sasdata to the python path.")
     if hasattr(data, 'qx_data'):
-        data.mask = Ringcut(0, radius)(data)
+        q = data.q_data
+        cut = (q <= radius)
         if outer is not None:
-            data.mask += Ringcut(outer, np.inf)(data)
+            cut |= (q >= outer)
+        data.mask = data.mask | cut
     else:
         data.mask = (data.x < radius)
         if outer is not None:
@@ -104,16 +116,10 @@ def set_half(data, half):
     """
     Select half of the data, either "right" or "left".
     """
-    try:
-        from sasdata.data_util.manipulations import Boxcut
-    except ImportError as ie:
-        raise ImportError(f"{ie.name} is not available. Add sasdata to the python path.")
     if half == 'right':
-        data.mask += \
-            Boxcut(x_min=-np.inf, x_max=0.0, y_min=-np.inf, y_max=np.inf)(data)
+        data.mask = data.mask | (data.qx_data < 0.0)
     if half == 'left':
-        data.mask += \
-            Boxcut(x_min=0.0, x_max=np.inf, y_min=-np.inf, y_max=np.inf)(data)
+        data.mask = data.mask | (data.qx_data >= 0.0)
 
 
 def set_top(data, cutoff):
@@ -121,12 +127,7 @@ def set_top(data, cutoff):
     """
     Chop the top off the data, above *cutoff*.
     """
-    try:
-        from sasdata.data_util.manipulations import Boxcut
-    except ImportError as ie:
-        raise ImportError(f"{ie.name} is not available. Add sasdata to the python path.")
-    data.mask += \
-        Boxcut(x_min=-np.inf, x_max=np.inf, y_min=-np.inf, y_max=cutoff)(data)
+    data.mask = data.mask | (data.qy_data < cutoff)
 
 
 class Source:
@@ -241,16 +242,23 @@ class Data2D(object):
     *Q_unit*, *I_unit*: units for Q and intensity
 
     *x_bins*, *y_bins*: grid steps in *x* and *y* directions
+
+    The arrays are used as given, without copying, so they can be views
+    into memory-mapped files.  *mask* defaults to the NaN values in *z*.
+    *q_data* is computed from *qx_data* and *qy_data* when first used.
     """
-    def __init__(self, x=None, y=None, z=None, dx=None, dy=None, dz=None):
-        # type: (OptArray, OptArray, OptArray, OptArray, OptArray, OptArray) -> None
+    _q_data = None  # type: OptArray
+
+    def __init__(self, x=None, y=None, z=None, dx=None, dy=None, dz=None,
+                 mask=None):
+        # type: (OptArray, OptArray, OptArray, OptArray, OptArray, OptArray, OptArray) -> None
         self.qx_data, self.dqx_data = _as_numpy(x), _as_numpy(dx)
         self.qy_data, self.dqy_data = _as_numpy(y), _as_numpy(dy)
         self.data, self.err_data = _as_numpy(z), _as_numpy(dz)
-        self.mask = (np.isnan(z) if z is not None
+        self.mask = (mask if mask is not None
+                     else np.isnan(z) if z is not None
                      else np.zeros_like(x, dtype='bool') if x is not None
                      else None)
-        self.q_data = np.sqrt(self.qx_data**2 + self.qy_data**2)
         self.qmin = 1e-16
         self.qmax = np.inf
         self.detector = []
@@ -266,6 +274,21 @@ class Data2D(object):
         self.x_bins, self.y_bins = None, None
         self.filename = None
 
+    @property
+    def q_data(self):
+        # type: () -> OptArray
+        """
+        $|q|$ matrix.
+        """
+        if self._q_data is None and self.qx_data is not None:
+            self._q_data = np.sqrt(self.qx_data**2 + self.qy_data**2)
+        return self._q_data
+
+    @q_data.setter
+    def q_data(self, value):
+        # type: (OptArray) -> None
+        self._q_data = value
+
     def xaxis(self, label, unit):
         # type: (str, str) -> None
         """
@@ -291,6 +314,152 @@ class Data2D(object):
         self._zunit = unit
 
 
+class Data2DFrames(object):
+    """
+    Sequence of 2D frames measured on one detector.
+
+    *qx_data*, *qy_data*, *dqx_data* and *dqy_data* are the detector
+    vectors shared by all frames, with one value per pixel.  *frames* and
+    *err_frames* have one row per frame.  Use :func:`load_frames` to map
+    them from a file so that only the frames being used are read.
+
+    ``frames[k]`` is a :class:`Data2D` for frame *k* whose arrays are views
+    of the stored rows and of the shared detector vectors, including
+    *q_data*, so creating a frame copies nothing.  The frames share *mask*,
+    *qmin* and *qmax*, which can be set with :func:`set_beam_stop`,
+    :func:`set_half` and :func:`set_top` on the frame set before the frames
+    are created.  Masking a single frame leaves the others alone.
+    """
+    def __init__(self, qx, qy, frames, err_frames=None, dqx=None, dqy=None,
+                 mask=None):
+        # type: (np.ndarray, np.ndarray, np.ndarray, OptArray, OptArray, OptArray, OptArray) -> None
+        self.qx_data, self.qy_data = np.reshape(qx, -1), np.reshape(qy, -1)
+        self.dqx_data = None if dqx is None else np.reshape(dqx, -1)
+        self.dqy_data = None if dqy is None else np.reshape(dqy, -1)
+        self.frames, self.err_frames = frames, err_frames
+        self.q_data = np.sqrt(self.qx_data**2 + self.qy_data**2)
+        self.mask = (np.zeros(self.qx_data.shape, 'bool') if mask is None
+                     else np.reshape(mask, -1))
+        self.qmin = 1e-16
+        self.qmax = np.inf
+        self.filename = None
+        # Keeps the h5py file open for datasets which can't be mapped.
+        self._file = None
+
+    def __len__(self):
+        # type: () -> int
+        return len(self.frames)
+
+    def __getitem__(self, k):
+        # type: (int) -> Data2D
+        def row(v):
+            return None if v is None else np.reshape(v[k], -1)
+        data = Data2D(x=self.qx_data, y=self.qy_data, z=row(self.frames),
+                      dx=self.dqx_data, dy=self.dqy_data,
+                      dz=row(self.err_frames), mask=self.mask)
+        data.q_data = self.q_data
+        data.qmin, data.qmax = self.qmin, self.qmax
+        data.filename = "%s[%d]" % (self.filename, k)
+        return data
+
+    def close(self):
+        # type: () -> None
+        """
+        Close the HDF5 file, if any.  Frames created from unmapped datasets
+        can no longer be read.
+        """
+        if self._file is not None:
+            self._file.close()
+            self._file = None
+
+
+#: Names of the arrays stored by :func:`save_frames`.
+_FRAME_FIELDS = ("qx", "qy", "frames", "err_frames", "dqx", "dqy", "mask")
+
+
+def _is_hdf5(path):
+    # type: (str) -> bool
+    return os.path.splitext(path)[1].lower() in (".h5", ".hdf5", ".hdf")
+
+
+def save_frames(path, qx, qy, frames, err_frames=None, dqx=None, dqy=None,
+                mask=None):
+    # type: (str, np.ndarray, np.ndarray, np.ndarray, OptArray, OptArray, OptArray, OptArray) -> None
+    """
+    Store 2D *frames* with one row per frame for :func:`load_frames`.
+
+    If *path* ends in .h5, .hdf5 or .hdf then the arrays are written as
+    contiguous datasets of an HDF5 file, which needs h5py.  Otherwise
+    *path* is a directory which receives one NPY file for each array.
+    Either way the arrays are stored uncompressed so they can be mapped.
+    """
+    arrays = dict(zip(_FRAME_FIELDS,
+                      (qx, qy, frames, err_frames, dqx, dqy, mask)))
+    arrays = {k: np.asarray(v) for k, v in arrays.items() if v is not None}
+    if _is_hdf5(path):
+        import h5py  # type: ignore
+        with h5py.File(path, "w") as fid:
+            for name, value in arrays.items():
+                fid.create_dataset(name, data=value)
+    else:
+        if not os.path.isdir(path):
+            os.makedirs(path)
+        for name, value in arrays.items():
+            np.save(os.path.join(path, name + ".npy"), value)
+
+
+def _map_dataset(dataset, path):
+    # type: (Any, str) -> Any
+    """
+    Return a read-only memory map of an HDF5 *dataset* in file *path*, or
+    the dataset itself if it is compressed or chunked.
+    """
+    offset = dataset.id.get_offset()
+    if offset is None or dataset.chunks is not None:
+        return dataset
+    return np.memmap(path, mode="r", dtype=dataset.dtype,
+                     shape=dataset.shape, offset=offset)
+
+
+def load_frames(path):
+    # type: (str) -> Data2DFrames
+    """
+    Map the frames stored by :func:`save_frames` into a
+    :class:`Data2DFrames`.
+
+    The frames are memory mapped read-only, so they are only read from
+    disk as they are used.  HDF5 datasets which are compressed or chunked
+    can't be mapped, and their frames are read one at a time instead.
+    """
+    if _is_hdf5(path):
+        import h5py  # type: ignore
+        fid = h5py.File(path, "r")
+        arrays = {name: _map_dataset(fid[name], path)
+                  for name in _FRAME_FIELDS if name in fid}
+    else:
+        fid = None
+        arrays = {}
+        for name in _FRAME_FIELDS:
+            filename = os.path.join(path, name + ".npy")
+            if os.path.exists(filename):
+                arrays[name] = np.load(filename, mmap_mode="r")
+    # The detector vectors are needed for every frame, so read them in case
+    # they are unmapped datasets.
+    for name in ("qx", "qy", "dqx", "dqy", "mask"):
+        if name in arrays:
+            arrays[name] = np.asarray(arrays[name])
+    if "mask" in arrays:
+        arrays["mask"] = arrays["mask"].astype('bool')
+    frames = Data2DFrames(
+        arrays["qx"], arrays["qy"], arrays["frames"],
+        err_frames=arrays.get("err_frames", None),
+        dqx=arrays.get("dqx", None), dqy=arrays.get("dqy", None),
+        mask=arrays.get("mask", None))
+    frames.filename = os.path.basename(path.rstrip(os.sep))
+    frames._file = fid
+    return frames
+
+
 class Vector(object):
     """
     3-space vector of *x*, *y*, *z*
@@ -930,6 +1099,34 @@ def _fillup_pixels(image=None, weights=None):
     return image
 
 
+def test_frames():
+    # type: () -> None
+    """
+    Check that stored frames are mapped and masked without copies.
+    """
+    import shutil
+    import tempfile
+    path = tempfile.mkdtemp()
+    try:
+        qx, qy = np.meshgrid(np.linspace(-0.1, 0.1, 8), np.linspace(-.1, .1, 6))
+        frames = np.random.rand(5, 6, 8)
+        save_frames(path, qx, qy, frames, err_frames=0.1*frames)
+        stack = load_frames(path)
+        assert len(stack) == 5
+        set_beam_stop(stack, 0.05)
+        frame = stack[3]
+        assert np.shares_memory(frame.data, stack.frames)
+        assert frame.q_data is stack.q_data and frame.mask is stack.mask
+        assert np.array_equal(frame.data, frames[3].flatten())
+        assert np.array_equal(frame.mask, np.sqrt(qx**2+qy**2).flatten() <= 0.05)
+        set_half(frame, 'right')
+        assert frame.mask is not stack.mask
+        assert np.array_equal(frame.mask, stack.mask | (frame.qx_data < 0))
+        del frame, stack
+    finally:
+        shutil.rmtree(path, ignore_errors=True)
+
+
 def demo():
     # type: () -> None
     """
@@ -13,10 +13,14 @@ can be passed to one of the computational kernels.
 
 from __future__ import print_function
 
+import os
+from collections import OrderedDict
+
 import numpy as np  # type: ignore
 from numpy import cos, sin, radians
 
-from .modelinfo import NUM_MAGNETIC_PARS, NUM_COMMON_PARS
+from .modelinfo import NUM_MAGNETIC_PARS, NUM_MAGFIELD_PARS, NUM_COMMON_PARS
+from .modelinfo import NUM_SPIN_VALUES
 
 try:
     np.meshgrid([])
@@ -32,7 +36,7 @@ except Exception:
 
 # pylint: disable=unused-import
 try:
-    from typing import List, Tuple, Sequence
+    from typing import List, Tuple, Sequence, Any, Optional
     from .modelinfo import ModelInfo, ParameterTable
     from .kernel import Kernel
 except ImportError:
@@ -65,27 +69,35 @@ class CallDetails(object):
     if the latitude is not a polydisperse parameter.
     """
     parts = None  # type: List["CallDetails"]
+    #: True for the compacted mesh from :func:`flatten_mesh`.
+    flat = False  # type: bool
     def __init__(self, model_info):
         # type: (ModelInfo) -> None
         parameters = model_info.parameters
         max_pd = parameters.max_pd
 
-        # Structure of the call details buffer:
+        # Structure of the call details buffer, matching ProblemDetails in
+        # kernel_iq.c, with the positions in the mesh as 64-bit integers:
+        #   pd_stride[max_pd]  index of pd value in loop = n//stride[k] (i8)
+        #   num_eval           total length of pd loop (i8)
         #   pd_par[max_pd]     pd params in order of length
         #   pd_length[max_pd]  length of each pd param
         #   pd_offset[max_pd]  offset of pd values in parameter array
-        #   pd_stride[max_pd]  index of pd value in loop = n//stride[k]
-        #   num_eval           total length of pd loop
         #   num_weights        total length of the weight vector
         #   num_active         number of pd params
         #   theta_par          parameter number for theta parameter
-        self.buffer = np.empty(4*max_pd + 4, 'i4')
+        # The buffer is int32, padded to a multiple of 8 bytes like the
+        # struct, so that stacked buffers keep the 64-bit fields aligned.
+        wide = 2*(max_pd + 1)
+        self.buffer = np.zeros(wide + 3*max_pd + 3 + (max_pd + 1)%2, 'i4')
 
         # generate views on different parts of the array
-        self._pd_par = self.buffer[0 * max_pd:1 * max_pd]
-        self._pd_length = self.buffer[1 * max_pd:2 * max_pd]
-        self._pd_offset = self.buffer[2 * max_pd:3 * max_pd]
-        self._pd_stride = self.buffer[3 * max_pd:4 * max_pd]
+        self._pd_stride = self.buffer[0:2*max_pd].view('i8')
+        self._num_eval = self.buffer[2*max_pd:wide].view('i8')
+        self._pd_par = self.buffer[wide + 0*max_pd:wide + 1*max_pd]
+        self._pd_length = self.buffer[wide + 1*max_pd:wide + 2*max_pd]
+        self._pd_offset = self.buffer[wide + 2*max_pd:wide + 3*max_pd]
+        self._index = wide + 3*max_pd
 
         # theta_par is fixed
         self.theta_par = parameters.theta_offset
@@ -124,42 +136,42 @@ class CallDetails(object):
     @property
     def num_eval(self):
         """Total size of the pd mesh"""
-        return self.buffer[-4]
+        return self._num_eval[0]
 
     @num_eval.setter
     def num_eval(self, v):
         """Total size of the pd mesh"""
-        self.buffer[-4] = v
+        self._num_eval[0] = v
 
     @property
     def num_weights(self):
         """Total length of all the weight vectors"""
-        return self.buffer[-3]
+        return self.buffer[self._index]
 
     @num_weights.setter
     def num_weights(self, v):
         """Total length of all the weight vectors"""
-        self.buffer[-3] = v
+        self.buffer[self._index] = v
 
     @property
     def num_active(self):
         """Number of active polydispersity loops"""
-        return self.buffer[-2]
+        return self.buffer[self._index + 1]
 
     @num_active.setter
     def num_active(self, v):
         """Number of active polydispersity loops"""
-        self.buffer[-2] = v
+        self.buffer[self._index + 1] = v
 
     @property
     def theta_par(self):
         """Location of the theta parameter in the parameter vector"""
-        return self.buffer[-1]
+        return self.buffer[self._index + 2]
 
     @theta_par.setter
     def theta_par(self, v):
         """Location of the theta parameter in the parameter vector"""
-        self.buffer[-1] = v
+        self.buffer[self._index + 2] = v
 
     def show(self, values=None):
         """Print the polydispersity call details to the console"""
@@ -205,7 +217,8 @@ def make_details(model_info, length, offset, num_weights):
     # Decreasing list of polydpersity lengths
     # Note: the reversing view, x[::-1], does not require a copy
     idx = np.argsort(length)[::-1][:max_pd]
-    pd_stride = np.cumprod(np.hstack((1, length[idx])))
+    # The mesh size can exceed 2^31, so the strides are always 64-bit.
+    pd_stride = np.cumprod(np.hstack((1, length[idx])), dtype='i8')
 
     call_details = CallDetails(model_info)
     call_details.pd_par[:max_pd] = idx
@@ -230,7 +243,53 @@ def make_kernel_args(kernel, mesh):
     Returns a CallDetails object indicating the polydispersity, a data object
     containing the different values, and the magnetic flag indicating whether
     any magnetic magnitudes are non-zero. Magnetic vectors (M0, phi, theta) are
-    converted to rectangular coordinates (mx, my, mz).
+    converted to rectangular coordinates (mx, my, mz), and for magnetic
+    models the polarization analysis from :func:`convert_spin_state` is
+    appended after the weights.
+
+    The most recent results are memoized since fits often change only a few
+    parameters between evaluations.  Callers should not modify the returned
+    values.
+    """
+    key = (id(kernel.info), np.dtype(kernel.dtype).str, _mesh_key(mesh))
+    cached = _KERNEL_ARGS_CACHE.get(key, None)
+    if cached is not None:
+        _KERNEL_ARGS_CACHE.move_to_end(key)
+        return cached[2]
+    result = _make_kernel_args(kernel, mesh)
+    # Keep a reference to model info and the mesh so that the object ids
+    # in the key are not reused while the entry is in the cache.
+    _KERNEL_ARGS_CACHE[key] = (kernel.info, mesh, result)
+    if len(_KERNEL_ARGS_CACHE) > _KERNEL_ARGS_CACHE_SIZE:
+        _KERNEL_ARGS_CACHE.popitem(last=False)
+    return result
+
+# Recent results from make_kernel_args, oldest first.
+_KERNEL_ARGS_CACHE = OrderedDict()  # type: OrderedDict[Tuple, Tuple[Any, Any, Tuple[CallDetails, np.ndarray, bool]]]
+_KERNEL_ARGS_CACHE_SIZE = 16
+
+def _mesh_key(mesh):
+    # type: (List[Tuple[float, np.ndarray, np.ndarray]]) -> Tuple
+    """
+    Return a hashable key for the (value, dispersity, weight) *mesh*.
+
+    Read-only vectors, such as those returned from :func:`.weights.get_weights`,
+    are identified by object id, and everything else by content.
+    """
+    key = []
+    for value, dispersity, weight in mesh:
+        key.append(value)
+        for v in (dispersity, weight):
+            if isinstance(v, np.ndarray) and not v.flags.writeable:
+                key.append(id(v))
+            else:
+                key.append(np.asarray(v, 'd').tobytes())
+    return tuple(key)
+
+def _make_kernel_args(kernel, mesh):
+    # type: (Kernel, Tuple[List[np.ndarray], List[np.ndarray]]) -> Tuple[CallDetails, np.ndarray, bool]
+    """
+    Implementation of :func:`make_kernel_args` without the cache.
     """
     npars = kernel.info.parameters.npars
     nvalues = kernel.info.parameters.nvalues
@@ -244,15 +303,378 @@ def make_kernel_args(kernel, mesh):
     offset = np.cumsum(np.hstack((0, length)))
     call_details = make_details(kernel.info, length, offset[:-1], offset[-1])
     # Pad value array to a 32 value boundary
-    data_len = nvalues + 2*sum(len(v) for v in dispersity)
+    spin_len = NUM_SPIN_VALUES if kernel.info.parameters.nmagnetic else 0
+    data_len = nvalues + 2*sum(len(v) for v in dispersity) + spin_len
     extra = (32 - data_len%32)%32
-    data = np.hstack((scalars,) + dispersity + weight + ZEROS[:extra])
+    spin = (np.zeros(spin_len),)
+    data = np.hstack((scalars,) + dispersity + weight + spin + ZEROS[:extra])
     data = data.astype(kernel.dtype)
     is_magnetic = convert_magnetism(kernel.info.parameters, data)
+    if spin_len:
+        start = nvalues + 2*int(offset[-1])
+        convert_spin_state(kernel.info.parameters, data,
+                           data[start:start+spin_len])
     #call_details.show()
     #print("data", data)
     return call_details, data, is_magnetic
 
+class KernelArgs(object):
+    """
+    Reusable argument buffer for repeated calls to *kernel*.
+
+    :meth:`update` returns the same *(call_details, values, is_magnetic)*
+    as :func:`make_kernel_args`, but while the number of points in each
+    dispersity distribution is unchanged it writes the new values and
+    weights into the previous *values* array in place and keeps the
+    previous *call_details*.  Only a change in the mesh shape builds
+    new arrays.
+
+    Since *values* is overwritten, the result of each kernel call must be
+    retrieved before the next update.  This makes it suitable for a single
+    calculator evaluated in sequence, such as :class:`.direct_model.DataMixin`,
+    but not for batched or concurrent calls.
+    """
+    def __init__(self, kernel):
+        # type: (Kernel) -> None
+        self.kernel = kernel
+        self._lengths = None  # type: Tuple[int, ...]
+        self._call_details = None  # type: CallDetails
+        self._values = None  # type: np.ndarray
+
+    def update(self, mesh):
+        # type: (List[Tuple[float, np.ndarray, np.ndarray]]) -> Tuple[CallDetails, np.ndarray, bool]
+        """
+        Set the kernel arguments from the (value, dispersity, weight) *mesh*.
+        """
+        parameters = self.kernel.info.parameters
+        npars, nvalues = parameters.npars, parameters.nvalues
+        _, dispersity, weight = (
+            zip(*mesh[NUM_COMMON_PARS:npars+NUM_COMMON_PARS]) if npars
+            else ((), (), ()))
+        lengths = tuple(len(w) for w in weight)
+        if lengths != self._lengths:
+            self._call_details, self._values, is_magnetic = \
+                _make_kernel_args(self.kernel, mesh)
+            self._lengths = lengths
+            return self._call_details, self._values, is_magnetic
+
+        values = self._values
+        nweights = int(self._call_details.num_weights)
+        values[:nvalues] = [value for value, _, _ in mesh]
+        if npars:
+            np.concatenate(dispersity, out=values[nvalues:nvalues+nweights])
+            np.concatenate(weight, out=values[nvalues+nweights:nvalues+2*nweights])
+        is_magnetic = convert_magnetism(parameters, values)
+        if parameters.nmagnetic:
+            start = nvalues + 2*nweights
+            spin = values[start:start+NUM_SPIN_VALUES]
+            spin[:] = 0.
+            convert_spin_state(parameters, values, spin)
+        return self._call_details, values, is_magnetic
+
+#: Use the flat mesh kernel if pruning keeps at most this fraction of the
+#: mesh points.  The flat loop has slightly more overhead for each point.
+FLAT_MESH_RATIO = 0.5
+
+#: Replace the tensor product mesh over the (dtheta, dphi) jitter angles by
+#: a near-uniform point set on the sphere when flattening the mesh (see
+#: :func:`jitter_quadrature`).  The value is the number of points for each
+#: cell of the tensor product mesh, so 0.5 uses half as many, and 0 keeps
+#: the tensor product.  The result is an approximation to the tensor
+#: product, which at 0.5 agrees to about 2% for a cylinder with 10 degree
+#: jitter.  Set with SAS_JITTER_QUADRATURE=1 in the environment.
+JITTER_QUADRATURE = float(os.environ.get("SAS_JITTER_QUADRATURE", "0") or "0")
+
+def flatten_mesh(call_details, values, cutoff):
+    # type: (CallDetails, np.ndarray, float) -> Tuple[CallDetails, np.ndarray]
+    """
+    Drop the dispersity mesh points with a weight product below *cutoff*.
+
+    Returns new *(call_details, values)* for the flat mesh kernels, with one
+    value vector for each active dispersity parameter and one vector of
+    product weights, or the inputs if pruning does not remove enough points
+    to be worthwhile (see :data:`FLAT_MESH_RATIO`).  The kernels skip these
+    points anyway, but only after walking to them, which on the GPU is
+    done by every work item.  With Gaussian distributions over several
+    parameters most of the corners of the mesh are below the cutoff.
+
+    If :data:`JITTER_QUADRATURE` is set and both theta and phi have jitter,
+    then their mesh is replaced by the points from :func:`jitter_quadrature`
+    and the flat mesh is used even if nothing is pruned.
+
+    If :data:`.generate.ADAPTIVE_TOLERANCE` is set, the flat mesh is always
+    used, with the points sorted by decreasing weight and the weight of
+    the mesh from each point to the end stored after the product weights.
+    The kernels use this to stop each q value once the points still to
+    come are estimated to be negligible, which at high q, where the
+    oscillations of the dispersed F^2 have averaged out, is after the few
+    points nearest the center of the distributions.
+
+    Composite models slice the call details for their parts, so this
+    should only be used for kernels with *supports_flat*.
+    """
+    num_active = int(call_details.num_active)
+    if num_active < 2 or call_details.flat:
+        return call_details, values
+
+    parameters = call_details.info.parameters
+    nvalues = parameters.nvalues
+    nweights = int(call_details.num_weights)
+    pd_value = values[nvalues:nvalues+nweights].astype('d')
+    pd_weight = values[nvalues+nweights:nvalues+2*nweights].astype('d')
+    pd_par = list(call_details.pd_par[:num_active])
+    lengths = call_details.pd_length[:num_active]
+    offsets = call_details.pd_offset[:num_active]
+    # Each factor of the tensor product is a weight vector together with
+    # the dispersity levels it sets and their value vectors.
+    factors = [(pd_weight[off:off+n], [(k, pd_value[off:off+n])])
+               for k, (n, off) in enumerate(zip(lengths, offsets))]
+
+    jitter = False
+    theta_par = int(call_details.theta_par)
+    if (JITTER_QUADRATURE > 0. and theta_par >= 0
+            and theta_par in pd_par and theta_par+1 in pd_par):
+        from .generate import PROJECTION
+        kt, kp = pd_par.index(theta_par), pd_par.index(theta_par+1)
+        points = jitter_quadrature(
+            factors[kt][1][0][1], factors[kt][0],
+            factors[kp][1][0][1], factors[kp][0],
+            projection=PROJECTION, density=JITTER_QUADRATURE)
+        if points is not None:
+            dtheta, dphi, weight = points
+            factors = [f for k, f in enumerate(factors) if k not in (kt, kp)]
+            factors.append((weight, [(kt, dtheta), (kp, dphi)]))
+            jitter = True
+    from .generate import ADAPTIVE_TOLERANCE
+    force = jitter or bool(ADAPTIVE_TOLERANCE)
+    if cutoff <= 0. and not force:
+        return call_details, values
+
+    index, weight = _prune_product([w for w, _ in factors], cutoff)
+    num_eval = len(weight)
+    if num_eval == 0 or (num_eval > FLAT_MESH_RATIO*int(call_details.num_eval)
+                         and not force):
+        return call_details, values
+    tail = np.zeros((num_active-1)*num_eval)
+    if ADAPTIVE_TOLERANCE:
+        order = np.argsort(-weight, kind='stable')
+        index, weight = index[order], weight[order]
+        tail[:num_eval] = np.cumsum(weight[::-1])[::-1]
+    columns = [None]*num_active  # type: List[np.ndarray]
+    for j, (_, levels) in enumerate(factors):
+        for k, v in levels:
+            columns[k] = v[index[:, j]]
+
+    flat = CallDetails(call_details.info)
+    flat.pd_par[:num_active] = pd_par
+    flat.pd_length[:num_active] = num_eval
+    flat.pd_offset[:num_active] = np.arange(num_active)*num_eval
+    flat.pd_stride[:num_active] = 1
+    flat.num_eval = num_eval
+    flat.num_weights = num_active*num_eval
+    flat.num_active = num_active
+    flat.flat = True
+
+    spin_len = NUM_SPIN_VALUES if parameters.nmagnetic else 0
+    spin_start = nvalues + 2*nweights
+    parts = [values[:nvalues]]
+    parts.extend(columns)
+    parts.append(weight)
+    parts.append(tail)
+    parts.append(values[spin_start:spin_start+spin_len])
+    data_len = nvalues + 2*num_active*num_eval + spin_len
+    parts.append(ZEROS[:(32 - data_len%32)%32])
+    return flat, np.hstack(parts).astype(values.dtype)
+
+def _prune_product(vectors, cutoff):
+    # type: (List[np.ndarray], float) -> Tuple[np.ndarray, np.ndarray]
+    """
+    Return *(index, weight)* for the points in the tensor product of the
+    weight *vectors* whose weight product is above *cutoff*, with one
+    column of *index* for each vector, and the last vector varying fastest.
+    The flat mesh kernels read the index of each point, so this order does
+    not need to match the nested loops of the mesh kernels.
+    """
+    # Largest weight product from the levels that are still to come, so
+    # that points can be pruned as the product is formed.  The weights from
+    # get_weights are normalized so this is at most one, but array weights
+    # may be larger.
+    bound = np.hstack((np.cumprod([np.max(v) for v in vectors][::-1])[::-1][1:],
+                       1.0))
+    index = np.zeros((1, 0), 'i')
+    weight = np.ones(1)
+    for w, limit in zip(vectors, bound):
+        n = len(w)
+        weight = (weight[:, None]*w[None, :]).ravel()
+        index = np.hstack((np.repeat(index, n, axis=0),
+                           np.tile(np.arange(n, dtype='i'), len(index))[:, None]))
+        keep = weight*limit > cutoff
+        weight, index = weight[keep], index[keep]
+    return index, weight
+
+def _cap_points(n, alpha):
+    # type: (int, float) -> Tuple[np.ndarray, np.ndarray, np.ndarray]
+    """
+    Return *n* points (x, y, z) on the spherical cap of angular radius
+    *alpha* radians about the z axis, using a Fibonacci spiral.  Each point
+    represents an equal area of the cap.
+    """
+    k = np.arange(n) + 0.5
+    z = 1.0 - (1.0 - cos(alpha))*k/n
+    r = np.sqrt(np.maximum(1.0 - z**2, 0.))
+    azimuth = k*np.pi*(3.0 - np.sqrt(5.0))
+    return r*cos(azimuth), r*sin(azimuth), z
+
+def jitter_quadrature(dtheta, wtheta, dphi, wphi, projection=1, density=1.0):
+    # type: (np.ndarray, np.ndarray, np.ndarray, np.ndarray, int, float) -> Optional[Tuple[np.ndarray, np.ndarray, np.ndarray]]
+    """
+    Return *(dtheta, dphi, weight)* for a near-uniform set of jitter
+    orientations covering the (*dtheta*, *dphi*) dispersity mesh.
+
+    The tensor product mesh of jitter angles samples the sphere unevenly,
+    crowding the points toward the poles of the projection and wasting the
+    corners of the mesh.  Instead, the points here are spread evenly over
+    the spherical cap which contains the mesh, with one point for each
+    mesh cell times *density*.  The weight for each point is its area times
+    the jitter distribution, interpolated from the mesh weights *wtheta*
+    and *wphi* in the coordinates for *projection* (see *generate.PROJECTION*),
+    so points outside the mesh are dropped.  The angles and weights are
+    returned in the same coordinates, so that after the projection in the
+    kernel the points have the correct orientation and weight.  The weights
+    are on the same scale as the weight products of the mesh so that the
+    cutoff has the same meaning.
+
+    Returns None if the mesh extends beyond dtheta=90 or dphi=180, where
+    the mesh repeats orientations, or if no point has any weight.
+    """
+    dtheta, dphi = np.asarray(dtheta, 'd'), np.asarray(dphi, 'd')
+    if (len(dtheta) < 2 or len(dphi) < 2
+            or np.max(abs(dtheta)) > 90. or np.max(abs(dphi)) > 180.):
+        return None
+    it, ip = np.argsort(dtheta), np.argsort(dphi)
+    dtheta, wtheta = dtheta[it], np.asarray(wtheta, 'd')[it]
+    dphi, wphi = dphi[ip], np.asarray(wphi, 'd')[ip]
+    # Area of a mesh cell in steradians at the pole.
+    cell = (radians(dtheta[-1] - dtheta[0])/(len(dtheta) - 1)
+            * radians(dphi[-1] - dphi[0])/(len(dphi) - 1))
+
+    def to_sphere(theta, phi):
+        """Return the z component of the jitter direction"""
+        if projection == 2:
+            phi = np.clip(phi/np.maximum(cos(radians(theta)), 1e-300),
+                          -180., 180.)
+        return cos(radians(theta))*cos(radians(phi))
+
+    # Cap radius from the boundary of the mesh, plus a point spacing.
+    edge = np.linspace(0., 1., 65)
+    t_lo, t_hi, p_lo, p_hi = dtheta[0], dtheta[-1], dphi[0], dphi[-1]
+    t_edge = np.hstack((t_lo + (t_hi-t_lo)*edge, t_hi + 0*edge,
+                        t_lo + (t_hi-t_lo)*edge, t_lo + 0*edge))
+    p_edge = np.hstack((p_lo + 0*edge, p_lo + (p_hi-p_lo)*edge,
+                        p_hi + 0*edge, p_lo + (p_hi-p_lo)*edge))
+    z_min = np.min(to_sphere(t_edge, p_edge))
+    alpha = min(np.arccos(np.clip(z_min, -1., 1.)) + np.sqrt(cell), np.pi)
+    area = 2*np.pi*(1.0 - cos(alpha))
+    n = max(int(np.ceil(density*area/cell)), 1)
+
+    x, y, z = _cap_points(n, alpha)
+    theta = np.degrees(np.arcsin(np.clip(x, -1., 1.)))
+    phi = np.degrees(np.arctan2(-y, z))
+    cos_theta = cos(radians(theta))
+    if projection == 2:
+        phi = phi*cos_theta
+    # Interpolate the log of the weights, which is much closer than linear
+    # interpolation for gaussian weights on a coarse mesh.
+    log_wtheta = np.log(np.maximum(wtheta, 1e-300))
+    log_wphi = np.log(np.maximum(wphi, 1e-300))
+    rho = np.exp(np.interp(theta, dtheta, log_wtheta, left=-np.inf, right=-np.inf)
+                 + np.interp(phi, dphi, log_wphi, left=-np.inf, right=-np.inf))
+    weight = rho*(area/n/cell)
+    if projection != 2:
+        # The kernel scales the weight by |cos(dtheta)| for equirectangular.
+        index = cos_theta > 1e-10
+        theta, phi, weight, cos_theta = (
+            theta[index], phi[index], weight[index], cos_theta[index])
+        weight = weight/cos_theta
+    index = weight > 0.
+    if not index.any():
+        return None
+    return theta[index], phi[index], weight[index]
+
+def stack_batch_args(call_details_list, values_list, dtype):
+    # type: (List[CallDetails], List[np.ndarray], np.dtype) -> Tuple[np.ndarray, np.ndarray, int]
+    """
+    Stack the call details and values for a batch of parameter sets into
+    contiguous matrices for the batch kernels, padding the values with zero
+    to the longest row.  The inputs are lists of the *call_details* and
+    *values* returned from :func:`make_kernel_args`.
+
+    Returns *details*, *values* and the *num_eval* for the largest
+    dispersity mesh in the batch.
+    """
+    details = np.ascontiguousarray(
+        np.vstack([d.buffer for d in call_details_list]), dtype='i4')
+    width = max(len(v) for v in values_list)
+    width = ((width+31)//32)*32
+    values = np.zeros((len(values_list), width), dtype=dtype)
+    for row, v in zip(values, values_list):
+        row[:len(v)] = v
+    num_eval = max(int(d.num_eval) for d in call_details_list)
+    return details, values, num_eval
+
+#: Number of work items to aim for when the GPU kernels divide each launch
+#: over the dispersity mesh as well as over q (see :func:`split_mesh`).
+SPLIT_WORK_ITEMS = 1 << 16
+
+#: Fewest mesh points in each part of a divided launch, so that the cost of
+#: setting up each work item is spread over enough kernel calls.
+SPLIT_MIN_PART = 64
+
+#: Largest number of parts, which is within the CUDA limit of 65535 on the
+#: grid height.
+SPLIT_MAX_PARTS = 32768
+
+def split_mesh(nq, num_eval, step):
+    # type: (int, int, int) -> Optional[Tuple[int, int]]
+    """
+    Return *(part_size, num_parts)* for dividing GPU launches of up to
+    *step* mesh points into parts of *part_size* points, or None if the
+    *nq* q values already provide enough work items or the *num_eval* mesh
+    points do not fill at least two parts.
+
+    Each launch then covers up to ``part_size*num_parts`` mesh points on
+    *nq* by *num_parts* work items, with each part accumulating into its own
+    row of partial sums.
+    """
+    if 2*nq > SPLIT_WORK_ITEMS:
+        return None
+    span = min(step, num_eval)
+    part_size = max(SPLIT_MIN_PART, -(-span*nq//SPLIT_WORK_ITEMS))
+    num_parts = min(-(-span//part_size), SPLIT_MAX_PARTS)
+    if num_parts < 2:
+        return None
+    return part_size, num_parts
+
+def dependency_key(call_details, values, nvalues):
+    # type: (CallDetails, np.ndarray, int) -> Tuple[bytes, bytes]
+    """
+    Return a key for the subset of *values* that a kernel actually uses.
+
+    Composite models pass the complete weight vector to each part, so the
+    *values* for a part change whenever the dispersity of any other part
+    changes.  The key includes the first *nvalues* entries, the dispersity
+    values and weights for the parameters in *call_details*, and anything
+    following the weights, such as the derived spin values.  Two calls with
+    equal keys and equal *call_details.buffer* give the same result.
+    """
+    nweights = call_details.num_weights
+    index = np.hstack([np.arange(nvalues)] + [
+        np.arange(start, start+n)
+        for n, off in zip(call_details.length, call_details.offset)
+        for start in (nvalues + off, nvalues + nweights + off)
+        ] + [np.arange(nvalues + 2*nweights, len(values))])
+    return call_details.buffer.tobytes(), values[index].tobytes()
+
 def correct_theta_weights(parameters, dispersity, weights):
     # type: (ParameterTable, Sequence[np.ndarray], Sequence[np.ndarray]) -> Sequence[np.ndarray]
     """
@@ -306,6 +728,53 @@ def convert_magnetism(parameters, values):
         return False
 
 
+def convert_spin_state(parameters, values, block):
+    # type: (ParameterTable, np.ndarray, np.ndarray) -> None
+    """
+    Analyse the polarization state (up_frac_i, up_frac_f, up_theta, up_phi)
+    into *block*, which the magnetic kernels read after the dispersity
+    weights, so that the kernel does not need to repeat the analysis.
+
+    The block holds the polarization direction P, the directions perpy and
+    perpz perpendicular to it (perpy has no z component), the number of
+    cross sections with significant weight, and the list of those cross
+    sections (0=dd, 1=du.real, 2=ud.real, 3=uu, 4=du.imag, 5=ud.imag)
+    followed by their weights.  Unused entries are zero.
+    """
+    nmagpars = NUM_MAGNETIC_PARS*parameters.nmagnetic
+    spin_index = parameters.nvalues - nmagpars - NUM_MAGFIELD_PARS
+    up_frac_i, up_frac_f, up_theta, up_phi = (
+        float(v) for v in values[spin_index:spin_index+NUM_MAGFIELD_PARS])
+
+    # The polarization efficiency ranges from 0.5 for an unpolarized beam to
+    # 1 for perfect optics, with values below 0.5 for a flipped spin state.
+    # The weights apply to the intensity rather than the amplitude, so no
+    # square root is needed.  The norm makes the spin resolved cross
+    # sections add up to the unpolarized or half-polarized cross section.
+    in_spin = min(max(up_frac_i, 0.0), 1.0)
+    out_spin = min(max(up_frac_f, 0.0), 1.0)
+    norm = 1.0 - out_spin if out_spin < 0.5 else out_spin
+    dd = (1.0-in_spin) * (1.0-out_spin) / norm
+    du = (1.0-in_spin) * out_spin / norm
+    ud = in_spin * (1.0-out_spin) / norm
+    uu = in_spin * out_spin / norm
+    weights = [dd, du, ud, uu, du, ud]
+    active = [xs for xs, w in enumerate(weights) if w > 1e-8]
+
+    theta, phi = radians(up_theta), radians(up_phi)
+    sin_theta, cos_theta = sin(theta), cos(theta)
+    sin_phi, cos_phi = sin(phi), cos(phi)
+    block[:] = 0.
+    block[0:8] = [
+        sin_theta*cos_phi, sin_theta*sin_phi, cos_theta,  # P
+        -sin_phi, cos_phi,  # perpy
+        -cos_theta*cos_phi, -cos_theta*sin_phi, sin_theta,  # perpz
+        ]
+    block[8] = len(active)
+    block[9:9+len(active)] = active
+    block[15:15+len(active)] = [weights[xs] for xs in active]
+
+
 def dispersion_mesh(model_info, mesh):
     # type: (ModelInfo, List[Tuple[float, np.ndarray, np.ndarray]]) -> Tuple[List[np.ndarray], List[np.ndarray]]
     """
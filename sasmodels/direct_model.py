@@ -23,25 +23,46 @@ on the individual parameters and send the model to the Bumps optimizers.
 from __future__ import print_function, division
 
 import os
+import copy
+import hashlib
+import threading
 
 import numpy as np  # type: ignore
 
 # TODO: fix sesans module
 from . import sesans  # type: ignore
 from . import weights
+from . import profiling
 from . import resolution
 from . import resolution2d
-from .details import make_kernel_args, dispersion_mesh
+from . import generate
+from .details import make_kernel_args, dispersion_mesh, KernelArgs
+from .details import flatten_mesh
 from .product import RADIUS_MODE_ID
 
 # pylint: disable=unused-import
-from typing import Optional, Dict, Tuple, List, Callable
+from typing import Any, Optional, Dict, Tuple, List, Callable
 from collections import OrderedDict
 from .data import Data
-from .kernel import Kernel, KernelModel
+from .kernel import Kernel, KernelModel, KernelFuture
+from .details import CallDetails
 from .modelinfo import Parameter, ParameterSet, ModelInfo
 # pylint: enable=unused-import
 
+#: Apply the resolution weights next to the kernel when the resolution is a
+#: simple weighted sum, so that only the smeared values are returned from
+#: the device.  The unsmeared theory is then not available as *Iq_calc*.
+#: Set this to False before creating the calculator to smear on the host.
+FUSE_RESOLUTION = True
+
+#: Evaluate 2D data only at the distinct points after folding each q onto
+#: its mate -q (see :func:`.resolution2d.fold_q`), then copy the results
+#: back to every point.  Magnetic models are evaluated on all the points
+#: when the magnetism is turned on, and models with their own *Iqxy* are
+#: never folded (see :func:`.generate.is_friedel_symmetric`).  Set this to
+#: False before creating the calculator to evaluate every point.
+FOLD_2D = True
+
 def call_kernel(calculator, pars, cutoff=0., mono=False):
     # type: (Kernel, ParameterSet, float, bool) -> np.ndarray
     """
@@ -56,12 +77,74 @@ def call_kernel(calculator, pars, cutoff=0., mono=False):
 
     *mono* is True if polydispersity should be set to none on all parameters.
     """
-    mesh = get_mesh(calculator.info, pars, dim=calculator.dim, mono=mono)
-    #print("in call_kernel: pars:", list(zip(*mesh))[0])
-    call_details, values, is_magnetic = make_kernel_args(calculator, mesh)
+    with profiling.stage("mesh", calculator.info.name):
+        mesh = get_mesh(calculator.info, pars, dim=calculator.dim, mono=mono)
+        #print("in call_kernel: pars:", list(zip(*mesh))[0])
+        call_details, values, is_magnetic = make_kernel_args(calculator, mesh)
+        call_details, values = _flatten(calculator, call_details, values,
+                                        cutoff)
     #print("in call_kernel: values:", values)
     return calculator(call_details, values, cutoff, is_magnetic)
 
+def call_kernel_smeared(calculator, pars, cutoff=0., mono=False):
+    # type: (Kernel, ParameterSet, float, bool) -> np.ndarray
+    """
+    Like :func:`call_kernel`, but returning I(q) smeared by the resolution
+    weights given to *calculator.set_resolution*.
+    """
+    with profiling.stage("mesh", calculator.info.name):
+        mesh = get_mesh(calculator.info, pars, dim=calculator.dim, mono=mono)
+        call_details, values, is_magnetic = make_kernel_args(calculator, mesh)
+        call_details, values = _flatten(calculator, call_details, values,
+                                        cutoff)
+    return calculator.Iq_smeared(call_details, values, cutoff, is_magnetic)
+
+def call_kernel_async(calculator, pars, cutoff=0., mono=False):
+    # type: (Kernel, ParameterSet, float, bool) -> KernelFuture
+    """
+    Like :func:`call_kernel`, but returns a :class:`.kernel.KernelFuture`
+    as soon as the calculation is started.  Use *future.result()* to
+    retrieve I(q).
+
+    Kernels for different models can run at the same time, so start all
+    of them before waiting for the results.
+    """
+    with profiling.stage("mesh", calculator.info.name):
+        mesh = get_mesh(calculator.info, pars, dim=calculator.dim, mono=mono)
+        call_details, values, is_magnetic = make_kernel_args(calculator, mesh)
+        call_details, values = _flatten(calculator, call_details, values,
+                                        cutoff)
+    return calculator.Iq_async(call_details, values, cutoff, is_magnetic)
+
+def call_kernel_batch(calculator, pars_list, cutoff=0., mono=False):
+    # type: (Kernel, List[ParameterSet], float, bool) -> np.ndarray
+    """
+    Like :func:`call_kernel`, but evaluating a list of parameter sets at
+    once, returning an array with one row of I(q) for each set.
+
+    GPU kernels evaluate the whole batch in a single launch, which is much
+    more efficient than separate calls when *q* is small.
+    """
+    call_details_list, values_list, any_magnetic = _batch_args(
+        calculator, pars_list, mono=mono)
+    return calculator.Iq_batch(call_details_list, values_list, cutoff,
+                               any_magnetic)
+
+def _batch_args(calculator, pars_list, mono=False):
+    # type: (Kernel, List[ParameterSet], bool) -> Tuple[List[CallDetails], List[np.ndarray], bool]
+    # Kernel arguments for each parameter set, and whether any is magnetic.
+    call_details_list, values_list, any_magnetic = [], [], False
+    with profiling.stage("mesh", calculator.info.name):
+        for pars in pars_list:
+            mesh = get_mesh(calculator.info, pars, dim=calculator.dim,
+                            mono=mono)
+            call_details, values, is_magnetic = make_kernel_args(
+                calculator, mesh)
+            call_details_list.append(call_details)
+            values_list.append(values)
+            any_magnetic = any_magnetic or is_magnetic
+    return call_details_list, values_list, any_magnetic
+
 def call_Fq(calculator, pars, cutoff=0., mono=False):
     # type: (Kernel, ParameterSet, float, bool) -> np.ndarray
     """
@@ -74,12 +157,25 @@ def call_Fq(calculator, pars, cutoff=0., mono=False):
     model.
     """
     R_eff_type = int(pars.pop(RADIUS_MODE_ID, 1.0))
-    mesh = get_mesh(calculator.info, pars, dim=calculator.dim, mono=mono)
-    #print("in call_Fq: pars", list(zip(*mesh))[0])
-    call_details, values, is_magnetic = make_kernel_args(calculator, mesh)
+    with profiling.stage("mesh", calculator.info.name):
+        mesh = get_mesh(calculator.info, pars, dim=calculator.dim, mono=mono)
+        #print("in call_Fq: pars", list(zip(*mesh))[0])
+        call_details, values, is_magnetic = make_kernel_args(calculator, mesh)
+        call_details, values = _flatten(calculator, call_details, values,
+                                        cutoff)
     #print("in call_Fq: values:", values)
     return calculator.Fq(call_details, values, cutoff, is_magnetic, R_eff_type)
 
+def _flatten(calculator, call_details, values, cutoff):
+    # type: (Kernel, CallDetails, np.ndarray, float) -> Tuple[CallDetails, np.ndarray]
+    """
+    Drop the mesh points below *cutoff* if the kernel supports a flat mesh.
+    See :func:`.details.flatten_mesh`.
+    """
+    if calculator.supports_flat:
+        return flatten_mesh(call_details, values, cutoff)
+    return call_details, values
+
 def call_profile(model_info, pars=None):
     # type: (ModelInfo, ParameterSet) -> Tuple[np.ndarray, np.ndarray, Tuple[str, str]]
     """
@@ -199,13 +295,23 @@ class DataMixin(object):
     *_set_data* sets the intensity data in the data object,
     possibly with random noise added.  This is useful for simulating a
     dataset with the results from *_calc_theory*.
+
+    If *shared* is a :class:`SharedQ` registry then the model is evaluated
+    through the registry rather than with a kernel of its own.
     """
-    def _interpret_data(self, data: Data, model: KernelModel) -> None:
-        # not type: (Data, KernelModel) -> None
+    def _interpret_data(self, data: Data, model: KernelModel,
+                        shared: "Optional[SharedQ]"=None) -> None:
+        # not type: (Data, KernelModel, Optional[SharedQ]) -> None
         # pylint: disable=attribute-defined-outside-init
 
+        if shared is not None and shared.model is not model:
+            raise ValueError("shared q registry is for a different model")
         self._data = data
         self._model = model
+        self._shared = shared
+        self._shared_slot = None  # type: Optional[int]
+        self._shared_q = None  # type: Optional[np.ndarray]
+        self._inputs = None  # type: Optional[SharedInputs]
 
         # interpret data
         if getattr(data, 'isSesans', False):
@@ -227,13 +333,20 @@ class DataMixin(object):
         elif self.data_type == 'Iqxy':
             #if not model.info.parameters.has_2d:
             #    raise ValueError("not 2D without orientation or magnetic parameters")
-            q = np.sqrt(data.qx_data**2 + data.qy_data**2)
+            q = getattr(data, 'q_data', None)
+            if q is None:
+                q = np.sqrt(data.qx_data**2 + data.qy_data**2)
             qmin = getattr(data, 'qmin', 1e-16)
             qmax = getattr(data, 'qmax', np.inf)
             accuracy = getattr(data, 'accuracy', 'Low')
             index = (data.mask == 0) & (q >= qmin) & (q <= qmax)
             if data.data is not None:
                 index &= ~np.isnan(data.data)
+            # Use views rather than copies of the data if nothing is masked,
+            # which matters for large memory-mapped frames.
+            if index.all():
+                index = slice(None, None)
+            if data.data is not None:
                 Iq = data.data[index]
                 dIq = data.err_data[index]
             else:
@@ -287,9 +400,27 @@ class DataMixin(object):
         # Remember function inputs so we can delay loading the function and
         # so we can save/restore state
         self._kernel = None
+        self._kernel_args = None  # type: Optional[KernelArgs]
+        self._full_kernel = None  # type: Optional[Kernel]
+        self._unfold = None  # type: Optional[np.ndarray]
+        self._fused = False
         self.Iq, self.dIq, self.index = Iq, dIq, index
         self.resolution = res
         self.results = None  # type: Optional[Callable[[], OrderedDict]]
+        if shared is not None:
+            self._register_shared()
+
+    def _register_shared(self):
+        # type: () -> None
+        # pylint: disable=attribute-defined-outside-init
+        # Resolution can be replaced after the data is interpreted, such as
+        # by multiple scattering, so remember which q_calc was registered.
+        self._shared_q = self.resolution.q_calc
+        kernel_inputs = self._shared_q
+        if isinstance(kernel_inputs, np.ndarray):
+            kernel_inputs = (kernel_inputs,)
+        self._shared_slot = self._shared.register(
+            kernel_inputs, slot=self._shared_slot)
 
     def _set_data(self, Iq, noise=None):
         # type: (np.ndarray, Optional[float]) -> None
@@ -320,33 +451,200 @@ class DataMixin(object):
         else:
             raise ValueError("Unknown model")
 
+    def _adapt_resolution(self, pars, tol=resolution.ADAPTIVE_TOLERANCE):
+        # type: (ParameterSet, float) -> None
+        """
+        Replace the 1D resolution by one on the points chosen by
+        :func:`.resolution.adaptive_q_calc` for the model at *pars*, so
+        that the theory is evaluated at fewer points in later calls.
+        Resolutions without an *adapt* method are left unchanged.
+        """
+        # pylint: disable=attribute-defined-outside-init
+        adapt = getattr(self.resolution, 'adapt', None)
+        if adapt is None:
+            return
+        pars = dict(pars, background=0.)
+        def theory(q):
+            # type: (np.ndarray) -> np.ndarray
+            kernel = self._model.make_kernel([q])
+            try:
+                return call_kernel(kernel, pars)
+            finally:
+                kernel.release()
+        self.resolution = adapt(theory, tol=tol)
+        self._release_kernel()
+        if self._shared is not None:
+            self._register_shared()
+
     def _calc_theory(self, pars, cutoff=0.0):
         # type: (ParameterSet, float) -> np.ndarray
+        if self._shared is not None:
+            return self._calc_shared_theory(pars, cutoff)
+        self._make_kernel()
+
+        # Need to pull background out of resolution for multiple scattering
+        default_background = self._model.info.parameters.common_parameters[1].default
+        background = (
+            pars.get('background', default_background)
+            if self.data_type != 'sesans' else 0.)
+        pars = pars.copy()
+        pars['background'] = 0.
+
+        # Evaluation is sequential, so the kernel arguments can be updated
+        # in place for each call.
+        kernel = self._kernel
+        with profiling.stage("mesh", kernel.info.name):
+            mesh = get_mesh(kernel.info, pars, dim=kernel.dim)
+            call_details, values, is_magnetic = self._kernel_args.update(mesh)
+            call_details, values = _flatten(kernel, call_details, values,
+                                            cutoff)
+        kernel, unfold = self._select_kernel(is_magnetic)
+
+        if self._fused:
+            result = kernel.Iq_smeared(call_details, values, cutoff, is_magnetic)
+            self.results = getattr(kernel, 'results', None)
+            self.Iq_calc = None
+            return result + background
+
+        Iq_calc = kernel(call_details, values, cutoff, is_magnetic)
+        self.results = getattr(kernel, 'results', None)
+        if unfold is not None:
+            Iq_calc = Iq_calc[unfold]
+        # Storing the calculated Iq values so that they can be plotted.
+        # Only applies to oriented USANS data for now.
+        # TODO: extend plotting of calculate Iq to other measurement types
+        # TODO: refactor so we don't store the result in the model
+        self.Iq_calc = Iq_calc
+        with profiling.stage("smear", kernel.info.name):
+            result = self.resolution.apply(Iq_calc)
+        if hasattr(self.resolution, 'nx'):
+            self.Iq_calc = (
+                self.resolution.qx_calc, self.resolution.qy_calc,
+                np.reshape(Iq_calc, (self.resolution.ny, self.resolution.nx))
+            )
+        return result + background
+
+    def _make_kernel(self):
+        # type: () -> None
+        # pylint: disable=attribute-defined-outside-init
+        # Models from watch.watch_model swap in a new build when the model
+        # files change, which needs a new kernel.
+        generation = getattr(self._model, 'generation', 0)
+        if (self._kernel is not None
+                and generation != getattr(self, '_kernel_generation', 0)):
+            self._release_kernel()
         if self._kernel is None:
+            self._kernel_generation = generation
             # TODO: change interfaces so that resolution returns kernel inputs
             # Maybe have resolution always return a tuple, or maybe have
             # make_kernel accept either an ndarray or a pair of ndarrays.
             kernel_inputs = self.resolution.q_calc
             if isinstance(kernel_inputs, np.ndarray):
                 kernel_inputs = (kernel_inputs,)
-            self._kernel = self._model.make_kernel(kernel_inputs)
+            weight_matrix = getattr(self.resolution, 'weight_matrix', None)
+            self._fused = FUSE_RESOLUTION and weight_matrix is not None
+            self._unfold = None
+            if (FOLD_2D and self.data_type == 'Iqxy'
+                    and generate.is_friedel_symmetric(self._model.info)):
+                qx_fold, qy_fold, unfold = resolution2d.fold_q(*kernel_inputs)
+                if len(qx_fold) < len(unfold):
+                    kernel_inputs = (qx_fold, qy_fold)
+                    self._unfold = unfold
+                    if self._fused:
+                        weight_matrix = resolution2d.fold_weights(
+                            weight_matrix, unfold, len(qx_fold))
+            self._kernel = self._new_kernel(kernel_inputs)
+            self._kernel_args = KernelArgs(self._kernel)
+            if self._fused:
+                self._kernel.set_resolution(weight_matrix)
+
+    def _new_kernel(self, q_vectors):
+        # type: (List[np.ndarray]) -> Kernel
+        if self._inputs is not None:
+            q_vectors = self._inputs.get(self._model, q_vectors)
+        return self._model.make_kernel(q_vectors)
+
+    def _select_kernel(self, is_magnetic):
+        # type: (bool) -> Tuple[Kernel, Optional[np.ndarray]]
+        """
+        Return the kernel to call and the index which maps its result back
+        to *q_calc*, or None if it is evaluated at *q_calc* directly.
+
+        Magnetism breaks the symmetry used to fold the 2D points, so the
+        folded kernel is replaced by one on every point of *q_calc*, made
+        the first time it is needed.
+        """
+        # pylint: disable=attribute-defined-outside-init
+        if self._unfold is None:
+            return self._kernel, None
+        if not is_magnetic:
+            return self._kernel, self._unfold
+        if self._full_kernel is None:
+            self._full_kernel = self._new_kernel(self.resolution.q_calc)
+            if self._fused:
+                self._full_kernel.set_resolution(self.resolution.weight_matrix)
+        return self._full_kernel, None
+
+    def _release_kernel(self):
+        # type: () -> None
+        # pylint: disable=attribute-defined-outside-init
+        for kernel in (self._kernel, self._full_kernel):
+            if kernel is not None:
+                kernel.release()
+        self._kernel = self._full_kernel = self._kernel_args = None
+        self._unfold = None
+
+    def _calc_theory_batch(self, pars_list, cutoff=0.0):
+        # type: (List[ParameterSet], float) -> List[np.ndarray]
+        """
+        Return the theory for each parameter set in *pars_list*, with the
+        kernel evaluated for the whole list in one batch call.
+
+        Shared, fused and composite kernels are called once for each set.
+        *Iq_calc* and *results* are not updated.
+        """
+        if self._shared is not None:
+            return [self._calc_theory(pars, cutoff) for pars in pars_list]
+        self._make_kernel()
+        if self._fused or self._kernel.info.composition is not None:
+            return [self._calc_theory(pars, cutoff) for pars in pars_list]
 
-        # Need to pull background out of resolution for multiple scattering
+        default_background = self._model.info.parameters.common_parameters[1].default
+        backgrounds, zeroed = [], []
+        for pars in pars_list:
+            backgrounds.append(
+                pars.get('background', default_background)
+                if self.data_type != 'sesans' else 0.)
+            pars = pars.copy()
+            pars['background'] = 0.
+            zeroed.append(pars)
+        call_details_list, values_list, any_magnetic = _batch_args(
+            self._kernel, zeroed)
+        kernel, unfold = self._select_kernel(any_magnetic)
+        Iq_batch = kernel.Iq_batch(call_details_list, values_list, cutoff,
+                                   any_magnetic)
+        if unfold is not None:
+            Iq_batch = Iq_batch[:, unfold]
+        with profiling.stage("smear", kernel.info.name):
+            return [self.resolution.apply(Iq_calc) + background
+                    for Iq_calc, background in zip(Iq_batch, backgrounds)]
+
+    def _calc_shared_theory(self, pars, cutoff):
+        # type: (ParameterSet, float) -> np.ndarray
+        # pylint: disable=attribute-defined-outside-init
+        if self.resolution.q_calc is not self._shared_q:
+            self._register_shared()
         default_background = self._model.info.parameters.common_parameters[1].default
         background = (
             pars.get('background', default_background)
             if self.data_type != 'sesans' else 0.)
         pars = pars.copy()
         pars['background'] = 0.
-
-        Iq_calc = call_kernel(self._kernel, pars, cutoff=cutoff)
-        self.results = getattr(self._kernel, 'results', None)
-        # Storing the calculated Iq values so that they can be plotted.
-        # Only applies to oriented USANS data for now.
-        # TODO: extend plotting of calculate Iq to other measurement types
-        # TODO: refactor so we don't store the result in the model
+        Iq_calc = self._shared.evaluate(self._shared_slot, pars, cutoff)
+        self.results = self._shared.results
         self.Iq_calc = Iq_calc
-        result = self.resolution.apply(Iq_calc)
+        with profiling.stage("smear", self._model.info.name):
+            result = self.resolution.apply(Iq_calc)
         if hasattr(self.resolution, 'nx'):
             self.Iq_calc = (
                 self.resolution.qx_calc, self.resolution.qy_calc,
@@ -355,6 +653,159 @@ class DataMixin(object):
         return result + background
 
 
+def _pars_key(pars):
+    # type: (ParameterSet) -> Tuple
+    # Hashable snapshot of the parameter values for detecting repeat calls.
+    return tuple(sorted(
+        (k, tuple(np.ravel(v)) if isinstance(v, np.ndarray) else v)
+        for k, v in pars.items()))
+
+
+class SharedQ(object):
+    """
+    Registry of calculation points for several datasets fit with the same
+    *model*.
+
+    Each dataset registers its *q_calc* vectors, and the registry merges
+    them into a single kernel with each distinct point evaluated once.  The
+    result for the most recent parameter set is kept, so datasets which are
+    evaluated at the same parameter values in turn, as happens in a global
+    fit where only a few parameters differ between datasets, share a single
+    kernel call.  Pass the registry as *shared* to :class:`DirectModel` or
+    :class:`.bumps_model.Experiment` for each dataset.
+
+    All datasets must use the same number of q dimensions.  Resolution is
+    always applied on the host since each dataset has its own weights.
+    """
+    def __init__(self, model):
+        # type: (KernelModel) -> None
+        self.model = model
+        self.results = None  # type: Optional[Callable[[], OrderedDict]]
+        self._inputs = []  # type: List[Tuple[np.ndarray, ...]]
+        self._index = None  # type: Optional[List[np.ndarray]]
+        self._kernel = None  # type: Optional[Kernel]
+        self._kernel_args = None  # type: Optional[KernelArgs]
+        self._key = None  # type: Optional[Tuple]
+        self._Iq = None  # type: Optional[np.ndarray]
+        self._size = 0
+
+    def register(self, q_calc, slot=None):
+        # type: (Tuple[np.ndarray, ...], Optional[int]) -> int
+        """
+        Add the calculation points *q_calc* to the registry, returning the
+        slot to pass to :meth:`evaluate`.  If *slot* is given then the points
+        for that slot are replaced.
+        """
+        q_calc = tuple(np.asarray(q, 'd').ravel() for q in q_calc)
+        if self._inputs and len(q_calc) != len(self._inputs[0]):
+            raise ValueError("shared q registry needs the same q dimensions")
+        if slot is None:
+            slot = len(self._inputs)
+            self._inputs.append(q_calc)
+        else:
+            self._inputs[slot] = q_calc
+        self.release()
+        return slot
+
+    @property
+    def size(self):
+        # type: () -> int
+        """Number of distinct points in the merged kernel."""
+        if self._kernel is None:
+            self._build()
+        return self._size
+
+    def evaluate(self, slot, pars, cutoff=0.):
+        # type: (int, ParameterSet, float) -> np.ndarray
+        """
+        Return I(q) at the points registered in *slot* for the parameters
+        *pars*, reusing the previous kernel call if *pars* and *cutoff* are
+        unchanged.
+        """
+        if self._kernel is None:
+            self._build()
+        key = _pars_key(pars), cutoff
+        if key != self._key:
+            kernel = self._kernel
+            with profiling.stage("mesh", kernel.info.name):
+                mesh = get_mesh(kernel.info, pars, dim=kernel.dim)
+                call_details, values, is_magnetic = \
+                    self._kernel_args.update(mesh)
+                call_details, values = _flatten(kernel, call_details, values,
+                                                cutoff)
+            self._Iq = kernel(call_details, values, cutoff, is_magnetic)
+            self.results = getattr(kernel, 'results', None)
+            self._key = key
+        return self._Iq[self._index[slot]]
+
+    def release(self):
+        # type: () -> None
+        """
+        Free the merged kernel.  It is rebuilt on the next evaluation.
+        """
+        if self._kernel is not None:
+            self._kernel.release()
+        self._kernel = self._kernel_args = None
+        self._index = self._key = self._Iq = None
+
+    def _build(self):
+        # type: () -> None
+        # Merge the points into one table with a row for each point, keep
+        # the distinct rows and map each dataset into them.
+        points = np.vstack([np.column_stack(q) for q in self._inputs])
+        unique, inverse = np.unique(points, axis=0, return_inverse=True)
+        inverse = inverse.ravel()
+        ends = np.cumsum([len(q[0]) for q in self._inputs])
+        self._index = np.split(inverse, ends[:-1])
+        self._size = len(unique)
+        kernel_inputs = [np.ascontiguousarray(q) for q in unique.T]
+        self._kernel = self.model.make_kernel(kernel_inputs)
+        self._kernel_args = KernelArgs(self._kernel)
+
+
+class SharedInputs(object):
+    """
+    Kernel inputs shared by the calculators for several models on the same
+    data, such as the candidates in :mod:`.selection`.
+
+    Models of the same engine and precision use a single copy of each set
+    of q vectors, made by *model.make_input*, rather than one for each
+    kernel.  Pass the registry to :meth:`DirectModel.with_model`, and call
+    :meth:`release` once the kernels are released.
+    """
+    def __init__(self):
+        # type: () -> None
+        self._inputs = {}  # type: Dict[Tuple, Any]
+        self._lock = threading.Lock()
+
+    def get(self, model, q_vectors):
+        # type: (KernelModel, List[np.ndarray]) -> Any
+        """
+        Return the shared input for *q_vectors* on *model*, or *q_vectors*
+        if the model can't share them.
+        """
+        digest = hashlib.sha1()
+        for q in q_vectors:
+            digest.update(np.ascontiguousarray(q, 'd').tobytes())
+        key = type(model), np.dtype(model.dtype).char, digest.hexdigest()
+        with self._lock:
+            if key not in self._inputs:
+                self._inputs[key] = model.make_input(q_vectors)
+            q_input = self._inputs[key]
+        return q_vectors if q_input is None else q_input
+
+    def release(self):
+        # type: () -> None
+        """
+        Free the shared inputs.
+        """
+        with self._lock:
+            for q_input in self._inputs.values():
+                if q_input is not None:
+                    q_input.release()
+            self._inputs = {}
+
+
 class DirectModel(DataMixin):
     """
     Create a calculator object for a model.
@@ -364,18 +815,42 @@ class DirectModel(DataMixin):
     *model* is a model calculator return from :func:`.core.load_model`
 
     *cutoff* is the polydispersity weight cutoff.
+
+    *shared* is an optional :class:`SharedQ` registry for evaluating several
+    datasets with the same model together.
     """
-    def __init__(self, data: Data, model: KernelModel, cutoff: float=1e-5) -> None:
-        # not type: (Data, KernelModel, float) -> None
+    def __init__(self, data: Data, model: KernelModel, cutoff: float=1e-5,
+                 shared: "Optional[SharedQ]"=None) -> None:
+        # not type: (Data, KernelModel, float, Optional[SharedQ]) -> None
         self.model = model
         self.cutoff = cutoff
         # Note: _interpret_data defines the model attributes
-        self._interpret_data(data, model)
+        self._interpret_data(data, model, shared=shared)
 
     def __call__(self, **pars):
         # type: (**float) -> np.ndarray
         return self._calc_theory(pars, cutoff=self.cutoff)
 
+    def with_model(self, model, inputs=None):
+        # type: (KernelModel, Optional[SharedInputs]) -> "DirectModel"
+        """
+        Return a calculator for *model* on the same data, reusing the data
+        interpretation and resolution of this one rather than building
+        them again.  Kernel inputs come from the :class:`SharedInputs`
+        registry *inputs* if it is given.
+        """
+        # pylint: disable=protected-access
+        if self._shared is not None:
+            raise ValueError("can't change the model of a shared q registry")
+        calculator = copy.copy(self)
+        calculator.model = calculator._model = model
+        calculator._inputs = inputs
+        calculator._kernel = calculator._full_kernel = None
+        calculator._kernel_args = calculator._unfold = None
+        calculator._fused = False
+        calculator.results = None
+        return calculator
+
     def simulate_data(self, noise=None, **pars):
         # type: (Optional[float], **float) -> None
         """
@@ -384,6 +859,16 @@ class DirectModel(DataMixin):
         Iq = self.__call__(**pars)
         self._set_data(Iq, noise=noise)
 
+    def adapt_q_calc(self, tol=resolution.ADAPTIVE_TOLERANCE, **pars):
+        # type: (float, **float) -> None
+        """
+        Choose the points at which the model is evaluated so that the
+        theory at *pars* is smeared to within about *tol*, using fewer
+        points where the model is flat.  See
+        :func:`.resolution.adaptive_q_calc`.
+        """
+        self._adapt_resolution(pars, tol=tol)
+
     def profile(self, **pars):
         # type: (**float) -> None
         """
@@ -556,6 +1041,333 @@ def main():
         print("use q or qx,qy")
         sys.exit(1)
 
+def test_call_kernel_batch():
+    # type: () -> None
+    """Check that batch evaluation matches individual evaluation"""
+    from .core import load_model
+    model = load_model('cylinder', dtype='double')
+    kernel = model.make_kernel([np.logspace(-3, -1, 20)])
+    pars_list = [
+        dict(radius=20),
+        dict(radius=30, radius_pd=0.1, radius_pd_n=15),
+        dict(length=200, length_pd=0.2, length_pd_n=10, radius_pd=0.1,
+             radius_pd_n=5, scale=2., background=0.1),
+    ]
+    batch = call_kernel_batch(kernel, pars_list)
+    for pars, Iq_batch in zip(pars_list, batch):
+        Iq_single = call_kernel(kernel, pars)
+        assert np.allclose(Iq_batch, Iq_single, rtol=1e-12, atol=0)
+
+def test_calc_theory_batch():
+    # type: () -> None
+    """Check that batch theory matches the theory for each parameter set"""
+    from .core import load_model
+    from .data import empty_data1D
+    model = load_model('cylinder', dtype='double')
+    data = empty_data1D(np.logspace(-3, -1, 20), resolution=0.05)
+    calculator = DirectModel(data, model)
+    pars_list = [
+        dict(radius=20, background=0.1),
+        dict(radius=30, radius_pd=0.1, radius_pd_n=15),
+    ]
+    batch = calculator._calc_theory_batch(pars_list)
+    for pars, theory in zip(pars_list, batch):
+        assert np.allclose(theory, calculator._calc_theory(pars),
+                           rtol=1e-12, atol=0)
+
+def test_call_kernel_async():
+    # type: () -> None
+    """Check that asynchronous evaluation matches direct evaluation"""
+    from .core import load_model
+    q = np.logspace(-3, -1, 20)
+    pars_list = [
+        ('cylinder', dict(radius=30, radius_pd=0.1, radius_pd_n=15)),
+        ('sphere+cylinder', dict(A_radius=50, B_length=200, B_scale=0.5)),
+        ('sphere@hardsphere', dict(radius=40, volfraction=0.2)),
+    ]
+    kernels = [load_model(name, dtype='double').make_kernel([q])
+               for name, _ in pars_list]
+    futures = [call_kernel_async(kernel, pars)
+               for kernel, (_, pars) in zip(kernels, pars_list)]
+    for kernel, (_, pars), future in zip(kernels, pars_list, futures):
+        Iq_async = future.result()
+        assert future.done()
+        assert np.allclose(Iq_async, call_kernel(kernel, pars),
+                           rtol=1e-12, atol=0)
+
+def test_composite_cache():
+    # type: () -> None
+    """Check that reusing unchanged parts of composite models is exact"""
+    from .core import load_model
+    q = np.logspace(-3, -1, 20)
+    cases = [
+        ('sphere@hardsphere', dict(radius=40, radius_pd=0.1, radius_pd_n=15),
+         [dict(volfraction=0.3), dict(scale=2, background=0.1),
+          dict(radius=45)]),
+        ('sphere+cylinder', dict(A_radius=50, B_radius_pd=0.1, B_radius_pd_n=5),
+         [dict(B_scale=0.5), dict(A_radius=60), dict(B_radius_pd=0.2)]),
+    ]
+    for name, base, updates in cases:
+        kernel = load_model(name, dtype='double').make_kernel([q])
+        call_kernel(kernel, base)
+        for update in updates:
+            pars = dict(base, **update)
+            fresh = load_model(name, dtype='double').make_kernel([q])
+            assert np.allclose(call_kernel(kernel, pars),
+                               call_kernel(fresh, pars), rtol=1e-14, atol=0)
+
+def test_fused_mixture():
+    # type: () -> None
+    """Check that the fused mixture kernel matches the separate parts"""
+    from .core import load_model
+    q = np.logspace(-3, -1, 20)
+    qx, qy = np.meshgrid(np.linspace(-0.1, 0.1, 5), np.linspace(-0.1, 0.1, 5))
+    pars = dict(A_radius=40, B_scale=0.5, B_theta=30, B_phi=20,
+                C_length_a=30, C_psi=45)
+    model = load_model('sphere+cylinder+parallelepiped', dtype='double')
+    for q_vectors in ([q], [qx.flatten(), qy.flatten()]):
+        kernel = model.make_kernel(q_vectors)
+        fused = call_kernel(kernel, pars)
+        assert kernel._fused_kernel is not None
+        parts = kernel.results()
+        # Disable the fused kernel to compute the parts separately.
+        kernel._make_fused = None
+        assert np.allclose(fused, call_kernel(kernel, pars),
+                           rtol=1e-12, atol=0)
+        assert len(parts) == 3
+
+def test_mesh_cache():
+    # type: () -> None
+    """Check that memoized weights and kernel args track parameter changes"""
+    from .core import load_model
+    from .details import _make_kernel_args
+    q = np.logspace(-3, -1, 20)
+    kernel = load_model('sphere', dtype='double').make_kernel([q])
+    pars = dict(radius=40, radius_pd=0.1, radius_pd_n=15, radius_pd_type='schulz')
+    first = make_kernel_args(kernel, get_mesh(kernel.info, pars))
+    again = make_kernel_args(kernel, get_mesh(kernel.info, pars))
+    assert first is again
+    for update in (dict(radius_pd=0.2), dict(radius=45), dict(scale=2)):
+        mesh = get_mesh(kernel.info, dict(pars, **update))
+        _, values, _ = make_kernel_args(kernel, mesh)
+        _, target, _ = _make_kernel_args(kernel, mesh)
+        assert not np.array_equal(values, first[1])
+        assert np.array_equal(values, target)
+
+def test_kernel_args():
+    # type: () -> None
+    """Check that in place updates of the kernel arguments are exact"""
+    from .core import load_model
+    from .details import _make_kernel_args
+    q = np.logspace(-3, -1, 20)
+    kernel = load_model('sphere', dtype='double').make_kernel([q])
+    args = KernelArgs(kernel)
+    base = dict(radius=40, radius_pd=0.1, radius_pd_n=15, sld_M0=3)
+    cases = [dict(), dict(radius=45), dict(up_frac_i=0.2, sld_mtheta=30),
+             dict(radius_pd_n=5), dict(radius_pd=0.)]
+    for update in cases:
+        mesh = get_mesh(kernel.info, dict(base, **update), dim='2d')
+        call_details, values, is_magnetic = args.update(mesh)
+        target = _make_kernel_args(kernel, mesh)
+        assert np.array_equal(call_details.buffer, target[0].buffer)
+        assert np.array_equal(values, target[1])
+        assert is_magnetic == target[2]
+
+def test_flatten_mesh():
+    # type: () -> None
+    """Check that the pruned flat mesh matches the nested dispersity loops"""
+    from .core import load_model
+    q = np.logspace(-3, -1, 20)
+    kernel = load_model('cylinder', dtype='double').make_kernel([q])
+    pars = dict(radius=30, radius_pd=0.1, radius_pd_n=35,
+                length=200, length_pd=0.1, length_pd_n=35)
+    cutoff = 1e-5
+    call_details, values, is_magnetic = make_kernel_args(
+        kernel, get_mesh(kernel.info, pars))
+    flat_details, flat_values = flatten_mesh(call_details, values, cutoff)
+    if not kernel.supports_flat:
+        return
+    assert flat_details.flat
+    assert flat_details.num_eval < call_details.num_eval//2
+    target = kernel(call_details, values, cutoff, is_magnetic)
+    actual = kernel(flat_details, flat_values, cutoff, is_magnetic)
+    assert np.allclose(actual, target, rtol=1e-12, atol=0)
+
+def test_deep_mesh():
+    # type: () -> None
+    """Check the nested loops for more than five dispersity parameters"""
+    from . import details
+    from .core import load_model
+    q = np.logspace(-3, -1, 10)
+    kernel = load_model('core_multi_shell', dtype='double').make_kernel([q])
+    if not kernel.supports_flat:
+        return
+    pars = dict(n=5, radius=50, radius_pd=0.1, radius_pd_n=3)
+    for k in range(1, 6):
+        pars.update({'thickness%d' % k: 10*k, 'thickness%d_pd' % k: 0.1,
+                     'thickness%d_pd_n' % k: 3})
+    call_details, values, is_magnetic = make_kernel_args(
+        kernel, get_mesh(kernel.info, pars))
+    assert call_details.num_active == 6
+    saved = details.FLAT_MESH_RATIO
+    try:
+        details.FLAT_MESH_RATIO = 1.
+        flat_details, flat_values = flatten_mesh(call_details, values, 1e-300)
+    finally:
+        details.FLAT_MESH_RATIO = saved
+    assert flat_details.flat and flat_details.num_eval == 3**6
+    target = kernel(flat_details, flat_values, 0., is_magnetic)
+    actual = kernel(call_details, values, 0., is_magnetic)
+    assert np.allclose(actual, target, rtol=1e-12, atol=0)
+
+def test_adaptive_mesh():
+    # type: () -> None
+    """Check that stopping each q early keeps the dispersity sum accurate"""
+    from . import generate
+    from .core import load_model_info
+    from .kerneldll import load_dll
+    model_info = load_model_info('cylinder')
+    q = np.logspace(-3, 0, 40)
+    pars = dict(radius=30, radius_pd=0.1, radius_pd_n=35,
+                length=200, length_pd=0.1, length_pd_n=35)
+    exact = load_dll(generate.make_source(model_info)['dll'], model_info,
+                     dtype=generate.F64).make_kernel([q])
+    target = call_kernel(exact, pars)
+    saved = generate.ADAPTIVE_TOLERANCE
+    try:
+        generate.ADAPTIVE_TOLERANCE = 1e-6
+        model = load_dll(generate.make_source(model_info)['dll'], model_info,
+                         dtype=generate.F64)
+        kernel = model.make_kernel([q])
+        call_details, values, _ = make_kernel_args(
+            kernel, get_mesh(kernel.info, pars))
+        flat_details, flat_values = flatten_mesh(call_details, values, 0.)
+        assert flat_details.flat
+        actual = call_kernel(kernel, pars)
+    finally:
+        generate.ADAPTIVE_TOLERANCE = saved
+    assert np.allclose(actual, target, rtol=1e-5, atol=0)
+
+def test_jitter_quadrature():
+    # type: () -> None
+    """Check that the spherical jitter points approximate the full mesh"""
+    from . import details
+    from .core import load_model
+    qx = np.linspace(-0.1, 0.1, 20)
+    qy = np.linspace(-0.15, 0.15, 20)
+    kernel = load_model('cylinder', dtype='double').make_kernel([qx, qy])
+    if not kernel.supports_flat:
+        return
+    pars = dict(radius=20, length=400, theta=60, phi=60,
+                theta_pd=10, theta_pd_n=35, phi_pd=10, phi_pd_n=35)
+    target = call_kernel(kernel, pars)
+    saved = details.JITTER_QUADRATURE
+    try:
+        details.JITTER_QUADRATURE = 0.5
+        mesh = get_mesh(kernel.info, pars, dim='2d')
+        call_details, values, _ = make_kernel_args(kernel, mesh)
+        flat_details, _ = flatten_mesh(call_details, values, 0.)
+        assert flat_details.flat
+        assert flat_details.num_eval < call_details.num_eval//2
+        actual = call_kernel(kernel, pars)
+    finally:
+        details.JITTER_QUADRATURE = saved
+    # Half as many points give an approximation to the full tensor product
+    # mesh, not the same accuracy.
+    assert np.allclose(actual, target, rtol=2e-2, atol=0)
+
+def test_call_kernel_smeared():
+    # type: () -> None
+    """Check that smearing with the kernel matches smearing on the host"""
+    from .core import load_model
+    q = np.logspace(-3, -1, 40)
+    res = resolution.Pinhole1D(q, 0.05*q)
+    pars = dict(radius=30, radius_pd=0.1, radius_pd_n=15, background=0.1)
+    for name in ('cylinder', 'sphere+cylinder'):
+        kernel = load_model(name, dtype='double').make_kernel([res.q_calc])
+        kernel.set_resolution(res.weight_matrix)
+        Iq_smeared = call_kernel_smeared(kernel, pars)
+        Iq_host = res.apply(call_kernel(kernel, pars))
+        assert np.allclose(Iq_smeared, Iq_host, rtol=1e-12, atol=0)
+
+def test_shared_q():
+    # type: () -> None
+    """Check that datasets sharing a q registry match separate evaluation"""
+    from .core import load_model
+    from .data import empty_data1D
+    model = load_model('sphere', dtype='double')
+    q1 = np.logspace(-3, -1, 20)
+    q2 = np.hstack((q1[5:], np.logspace(-1, -0.5, 10)[1:]))
+    datasets = [empty_data1D(q1, resolution=0.05), empty_data1D(q2),
+                empty_data1D(q1, resolution=0.05)]
+    shared = SharedQ(model)
+    calculators = [DirectModel(data, model, shared=shared) for data in datasets]
+    separate = [DirectModel(data, model) for data in datasets]
+    total = sum(len(calc.resolution.q_calc) for calc in calculators)
+    assert shared.size < total
+    pars = dict(radius=40, radius_pd=0.1, radius_pd_n=15, background=0.1)
+    Iq_first = None
+    for calc, target in zip(calculators, separate):
+        Iq = calc(**pars)
+        # later datasets reuse the kernel result from the first
+        Iq_first = shared._Iq if Iq_first is None else Iq_first
+        assert shared._Iq is Iq_first
+        assert np.allclose(Iq, target(**pars), rtol=1e-12, atol=0)
+    assert np.allclose(calculators[0](radius=50), separate[0](radius=50),
+                       rtol=1e-12, atol=0)
+
+def test_fold_2d():
+    # type: () -> None
+    """Check that folding q onto -q for 2D data matches every point"""
+    global FOLD_2D
+    from .core import load_model
+    from .data import empty_data2D
+    q = np.linspace(0.005, 0.1, 12)
+    q = np.hstack((-q[::-1], q))
+    pars = dict(radius=20, length=100, theta=30, phi=20, psi=10,
+                sld=4, sld_solvent=1, background=0.1)
+    magnetic = dict(pars, sld_M0=3, sld_mtheta=30, up_frac_i=0.8)
+    model = load_model('cylinder', dtype='double')
+    for resolution in (0., 0.05):
+        data = empty_data2D(q, resolution=resolution)
+        folded = DirectModel(data, model)
+        saved = FOLD_2D
+        try:
+            FOLD_2D = False
+            full = DirectModel(data, model)
+            targets = [full(**p) for p in (pars, magnetic)]
+        finally:
+            FOLD_2D = saved
+        assert np.allclose(folded(**pars), targets[0], rtol=1e-12, atol=0)
+        # Each point on the grid is paired with its mate.
+        assert 2*(folded._unfold.max() + 1) == len(folded._unfold)
+        assert np.allclose(folded(**magnetic), targets[1], rtol=1e-12, atol=0)
+        batch = folded._calc_theory_batch([pars, magnetic])
+        assert np.allclose(batch[0], targets[0], rtol=1e-12, atol=0)
+        assert np.allclose(batch[1], targets[1], rtol=1e-12, atol=0)
+
+    # line defines its own Iqxy = (b + m qx)(b + m qy), which changes when
+    # q goes to -q, so it must not be folded.
+    data = empty_data2D(q, resolution=0.)
+    pars = dict(intercept=1., slope=20., background=0.)
+    line = DirectModel(data, load_model('line', dtype='double'))
+    saved = FOLD_2D
+    try:
+        FOLD_2D = False
+        target = DirectModel(data, load_model('line', dtype='double'))(**pars)
+    finally:
+        FOLD_2D = saved
+    Iq = line(**pars)
+    assert line._unfold is None
+    assert np.allclose(Iq, target, rtol=1e-12, atol=0)
+    qx, qy = line.resolution.q_calc
+    # (q, q) and its mate (-q, -q) differ, which folding would hide.
+    k = np.argmin(abs(qx - q[-1]) + abs(qy - q[-1]))
+    j = np.argmin(abs(qx + q[-1]) + abs(qy + q[-1]))
+    assert not np.isclose(Iq[k], Iq[j])
+    assert np.isclose(Iq[k], target[k]) and np.isclose(Iq[j], target[j])
+
+
 def test_simple_interface():
     def near(value, target):
         """Close enough in single precision"""
@@ -107,6 +107,17 @@ The kernel module must set variables defining the kernel meta data:
     cylinder models).  The expression can call C functions, including
     those defined in your model file.
 
+    *setup_size* is the number of values in the scratch buffer for models
+    which do part of the calculation once per parameter set rather than
+    once per q.  The sources must then define
+    *void setup(p1, p2, ..., double scratch[])* which fills the buffer, and
+    each of the Iq functions takes *const double scratch[]* as its last
+    argument.  Setup is called once for each point in the dispersity mesh
+    before looping over q.  For the magnetic kernel it is called for each
+    cross section since the slds change with q.  On the GPU it is called
+    for each q, and *gpu_setup_size* gives a shorter buffer for models
+    which can compute their tables as needed.
+
 A :class:`.modelinfo.ModelInfo` structure is constructed from the kernel meta
 data and returned to the caller.
 
@@ -161,12 +172,13 @@ from __future__ import print_function
 
 import sys
 from os import environ
-from os.path import abspath, dirname, join as joinpath, exists, getmtime, sep
+from os.path import abspath, basename, dirname, join as joinpath, exists, getmtime, sep
 import re
 import string
 from zlib import crc32
 from inspect import currentframe, getframeinfo
 import logging
+from collections.abc import Mapping
 
 import numpy as np  # type: ignore
 
@@ -175,7 +187,7 @@ from .custom import load_custom_kernel_module
 
 # pylint: disable=unused-import
 try:
-    from typing import Tuple, Sequence, Iterator, Dict, List
+    from typing import Tuple, Sequence, Iterator, Dict, List, Optional, Union
     from types import ModuleType
     from .modelinfo import ModelInfo
 except ImportError:
@@ -188,6 +200,75 @@ logger = logging.getLogger(__name__)
 # for details.  To change it from a program, set generate.PROJECTION.
 PROJECTION = 1
 
+# Use compensated (Kahan) summation for the dispersity sums in the kernel,
+# so that single precision kernels keep their accuracy over large meshes.
+# Enable with SAS_KAHAN=1 in the environment, or set generate.USE_KAHAN
+# before the models are loaded.
+USE_KAHAN = environ.get("SAS_KAHAN", "0") not in ("", "0")
+
+# Relative tolerance for the flat mesh kernels to stop evaluating a q value
+# once the rest of the dispersity mesh is estimated to change it by less
+# than this (see details.flatten_mesh).  Every mesh point is evaluated when
+# this is None.  Set with SAS_ADAPTIVE_TOLERANCE=1e-5 in the environment, or
+# set generate.ADAPTIVE_TOLERANCE before the models are loaded.
+ADAPTIVE_TOLERANCE = (float(environ.get("SAS_ADAPTIVE_TOLERANCE", "0") or "0")
+                      or None)
+
+# Relative tolerance for the adaptive Gauss-Kronrod orientation average in
+# models which support it (see models/lib/gauss_kronrod.c).  Models use
+# their fixed gauss rule when this is None.  Set with SAS_GK_TOLERANCE=1e-6
+# in the environment, or set generate.GK_TOLERANCE before the models are
+# loaded.
+GK_TOLERANCE = float(environ.get("SAS_GK_TOLERANCE", "0") or "0") or None
+
+# Points per unit of q*radius for the orientation averages sized to q in
+# models which support them (see models/lib/orient_average.c).  Models use
+# their fixed gauss rule when this is None.  Set with SAS_ORIENT_AVERAGE=1
+# in the environment, or set generate.ORIENT_RESOLUTION before the models
+# are loaded.
+ORIENT_RESOLUTION = (float(environ.get("SAS_ORIENT_AVERAGE", "0") or "0")
+                     or None)
+
+# Use lazily built interpolation tables for the form factor in models which
+# support them (see models/lib/fq_table.c).  These only apply to the DLL
+# kernels.  Enable with SAS_FQ_TABLE=1 in the environment, or set
+# generate.USE_FQ_TABLE before the models are loaded.
+USE_FQ_TABLE = environ.get("SAS_FQ_TABLE", "0") not in ("", "0")
+
+# Use the branch-free versions of the special functions in models/lib
+# (J0, J1 and Si), which evaluate every range of the approximation and
+# select the result.  This avoids thread divergence on the GPU at the cost
+# of extra work where all threads would take the same branch.  Enable with
+# SAS_BRANCHLESS=1 in the environment, or set generate.USE_BRANCHLESS
+# before the models are loaded.
+USE_BRANCHLESS = environ.get("SAS_BRANCHLESS", "0") not in ("", "0")
+
+# Build instrumented kernels which count the mesh points visited and
+# skipped, the kernel calls and the form factor evaluations, returning the
+# counts after the normalization sums in the result vector.  The counts are
+# available as kernel.stats after each call (see kernel.KernelStats).
+# Enable with SAS_KERNEL_STATS=1 in the environment, or set
+# generate.USE_KERNEL_STATS before the models are loaded.
+USE_KERNEL_STATS = environ.get("SAS_KERNEL_STATS", "0") not in ("", "0")
+#: Number of counters returned by the instrumented kernels.
+NUM_KERNEL_STATS = 5
+
+# Read the Gauss-Legendre rule of models using lib/gauss<n>.c from a table
+# which the host can replace, so that the order can be changed with
+# KernelModel.set_integration_order without recompiling the dll or the CUDA
+# program (see models/lib/gauss_table.c).  Disable with SAS_GAUSS_TABLE=0
+# in the environment, or set generate.USE_GAUSS_TABLE before the models are
+# loaded.
+USE_GAUSS_TABLE = environ.get("SAS_GAUSS_TABLE", "1") not in ("", "0")
+#: Largest order for the run time Gauss-Legendre tables.
+GAUSS_MAX_N = 1024
+
+#: Number of dispersity values and weights which the GPU "_local" kernels
+#: copy into memory shared by the work group.  The values are in model
+#: precision, so this is 8 KiB per work group for double precision models.
+#: Meshes with more than PD_CACHE_SIZE/2 weights use the general kernels.
+PD_CACHE_SIZE = 1024
+
 def get_data_path(external_dir, target_file):
     """
     Search for the target file relative in the installed application.
@@ -226,6 +307,14 @@ try:  # CRUFT: older numpy does not support float128
 except TypeError:
     F128 = None
 
+# Half precision model code needs the OpenCL extension enabled before the
+# first use of the half type.  Protected so the C compilers skip it.
+_F16_PRAGMA = """\
+#if defined(__OPENCL_VERSION__)
+#  pragma OPENCL EXTENSION cl_khr_fp16: enable
+#endif
+"""
+
 # Conversion from units defined in the parameter table for each model
 # to units displayed in the sphinx documentation.
 # This section associates the unit with the macro to use to produce the LaTex
@@ -285,7 +374,10 @@ def set_integration_size(info, n):
     # type: (ModelInfo, int) -> None
     """
     Update the model definition, replacing the gaussian integration with
-    a gaussian integration of a different size.
+    a gaussian integration of a different size.  The model needs to be
+    built again for the new size.  Use
+    :meth:`.kernel.KernelModel.set_integration_order` to change the size
+    of a built model.
 
     Note: this really ought to be a method in modelinfo, but that leads to
     import loops.
@@ -298,6 +390,90 @@ def set_integration_size(info, n):
         info.source = ["lib/gauss%d.c"%n if lib.startswith('lib/gauss')
                        else lib for lib in info.source]
 
+def gpu_setup_size(model_info):
+    # type: (ModelInfo) -> int
+    """
+    Return the size of the setup scratch buffer for *model_info* on the GPU.
+    """
+    size = getattr(model_info, 'gpu_setup_size', None)
+    return model_info.setup_size if size is None else size
+
+def setup_select(cpu, gpu):
+    # type: (int, int) -> str
+    """
+    Return the C expression for a setup buffer size or offset which is
+    *cpu* in the dll and *gpu* on the GPU.
+    """
+    return "%d" % cpu if cpu == gpu else "SETUP_SELECT(%d, %d)" % (cpu, gpu)
+
+_GAUSS_SOURCE = re.compile(r"(?:^|[/\\])gauss([0-9]+)[.]c$")
+
+def gauss_order(model_info):
+    # type: (ModelInfo) -> int
+    """
+    Return the order of the Gauss-Legendre table that the host can replace
+    in the kernels for *model_info*, or 0 if the order is fixed.
+
+    Models have a replaceable table if they use lib/gauss<n>.c and
+    :data:`USE_GAUSS_TABLE` is set.  Fused models keep their fixed tables.
+    """
+    if (not USE_GAUSS_TABLE or not model_info.source
+            or (model_info.composition is not None
+                and model_info.composition[0] in ('fused', 'fused_mixture'))):
+        return 0
+    for lib in model_info.source:
+        match = _GAUSS_SOURCE.search(lib)
+        if match:
+            return int(match.group(1))
+    return 0
+
+def check_gauss_order(model_info, n):
+    # type: (ModelInfo, int) -> None
+    """
+    Raise ValueError if the kernels for *model_info* can't use an *n* point
+    Gauss-Legendre rule chosen at run time.
+    """
+    if not gauss_order(model_info):
+        raise ValueError("%s has no run time gauss table" % model_info.name)
+    if not 0 <= n <= GAUSS_MAX_N:
+        raise ValueError("gauss order must be at most %d, or 0 for the default"
+                         % GAUSS_MAX_N)
+
+def gauss_defines(n):
+    # type: (int) -> List[str]
+    """
+    Return the definitions of the *n* point rule for lib/gauss_table.c.
+    """
+    from .gengauss import gauss_table
+    z, w, cos_phi, sin_phi = gauss_table(n)
+    table = lambda v: "{%s}" % ", ".join("%.17e" % x for x in v)
+    return [
+        "#define GAUSS_TABLE_N %d" % n,
+        "#define GAUSS_TABLE_Z " + table(z),
+        "#define GAUSS_TABLE_W " + table(w),
+        "#define GAUSS_TABLE_COS " + table(cos_phi),
+        "#define GAUSS_TABLE_SIN " + table(sin_phi),
+        ]
+
+def _gauss_table_source(n, path):
+    # type: (int, str) -> List[str]
+    """
+    Return the source replacing the fixed table in *path* with the run time
+    table from lib/gauss_table.c.  OpenCL has no run time table, so it uses
+    the fixed table unless the host defines a different order.
+    """
+    source = ["#if defined(USE_OPENCL) && !defined(GAUSS_TABLE_N)"]
+    _add_source(source, read_text(path), path)
+    source.append("#else")
+    source.append("#define GAUSS_MAX_N %d" % GAUSS_MAX_N)
+    source.append("#if !defined(GAUSS_TABLE_N)")
+    source.extend(gauss_defines(n))
+    source.append("#endif")
+    table_path = joinpath(MODEL_PATH, "lib", "gauss_table.c")
+    _add_source(source, read_text(table_path), table_path)
+    source.append("#endif")
+    return source
+
 def format_units(units):
     # type: (str) -> str
     """
@@ -376,7 +552,8 @@ def dll_timestamp(model_info):
     # TODO: no longer used, and appears to be identical to ocl_timestamp
     # TODO: fails DRY; templates appear two places.
     model_templates = [joinpath(DATA_PATH, filename)
-                       for filename in ('kernel_header.c', 'kernel_iq.c')]
+                       for filename in ('kernel_header.c', 'kernel_iq.c',
+                                        'kernel_resolution.c')]
     source_files = (model_sources(model_info)
                     + model_templates
                     + [model_info.basefile])
@@ -400,7 +577,8 @@ def ocl_timestamp(model_info):
     """
     # TODO: fails DRY; templates appear two places.
     model_templates = [joinpath(DATA_PATH, filename)
-                       for filename in ('kernel_header.c', 'kernel_iq.c')]
+                       for filename in ('kernel_header.c', 'kernel_iq.c',
+                                        'kernel_resolution.c')]
     source_files = (model_sources(model_info)
                     + model_templates
                     + [model_info.basefile])
@@ -616,7 +794,12 @@ def kernel_name(model_info, variant):
     """
     Name of the exported kernel symbol.
 
-    *variant* is "Iq", "Iqxy" or "Imagnetic".
+    *variant* is "Iq", "Iqxy" or "Imagnetic", or one of these with the
+    suffix "_batch" for the GPU batch kernels, "_mono" for the kernels
+    specialized to a single point dispersity mesh, "_flat" for the kernels
+    which walk a compacted list of mesh points, "_local" for the GPU
+    kernels which stage the dispersity mesh in work group memory or
+    "_split" for the GPU kernels which divide the mesh between work items.
     """
     return model_info.name + "_" + variant
 
@@ -653,8 +836,8 @@ double %(name)s(%(pars)s) {
 }
 
 """
-def _gen_fn(model_info, name, pars):
-    # type: (ModelInfo, str, List[Parameter]) -> str
+def _gen_fn(model_info, name, pars, scratch=False):
+    # type: (ModelInfo, str, List[Parameter], bool) -> str
     """
     Generate a function given pars and body.
 
@@ -664,8 +847,14 @@ def _gen_fn(model_info, name, pars):
          double fn(double a, double b, ...) {
              ....
          }
+
+    If *scratch* is True then the values from the model setup function are
+    passed as a final *const double \*scratch* argument.
     """
-    par_decl = ', '.join(p.as_function_argument() for p in pars) if pars else 'void'
+    par_decl = [p.as_function_argument() for p in pars]
+    if scratch:
+        par_decl.append('const double *scratch')
+    par_decl = ', '.join(par_decl) if par_decl else 'void'
     body = getattr(model_info, name)
     filename = model_info.basefile
     # Note: if symbol is defined strangely in the module then default it to 1
@@ -689,6 +878,41 @@ def _call_pars(pars, subs):
     """
     return [subs[p.id] for p in pars]
 
+def _mixed_wrapper(name, ret, lead, pars, tail=()):
+    # type: (str, str, List[Tuple[str, str]], List[Parameter], List[Tuple[str, str]]) -> Tuple[str, str]
+    """
+    Return *(call, code)* for calling model function *name* from the double
+    precision kernel of a mixed precision build.
+
+    Vector parameters are double arrays in the parameter table, but the
+    converted model function expects arrays of model_real, so the wrapper
+    *code* copies them into local arrays before calling *name*.  *lead* and
+    *tail* are the *(type, name)* pairs for the arguments before and after
+    the parameters.  Without vector parameters *call* is *name* itself and
+    *code* is empty.
+    """
+    if all(p.length == 1 for p in pars):
+        return name, ""
+    decls = [(ctype + arg if ctype.endswith("*") else ctype + " " + arg)
+             for ctype, arg in lead]
+    decls.extend(("const double *%s" if p.length > 1 else "double %s") % p.id
+                 for p in pars)
+    decls.extend((ctype + arg if ctype.endswith("*") else ctype + " " + arg)
+                 for ctype, arg in tail)
+    args = [arg for _, arg in lead]
+    args.extend(("_"+p.id if p.length > 1 else p.id) for p in pars)
+    args.extend(arg for _, arg in tail)
+    lines = ["static %s _mixed_%s(%s)" % (ret, name, ", ".join(decls)), "{"]
+    for p in pars:
+        if p.length > 1:
+            lines.append("  model_real _%s[%d];" % (p.id, p.length))
+            lines.append("  for (int _k=0; _k < %d; _k++) _%s[_k] = %s[_k];"
+                         % (p.length, p.id, p.id))
+    lines.append("  %s%s(%s);" % ("" if ret == "void" else "return ",
+                                  name, ", ".join(args)))
+    lines.append("}")
+    return "_mixed_" + name, "\n".join(lines)
+
 def _split_translation(translation):
     r"""
     Process the *translation* string, which is a sequence of assignments.
@@ -927,13 +1151,371 @@ def read_text(f):
     with open(f) as fid:
         return fid.read()
 
-def make_source(model_info):
-    # type: (ModelInfo) -> Dict[str, str]
+def _component_source(model_info, renames, included):
+    # type: (ModelInfo, List[Tuple[str, str]], List[str]) -> List[str]
+    """
+    Return the code for one component of a model compiled into a shared
+    kernel, with the functions in *renames* renamed by #define.
+
+    Support library files from a *lib* directory which are already in
+    *included* are skipped so that libraries used by several components
+    are only compiled once.  The newly included files are appended to
+    *included*.
+    """
+    table = model_info.parameters
+    has_setup = model_info.setup_size > 0
+    q, qx, qy, qab, qa, qb, qc \
+        = [Parameter(name=v) for v in 'q qx qy qab qa qb qc'.split()]
+    source = ["#define %s %s" % pair for pair in renames]
+    for path in model_sources(model_info):
+        if _is_library(path):
+            if path in included:
+                continue
+            included.append(path)
+        _add_source(source, read_text(path), path)
+    if model_info.c_code:
+        _add_source(source, model_info.c_code, model_info.basefile,
+                    lineno=model_info.lineno.get('c_code', 1))
+    for name in ('form_volume', 'shell_volume'):
+        if isinstance(getattr(model_info, name), str):
+            source.append(_gen_fn(model_info, name,
+                                  table.form_volume_parameters))
+    functions = [
+        ('Iq', [q] + table.iq_parameters),
+        ('Iqxy', [qx, qy] + table.iq_parameters + table.orientation_parameters),
+        ('Iqac', [qab, qc] + table.iq_parameters),
+        ('Iqabc', [qa, qb, qc] + table.iq_parameters),
+        ]
+    for name, pars in functions:
+        if isinstance(getattr(model_info, name), str):
+            source.append(_gen_fn(model_info, name, pars, has_setup))
+    source.extend("#undef %s" % old for old, _ in renames)
+    return source
+
+def _fused_source(model_info):
+    # type: (ModelInfo) -> List[str]
+    """
+    Return the model code for a product P@S compiled into a single kernel.
+
+    The P sources are included with *Fq* and *setup* renamed to *P_Fq* and
+    *P_setup*, and the S sources with *Iq* renamed to *S_Iq*.  The generated
+    *setup* stores the effective radius and the volume fraction scaled by
+    the form:shell volume ratio for each point in the dispersity mesh,
+    followed by the P setup values, and the generated *Fq* returns <F> and
+    <F^2 S> from these.  See :func:`.product.make_fused_info`.
+    """
+    from .product import RADIUS_ID, VOLFRAC_ID, RADIUS_MODE_ID
+
+    p_info, s_info = model_info.composition[1]
+    p_table, s_table = p_info.parameters, s_info.parameters
+    included = []  # type: List[str]
+    source = _component_source(
+        p_info, [("Fq", "P_Fq"), ("setup", "P_setup")], included)
+    is_hollow = contains_shell_volume(source)
+    source.extend(_component_source(s_info, [("Iq", "S_Iq")], included))
+
+    # The arguments are prefixed so that S.radius_effective doesn't hide
+    # the P radius_effective function.  S parameters which collide with
+    # P parameters are tagged with _S in the P@S table.
+    p_ids = set(p.id for p in p_table.kernel_parameters)
+    def arg(par_id):
+        return "_" + par_id
+    def s_arg(par):
+        return arg(par.id + "_S" if par.id in p_ids else par.id)
+    decl = ", ".join("double " + ("*" if p.length > 1 else "") + arg(p.id)
+                     for p in model_info.parameters.iq_parameters)
+    p_args = [arg(p.id) for p in p_table.iq_parameters]
+    volume_args = [arg(p.id) for p in p_table.form_volume_parameters]
+    s_args = [s_arg(p) for p in s_table.iq_parameters[2:]]
+    p_scratch = ["scratch + 2"] if p_info.setup_size > 0 else []
+
+    if not p_table.form_volume_parameters:
+        volume = "const double form = 1.0, shell = 1.0;"
+    elif is_hollow:
+        volume = ("const double form = form_volume(%s);\n"
+                  "  const double shell = shell_volume(%s);"
+                  % ((", ".join(volume_args),)*2))
+    else:
+        volume = ("const double form = form_volume(%s), shell = form;"
+                  % ", ".join(volume_args))
+    if p_info.radius_effective_modes:
+        radius = ("const int mode = (int)(%s + 0.5);\n"
+                  "  scratch[0] = (mode > 0 ? radius_effective(%s) : %s);"
+                  % (arg(RADIUS_MODE_ID), ", ".join(["mode"] + volume_args),
+                     arg(RADIUS_ID)))
+    else:
+        radius = "scratch[0] = %s;" % arg(RADIUS_ID)
+    lines = [
+        "static void setup(%s, double scratch[])" % decl,
+        "{",
+        "  " + volume,
+        "  " + radius,
+        "  scratch[1] = %s*(shell == 0.0 ? 1.0 : form/shell);" % arg(VOLFRAC_ID),
+        ]
+    if p_scratch:
+        lines.append("  P_setup(%s);" % ", ".join(p_args + p_scratch))
+    lines.extend([
+        "}",
+        "static void Fq(double q, double *F1, double *F2, %s,"
+        " const double scratch[])" % decl,
+        "{",
+        "  P_Fq(%s);" % ", ".join(["q", "F1", "F2"] + p_args + p_scratch),
+        "  *F2 *= S_Iq(%s);" % ", ".join(["q", "scratch[0]", "scratch[1]"]
+                                         + s_args),
+        "}",
+        ])
+    source.append('#line 1 "sasmodels/generate.py %s"' % model_info.id)
+    source.append("\n".join(lines))
+    return source
+
+def _is_library(path):
+    # type: (str) -> bool
+    """
+    Return True if *path* is a support library shared between models.
+    """
+    return basename(dirname(path)) == 'lib'
+
+#: Model functions renamed for each component of a fused mixture.
+_MODEL_FUNCTIONS = ('Iq', 'Fq', 'Iqxy', 'Iqac', 'Iqabc', 'form_volume',
+                    'shell_volume', 'radius_effective', 'setup')
+# Function definitions with the return type on the same or previous line.
+_FN_DEF_PATTERN = re.compile(
+    r"^[ \t]*(?:(?:static|inline|const)\s+)*(?:double|float|void|int|int32_t)"
+    r"\b[\s*]+(\w+)\s*\([^;{]*\)\s*\{", flags=re.MULTILINE)
+
+def _local_functions(model_info):
+    # type: (ModelInfo) -> List[str]
+    """
+    Return the names of the functions defined by the model itself rather
+    than by its support libraries.  Like :func:`find_xy_mode`, this is
+    not a C parser, so unusual definitions may be missed.
+    """
+    code = [read_text(path) for path in model_sources(model_info)
+            if not _is_library(path)]
+    if model_info.c_code:
+        code.append(model_info.c_code)
+    names = list(_MODEL_FUNCTIONS)
+    for text in code:
+        names.extend(name for name in _FN_DEF_PATTERN.findall(text)
+                     if name not in names)
+    return names
+
+def is_friedel_symmetric(model_info):
+    # type: (ModelInfo) -> bool
+    """
+    Return True if the non-magnetic 2D scattering of the model satisfies
+    I(-qx, -qy) = I(qx, qy).
+
+    This holds when the 2D kernel is built from *Iq*, *Iqac* or *Iqabc*,
+    since these see an inversion of q as an inversion of the shape.  A
+    model that writes its own *Iqxy*, such as line or micromagnetic_FF_3D,
+    may depend on the sign of q, so it is not assumed to be symmetric.
+    Composite models are symmetric if all of their parts are.
+    """
+    if model_info.composition is not None:
+        return all(is_friedel_symmetric(part)
+                   for part in model_info.composition[1])
+    if model_info.Iqxy is not None:
+        return False
+    if callable(model_info.Iq):
+        return True
+    code = [read_text(path) for path in model_sources(model_info)
+            if not _is_library(path)]
+    if model_info.c_code:
+        code.append(model_info.c_code)
+    return find_xy_mode(code) != 'qxy'
+
+def _mixture_source(model_info):
+    # type: (ModelInfo) -> List[str]
+    """
+    Return the model code for a mixture of models compiled into a single
+    kernel.
+
+    The component sources are included once for each distinct model, with
+    the functions defined by the model prefixed by *m<k>_*.  The generated *Iq* and *Iqxy*
+    return the sum (or product) of the components for a single point in
+    parameter space, each normalized by its own volume as in
+    :meth:`.kernel.Kernel.Iq`.  The kernel only matches the separate
+    component kernels when none of the parameters are polydisperse, since
+    each component needs its own dispersity normalization.  See
+    :func:`.mixture.make_fused_info`.
+    """
+    parts = model_info.composition[1]
+    operation = model_info.operation
+    table = model_info.parameters.kernel_parameters
+
+    def arg(par):
+        return "_" + par.id
+    decl = ", ".join("double " + ("*" if p.length > 1 else "") + arg(p)
+                     for p in model_info.parameters.iq_parameters)
+
+    source = []  # type: List[str]
+    included = []  # type: List[str]
+    prefixes = {}  # type: Dict[str, Tuple[str, bool, str]]
+    setup, iq, iqxy, terms = [], [], [], []
+    index, offset, gpu_offset = 0, 0, 0
+    for k, part in enumerate(parts):
+        # Component parameters are in order following the part scale.
+        p_table = part.parameters
+        if operation == '+':
+            terms.append(arg(table[index]) + "*I%d" % k)
+            index += 1
+        else:
+            terms.append("I%d" % k)
+        subs = {}
+        for par in p_table.kernel_parameters:
+            subs[par.id] = arg(table[index])
+            index += 1
+
+        # Include the sources the first time the model is seen.
+        if part.id not in prefixes:
+            prefix = "m%d_" % len(prefixes)
+            renames = [(name, prefix + name)
+                       for name in _local_functions(part)]
+            code = _component_source(part, renames, included)
+            prefixes[part.id] = (prefix, contains_shell_volume(code),
+                                 find_xy_mode(code))
+            source.extend(code)
+        prefix, is_hollow, xy_mode = prefixes[part.id]
+
+        args = [subs[p.id] for p in p_table.iq_parameters]
+        angles = [subs[p.id] for p in p_table.orientation_parameters]
+        if part.setup_size > 0:
+            scratch = ["scratch + %s" % setup_select(offset, gpu_offset)]
+            setup.append("  %ssetup(%s);"
+                         % (prefix, ", ".join(args + scratch)))
+            offset += part.setup_size
+            gpu_offset += gpu_setup_size(part)
+        else:
+            scratch = []
+        if p_table.form_volume_parameters:
+            volume = "%s%s(%s)" % (
+                prefix, "shell_volume" if is_hollow else "form_volume",
+                ", ".join(subs[p.id] for p in p_table.form_volume_parameters))
+        else:
+            volume = "1.0"
+        if part.valid:
+            valid = _IDENT_RE.sub(
+                lambda m: "(%s)" % subs.get(m.group(0), m.group(0)),
+                part.valid)
+        else:
+            valid = "1"
+
+        # 1D uses the orientation averaged Iq for all components.
+        if part.have_Fq:
+            call = ("double F1, F2; %sFq(%s); I%d = F2/(%s);"
+                    % (prefix, ", ".join(["q", "&F1", "&F2"] + args + scratch),
+                       k, volume))
+        else:
+            call = ("I%d = %sIq(%s)/(%s);"
+                    % (k, prefix, ", ".join(["q"] + args + scratch), volume))
+        iq.append("  double I%d = 0.0;" % k)
+        iq.append("  if (%s) { %s }" % (valid, call))
+
+        # 2D rotates (qx, qy) into the frame of each oriented component.
+        # There is no jitter, so the rotation is the view matrix.
+        if xy_mode == 'qac':
+            rotate = ("double st, ct, sp, cp; SINCOS(%s*M_PI_180, st, ct);"
+                      " SINCOS(%s*M_PI_180, sp, cp);"
+                      " const double qc = st*(cp*qx + sp*qy);"
+                      " const double qab = sqrt(fmax(qx*qx + qy*qy - qc*qc, 0.0));"
+                      % tuple(angles[:2]))
+            call = ("I%d = %sIqac(%s)/(%s);"
+                    % (k, prefix, ", ".join(["qab", "qc"] + args + scratch),
+                       volume))
+        elif xy_mode == 'qabc':
+            rotate = ("double st, ct, sp, cp, ss, cs;"
+                      " SINCOS(%s*M_PI_180, st, ct);"
+                      " SINCOS(%s*M_PI_180, sp, cp);"
+                      " SINCOS(%s*M_PI_180, ss, cs);"
+                      " const double qa = (-sp*ss + cp*cs*ct)*qx + (sp*cs*ct + ss*cp)*qy;"
+                      " const double qb = (-sp*cs - ss*cp*ct)*qx + (-sp*ss*ct + cp*cs)*qy;"
+                      " const double qc = st*(cp*qx + sp*qy);"
+                      % tuple(angles[:3]))
+            call = ("I%d = %sIqabc(%s)/(%s);"
+                    % (k, prefix,
+                       ", ".join(["qa", "qb", "qc"] + args + scratch), volume))
+        elif xy_mode == 'qxy':
+            rotate = ""
+            call = ("I%d = %sIqxy(%s)/(%s);"
+                    % (k, prefix,
+                       ", ".join(["qx", "qy"] + args + angles + scratch),
+                       volume))
+        else:
+            rotate = "const double q = sqrt(qx*qx + qy*qy);"
+            if part.have_Fq:
+                call = ("double F1, F2; %sFq(%s); I%d = F2/(%s);"
+                        % (prefix,
+                           ", ".join(["q", "&F1", "&F2"] + args + scratch),
+                           k, volume))
+            else:
+                call = ("I%d = %sIq(%s)/(%s);"
+                        % (k, prefix, ", ".join(["q"] + args + scratch),
+                           volume))
+        iqxy.append("  double I%d = 0.0;" % k)
+        iqxy.append("  if (%s) { %s %s }" % (valid, rotate, call))
+
+    total = (" + " if operation == '+' else "*").join(terms)
+    scratch_decl = ", const double scratch[]" if offset else ""
+    lines = []
+    if offset:
+        lines.extend(["static void setup(%s, double scratch[])" % decl, "{"]
+                     + setup + ["}"])
+    lines.extend(["static double Iq(double q, %s%s)" % (decl, scratch_decl),
+                  "{"] + iq + ["  return %s;" % total, "}"])
+    lines.extend(["static double Iqxy(double qx, double qy, %s%s)"
+                  % (decl, scratch_decl), "{"]
+                 + iqxy + ["  return %s;" % total, "}"])
+    source.append('#line 1 "sasmodels/generate.py %s"' % model_info.id)
+    source.append("\n".join(lines))
+    return source
+
+def pd_loops(max_pd):
+    # type: (int) -> List[str]
+    """
+    Return the definitions of PD_LOOP_INIT, PD_LOOP_OPEN and PD_LOOP_CLOSE
+    for the *max_pd* levels of the dispersity loop in kernel_iq.c.
+
+    Level *max_pd-1* is the outermost loop, and the weight for level *k*
+    is the product of the weight at *k* with the weight for level *k+1*,
+    starting from the outermost weight set by PD_OUTERMOST_WEIGHT(max_pd).
+    Only the levels that the model can use are generated, so a model with
+    two dispersity parameters gets a two level loop nest.
+    """
+    levels = list(range(max_pd-1, -1, -1))
+    init = " ".join("PD_INIT(%d)" % k for k in levels)
+    open_ = " ".join("PD_OPEN(%d,%d)" % (k, k+1) for k in levels)
+    close = " ".join("PD_CLOSE(%d)" % k for k in reversed(levels))
+    return [
+        "#define PD_LOOP_INIT %s" % init,
+        "#define PD_LOOP_OPEN %s" % open_,
+        "#define PD_LOOP_CLOSE %s" % close,
+        ]
+
+
+def make_source(model_info, mixed=False):
+    # type: (ModelInfo, Union[bool, str]) -> Dict[str, str]
     """
     Generate the OpenCL/ctypes kernel from the module info.
 
     Uses source files found in the given search path.  Returns None if this
     is a pure python model, with no C source components.
+
+    If *mixed* is True, the model functions and the support library are
+    converted to single precision while the parameter table and the
+    dispersity loop in kernel_iq remain in double precision.  The result
+    must be compiled as a double precision kernel.  This gives single
+    precision speed for the model evaluation on devices with slow double
+    precision, but the weights and the accumulated sums keep their full
+    precision.  Vector parameters are copied from the double table into
+    model precision arrays by a wrapper around each model function.
+
+    If *mixed* is 'half', the model functions are converted to half
+    precision and the kernel is compiled in single precision, so the sums
+    are accumulated in float.  This is only suitable for screening, where
+    three digits are enough, on OpenCL devices with the cl_khr_fp16
+    extension.  Half precision overflows above 65504, so models with large
+    volumes or intensities will fail the :mod:`.accuracy` check.
     """
     if callable(model_info.Iq):
         raise ValueError("can't compile python model")
@@ -953,17 +1535,40 @@ def make_source(model_info):
     # by the caller.
     call_table = model_info.parameters
     base_table = model_info.base
+    fused = (model_info.composition[0]
+             if model_info.composition is not None
+             and model_info.composition[0] in ('fused', 'fused_mixture')
+             else None)
 
     # Load templates and user code
     kernel_header = load_template('kernel_header.c')
     kernel_code = load_template('kernel_iq.c')
-    user_code = [(f, read_text(f)) for f in model_sources(model_info)]
+    resolution_code = []
+    _add_source(resolution_code, *load_template('kernel_resolution.c'))
 
     # Build initial sources
     source = []
     _add_source(source, *kernel_header)
-    for path, code in user_code:
-        _add_source(source, code, path)
+    if GK_TOLERANCE:
+        source.append("#define GK_TOLERANCE %.15g" % GK_TOLERANCE)
+    if ORIENT_RESOLUTION:
+        source.append("#define ORIENT_RESOLUTION %.15g" % ORIENT_RESOLUTION)
+    if USE_FQ_TABLE:
+        source.append("#define USE_FQ_TABLE")
+    if USE_BRANCHLESS:
+        source.append("#define USE_BRANCHLESS_SPECIAL")
+    if fused == 'fused':
+        source.extend(_fused_source(model_info))
+    elif fused == 'fused_mixture':
+        source.extend(_mixture_source(model_info))
+    else:
+        order = gauss_order(model_info)
+        for path in model_sources(model_info):
+            match = _GAUSS_SOURCE.search(path) if order else None
+            if match and int(match.group(1)) == order:
+                source.extend(_gauss_table_source(order, path))
+            else:
+                _add_source(source, read_text(path), path)
     if model_info.c_code:
         _add_source(source, model_info.c_code, model_info.basefile,
                     lineno=model_info.lineno.get('c_code', 1))
@@ -982,25 +1587,32 @@ def make_source(model_info):
     if isinstance(model_info.shell_volume, str):
         pars = call_table.form_volume_parameters
         source.append(_gen_fn(model_info, 'shell_volume', pars))
+    has_setup = model_info.setup_size > 0
     if isinstance(model_info.Iq, str):
         pars = [q] + call_table.iq_parameters
-        source.append(_gen_fn(model_info, 'Iq', pars))
+        source.append(_gen_fn(model_info, 'Iq', pars, has_setup))
     if isinstance(model_info.Iqxy, str):
         pars = [qx, qy] + call_table.iq_parameters + call_table.orientation_parameters
-        source.append(_gen_fn(model_info, 'Iqxy', pars))
+        source.append(_gen_fn(model_info, 'Iqxy', pars, has_setup))
     if isinstance(model_info.Iqac, str):
         pars = [qab, qc] + call_table.iq_parameters
-        source.append(_gen_fn(model_info, 'Iqac', pars))
+        source.append(_gen_fn(model_info, 'Iqac', pars, has_setup))
     if isinstance(model_info.Iqabc, str):
         pars = [qa, qb, qc] + call_table.iq_parameters
-        source.append(_gen_fn(model_info, 'Iqabc', pars))
+        source.append(_gen_fn(model_info, 'Iqabc', pars, has_setup))
 
     # Check for shell_volume function in source code
     is_hollow = contains_shell_volume(source)
 
     # What kind of 2D model do we need?  Is it consistent with the parameters?
-    xy_mode = find_xy_mode(source)
-    if xy_mode == 'qabc' and not base_table.is_asymmetric:
+    # The fused P@S kernel is 1D only, but the loaders expect Iqxy and
+    # Imagnetic kernels as well so these are built in |q|.  The fused
+    # mixture handles the orientation of each component in its Iqxy.
+    xy_mode = ('qa' if fused == 'fused' else 'qxy' if fused
+               else find_xy_mode(source))
+    if fused:
+        pass
+    elif xy_mode == 'qabc' and not base_table.is_asymmetric:
         raise ValueError("asymmetric oriented models need to define Iqabc")
     elif xy_mode == 'qac' and base_table.is_asymmetric:
         raise ValueError("symmetric oriented models need to define Iqac")
@@ -1012,6 +1624,19 @@ def make_source(model_info):
         else:
             raise ValueError("Expected Iqac or Iqabc for oriented shape")
 
+    # For mixed precision the model code so far is converted to float, or
+    # to half for screening.  The kernel_iq code below is left as double,
+    # but it still needs FLOAT_SIZE to match the double (or for half, the
+    # single) precision kernel that it will be compiled into.
+    if mixed == "half":
+        model_code = convert_type('\n'.join(source), F16)
+        source = [_F16_PRAGMA, "#undef FLOAT_SIZE", model_code,
+                  "#undef FLOAT_SIZE", "#define FLOAT_SIZE 4"]
+    elif mixed:
+        model_code = convert_type('\n'.join(source), F32)
+        source = ["#undef FLOAT_SIZE", model_code,
+                  "#undef FLOAT_SIZE", "#define FLOAT_SIZE 8"]
+
     # Process parameter substitutions
     subs, translation_vars, valid = _build_translation(model_info, '_v')
 
@@ -1029,24 +1654,36 @@ def make_source(model_info):
     source.append("\\\n".join(p.as_definition()
                               for p in call_table.kernel_parameters))
 
-    # Define the function calls
+    # Define the function calls.  In mixed precision the vector parameters
+    # are copied to model_real arrays by wrappers around the model functions.
+    wrappers = {}
+    def _call(name, ret, lead, pars, tail=()):
+        if mixed and name not in wrappers:
+            wrappers[name] = _mixed_wrapper(name, ret, lead, pars, tail)
+        return wrappers[name][0] if mixed else name
     call_radius_effective = "#define CALL_RADIUS_EFFECTIVE(_mode, _v) 0.0"
     if base_table.form_volume_parameters:
-        refs = _call_pars(base_table.form_volume_parameters, subs)
+        volume_pars = base_table.form_volume_parameters
+        refs = _call_pars(volume_pars, subs)
+        form_volume = _call("form_volume", "double", [], volume_pars)
         if is_hollow:
+            shell_volume = _call("shell_volume", "double", [], volume_pars)
             call_volume = (
                 "#define CALL_VOLUME(_form, _shell, _v) "
-                "do { _form = form_volume(%s); _shell = shell_volume(%s); } "
-                "while (0)") % ((",".join(refs),)*2)
+                "do { _form = %s(%s); _shell = %s(%s); } "
+                "while (0)") % (form_volume, ",".join(refs),
+                                shell_volume, ",".join(refs))
         else:
             call_volume = (
                 "#define CALL_VOLUME(_form, _shell, _v) "
-                "do { _form = _shell = form_volume(%s); } "
-                "while (0)") % (",".join(refs))
+                "do { _form = _shell = %s(%s); } "
+                "while (0)") % (form_volume, ",".join(refs))
         if model_info.radius_effective_modes:
+            radius_effective = _call("radius_effective", "double",
+                                     [("int", "_mode")], volume_pars)
             call_radius_effective = (
                 "#define CALL_RADIUS_EFFECTIVE(_mode, _v) "
-                "radius_effective(_mode, %s)") % (",".join(refs))
+                "%s(_mode, %s)") % (radius_effective, ",".join(refs))
     else:
         # Model doesn't have volume.  We could make the kernel run a little
         # faster by not using/transferring the volume normalizations, but
@@ -1057,40 +1694,73 @@ def make_source(model_info):
     source.append(translation_vars)
     source.append(call_volume)
     source.append(call_radius_effective)
-    model_refs = _call_pars(base_table.iq_parameters, subs)
+    iq_pars = base_table.iq_parameters
+    model_refs = _call_pars(iq_pars, subs)
+
+    # The setup function fills the scratch buffer once for each mesh point,
+    # and the buffer is then passed as the last argument of every Iq call.
+    # kernel_iq declares setup_scratch[SETUP_SIZE] in the scope of the call.
+    if has_setup:
+        source.append("#define SETUP_SIZE %s" % setup_select(
+            model_info.setup_size, gpu_setup_size(model_info)))
+        setup = _call("setup", "void", [], iq_pars,
+                      [("model_real *", "_scratch")])
+        source.append("#define CALL_SETUP(_scratch, _v) %s(%s)"
+                      % (setup, ",".join(model_refs + ["_scratch"])))
+        scratch_ref = ["setup_scratch"]
+        scratch_arg = [("model_real *", "_scratch")]
+    else:
+        scratch_ref = []
+        scratch_arg = []
+    fq_lead = [("model_real *", "_F1"), ("model_real *", "_F2")]
 
     if model_info.have_Fq:
-        pars = ",".join(["_q", "&_F1", "&_F2",] + model_refs)
-        call_iq = "#define CALL_FQ(_q, _F1, _F2, _v) Fq(%s)" % pars
+        pars = ",".join(["_q", "&_F1", "&_F2",] + model_refs + scratch_ref)
+        fq = _call("Fq", "void", [("double", "_q")] + fq_lead, iq_pars,
+                   scratch_arg)
+        call_iq = "#define CALL_FQ(_q, _F1, _F2, _v) %s(%s)" % (fq, pars)
         clear_iq = "#undef CALL_FQ"
     else:
-        pars = ",".join(["_q"] + model_refs)
-        call_iq = "#define CALL_IQ(_q, _v) Iq(%s)" % pars
+        pars = ",".join(["_q"] + model_refs + scratch_ref)
+        iq = _call("Iq", "double", [("double", "_q")], iq_pars, scratch_arg)
+        call_iq = "#define CALL_IQ(_q, _v) %s(%s)" % (iq, pars)
         clear_iq = "#undef CALL_IQ"
     if xy_mode == 'qabc':
-        pars = ",".join(["_qa", "_qb", "_qc"] + model_refs)
-        call_iqxy = "#define CALL_IQ_ABC(_qa,_qb,_qc,_v) Iqabc(%s)" % pars
+        pars = ",".join(["_qa", "_qb", "_qc"] + model_refs + scratch_ref)
+        iqabc = _call("Iqabc", "double",
+                      [("double", "_qa"), ("double", "_qb"), ("double", "_qc")],
+                      iq_pars, scratch_arg)
+        call_iqxy = ("#define CALL_IQ_ABC(_qa,_qb,_qc,_v) %s(%s)"
+                     % (iqabc, pars))
         clear_iqxy = "#undef CALL_IQ_ABC"
     elif xy_mode == 'qac':
-        pars = ",".join(["_qa", "_qc"] + model_refs)
-        call_iqxy = "#define CALL_IQ_AC(_qa,_qc,_v) Iqac(%s)" % pars
+        pars = ",".join(["_qa", "_qc"] + model_refs + scratch_ref)
+        iqac = _call("Iqac", "double", [("double", "_qa"), ("double", "_qc")],
+                     iq_pars, scratch_arg)
+        call_iqxy = "#define CALL_IQ_AC(_qa,_qc,_v) %s(%s)" % (iqac, pars)
         clear_iqxy = "#undef CALL_IQ_AC"
     elif xy_mode == 'qa' and not model_info.have_Fq:
-        pars = ",".join(["_qa"] + model_refs)
-        call_iqxy = "#define CALL_IQ_A(_qa,_v) Iq(%s)" % pars
+        pars = ",".join(["_qa"] + model_refs + scratch_ref)
+        iq = _call("Iq", "double", [("double", "_q")], iq_pars, scratch_arg)
+        call_iqxy = "#define CALL_IQ_A(_qa,_v) %s(%s)" % (iq, pars)
         clear_iqxy = "#undef CALL_IQ_A"
     elif xy_mode == 'qa' and model_info.have_Fq:
-        pars = ",".join(["_qa", "&_F1", "&_F2",] + model_refs)
+        pars = ",".join(["_qa", "&_F1", "&_F2",] + model_refs + scratch_ref)
         # Note: uses rare C construction (expr1, expr2) which computes
         # expr1 then expr2 and evaluates to expr2.  This allows us to
         # leave it looking like a function even though it is returning
         # its values by reference.
-        call_iqxy = "#define CALL_FQ_A(_qa,_F1,_F2,_v) (Fq(%s),_F2)" % pars
+        fq = _call("Fq", "void", [("double", "_q")] + fq_lead, iq_pars,
+                   scratch_arg)
+        call_iqxy = ("#define CALL_FQ_A(_qa,_F1,_F2,_v) (%s(%s),_F2)"
+                     % (fq, pars))
         clear_iqxy = "#undef CALL_FQ_A"
     elif xy_mode == 'qxy':
         qxy_refs = _call_pars(base_table.orientation_parameters, subs)
-        pars = ",".join(["_qx", "_qy"] + model_refs + qxy_refs)
-        call_iqxy = "#define CALL_IQ_XY(_qx,_qy,_v) Iqxy(%s)" % pars
+        pars = ",".join(["_qx", "_qy"] + model_refs + qxy_refs + scratch_ref)
+        iqxy = _call("Iqxy", "double", [("double", "_qx"), ("double", "_qy")],
+                     iq_pars + base_table.orientation_parameters, scratch_arg)
+        call_iqxy = "#define CALL_IQ_XY(_qx,_qy,_v) %s(%s)" % (iqxy, pars)
         clear_iqxy = "#undef CALL_IQ_XY"
         if base_table.orientation_parameters:
             call_iqxy += "\n#define HAVE_THETA"
@@ -1098,7 +1768,7 @@ def make_source(model_info):
         if base_table.is_asymmetric:
             call_iqxy += "\n#define HAVE_PSI"
             clear_iqxy += "\n#undef HAVE_PSI"
-
+    source.extend(code for _, code in wrappers.values() if code)
 
     # TODO: test magnetism with translated sld parameters
     # By inspection it should work but intermediate variables aren't supported.
@@ -1106,28 +1776,123 @@ def make_source(model_info):
                if p.type == 'sld']
     # Fill in definitions for numbers of parameters
     source.append("#define MAX_PD %s"%call_table.max_pd)
+    source.extend(pd_loops(call_table.max_pd))
     source.append("#define NUM_PARS %d"%call_table.npars)
     source.append("#define NUM_VALUES %d" % call_table.nvalues)
     source.append("#define NUM_MAGNETIC %d" % call_table.nmagnetic)
     source.append("#define MAGNETIC_PARS %s"%",".join(str(k) for k in magpars))
     source.append("#define PROJECTION %d"%PROJECTION)
-    wrappers = _kernels(kernel_code, call_iq, clear_iq,
-                        call_iqxy, clear_iqxy, model_info.name)
-    code = '\n'.join(source + wrappers[0] + wrappers[1] + wrappers[2])
-
-    # Note: Identical code for dll and opencl.  This may not always be the case
-    # so leave them as separate entries in the returned value.
-    result = {'dll': code, 'opencl': code}
+    source.append("#define PD_CACHE_SIZE %d" % PD_CACHE_SIZE)
+    if USE_KAHAN:
+        source.append("#define USE_KAHAN_SUMMATION")
+    if ADAPTIVE_TOLERANCE:
+        source.append("#define ADAPTIVE_TOLERANCE %.15g" % ADAPTIVE_TOLERANCE)
+    if USE_KERNEL_STATS:
+        source.append("#define USE_KERNEL_STATS")
+        source.append("#define NUM_KERNEL_STATS %d" % NUM_KERNEL_STATS)
+    variants = {}
+    for suffix in [""] + list(KERNEL_VARIANTS):
+        wrappers = _kernels(kernel_code, call_iq, clear_iq,
+                            call_iqxy, clear_iqxy, model_info.name, suffix)
+        variants[suffix] = wrappers[0] + wrappers[1] + wrappers[2]
+    code = '\n'.join(source + variants[""] + resolution_code)
+
+    # C interface for native callers of the dll, from kernel_api.h.
+    api_code = [
+        '#define SAS_KERNEL_NAME "%s"' % model_info.name,
+        "#define SAS_KERNEL_IQ %s" % kernel_name(model_info, "Iq"),
+        "#define SAS_KERNEL_IQ_MONO %s" % kernel_name(model_info, "Iq_mono"),
+        "#define SAS_KERNEL_IQXY %s" % kernel_name(model_info, "Iqxy"),
+        "#define SAS_KERNEL_IQXY_MONO %s"
+        % kernel_name(model_info, "Iqxy_mono"),
+        "#define SAS_KERNEL_HAVE_FQ %d" % (1 if model_info.have_Fq else 0),
+        "#define SAS_KERNEL_THETA_PAR %d" % call_table.theta_offset,
+        ]
+    _add_source(api_code, *load_template('kernel_api.h'))
+    _add_source(api_code, *load_template('kernel_api.c'))
+
+    # The dll includes the monodisperse and flat mesh kernels alongside the
+    # general ones since it is compiled once and cached.  For OpenCL and CUDA each set of
+    # variant kernels is kept in a separate program so that the extra
+    # compile time is only paid by callers which use them.  The resolution
+    # stage goes with the general kernels, and the C interface is only
+    # available from the dll.
+    result = {
+        'dll': '\n'.join(source + variants[""] + variants["_mono"]
+                          + variants["_flat"] + resolution_code
+                          + api_code),
+        'opencl': code,
+        }
+    for suffix in KERNEL_VARIANTS:
+        result['opencl' + suffix] = '\n'.join(source + variants[suffix])
     return result
 
 
-def _kernels(kernel, call_iq, clear_iq, call_iqxy, clear_iqxy, name):
-    # type: (Dict[str, str], str, str, str, str, str) -> List[str]
+class LazySource(Mapping):
+    """
+    The sources returned by :func:`make_source` for *model_info* and
+    *mixed*, generated on first access.
+
+    The GPU models keep their source until the program is compiled, so
+    this delays the work of generating it until the model is evaluated.
+    The options in this module are read when the source is generated.
+    """
+    def __init__(self, model_info, mixed=False):
+        # type: (ModelInfo, Union[bool, str]) -> None
+        self.model_info = model_info
+        self.mixed = mixed
+        self._source = None  # type: Optional[Dict[str, str]]
+
+    def _get(self):
+        # type: () -> Dict[str, str]
+        if self._source is None:
+            self._source = make_source(self.model_info, mixed=self.mixed)
+        return self._source
+
+    def __getitem__(self, key):
+        # type: (str) -> str
+        return self._get()[key]
+
+    def __iter__(self):
+        return iter(self._get())
+
+    def __len__(self):
+        # type: () -> int
+        return len(self._get())
+
+
+def make_weights_source():
+    # type: () -> str
+    """
+    Generate the C source for the dispersity weights in kernel_weights.c.
+
+    The weights do not depend on the model, so they are compiled into
+    a dll of their own by :func:`.kerneldll.load_weights_dll`.
+    """
+    source = []
+    _add_source(source, *load_template('kernel_header.c'))
+    path = joinpath(MODEL_PATH, 'lib', 'sas_gammainc.c')
+    _add_source(source, read_text(path), path)
+    _add_source(source, *load_template('kernel_weights.c'))
+    return '\n'.join(source)
+
+
+#: Kernel variants compiled from the same source with an extra #define,
+#: keyed by the suffix on the kernel name.
+KERNEL_VARIANTS = {"_batch": "KERNEL_BATCH", "_mono": "KERNEL_MONO",
+                   "_flat": "KERNEL_FLAT", "_local": "KERNEL_LOCAL",
+                   "_split": "KERNEL_SPLIT"}
+
+def _kernels(kernel, call_iq, clear_iq, call_iqxy, clear_iqxy, name,
+             suffix=""):
+    # type: (Dict[str, str], str, str, str, str, str, str) -> List[str]
     code = kernel[0]
     path = _clean_source_filename(kernel[1])
+    # Variant kernels such as the batch kernels share the source with an
+    # extra macro defined, as given in KERNEL_VARIANTS.
     iq = [
         # define the Iq kernel
-        "#define KERNEL_NAME %s_Iq" % name,
+        "#define KERNEL_NAME %s_Iq%s" % (name, suffix),
         call_iq,
         '#line 1 "%s Iq"' % path,
         code,
@@ -1137,7 +1902,7 @@ def _kernels(kernel, call_iq, clear_iq, call_iqxy, clear_iqxy, name):
 
     iqxy = [
         # define the Iqxy kernel from the same source with different #defines
-        "#define KERNEL_NAME %s_Iqxy" % name,
+        "#define KERNEL_NAME %s_Iqxy%s" % (name, suffix),
         call_iqxy,
         '#line 1 "%s Iqxy"' % path,
         code,
@@ -1147,7 +1912,7 @@ def _kernels(kernel, call_iq, clear_iq, call_iqxy, clear_iqxy, name):
 
     imagnetic = [
         # define the Imagnetic kernel
-        "#define KERNEL_NAME %s_Imagnetic" % name,
+        "#define KERNEL_NAME %s_Imagnetic%s" % (name, suffix),
         "#define MAGNETIC 1",
         call_iqxy,
         '#line 1 "%s Imagnetic"' % path,
@@ -1157,6 +1922,12 @@ def _kernels(kernel, call_iq, clear_iq, call_iqxy, clear_iqxy, name):
         "#undef KERNEL_NAME",
     ]
 
+    if suffix:
+        flag = KERNEL_VARIANTS[suffix]
+        for wrapper in (iq, iqxy, imagnetic):
+            wrapper.insert(0, "#define %s 1" % flag)
+            wrapper.append("#undef %s" % flag)
+
     return iq, iqxy, imagnetic
 
 
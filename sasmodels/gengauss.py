@@ -4,21 +4,44 @@ Generate the Gauss-Legendre integration points and save them as a C file.
 """
 from __future__ import division, print_function
 
+from functools import lru_cache
+
 import numpy as np
 from numpy.polynomial.legendre import leggauss
 
+#: Names of the run time tables in lib/gauss_table.c, in the order of the
+#: arrays returned by :func:`gauss_table`.
+GAUSS_TABLE_NAMES = ("gauss_table_z", "gauss_table_w",
+                     "gauss_table_cos", "gauss_table_sin")
+
+@lru_cache(maxsize=32)
+def gauss_table(n, size=0):
+    """
+    Return the nodes and weights *(z, w)* of the *n* point Gauss-Legendre
+    rule with the cosine and sine of the nodes mapped to [0, pi/2],
+    *(z, w, cos_phi, sin_phi)*, padded with zeros to *size* or to a
+    multiple of 4.
+
+    These are the tables used by the kernels in place of lib/gauss*.c when
+    the quadrature order is chosen at run time.  The arrays are shared
+    between callers, so they are read only.
+    """
+    size = max(size, n + (-n)%4)
+    tables = [np.zeros(size) for _ in range(4)]
+    z, w, cos_phi, sin_phi = tables
+    z[:n], w[:n] = leggauss(n)
+    phi = 0.25*np.pi*(1 + z[:n])
+    cos_phi[:n], sin_phi[:n] = np.cos(phi), np.sin(phi)
+    for table in tables:
+        table.flags.writeable = False
+    return z, w, cos_phi, sin_phi
+
 def gengauss(n, path):
     """
     Save the Gauss-Legendre integration points for length *n* into file *path*.
     """
-    z, w = leggauss(n)
-
-    # Make sure array size is a multiple of 4
-    if n%4:
-        array_size = n + (4 - n%4)
-        z, w = [np.hstack((v, [0.]*(4-n%4))) for v in (z, w)]
-    else:
-        array_size = n
+    z, w, cos_phi, sin_phi = gauss_table(n)
+    array_size = len(z)
 
     with open(path, "w") as fid:
         fid.write("""\
@@ -28,12 +51,16 @@ def gengauss(n, path):
 # undef GAUSS_N
 # undef GAUSS_Z
 # undef GAUSS_W
+# undef GAUSS_COS
+# undef GAUSS_SIN
 #endif
 #define GAUSS_N %d
 #define GAUSS_Z Gauss%dZ
 #define GAUSS_W Gauss%dWt
+#define GAUSS_COS Gauss%dCos
+#define GAUSS_SIN Gauss%dSin
 
-"""%(n, n, n, n))
+"""%(n, n, n, n, n, n))
 
         if array_size != n:
             fid.write("// Note: using array size %d so that it is a multiple of 4\n\n"%array_size)
@@ -44,4 +71,52 @@ def gengauss(n, path):
 
         fid.write("constant double Gauss%dZ[%d]={\n"%(n, array_size))
         fid.write(",\n".join("\t% .15e"%v for v in z))
-        fid.write("\n};")
+        fid.write("\n};\n")
+
+        fid.write("\n// cos(phi) and sin(phi) for phi = pi/4 (1 + z) in [0, pi/2]"
+                  " at the nodes z\n")
+        for name, values in (("Cos", cos_phi), ("Sin", sin_phi)):
+            fid.write("constant double Gauss%d%s[%d]={\n"%(n, name, array_size))
+            fid.write(",\n".join("\t% .15e"%v for v in values))
+            fid.write("\n};\n")
+
+
+#: Number of points in each half of the orientation tables.
+ORIENT_SIZES = (4, 8, 16, 32, 64, 128, 256)
+
+def genorient(path):
+    """
+    Save the orientation tables for lib/orient_average.c into file *path*.
+
+    For each of the sizes *n* in :data:`ORIENT_SIZES`, the tables hold the
+    non-negative nodes and weights of the 2*n point Gauss-Legendre rule for
+    cos(theta) in [0, 1] and the cosine and sine of the *n* point midpoint
+    rule for phi in [0, pi/2], with the sizes concatenated in order.
+    """
+    z, w, cos_phi, sin_phi = [], [], [], []
+    for n in ORIENT_SIZES:
+        zn, wn = leggauss(2*n)
+        phi = (np.arange(n) + 0.5)*(0.5*np.pi/n)
+        z.extend(zn[n:])
+        w.extend(wn[n:])
+        cos_phi.extend(np.cos(phi))
+        sin_phi.extend(np.sin(phi))
+    total = len(z)
+
+    with open(path, "w") as fid:
+        fid.write("""\
+// Generated by sasmodels.gengauss.genorient()
+
+// The tables are only used by the adaptive orientation average.
+#if defined(ORIENT_RESOLUTION)
+#define ORIENT_NUM_TABLES %d
+#define ORIENT_MIN_SIZE %d
+
+"""%(len(ORIENT_SIZES), ORIENT_SIZES[0]))
+        for name, values in (("ORIENT_Z", z), ("ORIENT_W", w),
+                             ("ORIENT_COS_PHI", cos_phi),
+                             ("ORIENT_SIN_PHI", sin_phi)):
+            fid.write("constant double %s[%d]={\n"%(name, total))
+            fid.write(",\n".join("\t% .15e"%v for v in values))
+            fid.write("\n};\n")
+        fid.write("#endif // ORIENT_RESOLUTION\n")
@@ -0,0 +1,204 @@
+"""
+Work group sizes for GPU kernels
+================================
+
+The OpenCL and CUDA kernels evaluate one q value per work item, with the
+work items launched in groups.  The best group size depends on the model,
+the device and the precision: heavy models with many registers may run
+best in small groups, while light models on wide devices prefer large
+ones.  Rather than leave the choice to the driver, the first call to each
+kernel with enough q values times the first chunk of the dispersity mesh
+for each of the sizes from :func:`candidates` and keeps the fastest.  The
+chunk starts at the beginning of the mesh, so each run replaces the result
+of the previous one and the extra runs only cost time.
+
+The chosen sizes are stored in *SAS_GPU_TUNE_PATH*, which defaults to
+*~/.sasmodels/gpu_tune.json*, keyed by model, kernel, precision and the
+identity of the device and driver, so tuning happens once per machine.
+Delete the file to retune after a model changes.  Set *SAS_GPU_TUNE=0* to
+skip tuning, in which case OpenCL uses the driver default and CUDA uses
+blocks of :data:`DEFAULT_BLOCK`.  Sizes already in the file are used
+either way.
+
+The number of work items is padded up to a multiple of the group size.
+The kernels ignore work items beyond the end of q, so the q buffers are
+not changed.
+"""
+from __future__ import print_function
+
+import os
+from os.path import join as joinpath, exists, dirname
+import json
+import logging
+import tempfile
+import threading
+
+# pylint: disable=unused-import
+try:
+    from typing import Dict, List, Optional
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Tune the group sizes on first use.
+USE_TUNING = os.environ.get("SAS_GPU_TUNE", "1") not in ("", "0")
+
+if "SAS_GPU_TUNE_PATH" in os.environ:
+    SAS_GPU_TUNE_PATH = os.environ["SAS_GPU_TUNE_PATH"]
+else:
+    SAS_GPU_TUNE_PATH = joinpath(
+        os.path.expanduser("~"), ".sasmodels", "gpu_tune.json")
+
+#: Fewer q values than this don't fill enough groups to tell the sizes
+#: apart, so these calls use the stored size or the default.
+MIN_TUNE_NQ = 1024
+
+#: Multiples of the device warp (or wavefront) size to try.
+TUNE_MULTIPLES = (1, 2, 4, 8)
+
+#: CUDA block size when there is no tuned size.
+DEFAULT_BLOCK = 32
+
+#: Group size which tells OpenCL to let the driver choose.
+DRIVER_DEFAULT = 0
+
+_TABLE = None  # type: Optional[Dict[str, int]]
+_LOCK = threading.Lock()
+
+
+def tuning_key(model, kernel, dtype, device):
+    # type: (str, str, str, str) -> str
+    """
+    Key for the group size of *kernel* from *model* running in precision
+    *dtype* on the device described by the string *device*.
+    """
+    return "|".join((model, kernel, str(dtype), device))
+
+
+def _table():
+    # type: () -> Dict[str, int]
+    global _TABLE
+    if _TABLE is None:
+        _TABLE = _load(SAS_GPU_TUNE_PATH)
+    return _TABLE
+
+
+def _load(path):
+    # type: (str) -> Dict[str, int]
+    if not exists(path):
+        return {}
+    try:
+        with open(path) as fid:
+            return {k: int(v) for k, v in json.load(fid).items()}
+    except Exception as exc:
+        logging.warning("ignoring gpu tuning file %r: %s", path, exc)
+        return {}
+
+
+def lookup(key):
+    # type: (str) -> Optional[int]
+    """
+    Return the stored group size for *key*, or None if it isn't tuned.
+    :data:`DRIVER_DEFAULT` means that the driver choice was fastest.
+    """
+    with _LOCK:
+        return _table().get(key, None)
+
+
+def store(key, size):
+    # type: (str, int) -> None
+    """
+    Remember the group *size* for *key*, merging it into the tuning file.
+
+    The file is replaced atomically so that concurrent processes never see
+    a partial file.  Failure to write the file is logged and the size is
+    kept for the rest of the session.
+    """
+    with _LOCK:
+        _table()[key] = size
+        path = SAS_GPU_TUNE_PATH
+        try:
+            table = _load(path)
+            table[key] = size
+            os.makedirs(dirname(os.path.abspath(path)), exist_ok=True)
+            fd, tmp = tempfile.mkstemp(dir=dirname(os.path.abspath(path)),
+                                       suffix=".tmp")
+            try:
+                with os.fdopen(fd, "w") as fid:
+                    json.dump(table, fid, indent=2, sort_keys=True)
+                os.replace(tmp, path)
+            except Exception:
+                os.unlink(tmp)
+                raise
+        except Exception as exc:
+            logging.warning("could not save gpu tuning %r: %s", path, exc)
+
+
+def needs_tuning(key, nq):
+    # type: (str, int) -> bool
+    """
+    Return True if the kernel for *key* should be tuned on a call with
+    *nq* q values.
+    """
+    return USE_TUNING and nq >= MIN_TUNE_NQ and lookup(key) is None
+
+
+def candidates(warp, max_size, driver_default=True):
+    # type: (int, int, bool) -> List[int]
+    """
+    Return the group sizes to try for a device with the given *warp* size
+    and kernel limit *max_size*.  The list starts with
+    :data:`DRIVER_DEFAULT` if *driver_default* is True.
+    """
+    warp = max(int(warp), 1)
+    sizes = [warp*k for k in TUNE_MULTIPLES if warp*k <= max_size]
+    if not sizes:
+        sizes = [max(int(max_size), 1)]
+    return ([DRIVER_DEFAULT] if driver_default else []) + sizes
+
+
+def padded(n, size):
+    # type: (int, int) -> int
+    """
+    Round *n* up to a multiple of the group *size*.
+    """
+    return ((n + size - 1)//size)*size if size > 0 else n
+
+
+def best(timings):
+    # type: (Dict[int, float]) -> int
+    """
+    Return the group size with the shortest time in *timings*.  Ties go to
+    the first size tried, which keeps the driver default unless a size is
+    clearly faster.
+    """
+    return min(timings, key=lambda size: timings[size])
+
+
+def test_tuning():
+    # type: () -> None
+    """
+    Check that the sizes are chosen and stored.
+    """
+    import shutil
+    global SAS_GPU_TUNE_PATH, _TABLE
+    saved, cache_dir = (SAS_GPU_TUNE_PATH, _TABLE), tempfile.mkdtemp()
+    SAS_GPU_TUNE_PATH, _TABLE = joinpath(cache_dir, "tune.json"), None
+    try:
+        assert candidates(32, 256) == [0, 32, 64, 128, 256]
+        assert candidates(64, 128, driver_default=False) == [64, 128]
+        assert candidates(64, 16) == [0, 16]
+        assert padded(1000, 64) == 1024 and padded(1000, 0) == 1000
+        timings = {0: 2.0, 32: 1.5, 64: 1.0, 128: 1.0}
+        assert best(timings) == 64
+        key = tuning_key("sphere", "sphere_Iq", "float32", "device")
+        assert lookup(key) is None
+        assert needs_tuning(key, MIN_TUNE_NQ) == USE_TUNING
+        assert not needs_tuning(key, MIN_TUNE_NQ - 1)
+        store(key, 64)
+        assert lookup(key) == 64 and not needs_tuning(key, MIN_TUNE_NQ)
+        _TABLE = None
+        assert lookup(key) == 64
+    finally:
+        SAS_GPU_TUNE_PATH, _TABLE = saved
+        shutil.rmtree(cache_dir, ignore_errors=True)
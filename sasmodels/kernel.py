@@ -11,24 +11,172 @@ the kernel should be released, which also releases the inputs.
 
 from __future__ import division, print_function
 
+from time import perf_counter
+import threading
+import uuid
+
+import numpy as np  # type: ignore
+from scipy import sparse  # type: ignore
+
+from . import profiling
+
 # pylint: disable=unused-import
 try:
-    from typing import List, Any
+    from typing import List, Any, Tuple, Callable, Dict, Optional
 except ImportError:
     pass
 else:
-    import numpy as np
     from .details import CallDetails
     from .modelinfo import ModelInfo
 # pylint: enable=unused-import
 
 
+class KernelCancelled(Exception):
+    """
+    Raised when a kernel calculation is cancelled from a progress callback.
+    """
+    pass
+
+
+class KernelFuture(object):
+    """
+    Pending result from :meth:`Kernel.Fq_async` or :meth:`Kernel.Iq_async`.
+
+    *finish* is called without arguments the first time :meth:`result` is
+    requested.  It should block until the calculation is complete and
+    return its value.
+    """
+    def __init__(self, finish):
+        # type: (Callable[[], Any]) -> None
+        self._finish = finish
+        self._value = None  # type: Any
+
+    def done(self):
+        # type: () -> bool
+        """
+        Return True if the result has already been retrieved.
+        """
+        return self._finish is None
+
+    def result(self):
+        # type: () -> Any
+        """
+        Wait for the calculation to complete and return its value.
+        """
+        if self._finish is not None:
+            finish, self._finish = self._finish, None
+            self._value = finish()
+        return self._value
+
+
+#: Counters returned by the instrumented kernels, in the order they follow
+#: the normalization sums in the result vector.
+KERNEL_STATS = ("points", "invalid", "cutoff", "calls", "evaluations")
+
+
+class KernelStats(object):
+    """
+    Counts from the last call to an instrumented kernel, which is built
+    when *generate.USE_KERNEL_STATS* is set (*SAS_KERNEL_STATS=1*).
+
+    *points* is the number of dispersity mesh points visited, of which
+    *invalid* were rejected by the model *INVALID* test and *cutoff* had
+    weight at or below the cutoff.  *calls* is the number of calls into the
+    compiled kernel, which is more than one when the mesh is evaluated in
+    chunks.  *evaluations* is the number of form factor evaluations, with
+    one for each q and magnetic cross section at each accepted mesh point.
+    On the GPU this is scaled from the evaluations for the first q.
+    *time* is the wall clock time for the call in seconds.
+
+    The counts are stored in the precision of the kernel, so they are
+    not exact beyond $2^{24}$ for single precision kernels.
+    """
+    def __init__(self, counts, time):
+        # type: (List[float], float) -> None
+        for name, count in zip(KERNEL_STATS, counts):
+            setattr(self, name, int(count))
+        self.time = time
+
+    def __repr__(self):
+        # type: () -> str
+        counts = ", ".join("%s=%d" % (name, getattr(self, name))
+                           for name in KERNEL_STATS)
+        return "KernelStats(%s, time=%.3g)" % (counts, self.time)
+
+
+#: Models unpickled in this process, keyed by the token of the original
+#: model, so that a worker loads the dll or compiles the program once even
+#: when the model is sent with every task.
+_RESTORED = {}  # type: Dict[str, KernelModel]
+_RESTORED_LOCK = threading.Lock()
+
+
+def _restore_model(token, cls, state):
+    # type: (str, type, Any) -> KernelModel
+    with _RESTORED_LOCK:
+        model = _RESTORED.get(token, None)
+        if model is None:
+            model = cls.__new__(cls)
+            model.__setstate__(state)
+            model._pickle_token = token
+            _RESTORED[token] = model
+        return model
+
+
+def _restore_kernel(model, q_vectors):
+    # type: (KernelModel, List[np.ndarray]) -> Kernel
+    return model.make_kernel(q_vectors)
+
+
+def input_vectors(q_input):
+    # type: (Any) -> List[np.ndarray]
+    """
+    Return the q vectors used to create *q_input*, without the padding.
+    """
+    if q_input.is_2d:
+        return [q_input.q[0, :q_input.nq], q_input.q[1, :q_input.nq]]
+    return [q_input.q[:q_input.nq]]
+
+
 class KernelModel(object):
     """
     Model definition for the compute engine.
+
+    Models which define *__getstate__* and *__setstate__* can use
+    :meth:`_reduce_shared` as *__reduce__*, so that the copies of a model
+    sent to a worker process are all restored to one model in the worker.
+    The compiled dll or GPU program is then loaded once per worker rather
+    than once per task.
     """
     info = None  # type: ModelInfo
     dtype = None # type: np.dtype
+    #: Identity of the model across processes, assigned when first pickled.
+    _pickle_token = None  # type: Optional[str]
+    #: Order of the Gauss-Legendre rule set by :meth:`set_integration_order`,
+    #: or 0 for the order in the model source.
+    gauss_order = 0  # type: int
+
+    def set_integration_order(self, n):
+        # type: (int) -> None
+        """
+        Use the *n* point Gauss-Legendre rule for the integrals in models
+        using lib/gauss<n>.c, such as the orientation average, or the
+        rule in the model source if *n* is 0.
+
+        Engines with run time tables (see :func:`.generate.gauss_order`)
+        change the order without recompiling the model, so a fit can start
+        with a coarse rule and finish with a fine one.  Raises ValueError
+        if the engine or the model has a fixed rule.
+        """
+        raise ValueError("%s has a fixed gauss rule" % type(self).__name__)
+
+    def _reduce_shared(self):
+        # type: () -> Tuple[Any, ...]
+        if self._pickle_token is None:
+            self._pickle_token = uuid.uuid4().hex
+        return (_restore_model,
+                (self._pickle_token, type(self), self.__getstate__()))
+
     def make_kernel(self, q_vectors):
         # type: (List[np.ndarray]) -> "Kernel"
         """
@@ -36,6 +184,20 @@ class KernelModel(object):
         """
         raise NotImplementedError("need to implement make_kernel")
 
+    def make_input(self, q_vectors):
+        # type: (List[np.ndarray]) -> Any
+        """
+        Return *q_vectors* prepared for this engine and precision, which
+        can be passed to :meth:`make_kernel` in place of *q_vectors* by
+        every model of the same type and *dtype*, so that the kernels share
+        one copy.  The kernels don't release a shared input, so call
+        *release()* on it once they are done.
+
+        Returns None if the engine doesn't share inputs, or if the kernel
+        for *q_vectors* would be split into tiles.
+        """
+        return None
+
     def release(self):
         # type: () -> None
         """
@@ -87,8 +249,39 @@ class Kernel(object):
     dtype = None  # type: np.dtype
     #: Q values at which the kernel is to be evaluated.
     q_input = None  # type: Any
+    #: Model which created the kernel, used to rebuild it when unpickled.
+    _model = None  # type: KernelModel
     #: Place to hold result of *_call_kernel()* for subclass.
     result = None # type: np.ndarray
+    #: True if *_call_kernel()* accepts the compacted mesh from
+    #: :func:`.details.flatten_mesh`.
+    supports_flat = False # type: bool
+    #: Outstanding asynchronous call, which must complete before *result*
+    #: can be reused.
+    _pending = None # type: KernelFuture
+    #: Transpose of the resolution weight matrix from :meth:`set_resolution`
+    #: in CSR format, with one row for each measured point.
+    _resolution = None # type: sparse.csr_matrix
+    #: Sum of the resolution weights for each measured point.
+    _resolution_norm = None # type: np.ndarray
+    #: :class:`KernelStats` for the last call to :meth:`Fq` or :meth:`Iq`,
+    #: or None if the kernel is not instrumented.
+    stats = None # type: KernelStats
+    #: Number of counters after the normalization sums in *result*, which
+    #: is *len(KERNEL_STATS)* for the instrumented kernels and 0 otherwise.
+    _num_stats = 0 # type: int
+    #: Device time in seconds for the last kernel call, for backends which
+    #: can measure it, or None.  Only set when profiling is enabled.
+    _device_time = None # type: float
+
+    def __reduce__(self):
+        # type: () -> Tuple[Any, ...]
+        # Kernels hold device buffers or dll function pointers, so pickle
+        # the model and the q vectors and make a new kernel when unpickled.
+        # Settings such as the resolution weights are not kept.
+        if self._model is None:
+            raise TypeError("can't pickle %s kernel" % type(self).__name__)
+        return (_restore_kernel, (self._model, input_vectors(self.q_input)))
 
     def Iq(self, call_details, values, cutoff, magnetic):
         # type: (CallDetails, np.ndarray, np.ndarray, float, bool) -> np.ndarray
@@ -179,27 +372,186 @@ class Kernel(object):
         this scale factor evaluates to one and so can be used for both
         hollow and solid shapes.
         """
+        self._wait_pending()
+        start = perf_counter()
         self._call_kernel(call_details, values, cutoff, magnetic,
                           radius_effective_mode)
         #print("returned",self.q_input.q, self.result)
+        elapsed = perf_counter() - start
+        self.stats = self._unpack_stats(self.result, elapsed)
+        profiling.record("kernel", self.info.name, elapsed, self._device_time)
+        return self._unpack_result(self.result)
+
+    def Iq_async(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> KernelFuture
+        """
+        Like :meth:`Iq`, but returns a :class:`KernelFuture` as soon as
+        the calculation is queued.  Use *future.result()* to retrieve I(q).
+
+        This allows the caller to do other work, such as applying the
+        resolution function to a previous result or starting other kernels
+        on the same device, while this one runs.  *values* must not be
+        modified until the result is retrieved.
+        """
+        fq = self.Fq_async(call_details, values, cutoff, magnetic, 0)
+        def finish():
+            # type: () -> np.ndarray
+            _, F2, _, shell_volume, _ = fq.result()
+            return (values[0]/shell_volume)*F2 + values[1]
+        return KernelFuture(finish)
+
+    def Fq_async(self, call_details, values, cutoff, magnetic,
+                 radius_effective_mode=0):
+        # type: (CallDetails, np.ndarray, float, bool, int) -> KernelFuture
+        """
+        Like :meth:`Fq`, but returns a :class:`KernelFuture` as soon as
+        the calculation is queued.
+
+        The kernel has a single result buffer, so only one call per kernel
+        can be outstanding.  Starting another call on the same kernel waits
+        for the previous one to complete first.
+        """
+        self._wait_pending()
+        start = perf_counter()
+        wait = self._call_kernel_async(call_details, values, cutoff, magnetic,
+                                       radius_effective_mode)
+        def finish():
+            # type: () -> Tuple[np.ndarray, np.ndarray, float, float, float]
+            wait()
+            if self._pending is future:
+                self._pending = None
+            elapsed = perf_counter() - start
+            self.stats = self._unpack_stats(self.result, elapsed)
+            profiling.record("kernel", self.info.name, elapsed,
+                             self._device_time)
+            return self._unpack_result(self.result)
+        future = self._pending = KernelFuture(finish)
+        return future
+
+    def set_resolution(self, weight_matrix):
+        # type: (Any) -> None
+        """
+        Set the resolution weights used by :meth:`Iq_smeared`.
+
+        *weight_matrix* has shape *(nq, n)* for *n* measured points, as
+        returned by :func:`.resolution.pinhole_resolution`, and may be dense
+        or sparse.  Use None to clear the weights.
+        """
+        if weight_matrix is None:
+            self._resolution = self._resolution_norm = None
+            return
+        self._resolution = sparse.csr_matrix(weight_matrix.T)
+        self._resolution.sort_indices()
+        self._resolution_norm = np.asarray(
+            self._resolution.sum(axis=1)).flatten()
+
+    def Iq_smeared(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> np.ndarray
+        """
+        Like :meth:`Iq`, but returns I(q) smeared by the resolution weights
+        given to :meth:`set_resolution`, with one value for each measured
+        point.
+
+        The default smears the result of :meth:`Iq` on the host.  Backends
+        which can apply the weights next to the kernel override this so
+        that only the smeared values are returned from the device.
+        """
+        if self._resolution is None:
+            raise ValueError("call set_resolution before Iq_smeared")
+        Iq = self.Iq(call_details, values, cutoff, magnetic)
+        with profiling.stage("smear", self.info.name):
+            return self._resolution.dot(Iq)
+
+    def _smeared_Iq(self, values, result):
+        # type: (np.ndarray, np.ndarray) -> np.ndarray
+        """
+        Convert the *result* from the resolution stage in kernel_resolution.c
+        to smeared I(q).  The stage returns the unnormalized sums for the
+        measured points followed by the normalization sums.  Since smearing
+        is linear it can be applied before normalization, with the
+        background scaled by the sum of the weights for each point.
+        """
+        nrows = self._resolution.shape[0]
+        total_weight = result[nrows]
+        if total_weight == 0.:
+            total_weight = 1.
+        shell_volume = result[nrows + 2]/total_weight
+        if shell_volume == 0.:
+            shell_volume = 1.
+        F2 = result[:nrows]/total_weight
+        return (values[0]/shell_volume)*F2 + values[1]*self._resolution_norm
+
+    def _wait_pending(self):
+        # type: () -> None
+        """
+        Complete any outstanding asynchronous call on this kernel so that
+        *result* can be reused.
+        """
+        if self._pending is not None:
+            self._pending.result()
+
+    def Iq_batch(self, call_details_list, values_matrix, cutoff, magnetic):
+        # type: (List[CallDetails], np.ndarray, float, bool) -> np.ndarray
+        r"""
+        Returns I(q) for a batch of parameter sets as an array of shape
+        *(len(call_details_list), nq)*.
+
+        *call_details_list* gives the :class:`.details.CallDetails` for each
+        parameter set and *values_matrix* has one row of kernel values for
+        each set, as returned from :func:`.details.make_kernel_args`.  Rows
+        can be different lengths if they are given as a list of vectors.
+        All rows use the same *cutoff*, and the magnetic kernel is used for
+        all rows if *magnetic* is True.
+
+        Backends which can evaluate the whole batch in one launch override
+        *_call_kernel_batch()*; the default calls the kernel for each row.
+        """
+        self._wait_pending()
+        with profiling.stage("kernel", self.info.name):
+            results = self._call_kernel_batch(
+                call_details_list, values_matrix, cutoff, magnetic, 0)
+        Iq = []
+        for values, result in zip(values_matrix, results):
+            _, F2, _, shell_volume, _ = self._unpack_result(result)
+            Iq.append((values[0]/shell_volume)*F2 + values[1])
+        return np.array(Iq)
+
+    def _unpack_result(self, result):
+        # type: (np.ndarray) -> Tuple[np.ndarray, np.ndarray, float, float, float]
+        """
+        Convert the raw kernel *result* vector to F, F^2, R_eff, V_shell and
+        V_form/V_shell.  See :meth:`Fq` for details.
+        """
         nout = 2 if self.info.have_Fq and self.dim == '1d' else 1
-        total_weight = self.result[nout*self.q_input.nq + 0]
+        total_weight = result[nout*self.q_input.nq + 0]
         # Note: total_weight = sum(weight > cutoff), with cutoff >= 0, so it
         # is okay to test directly against zero.  If weight is zero then I(q),
         # etc. must also be zero.
         if total_weight == 0.:
             total_weight = 1.
         # Note: shell_volume == form_volume for solid objects
-        form_volume = self.result[nout*self.q_input.nq + 1]/total_weight
-        shell_volume = self.result[nout*self.q_input.nq + 2]/total_weight
-        radius_effective = self.result[nout*self.q_input.nq + 3]/total_weight
+        form_volume = result[nout*self.q_input.nq + 1]/total_weight
+        shell_volume = result[nout*self.q_input.nq + 2]/total_weight
+        radius_effective = result[nout*self.q_input.nq + 3]/total_weight
         if shell_volume == 0.:
             shell_volume = 1.
-        F1 = (self.result[1:nout*self.q_input.nq:nout]/total_weight
+        F1 = (result[1:nout*self.q_input.nq:nout]/total_weight
               if nout == 2 else None)
-        F2 = self.result[0:nout*self.q_input.nq:nout]/total_weight
+        F2 = result[0:nout*self.q_input.nq:nout]/total_weight
         return F1, F2, radius_effective, shell_volume, form_volume/shell_volume
 
+    def _unpack_stats(self, result, elapsed):
+        # type: (np.ndarray, float) -> KernelStats
+        """
+        Return the :class:`KernelStats` for the raw kernel *result* taking
+        *elapsed* seconds, or None if the kernel is not instrumented.
+        """
+        if not self._num_stats:
+            return None
+        nout = 2 if self.info.have_Fq and self.dim == '1d' else 1
+        offset = nout*self.q_input.nq + 4
+        return KernelStats(result[offset:offset + self._num_stats], elapsed)
+
     def release(self):
         # type: () -> None
         """
@@ -216,3 +568,33 @@ class Kernel(object):
         engines need to provide an implementation for this.
         """
         raise NotImplementedError()
+
+    def _call_kernel_async(self, call_details, values, cutoff, magnetic,
+                           radius_effective_mode):
+        # type: (CallDetails, np.ndarray, float, bool, int) -> Callable[[], None]
+        """
+        Start the kernel and return a function which blocks until *result*
+        holds the output.  Subclasses for devices which run independently
+        of the host can override this; the default evaluates the kernel
+        before returning.
+        """
+        self._call_kernel(call_details, values, cutoff, magnetic,
+                          radius_effective_mode)
+        return lambda: None
+
+    def _call_kernel_batch(self, call_details_list, values_matrix, cutoff,
+                           magnetic, radius_effective_mode):
+        # type: (List[CallDetails], np.ndarray, float, bool, int) -> np.ndarray
+        """
+        Call the kernel for each parameter set in the batch, returning an
+        array with one copy of the *result* vector for each set.  Subclasses
+        can override this to evaluate the batch in a single launch.
+        """
+        results = np.empty((len(call_details_list), self.result.size),
+                           dtype=self.result.dtype)
+        for k, (call_details, values) in enumerate(
+                zip(call_details_list, values_matrix)):
+            self._call_kernel(call_details, values, cutoff, magnetic,
+                              radius_effective_mode)
+            results[k] = self.result
+        return results
@@ -0,0 +1,284 @@
+/*
+    Implementation of the C interface in kernel_api.h.
+
+    This is included in the dll source after the kernels, with the names
+    of the kernels for the model given by the following macros from
+    generate.py:
+
+        SAS_KERNEL_NAME : the model name as a string
+        SAS_KERNEL_IQ, SAS_KERNEL_IQ_MONO : the 1D kernels
+        SAS_KERNEL_IQXY, SAS_KERNEL_IQXY_MONO : the 2D kernels
+        SAS_KERNEL_HAVE_FQ : 1 if the 1D kernel returns F and F^2
+        SAS_KERNEL_THETA_PAR : the theta_par entry of the details
+
+    The details and values are packed as in details.make_kernel_args.  The
+    values start with the NUM_VALUES scalars (scale, background, the
+    parameters and the magnetic field), followed by the dispersity points
+    for each parameter in turn and then the weights in the same order.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+// The OpenMP kernels take the number of threads as an extra argument.
+#if defined(USE_OPENMP)
+#  define _SAS_THREADS , 0
+#else
+#  define _SAS_THREADS
+#endif
+
+// The kernel result has four normalization sums after the values for each
+// q, plus the counters in the instrumented build.
+#if defined(USE_KERNEL_STATS)
+#  define _SAS_EXTRA (4 + NUM_KERNEL_STATS)
+#else
+#  define _SAS_EXTRA 4
+#endif
+
+struct sas_problem {
+    ProblemDetails details;
+    int32_t pd_length[NUM_PARS+1];  // length of each dispersity vector
+    int32_t pd_offset[NUM_PARS+1];  // offset of each dispersity vector
+    double *values;
+    double cutoff;
+    int32_t nq;      // capacity of the q and result buffers
+    double *q;       // padded qx,qy for the 2D kernels
+    double *result;  // raw kernel result
+};
+
+kernel int32_t sas_api_version(void) { return SAS_API_VERSION; }
+kernel const char *sas_model_name(void) { return SAS_KERNEL_NAME; }
+kernel int32_t sas_float_size(void) { return (int32_t)sizeof(double); }
+kernel int32_t sas_num_pars(void) { return NUM_PARS; }
+kernel int32_t sas_max_pd(void) { return MAX_PD; }
+kernel int32_t sas_have_Fq(void) { return SAS_KERNEL_HAVE_FQ; }
+
+kernel sas_problem *
+sas_problem_new(const int32_t *pd_length)
+{
+  int32_t num_active = 0, num_weights = 0;
+  for (int k=0; k < NUM_PARS; k++) {
+    const int32_t n = (pd_length == NULL ? 1 : pd_length[k]);
+    if (n < 1) return NULL;
+    if (n > 1) num_active++;
+    num_weights += n;
+  }
+  if (num_active > MAX_PD) return NULL;
+
+  sas_problem *problem = (sas_problem *)calloc(1, sizeof(sas_problem));
+  if (problem == NULL) return NULL;
+  problem->values = (double *)calloc(
+      NUM_VALUES + 2*(size_t)num_weights, sizeof(double));
+  if (problem->values == NULL) {
+    free(problem);
+    return NULL;
+  }
+  int32_t offset = 0;
+  for (int k=0; k < NUM_PARS; k++) {
+    problem->pd_length[k] = (pd_length == NULL ? 1 : pd_length[k]);
+    problem->pd_offset[k] = offset;
+    offset += problem->pd_length[k];
+    // Points with a single weight are set by sas_set_values.
+    if (problem->pd_length[k] == 1) {
+      problem->values[NUM_VALUES + num_weights + problem->pd_offset[k]] = 1.0;
+    }
+  }
+
+  // As for details.make_details, the loops are ordered by decreasing length.
+  // Parameters with equal length stay in parameter order.
+  ProblemDetails *details = &problem->details;
+#if MAX_PD > 0
+  int32_t used[NUM_PARS+1] = {0};
+  int64_t stride = 1;
+  for (int loop=0; loop < MAX_PD; loop++) {
+    int32_t best = -1;
+    for (int k=0; k < NUM_PARS; k++) {
+      if (!used[k] && (best < 0
+                       || problem->pd_length[k] > problem->pd_length[best])) {
+        best = k;
+      }
+    }
+    used[best] = 1;
+    details->pd_par[loop] = best;
+    details->pd_length[loop] = problem->pd_length[best];
+    details->pd_offset[loop] = problem->pd_offset[best];
+    details->pd_stride[loop] = stride;
+    stride *= problem->pd_length[best];
+  }
+  details->num_eval = stride;
+#else
+  details->num_eval = 1;
+#endif
+  details->num_weights = num_weights;
+  details->num_active = num_active;
+  details->theta_par = SAS_KERNEL_THETA_PAR;
+  problem->cutoff = 0.0;
+  return problem;
+}
+
+kernel void
+sas_problem_free(sas_problem *problem)
+{
+  if (problem == NULL) return;
+  free(problem->values);
+  free(problem->q);
+  free(problem->result);
+  free(problem);
+}
+
+kernel void
+sas_set_values(sas_problem *problem, double scale, double background,
+    const double *pars)
+{
+  double *values = problem->values;
+  values[0] = scale;
+  values[1] = background;
+  for (int k=0; k < NUM_PARS; k++) {
+    values[2+k] = pars[k];
+    if (problem->pd_length[k] == 1) {
+      values[NUM_VALUES + problem->pd_offset[k]] = pars[k];
+    }
+  }
+}
+
+kernel int32_t
+sas_set_dispersity(sas_problem *problem, int32_t par,
+    const double *x, const double *w)
+{
+  if (par < 0 || par >= NUM_PARS) return SAS_ERROR_ARGUMENT;
+  const int32_t n = problem->pd_length[par];
+  double *points = problem->values + NUM_VALUES + problem->pd_offset[par];
+  double *weights = points + problem->details.num_weights;
+  for (int k=0; k < n; k++) {
+    points[k] = x[k];
+    weights[k] = w[k];
+  }
+  return SAS_OK;
+}
+
+kernel void
+sas_set_cutoff(sas_problem *problem, double cutoff)
+{
+  problem->cutoff = cutoff;
+}
+
+// Make room for nq points in the q and result buffers.
+static int32_t
+_sas_reserve(sas_problem *problem, int32_t nq)
+{
+  if (nq < 0) return SAS_ERROR_ARGUMENT;
+  if (nq <= problem->nq && problem->result != NULL) return SAS_OK;
+  free(problem->q);
+  free(problem->result);
+  problem->q = (double *)calloc(QY_OFFSET(nq) + (size_t)nq, sizeof(double));
+  problem->result = (double *)calloc(2*(size_t)nq + _SAS_EXTRA, sizeof(double));
+  if (problem->q == NULL || problem->result == NULL) {
+    free(problem->q);
+    free(problem->result);
+    problem->q = problem->result = NULL;
+    problem->nq = 0;
+    return SAS_ERROR_MEMORY;
+  }
+  problem->nq = nq;
+  return SAS_OK;
+}
+
+// Run the kernel over the whole dispersity mesh.  The q values are already
+// in place for the 2D kernels.
+static void
+_sas_call(sas_problem *problem, int32_t nq, const double *q, int is_2d,
+    int32_t radius_effective_mode)
+{
+  const ProblemDetails *details = &problem->details;
+  const int mono = (details->num_eval == 1);
+  if (is_2d) {
+    if (mono) {
+      SAS_KERNEL_IQXY_MONO(nq, 0, 1, details, problem->values, problem->q,
+          problem->result, problem->cutoff, radius_effective_mode
+          _SAS_THREADS);
+    } else {
+      SAS_KERNEL_IQXY(nq, 0, details->num_eval, details, problem->values,
+          problem->q, problem->result, problem->cutoff,
+          radius_effective_mode _SAS_THREADS);
+    }
+  } else {
+    if (mono) {
+      SAS_KERNEL_IQ_MONO(nq, 0, 1, details, problem->values, q,
+          problem->result, problem->cutoff, radius_effective_mode
+          _SAS_THREADS);
+    } else {
+      SAS_KERNEL_IQ(nq, 0, details->num_eval, details, problem->values, q,
+          problem->result, problem->cutoff, radius_effective_mode
+          _SAS_THREADS);
+    }
+  }
+}
+
+// As kernel.Kernel._unpack_result followed by kernel.Kernel.Iq.
+static void
+_sas_scale(const sas_problem *problem, int32_t nq, int32_t nout, double *Iq)
+{
+  const double *result = problem->result;
+  double total_weight = result[nout*nq + 0];
+  if (total_weight == 0.0) total_weight = 1.0;
+  double shell_volume = result[nout*nq + 2]/total_weight;
+  if (shell_volume == 0.0) shell_volume = 1.0;
+  const double scale = problem->values[0]/(shell_volume*total_weight);
+  const double background = problem->values[1];
+  for (int k=0; k < nq; k++) {
+    Iq[k] = scale*result[nout*k] + background;
+  }
+}
+
+kernel int32_t
+sas_Iq(sas_problem *problem, int32_t nq, const double *q, double *Iq)
+{
+  const int32_t status = _sas_reserve(problem, nq);
+  if (status != SAS_OK) return status;
+  _sas_call(problem, nq, q, 0, 0);
+  _sas_scale(problem, nq, SAS_KERNEL_HAVE_FQ ? 2 : 1, Iq);
+  return SAS_OK;
+}
+
+kernel int32_t
+sas_Iqxy(sas_problem *problem, int32_t nq, const double *qx,
+    const double *qy, double *Iq)
+{
+  const int32_t status = _sas_reserve(problem, nq);
+  if (status != SAS_OK) return status;
+  // The kernel expects the qx block followed by the padded qy block.
+  memcpy(problem->q, qx, nq*sizeof(double));
+  memcpy(problem->q + QY_OFFSET(nq), qy, nq*sizeof(double));
+  _sas_call(problem, nq, NULL, 1, 0);
+  _sas_scale(problem, nq, 1, Iq);
+  return SAS_OK;
+}
+
+kernel int32_t
+sas_Fq(sas_problem *problem, int32_t nq, const double *q,
+    int32_t radius_effective_mode, double *F1, double *F2,
+    double *radius_effective, double *shell_volume, double *volume_ratio)
+{
+  const int32_t nout = SAS_KERNEL_HAVE_FQ ? 2 : 1;
+  if (F1 != NULL && nout == 1) return SAS_ERROR_NO_FQ;
+  const int32_t status = _sas_reserve(problem, nq);
+  if (status != SAS_OK) return status;
+  _sas_call(problem, nq, q, 0, radius_effective_mode);
+
+  const double *result = problem->result;
+  double total_weight = result[nout*nq + 0];
+  if (total_weight == 0.0) total_weight = 1.0;
+  const double form = result[nout*nq + 1]/total_weight;
+  double shell = result[nout*nq + 2]/total_weight;
+  if (shell == 0.0) shell = 1.0;
+  for (int k=0; k < nq; k++) {
+    F2[k] = result[nout*k]/total_weight;
+    if (F1 != NULL) F1[k] = result[nout*k + 1]/total_weight;
+  }
+  if (radius_effective != NULL) {
+    *radius_effective = result[nout*nq + 3]/total_weight;
+  }
+  if (shell_volume != NULL) *shell_volume = shell;
+  if (volume_ratio != NULL) *volume_ratio = form/shell;
+  return SAS_OK;
+}
@@ -0,0 +1,128 @@
+/*
+    C interface to a compiled sasmodels model.
+
+    Every dll built by sasmodels.kerneldll.make_dll exports these functions
+    alongside the KERNEL_NAME kernels, so that native code can evaluate the
+    model without going through python.  Each dll holds a single model, so
+    the names are the same in every dll; load the dll at run time with
+    dlopen/LoadLibrary and look up the functions by name.  Native callers
+    include this header for the declarations.
+
+    A calculation follows the same steps as sasmodels.direct_model:
+
+        sas_problem *p = sas_problem_new(pd_length);  // build the details
+        sas_set_values(p, scale, background, pars);   // pack the values
+        sas_set_dispersity(p, k, x, w);               // for each pd par k
+        sas_Iq(p, nq, q, Iq);                         // evaluate
+        sas_problem_free(p);                          // release
+
+    The problem may be evaluated any number of times, with new values set
+    between calls.  It holds the work buffers for the kernel, so a problem
+    must not be used from two threads at once.  Separate problems may be
+    evaluated concurrently.
+
+    Parameters are numbered as in model_info.parameters.kernel_parameters,
+    with pars[k] holding the value of parameter k.  Vector parameters are
+    expanded, so a parameter with length 3 fills pars[k:k+3].  Scale and
+    background are given separately.  The orientation dispersity weights
+    are used as given.
+
+    Magnetic parameters are not supported.  The magnetic field values are
+    set to zero, which gives the non-magnetic calculation.
+
+    The values are in the precision of the dll, which is double precision
+    unless the model was built with dtype='single' or 'longdouble'.  Check
+    that sas_float_size() returns sizeof(double) before using the dll.
+
+    Functions returning int32_t return SAS_OK on success, or one of the
+    negative error codes below.
+
+    This interface has version SAS_API_VERSION.  Any change to the calling
+    sequence will change the version number.
+*/
+
+#ifndef SAS_KERNEL_API_H
+#define SAS_KERNEL_API_H
+
+// Within the dll source, int32_t is declared by kernel_header.c.
+#if !defined(SAS_DOUBLE)
+#include <stdint.h>
+#endif
+
+#define SAS_API_VERSION 1
+
+#define SAS_OK 0
+#define SAS_ERROR_ARGUMENT -1  // parameter number or length out of range
+#define SAS_ERROR_MEMORY -2    // could not allocate the work buffers
+#define SAS_ERROR_NO_FQ -3     // F(q) requested from a model without Fq
+
+typedef struct sas_problem sas_problem;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Version of the interface compiled into the dll.
+int32_t sas_api_version(void);
+
+// Model name, such as "sphere".
+const char *sas_model_name(void);
+
+// Size of the floating point values in bytes.
+int32_t sas_float_size(void);
+
+// Number of parameters, not including scale and background.
+int32_t sas_num_pars(void);
+
+// Maximum number of polydisperse parameters.
+int32_t sas_max_pd(void);
+
+// Non-zero if the model computes F(q) as well as F^2(q).
+int32_t sas_have_Fq(void);
+
+// Create a problem with pd_length[k] dispersity points for parameter k, or
+// a single point for every parameter if pd_length is NULL.  Returns NULL if
+// there are more than sas_max_pd() parameters with length greater than one,
+// if a length is less than one, or if there is not enough memory.
+sas_problem *sas_problem_new(const int32_t *pd_length);
+
+// Release the problem and its work buffers.
+void sas_problem_free(sas_problem *problem);
+
+// Set scale, background and the values of the sas_num_pars() parameters.
+// Parameters with a single dispersity point are evaluated at pars[k]; the
+// values for the polydisperse parameters are ignored.
+void sas_set_values(sas_problem *problem, double scale, double background,
+    const double *pars);
+
+// Set the pd_length[par] dispersity points x and weights w for parameter
+// par, as returned by sasmodels.weights.get_weights.
+int32_t sas_set_dispersity(sas_problem *problem, int32_t par,
+    const double *x, const double *w);
+
+// Skip the dispersity points with weight product below cutoff, as for the
+// cutoff argument of sasmodels.direct_model.call_kernel.  The default is 0.
+void sas_set_cutoff(sas_problem *problem, double cutoff);
+
+// Compute I(q) at the nq values q[], including scale and background.
+int32_t sas_Iq(sas_problem *problem, int32_t nq, const double *q,
+    double *Iq);
+
+// Compute I(qx, qy) at the nq points (qx[k], qy[k]).
+int32_t sas_Iqxy(sas_problem *problem, int32_t nq, const double *qx,
+    const double *qy, double *Iq);
+
+// Compute <F> and <F^2> at the nq values q[], without scale and background,
+// as for sasmodels.direct_model.call_Fq.  F1 may be NULL, and must be NULL
+// if the model has no Fq.  The remaining outputs, which may also be NULL,
+// are set to R_eff for radius_effective_mode, the shell volume and the
+// ratio of form volume to shell volume.
+int32_t sas_Fq(sas_problem *problem, int32_t nq, const double *q,
+    int32_t radius_effective_mode, double *F1, double *F2,
+    double *radius_effective, double *shell_volume, double *volume_ratio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAS_KERNEL_API_H
@@ -18,6 +18,7 @@
    #define pconstant constant
 
    typedef int int32_t;
+   typedef long int64_t;
 
    #if defined(USE_SINCOS)
    #  define SINCOS(angle,svar,cvar) svar=sincos(angle,&cvar)
@@ -91,6 +92,7 @@
      #include <stdio.h>
      #if defined(__TINYC__)
          typedef int int32_t;
+         typedef long long int64_t;
          #include <math.h>
          // TODO: check isnan is correct
          inline double _isnan(double x) { return x != x; } // hope this doesn't optimize away!
@@ -118,8 +120,48 @@
    #define powr(a,b) pow(a,b)
    #define pown(a,b) pow(a,b)
 
+   // The OpenMP kernel driver in kernel_iq.c needs thread info and calloc.
+   #if defined(USE_OPENMP)
+     #include <stdlib.h>
+     #include <omp.h>
+   #endif
+
+   // Models which keep a cache between calls declare it THREAD_LOCAL since
+   // the dll may be called from several threads at once, whether or not it
+   // uses OpenMP.  TinyCC has no thread local storage, so the caller must
+   // run its kernels one at a time.
+   #if defined(_MSC_VER)
+     #define THREAD_LOCAL __declspec(thread)
+   #elif defined(__TINYC__)
+     #define THREAD_LOCAL
+   #else
+     #define THREAD_LOCAL __thread
+   #endif
+
 #endif // !USE_OPENCL
 
+// SIMD_LOOP(clauses) marks the next loop as having independent iterations
+// so that the compiler can evaluate several at once, and SIMD_FUNCTION
+// asks for a vector version of the next function so that it can be called
+// from such a loop.  They are enabled by USE_SIMD, which the dll build
+// defines along with the flag for OpenMP simd directives (-fopenmp-simd).
+#if defined(USE_SIMD)
+   #define _SAS_PRAGMA(_x) _Pragma(#_x)
+   #define SIMD_LOOP(_clauses) _SAS_PRAGMA(omp simd _clauses)
+   #define SIMD_FUNCTION _SAS_PRAGMA(omp declare simd)
+#else
+   #define SIMD_LOOP(_clauses)
+   #define SIMD_FUNCTION
+#endif
+
+// SETUP_SELECT(cpu, gpu) is the size or offset of the model setup scratch
+// buffer for the target, since models may use a shorter buffer on the GPU.
+#if defined(USE_GPU)
+   #define SETUP_SELECT(_cpu, _gpu) (_gpu)
+#else
+   #define SETUP_SELECT(_cpu, _gpu) (_cpu)
+#endif
+
 #if defined(NEED_CBRT)
    #define cbrt(_x) pow(_x, 0.33333333333333333333333)
 #endif
@@ -194,14 +236,12 @@ inline double cube(double x) { return x*x*x; }
 inline double clip(double x, double low, double high) { return x < low ? low : x > high ? high : x; }
 inline double sas_sinx_x(double x) { return x==0 ? 1.0 : sin(x)/x; }
 
-// vector algebra
-static void SET_VEC(double *vector, double v0, double v1, double v2)
-{
-    vector[0] = v0;
-    vector[1] = v1;
-    vector[2] = v2;
-}
+// Type of the values returned by reference from Fq().  It follows the
+// precision of the model code, which is float for mixed precision kernels
+// even though the rest of kernel_iq is double.
+typedef double model_real;
 
+// vector algebra
 static void SCALE_VEC(double *vector, double a)
 {
     vector[0] = a*vector[0];
@@ -227,14 +267,6 @@ static double MAG_VEC( double *vec)
 }
 
 
-static void ORTH_VEC(double *result_vec, double *vec1, double *vec2)
-{
-    double scale =  SCALAR_VEC(vec1,vec2) / SCALAR_VEC(vec2,vec2);
-    result_vec[0] = vec1[0] - scale * vec2[0];
-    result_vec[1] = vec1[1] - scale * vec2[1];
-    result_vec[2] = vec1[2] - scale * vec2[2];
-}
-
 // CRUFT: support old style models with orientation received qx, qy and angles
 
 // To rotate from the canonical position to theta, phi, psi, first rotate by
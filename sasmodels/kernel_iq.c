@@ -14,6 +14,10 @@
 //
 //  MAX_PD : the maximum number of dispersity loops allowed for this model,
 //      which will be at most modelinfo.MAX_PD.
+//  PD_LOOP_INIT, PD_LOOP_OPEN, PD_LOOP_CLOSE : the PD_INIT, PD_OPEN and
+//      PD_CLOSE macros for each of the MAX_PD levels of the dispersity
+//      loop, from the outermost level in for INIT and OPEN and from the
+//      innermost level out for CLOSE (see generate.pd_loops).
 //  NUM_PARS : the number of parameters in the parameter table
 //  NUM_VALUES : the number of values to skip at the start of the
 //      values array before you get to the dispersity values.
@@ -21,6 +25,22 @@
 //      ParameterTable type.
 //  KERNEL_NAME : model_Iq, model_Iqxy or model_Imagnetic.  This code is
 //      included three times, once for each kernel type.
+//  KERNEL_BATCH : defined for the GPU batch kernels (model_Iq_batch, etc.)
+//      which evaluate a set of parameter vectors in one launch.
+//  KERNEL_MONO : defined for the monodisperse kernels (model_Iq_mono, etc.)
+//      which are only called when the dispersity mesh has a single point,
+//      so the dispersity loops and the restart logic compile away.
+//  KERNEL_FLAT : defined for the flat mesh kernels (model_Iq_flat, etc.)
+//      which walk the compacted list of mesh points from
+//      details.flatten_mesh in a single loop.
+//  KERNEL_LOCAL : defined for the GPU kernels (model_Iq_local, etc.) which
+//      copy the dispersity values and weights into local memory shared by
+//      the work group before walking the mesh.  The host only uses them
+//      when the 2*num_weights values fit in PD_CACHE_SIZE.
+//  KERNEL_SPLIT : defined for the GPU kernels (model_Iq_split, etc.) which
+//      split each launch over the dispersity mesh as well as over q, with
+//      the second work dimension selecting a part of part_size mesh points
+//      and a row of partial sums in the result.  The host adds the rows.
 //  MAGNETIC : defined when the magnetic kernel is being instantiated
 //  NUM_MAGNETIC : the number of magnetic parameters
 //  MAGNETIC_PARS : a comma-separated list of indices to the sld
@@ -37,21 +57,44 @@
 //  CALL_IQ_AC(qa, qc, table) : call the Iqxy function for symmetric shapes
 //  CALL_IQ_ABC(qa, qc, table) : call the Iqxy function for asymmetric shapes
 //  CALL_IQ_XY(qx, qy, table) : call the Iqxy function for arbitrary models
+//  SETUP_SIZE : defined with the length of the scratch buffer if the model
+//      has a setup function.  The CALL_IQ macros then pass setup_scratch
+//      as the final argument, so it must be in scope at the call.
+//  CALL_SETUP(scratch, table) : call the setup function for a mesh point.
 //  PROJECTION : equirectangular=1, sinusoidal=2
 //      see explore/jitter.py for definitions.
+//  USE_KAHAN_SUMMATION : defined if the dispersity sums should use
+//      compensated summation (see generate.USE_KAHAN).
+//  ADAPTIVE_TOLERANCE : defined with the relative tolerance for the flat
+//      mesh kernels to stop evaluating a q value once the rest of the mesh
+//      is estimated to change its sum by less than this (see
+//      generate.ADAPTIVE_TOLERANCE).
+//  USE_KERNEL_STATS : defined for the instrumented build, which appends
+//      NUM_KERNEL_STATS counters after the normalization sums in the
+//      result (see generate.USE_KERNEL_STATS and kernel.KERNEL_STATS).
+//
+// 2D q values are stored as a block of nq qx values followed by a block of
+// nq qy values, with the qx block padded to QY_OFFSET(nq) entries so that
+// both blocks can be read with aligned, contiguous (or coalesced) loads.
 
 
 #ifndef _PAR_BLOCK_ // protected block so we can include this code twice.
 #define _PAR_BLOCK_
 
+// Positions in the mesh are 64-bit since the tensor product over several
+// finely sampled dispersity parameters can exceed 2^31 points.  The 64-bit
+// fields come first so that the layout matches details.CallDetails without
+// padding between the fields.
 typedef struct {
+#if MAX_PD > 0
+    int64_t pd_stride[MAX_PD];  // stride to move to the next index at this level
+#endif // MAX_PD > 0
+    int64_t num_eval;           // total number of voxels in hypercube
 #if MAX_PD > 0
     int32_t pd_par[MAX_PD];     // id of the nth dispersity variable
     int32_t pd_length[MAX_PD];  // length of the nth dispersity weight vector
     int32_t pd_offset[MAX_PD];  // offset of pd weights in the value & weight vector
-    int32_t pd_stride[MAX_PD];  // stride to move to the next index at this level
 #endif // MAX_PD > 0
-    int32_t num_eval;           // total number of voxels in hypercube
     int32_t num_weights;        // total length of the weights vector
     int32_t num_active;         // number of non-trivial pd loops
     int32_t theta_par;          // id of first orientation variable
@@ -65,119 +108,124 @@ typedef union {
     ParameterTable table;
     double vector[4*((NUM_PARS+3)/4)];
 } ParameterBlock;
+
+// Start of the qy block in the 2D q vector.  This must match the padding
+// used by the q inputs in kernelpy.py, kernelcl.py and kernelcuda.py.
+#define QY_OFFSET(_nq) ((((_nq)+15)/16)*16)
+
+// Add _x to _sum, carrying the low order bits lost from _sum in _err when
+// compensated summation is enabled.  The _err variables only need to be
+// declared when USE_KAHAN_SUMMATION is defined.  Compensation restarts on
+// each call, so the rounding error grows with the number of calls needed
+// to cover the mesh rather than with the number of mesh points.  Note that
+// fast math options may reorder the arithmetic and undo the compensation.
+#if defined(USE_KAHAN_SUMMATION)
+  #if !defined(USE_GPU)
+    #include <stdlib.h>
+  #endif
+  #define KAHAN_ADD(_sum, _err, _x) do { \
+      const double _y = (_x) - (_err); \
+      const double _t = (_sum) + _y; \
+      (_err) = (_t - (_sum)) - _y; \
+      (_sum) = _t; \
+    } while (0)
+#else
+  #define KAHAN_ADD(_sum, _err, _x) do { (_sum) += (_x); } while (0)
+#endif
 #endif // _PAR_BLOCK_
 
-#if defined(MAGNETIC) && NUM_MAGNETIC > 0
+// Error control for the flat mesh, which details.flatten_mesh sorts by
+// decreasing weight when ADAPTIVE_TOLERANCE is defined, storing the weight
+// of the mesh from each point to the end after the product weights.  A q
+// value is complete when the weight still to come, times the larger of the
+// last F^2 and the mean F^2 so far, is below the tolerance relative to the
+// sum so far.  The weights are decreasing, so once a q value is complete
+// it stays complete.  The estimate needs a point evaluated in the same
+// call, with last < 0 until then.  Meshes without the tail weights, with
+// total == 0, are never complete.
+#if !defined(_ADAPTIVE_SECTION) && defined(ADAPTIVE_TOLERANCE) \
+    && defined(KERNEL_FLAT) && MAX_PD>0
+#define _ADAPTIVE_SECTION
+#if !defined(USE_GPU)
+  #include <stdlib.h>
+#endif
+static int
+adaptive_complete(double sum, double last, double tail, double total)
+{
+  const double done = total - tail;
+  if (last < 0.0 || !(sum > 0.0) || !(done > 0.0)) return 0;
+  return tail*fmax(last, sum/done) < ADAPTIVE_TOLERANCE*sum;
+}
+#endif // _ADAPTIVE_SECTION
+
+#if !defined(_MAGNETIC_SECTION) && defined(MAGNETIC) && NUM_MAGNETIC > 0
+#define _MAGNETIC_SECTION
 // ===== Helper functions for magnetism =====
 
 
 
 
-// Compute spin cross sections given in_spin and out_spin
+// Spin cross sections are identified by index:
+//     0=dd, 1=du.real, 2=ud.real, 3=uu, 4=du.imag, 5=ud.imag
 // To convert spin cross sections to sld b:
 //     uu * (sld - m_perp_x);
 //     dd * (sld + m_perp_x);
 //     ud * (m_perp_y - 1j*m_perp_z);
 //     du * (m_perp_y + 1j*m_perp_z);
 //(x,y,z) is a local magnetic coordinate system. m_perp_x denotes the magnetic scattering vector along the polarisation and m_perp_y the component along the scattering vector, m_perpz is orthogonal to the others.
-// weights for spin crosssections: dd du real, ud real, uu, du imag, ud imag
-static void set_spin_weights(double in_spin, double out_spin, double weight[6])
-{
+// The cross section weights, which depend on the polarisation efficiency of
+// the instrument, are computed on the host by details.convert_spin_state.
 
-  double norm;
-  in_spin = clip(in_spin, 0.0, 1.0);
-  out_spin = clip(out_spin, 0.0, 1.0);
-  // Previous version of this function took the square root of the weights,
-  // under the assumption that
-  //
-  //     w*I(q, rho1, rho2, ...) = I(q, sqrt(w)*rho1, sqrt(w)*rho2, ...)
-  //
-  // However, since the weights are applied to the final intensity and
-  // are not interned inside the I(q) function, we want the full
-  // weight and not the square root.  Anyway no function will ever use
-  // set_spin_weights as part of calculating an amplitude, as the weights are
-  // related to polarisation efficiency of the instrument. The weights serve to
-  // construct various magnet scattering cross sections, which are linear combinations
-  // of the spin-resolved cross sections. The polarisation efficiency e_in and e_out
-  // are parameters ranging from 0.5 (unpolarised) beam to 1 (perfect optics).
-  // For in_spin or out_spin <0.5 one assumes a CS, where the spin is reversed/flipped
-  // with respect to the initial supermirror polariser. The actual polarisation efficiency
-  // in this case is however e_in/out = 1-in/out_spin.
-
-  if (out_spin < 0.5){norm=1-out_spin;}
-  else{norm=out_spin;}
-
-
-// The norm is needed to make sure that the scattering cross sections are
-//correctly weighted, such that the sum of spin-resolved measurements adds up to
-// the unpolarised or half-polarised scattering cross section. No intensity weighting
-// needed on the incoming polariser side (assuming that a user), has normalised
-// to the incoming flux with polariser in for SANSPOl and unpolarised beam, respectively.
-
-
-  weight[0] = (1.0-in_spin) * (1.0-out_spin) / norm; // dd
-  weight[1] = (1.0-in_spin) * out_spin / norm;       // du
-  weight[2] = in_spin * (1.0-out_spin) / norm;       // ud
-  weight[3] = in_spin * out_spin / norm;             // uu
-  weight[4] = weight[1]; // du.imag
-  weight[5] = weight[2]; // ud.imag
+// Directions used by the magnetic cross sections, which depend only on the
+// polarization angles and so are computed once per call on the host.
+typedef struct {
+  double P[3];      // polarization direction
+  double perpy[3];  // unit vectors spanning the plane perpendicular to the
+  double perpz[3];  // polarization, used for spin flip scattering
+} MagneticFrame;
+
+// Project the part of the magnetization m perpendicular to the unit
+// vector (qhat_x, qhat_y, 0) onto the polarization frame.  These are the
+// only q dependent terms in the magnetic sld, and they are shared by all
+// six cross sections.
+static void mag_projection(
+  const MagneticFrame *frame,
+  const double qhat_x, const double qhat_y,
+  const double mx, const double my, const double mz,
+  double proj[3]
+)
+{
+  const double m_q = mx*qhat_x + my*qhat_y;
+  const double Mperp[3] = { mx - m_q*qhat_x, my - m_q*qhat_y, mz };
+  proj[0] = frame->P[0]*Mperp[0] + frame->P[1]*Mperp[1] + frame->P[2]*Mperp[2];
+  proj[1] = frame->perpy[0]*Mperp[0] + frame->perpy[1]*Mperp[1];
+  proj[2] = frame->perpz[0]*Mperp[0] + frame->perpz[1]*Mperp[1] + frame->perpz[2]*Mperp[2];
 }
 
-// Compute the magnetic sld
+// Compute the magnetic sld from the projections returned by mag_projection
 static double mag_sld(
   const unsigned int xs, // 0=dd, 1=du.real, 2=ud.real, 3=uu, 4=du.imag, 5=ud.imag
-  const double qx, const double qy,
-  const double cos_mtheta, const double sin_mtheta,
-  const double cos_mphi, const double sin_mphi,
   const double sld,
-  const double mx, const double my, const double mz
+  const double proj[3]
 )
 {
-  double Mvector[3];
-  double Pvector[3];
-  double qvector[3];
-  double perpy[3];
-  double perpz[3];
-  double Mperp[3];
-
-  const double qsq = sqrt(qx*qx + qy*qy); 
-  SET_VEC(qvector, qx / qsq, qy / qsq, 0);
-  SET_VEC(Mvector, mx, my, mz);
-
-  SET_VEC(Pvector, sin_mtheta * cos_mphi, sin_mtheta * sin_mphi, cos_mtheta);
-  //two unit vectors spanning up the plane perpendicular to polarisation for SF scattering
-  SET_VEC(perpy, -sin_mphi, cos_mphi, 0);
-  SET_VEC(perpz, -cos_mtheta * cos_mphi, -cos_mtheta * sin_mphi, sin_mtheta);
-  ORTH_VEC(Mperp, Mvector, qvector);
-
-
-
-  if (xs < 4) {
-
-    switch (xs) {
-      default: // keep compiler happy; condition ensures xs in [0,1,2,3]
-      case 0: // dd => sld - D Pvector \cdot Mperp
-          return sld - SCALAR_VEC(Pvector, Mperp);
-      case 1: // du.real          
-          return SCALAR_VEC(perpy, Mperp);
-      case 2: // ud.real   
-          return SCALAR_VEC(perpy, Mperp);
-      case 3: // uu => sld + D Pvector \cdot Mperp
-          return sld + SCALAR_VEC(Pvector, Mperp); 
-    }
-  } else {
-    if (xs== 4) {
-      return - SCALAR_VEC(perpz, Mperp);  // du.imag => - i  nperp \cdot MperpP
-    } else { // index == 5 
-      return + SCALAR_VEC(perpz, Mperp);   // du.imag => + i nperp \cdot MperpP
-    }
+  switch (xs) {
+    default: // keep compiler happy; caller ensures xs in [0,5]
+    case 0: // dd => sld - D Pvector \cdot Mperp
+        return sld - proj[0];
+    case 1: // du.real
+    case 2: // ud.real
+        return proj[1];
+    case 3: // uu => sld + D Pvector \cdot Mperp
+        return sld + proj[0];
+    case 4: // du.imag => - i  nperp \cdot MperpP
+        return -proj[2];
+    case 5: // ud.imag => + i nperp \cdot MperpP
+        return proj[2];
   }
 }
 
-
-
-
-#endif
+#endif // _MAGNETIC_SECTION
 
 // ===== Helper functions for orientation and jitter =====
 
@@ -191,27 +239,40 @@ typedef struct {
     double R31, R32;
 } QACRotation;
 
-// Fill in the rotation matrix R from the view angles (theta, phi) and the
-// jitter angles (dtheta, dphi).  This matrix can be applied to all of the
-// (qx, qy) points in the image to produce R*[qx,qy]' = [qa,qc]'
+// Reverse view matrix for the view angles (theta, phi).  The view angles
+// are fixed for the call, so this is computed once before the dispersity
+// loop rather than at every jitter point.
+typedef struct {
+    double V11, V12, V21, V22, V31, V32;
+} QACView;
+
 static void
-qac_rotation(
-    QACRotation *rotation,
-    double theta, double phi,
-    double dtheta, double dphi)
+qac_view(QACView *view, double theta, double phi)
 {
     double sin_theta, cos_theta;
     double sin_phi, cos_phi;
 
-    // reverse view matrix
     SINCOS(theta*M_PI_180, sin_theta, cos_theta);
     SINCOS(phi*M_PI_180, sin_phi, cos_phi);
-    const double V11 = cos_phi*cos_theta;
-    const double V12 = sin_phi*cos_theta;
-    const double V21 = -sin_phi;
-    const double V22 = cos_phi;
-    const double V31 = sin_theta*cos_phi;
-    const double V32 = sin_phi*sin_theta;
+    view->V11 = cos_phi*cos_theta;
+    view->V12 = sin_phi*cos_theta;
+    view->V21 = -sin_phi;
+    view->V22 = cos_phi;
+    view->V31 = sin_theta*cos_phi;
+    view->V32 = sin_phi*sin_theta;
+}
+
+// Fill in the rotation matrix R from the view matrix for (theta, phi) and
+// the jitter angles (dtheta, dphi).  This matrix can be applied to all of
+// the (qx, qy) points in the image to produce R*[qx,qy]' = [qa,qc]'
+static void
+qac_rotation(
+    QACRotation *rotation,
+    const QACView *view,
+    double dtheta, double dphi)
+{
+    double sin_theta, cos_theta;
+    double sin_phi, cos_phi;
 
     // reverse jitter matrix
     SINCOS(dtheta*M_PI_180, sin_theta, cos_theta);
@@ -221,8 +282,8 @@ qac_rotation(
     const double J33 = cos_phi*cos_theta;
 
     // reverse matrix
-    rotation->R31 = J31*V11 + J32*V21 + J33*V31;
-    rotation->R32 = J31*V12 + J32*V22 + J33*V32;
+    rotation->R31 = J31*view->V11 + J32*view->V21 + J33*view->V31;
+    rotation->R32 = J31*view->V12 + J32*view->V22 + J33*view->V32;
 }
 
 // Apply the rotation matrix returned from qac_rotation to the point (qx,qy),
@@ -251,29 +312,43 @@ typedef struct {
     double R31, R32;
 } QABCRotation;
 
-// Fill in the rotation matrix R from the view angles (theta, phi, psi) and the
-// jitter angles (dtheta, dphi, dpsi).  This matrix can be applied to all of the
-// (qx, qy) points in the image to produce R*[qx,qy]' = [qa,qb,qc]'
+// Reverse view matrix for the view angles (theta, phi, psi), computed
+// once for the call as for qac_view.
+typedef struct {
+    double V11, V12, V21, V22, V31, V32;
+} QABCView;
+
 static void
-qabc_rotation(
-    QABCRotation *rotation,
-    double theta, double phi, double psi,
-    double dtheta, double dphi, double dpsi)
+qabc_view(QABCView *view, double theta, double phi, double psi)
 {
     double sin_theta, cos_theta;
     double sin_phi, cos_phi;
     double sin_psi, cos_psi;
 
-    // reverse view matrix
     SINCOS(theta*M_PI_180, sin_theta, cos_theta);
     SINCOS(phi*M_PI_180, sin_phi, cos_phi);
     SINCOS(psi*M_PI_180, sin_psi, cos_psi);
-    const double V11 = -sin_phi*sin_psi + cos_phi*cos_psi*cos_theta;
-    const double V12 = sin_phi*cos_psi*cos_theta + sin_psi*cos_phi;
-    const double V21 = -sin_phi*cos_psi - sin_psi*cos_phi*cos_theta;
-    const double V22 = -sin_phi*sin_psi*cos_theta + cos_phi*cos_psi;
-    const double V31 = sin_theta*cos_phi;
-    const double V32 = sin_phi*sin_theta;
+    view->V11 = -sin_phi*sin_psi + cos_phi*cos_psi*cos_theta;
+    view->V12 = sin_phi*cos_psi*cos_theta + sin_psi*cos_phi;
+    view->V21 = -sin_phi*cos_psi - sin_psi*cos_phi*cos_theta;
+    view->V22 = -sin_phi*sin_psi*cos_theta + cos_phi*cos_psi;
+    view->V31 = sin_theta*cos_phi;
+    view->V32 = sin_phi*sin_theta;
+}
+
+// Fill in the rotation matrix R from the view matrix for (theta, phi, psi)
+// and the jitter angles (dtheta, dphi, dpsi).  This matrix can be applied
+// to all of the (qx, qy) points in the image to produce
+// R*[qx,qy]' = [qa,qb,qc]'
+static void
+qabc_rotation(
+    QABCRotation *rotation,
+    const QABCView *view,
+    double dtheta, double dphi, double dpsi)
+{
+    double sin_theta, cos_theta;
+    double sin_phi, cos_phi;
+    double sin_psi, cos_psi;
 
     // reverse jitter matrix
     SINCOS(dtheta*M_PI_180, sin_theta, cos_theta);
@@ -290,12 +365,12 @@ qabc_rotation(
     const double J33 = cos_phi*cos_theta;
 
     // reverse matrix
-    rotation->R11 = J11*V11 + J12*V21 + J13*V31;
-    rotation->R12 = J11*V12 + J12*V22 + J13*V32;
-    rotation->R21 = J21*V11 + J22*V21 + J23*V31;
-    rotation->R22 = J21*V12 + J22*V22 + J23*V32;
-    rotation->R31 = J31*V11 + J32*V21 + J33*V31;
-    rotation->R32 = J31*V12 + J32*V22 + J33*V32;
+    rotation->R11 = J11*view->V11 + J12*view->V21 + J13*view->V31;
+    rotation->R12 = J11*view->V12 + J12*view->V22 + J13*view->V32;
+    rotation->R21 = J21*view->V11 + J22*view->V21 + J23*view->V31;
+    rotation->R22 = J21*view->V12 + J22*view->V22 + J23*view->V32;
+    rotation->R31 = J31*view->V11 + J32*view->V21 + J33*view->V31;
+    rotation->R32 = J31*view->V12 + J32*view->V22 + J33*view->V32;
 }
 
 // Apply the rotation matrix returned from qabc_rotation to the point (qx,qy),
@@ -314,17 +389,61 @@ qabc_apply(
 #endif // _QABC_SECTION
 
 // ==================== KERNEL CODE ========================
+// The problem details are small and read by every work item, so the
+// OpenCL kernels take them from constant memory.  The batch kernels index
+// into a matrix of details, which may be too large for constant memory.
+#if defined(USE_OPENCL) && !defined(KERNEL_BATCH)
+#  define pdetails constant
+#else
+#  define pdetails pglobal
+#endif
+// Address space of the dispersity values and weights.
+#if defined(USE_OPENCL) && defined(KERNEL_LOCAL)
+#  define pdispersity local
+#else
+#  define pdispersity pglobal
+#endif
+#if defined(USE_OPENMP)
+// With OpenMP the kernel body is compiled as a serial function which
+// evaluates part of the dispersity mesh for part of the q vector.  The
+// exported kernel, defined at the end of this file, divides the work
+// amongst the threads and combines the partial results.
+#ifndef KERNEL_PART
+#  define _KERNEL_PART(_name) _name ## _part
+#  define KERNEL_PART(_name) _KERNEL_PART(_name)
+#endif
+static void KERNEL_PART(KERNEL_NAME)(
+#else
 kernel
 void KERNEL_NAME(
+#endif
     int32_t nq,                   // number of q values
-    const int32_t pd_start,       // where we are in the dispersity loop
-    const int32_t pd_stop,        // where we are stopping in the dispersity loop
-    pglobal const ProblemDetails *details,
+#if defined(KERNEL_SPLIT)
+    const int64_t launch_start,   // where this launch starts in the mesh
+    const int64_t launch_stop,    // where this launch stops in the mesh
+#else
+    const int64_t pd_start,       // where we are in the dispersity loop
+    const int64_t pd_stop,        // where we are stopping in the dispersity loop
+#endif
+    pdetails const ProblemDetails *details,
     pglobal const double *values, // parameter values and distributions
     pglobal const double *q,      // nq q values, with padding to boundary
     pglobal double *result,       // nq+1 return values, again with padding
     const double cutoff,          // cutoff in the dispersity weight product
     int32_t radius_effective_mode // which effective radius to compute
+#if defined(USE_OPENMP)
+    , int32_t qy_offset           // start of qy in q, which may be a slice
+    , int32_t sum_weights         // accumulate the normalization sums
+#endif
+#if defined(KERNEL_BATCH)
+    , int32_t details_stride      // int32 count between details in batch
+    , int32_t values_stride       // double count between values in batch
+    , int32_t result_stride       // double count between results in batch
+#endif
+#if defined(KERNEL_SPLIT)
+    , int32_t part_size           // mesh points in each part
+    , int32_t result_stride       // double count between partial results
+#endif
     )
 {
 #if defined(USE_GPU)
@@ -334,7 +453,62 @@ void KERNEL_NAME(
   #else // USE_CUDA
   const int q_index = threadIdx.x + blockIdx.x * blockDim.x;
   #endif
+  #if defined(KERNEL_LOCAL) && MAX_PD > 0
+    // Every work item reads the same dispersity value and weight at each
+    // step of the mesh, so copy them once per work group, with the copy
+    // shared between the work items.  The padding work items beyond nq
+    // help with the copy and must reach the barrier before returning.
+    local double pd_cache[PD_CACHE_SIZE];
+    {
+      #if defined(USE_OPENCL)
+      const int local_index = get_local_id(0);
+      const int local_size = get_local_size(0);
+      #else // USE_CUDA
+      const int local_index = threadIdx.x;
+      const int local_size = blockDim.x;
+      #endif
+      const int num_cache = 2*details->num_weights;
+      for (int k = local_index; k < num_cache; k += local_size) {
+        pd_cache[k] = values[NUM_VALUES + k];
+      }
+    }
+    #if defined(USE_OPENCL)
+    barrier(CLK_LOCAL_MEM_FENCE);
+    #else // USE_CUDA
+    __syncthreads();
+    #endif
+  #endif
   if (q_index >= nq) return;
+  #if defined(KERNEL_BATCH)
+    // The second work dimension selects the parameter set in the batch.
+    #if defined(USE_OPENCL)
+    const int batch_index = get_global_id(1);
+    #else // USE_CUDA
+    const int batch_index = blockIdx.y;
+    #endif
+    details = (pglobal const ProblemDetails *)
+        ((pglobal const int32_t *)details + batch_index*details_stride);
+    values += batch_index*values_stride;
+    result += batch_index*result_stride;
+    // Mesh sizes differ between parameter sets, so the shorter meshes are
+    // already complete on the later calls.
+    if (pd_start >= details->num_eval) return;
+  #endif
+  #if defined(KERNEL_SPLIT)
+    // The second work dimension selects the part of the mesh.  The host
+    // only launches parts which have at least one mesh point, and never
+    // more parts than on the first launch, so every row of partial sums
+    // is cleared by the first launch and accumulates on the later ones.
+    #if defined(USE_OPENCL)
+    const int part_index = get_global_id(1);
+    #else // USE_CUDA
+    const int part_index = blockIdx.y;
+    #endif
+    const int64_t pd_start = launch_start + (int64_t)part_index*part_size;
+    const int64_t pd_stop = (launch_stop - pd_start < part_size
+                             ? launch_stop : pd_start + part_size);
+    result += part_index*result_stride;
+  #endif
 #else
   // Define q_index here so that debugging statements can be written to work
   // for both OpenCL and DLL using:
@@ -348,9 +522,6 @@ void KERNEL_NAME(
   ParameterBlock local_values;
   //   values[0] is scale
   //   values[1] is background
-  #ifdef USE_OPENMP
-  #pragma omp parallel for
-  #endif
   for (int i=0; i < NUM_PARS; i++) {
     local_values.vector[i] = values[2+i];
     //if (q_index==0) printf("p%d = %g\n",i, local_values.vector[i]);
@@ -364,18 +535,39 @@ void KERNEL_NAME(
   // These parameters are updated with the effective sld due to magnetism.
   const int32_t slds[] = { MAGNETIC_PARS };
 
-  // Interpret polarization cross section.
-  //     up_frac_i = values[NUM_PARS+2];
-  //     up_frac_f = values[NUM_PARS+3];
-  //     up_theta = values[NUM_PARS+4];
-  //     up_phi = values[NUM_PARS+5];
-  // TODO: could precompute more magnetism parameters before calling the kernel.
-  double xs_weights[8];  // uu, ud real, du real, dd, ud imag, du imag, fill, fill
-  double cos_mtheta, sin_mtheta;
-  double cos_mphi, sin_mphi;
-  set_spin_weights(values[NUM_PARS+2], values[NUM_PARS+3], xs_weights);
-  SINCOS(values[NUM_PARS+4]*M_PI_180, sin_mtheta, cos_mtheta);
-  SINCOS(values[NUM_PARS+5]*M_PI_180, sin_mphi, cos_mphi);
+  // The polarization state (up_frac_i, up_frac_f, up_theta, up_phi) is
+  // analysed on the host by details.convert_spin_state, which appends
+  //     P[3], perpy[2], perpz[3], num_xs, xs[6], xs_weight[6]
+  // after the dispersity weights.  Only the cross sections with
+  // significant weight are listed, so a fully polarized measurement makes
+  // one kernel call per q rather than testing all six.
+  pglobal const double *spin = values + NUM_VALUES + 2*details->num_weights;
+  MagneticFrame frame;
+  for (int k = 0; k < 3; k++) {
+    frame.P[k] = spin[k];
+    frame.perpz[k] = spin[5+k];
+  }
+  frame.perpy[0] = spin[3];
+  frame.perpy[1] = spin[4];
+  frame.perpy[2] = 0.;
+  const int num_xs = (int)spin[8];
+  unsigned int xs_list[6];
+  double xs_weights[6];
+  for (int k = 0; k < 6; k++) {
+    xs_list[k] = (unsigned int)spin[9+k];
+    xs_weights[k] = spin[15+k];
+  }
+
+  // Magnetic moments and nuclear slds are not polydisperse, so fetch them
+  // once rather than for every q and cross section.
+  double moments[3*NUM_MAGNETIC];
+  double nuclear_slds[NUM_MAGNETIC];
+  for (int sk = 0; sk < NUM_MAGNETIC; sk++) {
+    for (int k = 0; k < 3; k++) {
+      moments[3*sk + k] = values[NUM_PARS + 6 + 3*sk + k];
+    }
+    nuclear_slds[sk] = values[slds[sk] + 2];
+  }
 #endif // MAGNETIC
 
   // ** Fill in the initial results **
@@ -389,39 +581,132 @@ void KERNEL_NAME(
   // The code differs slightly between opencl and dll since opencl is only
   // seeing one q value (stored in the variable "this_F2") while the dll
   // version must loop over all q.
+  //
+  // The monodisperse kernel is only called for the whole (one point) mesh,
+  // so it always starts fresh.
+  #if defined(KERNEL_MONO)
+    #define PD_FRESH 1
+  #elif defined(KERNEL_SPLIT)
+    #define PD_FRESH (launch_start == 0)
+  #else
+    #define PD_FRESH (pd_start == 0)
+  #endif
   #if defined(CALL_FQ)
-    double weight_norm = (pd_start == 0 ? 0.0 : result[2*nq]);
-    double weighted_form = (pd_start == 0 ? 0.0 : result[2*nq+1]);
-    double weighted_shell = (pd_start == 0 ? 0.0 : result[2*nq+2]);
-    double weighted_radius = (pd_start == 0 ? 0.0 : result[2*nq+3]);
+    double weight_norm = (PD_FRESH ? 0.0 : result[2*nq]);
+    double weighted_form = (PD_FRESH ? 0.0 : result[2*nq+1]);
+    double weighted_shell = (PD_FRESH ? 0.0 : result[2*nq+2]);
+    double weighted_radius = (PD_FRESH ? 0.0 : result[2*nq+3]);
+  #else
+    double weight_norm = (PD_FRESH ? 0.0 : result[nq]);
+    double weighted_form = (PD_FRESH ? 0.0 : result[nq+1]);
+    double weighted_shell = (PD_FRESH ? 0.0 : result[nq+2]);
+    double weighted_radius = (PD_FRESH ? 0.0 : result[nq+3]);
+  #endif
+  // The normalization sums are the same for every q, so only the first
+  // work item on the GPU, or the first slice of q for the OpenMP driver,
+  // calls the volume and effective radius functions at each mesh point.
+  #if defined(USE_GPU)
+    const int sum_weights = (q_index == 0);
+  #elif !defined(USE_OPENMP)
+    const int sum_weights = 1;
+  #endif
+  #if defined(USE_KAHAN_SUMMATION)
+    double weight_norm_err = 0.0, weighted_form_err = 0.0;
+    double weighted_shell_err = 0.0, weighted_radius_err = 0.0;
+  #endif
+  #if defined(USE_KERNEL_STATS)
+    // Counters for the instrumented build, stored after the normalization
+    // sums: mesh points visited, points rejected by VALID(), points with
+    // weight at or below the cutoff, kernel calls and form factor
+    // evaluations (one per q per magnetic cross section).
+    #if defined(CALL_FQ)
+      const int stats_offset = 2*nq + 4;
+    #else
+      const int stats_offset = nq + 4;
+    #endif
+    double stats_points = (PD_FRESH ? 0.0 : result[stats_offset+0]);
+    double stats_invalid = (PD_FRESH ? 0.0 : result[stats_offset+1]);
+    double stats_cutoff = (PD_FRESH ? 0.0 : result[stats_offset+2]);
+    double stats_calls = (PD_FRESH ? 0.0 : result[stats_offset+3]);
+    #if defined(USE_GPU)
+      double stats_evals = 0.0;  // for this q only
+    #else
+      double stats_evals = (PD_FRESH ? 0.0 : result[stats_offset+4]);
+    #endif
+    #define KERNEL_STATS_ADD(_counter) do { stats_##_counter += 1.0; } while (0)
   #else
-    double weight_norm = (pd_start == 0 ? 0.0 : result[nq]);
-    double weighted_form = (pd_start == 0 ? 0.0 : result[nq+1]);
-    double weighted_shell = (pd_start == 0 ? 0.0 : result[nq+2]);
-    double weighted_radius = (pd_start == 0 ? 0.0 : result[nq+3]);
+    #define KERNEL_STATS_ADD(_counter) do {} while (0)
   #endif
   #if defined(USE_GPU)
     #if defined(CALL_FQ)
-      double this_F2 = (pd_start == 0 ? 0.0 : result[2*q_index+0]);
-      double this_F1 = (pd_start == 0 ? 0.0 : result[2*q_index+1]);
+      double this_F2 = (PD_FRESH ? 0.0 : result[2*q_index+0]);
+      double this_F1 = (PD_FRESH ? 0.0 : result[2*q_index+1]);
     #else
-      double this_F2 = (pd_start == 0 ? 0.0 : result[q_index]);
+      double this_F2 = (PD_FRESH ? 0.0 : result[q_index]);
     #endif
+    #if defined(USE_KAHAN_SUMMATION)
+      double this_F2_err = 0.0, this_F1_err = 0.0;
+    #endif
+    #define ADD_RESULT(_sum, _k, _x) KAHAN_ADD(_sum, _sum ## _err, _x)
   #else // !USE_GPU
-    if (pd_start == 0) {
-      #ifdef USE_OPENMP
-      #pragma omp parallel for
-      #endif
-      #if defined(CALL_FQ)
-          // 2*nq for F^2,F pairs
-          for (int q_index=0; q_index < 2*nq; q_index++) result[q_index] = 0.0;
-      #else
-          for (int q_index=0; q_index < nq; q_index++) result[q_index] = 0.0;
-      #endif
+    #if defined(CALL_FQ)
+      const int result_len = 2*nq; // 2*nq for F^2,F pairs
+    #else
+      const int result_len = nq;
+    #endif
+    if (PD_FRESH) {
+      for (int q_index=0; q_index < result_len; q_index++) result[q_index] = 0.0;
     }
+    #if defined(USE_KAHAN_SUMMATION)
+      // Compensation for each result value.  If there is no memory for it
+      // then sum without compensation.
+      double *result_err = (result_len > 0
+          ? (double *)calloc((size_t)result_len, sizeof(double)) : NULL);
+      #define ADD_RESULT(_sum, _k, _x) do { \
+          if (result_err != NULL) KAHAN_ADD(result[_k], result_err[_k], _x); \
+          else result[_k] += (_x); \
+        } while (0)
+    #else
+      #define ADD_RESULT(_sum, _k, _x) do { result[_k] += (_x); } while (0)
+    #endif
     //if (q_index==0) printf("start %d %g %g\n", pd_start, pd_norm, result[0]);
 #endif // !USE_GPU
 
+  // Last F^2 for each q value in the error controlled flat mesh, used by
+  // adaptive_complete to decide whether to stop evaluating the q value.
+  // Weights beyond num_eval hold the mesh weight from each point to the
+  // end.  Without memory for the state, the dll evaluates every point.
+#if defined(ADAPTIVE_TOLERANCE) && defined(KERNEL_FLAT) && MAX_PD>0
+  #define ADAPTIVE_TAIL(_step) pd_weight[details->num_eval + (_step)]
+  #if defined(USE_GPU)
+    double adaptive_last = -1.0;
+    #define ADAPTIVE_ACTIVE(_k) \
+      (!adaptive_complete(this_F2, adaptive_last, ADAPTIVE_TAIL(step), \
+                          ADAPTIVE_TAIL(0)))
+    #define ADAPTIVE_UPDATE(_k, _F2) do { adaptive_last = fabs(_F2); } while (0)
+  #else
+    double *adaptive_last = (double *)malloc((size_t)nq*sizeof(double));
+    if (adaptive_last != NULL) {
+      for (int k=0; k < nq; k++) adaptive_last[k] = -1.0;
+    }
+    #if defined(CALL_FQ)
+      #define ADAPTIVE_SUM(_k) result[2*(_k)]
+    #else
+      #define ADAPTIVE_SUM(_k) result[_k]
+    #endif
+    #define ADAPTIVE_ACTIVE(_k) \
+      (adaptive_last == NULL \
+       || !adaptive_complete(ADAPTIVE_SUM(_k), adaptive_last[_k], \
+                             ADAPTIVE_TAIL(step), ADAPTIVE_TAIL(0)))
+    #define ADAPTIVE_UPDATE(_k, _F2) do { \
+        if (adaptive_last != NULL) adaptive_last[_k] = fabs(_F2); \
+      } while (0)
+  #endif
+#else
+  #define ADAPTIVE_ACTIVE(_k) 1
+  #define ADAPTIVE_UPDATE(_k, _F2) do {} while (0)
+#endif
+
 
 // ====== macros to set up the parts of the loop =======
 /*
@@ -436,17 +721,18 @@ level-specific looping variables, including these from loop level 3:
   double weight3 : the product of weights from levels 3 and up, computed
        as weight5*weight4*w3[i3].  Note that we need an outermost
        value weight5 set to 1.0 for this to work properly.
-After expansion, the loop struction will look like the following:
+After expansion, the loop struction will look like the following for
+MAX_PD=5:
   // --- PD_INIT(4) ---
   const int n4 = pd_length[4];
   const int p4 = pd_par[4];
   pglobal const double *v4 = pd_value + pd_offset[4];
   pglobal const double *w4 = pd_weight + pd_offset[4];
-  int i4 = (pd_start/pd_stride[4])%n4;  // position in level 4 at pd_start
+  int i4 = (int)((pd_start/pd_stride[4])%n4);  // position in level 4 at pd_start
   // --- PD_INIT(3) ---
   const int n3 = pd_length[3];
   ...
-  int i3 = (pd_start/pd_stride[3])%n3;  // position in level 3 at pd_start
+  int i3 = (int)((pd_start/pd_stride[3])%n3);  // position in level 3 at pd_start
   PD_INIT(2)
   PD_INIT(1)
   PD_INIT(0)
@@ -501,24 +787,25 @@ After expansion, the loop struction will look like the following:
   // Note that F1 and F2 are returned from CALL_FQ by reference, and the
   // user of the CALL_KERNEL macro below is assuming that F1 and F2 are defined.
   double qk;
-  double F1, F2;
+  model_real F1, F2;
   #define FETCH_Q() do { qk = q[q_index]; } while (0)
   #define BUILD_ROTATION() do {} while(0)
   #define APPLY_ROTATION() do {} while(0)
-  #define CALL_KERNEL() CALL_FQ(qk,F1,F2,local_values.table)
+  #define CALL_KERNEL(_table) CALL_FQ(qk,F1,F2,_table)
+  #define Q_LOOP SIMD_LOOP(private(qk,F1,F2))
 
 #elif defined(CALL_FQ_A)
   // unoriented 2D return <F> and <F^2>
   // Note that the CALL_FQ_A macro is computing _F1_slot and _F2_slot by
   // reference then returning _F2_slot.  We are calling them _F1_slot and
   // _F2_slot here so they don't conflict with _F1 and _F2 in the macro
-  // expansion, or with the use of F2 = CALL_KERNEL() when it is used below.
+  // expansion, or with the use of F2 = CALL_KERNEL(table) when it is used below.
   double qx, qy;
-  double _F1_slot, _F2_slot;
-  #define FETCH_Q() do { qx = q[2*q_index]; qy = q[2*q_index+1]; } while (0)
+  model_real _F1_slot, _F2_slot;
   #define BUILD_ROTATION() do {} while(0)
   #define APPLY_ROTATION() do {} while(0)
-  #define CALL_KERNEL() CALL_FQ_A(sqrt(qx*qx+qy*qy),_F1_slot,_F2_slot,local_values.table)
+  #define CALL_KERNEL(_table) CALL_FQ_A(sqrt(qx*qx+qy*qy),_F1_slot,_F2_slot,_table)
+  #define Q_LOOP SIMD_LOOP(private(qx,qy,_F1_slot,_F2_slot))
 
 #elif defined(CALL_IQ)
   // unoriented 1D return <F^2>
@@ -526,50 +813,77 @@ After expansion, the loop struction will look like the following:
   #define FETCH_Q() do { qk = q[q_index]; } while (0)
   #define BUILD_ROTATION() do {} while(0)
   #define APPLY_ROTATION() do {} while(0)
-  #define CALL_KERNEL() CALL_IQ(qk,local_values.table)
+  #define CALL_KERNEL(_table) CALL_IQ(qk,_table)
+  #define Q_LOOP SIMD_LOOP(private(qk))
 
 #elif defined(CALL_IQ_A)
   // unoriented 2D
   double qx, qy;
-  #define FETCH_Q() do { qx = q[2*q_index]; qy = q[2*q_index+1]; } while (0)
   #define BUILD_ROTATION() do {} while(0)
   #define APPLY_ROTATION() do {} while(0)
-  #define CALL_KERNEL() CALL_IQ_A(sqrt(qx*qx+qy*qy), local_values.table)
+  #define CALL_KERNEL(_table) CALL_IQ_A(sqrt(qx*qx+qy*qy), _table)
+  #define Q_LOOP SIMD_LOOP(private(qx,qy))
 
 #elif defined(CALL_IQ_AC)
   // oriented symmetric 2D
   double qx, qy;
-  #define FETCH_Q() do { qx = q[2*q_index]; qy = q[2*q_index+1]; } while (0)
   double qa, qc;
   QACRotation rotation;
-  // theta, phi, dtheta, dphi are defined below in projection to avoid repeated code.
-  #define BUILD_ROTATION() qac_rotation(&rotation, theta, phi, dtheta, dphi);
+  // theta, phi, dtheta, dphi and the view matrix are defined below in
+  // projection to avoid repeated code.
+  #define BUILD_ROTATION() qac_rotation(&rotation, &view, dtheta, dphi);
   #define APPLY_ROTATION() qac_apply(&rotation, qx, qy, &qa, &qc)
-  #define CALL_KERNEL() CALL_IQ_AC(qa, qc, local_values.table)
+  #define CALL_KERNEL(_table) CALL_IQ_AC(qa, qc, _table)
+  #define Q_LOOP SIMD_LOOP(private(qx,qy,qa,qc))
 
 #elif defined(CALL_IQ_ABC)
   // oriented asymmetric 2D
   double qx, qy;
-  #define FETCH_Q() do { qx = q[2*q_index]; qy = q[2*q_index+1]; } while (0)
   double qa, qb, qc;
   QABCRotation rotation;
   // theta, phi, dtheta, dphi are defined below in projection to avoid repeated code.
   // psi and dpsi are only for IQ_ABC, so they are processed here.
   const double psi = values[details->theta_par+4];
   local_values.table.psi = 0.;
-  #define BUILD_ROTATION() qabc_rotation(&rotation, theta, phi, psi, dtheta, dphi, local_values.table.psi)
+  #define BUILD_ROTATION() qabc_rotation(&rotation, &view, dtheta, dphi, local_values.table.psi)
   #define APPLY_ROTATION() qabc_apply(&rotation, qx, qy, &qa, &qb, &qc)
-  #define CALL_KERNEL() CALL_IQ_ABC(qa, qb, qc, local_values.table)
+  #define CALL_KERNEL(_table) CALL_IQ_ABC(qa, qb, qc, _table)
+  #define Q_LOOP SIMD_LOOP(private(qx,qy,qa,qb,qc))
 
 #elif defined(CALL_IQ_XY)
   // direct call to qx,qy calculator
   double qx, qy;
-  #define FETCH_Q() do { qx = q[2*q_index]; qy = q[2*q_index+1]; } while (0)
   #define BUILD_ROTATION() do {} while(0)
   #define APPLY_ROTATION() do {} while(0)
-  #define CALL_KERNEL() CALL_IQ_XY(qx, qy, local_values.table)
+  #define CALL_KERNEL(_table) CALL_IQ_XY(qx, qy, _table)
+  #define Q_LOOP SIMD_LOOP(private(qx,qy))
+#endif
+
+#if defined(USE_KERNEL_STATS)
+  // The counters are updated within the q loop, so don't vectorize it.
+  #undef Q_LOOP
+  #define Q_LOOP
 #endif
 
+#if defined(SETUP_SIZE) && !(defined(MAGNETIC) && NUM_MAGNETIC > 0)
+  // q independent values from the model setup function, filled once for
+  // each mesh point and read by every q in the inner loop.
+  model_real setup_scratch[SETUP_SIZE];
+  #define BUILD_SETUP(_table) CALL_SETUP(setup_scratch, _table)
+#else
+  #define BUILD_SETUP(_table) do {} while(0)
+#endif
+
+#if !defined(CALL_FQ) && !defined(CALL_IQ)
+  // 2D q is stored as separate qx and qy blocks.  The OpenMP driver passes
+  // the offset explicitly since its threads may work on a slice of q.
+  #if !defined(USE_OPENMP)
+    const int qy_offset = QY_OFFSET(nq);
+  #endif
+  #define FETCH_Q() do { qx = q[q_index]; qy = q[qy_offset+q_index]; } while (0)
+#endif
+
+
 // Define APPLY_PROJECTION depending on model symmetries. We do this outside
 // the previous if block so that we don't need to repeat the identical
 // logic in the IQ_AC and IQ_ABC branches.  This will become more important
@@ -611,6 +925,13 @@ After expansion, the loop struction will look like the following:
   // Grab the "view" angles (theta, phi, psi) from the initial parameter table.
   const double theta = values[details->theta_par+2];
   const double phi = values[details->theta_par+3];
+  #if defined(CALL_IQ_AC)
+    QACView view;
+    qac_view(&view, theta, phi);
+  #else
+    QABCView view;
+    qabc_view(&view, theta, phi, psi);
+  #endif
   // Make sure jitter angle defaults to zero if there is no jitter distribution
   local_values.table.theta = 0.;
   local_values.table.phi = 0.;
@@ -638,13 +959,49 @@ After expansion, the loop struction will look like the following:
 
 // ** define looping macros **
 
+#if defined(KERNEL_MONO)
+// With a single point in the mesh each "loop" sets its parameter value and
+// weight from the first entry of its dispersity vector and runs its body
+// once, so there is no loop state or restart position to track.
+#define PD_INIT(_LOOP) \
+  const int p##_LOOP = details->pd_par[_LOOP]; \
+  const double v##_LOOP = pd_value[details->pd_offset[_LOOP]]; \
+  const double w##_LOOP = pd_weight[details->pd_offset[_LOOP]];
+
+#define PD_OPEN(_LOOP,_OUTER) \
+  { \
+    local_values.vector[p##_LOOP] = v##_LOOP; \
+    const double weight##_LOOP = w##_LOOP * weight##_OUTER;
+
+#define PD_CLOSE(_LOOP) \
+  }
+
+#elif defined(KERNEL_FLAT)
+// The compacted mesh has a value vector for each of the num_active
+// dispersity parameters and one vector of product weights, all indexed by
+// step.  The outermost weight is the product weight, and the loop over
+// step is opened and closed around the nested blocks.
+#define PD_INIT(_LOOP) \
+  const int p##_LOOP = details->pd_par[_LOOP]; \
+  pdispersity const double *v##_LOOP = pd_value + details->pd_offset[_LOOP];
+
+#define PD_OPEN(_LOOP,_OUTER) \
+  { \
+    if (_LOOP < details->num_active) \
+      local_values.vector[p##_LOOP] = v##_LOOP[step]; \
+    const double weight##_LOOP = weight##_OUTER;
+
+#define PD_CLOSE(_LOOP) \
+  }
+
+#else // !KERNEL_MONO && !KERNEL_FLAT
 // Define looping variables
 #define PD_INIT(_LOOP) \
   const int n##_LOOP = details->pd_length[_LOOP]; \
   const int p##_LOOP = details->pd_par[_LOOP]; \
-  pglobal const double *v##_LOOP = pd_value + details->pd_offset[_LOOP]; \
-  pglobal const double *w##_LOOP = pd_weight + details->pd_offset[_LOOP]; \
-  int i##_LOOP = (pd_start/details->pd_stride[_LOOP])%n##_LOOP;
+  pdispersity const double *v##_LOOP = pd_value + details->pd_offset[_LOOP]; \
+  pdispersity const double *w##_LOOP = pd_weight + details->pd_offset[_LOOP]; \
+  int i##_LOOP = (int)((pd_start/details->pd_stride[_LOOP])%n##_LOOP);
 
 // Jump into the middle of the dispersity loop
 #define PD_OPEN(_LOOP,_OUTER) \
@@ -652,71 +1009,56 @@ After expansion, the loop struction will look like the following:
     local_values.vector[p##_LOOP] = v##_LOOP[i##_LOOP]; \
     const double weight##_LOOP = w##_LOOP[i##_LOOP] * weight##_OUTER;
 
-// create the variable "weight#=1.0" where # is the outermost level+1 (=MAX_PD).
-#define _PD_OUTERMOST_WEIGHT(_n) const double weight##_n = 1.0;
-#define PD_OUTERMOST_WEIGHT(_n) _PD_OUTERMOST_WEIGHT(_n)
-
 // Close out the loop
 #define PD_CLOSE(_LOOP) \
     if (step >= pd_stop) break; \
     ++i##_LOOP; \
   } \
   i##_LOOP = 0;
+#endif // !KERNEL_MONO && !KERNEL_FLAT
+
+// create the variable "weight#=1.0" where # is the outermost level+1 (=MAX_PD).
+#if defined(KERNEL_FLAT) && MAX_PD>0
+#define _PD_OUTERMOST_WEIGHT(_n) const double weight##_n = pd_weight[step];
+#else
+#define _PD_OUTERMOST_WEIGHT(_n) const double weight##_n = 1.0;
+#endif
+#define PD_OUTERMOST_WEIGHT(_n) _PD_OUTERMOST_WEIGHT(_n)
 
 // ====== construct the loops =======
 
 // Pointers to the start of the dispersity and weight vectors, if needed.
 #if MAX_PD>0
-  pglobal const double *pd_value = values + NUM_VALUES;
-  pglobal const double *pd_weight = pd_value + details->num_weights;
+  #if defined(KERNEL_LOCAL)
+  pdispersity const double *pd_value = pd_cache;
+  #else
+  pdispersity const double *pd_value = values + NUM_VALUES;
+  #endif
+  pdispersity const double *pd_weight = pd_value + details->num_weights;
 #endif
 
 // The variable "step" is the current position in the dispersity loop.
 // It will be incremented each time a new point in the mesh is accumulated,
 // and used to test whether we have reached pd_stop.
-int step = pd_start;
+int64_t step = pd_start;
 
-// *** define loops for each of 0, 1, 2, ..., modelinfo.MAX_PD-1 ***
+// *** define loops for each of 0, 1, 2, ..., MAX_PD-1 ***
 
 // define looping variables
-#if MAX_PD>4
-  PD_INIT(4)
-#endif
-#if MAX_PD>3
-  PD_INIT(3)
-#endif
-#if MAX_PD>2
-  PD_INIT(2)
-#endif
-#if MAX_PD>1
-  PD_INIT(1)
-#endif
-#if MAX_PD>0
-  PD_INIT(0)
-#endif
+PD_LOOP_INIT
 
 // open nested loops
-PD_OUTERMOST_WEIGHT(MAX_PD)
-#if MAX_PD>4
-  PD_OPEN(4,5)
-#endif
-#if MAX_PD>3
-  PD_OPEN(3,4)
-#endif
-#if MAX_PD>2
-  PD_OPEN(2,3)
-#endif
-#if MAX_PD>1
-  PD_OPEN(1,2)
-#endif
-#if MAX_PD>0
-  PD_OPEN(0,1)
+#if defined(KERNEL_FLAT)
+while (step < pd_stop) {
 #endif
+PD_OUTERMOST_WEIGHT(MAX_PD)
+PD_LOOP_OPEN
 
 //if (q_index==0) {printf("step:%d of %d, pars:",step,pd_stop); for (int i=0; i < NUM_PARS; i++) printf("p%d=%g ",i, local_values.vector[i]); printf("\n");}
 
   // ====== loop body =======
   // Note: recalc all intermediates for each loop, because we don't know order
+  KERNEL_STATS_ADD(points);
   TRANSLATION_VARS(local_values.table);
   if (VALID(local_values.table)) {
      APPLY_PROJECTION();
@@ -724,24 +1066,26 @@ PD_OUTERMOST_WEIGHT(MAX_PD)
     // Accumulate I(q)
     // Note: weight==0 must always be excluded
     if (weight > cutoff) {
-      double form, shell;
-      CALL_VOLUME(form, shell, local_values.table);
-      weight_norm += weight;
-      weighted_form += weight * form;
-      weighted_shell += weight * shell;
-      if (radius_effective_mode != 0) {
-        weighted_radius += weight * CALL_RADIUS_EFFECTIVE(radius_effective_mode, local_values.table);
+      if (sum_weights) {
+        double form, shell;
+        CALL_VOLUME(form, shell, local_values.table);
+        KAHAN_ADD(weight_norm, weight_norm_err, weight);
+        KAHAN_ADD(weighted_form, weighted_form_err, weight * form);
+        KAHAN_ADD(weighted_shell, weighted_shell_err, weight * shell);
+        if (radius_effective_mode != 0) {
+          KAHAN_ADD(weighted_radius, weighted_radius_err,
+            weight * CALL_RADIUS_EFFECTIVE(radius_effective_mode, local_values.table));
+        }
       }
       BUILD_ROTATION();
+      BUILD_SETUP(local_values.table);
 
 #if !defined(USE_GPU)
       // DLL needs to explicitly loop over the q values.
-      #ifdef USE_OPENMP
-      #pragma omp parallel for
-      #endif
+      Q_LOOP
       for (q_index=0; q_index<nq; q_index++)
 #endif // !USE_GPU
-      {
+      if (ADAPTIVE_ACTIVE(q_index)) {
 
         FETCH_Q();
         APPLY_ROTATION();
@@ -754,75 +1098,81 @@ PD_OUTERMOST_WEIGHT(MAX_PD)
           if (qsq > 1.e-16) {
             // TODO: what is the magnetic scattering at q = 0
 
-
-            // loop over uu, ud real, du real, dd, ud imag, du imag
-            for (unsigned int xs = 0; xs < 6; xs++) {
-              const double xs_weight = xs_weights[xs];
-              if (xs_weight > 1.e-8) {
-                // Since the cross section weight is significant, set the slds
-                // to the effective slds for this cross section, call the
-                // kernel, and add according to weight.
-                for (int sk = 0; sk<NUM_MAGNETIC; sk++) {
-                  const int32_t mag_index = NUM_PARS + 6 + 3 * sk;
-                  const int32_t sld_index = slds[sk];
-                  const double mx = values[mag_index];
-                  const double my = values[mag_index + 1];
-                  const double mz = values[mag_index + 2];
-                  local_values.vector[sld_index] =
-                    mag_sld(xs, qx, qy, cos_mtheta, sin_mtheta, cos_mphi, sin_mphi, values[sld_index + 2], mx, my, mz);
-//if (q_index==0) printf("%d: (qx,qy)=(%g,%g) xs=%d sld%d=%g p=(%g,%g) m=(%g,%g,%g)\n",
-//  q_index, qx, qy, xs, sk, local_values.vector[sld_index], px, py, mx, my, mz);
-                }
-                F2 += xs_weight * CALL_KERNEL();
+            // Per q state lives in this block so that q values can be
+            // evaluated independently: the projections of each magnetic
+            // moment, and a copy of the parameters with the effective slds.
+            const double qnorm = sqrt(qsq);
+            const double qhat_x = qx / qnorm;
+            const double qhat_y = qy / qnorm;
+            double proj[3*NUM_MAGNETIC];
+            for (int sk = 0; sk<NUM_MAGNETIC; sk++) {
+              mag_projection(&frame, qhat_x, qhat_y, moments[3*sk],
+                  moments[3*sk+1], moments[3*sk+2], proj + 3*sk);
+            }
+            ParameterBlock xs_values = local_values;
+
+            // loop over the cross sections with significant weight, setting
+            // the slds to the effective slds for this cross section, calling
+            // the kernel, and adding according to weight.
+            for (int k = 0; k < num_xs; k++) {
+              const unsigned int xs = xs_list[k];
+              for (int sk = 0; sk<NUM_MAGNETIC; sk++) {
+                xs_values.vector[slds[sk]] =
+                  mag_sld(xs, nuclear_slds[sk], proj + 3*sk);
+//if (q_index==0) printf("%d: (qx,qy)=(%g,%g) xs=%d sld%d=%g\n",
+//  q_index, qx, qy, xs, sk, xs_values.vector[slds[sk]]);
               }
+              #if defined(SETUP_SIZE)
+                // The slds depend on the cross section, so the setup has
+                // to be redone for each one.
+                model_real setup_scratch[SETUP_SIZE];
+                CALL_SETUP(setup_scratch, xs_values.table);
+              #endif
+              F2 += xs_weights[k] * CALL_KERNEL(xs_values.table);
+              KERNEL_STATS_ADD(evals);
             }
           }
         #else  // !MAGNETIC
           #if defined(CALL_FQ)
-            CALL_KERNEL(); // sets F1 and F2 by reference
+            CALL_KERNEL(local_values.table); // sets F1 and F2 by reference
           #else
-            const double F2 = CALL_KERNEL();
+            const double F2 = CALL_KERNEL(local_values.table);
           #endif
+          KERNEL_STATS_ADD(evals);
         #endif // !MAGNETIC
 //printf("q_index:%d %g %g %g %g\n", q_index, F2, weight0);
 
-        #if defined(USE_GPU)
-          #if defined(CALL_FQ)
-            this_F2 += weight * F2;
-            this_F1 += weight * F1;
-          #else
-            this_F2 += weight * F2;
-          #endif
-        #else // !USE_OPENCL
-          #if defined(CALL_FQ)
-            result[2*q_index+0] += weight * F2;
-            result[2*q_index+1] += weight * F1;
-          #else
-            result[q_index] += weight * F2;
-          #endif
-        #endif // !USE_OPENCL
+        // The gpu sums into this_F2 and this_F1 while the dll sums
+        // directly into the result vector.
+        #if defined(CALL_FQ)
+          ADD_RESULT(this_F2, 2*q_index+0, weight * F2);
+          ADD_RESULT(this_F1, 2*q_index+1, weight * F1);
+        #else
+          ADD_RESULT(this_F2, q_index, weight * F2);
+        #endif
+        ADAPTIVE_UPDATE(q_index, F2);
       }
+    } else {
+      KERNEL_STATS_ADD(cutoff);
     }
+  } else {
+    KERNEL_STATS_ADD(invalid);
   }
 // close nested loops
 ++step;
-#if MAX_PD>0
-  PD_CLOSE(0)
-#endif
-#if MAX_PD>1
-  PD_CLOSE(1)
-#endif
-#if MAX_PD>2
-  PD_CLOSE(2)
-#endif
-#if MAX_PD>3
-  PD_CLOSE(3)
-#endif
-#if MAX_PD>4
-  PD_CLOSE(4)
+PD_LOOP_CLOSE
+#if defined(KERNEL_FLAT)
+}
 #endif
 
 // Remember the results and the updated norm.
+#if defined(USE_KAHAN_SUMMATION) && !defined(USE_GPU)
+  free(result_err);
+#endif
+#if defined(ADAPTIVE_TOLERANCE) && defined(KERNEL_FLAT) && MAX_PD>0 \
+    && !defined(USE_GPU)
+  free(adaptive_last);
+#endif
 #if defined(USE_GPU)
   #if defined(CALL_FQ)
   result[2*q_index+0] = this_F2;
@@ -843,16 +1193,203 @@ PD_OUTERMOST_WEIGHT(MAX_PD)
     result[nq+1] = weighted_form;
     result[nq+2] = weighted_shell;
     result[nq+3] = weighted_radius;
+#endif
+#if defined(USE_KERNEL_STATS)
+    result[stats_offset+0] = stats_points;
+    result[stats_offset+1] = stats_invalid;
+    result[stats_offset+2] = stats_cutoff;
+  #if defined(KERNEL_SPLIT)
+    // Count each launch once rather than once for each part.
+    result[stats_offset+3] = stats_calls + (part_index == 0 ? 1.0 : 0.0);
+  #else
+    result[stats_offset+3] = stats_calls + 1.0;
+  #endif
+  #if defined(USE_GPU)
+    // Each work item evaluates a single q, so scale the count from the
+    // first one to the full q vector.
+    result[stats_offset+4] = (PD_FRESH ? 0.0 : result[stats_offset+4])
+        + nq*stats_evals;
+  #else
+    result[stats_offset+4] = stats_evals;
+  #endif
 #endif
   }
 
 // ** clear the macros in preparation for the next kernel **
+#undef pdetails
+#undef pdispersity
+#undef PD_FRESH
 #undef PD_INIT
 #undef PD_OPEN
 #undef PD_CLOSE
+#undef _PD_OUTERMOST_WEIGHT
+#undef PD_OUTERMOST_WEIGHT
 #undef FETCH_Q
 #undef APPLY_PROJECTION
 #undef BUILD_ROTATION
+#undef BUILD_SETUP
 #undef APPLY_ROTATION
 #undef CALL_KERNEL
+#undef Q_LOOP
+#undef ADD_RESULT
+#undef KERNEL_STATS_ADD
+#undef ADAPTIVE_TAIL
+#undef ADAPTIVE_SUM
+#undef ADAPTIVE_ACTIVE
+#undef ADAPTIVE_UPDATE
+}
+
+#if defined(USE_OPENMP)
+// Number of parts of the work for each thread.  The parts are handed out
+// as the threads become free, so a thread which finishes early, such as
+// one whose mesh points were mostly skipped by the cutoff or by VALID(),
+// takes more of them.
+#ifndef OPENMP_PARTS_PER_THREAD
+#  define OPENMP_PARTS_PER_THREAD 4
+#endif
+// Limit on the number of doubles in the private copies of the result.
+#ifndef OPENMP_PART_MEMORY
+#  define OPENMP_PART_MEMORY (1<<21)
+#endif
+
+// Thread-parallel driver for the serial kernel above.  Unlike the other
+// kernels, this takes the number of threads as an additional argument,
+// with 0 meaning use omp_get_max_threads().  If there are enough
+// mesh points for every thread then the parts are contiguous slices
+// of pd_start..pd_stop for all q, otherwise they are contiguous slices
+// of q for the whole mesh.  Each part accumulates into its own copy of
+// the result vector (including weight_norm, weighted_form, etc.), which
+// is allocated and cleared by the thread that evaluates it so that the
+// memory is local to that thread on NUMA machines.  The copies are summed
+// in part order after the parallel loop so that the result does not
+// depend on the thread schedule.
+kernel
+void KERNEL_NAME(
+    int32_t nq,                   // number of q values
+    const int64_t pd_start,       // where we are in the dispersity loop
+    const int64_t pd_stop,        // where we are stopping in the dispersity loop
+    pglobal const ProblemDetails *details,
+    pglobal const double *values, // parameter values and distributions
+    pglobal const double *q,      // nq q values, with padding to boundary
+    pglobal double *result,       // nq+1 return values, again with padding
+    const double cutoff,          // cutoff in the dispersity weight product
+    int32_t radius_effective_mode, // which effective radius to compute
+    int32_t thread_limit          // number of threads to use, or 0 for all
+    )
+{
+  #if defined(CALL_FQ) || defined(CALL_IQ)
+    const int qy_offset = 0;               // 1D: q only
+  #else
+    const int qy_offset = QY_OFFSET(nq);   // 2D: qx block then qy block
+  #endif
+  #if defined(CALL_FQ)
+    const int nout = 2;  // F^2, F pairs
+  #else
+    const int nout = 1;
+  #endif
+  #if defined(USE_KERNEL_STATS)
+    const int num_extra = 4 + NUM_KERNEL_STATS;  // sums and counters
+  #else
+    const int num_extra = 4;  // weight_norm, weighted_form, etc.
+  #endif
+  const int num_threads = (thread_limit > 0 ? thread_limit : omp_get_max_threads());
+  const int64_t num_points = pd_stop - pd_start;
+
+  // Splitting the mesh needs a full copy of the result for each part, so
+  // only do so when q is short enough that the copies are cheap, and use
+  // fewer parts if the copies would need too much memory.
+  const int split_mesh = (num_points >= num_threads && nq < 256*num_threads);
+  int num_parts = num_threads*OPENMP_PARTS_PER_THREAD;
+  if (split_mesh) {
+    const int max_parts = OPENMP_PART_MEMORY/(nout*nq + num_extra);
+    if (num_parts > max_parts) num_parts = max_parts;
+    if (num_parts < num_threads) num_parts = num_threads;
+    if (num_parts > num_points) num_parts = (int)num_points;
+  } else {
+    if (num_parts > nq) num_parts = nq;
+  }
+  const int part_nq = (split_mesh ? nq : (nq + num_parts - 1)/num_parts);
+  const int part_size = nout*part_nq + num_extra;
+  double **partial = (num_parts > 1
+      ? (double **)calloc((size_t)num_parts, sizeof(double *))
+      : NULL);
+  if (partial == NULL) {
+    // Single thread, or out of memory, so do the whole calculation in place.
+    KERNEL_PART(KERNEL_NAME)(nq, pd_start, pd_stop, details, values, q,
+        result, cutoff, radius_effective_mode, qy_offset, 1);
+    return;
+  }
+
+  int failed = 0;
+  #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+  for (int k=0; k < num_parts; k++) {
+    double *part = (double *)malloc((size_t)part_size*sizeof(double));
+    partial[k] = part;
+    if (part == NULL) {
+      #pragma omp critical
+      failed = 1;
+      continue;
+    }
+    for (int i=0; i < part_size; i++) part[i] = 0.0;
+    if (split_mesh) {
+      const int64_t start = pd_start + (k*num_points)/num_parts;
+      const int64_t stop = pd_start + ((k+1)*num_points)/num_parts;
+      KERNEL_PART(KERNEL_NAME)(nq, start, stop, details, values, q,
+          part, cutoff, radius_effective_mode, qy_offset, 1);
+    } else {
+      const int q_lo = k*part_nq;
+      const int q_hi = (q_lo + part_nq < nq ? q_lo + part_nq : nq);
+      if (q_lo < q_hi) {
+        // Every slice sees the whole mesh, so only the first needs the
+        // normalization sums.
+        KERNEL_PART(KERNEL_NAME)(q_hi - q_lo, pd_start, pd_stop, details,
+            values, q + q_lo, part, cutoff, radius_effective_mode,
+            qy_offset, k == 0);
+      }
+    }
+  }
+  if (failed) {
+    // Out of memory for some of the parts, so redo the calculation in
+    // place, which is safe since the result has not yet been touched.
+    for (int k=0; k < num_parts; k++) free(partial[k]);
+    free(partial);
+    KERNEL_PART(KERNEL_NAME)(nq, pd_start, pd_stop, details, values, q,
+        result, cutoff, radius_effective_mode, qy_offset, 1);
+    return;
+  }
+
+  // Combine the partial sums with the running totals from earlier calls.
+  if (pd_start == 0) {
+    for (int i=0; i < nout*nq + num_extra; i++) result[i] = 0.0;
+  }
+  if (split_mesh) {
+    for (int k=0; k < num_parts; k++) {
+      const double *part = partial[k];
+      for (int i=0; i < nout*nq + num_extra; i++) result[i] += part[i];
+    }
+    #if defined(USE_KERNEL_STATS)
+      // Count one kernel call rather than one per part.
+      result[nout*nq + 4 + 3] -= num_parts - 1;
+    #endif
+  } else {
+    for (int k=0; k < num_parts; k++) {
+      const double *part = partial[k];
+      const int q_lo = k*part_nq;
+      const int q_hi = (q_lo + part_nq < nq ? q_lo + part_nq : nq);
+      for (int i=0; i < nout*(q_hi - q_lo); i++) result[nout*q_lo + i] += part[i];
+      #if defined(USE_KERNEL_STATS)
+        // Evaluations are counted per q, after the sums for this slice.
+        if (q_lo < q_hi) result[nout*nq + 4 + 4] += part[nout*(q_hi - q_lo) + 4 + 4];
+      #endif
+    }
+    // The weights are only summed by the first slice.
+    for (int i=0; i < 4; i++) result[nout*nq + i] += partial[0][nout*part_nq + i];
+    #if defined(USE_KERNEL_STATS)
+      // Similarly for the mesh counters.
+      for (int i=0; i < 4; i++) result[nout*nq + 4 + i] += partial[0][nout*part_nq + 4 + i];
+    #endif
+  }
+  for (int k=0; k < num_parts; k++) free(partial[k]);
+  free(partial);
 }
+#endif // USE_OPENMP
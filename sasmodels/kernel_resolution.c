@@ -0,0 +1,79 @@
+/*
+    Resolution smearing of the kernel result.
+
+    The resolution weights W from sasmodels.resolution have one column for
+    each measured point and one row for each calculated point, so that the
+    smeared intensity is W^T I(q_calc).  The kernel receives W^T in
+    compressed sparse row format, with the weights for measured point i
+    stored in weights[indptr[i]:indptr[i+1]] and the corresponding
+    calculated points in indices[indptr[i]:indptr[i+1]].
+
+    *theory* is the unnormalized result vector from the kernel in
+    kernel_iq.c for nq points with nout values per point, the first being
+    the sum of F^2, followed by the four normalization sums.  The smeared
+    sums are written to result[0:nrows] and the normalization sums are
+    copied to result[nrows:nrows+4], so the result has the same layout as
+    a kernel result for the measured points.
+
+    Since the weights are applied before normalization, the caller is
+    responsible for dividing by the total weight and the volume as usual.
+*/
+
+#if defined(USE_GPU)
+kernel
+void resolution_smear(
+    const int32_t nrows,             // number of measured points
+    const int32_t nq,                // number of calculated points
+    const int32_t nout,              // number of values per calculated point
+    pglobal const int32_t *indptr,   // start of each row in indices/weights
+    pglobal const int32_t *indices,  // calculated point for each weight
+    pglobal const double *weights,   // resolution weights
+    pglobal const double *theory,    // kernel result for calculated points
+    pglobal double *result)          // smeared result for measured points
+{
+  #if defined(USE_OPENCL)
+  const int row = get_global_id(0);
+  #else
+  const int row = threadIdx.x + blockIdx.x * blockDim.x;
+  #endif
+  if (row < nrows) {
+    double sum = 0.0;
+    for (int k = indptr[row]; k < indptr[row+1]; k++) {
+      sum += weights[k]*theory[nout*indices[k]];
+    }
+    result[row] = sum;
+  }
+  if (row < 4) {
+    result[nrows + row] = theory[nout*nq + row];
+  }
+}
+
+#else // !USE_GPU
+
+kernel
+void resolution_smear(
+    const int32_t nrows,             // number of measured points
+    const int32_t nq,                // number of calculated points
+    const int32_t nout,              // number of values per calculated point
+    const int32_t *indptr,           // start of each row in indices/weights
+    const int32_t *indices,          // calculated point for each weight
+    const double *weights,           // resolution weights
+    const double *theory,            // kernel result for calculated points
+    double *result)                  // smeared result for measured points
+{
+  #if defined(USE_OPENMP)
+  #pragma omp parallel for
+  #endif
+  for (int row = 0; row < nrows; row++) {
+    double sum = 0.0;
+    for (int k = indptr[row]; k < indptr[row+1]; k++) {
+      sum += weights[k]*theory[nout*indices[k]];
+    }
+    result[row] = sum;
+  }
+  for (int k = 0; k < 4; k++) {
+    result[nrows + k] = theory[nout*nq + k];
+  }
+}
+
+#endif // !USE_GPU
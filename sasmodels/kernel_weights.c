@@ -0,0 +1,53 @@
+/*
+    Dispersity weights evaluated in C, for distributions which are rebuilt
+    for every change of width during a fit.  These are compiled into their
+    own dll by kerneldll.load_weights_dll and called from sasmodels.weights
+    in place of the numpy expressions, which they match term for term.
+
+    The points are center + linspace(-nsigmas*sigma, nsigmas*sigma, n),
+    keeping only those in [lb, ub].  The kept points and their unnormalized
+    weights are written to x[] and w[], which must have room for n values,
+    and the number kept is returned.
+*/
+
+// As numpy.linspace, which sets the last point to the endpoint exactly.
+static double
+_weights_point(int32_t k, int32_t n, double center, double sigma,
+    double nsigmas)
+{
+  const double start = -nsigmas*sigma, stop = nsigmas*sigma;
+  const double offset = (k == n-1 ? stop : k*((stop - start)/(n-1)) + start);
+  return center + offset;
+}
+
+// Schulz distribution with z = (center/sigma)^2, evaluated in log space as
+//     w = exp(z ln z + (z-1) ln R - R z - ln c - ln Gamma(z))
+// with R = x/center.  The terms which do not depend on x, including the
+// single call to sas_gammaln, are computed once for the whole vector.
+kernel int32_t
+schulz_weights(
+    const int32_t n,          // number of points before the range check
+    const double center,      // center of the distribution
+    const double sigma,       // 1-sigma width of the distribution
+    const double nsigmas,     // number of sigmas spanned by the points
+    const double lb,          // lower bound on the points
+    const double ub,          // upper bound on the points
+    double *x,                // kept points
+    double *w)                // weights for the kept points
+{
+  const double z = square(center/sigma);
+  const double z_log_z = z*log(z);
+  const double log_c = log(center);
+  const double log_gamma_z = sas_gammaln(z);
+  int32_t count = 0;
+  for (int32_t k = 0; k < n; k++) {
+    const double xk = _weights_point(k, n, center, sigma, nsigmas);
+    if (xk >= lb && xk <= ub) {
+      const double R = xk/center;
+      x[count] = xk;
+      w[count] = exp(z_log_z + (z-1.0)*log(R) - R*z - log_c - log_gamma_z);
+      count++;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,149 @@
+"""
+Disk cache for compiled GPU programs
+====================================
+
+The OpenCL and CUDA drivers keep compiled programs for the life of the
+process, so each new process has to rebuild every model it uses.  This
+module stores the program binaries on disk so that they can be reloaded
+in later sessions.
+
+Binaries are stored in *SAS_KERNEL_CACHE*, which defaults to
+*~/.sasmodels/compiled_kernels*.  Set *SAS_KERNEL_CACHE=none* to disable
+the cache.  The file name includes a hash of the converted source, the
+build options and the identity of the device and driver, so any change
+to these will lead to a new file.  Files older than the model timestamp
+from :func:`.generate.ocl_timestamp` are ignored and rebuilt, which
+catches changes to included files that do not show up in the source.
+
+The same directory holds the dense Hankel matrices built by
+:class:`.sesans.SesansTransform` and the slit resolution weights built by
+:func:`.resolution.slit_resolution`, which are keyed by their inputs.
+
+The cache is only an accelerator.  Any failure to read or write it is
+logged and the program is compiled from source as usual.
+"""
+from __future__ import print_function
+
+import os
+from os.path import join as joinpath, exists, getmtime
+import hashlib
+import logging
+import struct
+import tempfile
+
+# pylint: disable=unused-import
+try:
+    from typing import List, Optional, Sequence
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+if "SAS_KERNEL_CACHE" in os.environ:
+    SAS_KERNEL_CACHE = os.environ["SAS_KERNEL_CACHE"]
+else:
+    SAS_KERNEL_CACHE = joinpath(
+        os.path.expanduser("~"), ".sasmodels", "compiled_kernels")
+
+#: Marker at the start of each cache file, updated if the format changes.
+_MAGIC = b"SASBIN01"
+
+
+def cache_path(name, key):
+    # type: (str, Sequence[str]) -> Optional[str]
+    """
+    Return the cache file for the program *name* whose binary depends on
+    the strings in *key*, or None if the cache is disabled.
+
+    *key* should contain everything that affects the binary, such as the
+    source, the precision, the compiler options and the device and driver
+    identity.
+    """
+    if not SAS_KERNEL_CACHE or SAS_KERNEL_CACHE.lower() == "none":
+        return None
+    digest = hashlib.sha1()
+    for part in key:
+        digest.update(part.encode('utf8'))
+        digest.update(b"\0")
+    return joinpath(SAS_KERNEL_CACHE, "%s-%s.bin"%(name, digest.hexdigest()))
+
+
+def load_binaries(path, timestamp):
+    # type: (Optional[str], float) -> Optional[List[bytes]]
+    """
+    Return the binaries stored in *path*, or None if there are none or if
+    the file is older than *timestamp*.
+    """
+    if path is None or not exists(path) or getmtime(path) < timestamp:
+        return None
+    try:
+        with open(path, 'rb') as fid:
+            data = fid.read()
+        if not data.startswith(_MAGIC):
+            raise ValueError("not a program cache file")
+        offset = len(_MAGIC)
+        count, = struct.unpack_from("<I", data, offset)
+        offset += 4
+        binaries = []
+        for _ in range(count):
+            size, = struct.unpack_from("<Q", data, offset)
+            offset += 8
+            if offset + size > len(data):
+                raise ValueError("truncated program cache file")
+            binaries.append(data[offset:offset+size])
+            offset += size
+        return binaries
+    except Exception as exc:
+        logging.warning("ignoring program cache %s: %s", path, exc)
+        return None
+
+
+def save_binaries(path, binaries):
+    # type: (Optional[str], Sequence[bytes]) -> None
+    """
+    Store *binaries* in *path*.
+
+    The file is written to a temporary name and renamed into place so that
+    concurrent processes never see a partial file.
+    """
+    if path is None or not binaries or not all(binaries):
+        return
+    parts = [_MAGIC, struct.pack("<I", len(binaries))]
+    for binary in binaries:
+        parts.extend((struct.pack("<Q", len(binary)), bytes(binary)))
+    try:
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        fd, tmp = tempfile.mkstemp(dir=os.path.dirname(path), suffix=".tmp")
+        try:
+            with os.fdopen(fd, 'wb') as fid:
+                fid.write(b"".join(parts))
+            os.replace(tmp, path)
+        except Exception:
+            os.unlink(tmp)
+            raise
+    except Exception as exc:
+        logging.warning("could not save program cache %s: %s", path, exc)
+
+
+def test_cache():
+    # type: () -> None
+    """Check that binaries round trip and that stale entries are ignored"""
+    global SAS_KERNEL_CACHE
+    import shutil
+    saved, cache_dir = SAS_KERNEL_CACHE, tempfile.mkdtemp()
+    SAS_KERNEL_CACHE = cache_dir
+    try:
+        path = cache_path("sphere", ["source", "float32", "device"])
+        assert path != cache_path("sphere", ["source", "float64", "device"])
+        assert load_binaries(path, 0) is None
+        binaries = [b"\0\1binary", b"second device"]
+        save_binaries(path, binaries)
+        assert load_binaries(path, 0) == binaries
+        assert load_binaries(path, getmtime(path) + 1) is None
+        with open(path, 'wb') as fid:
+            fid.write(_MAGIC + b"garbage")
+        assert load_binaries(path, 0) is None
+        SAS_KERNEL_CACHE = "none"
+        assert cache_path("sphere", ["source"]) is None
+    finally:
+        SAS_KERNEL_CACHE = saved
+        shutil.rmtree(cache_dir, ignore_errors=True)
@@ -41,9 +41,13 @@ can select.  It will then tell you that you can use these drivers
 automatically by setting the SAS_OPENCL environment variable, which is
 PYOPENCL_CTX equivalent but not conflicting with other pyopnecl programs.
 
-Some graphics cards have multiple devices on the same card.  You cannot
-yet use both of them concurrently to evaluate models, but you can run
-the program twice using a different device for each session.
+Some graphics cards have multiple devices on the same card, and some
+workstations have several cards.  Set SAS_OPENCL_POOL=1 to share each
+calculation amongst all devices of the same type on the selected platform.
+The dispersity mesh is split between the devices in proportion to their
+measured throughput and the partial sums are combined on the host.
+Without it, you can still run the program twice using a different device
+for each session.
 
 OpenCL kernels are compiled when needed by the device driver.  Some
 drivers produce compiler output even when there is no error.  You
@@ -86,13 +90,22 @@ except Exception as exc:
     HAVE_OPENCL = False
     OPENCL_ERROR = str(exc)
 
+#: Exceptions raised when the model source fails to compile.
+COMPILE_ERRORS = ((RuntimeError, cl.RuntimeError) if HAVE_OPENCL
+                  else (RuntimeError,))
+
 from . import generate
+from . import gputune
+from . import kernelcache
+from . import kerneltile
+from . import profiling
 from .generate import F32, F64
 from .kernel import KernelModel, Kernel
+from .details import stack_batch_args, split_mesh
 
 # pylint: disable=unused-import
 try:
-    from typing import Tuple, Callable, Any, List, Dict
+    from typing import Tuple, Callable, Any, List, Dict, Optional
     from .modelinfo import ModelInfo
     from .details import CallDetails
 except ImportError:
@@ -196,10 +209,20 @@ def has_type(device, dtype):
     elif dtype == F64:
         return "cl_khr_fp64" in device.extensions
     else:
-        # Not supporting F16 type since it isn't accurate enough.
+        # Not supporting F16 type since it isn't accurate enough.  Half
+        # precision model code with single precision sums is available
+        # for screening on devices where has_half is true.
         return False
 
 
+def has_half(device):
+    # type: (cl.Device) -> bool
+    """
+    Return true if device can evaluate half precision model code.
+    """
+    return "cl_khr_fp16" in device.extensions
+
+
 def get_warp(kernel, queue):
     # type: (cl.Kernel, cl.CommandQueue) -> int
     """
@@ -210,13 +233,17 @@ def get_warp(kernel, queue):
         queue.device)
 
 
-def compile_model(context, source, dtype, fast=False):
-    # type: (cl.Context, str, np.dtype, bool) -> cl.Program
+def compile_model(context, source, dtype, fast=False, name=None, timestamp=0.):
+    # type: (cl.Context, str, np.dtype, bool, str, float) -> cl.Program
     """
     Build a model to run on the gpu.
 
     Returns the compiled program and its type.
 
+    If *name* is given, the program binary is saved in the disk cache
+    from :mod:`.kernelcache` and reloaded on the next build, unless the
+    cached copy is older than *timestamp*.
+
     Raises an error if the desired precision is not available.
     """
     dtype = np.dtype(dtype)
@@ -236,13 +263,36 @@ def compile_model(context, source, dtype, fast=False):
     options = (get_fast_inaccurate_build_options(context.devices[0])
                if fast else [])
     source = "\n".join(source_list)
+    path = (kernelcache.cache_path(name, [source, " ".join(options)]
+                                   + [_device_identity(d)
+                                      for d in context.devices])
+            if name is not None else None)
+    binaries = kernelcache.load_binaries(path, timestamp)
+    if binaries is not None and len(binaries) == len(context.devices):
+        try:
+            program = cl.Program(context, context.devices, binaries)
+            return program.build(options=options)
+        except Exception as exc:
+            logging.warning("ignoring cached binary for %s: %s", name, exc)
     program = cl.Program(context, source).build(options=options)
+    kernelcache.save_binaries(
+        path, program.get_info(cl.program_info.BINARIES))
 
     #print("done with "+program)
     return program
 
 
-# For now, this returns one device in the context.
+def _device_identity(device):
+    # type: (cl.Device) -> str
+    """
+    Return a string identifying the device and driver for the program cache.
+    """
+    return "|".join((device.platform.name, device.platform.version,
+                     device.name, device.version, device.driver_version))
+
+
+# For now, this returns one device in the context unless SAS_OPENCL_POOL
+# is set, in which case the context holds all similar devices on the platform.
 # TODO: Create a context that contains all devices on all platforms.
 class GpuEnvironment(object):
     """
@@ -264,17 +314,31 @@ class GpuEnvironment(object):
             else:
                 self.context[dtype] = None
 
-        # Build a queue for each context.
+        # Extend the contexts to all matching devices if pooling.
+        if os.environ.get('SAS_OPENCL_POOL', '0') not in ('', '0'):
+            pooled = {}
+            for dtype in (F32, F64):
+                context = self.context[dtype]
+                if context is not None:
+                    if context not in pooled:
+                        pooled[context] = _pool_context(context, dtype)
+                    self.context[dtype] = pooled[context]
+
+        # Build a queue for each device in each context.  The first queue
+        # is used for everything except splitting a calculation across
+        # the device pool.
         self.queue = {}
+        self.pool = {}
         context = self.context[F32]
-        self.queue[F32] = cl.CommandQueue(context, context.devices[0])
+        self.pool[F32] = _make_queues(context)
         if self.context[F64] == self.context[F32]:
-            self.queue[F64] = self.queue[F32]
+            self.pool[F64] = self.pool[F32]
         elif self.context[F64] is not None:
-            context = self.context[F64]
-            self.queue[F64] = cl.CommandQueue(context, context.devices[0])
+            self.pool[F64] = _make_queues(self.context[F64])
         else:
-            self.queue[F64] = None
+            self.pool[F64] = []
+        for dtype in (F32, F64):
+            self.queue[dtype] = self.pool[dtype][0] if self.pool[dtype] else None
 
         ## Byte boundary for data alignment.
         #self.data_boundary = max(context.devices[0].min_data_type_align_size
@@ -290,6 +354,16 @@ class GpuEnvironment(object):
         """
         return self.context.get(dtype, None) is not None
 
+    def has_half(self):
+        # type: () -> bool
+        """
+        Return True if all devices in the single precision context can
+        evaluate half precision model code.
+        """
+        context = self.context.get(F32, None)
+        return (context is not None
+                and all(has_half(d) for d in context.devices))
+
     def compile_program(self, name, source, dtype, fast, timestamp):
         # type: (str, str, np.dtype, bool, float) -> cl.Program
         """
@@ -308,11 +382,48 @@ class GpuEnvironment(object):
             logging.info("building %s for OpenCL %s", key,
                          context.devices[0].name.strip())
             program = compile_model(self.context[dtype],
-                                    str(source), dtype, fast)
+                                    str(source), dtype, fast,
+                                    name=key, timestamp=timestamp)
             self.compiled[key] = (program, timestamp)
         return program
 
 
+def _pool_context(context, dtype):
+    # type: (cl.Context, np.dtype) -> cl.Context
+    """
+    Return a context containing all devices on the same platform as
+    *context* which have the same type and support *dtype*.
+
+    Returns the original context if there are no other such devices.
+    """
+    device = context.devices[0]
+    devices = [d for d in device.platform.get_devices(device_type=device.type)
+               if has_type(d, dtype)]
+    if len(devices) < 2:
+        return context
+    return cl.Context(devices)
+
+
+def _make_queues(context):
+    # type: (cl.Context) -> List[cl.CommandQueue]
+    """
+    Build one queue for each device in *context*.  Profiling is enabled so
+    that device pools can be balanced by measured throughput, and so that
+    :mod:`.profiling` can report the device time for each stage.
+    """
+    properties = cl.command_queue_properties.PROFILING_ENABLE
+    return [cl.CommandQueue(context, device, properties=properties)
+            for device in context.devices]
+
+
+def _event_seconds(events):
+    # type: (List[cl.Event]) -> float
+    """
+    Total device time in seconds for the completed *events*.
+    """
+    return 1e-9*sum(e.profile.end - e.profile.start for e in events)
+
+
 def _create_some_context():
     # type: () -> cl.Context
     """
@@ -422,6 +533,9 @@ class GpuModel(KernelModel):
     fast = False  # type: bool
     _program = None  # type: cl.Program
     _kernels = None  # type: Dict[str, cl.Kernel]
+    #: Programs for the kernel variants in generate.KERNEL_VARIANTS, keyed
+    #: by suffix, each with its dictionary of kernels.
+    _variants = None  # type: Dict[str, Tuple[cl.Program, Dict[str, cl.Kernel]]]
 
     def __init__(self, source, model_info, dtype=generate.F32, fast=False):
         # type: (Dict[str,str], ModelInfo, np.dtype, bool) -> None
@@ -440,37 +554,94 @@ class GpuModel(KernelModel):
         # type: (Tuple[ModelInfo, str, np.dtype, bool]) -> None
         self.info, self.source, self.dtype, self.fast = state
         self._program = self._kernels = None
+        self._variants = None
+
+    def __reduce__(self):
+        # type: () -> Tuple[Any, ...]
+        return self._reduce_shared()
 
     def make_kernel(self, q_vectors):
+        # type: (List[np.ndarray]) -> Kernel
+        if isinstance(q_vectors, GpuInput):
+            return GpuKernel(self, q_vectors)
+        context = environment().context[self.dtype]
+        memory = context.devices[0].global_mem_size if context else 0
+        tile = kerneltile.tile_size(q_vectors, self.dtype, memory)
+        if tile:
+            return kerneltile.TiledKernel(self, q_vectors, tile,
+                                          self._make_kernel,
+                                          GpuKernel.supports_flat)
+        return GpuKernel(self, q_vectors)
+
+    def _make_kernel(self, q_vectors):
         # type: (List[np.ndarray]) -> "GpuKernel"
         return GpuKernel(self, q_vectors)
 
+    def make_input(self, q_vectors):
+        # type: (List[np.ndarray]) -> Optional["GpuInput"]
+        context = environment().context[self.dtype]
+        memory = context.devices[0].global_mem_size if context else 0
+        if kerneltile.tile_size(q_vectors, self.dtype, memory):
+            return None
+        return GpuInput(q_vectors, self.dtype)
+    make_input.__doc__ = KernelModel.make_input.__doc__
+
+    def set_integration_order(self, n):
+        # type: (int) -> None
+        # OpenCL has no run time tables, so the programs are rebuilt with
+        # the new rule.  Programs are cached by source, so returning to an
+        # order that was used before doesn't compile again.
+        generate.check_gauss_order(self.info, n)
+        if n != self.gauss_order:
+            self.gauss_order = n
+            self._program = self._kernels = None
+            self._variants = None
+
     def get_function(self, name):
         # type: (str) -> cl.Kernel
         """
         Fetch the kernel from the environment by name, compiling it if it
         does not already exist.
+
+        The variant kernels, such as the batch kernels with names ending in
+        "_batch" or the monodisperse kernels ending in "_mono", are each in
+        a separate program which is only compiled when one of its kernels
+        is requested.
         """
+        for suffix in generate.KERNEL_VARIANTS:
+            if name.endswith(suffix):
+                if self._variants is None:
+                    self._variants = {}
+                if suffix not in self._variants:
+                    self._variants[suffix] = self._prepare_program(suffix)
+                return self._variants[suffix][1][name]
         if self._program is None:
-            self._prepare_program()
+            self._program, self._kernels = self._prepare_program()
         return self._kernels[name]
 
-    def _prepare_program(self):
-        # type: (str) -> None
+    def _prepare_program(self, suffix=""):
+        # type: (str) -> Tuple[Any, Dict[str, Any]]
         env = environment()
         timestamp = generate.ocl_timestamp(self.info)
+        source = self.source['opencl' + suffix]
+        if self.gauss_order not in (0, generate.gauss_order(self.info)):
+            source = "\n".join(generate.gauss_defines(self.gauss_order)
+                               + [source])
         program = env.compile_program(
-            self.info.name,
-            self.source['opencl'],
+            self.info.name + suffix,
+            source,
             self.dtype,
             self.fast,
             timestamp)
-        variants = ['Iq', 'Iqxy', 'Imagnetic']
+        variants = [k + suffix for k in ('Iq', 'Iqxy', 'Imagnetic')]
         names = [generate.kernel_name(self.info, k) for k in variants]
         functions = [getattr(program, k) for k in names]
-        self._kernels = {k: v for k, v in zip(variants, functions)}
-        # Keep a handle to program so GC doesn't collect.
-        self._program = program
+        kernels = {k: v for k, v in zip(variants, functions)}
+        if not suffix:
+            # The resolution stage is compiled with the general kernels.
+            kernels['resolution_smear'] = program.resolution_smear
+        # Return a handle to program as well so GC doesn't collect.
+        return program, kernels
 
 
 # TODO: Check that we don't need a destructor for buffers which go out of scope.
@@ -509,20 +680,23 @@ class GpuInput(object):
             raise ValueError("GpuInput vector length must be greater than zero")
         if self.is_2d and q_vectors[1].shape != q_vectors[0].shape:
             raise ValueError("GpuInput vectors must be the same shape")
-        # TODO: Stretch input based on get_warp().
-        # Not doing it now since warp depends on kernel, which is not known
-        # at this point, so instead using 32, which is good on the set of
-        # architectures tested so far.
+        # The work group size depends on the kernel, which is not known at
+        # this point, so the launch pads the number of work items to the
+        # tuned group size instead (see gputune).  The kernels skip work
+        # items beyond nq, so the q buffer only needs padding to 32.
+        # 2-D data is stored as a block of qx followed by a block of qy, with
+        # the blocks padded to match QY_OFFSET in kernel_iq.c, so that
+        # neighbouring work items read neighbouring values.
         if self.is_2d:
             width = ((self.nq+15)//16)*16
-            self.q = np.empty((width, 2), dtype=dtype)
-            self.q[:self.nq, 0] = q_vectors[0]
-            self.q[:self.nq, 1] = q_vectors[1]
+            self.q = np.empty((2, width), dtype=dtype)
+            self.q[0, :self.nq] = q_vectors[0]
+            self.q[1, :self.nq] = q_vectors[1]
         else:
             width = ((self.nq+31)//32)*32
             self.q = np.empty(width, dtype=dtype)
             self.q[:self.nq] = q_vectors[0]
-        self.global_size = [self.q.shape[0]]
+        self.global_size = [width]
         #print("creating inputs of size", self.global_size)
 
         # Transfer input value to GPU.
@@ -569,14 +743,28 @@ class GpuKernel(Kernel):
     dim = ""  # type: str
     #: Calculation results, updated after each call to *_call_kernel()*.
     result = None  # type: np.ndarray
+    #: The flat mesh kernels are compiled for every model.
+    supports_flat = True  # type: bool
     q_input = None # type: GpuInput
     _result_b = None # type: cl.Buffer
+    _result_pinned_b = None # type: cl.Buffer
+    _result_host = None # type: np.ndarray
+    _buffers = None # type: Dict[str, Tuple[cl.Buffer, np.ndarray]]
+    _part_b = None # type: List[cl.Buffer]
+    _split_b = None # type: cl.Buffer
+    _device_rate = None # type: np.ndarray
+    _smear_b = None # type: List[cl.Buffer]
+    _smeared = None # type: np.ndarray
 
     def __init__(self, model, q_vectors):
         # type: (GpuModel, List[np.ndarray]) -> None
         #print("create kernel", id(self))
         dtype = model.dtype
-        self.q_input = GpuInput(q_vectors, dtype)
+        # Inputs from GpuModel.make_input are shared, so they are left for
+        # the caller to release.
+        self._owns_input = not isinstance(q_vectors, GpuInput)
+        self.q_input = (GpuInput(q_vectors, dtype) if self._owns_input
+                        else q_vectors)
         self._model = model
 
         # Attributes accessed from the outside.
@@ -590,6 +778,9 @@ class GpuKernel(Kernel):
         # Holding place for the returned value.
         nout = 2 if self.info.have_Fq and self.dim == '1d' else 1
         extra_q = 4  # Total weight, form volume, shell volume and R_eff.
+        if generate.USE_KERNEL_STATS:
+            self._num_stats = generate.NUM_KERNEL_STATS
+            extra_q += self._num_stats
         self.result = np.empty(self.q_input.nq*nout + extra_q, dtype)
 
         # Allocate result value on GPU.
@@ -598,9 +789,460 @@ class GpuKernel(Kernel):
         width = ((self.result.size+31)//32)*32 * self.dtype.itemsize
         self._result_b = cl.Buffer(context, mf.READ_WRITE, width)
 
+        # Stage the copy back through page-locked host memory.  The result
+        # array is a view into the mapped buffer, so the copy from the
+        # device goes straight into it.  Fall back to pageable memory if
+        # the driver refuses the mapping.
+        try:
+            pinned_b = cl.Buffer(context, mf.READ_WRITE | mf.ALLOC_HOST_PTR,
+                                 width)
+            staging, _ = cl.enqueue_map_buffer(
+                env.queue[self.dtype], pinned_b,
+                cl.map_flags.READ | cl.map_flags.WRITE,
+                0, (width//self.dtype.itemsize,), self.dtype)
+        except Exception:
+            pass
+        else:
+            self._result_pinned_b = pinned_b
+            self._result_host = staging
+            self.result = staging[:self.result.size]
+
+        # Device buffers for details and values, reused between calls.
+        self._buffers = {}
+
+        # Partial results for the other devices in the pool.  The relative
+        # throughput of each device, in mesh points per second, is measured
+        # on the first pooled call.
+        num_devices = len(env.pool[self.dtype])
+        self._part_b = [cl.Buffer(context, mf.READ_WRITE, width)
+                        for _ in range(num_devices - 1)]
+
+    def _write_buffer(self, queue, slot, hostbuf):
+        # type: (cl.CommandQueue, str, np.ndarray) -> Tuple[cl.Buffer, List[cl.Event]]
+        """
+        Return the device buffer for *slot* holding a copy of *hostbuf*,
+        and a list with the event for the transfer if there is one.
+
+        The buffer persists between calls and only grows when *hostbuf*
+        no longer fits.  The transfer to the device is skipped when the
+        contents are unchanged since the previous call, which is the
+        usual case for the call details during a fit.
+        """
+        events = []
+        buf, cached = self._buffers.get(slot, (None, None))
+        if buf is None or buf.size < hostbuf.nbytes:
+            if buf is not None:
+                buf.release()
+            # Round up so that small changes in size don't reallocate.
+            width = max(((hostbuf.nbytes+1023)//1024)*1024, 1024)
+            buf = cl.Buffer(queue.context, mf.READ_ONLY, width)
+            cached = None
+        if (cached is None or cached.dtype != hostbuf.dtype
+                or cached.shape != hostbuf.shape
+                or not np.array_equal(cached, hostbuf)):
+            # Keep a private copy so the caller can modify hostbuf while
+            # the non-blocking write is still in flight.
+            cached = np.array(hostbuf, copy=True)
+            events.append(cl.enqueue_copy(queue, buf, cached,
+                                          is_blocking=False))
+        self._buffers[slot] = (buf, cached)
+        return buf, events
+
     def _call_kernel(self, call_details, values, cutoff, magnetic,
                      radius_effective_mode):
         # type: (CallDetails, np.ndarray, float, bool, int) -> None
+        wait = self._enqueue(call_details, values, cutoff, magnetic,
+                             radius_effective_mode, throttle=True)
+        wait()
+
+    def _call_kernel_async(self, call_details, values, cutoff, magnetic,
+                           radius_effective_mode):
+        # type: (CallDetails, np.ndarray, float, bool, int) -> Callable[[], None]
+        # Queue the entire dispersity walk and the copy back without
+        # waiting, so the host is free until the result is needed.
+        return self._enqueue(call_details, values, cutoff, magnetic,
+                             radius_effective_mode, throttle=False)
+
+    def _enqueue(self, call_details, values, cutoff, magnetic,
+                 radius_effective_mode, throttle):
+        # type: (CallDetails, np.ndarray, float, bool, int, bool) -> Callable[[], None]
+        """
+        Queue the kernel calls and the copy back to *result*, returning a
+        function which waits for the copy to complete.  If *throttle* is
+        True, wait between chunks of the dispersity loop so that other
+        processes can use the device.
+        """
+        env = environment()
+        queue = self._queue()
+        num_eval = call_details.num_eval
+        pool = env.pool[self._model.dtype]
+        use_pool = len(pool) > 1 and num_eval >= len(pool)
+        # With few q values, divide the mesh between the work items as well.
+        split = None
+        if not use_pool and not call_details.flat:
+            split = split_mesh(self.q_input.nq, num_eval, self._chunk_size())
+        kernel, kernel_args, ready = self._prepare(
+            queue, call_details, values, cutoff, magnetic,
+            radius_effective_mode, split)
+
+        # Call kernel and retrieve results.
+        #print("Calling OpenCL")
+        #call_details.show(values)
+        if use_pool:
+            return self._enqueue_pool(pool, kernel, kernel_args, num_eval,
+                                      ready)
+        if kernel.function_name.endswith('_split'):
+            events = self._walk(queue, kernel, kernel_args, 0, num_eval,
+                                throttle, split=split)
+            # The first launch has the most parts, so it fills every row.
+            part_size, num_parts = split
+            num_rows = min(num_parts, -(-num_eval//part_size))
+            rows = np.empty((num_rows, self._split_stride()), self.dtype)
+            done = cl.enqueue_copy(queue, rows, self._split_b,
+                                   wait_for=events[-1:], is_blocking=False)
+        else:
+            rows = None
+            events = self._walk(queue, kernel, kernel_args, 0, num_eval,
+                                throttle)
+            done = cl.enqueue_copy(queue, self.result, self._result_b,
+                                   wait_for=events[-1:], is_blocking=False)
+        def wait():
+            # type: () -> None
+            done.wait()
+            if rows is not None:
+                np.sum(rows[:, :self.result.size], axis=0, out=self.result)
+            if profiling.enabled():
+                self._profile(ready + [done], events)
+        return wait
+
+    def _profile(self, transfers, kernels):
+        # type: (List[cl.Event], List[cl.Event]) -> None
+        """
+        Record the device time for the completed *transfers* and set the
+        device time for the *kernels*, which is recorded with the host time
+        for the kernel stage.
+        """
+        if transfers:
+            profiling.record("transfer", self.info.name, None,
+                             _event_seconds(transfers))
+        self._device_time = _event_seconds(kernels)
+
+    def _queue(self):
+        # type: () -> cl.CommandQueue
+        """
+        Return the queue for the main device for the kernel precision.
+        """
+        queue = environment().queue[self._model.dtype]
+        if queue is None:
+            raise RuntimeError("No support for type %s in OpenCL"
+                               % str(self._model.dtype))
+        return queue
+
+    def _prepare(self, queue, call_details, values, cutoff, magnetic,
+                 radius_effective_mode, split=None):
+        # type: (cl.CommandQueue, CallDetails, np.ndarray, float, bool, int, Optional[Tuple[int, int]]) -> Tuple[cl.Kernel, List[Any], List[cl.Event]]
+        """
+        Transfer *call_details* and *values* to the device, returning the
+        kernel, its arguments and the events for the transfers.
+
+        If *split* is *(part_size, num_parts)* from :func:`.details.split_mesh`
+        then the kernel divides the mesh into parts, accumulating into the
+        rows of *_split_b* rather than into *_result_b*.
+        """
+        # Arrange data transfer to card, reusing the buffers from the
+        # previous call when possible.
+        details_b, details_events = self._write_buffer(
+            queue, 'details', call_details.buffer)
+        values_b, values_events = self._write_buffer(queue, 'values', values)
+
+        # Setup kernel function and arguments.  Use the flat mesh kernel for
+        # a compacted mesh, the monodisperse kernel if there is only one
+        # point in the dispersity mesh, or the kernel which stages the mesh
+        # in work group memory if it fits.
+        name = 'Iq' if self.dim == '1d' else 'Imagnetic' if magnetic else 'Iqxy'
+        if call_details.flat:
+            name += '_flat'
+        elif call_details.num_eval == 1:
+            name += '_mono'
+        elif split is not None:
+            name += '_split'
+        elif 2*call_details.num_weights <= generate.PD_CACHE_SIZE:
+            name += '_local'
+        kernel = self._model.get_function(name)
+        kernel_args = [
+            np.uint32(self.q_input.nq),  # Number of inputs.
+            None,  # Placeholder for pd_start.
+            None,  # Placeholder for pd_stop.
+            details_b,  # Problem definition.
+            values_b,  # Parameter values.
+            self.q_input.q_b,  # Q values.
+            self._result_b,   # Result storage.
+            self._as_dtype(cutoff),  # Probability cutoff.
+            np.uint32(radius_effective_mode),  # R_eff mode.
+        ]
+        if name.endswith('_split'):
+            part_size, num_parts = split
+            stride = self._split_stride()
+            nbytes = num_parts*stride*self.dtype.itemsize
+            if self._split_b is None or self._split_b.size < nbytes:
+                if self._split_b is not None:
+                    self._split_b.release()
+                self._split_b = cl.Buffer(queue.context, mf.READ_WRITE,
+                                          nbytes)
+            kernel_args[6] = self._split_b
+            kernel_args += [
+                np.int32(part_size),  # Mesh points in each part.
+                np.int32(stride),  # Result stride.
+            ]
+        return kernel, kernel_args, details_events + values_events
+
+    def _split_stride(self):
+        # type: () -> int
+        """
+        Distance between the rows of partial sums for the split kernels.
+        """
+        return ((self.result.size+31)//32)*32
+
+    def _chunk_size(self):
+        # type: () -> int
+        """
+        Number of mesh points to evaluate in each launch, which keeps each
+        launch short enough that the display stays responsive.
+        """
+        return 1000000//self.q_input.nq + 1
+
+    def set_resolution(self, weight_matrix):
+        # type: (Any) -> None
+        Kernel.set_resolution(self, weight_matrix)
+        self._release_resolution()
+        if self._resolution is None:
+            return
+        # Copy the weights to the device along with space for the smeared
+        # sums followed by the normalization sums.
+        W = self._resolution
+        context = self._queue().context
+        flags = mf.READ_ONLY | mf.COPY_HOST_PTR
+        self._smeared = np.empty(W.shape[0] + 4, self.dtype)
+        self._smear_b = [
+            cl.Buffer(context, flags, hostbuf=np.ascontiguousarray(
+                W.indptr, np.int32)),
+            cl.Buffer(context, flags, hostbuf=np.ascontiguousarray(
+                W.indices, np.int32)),
+            cl.Buffer(context, flags, hostbuf=np.ascontiguousarray(
+                W.data, self.dtype)),
+            cl.Buffer(context, mf.READ_WRITE, self._smeared.nbytes),
+            ]
+
+    def Iq_smeared(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> np.ndarray
+        # The device pool sums the partial results on the host, so smear
+        # them there as well.
+        num_eval = call_details.num_eval
+        pool = environment().pool[self._model.dtype]
+        if not self._smear_b or (len(pool) > 1 and num_eval >= len(pool)):
+            return Kernel.Iq_smeared(self, call_details, values, cutoff,
+                                     magnetic)
+        self._wait_pending()
+        start = clock()
+        queue = self._queue()
+        kernel, kernel_args, ready = self._prepare(
+            queue, call_details, values, cutoff, magnetic, 0)
+        events = self._walk(queue, kernel, kernel_args, 0, num_eval,
+                            throttle=True)
+
+        # Apply the weights on the device and copy back only the smeared
+        # values.  There is one work item for each measured point.
+        nrows = self._resolution.shape[0]
+        nout = 2 if self.info.have_Fq and self.dim == '1d' else 1
+        indptr_b, indices_b, weights_b, smeared_b = self._smear_b
+        smear = self._model.get_function('resolution_smear')
+        global_size = [((max(nrows, 4) + 31)//32)*32]
+        done = smear(queue, global_size, None,
+                     np.int32(nrows), np.int32(self.q_input.nq),
+                     np.int32(nout), indptr_b, indices_b, weights_b,
+                     self._result_b, smeared_b, wait_for=events[-1:])
+        copy = cl.enqueue_copy(queue, self._smeared, smeared_b,
+                               wait_for=[done])
+        if profiling.enabled():
+            # The smearing follows the kernel on the device, so the host
+            # time covers both.
+            copy.wait()
+            self._profile(ready + [copy], events)
+            profiling.record("kernel", self.info.name, clock() - start,
+                             self._device_time)
+            profiling.record("smear", self.info.name, None,
+                             _event_seconds([done]))
+        return self._smeared_Iq(values, self._smeared)
+
+    def _tuning_key(self, name, queue):
+        # type: (str, cl.CommandQueue) -> str
+        """
+        Key for the work group size of kernel *name* on the *queue* device.
+        """
+        return gputune.tuning_key(self.info.id, name, self.dtype.name,
+                                  _device_identity(queue.device))
+
+    def _launch_size(self, size, num_batch=0):
+        # type: (Optional[int], int) -> Tuple[List[int], Optional[List[int]]]
+        """
+        Return the global and local sizes for a launch with work groups of
+        *size*, or with the driver choice if *size* is None or 0.  Batch
+        and split kernels have a second dimension of length *num_batch*.
+        """
+        if size:
+            global_size = [gputune.padded(self.q_input.nq, size)]
+            local_size = [size]
+        else:
+            global_size, local_size = list(self.q_input.global_size), None
+        if num_batch:
+            global_size.append(num_batch)
+            if local_size is not None:
+                local_size.append(1)
+        return global_size, local_size
+
+    def _tune(self, key, queue, kernel, kernel_args, wait_for, num_parts=0):
+        # type: (str, cl.CommandQueue, cl.Kernel, List[Any], List[cl.Event], int) -> int
+        """
+        Time the first chunk of the mesh in *kernel_args* for each candidate
+        work group size, returning the fastest.  The chunk starts the mesh,
+        so each run overwrites the result of the previous one.  The split
+        kernels launch *num_parts* parts of the mesh.
+        """
+        if wait_for:
+            cl.wait_for_events(wait_for)
+        device = queue.device
+        max_size = kernel.get_work_group_info(
+            cl.kernel_work_group_info.WORK_GROUP_SIZE, device)
+        sizes = gputune.candidates(get_warp(kernel, queue), max_size)
+        timings = {}
+        for size in sizes[:1] + sizes:  # the first run is a warm up
+            global_size, local_size = self._launch_size(size, num_parts)
+            try:
+                event = kernel(queue, global_size, local_size, *kernel_args)
+                event.wait()
+            except cl.Error as exc:
+                logging.debug("work group size %d failed for %s: %s",
+                              size, key, exc)
+                continue
+            timings[size] = _event_seconds([event])
+        if not timings:
+            return gputune.DRIVER_DEFAULT
+        size = gputune.best(timings)
+        logging.info("work group size %d for %s", size, key)
+        gputune.store(key, size)
+        return size
+
+    def _release_resolution(self):
+        # type: () -> None
+        for buf in self._smear_b or []:
+            buf.release()
+        self._smear_b = None
+
+    def _walk(self, queue, kernel, kernel_args, pd_start, pd_stop,
+              throttle=False, wait_for=None, split=None):
+        # type: (cl.CommandQueue, cl.Kernel, List[Any], int, int, bool, List[cl.Event], Optional[Tuple[int, int]]) -> List[cl.Event]
+        """
+        Queue the kernel for mesh points *pd_start* to *pd_stop* in chunks,
+        returning the events for the chunks.  *kernel_args* is modified.
+        For the split kernels, *split* is *(part_size, num_parts)* and each
+        chunk launches up to *num_parts* parts of the mesh.
+        """
+        events = []
+        last_nap = clock()
+        if split is None:
+            step = self._chunk_size()
+        else:
+            part_size, num_parts = split
+            step = part_size*num_parts
+        key = self._tuning_key(kernel.function_name, queue)
+        size = gputune.lookup(key)
+        for start in range(pd_start, pd_stop, step):
+            stop = min(start + step, pd_stop)
+            #print("queuing",start,stop)
+            kernel_args[1:3] = [np.int64(start), np.int64(stop)]
+            parts = 0 if split is None else -(-(stop - start)//part_size)
+            if start == 0 and gputune.needs_tuning(key, self.q_input.nq):
+                size = self._tune(key, queue, kernel, kernel_args, wait_for,
+                                  parts)
+            global_size, local_size = self._launch_size(size, parts)
+            wait_for = [kernel(queue, global_size, local_size,
+                               *kernel_args, wait_for=wait_for)]
+            events.extend(wait_for)
+            if throttle and stop < pd_stop:
+                # Allow other processes to run.
+                wait_for[0].wait()
+                current_time = clock()
+                if current_time - last_nap > 0.5:
+                    time.sleep(0.001)
+                    last_nap = current_time
+        return events
+
+    def _enqueue_pool(self, pool, kernel, kernel_args, num_eval, wait_for):
+        # type: (List[cl.CommandQueue], cl.Kernel, List[Any], int, List[cl.Event]) -> Callable[[], None]
+        """
+        Split the dispersity mesh across the devices in *pool* in proportion
+        to their measured throughput, returning a function which waits for
+        all devices and sums their partial results into *result*.
+
+        Each device accumulates into its own result buffer.  The kernel
+        only clears the buffer when it starts at the first mesh point, so
+        the buffers for devices starting later in the mesh are cleared here.
+        """
+        if self._device_rate is None:
+            self._device_rate = np.ones(len(pool))
+            measured = False
+        else:
+            measured = True
+        share = np.cumsum(self._device_rate)/np.sum(self._device_rate)
+        bounds = [0] + [int(round(num_eval*v)) for v in share]
+        bounds[-1] = num_eval
+        result_b = [self._result_b] + self._part_b
+        parts = [np.empty_like(self.result) for _ in pool[1:]]
+        copies, device_events = [], []
+        zero = np.zeros(1, self.dtype)
+        for k, queue in enumerate(pool):
+            start, stop = bounds[k], bounds[k + 1]
+            events = []
+            if start < stop:
+                args = list(kernel_args)
+                args[6] = result_b[k]
+                ready = wait_for
+                if start > 0:
+                    ready = ready + [cl.enqueue_fill_buffer(
+                        queue, result_b[k], zero, 0, result_b[k].size,
+                        wait_for=wait_for)]
+                events = self._walk(queue, kernel, args, start, stop,
+                                    wait_for=ready)
+            target = self.result if k == 0 else parts[k - 1]
+            if events:
+                copies.append(cl.enqueue_copy(
+                    queue, target, result_b[k], wait_for=events[-1:],
+                    is_blocking=False))
+            else:
+                target[...] = 0.
+            device_events.append((stop - start, events))
+
+        def wait():
+            # type: () -> None
+            cl.wait_for_events(copies)
+            for part in parts:
+                self.result += part
+            if profiling.enabled():
+                self._profile(wait_for + copies,
+                              [e for _, events in device_events
+                               for e in events])
+            # Update device throughput from the kernel run times.
+            for k, (num_points, events) in enumerate(device_events):
+                if events:
+                    rate = num_points/max(_event_seconds(events), 1e-6)
+                    if measured:
+                        rate = 0.5*(self._device_rate[k] + rate)
+                    self._device_rate[k] = rate
+        return wait
+
+    def _call_kernel_batch(self, call_details_list, values_matrix, cutoff,
+                           magnetic, radius_effective_mode):
+        # type: (List[CallDetails], np.ndarray, float, bool, int) -> np.ndarray
         env = environment()
         queue = env.queue[self._model.dtype]
         if queue is None:
@@ -608,15 +1250,22 @@ class GpuKernel(Kernel):
                                % str(self._model.dtype))
         context = queue.context
 
-        # Arrange data transfer to card.
+        # Stack the details and values for the batch into matrices, with
+        # one row per parameter set.
+        details, values, num_eval = stack_batch_args(
+            call_details_list, values_matrix, self.dtype)
+        num_batch = details.shape[0]
+        result_stride = ((self.result.size+31)//32)*32
+        results = np.empty((num_batch, result_stride), self.dtype)
         details_b = cl.Buffer(context, mf.READ_ONLY | mf.COPY_HOST_PTR,
-                              hostbuf=call_details.buffer)
+                              hostbuf=details)
         values_b = cl.Buffer(context, mf.READ_ONLY | mf.COPY_HOST_PTR,
                              hostbuf=values)
+        results_b = cl.Buffer(context, mf.READ_WRITE, results.nbytes)
 
         # Setup kernel function and arguments.
         name = 'Iq' if self.dim == '1d' else 'Imagnetic' if magnetic else 'Iqxy'
-        kernel = self._model.get_function(name)
+        kernel = self._model.get_function(name + '_batch')
         kernel_args = [
             np.uint32(self.q_input.nq),  # Number of inputs.
             None,  # Placeholder for pd_start.
@@ -624,36 +1273,44 @@ class GpuKernel(Kernel):
             details_b,  # Problem definition.
             values_b,  # Parameter values.
             self.q_input.q_b,  # Q values.
-            self._result_b,   # Result storage.
+            results_b,   # Result storage.
             self._as_dtype(cutoff),  # Probability cutoff.
             np.uint32(radius_effective_mode),  # R_eff mode.
+            np.int32(details.shape[1]),  # Details stride.
+            np.int32(values.shape[1]),  # Values stride.
+            np.int32(result_stride),  # Result stride.
         ]
+        # Use the work group size tuned for the single parameter kernel.
+        base = kernel.function_name[:-len('_batch')]
+        size = gputune.lookup(self._tuning_key(base + '_local', queue))
+        if size is None:
+            size = gputune.lookup(self._tuning_key(base, queue))
+        global_size, local_size = self._launch_size(size, num_batch)
 
         # Call kernel and retrieve results.
-        #print("Calling OpenCL")
-        #call_details.show(values)
         wait_for = None
         last_nap = clock()
-        step = 1000000//self.q_input.nq + 1
-        for start in range(0, call_details.num_eval, step):
-            stop = min(start + step, call_details.num_eval)
-            #print("queuing",start,stop)
-            kernel_args[1:3] = [np.int32(start), np.int32(stop)]
-            wait_for = [kernel(queue, self.q_input.global_size, None,
+        step = 1000000//(self.q_input.nq*num_batch) + 1
+        for start in range(0, num_eval, step):
+            stop = min(start + step, num_eval)
+            kernel_args[1:3] = [np.int64(start), np.int64(stop)]
+            wait_for = [kernel(queue, global_size, local_size,
                                *kernel_args, wait_for=wait_for)]
-            if stop < call_details.num_eval:
+            if stop < num_eval:
                 # Allow other processes to run.
                 wait_for[0].wait()
                 current_time = clock()
                 if current_time - last_nap > 0.5:
                     time.sleep(0.001)
                     last_nap = current_time
-        cl.enqueue_copy(queue, self.result, self._result_b, wait_for=wait_for)
-        #print("result", self.result)
+        cl.enqueue_copy(queue, results, results_b, wait_for=wait_for)
 
         # Free buffers.
         details_b.release()
         values_b.release()
+        results_b.release()
+
+        return results[:, :self.result.size]
 
     def release(self):
         # type: () -> None
@@ -662,11 +1319,32 @@ class GpuKernel(Kernel):
         """
         #print("release kernel", id(self))
         if self.q_input is not None:
-            self.q_input.release()
+            if self._owns_input:
+                self.q_input.release()
             self.q_input = None
         if self._result_b is not None:
             self._result_b.release()
             self._result_b = None
+        if self._buffers:
+            for buf, _ in self._buffers.values():
+                buf.release()
+            self._buffers = {}
+        if self._split_b is not None:
+            self._split_b.release()
+            self._split_b = None
+        if self._part_b:
+            for buf in self._part_b:
+                buf.release()
+            self._part_b = []
+        self._release_resolution()
+        if self._result_host is not None:
+            # Detach the result from the mapped memory before unmapping.
+            self.result = np.array(self.result, copy=True)
+            queue = environment().queue[self.dtype]
+            self._result_host.base.release(queue)
+            self._result_host = None
+            self._result_pinned_b.release()
+            self._result_pinned_b = None
 
     def __del__(self):
         # type: () -> None
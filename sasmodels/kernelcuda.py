@@ -70,7 +70,7 @@ import numpy as np  # type: ignore
 # installed or if it is installed but there are no devices available.
 try:
     import pycuda.driver as cuda  # type: ignore
-    from pycuda.compiler import SourceModule
+    from pycuda.compiler import SourceModule, compile as compile_cubin
     from pycuda.tools import make_default_context, clear_context_caches
     # Ask CUDA for the default context (so that we know that one exists)
     # then immediately throw it away in case the user doesn't want it.
@@ -86,12 +86,22 @@ except Exception as exc:
     HAVE_CUDA = False
     CUDA_ERROR = str(exc)
 
+#: Exceptions raised when the model source fails to compile.
+COMPILE_ERRORS = ((RuntimeError, cuda.CompileError) if HAVE_CUDA
+                  else (RuntimeError,))
+
 from . import generate
+from . import gputune
+from . import kernelcache
+from . import kerneltile
+from . import profiling
 from .kernel import KernelModel, Kernel
+from .details import stack_batch_args, split_mesh
+from .gengauss import GAUSS_TABLE_NAMES, gauss_table
 
 # pylint: disable=unused-import
 try:
-    from typing import Tuple, Callable, Any, Dict, List
+    from typing import Tuple, Callable, Any, Dict, List, Optional
     from .modelinfo import ModelInfo
     from .details import CallDetails
 except ImportError:
@@ -106,6 +116,14 @@ except ImportError:
 # of polydisperse parameters.
 MAX_LOOPS = 2048
 
+# During a fit the sequence of kernel launches is the same for every call,
+# with only the parameter values changing in device memory.  The launches
+# are captured in a CUDA graph the first time, which is then replayed for
+# later calls with the same kernel, mesh size, cutoff and R_eff mode.
+# Graphs need a pycuda with stream capture (Stream.begin_capture), and are
+# skipped otherwise.  Set SAS_CUDA_GRAPH=0 to launch the kernels directly.
+USE_CUDA_GRAPH = os.environ.get("SAS_CUDA_GRAPH", "1") not in ("", "0")
+
 
 def use_cuda():
     # type: () -> bool
@@ -204,14 +222,28 @@ def show_device_functions(source):
     return source
 
 
-def compile_model(source, dtype, fast=False):
-    # type: (str, np.dtype, bool) -> SourceModule
+def _device_identity():
+    # type: () -> str
+    """
+    Describe the current device and driver for the kernel and tuning caches.
+    """
+    device = cuda.Context.get_device()
+    return "%s|%d.%d|%d" % ((device.name(),) + device.compute_capability()
+                            + (cuda.get_driver_version(),))
+
+
+def compile_model(source, dtype, fast=False, name=None, timestamp=0.):
+    # type: (str, np.dtype, bool, str, float) -> SourceModule
     """
     Build a model to run on the gpu.
 
     Returns the compiled program and its type.  The returned type will
     be float32 even if the desired type is float64 if any of the
     devices in the context do not support the cl_khr_fp64 extension.
+
+    If *name* is given, the cubin is saved in the disk cache from
+    :mod:`.kernelcache` and reloaded on the next build, unless the cached
+    copy is older than *timestamp*.
     """
     dtype = np.dtype(dtype)
     if not has_type(dtype):
@@ -227,7 +259,21 @@ def compile_model(source, dtype, fast=False):
     #print(source)
     #options = ['--verbose', '-E']
     options = ['--use_fast_math'] if fast else None
-    program = SourceModule(source, no_extern_c=True, options=options) #, include_dirs=[...])
+    if name is None:
+        program = SourceModule(source, no_extern_c=True, options=options) #, include_dirs=[...])
+        return program
+
+    path = kernelcache.cache_path(
+        name, [source, " ".join(options or []), _device_identity()])
+    binaries = kernelcache.load_binaries(path, timestamp)
+    if binaries is not None and len(binaries) == 1:
+        try:
+            return cuda.module_from_buffer(binaries[0])
+        except Exception as exc:
+            logging.warning("ignoring cached cubin for %s: %s", name, exc)
+    cubin = compile_cubin(source, no_extern_c=True, options=options)
+    kernelcache.save_binaries(path, [cubin])
+    program = cuda.module_from_buffer(cubin)
 
     #print("done with "+program)
     return program
@@ -260,6 +306,8 @@ class GpuEnvironment(object):
 
         # Cache for compiled programs, and for items in context.
         self.compiled = {}
+        # Order of the gauss table in each program, by table address.
+        self.gauss_orders = {}  # type: Dict[int, int]
 
     def release(self):
         """Free the CUDA device associated with this context."""
@@ -277,6 +325,15 @@ class GpuEnvironment(object):
         """
         return has_type(dtype)
 
+    def has_half(self):
+        # type: () -> bool
+        """
+        Return True if the device can evaluate half precision model code.
+        """
+        # The CUDA half type has no overloads for the math library, so the
+        # model code would need a wrapper for every function it calls.
+        return False
+
     def compile_program(self, name, source, dtype, fast, timestamp):
         # type: (str, str, np.dtype, bool, float) -> SourceModule
         """
@@ -292,7 +349,8 @@ class GpuEnvironment(object):
             del self.compiled[key]
         if key not in self.compiled:
             logging.info("building %s for CUDA", key)
-            program = compile_model(str(source), dtype, fast)
+            program = compile_model(str(source), dtype, fast,
+                                    name=key, timestamp=timestamp)
             self.compiled[key] = (program, timestamp)
         return program
 
@@ -318,6 +376,9 @@ class GpuModel(KernelModel):
     fast = False  # type: bool
     _program = None  # type: SourceModule
     _kernels = None  # type: Dict[str, cuda.Function]
+    #: Programs for the kernel variants in generate.KERNEL_VARIANTS, keyed
+    #: by suffix, each with its dictionary of kernels.
+    _variants = None  # type: Dict[str, Tuple[SourceModule, Dict[str, cuda.Function]]]
 
     def __init__(self, source, model_info, dtype=generate.F32, fast=False):
         # type: (Dict[str,str], ModelInfo, np.dtype, bool) -> None
@@ -334,37 +395,115 @@ class GpuModel(KernelModel):
         # type: (Tuple[ModelInfo, str, np.dtype, bool]) -> None
         self.info, self.source, self.dtype, self.fast = state
         self._program = self._kernels = None
+        self._variants = None
+
+    def __reduce__(self):
+        # type: () -> Tuple[Any, ...]
+        return self._reduce_shared()
 
     def make_kernel(self, q_vectors):
+        # type: (List[np.ndarray]) -> Kernel
+        if isinstance(q_vectors, GpuInput):
+            return GpuKernel(self, q_vectors)
+        environment()  # Make the context current before querying memory.
+        tile = kerneltile.tile_size(q_vectors, self.dtype,
+                                    cuda.mem_get_info()[1])
+        if tile:
+            return kerneltile.TiledKernel(self, q_vectors, tile,
+                                          self._make_kernel,
+                                          GpuKernel.supports_flat)
+        return GpuKernel(self, q_vectors)
+
+    def _make_kernel(self, q_vectors):
         # type: (List[np.ndarray]) -> "GpuKernel"
         return GpuKernel(self, q_vectors)
 
+    def make_input(self, q_vectors):
+        # type: (List[np.ndarray]) -> Optional["GpuInput"]
+        environment()
+        if kerneltile.tile_size(q_vectors, self.dtype, cuda.mem_get_info()[1]):
+            return None
+        return GpuInput(q_vectors, self.dtype)
+    make_input.__doc__ = KernelModel.make_input.__doc__
+
+    def set_integration_order(self, n):
+        # type: (int) -> None
+        generate.check_gauss_order(self.info, n)
+        self.gauss_order = n
+
     def get_function(self, name):
         # type: (str) -> cuda.Function
         """
         Fetch the kernel from the environment by name, compiling it if it
         does not already exist.
+
+        The variant kernels, such as the batch kernels with names ending in
+        "_batch" or the monodisperse kernels ending in "_mono", are each in
+        a separate program which is only compiled when one of its kernels
+        is requested.
         """
+        for suffix in generate.KERNEL_VARIANTS:
+            if name.endswith(suffix):
+                if self._variants is None:
+                    self._variants = {}
+                if suffix not in self._variants:
+                    self._variants[suffix] = self._prepare_program(suffix)
+                program, kernels = self._variants[suffix]
+                self._load_gauss_table(program)
+                return kernels[name]
         if self._program is None:
-            self._prepare_program()
+            self._program, self._kernels = self._prepare_program()
+        self._load_gauss_table(self._program)
         return self._kernels[name]
 
-    def _prepare_program(self):
-        # type: (str) -> None
+    def _load_gauss_table(self, program):
+        # type: (SourceModule) -> None
+        """
+        Copy the rule for :attr:`gauss_order` into the constant memory of
+        *program* if the program has a different rule.
+
+        Programs are shared by models with the same source, so the models
+        must use the same order while their kernels are running.
+        """
+        order = self.gauss_order or generate.gauss_order(self.info)
+        if not order:
+            return
+        try:
+            order_b, _ = program.get_global("gauss_table_n")
+        except cuda.LogicError:
+            # Programs built without lib/gauss_table.c have a fixed rule.
+            if self.gauss_order:
+                raise ValueError("%s has no run time gauss table"
+                                 % self.info.name)
+            return
+        orders = environment().gauss_orders
+        if orders.get(int(order_b), None) == order:
+            return
+        size = generate.GAUSS_MAX_N
+        for name, table in zip(GAUSS_TABLE_NAMES,
+                               gauss_table(order, size)):
+            table_b, nbytes = program.get_global(name)
+            dtype = np.float32 if nbytes == 4*size else np.float64
+            cuda.memcpy_htod(table_b, np.ascontiguousarray(table, dtype))
+        cuda.memcpy_htod(order_b, np.array([order], np.int32))
+        orders[int(order_b)] = order
+
+    def _prepare_program(self, suffix=""):
+        # type: (str) -> Tuple[Any, Dict[str, Any]]
         env = environment()
         timestamp = generate.ocl_timestamp(self.info)
         program = env.compile_program(
-            self.info.name,
-            self.source['opencl'],
+            self.info.name + suffix,
+            self.source['opencl' + suffix],
             self.dtype,
             self.fast,
             timestamp)
-        variants = ['Iq', 'Iqxy', 'Imagnetic']
+        variants = [k + suffix for k in ('Iq', 'Iqxy', 'Imagnetic')]
         names = [generate.kernel_name(self.info, k) for k in variants]
         functions = [program.get_function(k) for k in names]
-        self._kernels = {k: v for k, v in zip(variants, functions)}
-        # Keep a handle to program so GC doesn't collect.
-        self._program = program
+        kernels = {k: v for k, v in zip(variants, functions)}
+        # Return a handle to program as well so GC doesn't collect.
+        return program, kernels
 
 
 # TODO: Check that we don't need a destructor for buffers which go out of scope.
@@ -397,16 +536,19 @@ class GpuInput(object):
         # Not doing it now since warp depends on kernel, which is not known
         # at this point, so instead using 32, which is good on the set of
         # architectures tested so far.
+        # 2-D data is stored as a block of qx followed by a block of qy, with
+        # the blocks padded to match QY_OFFSET in kernel_iq.c, so that
+        # neighbouring work items read neighbouring values.
         if self.is_2d:
             width = ((self.nq+15)//16)*16
-            self.q = np.empty((width, 2), dtype=dtype)
-            self.q[:self.nq, 0] = q_vectors[0]
-            self.q[:self.nq, 1] = q_vectors[1]
+            self.q = np.empty((2, width), dtype=dtype)
+            self.q[0, :self.nq] = q_vectors[0]
+            self.q[1, :self.nq] = q_vectors[1]
         else:
             width = ((self.nq+31)//32)*32
             self.q = np.empty(width, dtype=dtype)
             self.q[:self.nq] = q_vectors[0]
-        self.global_size = [self.q.shape[0]]
+        self.global_size = [width]
         #print("creating inputs of size", self.global_size)
 
         # Transfer input value to GPU.
@@ -448,11 +590,22 @@ class GpuKernel(Kernel):
     dim = ""  # type: str
     #: Calculation results, updated after each call to *_call_kernel()*.
     result = None  # type: np.ndarray
+    #: The flat mesh kernels are compiled for every model.
+    supports_flat = True  # type: bool
+    _result_b = None  # type: cuda.DeviceAllocation
+    _rows_b = None  # type: cuda.DeviceAllocation
+    _rows_size = 0  # type: int
+    _buffers = None  # type: Dict[str, Tuple[cuda.DeviceAllocation, np.ndarray]]
+    _graphs = None  # type: Dict[Tuple, Any]
 
     def __init__(self, model, q_vectors):
         # type: (GpuModel, List[np.ndarray]) -> None
         dtype = model.dtype
-        self.q_input = GpuInput(q_vectors, dtype)
+        # Inputs from GpuModel.make_input are shared, so they are left for
+        # the caller to release.
+        self._owns_input = not isinstance(q_vectors, GpuInput)
+        self.q_input = (GpuInput(q_vectors, dtype) if self._owns_input
+                        else q_vectors)
         self._model = model
 
         # Attributes accessed from the outside.
@@ -466,22 +619,147 @@ class GpuKernel(Kernel):
         # Holding place for the returned value.
         nout = 2 if self.info.have_Fq and self.dim == '1d' else 1
         extra_q = 4  # Total weight, form volume, shell volume and R_eff.
+        if generate.USE_KERNEL_STATS:
+            self._num_stats = generate.NUM_KERNEL_STATS
+            extra_q += self._num_stats
         self.result = np.empty(self.q_input.nq*nout + extra_q, dtype)
 
         # Allocate result value on GPU.
         width = ((self.result.size+31)//32)*32 * self.dtype.itemsize
         self._result_b = cuda.mem_alloc(width)
 
+        # Each kernel queues its work on its own stream, so that the
+        # asynchronous calls for the parts of a composite model can overlap
+        # on the device.  The details, values and partial sums stay in
+        # device buffers between calls so that the captured launch graphs
+        # remain valid.
+        self._stream = cuda.Stream()
+        self._buffers = {}
+        self._graphs = {}
+        self._use_graph = USE_CUDA_GRAPH and hasattr(self._stream,
+                                                     "begin_capture")
+
+    def _write_buffer(self, slot, hostbuf):
+        # type: (str, np.ndarray) -> Any
+        """
+        Queue a copy of *hostbuf* to the device buffer for *slot* on the
+        kernel stream, returning the buffer.
+
+        The copy goes through page-locked memory so that it does not block
+        the host.  The buffer only grows when *hostbuf* no longer fits, at
+        which point the captured graphs, which hold the old address, are
+        discarded.
+        """
+        hostbuf = np.ascontiguousarray(hostbuf)
+        buf, staging = self._buffers.get(slot, (None, None))
+        if buf is None or staging.nbytes < hostbuf.nbytes:
+            if buf is not None:
+                buf.free()
+            # Round up so that small changes in size don't reallocate.
+            width = max(((hostbuf.nbytes+1023)//1024)*1024, 1024)
+            buf = cuda.mem_alloc(width)
+            staging = cuda.pagelocked_empty(width, np.uint8)
+            self._buffers[slot] = (buf, staging)
+            self._graphs.clear()
+        if hostbuf.nbytes:
+            staging[:hostbuf.nbytes] = hostbuf.view(np.uint8).ravel()
+            cuda.memcpy_htod_async(buf, staging[:hostbuf.nbytes],
+                                   self._stream)
+        return buf
+
+    def _result_rows(self, nbytes):
+        # type: (int) -> Any
+        """
+        Return a device buffer of at least *nbytes* for the partial sums of
+        the split kernels.
+        """
+        if self._rows_b is None or self._rows_size < nbytes:
+            if self._rows_b is not None:
+                self._rows_b.free()
+            self._rows_b, self._rows_size = cuda.mem_alloc(nbytes), nbytes
+            self._graphs.clear()
+        return self._rows_b
+
+    def _launch(self, key, launches):
+        # type: (Tuple, Callable[[], None]) -> None
+        """
+        Queue the kernel *launches* on the kernel stream.
+
+        If graphs are enabled, the launches are captured in a graph the
+        first time they are seen and the graph stored under *key* is
+        replayed on later calls.  If the capture fails then graphs are
+        turned off for this kernel and the launches are queued directly.
+        """
+        if not self._use_graph:
+            launches()
+            return
+        graph = self._graphs.get(key, None)
+        if graph is None:
+            try:
+                self._stream.begin_capture()
+                try:
+                    launches()
+                finally:
+                    captured = self._stream.end_capture()
+                graph = captured.instance()
+            except Exception as exc:
+                logging.warning("CUDA graph capture failed for %s: %s",
+                                self.info.name, exc)
+                self._use_graph = False
+                self._graphs.clear()
+                launches()
+                return
+            self._graphs[key] = graph
+        graph.launch(self._stream)
+
     def _call_kernel(self, call_details, values, cutoff, magnetic,
                      radius_effective_mode):
         # type: (CallDetails, np.ndarray, float, bool, int) -> None
-
+        finish = self._enqueue(call_details, values, cutoff, magnetic,
+                               radius_effective_mode, throttle=True)
+        finish()
+
+    def _call_kernel_async(self, call_details, values, cutoff, magnetic,
+                           radius_effective_mode):
+        # type: (CallDetails, np.ndarray, float, bool, int) -> Callable[[], None]
+        # Launch the entire dispersity walk without synchronizing, leaving
+        # the host free until the result is needed.
+        return self._enqueue(call_details, values, cutoff, magnetic,
+                             radius_effective_mode, throttle=False)
+
+    def _enqueue(self, call_details, values, cutoff, magnetic,
+                 radius_effective_mode, throttle):
+        # type: (CallDetails, np.ndarray, float, bool, int, bool) -> Callable[[], None]
+        """
+        Launch the kernel calls, returning a function which waits for them
+        to complete and copies the output to *result*.  If *throttle* is
+        True, synchronize between chunks of the dispersity loop so that
+        other processes can use the device.
+        """
         # Arrange data transfer to card.
-        details_b = cuda.to_device(call_details.buffer)
-        values_b = cuda.to_device(values)
-
-        # Setup kernel function and arguments.
+        with profiling.stage("transfer", self.info.name):
+            details_b = self._write_buffer('details', call_details.buffer)
+            values_b = self._write_buffer('values', values)
+
+        # Setup kernel function and arguments.  Use the flat mesh kernel for
+        # a compacted mesh, the monodisperse kernel if there is only one
+        # point in the dispersity mesh, or the kernel which stages the mesh
+        # in work group memory if it fits.
+        # With few q values, divide the mesh between the work items as well,
+        # with each part of the mesh accumulating into its own row.
         name = 'Iq' if self.dim == '1d' else 'Imagnetic' if magnetic else 'Iqxy'
+        step = 100000000//self.q_input.nq + 1
+        split = None
+        if call_details.flat:
+            name += '_flat'
+        elif call_details.num_eval == 1:
+            name += '_mono'
+        else:
+            split = split_mesh(self.q_input.nq, call_details.num_eval, step)
+            if split is not None:
+                name += '_split'
+            elif 2*call_details.num_weights <= generate.PD_CACHE_SIZE:
+                name += '_local'
         kernel = self._model.get_function(name)
         kernel_args = [
             np.uint32(self.q_input.nq),  # Number of inputs.
@@ -494,52 +772,216 @@ class GpuKernel(Kernel):
             self._as_dtype(cutoff),  # Probability cutoff.
             np.uint32(radius_effective_mode),  # R_eff mode.
         ]
-        grid = partition(self.q_input.nq)
+        rows_b = None
+        if split is not None:
+            part_size, num_parts = split
+            step = part_size*num_parts
+            stride = ((self.result.size+31)//32)*32
+            num_rows = min(num_parts, -(-call_details.num_eval//part_size))
+            rows = np.empty((num_rows, stride), self.dtype)
+            rows_b = self._result_rows(num_parts*stride*self.dtype.itemsize)
+            kernel_args[6] = rows_b
+            kernel_args += [
+                np.int32(part_size),  # Mesh points in each part.
+                np.int32(stride),  # Result stride.
+            ]
+        key = gputune.tuning_key(self.info.id, name, self.dtype.name,
+                                 _device_identity())
+        blocksize = gputune.lookup(key) or gputune.DEFAULT_BLOCK
+        if gputune.needs_tuning(key, self.q_input.nq):
+            first = min(call_details.num_eval, step)
+            kernel_args[1:3] = [np.int64(0), np.int64(first)]
+            parts = 1 if split is None else -(-first//part_size)
+            blocksize = self._tune(key, kernel, kernel_args, parts)
 
         # Call kernel and retrieve results.
         #print("Calling CUDA")
         #call_details.show(values)
-        last_nap = time.clock()
-        step = 100000000//self.q_input.nq + 1
-        #step = 1000000000
-        for start in range(0, call_details.num_eval, step):
-            stop = min(start + step, call_details.num_eval)
-            #print("queuing",start,stop)
-            kernel_args[1:3] = [np.int32(start), np.int32(stop)]
+        num_eval = call_details.num_eval
+        stream = self._stream
+        def launch(start, stop):
+            # type: (int, int) -> None
+            kernel_args[1:3] = [np.int64(start), np.int64(stop)]
+            parts = 1 if split is None else -(-(stop - start)//part_size)
+            kernel(*kernel_args, stream=stream,
+                   **partition(self.q_input.nq, parts, blocksize=blocksize))
+        def launch_all():
+            # type: () -> None
+            for start in range(0, num_eval, step):
+                launch(start, min(start + step, num_eval))
+
+        # Bracket the kernel calls with events to measure the device time.
+        timers = None
+        if profiling.enabled():
+            timers = cuda.Event(), cuda.Event()
+            timers[0].record(stream)
+        if throttle and num_eval > step:
+            # Synchronize between chunks so that other processes can use
+            # the device.  The graph would queue all chunks at once.
+            last_nap = time.perf_counter()
+            #step = 1000000000
+            for start in range(0, num_eval, step):
+                stop = min(start + step, num_eval)
+                #print("queuing",start,stop)
+                launch(start, stop)
+                if stop < num_eval:
+                    sync(stream)
+                    # Allow other processes to run.
+                    current_time = time.perf_counter()
+                    if current_time - last_nap > 0.5:
+                        time.sleep(0.001)
+                        last_nap = current_time
+        else:
+            key = (name, num_eval, float(cutoff), radius_effective_mode,
+                   blocksize, split)
+            self._launch(key, launch_all)
+        if timers is not None:
+            timers[1].record(stream)
+
+        def finish():
+            # type: () -> None
+            sync(stream)
+            if timers is not None:
+                # time_till is in milliseconds.
+                self._device_time = 1e-3*timers[0].time_till(timers[1])
+            with profiling.stage("transfer", self.info.name):
+                if rows_b is None:
+                    cuda.memcpy_dtoh(self.result, self._result_b)
+                else:
+                    cuda.memcpy_dtoh(rows, rows_b)
+            if rows_b is not None:
+                np.sum(rows[:, :self.result.size], axis=0, out=self.result)
+            #print("result", self.result)
+        return finish
+
+    def _call_kernel_batch(self, call_details_list, values_matrix, cutoff,
+                           magnetic, radius_effective_mode):
+        # type: (List[CallDetails], np.ndarray, float, bool, int) -> np.ndarray
+        # Stack the details and values for the batch into matrices, with
+        # one row per parameter set.
+        details, values, num_eval = stack_batch_args(
+            call_details_list, values_matrix, self.dtype)
+        num_batch = details.shape[0]
+        result_stride = ((self.result.size+31)//32)*32
+        results = np.empty((num_batch, result_stride), self.dtype)
+        details_b = cuda.to_device(details)
+        values_b = cuda.to_device(values)
+        results_b = cuda.mem_alloc(results.nbytes)
+
+        # Setup kernel function and arguments.
+        name = 'Iq' if self.dim == '1d' else 'Imagnetic' if magnetic else 'Iqxy'
+        kernel = self._model.get_function(name + '_batch')
+        kernel_args = [
+            np.uint32(self.q_input.nq),  # Number of inputs.
+            None,  # Placeholder for pd_start.
+            None,  # Placeholder for pd_stop.
+            details_b,  # Problem definition.
+            values_b,  # Parameter values.
+            self.q_input.q_b,  # Q values.
+            results_b,   # Result storage.
+            self._as_dtype(cutoff),  # Probability cutoff.
+            np.uint32(radius_effective_mode),  # R_eff mode.
+            np.int32(details.shape[1]),  # Details stride.
+            np.int32(values.shape[1]),  # Values stride.
+            np.int32(result_stride),  # Result stride.
+        ]
+        # Use the block size tuned for the single parameter kernel.
+        identity = _device_identity()
+        blocksize = (
+            gputune.lookup(gputune.tuning_key(
+                self.info.id, name + '_local', self.dtype.name, identity))
+            or gputune.lookup(gputune.tuning_key(
+                self.info.id, name, self.dtype.name, identity))
+            or gputune.DEFAULT_BLOCK)
+        grid = partition(self.q_input.nq, num_batch, blocksize=blocksize)
+
+        # Call kernel and retrieve results.
+        last_nap = time.perf_counter()
+        step = 100000000//(self.q_input.nq*num_batch) + 1
+        for start in range(0, num_eval, step):
+            stop = min(start + step, num_eval)
+            kernel_args[1:3] = [np.int64(start), np.int64(stop)]
             kernel(*kernel_args, **grid)
-            if stop < call_details.num_eval:
+            if stop < num_eval:
                 sync()
                 # Allow other processes to run.
-                current_time = time.clock()
+                current_time = time.perf_counter()
                 if current_time - last_nap > 0.5:
                     time.sleep(0.001)
                     last_nap = current_time
         sync()
-        cuda.memcpy_dtoh(self.result, self._result_b)
-        #print("result", self.result)
+        cuda.memcpy_dtoh(results, results_b)
 
         details_b.free()
         values_b.free()
+        results_b.free()
+
+        return results[:, :self.result.size]
+
+    def _tune(self, key, kernel, kernel_args, num_parts=1):
+        # type: (str, Any, List[Any], int) -> int
+        """
+        Time the first chunk of the mesh in *kernel_args* for each candidate
+        block size, returning the fastest.  The chunk starts the mesh, so
+        each run overwrites the result of the previous one.  The split
+        kernels launch *num_parts* parts of the mesh.
+        """
+        max_size = kernel.get_attribute(
+            cuda.function_attribute.MAX_THREADS_PER_BLOCK)
+        sizes = gputune.candidates(32, max_size, driver_default=False)
+        timings = {}
+        stream = self._stream
+        for blocksize in sizes[:1] + sizes:  # the first run is a warm up
+            start, stop = cuda.Event(), cuda.Event()
+            try:
+                start.record(stream)
+                kernel(*kernel_args, stream=stream,
+                       **partition(self.q_input.nq, num_parts,
+                                   blocksize=blocksize))
+                stop.record(stream)
+                stop.synchronize()
+            except cuda.Error as exc:
+                logging.debug("block size %d failed for %s: %s",
+                              blocksize, key, exc)
+                continue
+            # time_till is in milliseconds.
+            timings[blocksize] = 1e-3*start.time_till(stop)
+        if not timings:
+            return gputune.DEFAULT_BLOCK
+        blocksize = gputune.best(timings)
+        logging.info("block size %d for %s", blocksize, key)
+        gputune.store(key, blocksize)
+        return blocksize
 
     def release(self):
         # type: () -> None
         """
         Release resources associated with the kernel.
         """
-        self.q_input.release()
+        if self._owns_input:
+            self.q_input.release()
         if self._result_b is not None:
             self._result_b.free()
             self._result_b = None
+        if self._buffers:
+            for buf, _ in self._buffers.values():
+                buf.free()
+            self._buffers = {}
+        if self._rows_b is not None:
+            self._rows_b.free()
+            self._rows_b = None
+        self._graphs = {}
 
     def __del__(self):
         # type: () -> None
         self.release()
 
 
-def sync():
+def sync(stream=None):
     """
     Overview:
-        Waits for operation in the current context to complete.
+        Waits for operation in the current context to complete, or only
+        for the operations queued on *stream* if it is given.
 
     Note: Maybe context.synchronize() is sufficient.
     """
@@ -547,7 +989,7 @@ def sync():
     done = cuda.Event()
 
     # Schedule an event trigger on the GPU.
-    done.record()
+    done.record(stream)
 
     # Make sure we don't hog resource while waiting to sync.
     while not done.query():
@@ -560,17 +1002,25 @@ def sync():
     del done
 
 
-def partition(n):
+def partition(n, num_batch=1, blocksize=gputune.DEFAULT_BLOCK):
     """
-    Constructs block and grid arguments for *n* elements.
+    Constructs block and grid arguments for *n* elements in blocks of
+    *blocksize* threads.
+
+    For batch kernels, *num_batch* is the number of parameter sets, which
+    are indexed by the second grid dimension.  The split kernels use the
+    second dimension for the parts of the mesh.
     """
     max_gx, max_gy = 65535, 65535
-    blocksize = 32
     #max_gx, max_gy = 5, 65536
     #blocksize = 3
     block = (blocksize, 1, 1)
     num_blocks = int((n+blocksize-1)/blocksize)
-    if num_blocks < max_gx:
+    if num_batch > 1:
+        if num_blocks >= max_gx or num_batch >= max_gy:
+            raise ValueError("batch is too large")
+        grid = (num_blocks, num_batch)
+    elif num_blocks < max_gx:
         grid = (num_blocks, 1)
     else:
         gx = max_gx
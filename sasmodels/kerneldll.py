@@ -2,9 +2,32 @@ r"""
 DLL driver for C kernels
 
 If the environment variable *SAS_OPENMP* is set, then sasmodels
-will attempt to compile with OpenMP flags so that the model can use all
-available kernels.  This may or may not be available on your compiler
-toolchain.  Depending on operating system and environment.
+will compile the models with OpenMP flags so that the model can use all
+available cores.  This may or may not be available on your compiler
+toolchain, depending on operating system and environment.  The threaded
+dlls are tagged with "_omp" so that they can live in the compiled model
+cache beside the single threaded versions.  The number of threads used
+for each call is set by the *num_threads* attribute of the kernel, which
+defaults to the value of *SAS_NUM_THREADS* in the environment, or to all
+available cores if *SAS_NUM_THREADS* is not set.
+
+The OpenMP kernels split the dispersity mesh, or the q vector if the mesh
+is short, into several parts for each thread, which the threads take in
+turn as they finish, so the work stays balanced when the cutoff skips
+much of the mesh for some parts.  Each part sums into its own copy of the
+results, allocated by the thread which computes it so that it is in the
+memory of that thread's socket.  The OpenMP thread pool persists between
+calls, and unless *OMP_PROC_BIND* or *OMP_PLACES* are set in the
+environment, its threads are pinned to cores spread across the sockets
+so that they stay near their memory.  This only has an effect if the
+OpenMP runtime is not already running when the first dll is loaded.
+
+If *SAS_SIMD* is set, then the 1D q loops are compiled with OpenMP simd
+directives so that the compiler can evaluate several q values at once.
+This is only a gain if the compiler can vectorize the math functions used
+by the model (for example, gcc with glibc needs "-ffast-math" in *CFLAGS*
+before it will use the vector versions of sin and cos), so it is off by
+default.
 
 Windows does not have provide a compiler with the operating system.
 Instead, we assume that TinyCC is installed and available.  This can
@@ -65,15 +88,24 @@ evaluated in the shell.  For even more control, replace the entire
 The global attribute *ALLOW_SINGLE_PRECISION_DLLS* should be set to *False* if
 you wish to prevent single precision floating point evaluation for the compiled
 models, otherwise set it defaults to *True*.
+
+The dlls also export the C interface declared in *sasmodels/kernel_api.h*,
+which packs the call details and parameter values and normalizes the
+result, so that native code can evaluate a model without going through
+python.  Use :func:`make_dll` to build the dll for the native caller.
 """
 from __future__ import print_function
 
 import sys
 import os
 from os.path import join as joinpath, splitext
+import re
 import subprocess
 import shlex
 import tempfile
+import threading
+from concurrent.futures import ThreadPoolExecutor
+from time import perf_counter
 import ctypes as ct  # type: ignore
 import _ctypes as _ct
 import logging
@@ -86,14 +118,17 @@ except ImportError:
     tinycc = None
 
 from . import generate
-from .kernel import KernelModel, Kernel
+from . import kerneltile
+from . import profiling
+from .kernel import KernelModel, Kernel, KernelCancelled
 from .kernelpy import PyInput
 from .exception import annotate_exception
 from .generate import F16, F32, F64
+from .gengauss import GAUSS_TABLE_NAMES, gauss_table
 
 # pylint: disable=unused-import
 try:
-    from typing import Tuple, Callable, Any, List
+    from typing import Tuple, Callable, Any, List, Optional
     from .modelinfo import ModelInfo
     from .details import CallDetails
 except ImportError:
@@ -129,7 +164,8 @@ ARCH = "" if ct.sizeof(ct.c_void_p) > 4 else "x86"  # 4 byte pointers on x86.
 if COMPILER == "unix":
     # Generic unix compile.
     # On Mac users will need the X code command line tools installed.
-    #COMPILE = "gcc-mp-4.7 -shared -fPIC -std=c99 -fopenmp -O2 -Wall %s -o %s -lm -lgomp"
+    # Apple clang does not support -fopenmp, but gcc or llvm clang from
+    # macports or homebrew will work with CC set in the environment.
     CC = os.environ.get("CC", "cc")
     CPPFLAGS = os.environ.get("CPPFLAGS", "")
     CFLAGS = os.environ.get("CFLAGS", "-std=c99 -O2 -Wall")
@@ -138,16 +174,12 @@ if COMPILER == "unix":
     compiler_vars = (CC, CPPFLAGS, CFLAGS, LDFLAGS, SOFLAGS)
     compiler = [val for var in compiler_vars for val in shlex.split(var)]
     LIBS = ["-lm"] + shlex.split(os.environ.get("LIBS", ""))
-
-    # Add OpenMP support if not running on a Mac.
-    if sys.platform != "darwin":
-        # OpenMP seems to be broken on gcc 5.4.0 (ubuntu 16.04.9).
-        # Shut it off for all unix until we can investigate.
-        #CC.append("-fopenmp")
-        pass
-    def compile_command(source, output):
+    OPENMP = ["-fopenmp"]
+    SIMD = ["-fopenmp-simd", "-DUSE_SIMD"]
+    def compile_command(source, output, openmp=False):
         """unix compiler command"""
-        return compiler + [source, "-o", output] + LIBS
+        flags = (OPENMP if openmp else []) + (SIMD if USE_SIMD else [])
+        return compiler + flags + [source, "-o", output] + LIBS
 elif COMPILER == "msvc":
     # Call vcvarsall.bat before compiling to set path, headers, libs, etc.
     # MSVC compiler is available, so use it.  OpenMP requires a copy of
@@ -158,38 +190,79 @@ elif COMPILER == "msvc":
     # TODO: Maybe don't use randomized name for the c file.
     # TODO: Maybe ask distutils to find MSVC.
     CC = "cl /nologo /Ox /MD /W3 /GS- /DNDEBUG".split()
-    if "SAS_OPENMP" in os.environ:
-        CC.append("/openmp")
+    OPENMP = ["/openmp"]
+    SIMD = None  # MSVC only has the OpenMP 2.0 directives.
     LN = "/link /DLL /INCREMENTAL:NO /MANIFEST".split()
-    def compile_command(source, output):
+    def compile_command(source, output, openmp=False):
         """MSVC compiler command"""
-        return CC + ["/Tp%s"%source] + LN + ["/OUT:%s"%output]
+        flags = OPENMP if openmp else []
+        return CC + flags + ["/Tp%s"%source] + LN + ["/OUT:%s"%output]
 elif COMPILER == "tinycc":
     # TinyCC compiler.
     CC = [tinycc.TCC] + "-shared -rdynamic -Wall".split()
-    def compile_command(source, output):
+    OPENMP = None  # TinyCC does not support OpenMP.
+    SIMD = None
+    def compile_command(source, output, openmp=False):
         """tinycc compiler command"""
         return CC + [source, "-o", output]
 elif COMPILER == "mingw":
     # MinGW compiler.
     CC = "gcc -shared -std=c99 -O2 -Wall".split()
-    if "SAS_OPENMP" in os.environ:
-        CC.append("-fopenmp")
-    def compile_command(source, output):
+    OPENMP = ["-fopenmp"]
+    SIMD = ["-fopenmp-simd", "-DUSE_SIMD"]
+    def compile_command(source, output, openmp=False):
         """mingw compiler command"""
-        return CC + [source, "-o", output, "-lm"]
+        flags = (OPENMP if openmp else []) + (SIMD if USE_SIMD else [])
+        return CC + flags + [source, "-o", output, "-lm"]
 
 ALLOW_SINGLE_PRECISION_DLLS = True
 
+#: Build multithreaded dlls by default if SAS_OPENMP is in the environment
+#: and the compiler supports OpenMP.
+USE_OPENMP = "SAS_OPENMP" in os.environ and OPENMP is not None
+
+# Pin the OpenMP threads before the runtime is loaded by the first dll.
+if USE_OPENMP:
+    os.environ.setdefault("OMP_PROC_BIND", "spread")
+    os.environ.setdefault("OMP_PLACES", "cores")
+
+#: Build the 1D q loops for vector evaluation if SAS_SIMD is in the
+#: environment and the compiler supports OpenMP simd directives.  This only
+#: pays off when the compiler can also vectorize the math library calls,
+#: such as gcc with glibc and CFLAGS="-O2 -ffast-math -march=native".
+USE_SIMD = "SAS_SIMD" in os.environ and SIMD is not None
+
+#: Default number of threads for OpenMP dlls, with 0 for all available cores.
+NUM_THREADS = int(os.environ.get("SAS_NUM_THREADS", "0"))
+
+#: Target wall time in seconds for each call into the dll.  The number of
+#: mesh points per call is adjusted to match the measured cost per point.
+CHUNK_TIME = 0.05
+
+#: Number of q evaluations in the first call, before the cost is known.
+FIRST_CHUNK_WORK = 10000
+
+# Serializes updates to the gauss tables of the loaded dlls.
+_GAUSS_LOCK = threading.Lock()
 
-def compile_model(source, output):
-    # type: (str, str) -> None
+#: Exceptions raised when the model source fails to compile.
+COMPILE_ERRORS = (RuntimeError,)
+
+
+def compile_model(source, output, openmp=False):
+    # type: (str, str, bool) -> None
     """
-    Compile *source* producing *output*.
+    Compile *source* producing *output*.  If *openmp* then compile with
+    the OpenMP flags for the compiler.
 
     Raises RuntimeError if the compile failed or the output wasn't produced.
     """
-    command = compile_command(source=source, output=output)
+    # Only pass openmp if needed so that user supplied compile_command
+    # functions without the openmp keyword continue to work.
+    if openmp:
+        command = compile_command(source=source, output=output, openmp=True)
+    else:
+        command = compile_command(source=source, output=output)
     command_str = " ".join('"%s"'%p if ' ' in p else p for p in command)
     logging.info(command_str)
     try:
@@ -203,15 +276,63 @@ def compile_model(source, output):
         raise RuntimeError("compile failed.  File is in %r"%source)
 
 
-def dll_name(model_file, dtype):
-    # type: (str, np.dtype) ->  str
+# Splits a compiler argument into an option prefix, a directory and a name.
+_PATH_ARG = re.compile(r"^(-[A-Za-z]+|[^=]*=)?(.*[/\\])([^/\\]*)$")
+_COMPILER_VERSION = None
+
+def compiler_version():
+    # type: () -> str
+    """
+    Return the version reported by the compiler, or the empty string if it
+    can't be determined.  The compiler is queried once per session.
+    """
+    global _COMPILER_VERSION
+    if _COMPILER_VERSION is None:
+        version = ""
+        if COMPILER == "tinycc":
+            version = getattr(tinycc, "__version__", "")
+        elif COMPILER in ("unix", "mingw"):
+            command = (compiler if COMPILER == "unix" else CC)[:1]
+            try:
+                output = subprocess.check_output(
+                    command + ["-dumpversion"], stderr=subprocess.STDOUT)
+                version = decode(output).strip()
+            except (OSError, subprocess.CalledProcessError):
+                pass
+        _COMPILER_VERSION = version
+    return _COMPILER_VERSION
+
+
+def compiler_tag(openmp=False):
+    # type: (bool) -> str
+    """
+    Return the compiler kind and version with the command used for the dlls,
+    so that changes to the compiler or flags lead to new dll names.
+
+    The command uses placeholder file names, and directories are dropped
+    from the arguments so that the tag doesn't depend on where the compiler
+    is installed.  The dlls precompiled for a distribution are then found
+    after the application is installed elsewhere.
+    """
+    if openmp:
+        command = compile_command(source="model.c", output="model.so",
+                                  openmp=True)
+    else:
+        command = compile_command(source="model.c", output="model.so")
+    args = [_PATH_ARG.sub(r"\1\3", arg) for arg in command]
+    return " ".join([COMPILER, compiler_version()] + args)
+
+
+def dll_name(model_file, dtype, openmp=False):
+    # type: (str, np.dtype, bool) ->  str
     """
     Name of the dll containing the model.  This is the base file name without
-    any path or extension, with a form such as 'sas_sphere32'.
+    any path or extension, with a form such as 'sas_sphere32'.  OpenMP dlls
+    have the suffix '_omp'.
     """
     bits = 8*dtype.itemsize
     basename = "sas%d_%s"%(bits, model_file)
-    basename += ARCH + ".so"
+    basename += ("_omp" if openmp else "") + ARCH + ".so"
 
     # Hack to find precompiled dlls.
     path = joinpath(generate.DATA_PATH, '..', 'compiled_models', basename)
@@ -221,17 +342,17 @@ def dll_name(model_file, dtype):
     return joinpath(SAS_DLL_PATH, basename)
 
 
-def dll_path(model_file, dtype):
-    # type: (str, np.dtype) -> str
+def dll_path(model_file, dtype, openmp=False):
+    # type: (str, np.dtype, bool) -> str
     """
     Complete path to the dll for the model.  Note that the dll may not
     exist yet if it hasn't been compiled.
     """
-    return os.path.join(SAS_DLL_PATH, dll_name(model_file, dtype))
+    return os.path.join(SAS_DLL_PATH, dll_name(model_file, dtype, openmp))
 
 
-def make_dll(source, model_info, dtype=F64, system=False):
-    # type: (str, ModelInfo, np.dtype, bool) -> str
+def make_dll(source, model_info, dtype=F64, system=False, openmp=None):
+    # type: (str, ModelInfo, np.dtype, bool, Optional[bool]) -> str
     """
     Returns the path to the compiled model defined by *kernel_module*.
 
@@ -252,7 +373,15 @@ def make_dll(source, model_info, dtype=F64, system=False):
 
     *system* is a bool that controls whether these are the precompiled DLLs
     that would be shipped with a binary distribution.
+
+    *openmp* is True if the model should be compiled with OpenMP so that
+    the dispersity mesh is shared across cores.  The default is
+    :data:`USE_OPENMP`, which is set if *SAS_OPENMP* is in the environment.
     """
+    if openmp is None:
+        openmp = USE_OPENMP
+    if openmp and OPENMP is None:
+        raise ValueError("OpenMP not supported by compiler %s" % COMPILER)
     if dtype == F16:
         raise ValueError("16 bit floats not supported")
     if dtype == F32 and not ALLOW_SINGLE_PRECISION_DLLS:
@@ -261,16 +390,27 @@ def make_dll(source, model_info, dtype=F64, system=False):
 
     # TODO: Deal with ever-growing ~/.sasmodels/compiled_models.
     # TODO: Is the GPU model cache growing without bound?
-    # Tag model name with hash so any change to the model or the wrapper
-    # will generate a new dll. Need to tag with dtype as well because
-    # double has not yet been converted to the target type in the source.
-    # Don't use time stamps for caching since they are not reliable, especially
-    # when multiple versions of the application are installed.
-    model_file = model_info.id + "_" + generate.tag_source(source)
-    dll = dll_path(model_file, dtype)
+    # Tag model name with hash so any change to the model, the wrapper or
+    # the compiler command will generate a new dll. Need to tag with dtype
+    # as well because double has not yet been converted to the target type
+    # in the source. Don't use time stamps for caching since they are not
+    # reliable, especially when multiple versions of the application are
+    # installed.  Since the name depends only on content, a directory of
+    # dlls can be shared between machines with the same compiler.
+    tag = generate.tag_source(source + "\n" + compiler_tag(openmp))
+    model_file = model_info.id + "_" + tag
+    dll = dll_path(model_file, dtype, openmp)
     logging.debug("make_dll: dll located %s as %s in %s",
                   model_info.id, model_file, dll)
+    _build_dll(source, dll, dtype, system, openmp)
+    return dll
 
+
+def _build_dll(source, dll, dtype, system, openmp):
+    # type: (str, str, np.dtype, bool, bool) -> None
+    """
+    Compile *source* to *dll* unless it is already in the cache.
+    """
     if not os.path.exists(dll):
         # Make sure the DLL path exists. Use abspath since python docs warn
         # that makedirs is not robust against '..' in path.
@@ -287,7 +427,12 @@ def make_dll(source, model_info, dtype=F64, system=False):
             logging.debug("make_dll: writing C for system dll: %s", filename)
             with open(filename, 'w') as file_handle:
                 file_handle.write(source)
-        compile_model(source=filename, output=dll)
+        # Build to a temporary name and move it into place so that other
+        # processes sharing the dll path never load a partial dll.
+        root, ext = splitext(dll)
+        partial = "%s_%d_%d%s" % (root, os.getpid(), threading.get_ident(), ext)
+        compile_model(source=filename, output=partial, openmp=openmp)
+        os.replace(partial, dll)
         # Comment the following to keep the generated C file.
         # Note: If there is a syntax error then compile raises an error
         # and the source file will not be deleted.
@@ -295,11 +440,10 @@ def make_dll(source, model_info, dtype=F64, system=False):
         #print("saving compiled file in %r"%filename)
     else:
         logging.debug("make_dll: cache hit for %s", dll)
-    return dll
 
 
-def load_dll(source, model_info, dtype=F64):
-    # type: (str, ModelInfo, np.dtype) -> "DllModel"
+def load_dll(source, model_info, dtype=F64, openmp=None):
+    # type: (str, ModelInfo, np.dtype, Optional[bool]) -> "DllModel"
     """
     Create and load a dll corresponding to the source.
 
@@ -309,11 +453,38 @@ def load_dll(source, model_info, dtype=F64):
     *source* is returned from :func:`.generate.make_source`, as
     *make_source(model_info)['dll']*.
 
-    See :func:`make_dll` for details on controlling the dll path and the
-    allowed floating point precision.
+    See :func:`make_dll` for details on controlling the dll path, the
+    allowed floating point precision and the use of OpenMP.
     """
-    filename = make_dll(source, model_info, dtype=dtype)
-    return DllModel(filename, model_info, dtype=dtype)
+    if openmp is None:
+        openmp = USE_OPENMP
+    filename = make_dll(source, model_info, dtype=dtype, openmp=openmp)
+    return DllModel(filename, model_info, dtype=dtype, openmp=openmp)
+
+
+_WEIGHTS_DLL = None  # type: ct.CDLL
+def load_weights_dll():
+    # type: () -> ct.CDLL
+    """
+    Load the dll with the dispersity weights from kernel_weights.c,
+    compiling it first if it is not in the dll cache.
+
+    The dll is built in double precision without OpenMP, and is loaded
+    once for the process.
+    """
+    global _WEIGHTS_DLL
+    if _WEIGHTS_DLL is None:
+        source = generate.make_weights_source()
+        tag = generate.tag_source(source + "\n" + compiler_tag())
+        dll = dll_path("weights_" + tag, F64)
+        _build_dll(source, dll, F64, system=False, openmp=False)
+        lib = ct.CDLL(dll)
+        # int, double, double, double, double, double, double*, double*
+        lib.schulz_weights.argtypes = (
+            [ct.c_int32] + [ct.c_double]*5 + [ct.c_void_p]*2)
+        lib.schulz_weights.restype = ct.c_int32
+        _WEIGHTS_DLL = lib
+    return _WEIGHTS_DLL
 
 
 class DllModel(KernelModel):
@@ -330,14 +501,21 @@ class DllModel(KernelModel):
     for single and 'd', 'float64' or 'double' for double.  Double precision
     is an optional extension which may not be available on all devices.
 
+    *openmp* is True if the dll was compiled with OpenMP, in which case
+    the kernels take an additional argument for the number of threads.
+
     Call :meth:`release` when done with the kernel.
     """
-    def __init__(self, dllpath, model_info, dtype=generate.F32):
-        # type: (str, ModelInfo, np.dtype) -> None
+    def __init__(self, dllpath, model_info, dtype=generate.F32, openmp=False):
+        # type: (str, ModelInfo, np.dtype, bool) -> None
         self.info = model_info
         self.dllpath = dllpath
+        self.openmp = openmp
         self._dll = None  # type: ct.CDLL
         self._kernels = None  # type: List[Callable, Callable]
+        self._smear = None  # type: Optional[Callable]
+        self._have_flat = False  # type: bool
+        self._gauss_n = None  # type: Optional[ct.c_int32]
         self.dtype = np.dtype(dtype)
 
     def _load_dll(self):
@@ -352,32 +530,132 @@ class DllModel(KernelModel):
                       else ct.c_double if self.dtype == generate.F64
                       else ct.c_longdouble)
 
-        # int, int, int, int*, double*, double*, double*, double*, double
-        argtypes = [ct.c_int32]*3 + [ct.c_void_p]*4 + [float_type, ct.c_int32]
+        # int, int64, int64, int*, double*, double*, double*, double*, double,
+        # int, with the mesh positions 64-bit for meshes beyond 2^31 points.
+        # OpenMP kernels have an extra int for the number of threads.
+        argtypes = ([ct.c_int32] + [ct.c_int64]*2 + [ct.c_void_p]*4
+                    + [float_type, ct.c_int32])
+        if self.openmp:
+            argtypes.append(ct.c_int32)
         names = [generate.kernel_name(self.info, variant)
                  for variant in ("Iq", "Iqxy", "Imagnetic")]
         self._kernels = [self._dll[name] for name in names]
+        # Monodisperse kernels, falling back to the general kernels for
+        # dlls built before they were available.
+        try:
+            self._kernels += [self._dll[name + "_mono"] for name in names]
+        except AttributeError:
+            self._kernels += self._kernels[:3]
+        # Flat mesh kernels, which can't be replaced by the general kernels.
+        try:
+            self._kernels += [self._dll[name + "_flat"] for name in names]
+            self._have_flat = True
+        except AttributeError:
+            self._kernels += self._kernels[:3]
+            self._have_flat = False
         for k in self._kernels:
             k.argtypes = argtypes
+        # Resolution stage from kernel_resolution.c, if the dll has it.
+        # int, int, int, int*, int*, double*, double*, double*
+        try:
+            self._smear = self._dll["resolution_smear"]
+        except AttributeError:
+            self._smear = None
+        else:
+            self._smear.argtypes = [ct.c_int32]*3 + [ct.c_void_p]*5
+        # Run time gauss table from lib/gauss_table.c, if the model has one.
+        try:
+            self._gauss_n = ct.c_int32.in_dll(self._dll, "gauss_table_n")
+        except ValueError:
+            self._gauss_n = None
+
+    def set_integration_order(self, n):
+        # type: (int) -> None
+        generate.check_gauss_order(self.info, n)
+        self.gauss_order = n
+
+    def _load_gauss_table(self):
+        # type: () -> None
+        """
+        Copy the rule for :attr:`gauss_order` into the dll if the dll has a
+        different rule.
+
+        Models loaded from the same dll share the table, so they must use
+        the same order while their kernels are running.
+        """
+        if self._gauss_n is None:
+            if self.gauss_order:
+                raise ValueError("%s has no run time gauss table"
+                                 % self.dllpath)
+            return
+        order = self.gauss_order or generate.gauss_order(self.info)
+        if self._gauss_n.value == order:
+            return
+        with _GAUSS_LOCK:
+            itemsize = ct.c_int32.in_dll(
+                self._dll, "gauss_table_itemsize").value
+            dtype = {4: np.float32, 8: np.float64}.get(itemsize, np.longdouble)
+            size = generate.GAUSS_MAX_N
+            for name, table in zip(GAUSS_TABLE_NAMES,
+                                   gauss_table(order, size)):
+                target = ct.addressof(ct.c_char.in_dll(self._dll, name))
+                values = np.ascontiguousarray(table, dtype)
+                ct.memmove(target, values.ctypes.data, itemsize*size)
+            self._gauss_n.value = order
 
     def __getstate__(self):
-        # type: () -> Tuple[ModelInfo, str]
-        return self.info, self.dllpath
+        # type: () -> Tuple[ModelInfo, str, np.dtype, bool]
+        return self.info, self.dllpath, self.dtype, self.openmp
 
     def __setstate__(self, state):
-        # type: (Tuple[ModelInfo, str]) -> None
-        self.info, self.dllpath = state
+        # type: (Tuple[ModelInfo, str, np.dtype, bool]) -> None
+        self.info, self.dllpath, self.dtype, self.openmp = state
         self._dll = None
+        self._gauss_n = None
+
+    def __reduce__(self):
+        # type: () -> Tuple[Any, ...]
+        return self._reduce_shared()
 
     def make_kernel(self, q_vectors):
+        # type: (List[np.ndarray]) -> Kernel
+        if isinstance(q_vectors, PyInput):
+            return self._make_kernel(q_vectors)
+        tile = kerneltile.tile_size(q_vectors, self.dtype)
+        if tile:
+            # Note: DLL is lazy loaded.
+            if self._dll is None:
+                self._load_dll()
+            return kerneltile.TiledKernel(self, q_vectors, tile,
+                                          self._make_kernel, self._have_flat)
+        return self._make_kernel(q_vectors)
+
+    def make_input(self, q_vectors):
+        # type: (List[np.ndarray]) -> Optional[PyInput]
+        if kerneltile.tile_size(q_vectors, self.dtype):
+            return None
+        return PyInput(q_vectors, self.dtype)
+    make_input.__doc__ = KernelModel.make_input.__doc__
+
+    def _make_kernel(self, q_vectors):
         # type: (List[np.ndarray]) -> DllKernel
-        q_input = PyInput(q_vectors, self.dtype)
+        q_input = (q_vectors if isinstance(q_vectors, PyInput)
+                   else PyInput(q_vectors, self.dtype))
         # Note: DLL is lazy loaded.
         if self._dll is None:
             self._load_dll()
-        is_2d = len(q_vectors) == 2
-        kernel = self._kernels[1:3] if is_2d else [self._kernels[0]]*2
-        return DllKernel(kernel, self.info, q_input)
+        is_2d = q_input.is_2d
+        if is_2d:
+            kernel = (self._kernels[1:3] + self._kernels[4:6]
+                      + self._kernels[7:9])
+        else:
+            kernel = ([self._kernels[0]]*2 + [self._kernels[3]]*2
+                      + [self._kernels[6]]*2)
+        kernel = DllKernel(kernel, self.info, q_input, openmp=self.openmp,
+                           smear=self._smear)
+        kernel.supports_flat = self._have_flat
+        kernel._model = self
+        return kernel
 
     def release(self):
         # type: () -> None
@@ -391,32 +669,64 @@ class DllModel(KernelModel):
             _ct.dlclose(dll_handle)
         del self._dll
         self._dll = None
+        self._gauss_n = None
 
 
 class DllKernel(Kernel):
     """
     Callable SAS kernel.
 
-    *kernel* is the c function to call.
+    *kernel* is the list of c functions to call, with the normal and
+    magnetic kernels followed by their monodisperse versions, which are
+    used when the dispersity mesh has a single point, and their flat mesh
+    versions, which are used for the compacted mesh from
+    :func:`.details.flatten_mesh`.
 
     *model_info* is the module information
 
     *q_input* is the DllInput q vectors at which the kernel should be
     evaluated.
 
+    *smear* is the resolution stage from the dll used by :meth:`Iq_smeared`,
+    or None if the dll does not have one.
+
     The resulting call method takes the *pars*, a list of values for
     the fixed parameters to the kernel, and *pd_pars*, a list of (value, weight)
     vectors for the polydisperse parameters.  *cutoff* determines the
     integration limits: any points with combined weight less than *cutoff*
     will not be calculated.
 
+    If the kernel was compiled with *openmp*, then set *num_threads* to
+    control the number of threads used on each call, or zero to use all
+    available cores.  For single threaded dlls, *num_threads* instead sets
+    the number of parameter sets in a batch which are evaluated at once.
+
+    The dispersity mesh is evaluated in chunks, with the chunk size chosen
+    so that each call into the dll takes about :data:`CHUNK_TIME` seconds.
+    Set *progress* to a function *progress(done, total)* to be notified
+    after each chunk, where *done* and *total* count mesh points.  If it
+    returns True then the calculation is cancelled and the kernel raises
+    :class:`.kernel.KernelCancelled`.
+
     Call :meth:`release` when done with the kernel instance.
     """
-    def __init__(self, kernel, model_info, q_input):
-        # type: (Callable[[], np.ndarray], ModelInfo, PyInput) -> None
+    #: Number of OpenMP threads for the next call, or 0 for all cores.
+    num_threads = 0  # type: int
+    #: Callback *progress(done, total) -> cancel* between chunks, or None.
+    progress = None  # type: Optional[Callable[[int, int], bool]]
+    #: Measured time to evaluate one mesh point for all q, or 0 if unknown.
+    _point_time = 0.  # type: float
+    #: Arrays for the resolution stage set up by :meth:`set_resolution`.
+    _smear_args = None  # type: Optional[Tuple[np.ndarray, ...]]
+
+    def __init__(self, kernel, model_info, q_input, openmp=False, smear=None):
+        # type: (List[Callable[[], np.ndarray]], ModelInfo, PyInput, bool, Optional[Callable]) -> None
         dtype = q_input.dtype
         self.q_input = q_input
         self.kernel = kernel
+        self.smear = smear
+        self.openmp = openmp
+        self.num_threads = NUM_THREADS
 
         # Attributes accessed from the outside.
         self.dim = '2d' if q_input.is_2d else '1d'
@@ -431,14 +741,23 @@ class DllKernel(Kernel):
         # Holding place for the returned value.
         nout = 2 if self.info.have_Fq else 1
         extra_q = 4  # Total weight, form volume, shell volume and R_eff.
+        if generate.USE_KERNEL_STATS:
+            self._num_stats = generate.NUM_KERNEL_STATS
+            extra_q += self._num_stats
         self.result = np.empty(self.q_input.nq*nout + extra_q, dtype)
 
     def _call_kernel(self, call_details, values, cutoff, magnetic,
-                     radius_effective_mode):
-        # type: (CallDetails, np.ndarray, float, bool, int)
+                     radius_effective_mode, result=None):
+        # type: (CallDetails, np.ndarray, float, bool, int, Optional[np.ndarray])
+        if result is None:
+            result = self.result
+        if self._model is not None:
+            self._model._load_gauss_table()
 
         # Setup kernel function and arguments.
-        kernel = self.kernel[1 if magnetic else 0]
+        mono = (call_details.num_eval == 1)
+        variant = 4 if call_details.flat else 2 if mono else 0
+        kernel = self.kernel[variant + (1 if magnetic else 0)]
         kernel_args = [
             self.q_input.nq,  # Number of inputs.
             None,  # Placeholder for pd_start.
@@ -446,20 +765,135 @@ class DllKernel(Kernel):
             call_details.buffer.ctypes.data,  # Problem definition.
             values.ctypes.data,  # Parameter values.
             self.q_input.q.ctypes.data,  # Q values.
-            self.result.ctypes.data,   # Result storage.
+            result.ctypes.data,   # Result storage.
             self._as_dtype(cutoff),  # Probability cutoff.
             radius_effective_mode,  # R_eff mode.
         ]
+        if self.openmp:
+            kernel_args.append(self.num_threads)  # Thread count.
 
         # Call kernel and retrieve results.
         #print("Calling DLL")
         #call_details.show(values)
-        step = 100
         # TODO: Do we need the explicit sleep like the OpenCL and CUDA loops?
-        for start in range(0, call_details.num_eval, step):
-            stop = min(start + step, call_details.num_eval)
+        num_eval = int(call_details.num_eval)
+        start = 0
+        while start < num_eval:
+            stop = min(start + self._chunk_size(), num_eval)
             kernel_args[1:3] = [start, stop]
+            t0 = perf_counter()
             kernel(*kernel_args) # type: ignore
+            self._update_point_time(perf_counter() - t0, stop - start)
+            start = stop
+            if self.progress is not None and self.progress(start, num_eval):
+                raise KernelCancelled("%s cancelled after %d of %d points"
+                                      % (self.info.name, start, num_eval))
+
+    def set_resolution(self, weight_matrix):
+        # type: (Any) -> None
+        Kernel.set_resolution(self, weight_matrix)
+        if self._resolution is None or self.smear is None:
+            self._smear_args = None
+            return
+        # Keep the arrays in the types expected by the dll.  The result of
+        # the stage is the smeared sums followed by the normalization sums.
+        W = self._resolution
+        indptr = np.ascontiguousarray(W.indptr, np.int32)
+        indices = np.ascontiguousarray(W.indices, np.int32)
+        weights = np.ascontiguousarray(W.data, self.dtype)
+        smeared = np.empty(W.shape[0] + 4, self.dtype)
+        self._smear_args = indptr, indices, weights, smeared
+
+    def Iq_smeared(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> np.ndarray
+        if self._smear_args is None:
+            return Kernel.Iq_smeared(self, call_details, values, cutoff,
+                                     magnetic)
+        self._wait_pending()
+        start = perf_counter()
+        self._call_kernel(call_details, values, cutoff, magnetic, 0)
+        elapsed = perf_counter() - start
+        self.stats = self._unpack_stats(self.result, elapsed)
+        profiling.record("kernel", self.info.name, elapsed)
+        with profiling.stage("smear", self.info.name):
+            indptr, indices, weights, smeared = self._smear_args
+            nout = 2 if self.info.have_Fq and self.dim == '1d' else 1
+            self.smear(len(indptr) - 1, self.q_input.nq, nout,
+                       indptr.ctypes.data, indices.ctypes.data,
+                       weights.ctypes.data, self.result.ctypes.data,
+                       smeared.ctypes.data)
+            return self._smeared_Iq(values, smeared)
+
+    def _call_kernel_batch(self, call_details_list, values_matrix, cutoff,
+                           magnetic, radius_effective_mode):
+        # type: (List[CallDetails], np.ndarray, float, bool, int) -> np.ndarray
+        # ctypes releases the GIL while the dll is running, so the rows of
+        # the batch are evaluated in parallel threads, each writing to its
+        # own row of the results.  OpenMP dlls already use the cores for
+        # each row, so they run the rows in turn.  Model caches are thread
+        # local, except with TinyCC, which has no thread local storage.
+        results = np.empty((len(call_details_list), self.result.size),
+                           dtype=self.result.dtype)
+        def run(k):
+            # type: (int) -> None
+            self._call_kernel(call_details_list[k], values_matrix[k], cutoff,
+                              magnetic, radius_effective_mode,
+                              result=results[k])
+        workers = self.num_threads or os.cpu_count() or 1
+        workers = min(workers, len(call_details_list))
+        if self.openmp or workers < 2 or COMPILER == "tinycc":
+            for k in range(len(call_details_list)):
+                run(k)
+        else:
+            with ThreadPoolExecutor(max_workers=workers) as pool:
+                list(pool.map(run, range(len(call_details_list))))
+        return results
+
+    def _call_kernel_async(self, call_details, values, cutoff, magnetic,
+                           radius_effective_mode):
+        # type: (CallDetails, np.ndarray, float, bool, int) -> Callable[[], None]
+        # ctypes releases the GIL while the dll is running, so evaluating
+        # in a thread lets the caller continue with other work.
+        errors = []
+        def run():
+            # type: () -> None
+            try:
+                self._call_kernel(call_details, values, cutoff, magnetic,
+                                  radius_effective_mode)
+            except Exception as exc:
+                errors.append(exc)
+        thread = threading.Thread(target=run)
+        thread.daemon = True
+        thread.start()
+        def wait():
+            # type: () -> None
+            thread.join()
+            if errors:
+                raise errors[0]
+        return wait
+
+    def _chunk_size(self):
+        # type: () -> int
+        """
+        Number of mesh points to evaluate in the next call to the dll.
+        """
+        if self._point_time <= 0.:
+            return max(1, FIRST_CHUNK_WORK//self.q_input.nq)
+        return max(1, int(CHUNK_TIME/self._point_time))
+
+    def _update_point_time(self, elapsed, num_points):
+        # type: (float, int) -> None
+        """
+        Update the cost per mesh point from the time of the last chunk.
+
+        Growth in the chunk size is limited to a factor of 10 per call so
+        that a chunk that was timed too short to measure doesn't lead to
+        a very long next chunk.
+        """
+        point_time = max(elapsed, 1e-6)/num_points
+        if self._point_time > 0.:
+            point_time = max(point_time, 0.1*self._point_time)
+        self._point_time = point_time
 
     def release(self):
         # type: () -> None
@@ -474,3 +908,228 @@ class DllKernel(Kernel):
     def __del__(self):
         # type: () -> None
         self.release()
+
+
+def test_kernel_api():
+    # type: () -> None
+    """
+    Check the C interface from kernel_api.h against the python interface.
+    """
+    from .core import load_model_info
+    from .direct_model import call_kernel
+
+    model_info = load_model_info('cylinder')
+    source = generate.make_source(model_info)['dll']
+    model = load_dll(source, model_info)
+    dll = ct.CDLL(model.dllpath)
+    pars = {'radius': 20., 'length': 400., 'theta': 30., 'phi': 20.,
+            'scale': 1.5, 'background': 0.01}
+    npars = model_info.parameters.npars
+    values = [pars.get(p.id, p.default)
+              for p in model_info.parameters.call_parameters[2:2+npars]]
+    q = np.array([0.005, 0.02, 0.08, 0.2])
+    qx, qy = q, np.array([0.01, 0.0, -0.03, 0.05])
+
+    assert dll.sas_api_version() == 1
+    assert dll.sas_num_pars() == npars
+    dll.sas_problem_new.restype = ct.c_void_p
+    dll.sas_problem_free.argtypes = [ct.c_void_p]
+    dll.sas_set_values.argtypes = [ct.c_void_p, ct.c_double, ct.c_double,
+                                   ct.c_void_p]
+    dll.sas_Iq.argtypes = [ct.c_void_p, ct.c_int32] + [ct.c_void_p]*2
+    dll.sas_Iqxy.argtypes = [ct.c_void_p, ct.c_int32] + [ct.c_void_p]*3
+    problem = dll.sas_problem_new(None)
+    values = np.array(values, 'd')
+    dll.sas_set_values(problem, pars['scale'], pars['background'],
+                       values.ctypes.data)
+    Iq, Iqxy = np.empty(len(q)), np.empty(len(q))
+    assert dll.sas_Iq(problem, len(q), q.ctypes.data, Iq.ctypes.data) == 0
+    assert dll.sas_Iqxy(problem, len(q), qx.ctypes.data, qy.ctypes.data,
+                        Iqxy.ctypes.data) == 0
+    dll.sas_problem_free(problem)
+
+    for q_input, result in (([q], Iq), ([qx, qy], Iqxy)):
+        kernel = model.make_kernel(q_input)
+        expected = call_kernel(kernel, pars)
+        assert np.allclose(result, expected, rtol=1e-12), (result, expected)
+        kernel.release()
+    model.release()
+
+
+def test_kernel_stats():
+    # type: () -> None
+    """
+    Check the counters from the instrumented kernels.
+    """
+    from .core import load_model_info
+    from .direct_model import call_kernel
+
+    # barbell is invalid where radius_bell < radius.
+    model_info = load_model_info('barbell')
+    pars = {'radius_bell': 20., 'radius_bell_pd': 0.3, 'radius_bell_pd_n': 9,
+            'radius': 20., 'length': 400.}
+    q = np.array([0.005, 0.02, 0.08, 0.2])
+    plain = load_dll(generate.make_source(model_info)['dll'], model_info)
+    kernel = plain.make_kernel([q])
+    expected = call_kernel(kernel, pars)
+    assert kernel.stats is None
+    kernel.release()
+    plain.release()
+
+    saved = generate.USE_KERNEL_STATS
+    generate.USE_KERNEL_STATS = True
+    try:
+        source = generate.make_source(model_info)['dll']
+        model = load_dll(source, model_info)
+        kernel = model.make_kernel([q])
+    finally:
+        generate.USE_KERNEL_STATS = saved
+    result = call_kernel(kernel, pars)
+    stats = kernel.stats
+    assert np.allclose(result, expected, rtol=1e-12), (result, expected)
+    assert stats.points == 9 and stats.calls >= 1, stats
+    assert 0 < stats.invalid < stats.points, stats
+    accepted = stats.points - stats.invalid - stats.cutoff
+    assert stats.evaluations == accepted*len(q), stats
+    kernel.release()
+    model.release()
+
+
+def test_gauss_order():
+    # type: () -> None
+    """
+    Check that the gauss rule chosen at run time matches the rule compiled
+    into the model.
+    """
+    from .core import load_model_info
+    from .direct_model import call_kernel
+
+    pars = {'radius': 20., 'length': 400., 'theta': 30., 'phi': 15.}
+    q = np.array([0.005, 0.02, 0.08, 0.2, 0.4])
+    model_info = load_model_info('cylinder')
+    assert generate.gauss_order(model_info) == 76
+    model = load_dll(generate.make_source(model_info)['dll'], model_info,
+                     dtype=F64)
+    kernel = model.make_kernel([q])
+    standard = call_kernel(kernel, pars)
+    model.set_integration_order(20)
+    coarse = call_kernel(kernel, pars)
+    model.set_integration_order(0)
+    assert np.allclose(call_kernel(kernel, pars), standard, rtol=1e-14)
+    assert not np.allclose(coarse, standard, rtol=1e-8)
+    kernel.release()
+    model.release()
+
+    generate.set_integration_size(model_info, 20)
+    fixed = load_dll(generate.make_source(model_info)['dll'], model_info,
+                     dtype=F64)
+    kernel = fixed.make_kernel([q])
+    assert np.allclose(call_kernel(kernel, pars), coarse, rtol=1e-13)
+    kernel.release()
+    fixed.release()
+
+
+def test_setup_stage():
+    # type: () -> None
+    """
+    Check that models with a setup stage build all kernel variants, with
+    and without magnetic parameters.
+    """
+    from .core import load_model_info
+    from .direct_model import call_kernel
+
+    q = np.array([0.005, 0.02, 0.08, 0.2])
+    qx, qy = q, np.array([0.01, 0.0, -0.03, 0.05])
+    # rpa has no magnetic parameters, onion does.
+    for name, pars in (('rpa', {'case_num': 1}),
+                       ('onion', {'sld_core_M0': 2., 'up_frac_i': 0.3})):
+        model_info = load_model_info(name)
+        assert model_info.setup_size, name
+        model = load_dll(generate.make_source(model_info)['dll'], model_info,
+                         dtype=F64)
+        for q_input in ([q], [qx, qy]):
+            kernel = model.make_kernel(q_input)
+            result = call_kernel(kernel, pars)
+            assert np.all(np.isfinite(result)), (name, result)
+            kernel.release()
+        model.release()
+
+
+def test_large_mesh():
+    # type: () -> None
+    """
+    Check that the kernel restarts correctly beyond 2^31 mesh points.
+    """
+    from .core import load_model_info
+    from .details import make_details
+
+    model_info = load_model_info('cylinder')
+    model = load_dll(generate.make_source(model_info)['dll'], model_info,
+                     dtype=F64)
+    q = np.array([0.005, 0.02, 0.08, 0.2])
+    kernel = model.make_kernel([q])
+    parameters = model_info.parameters
+    nvalues, npars, n = parameters.nvalues, parameters.npars, 300
+    defaults = [p.default for p in parameters.kernel_parameters]
+    scalars = np.hstack((1., 0., defaults, np.zeros(nvalues - npars - 2)))
+
+    def details(length):
+        # type: (np.ndarray) -> CallDetails
+        offset = np.cumsum(np.hstack((0, length)))
+        return make_details(model_info, length, offset[:-1], offset[-1])
+    def raw(length, points, start, stop):
+        # type: (np.ndarray, List[Tuple[np.ndarray, np.ndarray]], int, int) -> np.ndarray
+        call_details = details(length)
+        values = np.hstack([scalars] + [v for v, _ in points]
+                           + [w for _, w in points] + [np.zeros(32)])
+        result = np.zeros_like(kernel.result)
+        args = [kernel.q_input.nq, start, stop, call_details.buffer.ctypes.data,
+                values.ctypes.data, kernel.q_input.q.ctypes.data,
+                result.ctypes.data, kernel._as_dtype(0.), 0]
+        if kernel.openmp:
+            args.append(kernel.num_threads)
+        kernel.kernel[0](*args)
+        return result
+
+    # Dispersity in sld, sld_solvent, radius and length gives 300^4 points.
+    # The last 300 are the inner loop with the other levels at their ends.
+    full = [(p.default*np.linspace(0.5, 1.5, n), np.linspace(1., 2., n))
+            for p in parameters.kernel_parameters[:4]]
+    fixed = [(np.array([p.default]), np.ones(1))
+             for p in parameters.kernel_parameters[4:npars]]
+    length = np.array([n]*4 + [1]*(npars - 4))
+    mesh = details(length)
+    assert mesh.num_eval == n**4 > 2**31
+    inner = int(mesh.pd_par[0])
+    last = [(v, w) if k == inner else (v[-1:], w[-1:])
+            for k, (v, w) in enumerate(full)]
+    target = raw(np.array([len(w) for _, w in last + fixed]), last + fixed,
+                 0, n)
+    actual = raw(length, full + fixed, n**4 - n, n**4)
+    assert np.allclose(actual, target, rtol=1e-14, atol=0)
+    kernel.release()
+    model.release()
+
+
+def test_pickle():
+    # type: () -> None
+    """
+    Check that pickled models are restored once per process and that
+    pickled kernels give the same result.
+    """
+    import pickle
+    from .core import load_model_info
+    from .direct_model import call_kernel
+
+    model_info = load_model_info('cylinder')
+    model = load_dll(generate.make_source(model_info)['dll'], model_info,
+                     dtype=F64)
+    q = np.logspace(-3, -1, 10)
+    kernel = model.make_kernel([q])
+    pars = {'radius': 20., 'length': 400., 'radius_pd': 0.1,
+            'radius_pd_n': 10}
+    first, second = pickle.loads(pickle.dumps([model, model]))
+    assert first is second and first is not model
+    assert pickle.loads(pickle.dumps(model)) is first
+    copy = pickle.loads(pickle.dumps(kernel))
+    assert np.array_equal(call_kernel(copy, pars), call_kernel(kernel, pars))
@@ -5,10 +5,18 @@ Calls the kernel with a vector of $q$ values for a single parameter set.
 Polydispersity is supported by looping over different parameter sets and
 summing the results.  The interface to :class:`PyModel` matches those for
 :class:`.kernelcl.GpuModel` and :class:`.kerneldll.DllModel`.
+
+If numba is available and *SAS_NUMBA* is set in the environment, the model
+functions and the dispersity loop are compiled together with numba, so that
+the loop no longer runs in the python interpreter.  The compiled loop is
+generated from the same steps as :func:`_loops`.  Models which numba cannot
+compile, such as those using scipy.special, fall back to :func:`_loops`.
 """
 from __future__ import division, print_function
 
+import os
 import logging
+from types import FunctionType
 
 import numpy as np  # type: ignore
 from numpy import pi
@@ -19,12 +27,17 @@ except ImportError:
         """Return cubed root of x."""
         return x ** (1.0/3.0)
 
+try:
+    from numba import njit
+except ImportError:
+    njit = None
+
 from .generate import F64
 from .kernel import KernelModel, Kernel
 
 # pylint: disable=unused-import
 try:
-    from typing import Union, Callable, List
+    from typing import Union, Callable, List, Dict, Tuple, Optional
     from .details import CallDetails
     from .modelinfo import ModelInfo
 except ImportError:
@@ -33,6 +46,11 @@ except ImportError:
 
 logger = logging.getLogger(__name__)
 
+#: Compile the python models with numba if it is available.  Set
+#: *SAS_NUMBA=1* in the environment to enable it.
+USE_NUMBA = (njit is not None
+             and int(os.environ.get("SAS_NUMBA", "0") or "0") > 0)
+
 
 class PyModel(KernelModel):
     """
@@ -43,12 +61,22 @@ class PyModel(KernelModel):
         _create_default_functions(model_info)
         self.info = model_info
         self.dtype = np.dtype('d')
+        # Compiled dispersity loops for Iq and Iqxy, shared by the kernels.
+        self._mesh_loops = {}  # type: Dict[bool, MeshLoop]
         logger.info("make python model %s", self.info.name)
 
     def make_kernel(self, q_vectors):
         """Instantiate the python kernel with input *q_vectors*"""
         q_input = PyInput(q_vectors, dtype=F64)
-        return PyKernel(self.info, q_input)
+        mesh_loop = None
+        if USE_NUMBA and self.info.setup is None:
+            # Iqxy computed from Iq uses the Iq loop with |q|.
+            is_2d = (q_input.is_2d
+                     and not getattr(self.info.Iqxy, 'from_Iq', False))
+            if is_2d not in self._mesh_loops:
+                self._mesh_loops[is_2d] = MeshLoop(self.info, is_2d, njit)
+            mesh_loop = self._mesh_loops[is_2d]
+        return PyKernel(self.info, q_input, mesh_loop=mesh_loop)
 
     def release(self):
         """
@@ -67,6 +95,11 @@ class PyInput(object):
     stretching the array to better match the memory architecture.  Additional
     points will be evaluated with *q=1e-3*.
 
+    For 2-D data, *q* has shape *(2, width)* with *qx* in the first row and
+    *qy* in the second, each padded to a multiple of 16 values.  This is
+    the layout that the compiled kernels expect (see *QY_OFFSET* in
+    kernel_iq.c), so the same input can be used for dll kernels.
+
     *dtype* is the data type for the q vectors. The data type should be
     set to match that of the kernel, which is an attribute of
     :class:`PyModel`.  Note that not all kernels support double
@@ -81,9 +114,10 @@ class PyInput(object):
         self.dtype = dtype
         self.is_2d = (len(q_vectors) == 2)
         if self.is_2d:
-            self.q = np.empty((self.nq, 2), dtype=dtype)
-            self.q[:, 0] = q_vectors[0]
-            self.q[:, 1] = q_vectors[1]
+            width = ((self.nq+15)//16)*16
+            self.q = np.zeros((2, width), dtype=dtype)
+            self.q[0, :self.nq] = q_vectors[0]
+            self.q[1, :self.nq] = q_vectors[1]
         else:
             self.q = np.empty(self.nq, dtype=dtype)
             self.q[:self.nq] = q_vectors[0]
@@ -106,6 +140,9 @@ class PyKernel(Kernel):
     *q_input* is the DllInput q vectors at which the kernel should be
     evaluated.
 
+    *mesh_loop* is the compiled :class:`MeshLoop` for the model, or None
+    to evaluate the dispersity mesh with :func:`_loops`.
+
     The resulting call method takes the *pars*, a list of values for
     the fixed parameters to the kernel, and *pd_pars*, a list of (value,weight)
     vectors for the polydisperse parameters.  *cutoff* determines the
@@ -114,11 +151,12 @@ class PyKernel(Kernel):
 
     Call :meth:`release` when done with the kernel instance.
     """
-    def __init__(self, model_info, q_input):
-        # type: (ModelInfo, List[np.ndarray]) -> None
+    def __init__(self, model_info, q_input, mesh_loop=None):
+        # type: (ModelInfo, List[np.ndarray], Optional[MeshLoop]) -> None
         self.dtype = np.dtype('d')
         self.info = model_info
         self.q_input = q_input
+        self._mesh_loop = mesh_loop
         self.res = np.empty(q_input.nq, q_input.dtype)
         self.dim = '2d' if q_input.is_2d else '1d'
 
@@ -156,15 +194,22 @@ class PyKernel(Kernel):
         self._parameter_vector = parameter_vector
 
         # Generate a closure which calls the kernel with the views into the
-        # parameter array.
+        # parameter array.  If the model has a setup function then its
+        # result is passed as the last argument.  The form is evaluated for
+        # all q at once, so setup is called once per mesh point.
+        setup = model_info.setup
+        if setup is not None:
+            form_args = lambda: kernel_args + [setup(*kernel_args)]
+        else:
+            form_args = lambda: kernel_args
         if q_input.is_2d:
             form = model_info.Iqxy
-            qx, qy = q_input.q[:, 0], q_input.q[:, 1]
-            self._form = lambda: form(qx, qy, *kernel_args)
+            qx, qy = q_input.q[0, :q_input.nq], q_input.q[1, :q_input.nq]
+            self._form = lambda: form(qx, qy, *form_args())
         else:
             form = model_info.Iq
             q = q_input.q
-            self._form = lambda: form(q, *kernel_args)
+            self._form = lambda: form(q, *form_args())
 
         # Generate a closure which calls the form_volume if it exists.
         self._volume_args = volume_args
@@ -184,6 +229,21 @@ class PyKernel(Kernel):
             raise NotImplementedError("Magnetism not implemented for pure python models")
         #print("Calling python kernel")
         #call_details.show(values)
+        if self._mesh_loop is not None:
+            q_input = self.q_input
+            if not q_input.is_2d:
+                q = (q_input.q,)
+            elif self._mesh_loop.is_2d:
+                q = (q_input.q[0, :q_input.nq], q_input.q[1, :q_input.nq])
+            else:
+                q = (np.sqrt(q_input.q[0, :q_input.nq]**2
+                             + q_input.q[1, :q_input.nq]**2),)
+            result = self._mesh_loop(q, call_details, values, cutoff,
+                                     radius_effective_mode)
+            if result is not None:
+                self.result = result
+                return
+            self._mesh_loop = None
         radius = ((lambda: 0.0) if radius_effective_mode == 0
                   else (lambda: self._radius(radius_effective_mode)))
         self.result = _loops(
@@ -281,6 +341,181 @@ def _loops(parameters, form, form_volume, form_radius, nq, call_details,
     return result
 
 
+_MESH_LOOP_TEMPLATE = """\
+def mesh_loop(%(q)s, values, pd_par, pd_length, pd_offset, pd_stride,
+              num_active, num_eval, num_weights, cutoff, radius_mode):
+    p = values[2:%(nvalues)d].copy()
+    pd_value = values[%(nvalues)d:%(nvalues)d+num_weights]
+    pd_weight = values[%(nvalues)d+num_weights:%(nvalues)d+2*num_weights]
+    nq = len(%(q0)s)
+    result = np.zeros(nq + 4)
+    if num_active == 0:
+        result[:nq] = form(%(form_args)s)
+        result[nq] = 1.0
+        result[nq+1] = %(form_volume)s
+        result[nq+2] = %(shell_volume)s
+        if radius_mode != 0:
+            result[nq+3] = %(radius)s
+        return result
+
+    p0_par = pd_par[0]
+    p0_length = pd_length[0]
+    p0_offset = pd_offset[0]
+    p0_index = p0_length
+    partial_weight = np.nan
+    for loop_index in range(num_eval):
+        # Update polydispersity parameter values.
+        if p0_index == p0_length:
+            partial_weight = 1.0
+            for k in range(num_active):
+                index = pd_offset[k] + (loop_index//pd_stride[k])%%pd_length[k]
+                p[pd_par[k]] = pd_value[index]
+                if k > 0:
+                    partial_weight *= pd_weight[index]
+            p0_index = loop_index%%p0_length
+
+        weight = partial_weight*pd_weight[p0_offset + p0_index]
+        p[p0_par] = pd_value[p0_offset + p0_index]
+        p0_index += 1
+        if weight > cutoff:
+            Iq = form(%(form_args)s)
+            if np.isnan(Iq).any():
+                continue
+            result[:nq] += weight*Iq
+            result[nq] += weight
+            result[nq+1] += weight*(%(form_volume)s)
+            result[nq+2] += weight*(%(shell_volume)s)
+            if radius_mode != 0:
+                result[nq+3] += weight*(%(radius)s)
+    return result
+"""
+
+def _mesh_loop_source(model_info, is_2d):
+    # type: (ModelInfo, bool) -> str
+    """
+    Return the source for the dispersity loop of :func:`_loops` with the
+    model functions called directly on the parameter vector *p*.  The
+    loop for Iqxy is generated if *is_2d*, otherwise the loop for Iq.
+    """
+    partable = model_info.parameters
+    kernel_parameters = partable.iq_parameters
+    volume_parameters = partable.form_volume_parameters
+    offset = 0
+    kernel_args, volume_args = [], []
+    for p in partable.kernel_parameters:
+        if p.length == 1:
+            v = "p[%d]" % offset
+        else:
+            v = "p[%d:%d]" % (offset, offset+p.length)
+        offset += p.length
+        if p in kernel_parameters:
+            kernel_args.append(v)
+        if p in volume_parameters:
+            volume_args.append(v)
+
+    q = ["qx", "qy"] if is_2d else ["q"]
+    volume_args = ", ".join(volume_args)
+    has_volume = model_info.form_volume is not None
+    has_shell = has_volume and model_info.shell_volume is not None
+    form_volume = "form_volume(%s)" % volume_args if has_volume else "1.0"
+    shell_volume = ("shell_volume(%s)" % volume_args if has_shell
+                    else form_volume)
+    radius = (
+        "radius_effective(radius_mode, %s)" % volume_args
+        if model_info.radius_effective is not None
+        else "cbrt(0.75/pi*%s)" % form_volume if has_volume
+        else "1.0")
+    return _MESH_LOOP_TEMPLATE % {
+        'q': ", ".join(q),
+        'q0': q[0],
+        'nvalues': partable.nvalues,
+        'form_args': ", ".join(q + kernel_args),
+        'form_volume': form_volume,
+        'shell_volume': shell_volume,
+        'radius': radius,
+    }
+
+
+def _jit_function(fn, jit, cache):
+    # type: (Callable, Callable, Dict[Callable, Callable]) -> Callable
+    """
+    Compile *fn* with *jit*, first compiling the python functions from the
+    same module that it calls so that numba can call them directly.
+
+    The model module is not changed.  Instead *fn* is copied with its own
+    globals, in which the helper functions are replaced by the compiled
+    versions.  *cache* holds the functions already compiled.
+    """
+    if fn in cache:
+        return cache[fn]
+    namespace = dict(fn.__globals__)
+    compiled = jit(FunctionType(fn.__code__, namespace, fn.__name__,
+                                fn.__defaults__, fn.__closure__))
+    cache[fn] = compiled
+    for name in fn.__code__.co_names:
+        value = namespace.get(name, None)
+        if (isinstance(value, FunctionType)
+                and value.__module__ == fn.__module__):
+            namespace[name] = _jit_function(value, jit, cache)
+    return compiled
+
+
+class MeshLoop(object):
+    """
+    Compiled dispersity loop for the python model *model_info*.
+
+    The model functions and the loop from :func:`_mesh_loop_source` are
+    compiled with *jit*, which is *numba.njit* unless testing.  The loop
+    evaluates Iqxy(qx, qy) if *is_2d*, otherwise Iq(q).
+
+    Numba compiles the functions when the loop is first called.  If the
+    compile fails, or the compiled loop raises an error, then the loop is
+    disabled and the call returns None so that the caller can use
+    :func:`_loops` instead.
+    """
+    def __init__(self, model_info, is_2d, jit):
+        # type: (ModelInfo, bool, Callable) -> None
+        self.info = model_info
+        self.is_2d = is_2d
+        self.source = _mesh_loop_source(model_info, is_2d)
+        cache = {}
+        namespace = {'np': np, 'pi': pi, 'cbrt': cbrt}
+        functions = {
+            'form': model_info.Iqxy if is_2d else model_info.Iq,
+            'form_volume': model_info.form_volume,
+            'shell_volume': model_info.shell_volume,
+            'radius_effective': model_info.radius_effective,
+        }
+        for name, fn in functions.items():
+            if fn is not None:
+                namespace[name] = _jit_function(fn, jit, cache)
+        exec(compile(self.source, "<%s mesh loop>" % model_info.id, "exec"),
+             namespace)
+        self._loop = jit(namespace['mesh_loop'])
+
+    def __call__(self, q, call_details, values, cutoff, radius_effective_mode):
+        # type: (Tuple[np.ndarray, ...], CallDetails, np.ndarray, float, int) -> Optional[np.ndarray]
+        """
+        Evaluate the model at *q*, which is *(q,)* or *(qx, qy)*,
+        returning the same result vector as :func:`_loops`.
+        """
+        if self._loop is None:
+            return None
+        try:
+            return self._loop(
+                *(q + (values, call_details.pd_par, call_details.pd_length,
+                       call_details.pd_offset, call_details.pd_stride,
+                       int(call_details.num_active),
+                       int(call_details.num_eval),
+                       int(call_details.num_weights),
+                       float(cutoff), int(radius_effective_mode))))
+        except Exception as exc:  # pylint: disable=broad-except
+            logger.warning("numba could not compile %s; using numpy loop: %s",
+                           self.info.name, exc)
+            self._loop = None
+            return None
+
+
 def _create_default_functions(model_info):
     """
     Autogenerate missing functions, such as Iqxy from Iq.
@@ -335,4 +570,42 @@ def _create_vector_Iqxy(model_info):
             """
             return Iq(np.sqrt(qx**2 + qy**2), *args)
         default_Iqxy.vectorized = True
+        default_Iqxy.from_Iq = True
         model_info.Iqxy = default_Iqxy
+
+
+def test_mesh_loop():
+    # type: () -> None
+    """
+    Check the generated dispersity loop against :func:`_loops`.
+
+    The loop is run without compiling it so that the test does not need
+    numba.
+    """
+    from .core import load_model_info
+    from .direct_model import call_kernel, call_Fq
+
+    model_info = load_model_info('_spherepy')
+    model = PyModel(model_info)
+    pars = {'radius': 40., 'radius_pd': 0.2, 'radius_pd_n': 11,
+            'sld': 2., 'sld_pd': 0.1, 'sld_pd_n': 5, 'background': 0.1}
+    q = np.logspace(-3, -1, 20)
+    qx, qy = np.linspace(-0.1, 0.1, 9), np.linspace(0.1, -0.05, 9)
+    def evaluate(kernel):
+        results = [call_kernel(kernel, pars),
+                   call_kernel(kernel, pars, mono=True)]
+        if kernel.dim == '1d':
+            fq_pars = dict(pars, radius_effective_mode=1)
+            results.append(call_Fq(kernel, fq_pars)[1:3])  # F^2, R_eff
+        return results
+    for q_vectors in ([q], [qx, qy]):
+        kernel = model.make_kernel(q_vectors)
+        kernel._mesh_loop = None
+        expected = evaluate(kernel)
+        # Iqxy is computed from Iq, so 2D uses the Iq loop with |q|.
+        kernel._mesh_loop = MeshLoop(model_info, False, lambda fn: fn)
+        actual = evaluate(kernel)
+        assert kernel._mesh_loop is not None
+        for a, b in zip(actual, expected):
+            assert np.allclose(np.hstack(a), np.hstack(b), rtol=1e-14), (a, b)
+        kernel.release()
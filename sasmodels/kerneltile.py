@@ -0,0 +1,190 @@
+"""
+Tiled kernels for large q sets
+==============================
+
+The compute engines hold the q vectors and the result for every q value in
+device memory for the life of the kernel.  Large 2-D detectors, especially
+after :class:`.resolution2d.Pinhole2D` expands each pixel into several q
+points, may need more memory than the device has.  :class:`TiledKernel`
+keeps q on the host instead, and evaluates it in tiles, with a kernel for
+each tile created when the tile is needed and released once its result is
+copied back.  The next tile is queued before waiting for the current one,
+so the transfer of q for one tile overlaps the calculation of the other.
+
+The normalization sums at the end of the result vector (total weight,
+volumes and effective radius) do not depend on q, so they come from the
+first tile, and the per-tile results for F and F^2 are copied into place.
+The returned values are the same as for a single kernel.
+
+The GPU engines pick the tile size from the device memory, using at most
+:data:`MEMORY_FRACTION` of it for the two tiles in flight.  Set
+*SAS_TILE_SIZE* to the number of q values per tile to force tiling on any
+engine, including the DLLs.
+"""
+from __future__ import division, print_function
+
+import os
+
+import numpy as np  # type: ignore
+
+from . import generate
+from .kernel import Kernel, KERNEL_STATS, input_vectors
+from .kernelpy import PyInput
+
+# pylint: disable=unused-import
+try:
+    from typing import Callable, List, Optional, Tuple
+    from .details import CallDetails
+    from .kernel import KernelModel
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Number of q values in each tile, or 0 to size the tiles from the device
+#: memory.
+TILE_SIZE = int(os.environ.get("SAS_TILE_SIZE", "0") or "0")
+
+#: Fraction of the device memory to use for q and results.
+MEMORY_FRACTION = 0.25
+
+#: Tiles are a multiple of this many q values, which keeps the padding of
+#: each tile the same as for the full vector.
+TILE_QUANTUM = 1024
+
+#: Counters in :data:`.kernel.KERNEL_STATS` which add over tiles.  The
+#: others count mesh points, which are the same for every tile.
+_SUMMED_STATS = [KERNEL_STATS.index(name) for name in ("calls", "evaluations")]
+
+
+def tile_size(q_vectors, dtype, memory=0):
+    # type: (List[np.ndarray], np.dtype, int) -> int
+    """
+    Return the number of q values per tile for a kernel on *q_vectors*,
+    or 0 if the vectors fit in one kernel.
+
+    *memory* is the device memory in bytes, or 0 if there is no limit
+    other than *SAS_TILE_SIZE*.
+    """
+    nq = q_vectors[0].size
+    if TILE_SIZE > 0:
+        size = TILE_SIZE
+    elif memory > 0:
+        # Each q value needs its q vectors and up to two result values,
+        # and two tiles can be on the device at once.
+        per_q = (len(q_vectors) + 2)*np.dtype(dtype).itemsize
+        size = int(MEMORY_FRACTION*memory)//(2*per_q)
+    else:
+        return 0
+    size = max((size//TILE_QUANTUM)*TILE_QUANTUM, TILE_QUANTUM)
+    return size if nq > size else 0
+
+
+class TiledKernel(Kernel):
+    """
+    Kernel which evaluates *q_vectors* in tiles of *tile* values.
+
+    *make_tile(q_vectors)* returns the kernel for one tile.  The kernels
+    must come from *model*, without tiling, and must accept the flat mesh
+    if *supports_flat* is True.
+
+    Call :meth:`release` when done with the kernel.
+    """
+    def __init__(self, model, q_vectors, tile, make_tile, supports_flat):
+        # type: (KernelModel, List[np.ndarray], int, Callable[[List[np.ndarray]], Kernel], bool) -> None
+        self._model = model
+        self._make_tile = make_tile
+        self.q_input = PyInput(q_vectors, model.dtype)
+        self.info = model.info
+        self.dtype = model.dtype
+        self.dim = '2d' if self.q_input.is_2d else '1d'
+        self.supports_flat = supports_flat
+        nq = self.q_input.nq
+        self._tiles = [(start, min(start + tile, nq))
+                       for start in range(0, nq, tile)]
+
+        nout = 2 if self.info.have_Fq and self.dim == '1d' else 1
+        extra_q = 4  # Total weight, form volume, shell volume and R_eff.
+        if generate.USE_KERNEL_STATS:
+            self._num_stats = generate.NUM_KERNEL_STATS
+            extra_q += self._num_stats
+        self._nout = nout
+        self.result = np.empty(nq*nout + extra_q, self.dtype)
+
+    def _call_kernel(self, call_details, values, cutoff, magnetic,
+                     radius_effective_mode):
+        # type: (CallDetails, np.ndarray, float, bool, int) -> None
+        vectors = input_vectors(self.q_input)
+        pending = None  # type: Optional[Tuple[Kernel, Callable[[], None], int, int]]
+        for start, stop in self._tiles:
+            kernel = self._make_tile([v[start:stop] for v in vectors])
+            wait = kernel._call_kernel_async(
+                call_details, values, cutoff, magnetic, radius_effective_mode)
+            if pending is not None:
+                self._collect(*pending)
+            pending = kernel, wait, start, stop
+        self._collect(*pending)
+
+    def _collect(self, kernel, wait, start, stop):
+        # type: (Kernel, Callable[[], None], int, int) -> None
+        """
+        Wait for the tile *kernel* covering q values *start* to *stop* and
+        copy its result into place.
+        """
+        try:
+            wait()
+            nout, nq = self._nout, self.q_input.nq
+            tile_end = nout*(stop - start)
+            self.result[nout*start:nout*stop] = kernel.result[:tile_end]
+            tail = kernel.result[tile_end:tile_end + 4 + self._num_stats]
+            if start == 0:
+                self.result[nout*nq:] = tail
+            elif self._num_stats:
+                for k in _SUMMED_STATS:
+                    self.result[nout*nq + 4 + k] += tail[4 + k]
+        finally:
+            kernel.release()
+
+    def release(self):
+        # type: () -> None
+        """
+        Free resources associated with the kernel instance.
+        """
+        self.q_input.release()
+
+
+def test_tiled_kernel():
+    # type: () -> None
+    """
+    Check that tiled kernels match the untiled kernel on 1-D and 2-D data.
+    """
+    from .core import load_model_info
+    from .direct_model import call_kernel
+    from .kerneldll import load_dll
+    global TILE_SIZE
+
+    saved, TILE_SIZE = TILE_SIZE, 0
+    try:
+        assert tile_size([np.empty(5000)], 'd') == 0
+        assert tile_size([np.empty(2000)], 'f', memory=2**30) == 0
+        assert tile_size([np.empty(10**8)]*2, 'f', memory=2**30) == 2**23
+        TILE_SIZE = 1500
+        assert tile_size([np.empty(5000)], 'd') == TILE_QUANTUM
+    finally:
+        TILE_SIZE = saved
+
+    model_info = load_model_info('cylinder')
+    model = load_dll(generate.make_source(model_info)['dll'], model_info,
+                     dtype=generate.F64)
+    pars = {'radius': 20., 'length': 300., 'radius_pd': 0.1,
+            'radius_pd_n': 5, 'theta': 30., 'phi': 20.}
+    q = np.linspace(0.001, 0.3, 2500)
+    for q_vectors in ([q], [q, q[::-1]]):
+        direct = model._make_kernel(q_vectors)
+        tiled = TiledKernel(model, q_vectors, TILE_QUANTUM,
+                            model._make_kernel, direct.supports_flat)
+        assert len(tiled._tiles) == 3
+        expected = call_kernel(direct, pars)
+        actual = call_kernel(tiled, pars)
+        assert np.allclose(actual, expected, rtol=1e-14, atol=0)
+        direct.release()
+        tiled.release()
@@ -9,18 +9,28 @@ and the module evaluator (with call, release, etc.).
 
 To use it, first load form factor P and structure factor S, then create
 *ProductModel(P, S)*.
+
+When all the parts are C models they are also compiled together into a
+single kernel which evaluates every component in the same q loop.  This
+is used for calls without polydispersity, where each component is
+evaluated at a single point in parameter space.  See :func:`make_fused_info`.
 """
 from __future__ import print_function
 
+import sys
+import logging
 from copy import copy
 from collections import OrderedDict
 
 import numpy as np  # type: ignore
 
+from . import profiling
 from .modelinfo import Parameter, ParameterTable, ModelInfo
 from .modelinfo import NUM_MAGFIELD_PARS, NUM_MAGNETIC_PARS, NUM_COMMON_PARS
-from .kernel import KernelModel, Kernel
-from .details import make_details
+from .modelinfo import NUM_SPIN_VALUES
+from .kernel import KernelModel, Kernel, KernelFuture
+from .details import make_details, dependency_key
+from .generate import model_sources, gpu_setup_size
 
 # pylint: disable=unused-import
 try:
@@ -30,6 +40,8 @@ except ImportError:
     pass
 # pylint: enable=unused-import
 
+logger = logging.getLogger(__name__)
+
 def make_mixture_info(parts, operation='+'):
     # type: (List[ModelInfo], str) -> ModelInfo
     """
@@ -152,15 +164,93 @@ def make_mixture_info(parts, operation='+'):
     return model_info
 
 
+def can_fuse(parts):
+    # type: (List[ModelInfo]) -> bool
+    """
+    Return True if the *parts* of a mixture can be compiled into a single
+    fused kernel.
+
+    The parts must be C models which are not themselves compositions and
+    which are not reparameterized, since the fused kernel calls the part
+    model functions directly.
+    """
+    return all(part.composition is None and not callable(part.Iq)
+               and not part.translation for part in parts)
+
+def make_fused_info(model_info):
+    # type: (ModelInfo) -> Optional[ModelInfo]
+    """
+    Create the info block for a mixture compiled into a single kernel, or
+    None if the parts cannot be fused.
+
+    The fused model uses a copy of the mixture parameter table, so it
+    accepts the mixture values unchanged.  None of the parameters are
+    volume or orientation parameters of the fused model.  Each component
+    is normalized by its own volume, and oriented components are rotated
+    in the generated *Iqxy*, which is only correct in the absence of
+    polydispersity.  The kernel source is built by
+    :func:`.generate.make_source`.
+    """
+    parts = model_info.composition[1]
+    if not can_fuse(parts):
+        return None
+    pars = []
+    for par in model_info.parameters.kernel_parameters:
+        if par.type in ('volume', 'orientation'):
+            par = copy(par)
+            par.type = ''
+        pars.append(par)
+    parameters = ParameterTable(pars)
+
+    fused_id = '_'.join(part.id for part in parts) + '_mixture'
+    sources = []  # type: List[str]
+    for part in parts:
+        sources.extend(f for f in model_sources(part) if f not in sources)
+
+    fused_info = ModelInfo()
+    fused_info.id = fused_info.name = fused_id
+    fused_info.operation = model_info.operation
+    fused_info.filename = None
+    fused_info.basefile = parts[0].basefile
+    fused_info.title = model_info.title
+    fused_info.description = model_info.description
+    fused_info.docs = model_info.docs
+    fused_info.category = model_info.category
+    fused_info.parameters = fused_info.base = parameters
+    fused_info.translation = None
+    fused_info.composition = ('fused_mixture', parts)
+    fused_info.structure_factor = False
+    fused_info.have_Fq = False
+    fused_info.setup_size = sum(part.setup_size for part in parts)
+    fused_info.gpu_setup_size = sum(gpu_setup_size(part) for part in parts)
+    fused_info.source = sources
+    fused_info.c_code = None
+    # Part validity is checked for each component in the kernel.
+    fused_info.valid = ''
+    fused_info.form_volume = fused_info.shell_volume = None
+    fused_info.radius_effective_modes = None
+    fused_info.Iq = fused_info.Iqxy = None
+    fused_info.Iqac = fused_info.Iqabc = None
+    fused_info.lineno = {}
+    fused_info.single = all(part.single for part in parts)
+    fused_info.opencl = all(part.opencl for part in parts)
+    fused_info.hidden = False
+    return fused_info
+
+
 class MixtureModel(KernelModel):
     """
     Model definition for mixture of models.
     """
-    def __init__(self, model_info, parts):
-        # type: (ModelInfo, List[KernelModel]) -> None
+    def __init__(self, model_info, parts, fused=None):
+        # type: (ModelInfo, List[KernelModel], Optional[Callable[[], KernelModel]]) -> None
         self.info = model_info
         self.parts = parts
         self.dtype = parts[0].dtype
+        # Builder for the mixture compiled as a single model.  It is only
+        # compiled when first needed for a call without polydispersity.
+        self._fused_builder = fused
+        self._fused = None  # type: Optional[KernelModel]
 
     def make_kernel(self, q_vectors):
         # type: (List[np.ndarray]) -> MixtureKernel
@@ -171,14 +261,30 @@ class MixtureModel(KernelModel):
         # in opencl; or both in opencl, but one in single precision and the
         # other in double precision).
         kernels = [part.make_kernel(q_vectors) for part in self.parts]
-        return MixtureKernel(self.info, kernels, q_vectors)
+        make_fused = (None if self._fused_builder is None
+                      else lambda: self.fused.make_kernel(q_vectors))
+        return MixtureKernel(self.info, kernels, q_vectors, make_fused)
     make_kernel.__doc__ = KernelModel.make_kernel.__doc__
 
+    @property
+    def fused(self):
+        # type: () -> KernelModel
+        """
+        The mixture compiled as a single model, or None if the parts
+        cannot be fused.
+        """
+        if self._fused is None and self._fused_builder is not None:
+            self._fused = self._fused_builder()
+        return self._fused
+
     def release(self):
         # type: () -> None
         """Free resources associated with the model."""
         for part in self.parts:
             part.release()
+        if self._fused is not None:
+            self._fused.release()
+            self._fused = None
     release.__doc__ = KernelModel.release.__doc__
 
 
@@ -196,12 +302,26 @@ def _intermediates(q, results):
     return parts
 
 
+def _compile_errors():
+    # type: () -> Tuple[type, ...]
+    """
+    Return the exceptions raised by the loaded kernel modules when the
+    model source fails to compile.
+    """
+    errors = []  # type: List[type]
+    for name in ("kerneldll", "kernelcl", "kernelcuda"):
+        module = sys.modules.get(__package__ + "." + name)
+        if module is not None:
+            errors.extend(module.COMPILE_ERRORS)
+    return tuple(errors)
+
+
 class MixtureKernel(Kernel):
     """
     Instantiated kernel for mixture of models.
     """
-    def __init__(self, model_info, kernels, q):
-        # type: (ModelInfo, List[Kernel], Tuple[np.ndarray]) -> None
+    def __init__(self, model_info, kernels, q, make_fused=None):
+        # type: (ModelInfo, List[Kernel], Tuple[np.ndarray], Optional[Callable[[], Kernel]]) -> None
         self.dim = kernels[0].dim
         self.info = model_info
         self.q = q
@@ -209,40 +329,137 @@ class MixtureKernel(Kernel):
         self.dtype = self.kernels[0].dtype
         self.operation = model_info.operation
         self.results = None  # type: Callable[[], OrderedDict]
+        # Inputs and outputs for each part from the previous call, so that
+        # parts whose parameters haven't changed are not computed again.
+        self._part_cache = [None]*len(kernels)  # type: List[Tuple[Any, np.ndarray, Any]]
+        self._make_fused = make_fused
+        self._fused_kernel = None  # type: Optional[Kernel]
 
     def Iq(self, call_details, values, cutoff, magnetic):
         # type: (CallDetails, np.ndarray, np.ndarray, float, bool) -> np.ndarray
-        scale, background = values[0:2]
-        total = 0.0
-        # remember the parts for plotting later
-        results = []
-        parts = _MixtureParts(self.info, self.kernels, call_details, values)
-        for kernel, kernel_details, kernel_values in parts:
-            #print("calling kernel", kernel.info.name)
-            result = kernel(kernel_details, kernel_values, cutoff, magnetic)
-            result = np.array(result).astype(kernel.dtype)
-            # print(kernel.info.name, result)
-            if self.operation == '+':
-                total += result
-            elif self.operation == '*':
-                if np.all(total) == 0.0:
-                    total = result
-                else:
-                    total *= result
-            results.append((kernel, result, getattr(kernel, 'results', None)))
-
-        self.results = lambda: _intermediates(self.q, results)
-
-        return scale*total + background
+        return self.Iq_async(call_details, values, cutoff, magnetic).result()
 
     Iq.__doc__ = Kernel.Iq.__doc__
     __call__ = Iq
 
+    def Iq_async(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> KernelFuture
+        # Without polydispersity the parts can share a single kernel call.
+        if call_details.num_active == 0 and self._make_fused is not None:
+            if self._fused_kernel is not None:
+                return self._fused_Iq_async(call_details, values, cutoff,
+                                            magnetic)
+            # The kernel may only be compiled when it is first called, so
+            # the first call is also checked.  Fall back to the separate
+            # part kernels if the fused source doesn't compile, for example
+            # because two parts define the same helper function.
+            try:
+                self._fused_kernel = self._make_fused()
+                return self._fused_Iq_async(call_details, values, cutoff,
+                                            magnetic)
+            except _compile_errors() as exc:
+                logger.warning("using separate kernels for %s: %s",
+                               self.info.name, exc)
+                self._make_fused = None
+                if self._fused_kernel is not None:
+                    self._fused_kernel.release()
+                    self._fused_kernel = None
+        return self._parts_Iq_async(call_details, values, cutoff, magnetic)
+
+    Iq_async.__doc__ = Kernel.Iq_async.__doc__
+
+    def _fused_Iq_async(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> KernelFuture
+        """
+        Evaluate all the parts in one call to the fused mixture kernel.
+
+        The individual parts are only computed if the intermediate results
+        are requested.
+        """
+        kernel = self._fused_kernel
+        details = make_details(kernel.info, call_details.length,
+                               call_details.offset, call_details.num_weights)
+        fused_values = values.astype(kernel.dtype)
+        fused_values[0], fused_values[1] = 1., 0.
+        future = kernel.Iq_async(details, fused_values, cutoff, magnetic)
+        inputs = (call_details, values.copy(), cutoff, magnetic)
+
+        def finish():
+            # type: () -> np.ndarray
+            scale, background = values[0:2]
+            def results():
+                # type: () -> OrderedDict[str, Any]
+                self._parts_Iq_async(*inputs).result()
+                return self.results()
+            self.results = results
+            return scale*future.result() + background
+        return KernelFuture(finish)
+
+    def _parts_Iq_async(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> KernelFuture
+        """
+        Evaluate each part in its own kernel and combine the results.
+        """
+        # Start all the parts before waiting on any of them so that they
+        # run concurrently.
+        futures = []
+        parts = _MixtureParts(self.info, self.kernels, call_details, values)
+        for k, (kernel, kernel_details, kernel_values, part_scale) \
+                in enumerate(parts):
+            key = (dependency_key(kernel_details, kernel_values,
+                                  kernel.info.parameters.nvalues),
+                   cutoff, magnetic)
+            cached = self._part_cache[k]
+            if cached is not None and cached[0] == key:
+                future = None
+            else:
+                #print("calling kernel", kernel.info.name)
+                self._part_cache[k] = None
+                future = kernel.Iq_async(kernel_details, kernel_values, cutoff,
+                                         magnetic)
+            futures.append((k, kernel, key, part_scale, future))
+
+        def finish():
+            # type: () -> np.ndarray
+            scale, background = values[0:2]
+            for k, kernel, key, part_scale, future in futures:
+                if future is not None:
+                    result = np.array(future.result()).astype(kernel.dtype)
+                    self._part_cache[k] = (
+                        key, result, getattr(kernel, 'results', None))
+
+            with profiling.stage("combine", self.info.name):
+                total = 0.0
+                # remember the parts for plotting later
+                results = []
+                for k, kernel, key, part_scale, future in futures:
+                    _, result, intermediates = self._part_cache[k]
+                    # Parts are computed with scale=1 so that the cached
+                    # result can be reused when only the part scale changes.
+                    result = part_scale*result
+                    # print(kernel.info.name, result)
+                    if self.operation == '+':
+                        total += result
+                    elif self.operation == '*':
+                        if np.all(total) == 0.0:
+                            total = result
+                        else:
+                            total *= result
+                    results.append((kernel, result, intermediates))
+
+            self.results = lambda: _intermediates(self.q, results)
+
+            return scale*total + background
+        return KernelFuture(finish)
+
     def release(self):
         # type: () -> None
         """Free resources associated with the kernel."""
         for k in self.kernels:
             k.release()
+        if self._fused_kernel is not None:
+            self._fused_kernel.release()
+            self._fused_kernel = None
 
 
 # Note: _MixtureParts doesn't implement iteration correctly, and only allows
@@ -275,7 +492,7 @@ class _MixtureParts(object):
         return self
 
     def __next__(self):
-        # type: () -> Tuple[List[Callable], CallDetails, np.ndarray]
+        # type: () -> Tuple[Kernel, CallDetails, np.ndarray, float]
         if self.part_num >= len(self.parts):
             raise StopIteration()
         info = self.parts[self.part_num]
@@ -283,6 +500,10 @@ class _MixtureParts(object):
         call_details = self._part_details(info, self.par_index)
         values = self._part_values(info, self.par_index, self.mag_index)
         values = values.astype(kernel.dtype)
+        # Each constituent of an addition model has its own scale factor.
+        # This is applied to the result rather than sent to the kernel.
+        scale = (self.values[self.par_index] if self.model_info.operation == '+'
+                 else 1.0)
         #call_details.show(values)
 
         self.part_num += 1
@@ -291,7 +512,7 @@ class _MixtureParts(object):
             self.par_index += 1 # Account for each constituent model's scale param
         self.mag_index += NUM_MAGNETIC_PARS*len(info.parameters.magnetism_index)
 
-        return kernel, call_details, values
+        return kernel, call_details, values, scale
 
     # CRUFT: py2 support
     next = __next__
@@ -317,8 +538,9 @@ class _MixtureParts(object):
 
     def _part_values(self, info, par_index, mag_index):
         # type: (ModelInfo, int, int) -> np.ndarray
-        # Set each constituent model's scale to 1 if this is a multiplication model
-        scale = self.values[par_index] if self.model_info.operation == '+' else 1.0
+        # Each constituent model's scale is set to 1; for addition models the
+        # scale is applied to the result by the caller.
+        scale = 1.0
         diff = 1 if self.model_info.operation == '+' else 0 # Skip scale if addition model
         pars = self.values[par_index + diff:par_index + info.parameters.npars + diff]
         nmagnetic = len(info.parameters.magnetism_index)
@@ -331,8 +553,12 @@ class _MixtureParts(object):
         nvalues = self.model_info.parameters.nvalues
         nweights = self.call_details.num_weights
         weights = self.values[nvalues:nvalues+2*nweights]
+        # The derived polarization values follow the weights.
+        spin_start = nvalues + 2*nweights
+        spin_values = (self.values[spin_start:spin_start + NUM_SPIN_VALUES]
+                       if nmagnetic else [])
         zero = self.values.dtype.type(0.)
-        values = [[scale, zero], pars, spin_state, mag_index, weights]
+        values = [[scale, zero], pars, spin_state, mag_index, weights, spin_values]
         # Pad value array to a 32 value boundary
         spacer = (32 - sum(len(v) for v in values)%32)%32
         values.append([zero]*spacer)
@@ -0,0 +1,328 @@
+"""
+Model index
+===========
+
+Listing the models by kind, or building the model menus in SasView, needs
+the name, category and parameters of every model.  Importing each model
+module to get them takes seconds, most of it spent on models that are
+never used.  Instead, the metadata for each standard model is kept in an
+index, and the module is only imported when the model is first evaluated.
+
+Each entry records the files that define the model (the model module,
+the base module for reparameterized models, and the C sources), along with
+a hash of their contents.  An entry is rebuilt whenever the hash changes,
+so editing a model or one of its sources is picked up on the next run.
+The hashes are checked once per session.
+
+The index is stored in *SAS_MODEL_INDEX_PATH*, which defaults to
+*~/.sasmodels/model_index.json*.  Set *SAS_MODEL_INDEX=0* to import the
+models directly instead.
+
+Use :func:`summary` or :func:`summaries` to get a :class:`ModelSummary`,
+which has the attributes of :class:`.modelinfo.ModelInfo` needed to
+describe a model.  Use :func:`.core.load_model_info` for the full info.
+"""
+from __future__ import print_function
+
+import os
+from os.path import join as joinpath, exists, dirname, relpath
+import hashlib
+import json
+import logging
+import tempfile
+import threading
+import traceback
+
+from . import generate
+from . import modelinfo
+
+# pylint: disable=unused-import
+try:
+    from typing import Any, Dict, List, Optional
+    from .modelinfo import ModelInfo, ParameterTable
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+logger = logging.getLogger(__name__)
+
+#: Use the model index for metadata queries.
+USE_INDEX = os.environ.get("SAS_MODEL_INDEX", "1") not in ("", "0")
+
+if "SAS_MODEL_INDEX_PATH" in os.environ:
+    SAS_MODEL_INDEX_PATH = os.environ["SAS_MODEL_INDEX_PATH"]
+else:
+    SAS_MODEL_INDEX_PATH = joinpath(
+        os.path.expanduser("~"), ".sasmodels", "model_index.json")
+
+#: Version of the index format.  Index files with a different version are
+#: rebuilt.
+INDEX_VERSION = 1
+
+#: Record fields which are copied directly to the :class:`ModelSummary`.
+_SUMMARY_FIELDS = (
+    "id", "name", "title", "description", "category", "structure_factor",
+    "radius_effective_modes", "have_Fq", "single", "opencl", "python",
+    "profile_axes",
+    )
+
+_TABLE = None  # type: Optional[Dict[str, Dict[str, Any]]]
+_CHECKED = set()  # type: set
+_LOCK = threading.Lock()
+
+
+class ModelSummary(object):
+    """
+    Model metadata from the index.
+
+    The attributes match those of :class:`.modelinfo.ModelInfo`, except for
+    *python*, which is True for models with *Iq* defined in python, and
+    *profile*, which is True rather than a function for models with a
+    profile.  Functions, C code, docs and tests are not available.
+    """
+    #: Full path to the file defining the model.
+    filename = None       # type: str
+    #: Parameter table rebuilt from the parameter definitions.
+    parameters = None     # type: ParameterTable
+    #: True if the model has a profile function, or None.
+    profile = None        # type: Optional[bool]
+    #: Hash of the files defining the model.
+    hash = None           # type: str
+
+    def __init__(self, record):
+        # type: (Dict[str, Any]) -> None
+        for field in _SUMMARY_FIELDS:
+            setattr(self, field, record[field])
+        self.filename = joinpath(generate.MODEL_PATH, record["files"][0])
+        self.profile = True if record["profile"] else None
+        self.hash = record["hash"]
+        self.parameters = _parameter_table(record)
+
+    def __repr__(self):
+        # type: () -> str
+        return "ModelSummary(%r)" % self.id
+
+
+def _parameter_table(record):
+    # type: (Dict[str, Any]) -> ParameterTable
+    table = modelinfo.make_parameter_table(record["parameters"])
+    if record["structure_factor"]:
+        table.set_zero_background()
+    if record["control"] is not None:
+        table[record["control"]].is_control = True
+    return table
+
+
+def _definition(p):
+    # type: (modelinfo.Parameter) -> List[Any]
+    limits = [list(p.choices)] if p.choices else list(p.limits)
+    return [p.name, p.units, p.default, limits, p.type, p.description]
+
+
+def _model_files(model_info):
+    # type: (ModelInfo) -> List[str]
+    """
+    Return the files defining *model_info*, relative to the model path.
+    """
+    paths = [model_info.filename, model_info.basefile]
+    paths.extend(generate.model_sources(model_info))
+    files = []  # type: List[str]
+    for path in paths:
+        name = relpath(path, generate.MODEL_PATH).replace(os.sep, "/")
+        if name not in files:
+            files.append(name)
+    return files
+
+
+def _digest(files):
+    # type: (List[str]) -> Optional[str]
+    """
+    Return the hash of the contents of *files*, or None if any are missing.
+    """
+    digest = hashlib.sha1()
+    for name in files:
+        path = joinpath(generate.MODEL_PATH, name)
+        if not exists(path):
+            return None
+        with open(path, "rb") as fid:
+            digest.update(name.encode("utf-8") + b"\0" + fid.read() + b"\0")
+    return digest.hexdigest()
+
+
+def summarize(model_info):
+    # type: (ModelInfo) -> Dict[str, Any]
+    """
+    Return the index record for *model_info*.
+    """
+    pars = model_info.parameters.kernel_parameters
+    files = _model_files(model_info)
+    modes = model_info.radius_effective_modes
+    return {
+        "files": files,
+        "hash": _digest(files),
+        "id": model_info.id,
+        "name": model_info.name,
+        "title": model_info.title,
+        "description": model_info.description,
+        "category": model_info.category,
+        "structure_factor": bool(model_info.structure_factor),
+        "radius_effective_modes": list(modes) if modes is not None else None,
+        "have_Fq": bool(model_info.have_Fq),
+        "single": bool(model_info.single),
+        "opencl": bool(model_info.opencl),
+        "python": callable(model_info.Iq),
+        "profile": model_info.profile is not None,
+        "profile_axes": list(model_info.profile_axes),
+        "control": next((p.id for p in pars if p.is_control), None),
+        "parameters": [_definition(p) for p in pars],
+        }
+
+
+def _table():
+    # type: () -> Dict[str, Dict[str, Any]]
+    global _TABLE
+    if _TABLE is None:
+        _TABLE = _load(SAS_MODEL_INDEX_PATH)
+    return _TABLE
+
+
+def _load(path):
+    # type: (str) -> Dict[str, Dict[str, Any]]
+    if not exists(path):
+        return {}
+    try:
+        with open(path) as fid:
+            index = json.load(fid)
+        if index.get("version") != INDEX_VERSION:
+            return {}
+        return dict(index["models"])
+    except Exception as exc:
+        logger.warning("ignoring model index %r: %s", path, exc)
+        return {}
+
+
+def _save(path, table):
+    # type: (str, Dict[str, Dict[str, Any]]) -> None
+    """
+    Replace the index file atomically so that concurrent processes never
+    see a partial file.  Failure to write the file is logged and the index
+    is kept for the rest of the session.
+    """
+    try:
+        os.makedirs(dirname(os.path.abspath(path)), exist_ok=True)
+        fd, tmp = tempfile.mkstemp(dir=dirname(os.path.abspath(path)),
+                                   suffix=".tmp")
+        try:
+            with os.fdopen(fd, "w") as fid:
+                json.dump({"version": INDEX_VERSION, "models": table}, fid,
+                          indent=1, sort_keys=True)
+            os.replace(tmp, path)
+        except Exception:
+            os.unlink(tmp)
+            raise
+    except Exception as exc:
+        logger.warning("could not save model index %r: %s", path, exc)
+
+
+def _import_info(name):
+    # type: (str) -> ModelInfo
+    return modelinfo.make_model_info(generate.load_kernel_module(name))
+
+
+def summaries(names, strict=False):
+    # type: (List[str], bool) -> Dict[str, ModelSummary]
+    """
+    Return the :class:`ModelSummary` for each of the standard models in
+    *names*, importing only those which are new or have changed.
+
+    Models which fail to load are logged and left out, or raise the error
+    if *strict* is True.
+    """
+    if not USE_INDEX:
+        result = {}
+        for name in names:
+            try:
+                result[name] = ModelSummary(summarize(_import_info(name)))
+            except Exception:
+                if strict:
+                    raise
+                logger.error(traceback.format_exc())
+        return result
+
+    with _LOCK:
+        table = _table()
+        changed = False
+        result = {}
+        try:
+            for name in names:
+                record = table.get(name, None)
+                if (name not in _CHECKED and record is not None
+                        and _digest(record["files"]) != record["hash"]):
+                    record = None
+                if record is None:
+                    try:
+                        record = summarize(_import_info(name))
+                    except Exception:
+                        if strict:
+                            raise
+                        logger.error(traceback.format_exc())
+                        continue
+                    table[name] = record
+                    changed = True
+                _CHECKED.add(name)
+                result[name] = ModelSummary(record)
+        finally:
+            if changed:
+                # Merge with entries written by other processes.
+                merged = _load(SAS_MODEL_INDEX_PATH)
+                merged.update(table)
+                _save(SAS_MODEL_INDEX_PATH, merged)
+        return result
+
+
+def summary(name):
+    # type: (str) -> ModelSummary
+    """
+    Return the :class:`ModelSummary` for the standard model *name*.
+    """
+    return summaries([name], strict=True)[name]
+
+
+def test_model_index():
+    # type: () -> None
+    """
+    Check that the index matches the model info and is reused.
+    """
+    import shutil
+    global SAS_MODEL_INDEX_PATH, _TABLE, _CHECKED
+    saved = SAS_MODEL_INDEX_PATH, _TABLE, _CHECKED
+    cache_dir = tempfile.mkdtemp()
+    SAS_MODEL_INDEX_PATH = joinpath(cache_dir, "index.json")
+    _TABLE, _CHECKED = None, set()
+    try:
+        names = ["cylinder", "hardsphere", "rpa", "spherical_sld"]
+        found = summaries(names + ["not_a_model"])
+        assert sorted(found) == names
+        for name in names:
+            info, brief = _import_info(name), found[name]
+            assert brief.name == info.name and brief.id == info.id
+            assert brief.filename == info.filename
+            assert brief.python == callable(info.Iq)
+            assert (brief.parameters.defaults == info.parameters.defaults)
+            for p, q in zip(brief.parameters.call_parameters,
+                            info.parameters.call_parameters):
+                assert (p.name, p.type, p.length, p.is_control, p.choices) \
+                    == (q.name, q.type, q.length, q.is_control, q.choices)
+        assert found["hardsphere"].structure_factor
+        assert found["spherical_sld"].profile
+
+        # The saved index is used in the next session, and a stale entry
+        # is rebuilt.
+        _TABLE, _CHECKED = None, set()
+        _table()["cylinder"]["hash"] = "stale"
+        _table()["cylinder"]["title"] = "stale"
+        assert summary("cylinder").title == found["cylinder"].title
+        assert summary("rpa").hash == found["rpa"].hash
+    finally:
+        SAS_MODEL_INDEX_PATH, _TABLE, _CHECKED = saved
+        shutil.rmtree(cache_dir, ignore_errors=True)
@@ -36,8 +36,10 @@ except ImportError:
 
 logger = logging.getLogger(__name__)
 
-# If MAX_PD changes, need to change the loop macros in kernel_iq.c
-MAX_PD = 5 #: Maximum number of simultaneously polydisperse parameters
+# The loop nest in kernel_iq.c is generated for each model, with one level
+# for each of its polydisperse parameters up to this limit (see
+# generate.pd_loops).
+MAX_PD = 8 #: Maximum number of simultaneously polydisperse parameters
 
 # assumptions about common parameters exist throughout the code, such as:
 # (1) kernel functions Iq, Iqxy, Iqac, Iqabc, form_volume, ... don't see them
@@ -56,6 +58,10 @@ COMMON_PARAMETERS = [
 NUM_COMMON_PARS = 2
 NUM_MAGFIELD_PARS = 4
 NUM_MAGNETIC_PARS = 3  # per sld
+# Derived polarization values appended to the magnetic kernel values, after
+# the dispersity weights: P[3], perpy[2], perpz[3], n_xs, xs[6], weight[6].
+# See details.convert_spin_state and kernel_iq.c.
+NUM_SPIN_VALUES = 21
 assert (len(COMMON_PARAMETERS) == NUM_COMMON_PARS
         and COMMON_PARAMETERS[0][0] == "scale"
         and COMMON_PARAMETERS[1][0] == "background"), "don't change common parameters"
@@ -943,9 +949,13 @@ def make_model_info(kernel_module):
     info.docs = kernel_module.__doc__
     info.category = getattr(kernel_module, 'category', None)
     info.structure_factor = getattr(kernel_module, 'structure_factor', False)
+    info.scale_invariant = getattr(kernel_module, 'scale_invariant', False)
     # TODO: find Fq by inspection
     info.radius_effective_modes = getattr(kernel_module, 'radius_effective_modes', None)
     info.have_Fq = getattr(kernel_module, 'have_Fq', False)
+    info.setup_size = getattr(kernel_module, 'setup_size', 0)
+    info.gpu_setup_size = getattr(kernel_module, 'gpu_setup_size', None)
+    info.setup = getattr(kernel_module, 'setup', None)
     info.profile_axes = getattr(kernel_module, 'profile_axes', ['x', 'y'])
     # Note: custom.load_custom_kernel_module assumes the C sources are defined
     # by this attribute.
@@ -1096,9 +1106,34 @@ class ModelInfo(object):
     #: between form factor models.  This will default to False if it is not
     #: provided in the file.
     structure_factor = None # type: bool
+    #: True if the structure factor depends on *q* and *radius_effective*
+    #: only through *q radius_effective*, and has no other parameters with
+    #: units of length.  Product models then interpolate it from tables in
+    #: these reduced variables (see :mod:`.sftable`).
+    scale_invariant = False
     #: True if the model defines an Fq function with signature
     #: ``void Fq(double q, double *F1, double *F2, ...)``
     have_Fq = False
+    #: Number of values in the scratch buffer filled by the *setup* function
+    #: of a C model, or 0 if the model has no setup stage.  When it is
+    #: positive the sources should define
+    #: ``void setup(double a, double b, ..., double scratch[])`` taking the
+    #: same parameters as *Iq*, and *Iq*, *Fq*, *Iqac*, *Iqabc* and *Iqxy*
+    #: receive ``const double scratch[]`` as their last argument.  Setup is
+    #: called once for each point in the dispersity mesh, so it is the place
+    #: for the q independent parts of the calculation.
+    setup_size = 0
+    #: Number of values in the scratch buffer on the GPU, or None for
+    #: *setup_size*.  Each GPU work item evaluates a single q, so setup runs
+    #: for every q and the buffer is in private memory.  Models with large
+    #: tables can keep a short buffer there and compute the values as they
+    #: are needed.
+    gpu_setup_size = None   # type: Optional[int]
+    #: For python models, *setup(a, b, ...)* returns an object holding the
+    #: q independent parts of the calculation, which is passed to *Iq* as
+    #: its last argument.  It is called once for each point in the
+    #: dispersity mesh.
+    setup = None            # type: Optional[Callable[[...], Any]]
     #: List of options for computing the effective radius of the shape,
     #: or None if the model is not usable as a form factor model.
     radius_effective_modes = None   # type: List[str]
@@ -194,7 +194,8 @@ parameters = [["dnn",         "Ang",       220,    [-inf, inf], "",            "
              ]
 # pylint: enable=bad-whitespace, line-too-long
 
-source = ["lib/sas_3j1x_x.c", "lib/gauss150.c", "lib/sphere_form.c", "bcc_paracrystal.c"]
+source = ["lib/sas_3j1x_x.c", "lib/gauss150.c", "lib/sphere_form.c",
+          "lib/fq_table.c", "lib/paracrystal.c", "bcc_paracrystal.c"]
 
 def random():
     """Return a random parameter set for the model."""
@@ -227,6 +228,12 @@ def random():
 q = 4.*pi/220.
 tests = [
     [{}, [0.001, q, 0.25], [0.6945817843046642, 1.6885157981411993, 0.005367008206852725]],
+    # Sharp (d_factor 0.01) and broad (0.3) peaks from low to high q, with
+    # long double references from the form that keeps precision as q -> 0.
+    [{'d_factor': 0.01, 'background': 0.0},
+     [0.002, 0.01, 0.05, 0.3], [3.27553e-05, 3.0409e-05, 0.307527, 0.00287866]],
+    [{'d_factor': 0.3, 'dnn': 160.0, 'radius': 30.0, 'background': 0.0},
+     [0.002, 0.01, 0.05, 0.3], [39.7201, 2.2779, 2.46655, 0.004586]],
     #[{'theta': 20.0, 'phi': 30, 'psi': 40.0}, (-0.017, 0.035), 2082.20264399],
     #[{'theta': 20.0, 'phi': 30, 'psi': 40.0}, (-0.081, 0.011), 0.436323144781],
     ]
@@ -1,160 +1,192 @@
-double form_volume(void);
-
-double Iq(double q,
-    double lg_radius, double sm_radius,
+// Percus-Yevick partial structure factors for a binary mixture of hard
+// spheres.  The coefficients of the direct correlation functions depend
+// only on the radii and volume fractions, so they are computed once in
+// setup() and stored in the scratch buffer as follows:
+#define BHS_S2 0        // diameter of the large spheres
+#define BHS_AA 1        // radius ratio small/large
+#define BHS_V1 2        // volume fractions v1 and v2
+#define BHS_V2 3
+#define BHS_A1 4        // coefficients of the direct correlation functions
+#define BHS_A2 5
+#define BHS_B1 6
+#define BHS_B2 7
+#define BHS_B12 8
+#define BHS_GM1 9
+#define BHS_GM12 10
+#define BHS_P11 11      // prefactor of the first term of c12
+#define BHS_P12 12      // prefactor of the remaining terms of c12
+#define BHS_DEN 13      // denominator of the c12 prefactors
+#define BHS_R1 14       // small and large radii
+#define BHS_R2 15
+#define BHS_N1 16       // number densities and the cross term 2 sqrt(n1 n2)
+#define BHS_N2 17
+#define BHS_N12 18
+#define BHS_C1 19       // contrast times volume for the small and large spheres
+#define BHS_C2 20
+// for a total of 21 values, which is setup_size in binary_hard_sphere.py.
+
+static void
+setup(double lg_radius, double sm_radius,
     double lg_vol_frac, double sm_vol_frac,
-    double lg_sld, double sm_sld, double solvent_sld
-    );
-
-void calculate_psfs(double qval,
-    double r2, double nf2,
-    double aa, double phi,
-    double *s11, double *s22, double *s12
-    );
-
-double form_volume(void)
+    double lg_sld, double sm_sld, double solvent_sld,
+    double scratch[])
 {
-    return 1.0;
-}
-
-double Iq(double q,
-    double lg_radius, double sm_radius,
-    double lg_vol_frac, double sm_vol_frac,
-    double lg_sld, double sm_sld, double solvent_sld)
-{
-    double r2,r1,nf2,phi,aa,rho2,rho1,rhos,inten;       //my local names
-    double psf11,psf12,psf22;
-    double phi1,phi2,phr,a3;
-    double v1,v2,n1,n2,qr1,qr2,b1,b2,sc1,sc2;
-
-    r2 = lg_radius;
-    r1 = sm_radius;
-    phi2 = lg_vol_frac;
-    phi1 = sm_vol_frac;
-    rho2 = lg_sld;
-    rho1 = sm_sld;
-    rhos = solvent_sld;
+    const double r2 = lg_radius;
+    const double r1 = sm_radius;
+    const double phi2 = lg_vol_frac;
+    const double phi1 = sm_vol_frac;
 
-
-    phi = phi1 + phi2;
-    aa = r1/r2;
+    const double phi = phi1 + phi2;
+    const double aa = r1/r2;
     //calculate the number fraction of larger spheres (eqn 2 in reference)
-    a3=aa*aa*aa;
-    phr=phi2/phi;
-    nf2 = phr*a3/(1.0-phr+phr*a3);
-    // calculate the PSF's here
-    calculate_psfs(q,r2,nf2,aa,phi,&psf11,&psf22,&psf12);
-
-    // /* do form factor calculations  */
-
-    v1 = M_4PI_3*r1*r1*r1;
-    v2 = M_4PI_3*r2*r2*r2;
-
-    n1 = phi1/v1;
-    n2 = phi2/v2;
+    const double a3 = aa*aa*aa;
+    const double phr = phi2/phi;
+    const double nf2 = phr*a3/(1.0-phr+phr*a3);
 
-    qr1 = r1*q;
-    qr2 = r2*q;
-
-    sc1 = sas_3j1x_x(qr1);
-    sc2 = sas_3j1x_x(qr2);
-    b1 = r1*r1*r1*(rho1-rhos)*M_4PI_3*sc1;
-    b2 = r2*r2*r2*(rho2-rhos)*M_4PI_3*sc2;
-    inten = n1*b1*b1*psf11;
-    inten += sqrt(n1*n2)*2.0*b1*b2*psf12;
-    inten += n2*b2*b2*psf22;
-    ///* convert I(1/A) to (1/cm)  */
-    inten *= 1.0e8;
-    ///*convert rho^2 in 10^-6A to A*/
-    inten *= 1.0e-12;
-    return(inten);
+    //   calculate constant terms
+    const double s2 = 2.0*r2;
+//    s1 = aa*s2;  why is this never used?  check original paper?
+    const double v = phi;
+    const double v1=((1.-nf2)*a3/(nf2+(1.-nf2)*a3))*v;
+    const double v2=(nf2/(nf2+(1.-nf2)*a3))*v;
+    const double g11=((1.+.5*v)+1.5*v2*(aa-1.))/(1.-v)/(1.-v);
+    const double g22=((1.+.5*v)+1.5*v1*(1./aa-1.))/(1.-v)/(1.-v);
+    const double g12=((1.+.5*v)+1.5*(1.-aa)*(v1-v2)/(1.+aa))/(1.-v)/(1.-v);
+    const double wmv = 1/(1.-v);
+    const double wmv3 = wmv*wmv*wmv;
+    const double wmv4 = wmv*wmv3;
+    const double a1=3.*wmv4*((v1+a3*v2)*(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2))) + ((v1+a3*v2)*(1.+2.*v)+(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)-3.*v2*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2)))*wmv3;
+    const double a2i=((v1+a3*v2)*(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2)))*3*wmv4 + ((v1+a3*v2)*(1.+2.*v)+a3*(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)*aa-3.*v1*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2)))*wmv3;
+    const double a2=a2i/a3;
+    const double b1=-6.*(v1*g11*g11+.25*v2*(1.+aa)*(1.+aa)*aa*g12*g12);
+    const double b2=-6.*(v2*g22*g22+.25*v1/a3*(1.+aa)*(1.+aa)*g12*g12);
+    const double b12=-3.*aa*(1.+aa)*(v1*g11/aa/aa+v2*g22)*g12;
+    const double gm1=(v1*a1+a3*v2*a2)*.5;
+    const double gm12=2.*gm1*(1.-aa)/aa;
+    const double wma3 = (1.-aa)*(1.-aa)*(1.-aa);
+
+    scratch[BHS_S2] = s2;
+    scratch[BHS_AA] = aa;
+    scratch[BHS_V1] = v1;
+    scratch[BHS_V2] = v2;
+    scratch[BHS_A1] = a1;
+    scratch[BHS_A2] = a2;
+    scratch[BHS_B1] = b1;
+    scratch[BHS_B2] = b2;
+    scratch[BHS_B12] = b12;
+    scratch[BHS_GM1] = gm1;
+    scratch[BHS_GM12] = gm12;
+    scratch[BHS_P11] = 3.*wma3*v*sqrt(nf2)*sqrt(1.-nf2)*a1;
+    scratch[BHS_P12] = 24.*v*sqrt(nf2)*sqrt(1.-nf2)*a3;
+    scratch[BHS_DEN] = nf2+(1.-nf2)*a3;
+
+    // /* form factor terms */
+    const double vol1 = M_4PI_3*r1*r1*r1;
+    const double vol2 = M_4PI_3*r2*r2*r2;
+    const double n1 = phi1/vol1;
+    const double n2 = phi2/vol2;
+    scratch[BHS_R1] = r1;
+    scratch[BHS_R2] = r2;
+    scratch[BHS_N1] = n1;
+    scratch[BHS_N2] = n2;
+    scratch[BHS_N12] = sqrt(n1*n2)*2.0;
+    scratch[BHS_C1] = r1*r1*r1*(sm_sld-solvent_sld)*M_4PI_3;
+    scratch[BHS_C2] = r2*r2*r2*(lg_sld-solvent_sld)*M_4PI_3;
 }
 
-
-void calculate_psfs(double qval,
-    double r2, double nf2,
-    double aa, double phi,
+static void
+calculate_psfs(double qval, const double scratch[],
     double *s11, double *s22, double *s12)
 {
-    //  variable qval,r2,nf2,aa,phi,&s11,&s22,&s12
-
-    //   calculate constant terms
-    double s2,v,a3,v1,v2,g11,g12,g22,wmv,wmv3,wmv4;
-    double a1,a2i,a2,b1,b2,b12,gm1,gm12;
-    double yy,ay,ay2,ay3,t1,t2,t3,f11,y2,y3,tt1,tt2,tt3;
-    double c11,c22,c12,f12,f22,ttt1,ttt2,ttt3,ttt4,yl,y13;
-    double t21,t22,t23,t31,t32,t33,t41,t42,yl3,wma3,y1;
+    const double aa = scratch[BHS_AA];
+    const double v1 = scratch[BHS_V1];
+    const double v2 = scratch[BHS_V2];
+    const double a1 = scratch[BHS_A1];
+    const double a2 = scratch[BHS_A2];
+    const double b1 = scratch[BHS_B1];
+    const double b2 = scratch[BHS_B2];
+    const double b12 = scratch[BHS_B12];
+    const double gm1 = scratch[BHS_GM1];
+    const double gm12 = scratch[BHS_GM12];
 
-    s2 = 2.0*r2;
-//    s1 = aa*s2;  why is this never used?  check original paper?
-    v = phi;
-    a3 = aa*aa*aa;
-    v1=((1.-nf2)*a3/(nf2+(1.-nf2)*a3))*v;
-    v2=(nf2/(nf2+(1.-nf2)*a3))*v;
-    g11=((1.+.5*v)+1.5*v2*(aa-1.))/(1.-v)/(1.-v);
-    g22=((1.+.5*v)+1.5*v1*(1./aa-1.))/(1.-v)/(1.-v);
-    g12=((1.+.5*v)+1.5*(1.-aa)*(v1-v2)/(1.+aa))/(1.-v)/(1.-v);
-    wmv = 1/(1.-v);
-    wmv3 = wmv*wmv*wmv;
-    wmv4 = wmv*wmv3;
-    a1=3.*wmv4*((v1+a3*v2)*(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2))) + ((v1+a3*v2)*(1.+2.*v)+(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)-3.*v2*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2)))*wmv3;
-    a2i=((v1+a3*v2)*(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2)))*3*wmv4 + ((v1+a3*v2)*(1.+2.*v)+a3*(1.+v+v*v)-3.*v1*v2*(1.-aa)*(1.-aa)*aa-3.*v1*(1.-aa)*(1.-aa)*(1.+v1+aa*(1.+v2)))*wmv3;
-    a2=a2i/a3;
-    b1=-6.*(v1*g11*g11+.25*v2*(1.+aa)*(1.+aa)*aa*g12*g12);
-    b2=-6.*(v2*g22*g22+.25*v1/a3*(1.+aa)*(1.+aa)*g12*g12);
-    b12=-3.*aa*(1.+aa)*(v1*g11/aa/aa+v2*g22)*g12;
-    gm1=(v1*a1+a3*v2*a2)*.5;
-    gm12=2.*gm1*(1.-aa)/aa;
     //c
-    //c   calculate the direct correlation functions and print results
+    //c   calculate the direct correlation functions
     //c
-    //  do 20 j=1,npts
+    // ay and y1 are the same argument, so each of the three arguments
+    // needs one SINCOS.
+    const double yy=qval*scratch[BHS_S2];
+    const double ay=aa*yy;
+    const double yl=.5*yy*(1.-aa);
+    double sin_ay, cos_ay, sin_yy, cos_yy, sin_yl, cos_yl;
+    SINCOS(ay, sin_ay, cos_ay);
+    SINCOS(yy, sin_yy, cos_yy);
+    SINCOS(yl, sin_yl, cos_yl);
 
-    yy=qval*s2;
-    //c   calculate direct correlation functions
     //c   ----c11
-    ay=aa*yy;
-    ay2 = ay*ay;
-    ay3 = ay*ay*ay;
-    t1=a1*(sin(ay)-ay*cos(ay));
-    t2=b1*(2.*ay*sin(ay)-(ay2-2.)*cos(ay)-2.)/ay;
-    t3=gm1*((4.*ay*ay2-24.*ay)*sin(ay)-(ay2*ay2-12.*ay2+24.)*cos(ay)+24.)/ay3;
-    f11=24.*v1*(t1+t2+t3)/ay3;
+    const double ay2 = ay*ay;
+    const double ay3 = ay*ay*ay;
+    const double t1=a1*(sin_ay-ay*cos_ay);
+    const double t2=b1*(2.*ay*sin_ay-(ay2-2.)*cos_ay-2.)/ay;
+    const double t3=gm1*((4.*ay*ay2-24.*ay)*sin_ay-(ay2*ay2-12.*ay2+24.)*cos_ay+24.)/ay3;
+    const double f11=24.*v1*(t1+t2+t3)/ay3;
 
     //c ------c22
-    y2=yy*yy;
-    y3=yy*y2;
-    tt1=a2*(sin(yy)-yy*cos(yy));
-    tt2=b2*(2.*yy*sin(yy)-(y2-2.)*cos(yy)-2.)/yy;
-    tt3=gm1*((4.*y3-24.*yy)*sin(yy)-(y2*y2-12.*y2+24.)*cos(yy)+24.)/ay3;
-    f22=24.*v2*(tt1+tt2+tt3)/y3;
+    const double y2=yy*yy;
+    const double y3=yy*y2;
+    const double tt1=a2*(sin_yy-yy*cos_yy);
+    const double tt2=b2*(2.*yy*sin_yy-(y2-2.)*cos_yy-2.)/yy;
+    const double tt3=gm1*((4.*y3-24.*yy)*sin_yy-(y2*y2-12.*y2+24.)*cos_yy+24.)/ay3;
+    const double f22=24.*v2*(tt1+tt2+tt3)/y3;
 
     //c   -----c12
-    yl=.5*yy*(1.-aa);
-    yl3=yl*yl*yl;
-    wma3 = (1.-aa)*(1.-aa)*(1.-aa);
-    y1=aa*yy;
-    y13 = y1*y1*y1;
-    ttt1=3.*wma3*v*sqrt(nf2)*sqrt(1.-nf2)*a1*(sin(yl)-yl*cos(yl))/((nf2+(1.-nf2)*a3)*yl3);
-    t21=b12*(2.*y1*cos(y1)+(y1*y1-2.)*sin(y1));
-    t22=gm12*((3.*y1*y1-6.)*cos(y1)+(y1*y1*y1-6.*y1)*sin(y1)+6.)/y1;
-    t23=gm1*((4.*y13-24.*y1)*cos(y1)+(y13*y1-12.*y1*y1+24.)*sin(y1))/(y1*y1);
-    t31=b12*(2.*y1*sin(y1)-(y1*y1-2.)*cos(y1)-2.);
-    t32=gm12*((3.*y1*y1-6.)*sin(y1)-(y1*y1*y1-6.*y1)*cos(y1))/y1;
-    t33=gm1*((4.*y13-24.*y1)*sin(y1)-(y13*y1-12.*y1*y1+24.)*cos(y1)+24.)/(y1*y1);
-    t41=cos(yl)*((sin(y1)-y1*cos(y1))/(y1*y1) + (1.-aa)/(2.*aa)*(1.-cos(y1))/y1);
-    t42=sin(yl)*((cos(y1)+y1*sin(y1)-1.)/(y1*y1) + (1.-aa)/(2.*aa)*sin(y1)/y1);
-    ttt2=sin(yl)*(t21+t22+t23)/(y13*y1);
-    ttt3=cos(yl)*(t31+t32+t33)/(y13*y1);
-    ttt4=a1*(t41+t42)/y1;
-    f12=ttt1+24.*v*sqrt(nf2)*sqrt(1.-nf2)*a3*(ttt2+ttt3+ttt4)/(nf2+(1.-nf2)*a3);
-
-    c11=f11;
-    c22=f22;
-    c12=f12;
+    const double yl3=yl*yl*yl;
+    const double y1=ay;
+    const double sin_y1=sin_ay, cos_y1=cos_ay;
+    const double y13 = y1*y1*y1;
+    const double ttt1=scratch[BHS_P11]*(sin_yl-yl*cos_yl)/(scratch[BHS_DEN]*yl3);
+    const double t21=b12*(2.*y1*cos_y1+(y1*y1-2.)*sin_y1);
+    const double t22=gm12*((3.*y1*y1-6.)*cos_y1+(y1*y1*y1-6.*y1)*sin_y1+6.)/y1;
+    const double t23=gm1*((4.*y13-24.*y1)*cos_y1+(y13*y1-12.*y1*y1+24.)*sin_y1)/(y1*y1);
+    const double t31=b12*(2.*y1*sin_y1-(y1*y1-2.)*cos_y1-2.);
+    const double t32=gm12*((3.*y1*y1-6.)*sin_y1-(y1*y1*y1-6.*y1)*cos_y1)/y1;
+    const double t33=gm1*((4.*y13-24.*y1)*sin_y1-(y13*y1-12.*y1*y1+24.)*cos_y1+24.)/(y1*y1);
+    const double t41=cos_yl*((sin_y1-y1*cos_y1)/(y1*y1) + (1.-aa)/(2.*aa)*(1.-cos_y1)/y1);
+    const double t42=sin_yl*((cos_y1+y1*sin_y1-1.)/(y1*y1) + (1.-aa)/(2.*aa)*sin_y1/y1);
+    const double ttt2=sin_yl*(t21+t22+t23)/(y13*y1);
+    const double ttt3=cos_yl*(t31+t32+t33)/(y13*y1);
+    const double ttt4=a1*(t41+t42)/y1;
+    const double f12=ttt1+scratch[BHS_P12]*(ttt2+ttt3+ttt4)/scratch[BHS_DEN];
+
+    const double c11=f11;
+    const double c22=f22;
+    const double c12=f12;
     *s11=1./(1.+c11-(c12)*c12/(1.+c22));
     *s22=1./(1.+c22-(c12)*c12/(1.+c11));
     *s12=-c12/((1.+c11)*(1.+c22)-(c12)*(c12));
+}
 
-    return;
+static double
+Iq(double q,
+    double lg_radius, double sm_radius,
+    double lg_vol_frac, double sm_vol_frac,
+    double lg_sld, double sm_sld, double solvent_sld,
+    const double scratch[])
+{
+    // calculate the PSF's here
+    double psf11,psf12,psf22;
+    calculate_psfs(q,scratch,&psf11,&psf22,&psf12);
+
+    // /* do form factor calculations  */
+    const double sc1 = sas_3j1x_x(scratch[BHS_R1]*q);
+    const double sc2 = sas_3j1x_x(scratch[BHS_R2]*q);
+    const double b1 = scratch[BHS_C1]*sc1;
+    const double b2 = scratch[BHS_C2]*sc2;
+    double inten = scratch[BHS_N1]*b1*b1*psf11;
+    inten += scratch[BHS_N12]*b1*b2*psf12;
+    inten += scratch[BHS_N2]*b2*b2*psf22;
+    ///* convert I(1/A) to (1/cm)  */
+    inten *= 1.0e8;
+    ///*convert rho^2 in 10^-6A to A*/
+    inten *= 1.0e-12;
+    return(inten);
 }
@@ -110,6 +110,8 @@ parameters = [["radius_lg", "Ang", 100, [0, inf], "",
              ]
 
 source = ["lib/sas_3j1x_x.c", "binary_hard_sphere.c"]
+# q independent Percus-Yevick coefficients; see binary_hard_sphere.c
+setup_size = 21
 
 def random():
     """Return a random parameter set for the model."""
@@ -132,4 +134,18 @@ def random():
     return pars
 
 # NOTE: test results taken from values returned by SasView 3.1.2
-tests = [[{}, 0.001, 25.8927262013]]
+tests = [
+    [{}, 0.001, 25.8927262013],
+    # Nearly equal spheres at high packing, and a dilute large sphere in a
+    # dense small sphere solution.  The small sphere case starts at
+    # q = 0.01, since below that the terms in q times the small diameter
+    # cancel.
+    [{'radius_lg': 100.0, 'radius_sm': 90.0,
+      'volfraction_lg': 0.3, 'volfraction_sm': 0.1, 'background': 0.0},
+     [0.001, 0.003, 0.01, 0.03, 0.1, 0.5],
+     [255.629, 253.547, 232.77, 333.25, 1.99103, 0.00198821]],
+    [{'radius_lg': 200.0, 'radius_sm': 10.0,
+      'volfraction_lg': 0.05, 'volfraction_sm': 0.4, 'background': 0.0},
+     [0.01, 0.03, 0.1, 0.5],
+     [6.35206, 0.312186, 0.217934, 0.0131241]],
+    ]
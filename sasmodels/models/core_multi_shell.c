@@ -36,21 +36,35 @@ radius_effective(int mode, double core_radius, double fp_n, double thickness[])
   }
 }
 
+// The scratch buffer holds the radius and the volume weighted contrast
+// for each interface, working out from the core to the solvent.
 static void
-Fq(double q, double *F1, double *F2, double core_sld, double core_radius,
-   double solvent_sld, double fp_n, double sld[], double thickness[])
+setup(double core_sld, double core_radius, double solvent_sld, double fp_n,
+   double sld[], double thickness[], double scratch[])
 {
   const int n = (int)(fp_n+0.5);
-  double f, r, last_sld;
-  r = core_radius;
-  last_sld = core_sld;
-  f = 0.;
+  double r = core_radius;
+  double last_sld = core_sld;
   for (int i=0; i<n; i++) {
-    f += M_4PI_3 * cube(r) * (sld[i] - last_sld) * sas_3j1x_x(q*r);
+    scratch[2*i] = r;
+    scratch[2*i+1] = M_4PI_3 * cube(r) * (sld[i] - last_sld);
     last_sld = sld[i];
     r += thickness[i];
   }
-  f += M_4PI_3 * cube(r) * (solvent_sld - last_sld) * sas_3j1x_x(q*r);
+  scratch[2*n] = r;
+  scratch[2*n+1] = M_4PI_3 * cube(r) * (solvent_sld - last_sld);
+}
+
+static void
+Fq(double q, double *F1, double *F2, double core_sld, double core_radius,
+   double solvent_sld, double fp_n, double sld[], double thickness[],
+   const double scratch[])
+{
+  const int n = (int)(fp_n+0.5);
+  double f = 0.;
+  for (int i=0; i<=n; i++) {
+    f += scratch[2*i+1] * sas_3j1x_x(q*scratch[2*i]);
+  }
   *F1 = 1e-2 * f;
   *F2 = 1e-4 * f * f;
 }
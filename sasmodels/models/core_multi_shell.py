@@ -101,6 +101,8 @@ parameters = [["sld_core", "1e-6/Ang^2", 1.0, [-inf, inf], "sld",
 
 source = ["lib/sas_3j1x_x.c", "core_multi_shell.c"]
 have_Fq = True
+# radius and contrast for each of up to 10 shells plus the core
+setup_size = 22
 radius_effective_modes = ["outer radius", "core radius"]
 
 def random():
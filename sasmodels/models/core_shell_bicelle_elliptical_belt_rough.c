@@ -57,6 +57,33 @@ radius_effective(int mode, double r_minor, double x_core, double thick_rim, doub
     }
 }
 
+static void
+_fq_row(double x, double q, double halfheight, double thick_rim,
+    double thick_face, double r2A, double r2B, double dr1, double dr2,
+    double dr3, double *row)
+{
+    const double qc = q*x;
+    row[0] = q*sqrt(1.0 - x*x);
+    row[1] = sas_sinx_x(halfheight*qc);
+    row[2] = sas_sinx_x((halfheight+thick_face)*qc);
+}
+
+static void
+_fq_point(const double *row, double cos_phi, double sin_phi,
+    double q, double halfheight, double thick_rim, double thick_face,
+    double r2A, double r2B, double dr1, double dr2, double dr3,
+    double *f1, double *f2)
+{
+    const double qab = row[0];
+    const double cos_beta = cos_phi*cos_phi - sin_phi*sin_phi;
+    const double rr = sqrt(r2A - r2B*cos_beta);
+    const double be1 = sas_2J1x_x(rr*qab);
+    const double be2 = sas_2J1x_x((rr+thick_rim)*qab);
+    const double f = dr1*row[1]*be1 + dr2*row[1]*be2 + dr3*row[2]*be1;
+    *f1 = f;
+    *f2 = f*f;
+}
+
 static void
 Fq(double q,
         double *F1,
@@ -93,40 +120,10 @@ Fq(double q,
     const double dr2 = vol2*(rhor-rhosolv);
     const double dr3 = vol3*(rhoh-rhosolv);
 
-    //initialize integral
-    double outer_total_F1 = 0.0;
-    double outer_total_F2 = 0.0;
-    for(int i=0;i<GAUSS_N;i++) {
-        //setup inner integral over the ellipsoidal cross-section
-        // since we generate these lots of times, why not store them somewhere?
-        //const double cos_theta = ( GAUSS_Z[i]*(vb-va) + va + vb )/2.0;
-        const double cos_theta = ( GAUSS_Z[i] + 1.0 )/2.0;
-        const double sin_theta = sqrt(1.0 - cos_theta*cos_theta);
-        const double qab = q*sin_theta;
-        const double qc = q*cos_theta;
-        const double si1 = sas_sinx_x(halfheight*qc);
-        const double si2 = sas_sinx_x((halfheight+thick_face)*qc);
-        double inner_total_F1 = 0;
-        double inner_total_F2 = 0;
-        for(int j=0;j<GAUSS_N;j++) {
-            //76 gauss points for the inner integral (WAS 20 points,so this may make unecessarily slow, but playing safe)
-            //const double beta = ( GAUSS_Z[j]*(vbj-vaj) + vaj + vbj )/2.0;
-            const double beta = ( GAUSS_Z[j] +1.0)*M_PI_2;
-            const double rr = sqrt(r2A - r2B*cos(beta));
-            const double be1 = sas_2J1x_x(rr*qab);
-            const double be2 = sas_2J1x_x((rr+thick_rim)*qab);
-            const double f = dr1*si1*be1 + dr2*si1*be2 + dr3*si2*be1;
-
-            inner_total_F1 += GAUSS_W[j] * f;
-            inner_total_F2 += GAUSS_W[j] * f * f;
-        }
-        //now calculate outer integral
-        outer_total_F1 += GAUSS_W[i] * inner_total_F1;
-        outer_total_F2 += GAUSS_W[i] * inner_total_F2;
-    }
-    // now complete change of integration variables (1-0)/(1-(-1))= 0.5
-    outer_total_F1 *= 0.25;
-    outer_total_F2 *= 0.25;
+    // average over x = cos(theta) and the ellipse angle beta = 2 phi
+    double outer_total_F1, outer_total_F2;
+    GAUSS_2D(outer_total_F1, outer_total_F2, 0, _fq_row, _fq_point,
+        q, halfheight, thick_rim, thick_face, r2A, r2B, dr1, dr2, dr3);
 
     //convert from [1e-12 A-1] to [cm-1]
     *F1 = 1e-2*outer_total_F1*exp(-0.25*square(q*sigma));
@@ -158,6 +158,7 @@ parameters = [
 # pylint: enable=bad-whitespace, line-too-long
 
 source = ["lib/sas_Si.c", "lib/polevl.c", "lib/sas_J1.c", "lib/gauss76.c",
+          "lib/gauss_2d.c",
           "core_shell_bicelle_elliptical_belt_rough.c"]
 have_Fq = True
 radius_effective_modes = [
@@ -182,6 +183,10 @@ tests = [
       'sld_solvent': 6.0, 'background': 0.0},
      0.015, 189.328],
     #[{'theta':80., 'phi':10.}, (qx, qy), 7.88866563001 ],
+    # Default shape from the Guinier region to high q.
+    [{'background': 0.0},
+     [1e-4, 0.001, 0.01, 0.05, 0.2, 0.5],
+     [243.429, 243.153, 217.333, 37.1944, 0.779499, 0.0146229]],
 ]
 
 del qx, qy  # not necessary to delete, but cleaner
@@ -98,6 +98,38 @@ radius_effective(int mode, double length_a, double length_b, double length_c,
     }
 }
 
+#if defined(ORIENT_RESOLUTION)
+// Oriented amplitude for the orientation average sized to q.
+static void
+_orient(double qa, double qb, double qc,
+    double dr0, double drA, double drB, double drC,
+    double length_a, double length_b, double length_c,
+    double tA, double tB, double tC,
+    double *f1, double *f2)
+{
+    const double siA = length_a*sas_sinx_x(0.5*length_a*qa);
+    const double siB = length_b*sas_sinx_x(0.5*length_b*qb);
+    const double siC = length_c*sas_sinx_x(0.5*length_c*qc);
+    const double siAt = tA*sas_sinx_x(0.5*tA*qa);
+    const double siBt = tB*sas_sinx_x(0.5*tB*qb);
+    const double siCt = tC*sas_sinx_x(0.5*tC*qc);
+
+#if OVERLAPPING
+    const double f = dr0*siA*siB*siC
+        + drA*(siAt-siA)*siB*siC
+        + drB*siAt*(siBt-siB)*siC
+        + drC*siAt*siBt*(siCt-siC);
+#else
+    const double f = dr0*siA*siB*siC
+        + drA*(siAt-siA)*siB*siC
+        + drB*siA*(siBt-siB)*siC
+        + drC*siA*siB*(siCt-siC);
+#endif
+    *f1 = f;
+    *f2 = f * f;
+}
+#endif
+
 static void
 Fq(double q,
     double *F1,
@@ -119,8 +151,6 @@ Fq(double q,
     // Code is rewritten, the code is compliant with Diva Singh's thesis now (Dirk Honecker)
     // Code rewritten; cross checked against hollow rectangular prism and realspace (PAK)
 
-    const double half_q = 0.5*q;
-
     const double tA = length_a + 2.0*thick_rim_a;
     const double tB = length_b + 2.0*thick_rim_b;
     const double tC = length_c + 2.0*thick_rim_c;
@@ -131,6 +161,15 @@ Fq(double q,
     const double drB = (brim_sld-solvent_sld);
     const double drC = (crim_sld-solvent_sld);
 
+#if defined(ORIENT_RESOLUTION)
+    const double radius = 0.5*sqrt(tA*tA + tB*tB + tC*tC);
+    double outer_sum_F1, outer_sum_F2;
+    ORIENT_AVERAGE(q, radius, outer_sum_F1, outer_sum_F2, _orient,
+                   dr0, drA, drB, drC, length_a, length_b, length_c,
+                   tA, tB, tC);
+#else
+    const double half_q = 0.5*q;
+
     // outer integral (with gauss points), integration limits = 0, 1
     // substitute d_cos_alpha for sin_alpha d_alpha
     double outer_sum_F1 = 0; //initialize integral
@@ -177,6 +216,7 @@ Fq(double q,
     // now complete change of outer integration variable (1-0)/(1-(-1))= 0.5
     outer_sum_F1 *= 0.5;
     outer_sum_F2 *= 0.5;
+#endif
 
     //convert from [1e-12 A-1] to [cm-1]
     *F1 = 1.0e-2 * outer_sum_F1;
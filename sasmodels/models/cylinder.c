@@ -51,6 +51,19 @@ radius_effective(int mode, double radius, double length)
     }
 }
 
+#if defined(GK_TOLERANCE)
+static void
+_orient(double theta, double q, double radius, double length,
+    double *f1, double *f2)
+{
+    double sin_theta, cos_theta;
+    SINCOS(theta, sin_theta, cos_theta);
+    const double form = _fq(q*sin_theta, q*cos_theta, radius, length);
+    *f1 = form * sin_theta;
+    *f2 = form * form * sin_theta;
+}
+#endif
+
 static void
 Fq(double q,
     double *F1,
@@ -60,6 +73,10 @@ Fq(double q,
     double radius,
     double length)
 {
+#if defined(GK_TOLERANCE)
+    double total_F1, total_F2;
+    GK_INTEGRATE(0.0, M_PI_2, total_F1, total_F2, _orient, q, radius, length);
+#else
     // translate a point in [-1,1] to a point in [0, pi/2]
     const double zm = M_PI_4;
     const double zb = M_PI_4;
@@ -78,6 +95,7 @@ Fq(double q,
     // translate dx in [-1,1] to dx in [lower,upper]
     total_F1 *= zm;
     total_F2 *= zm;
+#endif
     const double s = (sld - solvent_sld) * form_volume(radius, length);
     *F1 = 1e-2 * s * total_F1;
     *F2 = 1e-4 * s * s * total_F2;
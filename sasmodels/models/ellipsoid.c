@@ -47,6 +47,18 @@ radius_effective(int mode, double radius_polar, double radius_equatorial)
 }
 
 
+#if defined(GK_TOLERANCE)
+static void
+_orient(double u, double q, double radius_equatorial,
+    double v_square_minus_one, double *f1, double *f2)
+{
+    const double r = radius_equatorial*sqrt(1.0 + u*u*v_square_minus_one);
+    const double f = sas_3j1x_x(q*r);
+    *f1 = f;
+    *f2 = f * f;
+}
+#endif
+
 static void
 Fq(double q,
     double *F1,
@@ -64,6 +76,11 @@ Fq(double q,
     //     u = sin, du = cos dT
     //     i(h) = int_0^1 Phi^2(h a sqrt(1 + u^2(v^2-1)) du
     const double v_square_minus_one = square(radius_polar/radius_equatorial) - 1.0;
+#if defined(GK_TOLERANCE)
+    double total_F1, total_F2;
+    GK_INTEGRATE(0.0, 1.0, total_F1, total_F2, _orient,
+                 q, radius_equatorial, v_square_minus_one);
+#else
     // translate a point in [-1,1] to a point in [0, 1]
     // const double u = GAUSS_Z[i]*(upper-lower)/2 + (upper+lower)/2;
     const double zm = 0.5;
@@ -80,6 +97,7 @@ Fq(double q,
     // translate dx in [-1,1] to dx in [lower,upper]
     total_F1 *= zm;
     total_F2 *= zm;
+#endif
     const double s = (sld - sld_solvent) * form_volume(radius_polar, radius_equatorial);
     *F1 = 1e-2 * s * total_F1;
     *F2 = 1e-4 * s * s * total_F2;
@@ -67,50 +67,39 @@ radius_effective(int mode, double radius_minor, double r_ratio, double length)
     }
 }
 
+// Cross-section amplitude at x = cos(alpha) for the average over alpha.
+static void
+_fq_row(double x, double q, double half_length, double rA, double rB,
+    double *row)
+{
+    row[0] = q*sqrt(1.0 - x*x);
+    row[1] = sas_sinx_x(q*half_length*x);
+}
+
+// The inner integral is over the ellipse angle theta = 2 phi in [0, pi].
+static void
+_fq_point(const double *row, double cos_phi, double sin_phi,
+    double q, double half_length, double rA, double rB,
+    double *f1, double *f2)
+{
+    const double cos_theta = cos_phi*cos_phi - sin_phi*sin_phi;
+    const double be = sas_2J1x_x(row[0]*sqrt(rA - rB*cos_theta));
+    *f1 = row[1]*be;
+    *f2 = square(*f1);
+}
+
 static void
 Fq(double q, double *F1, double *F2, double radius_minor, double r_ratio, double length,
    double sld, double solvent_sld)
 {
-    // orientational average limits
-    const double va = 0.0;
-    const double vb = 1.0;
-    // inner integral limits
-    const double vaj=0.0;
-    const double vbj=M_PI;
-
     const double radius_major = r_ratio * radius_minor;
     const double rA = 0.5*(square(radius_major) + square(radius_minor));
     const double rB = 0.5*(square(radius_major) - square(radius_minor));
 
-    //initialize integral
-    double outer_sum_F1 = 0.0;
-    double outer_sum_F2 = 0.0;
-    for(int i=0;i<GAUSS_N;i++) {
-        //setup inner integral over the ellipsoidal cross-section
-        const double cos_val = ( GAUSS_Z[i]*(vb-va) + va + vb )/2.0;
-        const double sin_val = sqrt(1.0 - cos_val*cos_val);
-        //const double arg = radius_minor*sin_val;
-        double inner_sum_F1 = 0.0;
-        double inner_sum_F2 = 0.0;
-        for(int j=0;j<GAUSS_N;j++) {
-            const double theta = ( GAUSS_Z[j]*(vbj-vaj) + vaj + vbj )/2.0;
-            const double r = sin_val*sqrt(rA - rB*cos(theta));
-            const double be = sas_2J1x_x(q*r);
-            inner_sum_F1 += GAUSS_W[j] * be;
-            inner_sum_F2 += GAUSS_W[j] * be * be;
-        }
-        //now calculate the value of the inner integral
-        inner_sum_F1 *= 0.5*(vbj-vaj);
-        inner_sum_F2 *= 0.5*(vbj-vaj);
-
-        //now calculate outer integral
-        const double si = sas_sinx_x(q*0.5*length*cos_val);
-        outer_sum_F1 += GAUSS_W[i] * inner_sum_F1 * si;
-        outer_sum_F2 += GAUSS_W[i] * inner_sum_F2 * si * si;
-    }
-    // correct limits and divide integral by pi
-    outer_sum_F1 *= 0.5*(vb-va)/M_PI;
-    outer_sum_F2 *= 0.5*(vb-va)/M_PI;
+    // average over alpha and the ellipse angle
+    double outer_sum_F1, outer_sum_F2;
+    GAUSS_2D(outer_sum_F1, outer_sum_F2, 0, _fq_row, _fq_point,
+        q, 0.5*length, rA, rB);
 
     // scale by contrast and volume, and convert to to 1/cm units
     const double volume = form_volume(radius_minor, r_ratio, length);
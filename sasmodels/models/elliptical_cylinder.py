@@ -123,7 +123,8 @@ parameters = [["radius_minor",     "Ang",        20.0,  [0, inf],    "volume",
 
 # pylint: enable=bad-whitespace, line-too-long
 
-source = ["lib/polevl.c", "lib/sas_J1.c", "lib/gauss76.c", "elliptical_cylinder.c"]
+source = ["lib/polevl.c", "lib/sas_J1.c", "lib/gauss76.c", "lib/gauss_2d.c",
+          "elliptical_cylinder.c"]
 have_Fq = True
 radius_effective_modes = [
     "equivalent cylinder excluded volume",
@@ -163,4 +164,9 @@ tests = [
       'sld_solvent':1.0, 'background':0.0},
      0.001, 675.504402],
     #[{'theta':80., 'phi':10.}, (qx, qy), 7.88866563001 ],
+    # A flat, strongly elliptical disk from the Guinier region to high q.
+    [{'radius_minor': 50.0, 'axis_ratio': 4.0, 'length': 20.0,
+      'background': 0.0},
+     [1e-4, 0.001, 0.01, 0.05, 0.2, 0.5],
+     [565.467, 563.483, 406.672, 44.8055, 0.687696, 0.0190909]],
 ]
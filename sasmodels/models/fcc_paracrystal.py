@@ -192,7 +192,8 @@ parameters = [["dnn", "Ang", 220, [-inf, inf], "", "Nearest neighbour distance"]
              ]
 # pylint: enable=bad-whitespace, line-too-long
 
-source = ["lib/sas_3j1x_x.c", "lib/gauss150.c", "lib/sphere_form.c", "fcc_paracrystal.c"]
+source = ["lib/sas_3j1x_x.c", "lib/gauss150.c", "lib/sphere_form.c",
+          "lib/fq_table.c", "lib/paracrystal.c", "fcc_paracrystal.c"]
 
 def random():
     """Return a random parameter set for the model."""
@@ -217,6 +218,12 @@ def random():
 q=0.035
 tests = [
     [{}, [0.01, q, 0.25], [0.0213498915484313, 69.03586722100925, 0.005713137547083953]],
+    # Sharp (d_factor 0.01) and broad (0.3) peaks from low to high q, with
+    # long double references from the form that keeps precision as q -> 0.
+    [{'d_factor': 0.01, 'background': 0.0},
+     [0.002, 0.01, 0.05, 0.3], [4.18149e-06, 1.6803e-06, 0.000619701, 0.00133773]],
+    [{'d_factor': 0.3, 'dnn': 160.0, 'radius': 30.0, 'background': 0.0},
+     [0.002, 0.01, 0.05, 0.3], [31.991, 1.71387, 3.12119, 0.0049926]],
     #[{}, (-0.047, -0.007), 238.103096286],
     #[{}, (0.053, 0.063), 0.863609587796],
 ]
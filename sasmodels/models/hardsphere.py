@@ -78,6 +78,7 @@ description = """\
 """
 category = "structure-factor"
 structure_factor = True
+scale_invariant = True
 single = False # TODO: check
 
 #             ["name", "units", default, [lower, upper], "type","description"],
@@ -1,8 +1,15 @@
 // Hayter-Penfold (rescaled) MSA structure factor for screened Coulomb interactions 
 //
+// The MSA coefficients depend on the parameters but not on q, so they are
+// found once by hayter_msa_solve and then used by sqhcal for each q.  The
+// dll keeps the last solution for each thread so that it is reused for all
+// q values at a mesh point.  The solution is only reused for exactly the
+// same parameters, and is otherwise found from the usual starting point,
+// so S(q) does not depend on the order of the calls.
+//
 // C99 needs declarations of routines here
 double Iq(double QQ,
-      double radius_effective, double zz, double VolFrac, double Temp, double csalt, double dialec);
+      double radius_effective, double VolFrac, double zz, double Temp, double csalt, double dialec);
 int
 sqcoef(int ir, double gMSAWave[]);
 
@@ -11,19 +18,24 @@ sqfun(int ix, int ir, double gMSAWave[]);
 
 double
 sqhcal(double qq, double gMSAWave[]);
-  
-double Iq(double QQ,
-      double radius_effective, double VolFrac, double zz, double Temp, double csalt, double dialec)
+
+// Fill in the MSA coefficients gMSAWave[17] for the parameters, returning
+// the error level from sqcoef, which is negative if there is no solution.
+static int
+hayter_msa_solve(double radius_effective, double VolFrac, double zz,
+      double Temp, double csalt, double dialec, double gMSAWave[])
 {
-    double gMSAWave[17]={1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17};
 	double Elcharge=1.602189e-19;		// electron charge in Coulombs (C)
 	double kB=1.380662e-23;				// Boltzman constant in J/K
 	double FrSpPerm=8.85418782E-12;	//Permittivity of free space in C^2/(N m^2)
-	double SofQ, Qdiam, Vp, ss;
+	double Vp, ss;
 	double SIdiam, diam, Kappa, cs, IonSt;
 	double  Perm, Beta;
 	double charge;
-	int ierr;
+	
+	for (int k=0; k < 17; k++) {
+		gMSAWave[k] = k+1;
+	}
 	
 	diam=2*radius_effective;		//in A
 
@@ -50,7 +62,6 @@ double Iq(double QQ,
 	gMSAWave[5]=Beta*charge*charge/(M_PI*Perm*SIdiam*square(2.0+Kappa*SIdiam));
 	
 	//         Finally set up dimensionless parameters 
-	Qdiam=QQ*diam;
 	gMSAWave[6] = Kappa*SIdiam;
 	gMSAWave[4] = VolFrac;
 	
@@ -62,23 +73,61 @@ double Iq(double QQ,
 	gMSAWave[9] = 2.0*ss*gMSAWave[5]*exp(gMSAWave[6]-gMSAWave[6]/ss);
 	
 	//        CALCULATE COEFFICIENTS, CHECK ALL IS WELL
-	//        AND IF SO CALCULATE S(Q*SIG)
 	
-	ierr=0;
-	ierr=sqcoef(ierr, gMSAWave);
+	return sqcoef(0, gMSAWave);
+}
+
+#if !defined(USE_GPU)
+#define HAVE_HAYTER_MSA_CACHE 1
+typedef struct {
+	int ready;          // solution is available for pars
+	int ierr;           // error level from hayter_msa_solve
+	double pars[6];     // radius_effective, VolFrac, zz, Temp, csalt, dialec
+	double gMSAWave[17];
+} HayterMSACache;
+static THREAD_LOCAL HayterMSACache hayter_msa_cache;
+#endif // !USE_GPU
+
+double Iq(double QQ,
+      double radius_effective, double VolFrac, double zz, double Temp, double csalt, double dialec)
+{
+	double *gMSAWave;
+	int ierr;
+#if defined(HAVE_HAYTER_MSA_CACHE)
+	HayterMSACache *cache = &hayter_msa_cache;
+	const double pars[6] = {radius_effective, VolFrac, zz, Temp, csalt, dialec};
+	int same = cache->ready;
+	for (int k=0; k < 6 && same; k++) {
+		same = (cache->pars[k] == pars[k]);
+	}
+	if (!same) {
+		cache->ierr = hayter_msa_solve(radius_effective, VolFrac, zz, Temp,
+			csalt, dialec, cache->gMSAWave);
+		for (int k=0; k < 6; k++) {
+			cache->pars[k] = pars[k];
+		}
+		cache->ready = 1;
+	}
+	gMSAWave = cache->gMSAWave;
+	ierr = cache->ierr;
+#else
+	double wave[17];
+	gMSAWave = wave;
+	ierr = hayter_msa_solve(radius_effective, VolFrac, zz, Temp, csalt,
+		dialec, gMSAWave);
+#endif
+
+	//        AND IF SO CALCULATE S(Q*SIG)
 	if (ierr>=0) {
-		SofQ=sqhcal(Qdiam, gMSAWave);
+		return sqhcal(QQ*2.0*radius_effective, gMSAWave);
 	}else{
-       	SofQ=NAN;
 		//	print "Error Level = ",ierr
 		//      print "Please report HPMSA problem with above error code"
+		return NAN;
 	}
-	
-	return(SofQ);
 }
 
 
-
 /////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////
 //
@@ -174,6 +174,37 @@ tests = [
       'dielectconst': 78.0,
       'radius_effective_pd': 0.1,
       'radius_effective_pd_n': 40},
-     [0.00001, 0.0010, 0.01, 0.075], [0.450272, 0.450420, 0.465116, 1.039625]]
+     [0.00001, 0.0010, 0.01, 0.075], [0.450272, 0.450420, 0.465116, 1.039625]],
+    # Concentrated, highly charged spheres with little salt.
+    [{'scale': 1.0,
+      'background': 0.0,
+      'radius_effective': 40.0,
+      'charge': 60.0,
+      'volfraction': 0.3,
+      'temperature': 298.0,
+      'concentration_salt': 0.01,
+      'dielectconst': 78.0},
+     [0.0001, 0.005, 0.02, 0.06, 0.1, 0.3],
+     [0.0134673, 0.0137309, 0.0184518, 0.447627, 0.646747, 0.992587]],
+    # Strong screening by salt.
+    [{'scale': 1.0,
+      'background': 0.0,
+      'radius_effective': 15.0,
+      'charge': 5.0,
+      'volfraction': 0.1,
+      'temperature': 298.0,
+      'concentration_salt': 0.5,
+      'dielectconst': 78.0},
+     [0.0001, 0.01, 0.1, 0.5], [0.42536, 0.427688, 0.687261, 0.98994]],
+    # Dilute, highly charged spheres without salt.
+    [{'scale': 1.0,
+      'background': 0.0,
+      'radius_effective': 100.0,
+      'charge': 150.0,
+      'volfraction': 0.001,
+      'temperature': 350.0,
+      'concentration_salt': 0.0,
+      'dielectconst': 60.0},
+     [0.0001, 0.001, 0.005, 0.02], [0.0113606, 0.0171158, 1.22139, 0.995923]],
     ]
 # ADDED by:  RKH  ON: 16Mar2016 converted from sasview, new Taylor expansion at smallest rescaled Q
@@ -120,7 +120,7 @@ parameters = [
      "Solvent scattering length density"],
     ]
 
-source = ["lamellar_hg_stack_caille.c"]
+source = ["lib/lattice_power_cos_sum.c", "lamellar_hg_stack_caille.c"]
 
 # No volume normalization despite having a volume parameter
 # This should perhaps be volume normalized?
@@ -150,5 +150,15 @@ def random():
 tests = [[{'scale': 1.0, 'background': 0.0, 'length_tail': 10.0, 'length_head': 2.0,
            'Nlayers': 30.0, 'd_spacing': 40., 'Caille_parameter': 0.001, 'sld': 0.4,
            'sld_head': 2.0, 'sld_solvent': 6.0, 'length_tail_pd': 0.0,
-           'length_head_pd': 0.0, 'd_spacing_pd': 0.0}, [0.001], [6838238.571488]]]
+           'length_head_pd': 0.0, 'd_spacing_pd': 0.0}, [0.001], [6838238.571488]],
+         # A large and a minimal stack through the first two Bragg peaks.
+         [{'scale': 1.0, 'background': 0.0, 'Nlayers': 500.0, 'd_spacing': 400.,
+           'Caille_parameter': 0.01},
+          [1e-4, 0.001, 0.015708, 0.02, 0.031516, 0.1, 0.5],
+          [3.80897e+06, 342.46, 48370.8, 2.00892, 97.5187, 0.73191, 0.000707013]],
+         [{'scale': 1.0, 'background': 0.0, 'Nlayers': 2.0, 'd_spacing': 400.,
+           'Caille_parameter': 0.3},
+          [1e-4, 0.001, 0.015708, 0.02, 0.031516, 0.1, 0.5],
+          [5.14507e+06, 49388.5, 164.712, 59.2266, 27.8857, 1.61796, 0.000707013]],
+        ]
 # ADDED by: RKH  ON: 18Mar2016  converted from sasview previously, now renaming everything & sorting the docs
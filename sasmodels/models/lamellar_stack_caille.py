@@ -105,7 +105,7 @@ parameters = [
     ]
 # pylint: enable=bad-whitespace, line-too-long
 
-source = ["lamellar_stack_caille.c"]
+source = ["lib/lattice_power_cos_sum.c", "lamellar_stack_caille.c"]
 
 def random():
     """Return a random parameter set for the model."""
@@ -133,6 +133,21 @@ tests = [
     [{'scale': 1.0, 'background': 0.0, 'thickness': 30., 'Nlayers': 20.0,
       'd_spacing': 400., 'Caille_parameter': 0.1, 'sld': 6.3,
       'sld_solvent': 1.0, 'thickness_pd': 0.0, 'd_spacing_pd': 0.0},
-     [0.001], [28895.13397]]
+     [0.001], [28895.13397]],
+    # Small to large Caille parameters and layer counts, through the
+    # first two Bragg peaks at q = 2 pi n/d_spacing.  33 layers crosses
+    # the first restart of the recurrences.
+    [{'scale': 1.0, 'background': 0.0, 'Nlayers': 33.0,
+      'Caille_parameter': 0.001},
+     [1e-4, 0.001, 0.015708, 0.02, 0.031516, 0.1, 0.5],
+     [1.13106e+08, 2960.26, 5194.2, 0.312895, 1041.07, 0.107919, 0.00249152]],
+    [{'scale': 1.0, 'background': 0.0, 'Nlayers': 2000.0,
+      'Caille_parameter': 0.05},
+     [1e-4, 0.001, 0.015708, 0.02, 0.031516, 0.1, 0.5],
+     [2.7569e+06, 426.133, 214016., 13.278, 254.765, 1.68685, 0.0024846]],
+    [{'scale': 1.0, 'background': 0.0, 'Nlayers': 20000.0,
+      'Caille_parameter': 0.8},
+     [1e-4, 0.001, 0.015708, 0.02, 0.031516, 0.1, 0.5],
+     [369478., 1013.32, 2207.25, 88.4207, 37.4262, 1.75612, 0.0024846]],
     ]
 # ADDED by: RKH  ON: 18Mar2016  converted from sasview previously, now renaming everything & sorting the docs
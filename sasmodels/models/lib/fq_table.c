@@ -0,0 +1,126 @@
+// Lazily built interpolation tables for expensive 1D form factors.
+//
+// Some models have an orientation averaged form factor which depends on q
+// only through a scaled variable x = q*R for a fixed shape, so a table of
+// the unit form factor in x can be reused for every size in the dispersity
+// mesh.  The table is split into panels of width FQ_TABLE_WIDTH in x, each
+// holding a Chebyshev interpolant of degree FQ_TABLE_ORDER-1 through F1
+// and F2.  Panels are filled on first use and kept for later calls to the
+// kernel.  A panel whose trailing Chebyshev coefficients are larger than
+// FQ_TABLE_TOLERANCE relative to the panel is marked for direct evaluation
+// instead, as are points beyond the end of the table.
+//
+// Tables are only available for the DLL kernels since they keep state
+// between calls.  Enable them with SAS_FQ_TABLE=1 in the environment, which
+// defines USE_FQ_TABLE.  Models check HAVE_FQ_TABLE before using them.
+//
+// The table is rebuilt whenever the shape parameter changes, so it pays for
+// itself with size dispersity, but not with dispersity in the shape.
+
+#if defined(USE_FQ_TABLE) && !defined(USE_GPU)
+#define HAVE_FQ_TABLE 1
+
+#ifndef FQ_TABLE_PANELS
+#  define FQ_TABLE_PANELS 512
+#endif
+#ifndef FQ_TABLE_WIDTH
+#  define FQ_TABLE_WIDTH 0.5
+#endif
+#ifndef FQ_TABLE_ORDER
+#  define FQ_TABLE_ORDER 16
+#endif
+#ifndef FQ_TABLE_TOLERANCE
+#  if FLOAT_SIZE > 4
+#    define FQ_TABLE_TOLERANCE 1e-10
+#  else
+#    define FQ_TABLE_TOLERANCE 1e-5
+#  endif
+#endif
+
+// Unit form factor fn(x, shape, &F1, &F2) to be tabulated.
+typedef void (*FqTableFn)(double x, double shape, double *F1, double *F2);
+
+typedef struct {
+    int ready;          // table is in use for shape
+    double shape;       // shape parameter for the current table
+    signed char state[FQ_TABLE_PANELS]; // 0: empty, 1: tabulated, -1: direct
+    double c1[FQ_TABLE_PANELS][FQ_TABLE_ORDER];
+    double c2[FQ_TABLE_PANELS][FQ_TABLE_ORDER];
+} FqTable;
+
+// Declare a table for each thread, since there is no locking on the table.
+// Use this at file scope in the model, without a trailing semicolon.
+#define FQ_TABLE(_name) static THREAD_LOCAL FqTable _name;
+
+static int
+_fq_table_converged(const double *c)
+{
+    double scale = 0.0;
+    for (int j = 0; j < FQ_TABLE_ORDER; j++) scale += fabs(c[j]);
+    const double tail = fabs(c[FQ_TABLE_ORDER-1]) + fabs(c[FQ_TABLE_ORDER-2]);
+    return tail <= FQ_TABLE_TOLERANCE*scale;
+}
+
+static void
+_fq_table_fill(FqTable *table, int panel, FqTableFn fn)
+{
+    const double lo = panel*FQ_TABLE_WIDTH;
+    double f1[FQ_TABLE_ORDER], f2[FQ_TABLE_ORDER];
+    for (int k = 0; k < FQ_TABLE_ORDER; k++) {
+        const double t = cos(M_PI*(k + 0.5)/FQ_TABLE_ORDER);
+        fn(lo + 0.5*FQ_TABLE_WIDTH*(t + 1.0), table->shape, f1+k, f2+k);
+    }
+    double *c1 = table->c1[panel], *c2 = table->c2[panel];
+    for (int j = 0; j < FQ_TABLE_ORDER; j++) {
+        double s1 = 0.0, s2 = 0.0;
+        for (int k = 0; k < FQ_TABLE_ORDER; k++) {
+            const double w = cos(M_PI*j*(k + 0.5)/FQ_TABLE_ORDER);
+            s1 += w*f1[k];
+            s2 += w*f2[k];
+        }
+        c1[j] = 2.0*s1/FQ_TABLE_ORDER;
+        c2[j] = 2.0*s2/FQ_TABLE_ORDER;
+    }
+    table->state[panel] =
+        (_fq_table_converged(c1) && _fq_table_converged(c2)) ? 1 : -1;
+}
+
+static double
+_fq_table_clenshaw(const double *c, double t)
+{
+    double b1 = 0.0, b2 = 0.0;
+    for (int j = FQ_TABLE_ORDER-1; j > 0; j--) {
+        const double b0 = 2.0*t*b1 - b2 + c[j];
+        b2 = b1;
+        b1 = b0;
+    }
+    return t*b1 - b2 + 0.5*c[0];
+}
+
+// Set F1 and F2 to fn(x, shape), interpolating from the table if possible.
+static void
+fq_table_eval(FqTable *table, FqTableFn fn, double x, double shape,
+    double *F1, double *F2)
+{
+    const double panel_x = x/FQ_TABLE_WIDTH;
+    if (!(panel_x >= 0.0 && panel_x < FQ_TABLE_PANELS)) {
+        fn(x, shape, F1, F2);
+        return;
+    }
+    if (!table->ready || table->shape != shape) {
+        for (int k = 0; k < FQ_TABLE_PANELS; k++) table->state[k] = 0;
+        table->shape = shape;
+        table->ready = 1;
+    }
+    const int panel = (int)panel_x;
+    if (table->state[panel] == 0) _fq_table_fill(table, panel, fn);
+    if (table->state[panel] < 0) {
+        fn(x, shape, F1, F2);
+    } else {
+        const double t = 2.0*(panel_x - panel) - 1.0;
+        *F1 = _fq_table_clenshaw(table->c1[panel], t);
+        *F2 = _fq_table_clenshaw(table->c2[panel], t);
+    }
+}
+
+#endif // USE_FQ_TABLE && !USE_GPU
@@ -4,10 +4,14 @@
  # undef GAUSS_N
  # undef GAUSS_Z
  # undef GAUSS_W
+ # undef GAUSS_COS
+ # undef GAUSS_SIN
  #endif
  #define GAUSS_N 150
  #define GAUSS_Z Gauss150Z
  #define GAUSS_W Gauss150Wt
+ #define GAUSS_COS Gauss150Cos
+ #define GAUSS_SIN Gauss150Sin
 
 
 // Note: using array size 152 rather than 150 so that it is a multiple of 4.
@@ -321,3 +325,313 @@ constant double Gauss150Wt[152]={
   	0., // zero padding is ignored
   	0.  // zero padding is ignored
 };
+
+// cos(phi) and sin(phi) for phi = pi/4 (1 + z) in [0, pi/2] at the nodes z
+constant double Gauss150Cos[152]={
+	 9.999999949736074e-01,
+	 9.999998604839776e-01,
+	 9.999991576081732e-01,
+	 9.999970974659850e-01,
+	 9.999925428380464e-01,
+	 9.999840106574407e-01,
+	 9.999696752638781e-01,
+	 9.999473724230636e-01,
+	 9.999146041113528e-01,
+	 9.998685440653134e-01,
+	 9.998060440954457e-01,
+	 9.997236411628689e-01,
+	 9.996175652172300e-01,
+	 9.994837477933981e-01,
+	 9.993178313636877e-01,
+	 9.991151794413737e-01,
+	 9.988708874301336e-01,
+	 9.985797942127611e-01,
+	 9.982364944710397e-01,
+	 9.978353517270488e-01,
+	 9.973705120943910e-01,
+	 9.968359187258796e-01,
+	 9.962253269421322e-01,
+	 9.955323200232498e-01,
+	 9.947503256433742e-01,
+	 9.938726329253779e-01,
+	 9.928924100902912e-01,
+	 9.918027226733148e-01,
+	 9.905965522754122e-01,
+	 9.892668158165534e-01,
+	 9.878063852537061e-01,
+	 9.862081077236553e-01,
+	 9.844648260677116e-01,
+	 9.825693996923578e-01,
+	 9.805147257169095e-01,
+	 9.782937603563535e-01,
+	 9.758995404847078e-01,
+	 9.733252053215358e-01,
+	 9.705640181816876e-01,
+	 9.676093882259423e-01,
+	 9.644548921480286e-01,
+	 9.610942957315244e-01,
+	 9.575215752084090e-01,
+	 9.537309383495876e-01,
+	 9.497168452165482e-01,
+	 9.454740285024756e-01,
+	 9.409975133906417e-01,
+	 9.362826368577517e-01,
+	 9.313250663501531e-01,
+	 9.261208177614282e-01,
+	 9.206662726409058e-01,
+	 9.149581945640418e-01,
+	 9.089937445974451e-01,
+	 9.027704957935672e-01,
+	 8.962864466527150e-01,
+	 8.895400334931075e-01,
+	 8.825301416731414e-01,
+	 8.752561156138684e-01,
+	 8.677177675738973e-01,
+	 8.599153851334843e-01,
+	 8.518497373494730e-01,
+	 8.435220795479352e-01,
+	 8.349341567268400e-01,
+	 8.260882055467998e-01,
+	 8.169869548938790e-01,
+	 8.076336250045690e-01,
+	 7.980319251492914e-01,
+	 7.881860498771548e-01,
+	 7.781006738311179e-01,
+	 7.677809451491578e-01,
+	 7.572324774734727e-01,
+	 7.464613405961050e-01,
+	 7.354740497756409e-01,
+	 7.242775537657397e-01,
+	 7.128792216021745e-01,
+	 7.012868282007569e-01,
+	 6.895085388239338e-01,
+	 6.775528924789695e-01,
+	 6.654287843153960e-01,
+	 6.531454470938205e-01,
+	 6.407124318021821e-01,
+	 6.281395874991166e-01,
+	 6.154370404672173e-01,
+	 6.026151727616188e-01,
+	 5.896846002415013e-01,
+	 5.766561501737644e-01,
+	 5.635408384992771e-01,
+	 5.503498468527456e-01,
+	 5.370944994273604e-01,
+	 5.237862397750003e-01,
+	 5.104366076318698e-01,
+	 4.970572158580659e-01,
+	 4.836597275776874e-01,
+	 4.702558336037790e-01,
+	 4.568572302296213e-01,
+	 4.434755974646746e-01,
+	 4.301225777899099e-01,
+	 4.168097555032927e-01,
+	 4.035486367219062e-01,
+	 3.903506301026057e-01,
+	 3.772270283382457e-01,
+	 3.641889904814298e-01,
+	 3.512475251424493e-01,
+	 3.384134746026361e-01,
+	 3.256974998787985e-01,
+	 3.131100667687437e-01,
+	 3.006614329022186e-01,
+	 2.883616358158748e-01,
+	 2.762204820651888e-01,
+	 2.642475373806434e-01,
+	 2.524521178699392e-01,
+	 2.408432822625885e-01,
+	 2.294298251879868e-01,
+	 2.182202714729686e-01,
+	 2.072228714399679e-01,
+	 1.964455971822577e-01,
+	 1.858961397883229e-01,
+	 1.755819074832895e-01,
+	 1.655100246514609e-01,
+	 1.556873317004527e-01,
+	 1.461203857241606e-01,
+	 1.368154619188439e-01,
+	 1.277785557039985e-01,
+	 1.190153854973935e-01,
+	 1.105313960916857e-01,
+	 1.023317625783946e-01,
+	 9.442139476371800e-02,
+	 8.680494201969095e-02,
+	 7.948679851353599e-02,
+	 7.247110875771336e-02,
+	 6.576177342314202e-02,
+	 5.936245535833264e-02,
+	 5.327658575771908e-02,
+	 4.750737042330611e-02,
+	 4.205779606484001e-02,
+	 3.693063658503992e-02,
+	 3.212845929799683e-02,
+	 2.765363103060757e-02,
+	 2.350832405883710e-02,
+	 1.969452183262604e-02,
+	 1.621402444522651e-02,
+	 1.306845380436037e-02,
+	 1.025925846301379e-02,
+	 7.787718064632114e-03,
+	 5.654947343664307e-03,
+	 3.861899571193982e-03,
+	 2.409369130140169e-03,
+	 1.297991889027710e-03,
+	 5.282348203119482e-04,
+	 1.002635792932083e-04,
+	 0.000000000000000e+00,
+	 0.000000000000000e+00
+};
+constant double Gauss150Sin[152]={
+	 1.002635792931638e-04,
+	 5.282348203119553e-04,
+	 1.297991889027684e-03,
+	 2.409369130140019e-03,
+	 3.861899571193840e-03,
+	 5.654947343664278e-03,
+	 7.787718064631976e-03,
+	 1.025925846301383e-02,
+	 1.306845380436049e-02,
+	 1.621402444522642e-02,
+	 1.969452183262582e-02,
+	 2.350832405883689e-02,
+	 2.765363103060743e-02,
+	 3.212845929799676e-02,
+	 3.693063658503984e-02,
+	 4.205779606483998e-02,
+	 4.750737042330599e-02,
+	 5.327658575771883e-02,
+	 5.936245535833248e-02,
+	 6.576177342314188e-02,
+	 7.247110875771322e-02,
+	 7.948679851353598e-02,
+	 8.680494201969090e-02,
+	 9.442139476371803e-02,
+	 1.023317625783946e-01,
+	 1.105313960916856e-01,
+	 1.190153854973934e-01,
+	 1.277785557039984e-01,
+	 1.368154619188438e-01,
+	 1.461203857241605e-01,
+	 1.556873317004526e-01,
+	 1.655100246514607e-01,
+	 1.755819074832895e-01,
+	 1.858961397883228e-01,
+	 1.964455971822576e-01,
+	 2.072228714399680e-01,
+	 2.182202714729686e-01,
+	 2.294298251879868e-01,
+	 2.408432822625884e-01,
+	 2.524521178699392e-01,
+	 2.642475373806435e-01,
+	 2.762204820651886e-01,
+	 2.883616358158748e-01,
+	 3.006614329022186e-01,
+	 3.131100667687436e-01,
+	 3.256974998787985e-01,
+	 3.384134746026362e-01,
+	 3.512475251424492e-01,
+	 3.641889904814298e-01,
+	 3.772270283382457e-01,
+	 3.903506301026056e-01,
+	 4.035486367219062e-01,
+	 4.168097555032927e-01,
+	 4.301225777899097e-01,
+	 4.434755974646745e-01,
+	 4.568572302296213e-01,
+	 4.702558336037790e-01,
+	 4.836597275776872e-01,
+	 4.970572158580659e-01,
+	 5.104366076318698e-01,
+	 5.237862397750002e-01,
+	 5.370944994273603e-01,
+	 5.503498468527456e-01,
+	 5.635408384992771e-01,
+	 5.766561501737643e-01,
+	 5.896846002415013e-01,
+	 6.026151727616188e-01,
+	 6.154370404672173e-01,
+	 6.281395874991166e-01,
+	 6.407124318021821e-01,
+	 6.531454470938205e-01,
+	 6.654287843153959e-01,
+	 6.775528924789695e-01,
+	 6.895085388239337e-01,
+	 7.012868282007568e-01,
+	 7.128792216021744e-01,
+	 7.242775537657395e-01,
+	 7.354740497756409e-01,
+	 7.464613405961049e-01,
+	 7.572324774734727e-01,
+	 7.677809451491578e-01,
+	 7.781006738311178e-01,
+	 7.881860498771548e-01,
+	 7.980319251492914e-01,
+	 8.076336250045690e-01,
+	 8.169869548938790e-01,
+	 8.260882055467997e-01,
+	 8.349341567268400e-01,
+	 8.435220795479352e-01,
+	 8.518497373494729e-01,
+	 8.599153851334842e-01,
+	 8.677177675738973e-01,
+	 8.752561156138683e-01,
+	 8.825301416731414e-01,
+	 8.895400334931075e-01,
+	 8.962864466527148e-01,
+	 9.027704957935671e-01,
+	 9.089937445974452e-01,
+	 9.149581945640418e-01,
+	 9.206662726409058e-01,
+	 9.261208177614282e-01,
+	 9.313250663501531e-01,
+	 9.362826368577516e-01,
+	 9.409975133906417e-01,
+	 9.454740285024756e-01,
+	 9.497168452165482e-01,
+	 9.537309383495876e-01,
+	 9.575215752084090e-01,
+	 9.610942957315243e-01,
+	 9.644548921480286e-01,
+	 9.676093882259423e-01,
+	 9.705640181816876e-01,
+	 9.733252053215358e-01,
+	 9.758995404847078e-01,
+	 9.782937603563535e-01,
+	 9.805147257169095e-01,
+	 9.825693996923578e-01,
+	 9.844648260677116e-01,
+	 9.862081077236553e-01,
+	 9.878063852537061e-01,
+	 9.892668158165534e-01,
+	 9.905965522754122e-01,
+	 9.918027226733148e-01,
+	 9.928924100902911e-01,
+	 9.938726329253779e-01,
+	 9.947503256433742e-01,
+	 9.955323200232498e-01,
+	 9.962253269421322e-01,
+	 9.968359187258796e-01,
+	 9.973705120943910e-01,
+	 9.978353517270488e-01,
+	 9.982364944710397e-01,
+	 9.985797942127611e-01,
+	 9.988708874301336e-01,
+	 9.991151794413737e-01,
+	 9.993178313636877e-01,
+	 9.994837477933981e-01,
+	 9.996175652172300e-01,
+	 9.997236411628689e-01,
+	 9.998060440954456e-01,
+	 9.998685440653134e-01,
+	 9.999146041113528e-01,
+	 9.999473724230636e-01,
+	 9.999696752638781e-01,
+	 9.999840106574407e-01,
+	 9.999925428380464e-01,
+	 9.999970974659850e-01,
+	 9.999991576081732e-01,
+	 9.999998604839776e-01,
+	 9.999999949736074e-01,
+	 0.000000000000000e+00,
+	 0.000000000000000e+00
+};
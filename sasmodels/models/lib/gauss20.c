@@ -4,10 +4,14 @@
  # undef GAUSS_N
  # undef GAUSS_Z
  # undef GAUSS_W
+ # undef GAUSS_COS
+ # undef GAUSS_SIN
  #endif
  #define GAUSS_N 20
  #define GAUSS_Z Gauss20Z
  #define GAUSS_W Gauss20Wt
+ #define GAUSS_COS Gauss20Cos
+ #define GAUSS_SIN Gauss20Sin
 
 // Gaussians
 constant double Gauss20Wt[20]={
@@ -55,3 +59,49 @@ constant double Gauss20Z[20]={
 	.963971927277914,
 	.993128599185095
 };
+
+// cos(phi) and sin(phi) for phi = pi/4 (1 + z) in [0, pi/2] at the nodes z
+constant double Gauss20Cos[20]={
+	 9.999854373880469e-01,
+	 9.995996840903608e-01,
+	 9.976252047502733e-01,
+	 9.920275405310881e-01,
+	 9.802191726626536e-01,
+	 9.594243606084049e-01,
+	 9.271120168694080e-01,
+	 8.814417589150388e-01,
+	 8.216505521640560e-01,
+	 7.483041795406691e-01,
+	 6.633557528822419e-01,
+	 5.699915526817059e-01,
+	 4.722927329959276e-01,
+	 3.747843488945856e-01,
+	 2.819661261058736e-01,
+	 1.979150664920259e-01,
+	 1.260212633956685e-01,
+	 6.887634461101447e-02,
+	 2.829260621524545e-02,
+	 5.396759382870686e-03
+};
+constant double Gauss20Sin[20]={
+	 5.396759382870622e-03,
+	 2.829260621524523e-02,
+	 6.887634461101450e-02,
+	 1.260212633956684e-01,
+	 1.979150664920258e-01,
+	 2.819661261058737e-01,
+	 3.747843488945856e-01,
+	 4.722927329959275e-01,
+	 5.699915526817058e-01,
+	 6.633557528822420e-01,
+	 7.483041795406692e-01,
+	 8.216505521640560e-01,
+	 8.814417589150388e-01,
+	 9.271120168694080e-01,
+	 9.594243606084049e-01,
+	 9.802191726626535e-01,
+	 9.920275405310880e-01,
+	 9.976252047502733e-01,
+	 9.995996840903608e-01,
+	 9.999854373880469e-01
+};
@@ -4,10 +4,14 @@
  # undef GAUSS_N
  # undef GAUSS_Z
  # undef GAUSS_W
+ # undef GAUSS_COS
+ # undef GAUSS_SIN
  #endif
  #define GAUSS_N 76
  #define GAUSS_Z Gauss76Z
  #define GAUSS_W Gauss76Wt
+ #define GAUSS_COS Gauss76Cos
+ #define GAUSS_SIN Gauss76Sin
 
 // Gaussians
 constant double Gauss76Wt[76] = {
@@ -167,3 +171,161 @@ constant double Gauss76Z[76] = {
 	.997397786355355,
 	.999505948362153		//75
 };
+
+// cos(phi) and sin(phi) for phi = pi/4 (1 + z) in [0, pi/2] at the nodes z
+constant double Gauss76Cos[76]={
+	 9.999999247174279e-01,
+	 9.999979114950189e-01,
+	 9.999874015424079e-01,
+	 9.999566499307031e-01,
+	 9.998888238924654e-01,
+	 9.997621471062758e-01,
+	 9.995500882403174e-01,
+	 9.992215936409453e-01,
+	 9.987413638728661e-01,
+	 9.980701736082810e-01,
+	 9.971652340883209e-01,
+	 9.959805970352570e-01,
+	 9.944675984775696e-01,
+	 9.925753404647586e-01,
+	 9.902512081009116e-01,
+	 9.874414187249902e-01,
+	 9.840915994242234e-01,
+	 9.801473884005871e-01,
+	 9.755550550374379e-01,
+	 9.702621328544466e-01,
+	 9.642180589162068e-01,
+	 9.573748126962872e-01,
+	 9.496875469173405e-01,
+	 9.411152025117137e-01,
+	 9.316210995968986e-01,
+	 9.211734962547908e-01,
+	 9.097461069585330e-01,
+	 8.973185727171403e-01,
+	 8.838768754129469e-01,
+	 8.694136893917477e-01,
+	 8.539286641263732e-01,
+	 8.374286327016740e-01,
+	 8.199277419471213e-01,
+	 8.014475012517497e-01,
+	 7.820167484093161e-01,
+	 7.616715322294568e-01,
+	 7.404549130801977e-01,
+	 7.184166839628723e-01,
+	 6.956130161259136e-01,
+	 6.721060345625509e-01,
+	 6.479633299741826e-01,
+	 6.232574148835459e-01,
+	 5.980651325209710e-01,
+	 5.724670278588060e-01,
+	 5.465466907148965e-01,
+	 5.203900811731021e-01,
+	 4.940848476711564e-01,
+	 4.677196479839669e-01,
+	 4.413834829905558e-01,
+	 4.151650525680039e-01,
+	 3.891521422242525e-01,
+	 3.634310481863999e-01,
+	 3.380860476289079e-01,
+	 3.131989195864576e-01,
+	 2.888485208803205e-01,
+	 2.651104201269016e-01,
+	 2.420565916242322e-01,
+	 2.197551696568289e-01,
+	 1.982702625496536e-01,
+	 1.776618246632455e-01,
+	 1.579855834763998e-01,
+	 1.392930179681846e-01,
+	 1.216313837020223e-01,
+	 1.050437793410701e-01,
+	 8.956924879272514e-02,
+	 7.524291279306049e-02,
+	 6.209612349845908e-02,
+	 5.015663554672831e-02,
+	 3.944878707450374e-02,
+	 2.999368431476415e-02,
+	 2.180938361002959e-02,
+	 1.491106484938046e-02,
+	 9.311190008013193e-03,
+	 5.019637084796509e-03,
+	 2.043772394461318e-03,
+	 3.880272392515074e-04
+};
+constant double Gauss76Sin[76]={
+	 3.880272392512995e-04,
+	 2.043772394461141e-03,
+	 5.019637084796367e-03,
+	 9.311190008013002e-03,
+	 1.491106484938039e-02,
+	 2.180938361002953e-02,
+	 2.999368431476416e-02,
+	 3.944878707450359e-02,
+	 5.015663554672815e-02,
+	 6.209612349845908e-02,
+	 7.524291279306043e-02,
+	 8.956924879272504e-02,
+	 1.050437793410701e-01,
+	 1.216313837020223e-01,
+	 1.392930179681846e-01,
+	 1.579855834763998e-01,
+	 1.776618246632454e-01,
+	 1.982702625496535e-01,
+	 2.197551696568288e-01,
+	 2.420565916242320e-01,
+	 2.651104201269015e-01,
+	 2.888485208803207e-01,
+	 3.131989195864576e-01,
+	 3.380860476289080e-01,
+	 3.634310481863999e-01,
+	 3.891521422242525e-01,
+	 4.151650525680038e-01,
+	 4.413834829905557e-01,
+	 4.677196479839669e-01,
+	 4.940848476711563e-01,
+	 5.203900811731018e-01,
+	 5.465466907148965e-01,
+	 5.724670278588060e-01,
+	 5.980651325209710e-01,
+	 6.232574148835459e-01,
+	 6.479633299741826e-01,
+	 6.721060345625508e-01,
+	 6.956130161259135e-01,
+	 7.184166839628723e-01,
+	 7.404549130801977e-01,
+	 7.616715322294568e-01,
+	 7.820167484093160e-01,
+	 8.014475012517497e-01,
+	 8.199277419471213e-01,
+	 8.374286327016740e-01,
+	 8.539286641263731e-01,
+	 8.694136893917476e-01,
+	 8.838768754129469e-01,
+	 8.973185727171403e-01,
+	 9.097461069585330e-01,
+	 9.211734962547908e-01,
+	 9.316210995968986e-01,
+	 9.411152025117137e-01,
+	 9.496875469173405e-01,
+	 9.573748126962872e-01,
+	 9.642180589162068e-01,
+	 9.702621328544465e-01,
+	 9.755550550374378e-01,
+	 9.801473884005871e-01,
+	 9.840915994242234e-01,
+	 9.874414187249902e-01,
+	 9.902512081009116e-01,
+	 9.925753404647586e-01,
+	 9.944675984775696e-01,
+	 9.959805970352570e-01,
+	 9.971652340883209e-01,
+	 9.980701736082810e-01,
+	 9.987413638728661e-01,
+	 9.992215936409453e-01,
+	 9.995500882403174e-01,
+	 9.997621471062758e-01,
+	 9.998888238924654e-01,
+	 9.999566499307031e-01,
+	 9.999874015424079e-01,
+	 9.999979114950189e-01,
+	 9.999999247174279e-01
+};
@@ -0,0 +1,70 @@
+// Two dimensional Gauss-Legendre integration for double integral models.
+//
+// Models with an outer integral over x in [0, 1], usually cos(theta), and
+// an inner integral over an angle phi in [0, pi/2] share the tensor product
+// of the model's gauss rule on both axes.  Angles on [0, pi] use the same
+// nodes as 2*phi, with cos(2 phi) = cos^2(phi) - sin^2(phi).  The cosine and
+// sine of phi at the nodes come from GAUSS_COS and GAUSS_SIN, which come
+// with the rule in lib/gauss<n>.c or lib/gauss_table.c, so the inner loop
+// has no trig calls beyond those in the integrand.
+//
+// The nodes for phi and pi/2 - phi have the same weight, with the cosine
+// and sine exchanged, so the inner loop walks the pairs of nodes and
+// evaluates the integrand at both points as independent lanes.  When the
+// computed integrand is symmetric under phi -> pi/2 - phi, as for a shape
+// which is unchanged when a and b are exchanged and whose amplitude is
+// computed the same way for both, the second point is skipped and the
+// first counted twice, halving the work.
+//
+// Work which depends only on x is done once for each row by the row
+// function, which leaves its results in a small array for the integrand.
+// The accuracy is set by the order of the gauss rule, so the order chosen
+// with set_integration_order applies to every model using GAUSS_2D.
+//
+// Note: needs lib/gauss<n>.c in the model source list.
+
+// Number of values the row function can leave for the integrand.
+#define GAUSS_2D_ROW 4
+
+// GAUSS_2D(_F1, _F2, _fold, _row, _fn, ...) sets _F1 and _F2 to the average
+// over x in [0, 1] and phi in [0, pi/2] of the pair returned by
+//     _row(x, ..., row)
+//     _fn(row, cos_phi, sin_phi, ..., &f1, &f2)
+// where ... are the extra arguments to GAUSS_2D and row is an array of
+// GAUSS_2D_ROW values filled by _row for each x.  Set _fold to 1 if
+// _fn is unchanged when cos_phi and sin_phi are exchanged.
+//
+// Note: OpenCL does not support function pointers, so the integrand is
+// passed to a macro rather than a function.
+#define GAUSS_2D(_F1, _F2, _fold, _row, _fn, ...) do { \
+    const int _half = GAUSS_N/2; \
+    double _sum1 = 0.0, _sum2 = 0.0; \
+    for (int _i = 0; _i < GAUSS_N; _i++) { \
+        double _r[GAUSS_2D_ROW]; \
+        _row(0.5*(GAUSS_Z[_i] + 1.0), __VA_ARGS__, _r); \
+        double _row1 = 0.0, _row2 = 0.0; \
+        for (int _j = 0; _j < _half; _j++) { \
+            const double _c = GAUSS_COS[_j], _s = GAUSS_SIN[_j]; \
+            double _f1, _f2, _g1, _g2; \
+            _fn(_r, _c, _s, __VA_ARGS__, &_f1, &_f2); \
+            if (_fold) { \
+                _g1 = _f1; _g2 = _f2; \
+            } else { \
+                _fn(_r, _s, _c, __VA_ARGS__, &_g1, &_g2); \
+            } \
+            _row1 += GAUSS_W[_j]*(_f1 + _g1); \
+            _row2 += GAUSS_W[_j]*(_f2 + _g2); \
+        } \
+        if (GAUSS_N%2) { \
+            double _f1, _f2; \
+            _fn(_r, GAUSS_COS[_half], GAUSS_SIN[_half], __VA_ARGS__, \
+                &_f1, &_f2); \
+            _row1 += GAUSS_W[_half]*_f1; \
+            _row2 += GAUSS_W[_half]*_f2; \
+        } \
+        _sum1 += GAUSS_W[_i]*_row1; \
+        _sum2 += GAUSS_W[_i]*_row2; \
+    } \
+    _F1 = 0.25*_sum1; \
+    _F2 = 0.25*_sum2; \
+} while (0)
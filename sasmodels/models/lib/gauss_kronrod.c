@@ -0,0 +1,111 @@
+// Adaptive Gauss-Kronrod quadrature for orientation averages.
+//
+// Each panel is integrated with the 15 point Kronrod rule, and the
+// difference from the embedded 7 point Gauss rule is used as the error
+// estimate.  As in QUADPACK qag, the panel with the largest error is split
+// in half until the total error is below GK_TOLERANCE relative to the
+// estimate of <F^2>, or until there are GK_MAX_PANELS panels.  The
+// tolerance is set by generate.py from SAS_GK_TOLERANCE.  Models use
+// GK_INTEGRATE when GK_TOLERANCE is defined, and their fixed gauss rule
+// otherwise.
+//
+// Node and weight values are from QUADPACK qk15.
+
+#ifndef GK_MAX_PANELS
+// Upper limit on the number of 15 point panels for each integral, which
+// bounds the cost at high q for large aspect ratio shapes.
+#  define GK_MAX_PANELS 64
+#endif
+
+// Non-negative Kronrod nodes on [-1,1], with the Gauss nodes at the odd
+// indices, and their weights.
+constant double GK15_X[8] = {
+    0.991455371120812639206854697526329,
+    0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013,
+    0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+    0.000000000000000000000000000000000,
+};
+constant double GK15_WK[8] = {
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714,
+};
+constant double GK15_WG[4] = {
+    0.129484966168869693270611432679082,
+    0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975,
+    0.417959183673469387755102040816327,
+};
+
+// GK_PANEL(_lo, _hi, _F1, _F2, _err, _fn, ...) applies the 15 point rule
+// to the pair of functions returned by _fn(x, ..., &f1, &f2) over [_lo, _hi],
+// with the error estimate based on f2.
+#define GK_PANEL(_lo, _hi, _F1, _F2, _err, _fn, ...) do { \
+    const double _half = 0.5*(_hi - _lo), _mid = 0.5*(_hi + _lo); \
+    double _f1, _f2, _fl1, _fl2, _fr1, _fr2; \
+    _fn(_mid, __VA_ARGS__, &_f1, &_f2); \
+    double _k1 = GK15_WK[7]*_f1, _k2 = GK15_WK[7]*_f2; \
+    double _g2 = GK15_WG[3]*_f2; \
+    for (int _j = 0; _j < 7; _j++) { \
+        const double _dx = _half*GK15_X[_j]; \
+        _fn(_mid - _dx, __VA_ARGS__, &_fl1, &_fl2); \
+        _fn(_mid + _dx, __VA_ARGS__, &_fr1, &_fr2); \
+        _k1 += GK15_WK[_j]*(_fl1 + _fr1); \
+        _k2 += GK15_WK[_j]*(_fl2 + _fr2); \
+        if (_j%2 == 1) _g2 += GK15_WG[_j/2]*(_fl2 + _fr2); \
+    } \
+    _F1 = _half*_k1; \
+    _F2 = _half*_k2; \
+    _err = fabs(_half*(_k2 - _g2)); \
+} while (0)
+
+// GK_INTEGRATE(_a, _b, _F1, _F2, _fn, ...) sets _F1 and _F2 to the
+// integrals from _a to _b of the pair of functions returned by
+//     _fn(x, ..., &f1, &f2)
+// where ... are the extra arguments to GK_INTEGRATE.  The error estimate
+// is based on f2, which is the non-negative <F^2> integrand.
+//
+// Note: OpenCL does not support function pointers, so the integrand is
+// passed to a macro rather than a function.
+#define GK_INTEGRATE(_a, _b, _F1, _F2, _fn, ...) do { \
+    double _gk_lo[GK_MAX_PANELS], _gk_hi[GK_MAX_PANELS]; \
+    double _gk_F1[GK_MAX_PANELS], _gk_F2[GK_MAX_PANELS]; \
+    double _gk_err[GK_MAX_PANELS]; \
+    _gk_lo[0] = _a; _gk_hi[0] = _b; \
+    GK_PANEL(_gk_lo[0], _gk_hi[0], _gk_F1[0], _gk_F2[0], _gk_err[0], \
+             _fn, __VA_ARGS__); \
+    int _gk_n = 1; \
+    while (_gk_n < GK_MAX_PANELS) { \
+        double _total = 0.0, _error = 0.0, _worst = -1.0; \
+        int _k = 0; \
+        for (int _i = 0; _i < _gk_n; _i++) { \
+            _total += _gk_F2[_i]; \
+            _error += _gk_err[_i]; \
+            if (_gk_err[_i] > _worst) { _worst = _gk_err[_i]; _k = _i; } \
+        } \
+        if (_error <= GK_TOLERANCE*fabs(_total)) break; \
+        const double _split = 0.5*(_gk_lo[_k] + _gk_hi[_k]); \
+        _gk_lo[_gk_n] = _split; _gk_hi[_gk_n] = _gk_hi[_k]; \
+        _gk_hi[_k] = _split; \
+        GK_PANEL(_gk_lo[_k], _gk_hi[_k], _gk_F1[_k], _gk_F2[_k], _gk_err[_k], \
+                 _fn, __VA_ARGS__); \
+        GK_PANEL(_gk_lo[_gk_n], _gk_hi[_gk_n], \
+                 _gk_F1[_gk_n], _gk_F2[_gk_n], _gk_err[_gk_n], \
+                 _fn, __VA_ARGS__); \
+        _gk_n++; \
+    } \
+    _F1 = _F2 = 0.0; \
+    for (int _i = 0; _i < _gk_n; _i++) { \
+        _F1 += _gk_F1[_i]; \
+        _F2 += _gk_F2[_i]; \
+    } \
+} while (0)
@@ -0,0 +1,59 @@
+// Gauss-Legendre quadrature with the order chosen at run time.
+//
+// generate.py includes this in place of lib/gauss<n>.c, defining the n
+// point rule as GAUSS_TABLE_N with the nodes and weights in GAUSS_TABLE_Z
+// and GAUSS_TABLE_W, and cos(phi) and sin(phi) for the nodes mapped to
+// phi in [0, pi/2] in GAUSS_TABLE_COS and GAUSS_TABLE_SIN, all padded to a
+// multiple of 4.  The dll and CUDA kernels
+// read the rule from module memory with room for GAUSS_MAX_N points, which
+// the host overwrites to change the order without recompiling (see
+// KernelModel.set_integration_order).  The rule is in aligned static
+// memory in the dll and in constant memory on the GPU.
+//
+// OpenCL C 1.2 has no writable program scope memory, so OpenCL programs
+// use lib/gauss<n>.c for the order in the model source, and are built
+// with the rule defined by the host for any other order.  The programs
+// for each order are cached like any other program.
+
+#if defined(USE_OPENCL)
+
+constant double gauss_table_z[] = GAUSS_TABLE_Z;
+constant double gauss_table_w[] = GAUSS_TABLE_W;
+constant double gauss_table_cos[] = GAUSS_TABLE_COS;
+constant double gauss_table_sin[] = GAUSS_TABLE_SIN;
+#define GAUSS_N GAUSS_TABLE_N
+
+#elif defined(USE_CUDA)
+
+extern "C" {
+__constant__ int32_t gauss_table_n = GAUSS_TABLE_N;
+__constant__ double gauss_table_z[GAUSS_MAX_N] = GAUSS_TABLE_Z;
+__constant__ double gauss_table_w[GAUSS_MAX_N] = GAUSS_TABLE_W;
+__constant__ double gauss_table_cos[GAUSS_MAX_N] = GAUSS_TABLE_COS;
+__constant__ double gauss_table_sin[GAUSS_MAX_N] = GAUSS_TABLE_SIN;
+}
+#define GAUSS_N gauss_table_n
+
+#else // dll
+
+#if defined(_MSC_VER)
+#  define GAUSS_ALIGN __declspec(align(64))
+#else
+#  define GAUSS_ALIGN __attribute__((aligned(64)))
+#endif
+// Exported with the kernels so that the host can find them.  The item
+// size tells the host the precision of the table after type conversion.
+kernel int32_t gauss_table_n = GAUSS_TABLE_N;
+kernel int32_t gauss_table_itemsize = sizeof(double);
+kernel GAUSS_ALIGN double gauss_table_z[GAUSS_MAX_N] = GAUSS_TABLE_Z;
+kernel GAUSS_ALIGN double gauss_table_w[GAUSS_MAX_N] = GAUSS_TABLE_W;
+kernel GAUSS_ALIGN double gauss_table_cos[GAUSS_MAX_N] = GAUSS_TABLE_COS;
+kernel GAUSS_ALIGN double gauss_table_sin[GAUSS_MAX_N] = GAUSS_TABLE_SIN;
+#define GAUSS_N gauss_table_n
+
+#endif
+
+#define GAUSS_Z gauss_table_z
+#define GAUSS_W gauss_table_w
+#define GAUSS_COS gauss_table_cos
+#define GAUSS_SIN gauss_table_sin
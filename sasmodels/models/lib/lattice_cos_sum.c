@@ -0,0 +1,18 @@
+// Requires lib/lattice_reinsch.c
+
+// sum_{k=1}^{n-1} (n-k) r^k cos(k x)
+static double
+lattice_cos_sum(int n, double x, double r)
+{
+    double s, lambda;
+    (void)_lattice_reinsch(x, &s, &lambda);
+    const double a = r*lambda;
+    const double c = s*r;
+    double b = 0.0, d = 0.0;
+    for (int k=n-1; k >= 1; k--) {
+        d = (double)(n-k) + a*b + c*d;
+        b = d + c*b;
+    }
+    // b and d now hold b_1 and d_1, with c_0 = 0
+    return 0.5*a*b + c*d;
+}
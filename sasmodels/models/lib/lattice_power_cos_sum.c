@@ -0,0 +1,68 @@
+// Sum over the pairs of n equally spaced layers with power law damping.
+// There are n-k pairs separated by k spacings, so the sum has the form
+//
+//     sum_{k=1}^{n-1} (n-k) f(k)
+
+// Relative error allowed by lattice_power_cos_sum, and the number of terms
+// between restarts of its recurrences from exact values.
+#if FLOAT_SIZE > 4
+#  define LATTICE_POWER_TOLERANCE 1e-14
+#else
+#  define LATTICE_POWER_TOLERANCE 1e-7
+#endif
+#define LATTICE_RESTART 32
+
+// sum_{k=1}^{n-1} (n-k) k^-p cos(k x) for p >= 0
+//
+// This is the pair sum of the Caille structure factor.  Rather than calls
+// to pow and cos for every term, cos(k x) + i sin(k x) is advanced by a
+// rotation through x, and k^-p by the ratio
+//
+//     ((k+1)/k)^-p = exp(-2 p atanh(u)),  u = 1/(2k+1)
+//
+// from short series in u and in the exponent once k >= 8 and p/k is small.
+// Both restart from exact values every LATTICE_RESTART terms so the
+// rounding error doesn't grow with n.  The sum stops once the remaining
+// terms add less than LATTICE_POWER_TOLERANCE times n, the k=0 term of
+// the full lattice sum, which for large p leaves only the first few layers.
+static double
+lattice_power_cos_sum(int n, double x, double p)
+{
+    double sin_x, cos_x;
+    SINCOS(x, sin_x, cos_x);
+    double sum = 0.0;
+    double a = 0.0, re = 0.0, im = 0.0;
+    for (int k=1; k < n; k++) {
+        if ((k-1)%LATTICE_RESTART == 0) {
+            // a = k^-p, with the bound on the tail for p > 1 of
+            //     sum_{j>=k} (n-j) j^-p < (n-k) k^-p (1 + k/(p-1))
+            a = pow((double)k, -p);
+            if (p > 1.0
+                && (n-k)*a*(1.0 + k/(p-1.0)) < LATTICE_POWER_TOLERANCE*n) {
+                break;
+            }
+            SINCOS(k*x, im, re);
+        }
+        sum += (n-k)*a*re;
+
+        // rotate by x
+        const double t = re*cos_x - im*sin_x;
+        im = re*sin_x + im*cos_x;
+        re = t;
+
+        // scale by ((k+1)/k)^-p
+        const double u = 1.0/(2*k + 1);
+        const double y = 2.0*p*u;
+        if (k >= 8 && y < 0.0625) {
+            const double u2 = u*u;
+            const double z = -y*(1.0 + u2*(1.0/3.0 + u2*(1.0/5.0
+                + u2*(1.0/7.0 + u2*(1.0/9.0 + u2*(1.0/11.0))))));
+            a *= 1.0 + z*(1.0 + z*(1.0/2.0 + z*(1.0/6.0 + z*(1.0/24.0
+                + z*(1.0/120.0 + z*(1.0/720.0 + z*(1.0/5040.0
+                + z*(1.0/40320.0))))))));
+        } else {
+            a = pow((double)(k+1), -p);
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,16 @@
+// Requires lib/lattice_reinsch.c
+
+// sum_{k=1}^{n-1} (n-k) sin(k x)/(k x)
+static double
+lattice_sinc_sum(int n, double x)
+{
+    double s, lambda;
+    const double sin_x = _lattice_reinsch(x, &s, &lambda);
+    double b = 0.0, d = 0.0;
+    for (int k=n-1; k >= 1; k--) {
+        d = (double)(n-k)/(double)k + lambda*b + s*d;
+        b = d + s*b;
+    }
+    // the sine sum is b_1 sin(x), scaled by 1/x
+    return b*(x == 0.0 ? 1.0 : sin_x/x);
+}
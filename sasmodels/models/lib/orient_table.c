@@ -0,0 +1,2048 @@
+// Generated by sasmodels.gengauss.genorient()
+
+// The tables are only used by the adaptive orientation average.
+#if defined(ORIENT_RESOLUTION)
+#define ORIENT_NUM_TABLES 7
+#define ORIENT_MIN_SIZE 4
+
+constant double ORIENT_Z[508]={
+	 1.834346424956498e-01,
+	 5.255324099163290e-01,
+	 7.966664774136268e-01,
+	 9.602898564975363e-01,
+	 9.501250983763744e-02,
+	 2.816035507792589e-01,
+	 4.580167776572274e-01,
+	 6.178762444026438e-01,
+	 7.554044083550030e-01,
+	 8.656312023878318e-01,
+	 9.445750230732326e-01,
+	 9.894009349916499e-01,
+	 4.830766568773830e-02,
+	 1.444719615827965e-01,
+	 2.392873622521371e-01,
+	 3.318686022821277e-01,
+	 4.213512761306353e-01,
+	 5.068999089322294e-01,
+	 5.877157572407623e-01,
+	 6.630442669302152e-01,
+	 7.321821187402897e-01,
+	 7.944837959679424e-01,
+	 8.493676137325700e-01,
+	 8.963211557660521e-01,
+	 9.349060759377397e-01,
+	 9.647622555875064e-01,
+	 9.856115115452684e-01,
+	 9.972638618494816e-01,
+	 2.435029266342443e-02,
+	 7.299312178779904e-02,
+	 1.214628192961206e-01,
+	 1.696444204239928e-01,
+	 2.174236437400071e-01,
+	 2.646871622087674e-01,
+	 3.113228719902110e-01,
+	 3.572201583376681e-01,
+	 4.022701579639916e-01,
+	 4.463660172534641e-01,
+	 4.894031457070530e-01,
+	 5.312794640198946e-01,
+	 5.718956462026340e-01,
+	 6.111553551723933e-01,
+	 6.489654712546573e-01,
+	 6.852363130542333e-01,
+	 7.198818501716109e-01,
+	 7.528199072605319e-01,
+	 7.839723589433414e-01,
+	 8.132653151227975e-01,
+	 8.406292962525804e-01,
+	 8.659993981540929e-01,
+	 8.893154459951141e-01,
+	 9.105221370785028e-01,
+	 9.295691721319396e-01,
+	 9.464113748584028e-01,
+	 9.610087996520538e-01,
+	 9.733268277899110e-01,
+	 9.833362538846260e-01,
+	 9.910133714767443e-01,
+	 9.963401167719552e-01,
+	 9.993050417357722e-01,
+	 1.222369896061576e-02,
+	 3.666379096873349e-02,
+	 6.108196960413956e-02,
+	 8.546364050451549e-02,
+	 1.097942311276437e-01,
+	 1.340591994611878e-01,
+	 1.582440427142249e-01,
+	 1.823343059853372e-01,
+	 2.063155909020792e-01,
+	 2.301735642266600e-01,
+	 2.538939664226943e-01,
+	 2.774626201779044e-01,
+	 3.008654388776772e-01,
+	 3.240884350244134e-01,
+	 3.471177285976355e-01,
+	 3.699395553498590e-01,
+	 3.925402750332674e-01,
+	 4.149063795522750e-01,
+	 4.370245010371042e-01,
+	 4.588814198335522e-01,
+	 4.804640724041720e-01,
+	 5.017595591361445e-01,
+	 5.227551520511755e-01,
+	 5.434383024128103e-01,
+	 5.637966482266181e-01,
+	 5.838180216287631e-01,
+	 6.034904561585486e-01,
+	 6.228021939105849e-01,
+	 6.417416925623075e-01,
+	 6.602976322726460e-01,
+	 6.784589224477192e-01,
+	 6.962147083695144e-01,
+	 7.135543776835874e-01,
+	 7.304675667419088e-01,
+	 7.469441667970620e-01,
+	 7.629743300440948e-01,
+	 7.785484755064119e-01,
+	 7.936572947621933e-01,
+	 8.082917575079137e-01,
+	 8.224431169556439e-01,
+	 8.361029150609068e-01,
+	 8.492629875779689e-01,
+	 8.619154689395485e-01,
+	 8.740527969580318e-01,
+	 8.856677173453972e-01,
+	 8.967532880491582e-01,
+	 9.073028834017568e-01,
+	 9.173101980809605e-01,
+	 9.267692508789478e-01,
+	 9.356743882779164e-01,
+	 9.440202878302202e-01,
+	 9.518019613412644e-01,
+	 9.590147578536999e-01,
+	 9.656543664319652e-01,
+	 9.717168187471366e-01,
+	 9.771984914639074e-01,
+	 9.820961084357185e-01,
+	 9.864067427245862e-01,
+	 9.901278184917344e-01,
+	 9.932571129002129e-01,
+	 9.957927585349812e-01,
+	 9.977332486255140e-01,
+	 9.990774599773760e-01,
+	 9.998248879471319e-01,
+	 6.123912375189531e-03,
+	 1.837081847881367e-02,
+	 3.061496877997903e-02,
+	 4.285452653637910e-02,
+	 5.508765569463398e-02,
+	 6.731252116571640e-02,
+	 7.952728910023296e-02,
+	 9.173012716351955e-02,
+	 1.039192048105094e-01,
+	 1.160926935603328e-01,
+	 1.282487672706071e-01,
+	 1.403856024113759e-01,
+	 1.525013783386564e-01,
+	 1.645942775675538e-01,
+	 1.766624860449020e-01,
+	 1.887041934213888e-01,
+	 2.007175933231267e-01,
+	 2.127008836226260e-01,
+	 2.246522667091320e-01,
+	 2.365699497582840e-01,
+	 2.484521450010567e-01,
+	 2.602970699919425e-01,
+	 2.721029478763366e-01,
+	 2.838680076570818e-01,
+	 2.955904844601356e-01,
+	 3.072686197993191e-01,
+	 3.189006618401063e-01,
+	 3.304848656624170e-01,
+	 3.420194935223717e-01,
+	 3.535028151129700e-01,
+	 3.649331078236540e-01,
+	 3.763086569987164e-01,
+	 3.876277561945156e-01,
+	 3.988887074354591e-01,
+	 4.100898214687165e-01,
+	 4.212294180176238e-01,
+	 4.323058260337413e-01,
+	 4.433173839475273e-01,
+	 4.542624399175900e-01,
+	 4.651393520784793e-01,
+	 4.759464887869833e-01,
+	 4.866822288668903e-01,
+	 4.973449618521815e-01,
+	 5.079330882286160e-01,
+	 5.184450196736745e-01,
+	 5.288791792948223e-01,
+	 5.392340018660592e-01,
+	 5.495079340627186e-01,
+	 5.596994346944811e-01,
+	 5.698069749365687e-01,
+	 5.798290385590830e-01,
+	 5.897641221544543e-01,
+	 5.996107353629683e-01,
+	 6.093674010963339e-01,
+	 6.190326557592613e-01,
+	 6.286050494690150e-01,
+	 6.380831462729114e-01,
+	 6.474655243637248e-01,
+	 6.567507762929732e-01,
+	 6.659375091820485e-01,
+	 6.750243449311628e-01,
+	 6.840099204260760e-01,
+	 6.928928877425770e-01,
+	 7.016719143486851e-01,
+	 7.103456833045433e-01,
+	 7.189128934599714e-01,
+	 7.273722596496521e-01,
+	 7.357225128859178e-01,
+	 7.439624005491116e-01,
+	 7.520906865754921e-01,
+	 7.601061516426555e-01,
+	 7.680075933524456e-01,
+	 7.757938264113258e-01,
+	 7.834636828081838e-01,
+	 7.910160119895460e-01,
+	 7.984496810321707e-01,
+	 8.057635748129987e-01,
+	 8.129565961764316e-01,
+	 8.200276660989171e-01,
+	 8.269757238508125e-01,
+	 8.337997271555049e-01,
+	 8.404986523457627e-01,
+	 8.470714945172962e-01,
+	 8.535172676795030e-01,
+	 8.598350049033764e-01,
+	 8.660237584665545e-01,
+	 8.720825999954883e-01,
+	 8.780106206047066e-01,
+	 8.838069310331583e-01,
+	 8.894706617776109e-01,
+	 8.950009632230845e-01,
+	 9.003970057703036e-01,
+	 9.056579799601446e-01,
+	 9.107830965950650e-01,
+	 9.157715868574904e-01,
+	 9.206227024251465e-01,
+	 9.253357155833162e-01,
+	 9.299099193340057e-01,
+	 9.343446275020031e-01,
+	 9.386391748378148e-01,
+	 9.427929171174625e-01,
+	 9.468052312391275e-01,
+	 9.506755153166283e-01,
+	 9.544031887697163e-01,
+	 9.579876924111781e-01,
+	 9.614284885307322e-01,
+	 9.647250609757064e-01,
+	 9.678769152284895e-01,
+	 9.708835784807430e-01,
+	 9.737445997043704e-01,
+	 9.764595497192342e-01,
+	 9.790280212576220e-01,
+	 9.814496290254644e-01,
+	 9.837240097603155e-01,
+	 9.858508222861260e-01,
+	 9.878297475648606e-01,
+	 9.896604887450652e-01,
+	 9.913427712075831e-01,
+	 9.928763426088221e-01,
+	 9.942609729224097e-01,
+	 9.954964544810964e-01,
+	 9.965826020233816e-01,
+	 9.975192527567208e-01,
+	 9.983062664730065e-01,
+	 9.989435258434088e-01,
+	 9.994309374662614e-01,
+	 9.997684374092631e-01,
+	 9.999560500189922e-01,
+	 3.064962185159397e-03,
+	 9.194771386432913e-03,
+	 1.532423508489819e-02,
+	 2.145312295977488e-02,
+	 2.758120471191979e-02,
+	 3.370825007248059e-02,
+	 3.983402881154845e-02,
+	 4.595831074680906e-02,
+	 5.208086575219207e-02,
+	 5.820146376651824e-02,
+	 6.431987480214424e-02,
+	 7.043586895360469e-02,
+	 7.654921640625105e-02,
+	 8.265968744488716e-02,
+	 8.876705246240103e-02,
+	 9.487108196839254e-02,
+	 1.009715465977968e-01,
+	 1.070682171195027e-01,
+	 1.131608644449665e-01,
+	 1.192492596368204e-01,
+	 1.253331739174745e-01,
+	 1.314123786777137e-01,
+	 1.374866454852881e-01,
+	 1.435557460934960e-01,
+	 1.496194524497613e-01,
+	 1.556775367042019e-01,
+	 1.617297712181921e-01,
+	 1.677759285729161e-01,
+	 1.738157815779134e-01,
+	 1.798491032796159e-01,
+	 1.858756669698757e-01,
+	 1.918952461944840e-01,
+	 1.979076147616805e-01,
+	 2.039125467506524e-01,
+	 2.099098165200239e-01,
+	 2.158991987163350e-01,
+	 2.218804682825090e-01,
+	 2.278534004663096e-01,
+	 2.338177708287859e-01,
+	 2.397733552527062e-01,
+	 2.457199299509792e-01,
+	 2.516572714750633e-01,
+	 2.575851567233626e-01,
+	 2.635033629496103e-01,
+	 2.694116677712386e-01,
+	 2.753098491777350e-01,
+	 2.811976855389846e-01,
+	 2.870749556135980e-01,
+	 2.929414385572244e-01,
+	 2.987969139308507e-01,
+	 3.046411617090842e-01,
+	 3.104739622884204e-01,
+	 3.162950964954949e-01,
+	 3.221043455953188e-01,
+	 3.279014912994984e-01,
+	 3.336863157744371e-01,
+	 3.394586016495210e-01,
+	 3.452181320252867e-01,
+	 3.509646904815714e-01,
+	 3.566980610856456e-01,
+	 3.624180284003264e-01,
+	 3.681243774920731e-01,
+	 3.738168939390634e-01,
+	 3.794953638392505e-01,
+	 3.851595738184011e-01,
+	 3.908093110381125e-01,
+	 3.964443632038105e-01,
+	 4.020645185727270e-01,
+	 4.076695659618556e-01,
+	 4.132592947558876e-01,
+	 4.188334949151263e-01,
+	 4.243919569833787e-01,
+	 4.299344720958266e-01,
+	 4.354608319868747e-01,
+	 4.409708289979767e-01,
+	 4.464642560854375e-01,
+	 4.519409068281941e-01,
+	 4.574005754355713e-01,
+	 4.628430567550148e-01,
+	 4.682681462798001e-01,
+	 4.736756401567166e-01,
+	 4.790653351937285e-01,
+	 4.844370288676086e-01,
+	 4.897905193315499e-01,
+	 4.951256054227486e-01,
+	 5.004420866699644e-01,
+	 5.057397633010522e-01,
+	 5.110184362504699e-01,
+	 5.162779071667575e-01,
+	 5.215179784199908e-01,
+	 5.267384531092077e-01,
+	 5.319391350698066e-01,
+	 5.371198288809178e-01,
+	 5.422803398727462e-01,
+	 5.474204741338866e-01,
+	 5.525400385186102e-01,
+	 5.576388406541219e-01,
+	 5.627166889477890e-01,
+	 5.677733925943407e-01,
+	 5.728087615830374e-01,
+	 5.778226067048111e-01,
+	 5.828147395593745e-01,
+	 5.877849725623008e-01,
+	 5.927331189520721e-01,
+	 5.976589927970977e-01,
+	 6.025624090026994e-01,
+	 6.074431833180683e-01,
+	 6.123011323431869e-01,
+	 6.171360735357212e-01,
+	 6.219478252178794e-01,
+	 6.267362065832393e-01,
+	 6.315010377035416e-01,
+	 6.362421395354517e-01,
+	 6.409593339272864e-01,
+	 6.456524436257089e-01,
+	 6.503212922823893e-01,
+	 6.549657044606303e-01,
+	 6.595855056419603e-01,
+	 6.641805222326905e-01,
+	 6.687505815704384e-01,
+	 6.732955119306152e-01,
+	 6.778151425328788e-01,
+	 6.823093035475509e-01,
+	 6.867778261019991e-01,
+	 6.912205422869816e-01,
+	 6.956372851629570e-01,
+	 7.000278887663572e-01,
+	 7.043921881158238e-01,
+	 7.087300192184071e-01,
+	 7.130412190757285e-01,
+	 7.173256256901053e-01,
+	 7.215830780706379e-01,
+	 7.258134162392593e-01,
+	 7.300164812367466e-01,
+	 7.341921151286931e-01,
+	 7.383401610114442e-01,
+	 7.424604630179923e-01,
+	 7.465528663238341e-01,
+	 7.506172171527881e-01,
+	 7.546533627827725e-01,
+	 7.586611515515449e-01,
+	 7.626404328624002e-01,
+	 7.665910571898299e-01,
+	 7.705128760851405e-01,
+	 7.744057421820316e-01,
+	 7.782695092021338e-01,
+	 7.821040319605042e-01,
+	 7.859091663710830e-01,
+	 7.896847694521072e-01,
+	 7.934306993314830e-01,
+	 7.971468152521175e-01,
+	 8.008329775772071e-01,
+	 8.044890477954846e-01,
+	 8.081148885264243e-01,
+	 8.117103635254043e-01,
+	 8.152753376888249e-01,
+	 8.188096770591868e-01,
+	 8.223132488301236e-01,
+	 8.257859213513925e-01,
+	 8.292275641338213e-01,
+	 8.326380478542114e-01,
+	 8.360172443601974e-01,
+	 8.393650266750627e-01,
+	 8.426812690025105e-01,
+	 8.459658467313906e-01,
+	 8.492186364403826e-01,
+	 8.524395159026327e-01,
+	 8.556283640903465e-01,
+	 8.587850611793375e-01,
+	 8.619094885535290e-01,
+	 8.650015288094115e-01,
+	 8.680610657604539e-01,
+	 8.710879844414698e-01,
+	 8.740821711129373e-01,
+	 8.770435132652723e-01,
+	 8.799718996230571e-01,
+	 8.828672201492210e-01,
+	 8.857293660491754e-01,
+	 8.885582297749018e-01,
+	 8.913537050289927e-01,
+	 8.941156867686465e-01,
+	 8.968440712096138e-01,
+	 8.995387558300979e-01,
+	 9.021996393746068e-01,
+	 9.048266218577580e-01,
+	 9.074196045680355e-01,
+	 9.099784900714992e-01,
+	 9.125031822154460e-01,
+	 9.149935861320229e-01,
+	 9.174496082417911e-01,
+	 9.198711562572436e-01,
+	 9.222581391862719e-01,
+	 9.246104673355856e-01,
+	 9.269280523140828e-01,
+	 9.292108070361711e-01,
+	 9.314586457250403e-01,
+	 9.336714839158854e-01,
+	 9.358492384590805e-01,
+	 9.379918275233031e-01,
+	 9.400991705986094e-01,
+	 9.421711884994589e-01,
+	 9.442078033676905e-01,
+	 9.462089386754480e-01,
+	 9.481745192280551e-01,
+	 9.501044711668419e-01,
+	 9.519987219719198e-01,
+	 9.538572004649060e-01,
+	 9.556798368115988e-01,
+	 9.574665625246019e-01,
+	 9.592173104658972e-01,
+	 9.609320148493677e-01,
+	 9.626106112432703e-01,
+	 9.642530365726560e-01,
+	 9.658592291217407e-01,
+	 9.674291285362238e-01,
+	 9.689626758255566e-01,
+	 9.704598133651587e-01,
+	 9.719204848985836e-01,
+	 9.733446355396325e-01,
+	 9.747322117744170e-01,
+	 9.760831614633703e-01,
+	 9.773974338432059e-01,
+	 9.786749795288263e-01,
+	 9.799157505151782e-01,
+	 9.811197001790571e-01,
+	 9.822867832808596e-01,
+	 9.834169559662840e-01,
+	 9.845101757679784e-01,
+	 9.855664016071379e-01,
+	 9.865855937950492e-01,
+	 9.875677140345829e-01,
+	 9.885127254216350e-01,
+	 9.894205924465157e-01,
+	 9.902912809952868e-01,
+	 9.911247583510481e-01,
+	 9.919209931951715e-01,
+	 9.926799556084865e-01,
+	 9.934016170724148e-01,
+	 9.940859504700559e-01,
+	 9.947329300872282e-01,
+	 9.953425316134658e-01,
+	 9.959147321429772e-01,
+	 9.964495101755774e-01,
+	 9.969468456176038e-01,
+	 9.974067197828498e-01,
+	 9.978291153935629e-01,
+	 9.982140165816128e-01,
+	 9.985614088900397e-01,
+	 9.988712792754494e-01,
+	 9.991436161123782e-01,
+	 9.993784092025992e-01,
+	 9.995756497983108e-01,
+	 9.997353306710427e-01,
+	 9.998574463699794e-01,
+	 9.999419946068456e-01,
+	 9.999889909843819e-01
+};
+constant double ORIENT_W[508]={
+	 3.626837833783620e-01,
+	 3.137066458778874e-01,
+	 2.223810344533745e-01,
+	 1.012285362903762e-01,
+	 1.894506104550685e-01,
+	 1.826034150449236e-01,
+	 1.691565193950026e-01,
+	 1.495959888165768e-01,
+	 1.246289712555339e-01,
+	 9.515851168249290e-02,
+	 6.225352393864778e-02,
+	 2.715245941175406e-02,
+	 9.654008851472785e-02,
+	 9.563872007927485e-02,
+	 9.384439908080454e-02,
+	 9.117387869576390e-02,
+	 8.765209300440374e-02,
+	 8.331192422694672e-02,
+	 7.819389578707044e-02,
+	 7.234579410884862e-02,
+	 6.582222277636195e-02,
+	 5.868409347853558e-02,
+	 5.099805926237615e-02,
+	 4.283589802222670e-02,
+	 3.427386291302141e-02,
+	 2.539206530926214e-02,
+	 1.627439473090571e-02,
+	 7.018610009470136e-03,
+	 4.869095700913974e-02,
+	 4.857546744150339e-02,
+	 4.834476223480290e-02,
+	 4.799938859645833e-02,
+	 4.754016571483032e-02,
+	 4.696818281620999e-02,
+	 4.628479658131440e-02,
+	 4.549162792741812e-02,
+	 4.459055816375658e-02,
+	 4.358372452932347e-02,
+	 4.247351512365363e-02,
+	 4.126256324262355e-02,
+	 3.995374113272036e-02,
+	 3.855015317861560e-02,
+	 3.705512854024007e-02,
+	 3.547221325688236e-02,
+	 3.380516183714161e-02,
+	 3.205792835485161e-02,
+	 3.023465707240243e-02,
+	 2.833967261425946e-02,
+	 2.637746971505464e-02,
+	 2.435270256871093e-02,
+	 2.227017380838321e-02,
+	 2.013482315353022e-02,
+	 1.795171577569734e-02,
+	 1.572603047602479e-02,
+	 1.346304789671853e-02,
+	 1.116813946013108e-02,
+	 8.846759826363935e-03,
+	 6.504457968978368e-03,
+	 4.147033260562521e-03,
+	 1.783280721696268e-03,
+	 2.444618019626252e-02,
+	 2.443156909785004e-02,
+	 2.440235563384958e-02,
+	 2.435855726469068e-02,
+	 2.430020016797183e-02,
+	 2.422731922281525e-02,
+	 2.413995798901926e-02,
+	 2.403816868102404e-02,
+	 2.392201213670350e-02,
+	 2.379155778100335e-02,
+	 2.364688358444763e-02,
+	 2.348807601653593e-02,
+	 2.331522999406276e-02,
+	 2.312844882438705e-02,
+	 2.292784414368684e-02,
+	 2.271353585023643e-02,
+	 2.248565203274498e-02,
+	 2.224432889379978e-02,
+	 2.198971066846047e-02,
+	 2.172194953805211e-02,
+	 2.144120553920844e-02,
+	 2.114764646822132e-02,
+	 2.084144778075112e-02,
+	 2.052279248696013e-02,
+	 2.019187104213003e-02,
+	 1.984888123283089e-02,
+	 1.949402805870666e-02,
+	 1.912752360995098e-02,
+	 1.874958694054470e-02,
+	 1.836044393733136e-02,
+	 1.796032718500870e-02,
+	 1.754947582711768e-02,
+	 1.712813542311139e-02,
+	 1.669655780158920e-02,
+	 1.625500090978517e-02,
+	 1.580372865939932e-02,
+	 1.534301076886513e-02,
+	 1.487312260214730e-02,
+	 1.439434500416685e-02,
+	 1.390696413295198e-02,
+	 1.341127128861632e-02,
+	 1.290756273926730e-02,
+	 1.239613954395089e-02,
+	 1.187730737274026e-02,
+	 1.135137632408043e-02,
+	 1.081866073950307e-02,
+	 1.027947901583220e-02,
+	 9.734153415006837e-03,
+	 9.183009871660921e-03,
+	 8.626377798616726e-03,
+	 8.064589890486031e-03,
+	 7.497981925634747e-03,
+	 6.926892566898786e-03,
+	 6.351663161707208e-03,
+	 5.772637542865717e-03,
+	 5.190161832676298e-03,
+	 4.604584256702957e-03,
+	 4.016254983738681e-03,
+	 3.425526040910243e-03,
+	 2.832751471458051e-03,
+	 2.238288430962617e-03,
+	 1.642503018668999e-03,
+	 1.045812679340304e-03,
+	 4.493809602922429e-04,
+	 1.224767164028975e-02,
+	 1.224583436974792e-02,
+	 1.224216010427278e-02,
+	 1.223664939504016e-02,
+	 1.222930306871027e-02,
+	 1.222012222730395e-02,
+	 1.220910824803722e-02,
+	 1.219626278311472e-02,
+	 1.218158775948178e-02,
+	 1.216508537853548e-02,
+	 1.214675811579444e-02,
+	 1.212660872052730e-02,
+	 1.210464021534047e-02,
+	 1.208085589572453e-02,
+	 1.205525932956014e-02,
+	 1.202785435658258e-02,
+	 1.199864508780584e-02,
+	 1.196763590490587e-02,
+	 1.193483145956355e-02,
+	 1.190023667276649e-02,
+	 1.186385673407109e-02,
+	 1.182569710082398e-02,
+	 1.178576349734341e-02,
+	 1.174406191406053e-02,
+	 1.170059860662073e-02,
+	 1.165538009494526e-02,
+	 1.160841316225309e-02,
+	 1.155970485404361e-02,
+	 1.150926247703950e-02,
+	 1.145709359809063e-02,
+	 1.140320604303919e-02,
+	 1.134760789554548e-02,
+	 1.129030749587549e-02,
+	 1.123131343964968e-02,
+	 1.117063457655345e-02,
+	 1.110828000900985e-02,
+	 1.104425909081395e-02,
+	 1.097858142572958e-02,
+	 1.091125686604904e-02,
+	 1.084229551111479e-02,
+	 1.077170770580464e-02,
+	 1.069950403897975e-02,
+	 1.062569534189652e-02,
+	 1.055029268658144e-02,
+	 1.047330738417042e-02,
+	 1.039475098321174e-02,
+	 1.031463526793403e-02,
+	 1.023297225647823e-02,
+	 1.014977419909487e-02,
+	 1.006505357630640e-02,
+	 9.978823097034878e-03,
+	 9.891095696695829e-03,
+	 9.801884535257318e-03,
+	 9.711202995266253e-03,
+	 9.619064679840732e-03,
+	 9.525483410629256e-03,
+	 9.430473225737708e-03,
+	 9.334048377623222e-03,
+	 9.236223330956294e-03,
+	 9.137012760450782e-03,
+	 9.036431548662854e-03,
+	 8.934494783758191e-03,
+	 8.831217757248811e-03,
+	 8.726615961698846e-03,
+	 8.620705088401048e-03,
+	 8.513501025022468e-03,
+	 8.405019853221481e-03,
+	 8.295277846235233e-03,
+	 8.184291466438219e-03,
+	 8.072077362873523e-03,
+	 7.958652368754354e-03,
+	 7.844033498939685e-03,
+	 7.728237947381598e-03,
+	 7.611283084545602e-03,
+	 7.493186454805871e-03,
+	 7.373965773812383e-03,
+	 7.253638925833928e-03,
+	 7.132223961075385e-03,
+	 7.009739092969799e-03,
+	 6.886202695446326e-03,
+	 6.761633300173832e-03,
+	 6.636049593781048e-03,
+	 6.509470415053654e-03,
+	 6.381914752107846e-03,
+	 6.253401739542443e-03,
+	 6.123950655567865e-03,
+	 5.993580919115377e-03,
+	 5.862312086922655e-03,
+	 5.730163850601435e-03,
+	 5.597156033682907e-03,
+	 5.463308588644305e-03,
+	 5.328641593915932e-03,
+	 5.193175250869282e-03,
+	 5.056929880786863e-03,
+	 4.919925921813896e-03,
+	 4.782183925892678e-03,
+	 4.643724555680072e-03,
+	 4.504568581447893e-03,
+	 4.364736877968060e-03,
+	 4.224250421381543e-03,
+	 4.083130286052652e-03,
+	 3.941397641408838e-03,
+	 3.799073748766234e-03,
+	 3.656179958142504e-03,
+	 3.512737705056300e-03,
+	 3.368768507315517e-03,
+	 3.224293961794159e-03,
+	 3.079335741199409e-03,
+	 2.933915590829727e-03,
+	 2.788055325327737e-03,
+	 2.641776825427477e-03,
+	 2.495102034703697e-03,
+	 2.348052956327347e-03,
+	 2.200651649839935e-03,
+	 2.052920227966165e-03,
+	 1.904880853499740e-03,
+	 1.756555736330753e-03,
+	 1.607967130749334e-03,
+	 1.459137333310748e-03,
+	 1.310088681902493e-03,
+	 1.160843557567707e-03,
+	 1.011424393208423e-03,
+	 8.618537014200999e-04,
+	 7.121541634732977e-04,
+	 5.623489540314093e-04,
+	 4.124632544261648e-04,
+	 2.625349442964814e-04,
+	 1.127890178221942e-04,
+	 6.129905175405823e-03,
+	 6.129674838036500e-03,
+	 6.129214171953111e-03,
+	 6.128523194465539e-03,
+	 6.127601931538023e-03,
+	 6.126450417787940e-03,
+	 6.125068696484557e-03,
+	 6.123456819547473e-03,
+	 6.121614847544576e-03,
+	 6.119542849689821e-03,
+	 6.117240903840624e-03,
+	 6.114709096494938e-03,
+	 6.111947522787904e-03,
+	 6.108956286488513e-03,
+	 6.105735499995474e-03,
+	 6.102285284333082e-03,
+	 6.098605769146653e-03,
+	 6.094697092697663e-03,
+	 6.090559401858701e-03,
+	 6.086192852107484e-03,
+	 6.081597607521643e-03,
+	 6.076773840772098e-03,
+	 6.071721733116747e-03,
+	 6.066441474393633e-03,
+	 6.060933263013824e-03,
+	 6.055197305953886e-03,
+	 6.049233818748191e-03,
+	 6.043043025480799e-03,
+	 6.036625158776993e-03,
+	 6.029980459794661e-03,
+	 6.023109178214960e-03,
+	 6.016011572233275e-03,
+	 6.008687908549352e-03,
+	 6.001138462357158e-03,
+	 5.993363517334820e-03,
+	 5.985363365633667e-03,
+	 5.977138307867512e-03,
+	 5.968688653101227e-03,
+	 5.960014718839075e-03,
+	 5.951116831012852e-03,
+	 5.941995323969712e-03,
+	 5.932650540459492e-03,
+	 5.923082831621804e-03,
+	 5.913292556972993e-03,
+	 5.903280084392508e-03,
+	 5.893045790109076e-03,
+	 5.882590058686664e-03,
+	 5.871913283009892e-03,
+	 5.861015864269411e-03,
+	 5.849898211946674e-03,
+	 5.838560743798737e-03,
+	 5.827003885842329e-03,
+	 5.815228072338118e-03,
+	 5.803233745774094e-03,
+	 5.791021356849256e-03,
+	 5.778591364456348e-03,
+	 5.765944235664976e-03,
+	 5.753080445703678e-03,
+	 5.740000477942354e-03,
+	 5.726704823873985e-03,
+	 5.713193983096190e-03,
+	 5.699468463292464e-03,
+	 5.685528780213008e-03,
+	 5.671375457655466e-03,
+	 5.657009027445278e-03,
+	 5.642430029415459e-03,
+	 5.627639011386662e-03,
+	 5.612636529146198e-03,
+	 5.597423146427576e-03,
+	 5.581999434888909e-03,
+	 5.566365974091787e-03,
+	 5.550523351479176e-03,
+	 5.534472162353668e-03,
+	 5.518213009854877e-03,
+	 5.501746504936830e-03,
+	 5.485073266345063e-03,
+	 5.468193920593368e-03,
+	 5.451109101940137e-03,
+	 5.433819452364682e-03,
+	 5.416325621543061e-03,
+	 5.398628266823548e-03,
+	 5.380728053202091e-03,
+	 5.362625653297332e-03,
+	 5.344321747325189e-03,
+	 5.325817023073348e-03,
+	 5.307112175875538e-03,
+	 5.288207908585185e-03,
+	 5.269104931549274e-03,
+	 5.249803962581393e-03,
+	 5.230305726934936e-03,
+	 5.210610957275751e-03,
+	 5.190720393654716e-03,
+	 5.170634783479766e-03,
+	 5.150354881487984e-03,
+	 5.129881449717179e-03,
+	 5.109215257477094e-03,
+	 5.088357081320842e-03,
+	 5.067307705015388e-03,
+	 5.046067919512336e-03,
+	 5.024638522917937e-03,
+	 5.003020320463463e-03,
+	 4.981214124474665e-03,
+	 4.959220754341328e-03,
+	 4.937041036486537e-03,
+	 4.914675804335546e-03,
+	 4.892125898284523e-03,
+	 4.869392165668914e-03,
+	 4.846475460731626e-03,
+	 4.823376644591042e-03,
+	 4.800096585208410e-03,
+	 4.776636157355478e-03,
+	 4.752996242581396e-03,
+	 4.729177729179943e-03,
+	 4.705181512155671e-03,
+	 4.681008493190708e-03,
+	 4.656659580610524e-03,
+	 4.632135689350189e-03,
+	 4.607437740919595e-03,
+	 4.582566663369041e-03,
+	 4.557523391254381e-03,
+	 4.532308865601804e-03,
+	 4.506924033872599e-03,
+	 4.481369849927311e-03,
+	 4.455647273990277e-03,
+	 4.429757272613196e-03,
+	 4.403700818638938e-03,
+	 4.377478891165114e-03,
+	 4.351092475507087e-03,
+	 4.324542563160962e-03,
+	 4.297830151766573e-03,
+	 4.270956245069615e-03,
+	 4.243921852884303e-03,
+	 4.216727991055222e-03,
+	 4.189375681419105e-03,
+	 4.161865951766559e-03,
+	 4.134199835803484e-03,
+	 4.106378373111952e-03,
+	 4.078402609111734e-03,
+	 4.050273595020147e-03,
+	 4.021992387813373e-03,
+	 3.993560050186274e-03,
+	 3.964977650512611e-03,
+	 3.936246262804864e-03,
+	 3.907366966673979e-03,
+	 3.878340847288517e-03,
+	 3.849168995334266e-03,
+	 3.819852506973006e-03,
+	 3.790392483801295e-03,
+	 3.760790032809262e-03,
+	 3.731046266338861e-03,
+	 3.701162302042048e-03,
+	 3.671139262839015e-03,
+	 3.640978276875689e-03,
+	 3.610680477481550e-03,
+	 3.580247003126996e-03,
+	 3.549678997380520e-03,
+	 3.518977608865757e-03,
+	 3.488143991218276e-03,
+	 3.457179303042456e-03,
+	 3.426084707867670e-03,
+	 3.394861374104679e-03,
+	 3.363510475001779e-03,
+	 3.332033188600575e-03,
+	 3.300430697691896e-03,
+	 3.268704189771167e-03,
+	 3.236854856993980e-03,
+	 3.204883896131127e-03,
+	 3.172792508523695e-03,
+	 3.140581900037983e-03,
+	 3.108253281019998e-03,
+	 3.075807866250331e-03,
+	 3.043246874898162e-03,
+	 3.010571530475514e-03,
+	 2.977783060791480e-03,
+	 2.944882697905859e-03,
+	 2.911871678083002e-03,
+	 2.878751241745292e-03,
+	 2.845522633426487e-03,
+	 2.812187101725089e-03,
+	 2.778745899257362e-03,
+	 2.745200282610235e-03,
+	 2.711551512294091e-03,
+	 2.677800852695416e-03,
+	 2.643949572029310e-03,
+	 2.609998942291830e-03,
+	 2.575950239212105e-03,
+	 2.541804742204583e-03,
+	 2.507563734320793e-03,
+	 2.473228502201056e-03,
+	 2.438800336026476e-03,
+	 2.404280529470157e-03,
+	 2.369670379648607e-03,
+	 2.334971187073224e-03,
+	 2.300184255601204e-03,
+	 2.265310892386636e-03,
+	 2.230352407831350e-03,
+	 2.195310115535776e-03,
+	 2.160185332249384e-03,
+	 2.124979377821452e-03,
+	 2.089693575151362e-03,
+	 2.054329250138729e-03,
+	 2.018887731633911e-03,
+	 1.983370351387805e-03,
+	 1.947778444001910e-03,
+	 1.912113346878277e-03,
+	 1.876376400168939e-03,
+	 1.840568946726018e-03,
+	 1.804692332050854e-03,
+	 1.768747904243622e-03,
+	 1.732737013952762e-03,
+	 1.696661014324121e-03,
+	 1.660521260950064e-03,
+	 1.624319111818721e-03,
+	 1.588055927262727e-03,
+	 1.551733069908440e-03,
+	 1.515351904624341e-03,
+	 1.478913798470207e-03,
+	 1.442420120645374e-03,
+	 1.405872242437502e-03,
+	 1.369271537171091e-03,
+	 1.332619380155797e-03,
+	 1.295917148634930e-03,
+	 1.259166221733582e-03,
+	 1.222367980406941e-03,
+	 1.185523807388676e-03,
+	 1.148635087138666e-03,
+	 1.111703205791424e-03,
+	 1.074729551104184e-03,
+	 1.037715512404542e-03,
+	 1.000662480539100e-03,
+	 9.635718478211860e-04,
+	 9.264450079791546e-04,
+	 8.892833561045022e-04,
+	 8.520882886004978e-04,
+	 8.148612031307577e-04,
+	 7.776034985686857e-04,
+	 7.403165749469767e-04,
+	 7.030018334087211e-04,
+	 6.656606761599437e-04,
+	 6.282945064244445e-04,
+	 5.909047284032144e-04,
+	 5.534927472403937e-04,
+	 5.160599690007798e-04,
+	 4.786078006679640e-04,
+	 4.411376501795688e-04,
+	 4.036509265333137e-04,
+	 3.661490400356027e-04,
+	 3.286334028523289e-04,
+	 2.911054302514923e-04,
+	 2.535665435706075e-04,
+	 2.160181779769902e-04,
+	 1.784618055459688e-04,
+	 1.408990173881921e-04,
+	 1.033319034969358e-04,
+	 6.576573165924773e-05,
+	 2.825263737393154e-05
+};
+constant double ORIENT_COS_PHI[508]={
+	 9.807852804032304e-01,
+	 8.314696123025452e-01,
+	 5.555702330196023e-01,
+	 1.950903220161283e-01,
+	 9.951847266721969e-01,
+	 9.569403357322088e-01,
+	 8.819212643483550e-01,
+	 7.730104533627370e-01,
+	 6.343932841636455e-01,
+	 4.713967368259978e-01,
+	 2.902846772544623e-01,
+	 9.801714032956077e-02,
+	 9.987954562051724e-01,
+	 9.891765099647810e-01,
+	 9.700312531945440e-01,
+	 9.415440651830208e-01,
+	 9.039892931234433e-01,
+	 8.577286100002721e-01,
+	 8.032075314806449e-01,
+	 7.409511253549591e-01,
+	 6.715589548470183e-01,
+	 5.956993044924335e-01,
+	 5.141027441932217e-01,
+	 4.275550934302822e-01,
+	 3.368898533922201e-01,
+	 2.429801799032640e-01,
+	 1.467304744553617e-01,
+	 4.906767432741813e-02,
+	 9.996988186962042e-01,
+	 9.972904566786902e-01,
+	 9.924795345987100e-01,
+	 9.852776423889412e-01,
+	 9.757021300385286e-01,
+	 9.637760657954398e-01,
+	 9.495281805930367e-01,
+	 9.329927988347390e-01,
+	 9.142097557035307e-01,
+	 8.932243011955153e-01,
+	 8.700869911087115e-01,
+	 8.448535652497071e-01,
+	 8.175848131515837e-01,
+	 7.883464276266063e-01,
+	 7.572088465064846e-01,
+	 7.242470829514670e-01,
+	 6.895405447370669e-01,
+	 6.531728429537768e-01,
+	 6.152315905806268e-01,
+	 5.758081914178453e-01,
+	 5.349976198870973e-01,
+	 4.928981922297841e-01,
+	 4.496113296546066e-01,
+	 4.052413140049899e-01,
+	 3.598950365349883e-01,
+	 3.136817403988916e-01,
+	 2.667127574748984e-01,
+	 2.191012401568698e-01,
+	 1.709618887603014e-01,
+	 1.224106751992163e-01,
+	 7.356456359966745e-02,
+	 2.454122852291226e-02,
+	 9.999247018391445e-01,
+	 9.993223845883495e-01,
+	 9.981181129001492e-01,
+	 9.963126121827780e-01,
+	 9.939069700023561e-01,
+	 9.909026354277800e-01,
+	 9.873014181578584e-01,
+	 9.831054874312163e-01,
+	 9.783173707196277e-01,
+	 9.729399522055602e-01,
+	 9.669764710448521e-01,
+	 9.604305194155658e-01,
+	 9.533060403541939e-01,
+	 9.456073253805213e-01,
+	 9.373390119125750e-01,
+	 9.285060804732156e-01,
+	 9.191138516900578e-01,
+	 9.091679830905224e-01,
+	 8.986744656939538e-01,
+	 8.876396204028539e-01,
+	 8.760700941954066e-01,
+	 8.639728561215868e-01,
+	 8.513551931052652e-01,
+	 8.382247055548381e-01,
+	 8.245893027850253e-01,
+	 8.104571982525948e-01,
+	 7.958369046088836e-01,
+	 7.807372285720945e-01,
+	 7.651672656224590e-01,
+	 7.491363945234594e-01,
+	 7.326542716724128e-01,
+	 7.157308252838186e-01,
+	 6.983762494089729e-01,
+	 6.806009977954531e-01,
+	 6.624157775901718e-01,
+	 6.438315428897915e-01,
+	 6.248594881423865e-01,
+	 6.055110414043255e-01,
+	 5.857978574564389e-01,
+	 5.657318107836132e-01,
+	 5.453249884220465e-01,
+	 5.245896826784688e-01,
+	 5.035383837257176e-01,
+	 4.821837720791228e-01,
+	 4.605387109582400e-01,
+	 4.386162385385277e-01,
+	 4.164295600976373e-01,
+	 3.939920400610481e-01,
+	 3.713171939518376e-01,
+	 3.484186802494345e-01,
+	 3.253102921622630e-01,
+	 3.020059493192282e-01,
+	 2.785196893850531e-01,
+	 2.548656596045146e-01,
+	 2.310581082806713e-01,
+	 2.071113761922186e-01,
+	 1.830398879551411e-01,
+	 1.588581433338614e-01,
+	 1.345807085071262e-01,
+	 1.102222072938832e-01,
+	 8.579731234443988e-02,
+	 6.132073630220865e-02,
+	 3.680722294135899e-02,
+	 1.227153828571994e-02,
+	 9.999811752826011e-01,
+	 9.998305817958234e-01,
+	 9.995294175010931e-01,
+	 9.990777277526454e-01,
+	 9.984755805732948e-01,
+	 9.977230666441916e-01,
+	 9.968202992911657e-01,
+	 9.957674144676598e-01,
+	 9.945645707342554e-01,
+	 9.932119492347945e-01,
+	 9.917097536690995e-01,
+	 9.900582102622971e-01,
+	 9.882575677307495e-01,
+	 9.863080972445987e-01,
+	 9.842100923869290e-01,
+	 9.819638691095552e-01,
+	 9.795697656854405e-01,
+	 9.770281426577544e-01,
+	 9.743393827855759e-01,
+	 9.715038909862518e-01,
+	 9.685220942744174e-01,
+	 9.653944416976894e-01,
+	 9.621214042690416e-01,
+	 9.587034748958716e-01,
+	 9.551411683057708e-01,
+	 9.514350209690083e-01,
+	 9.475855910177411e-01,
+	 9.435934581619604e-01,
+	 9.394592236021899e-01,
+	 9.351835099389476e-01,
+	 9.307669610789837e-01,
+	 9.262102421383114e-01,
+	 9.215140393420420e-01,
+	 9.166790599210427e-01,
+	 9.117060320054299e-01,
+	 9.065957045149153e-01,
+	 9.013488470460220e-01,
+	 8.959662497561852e-01,
+	 8.904487232447579e-01,
+	 8.847970984309378e-01,
+	 8.790122264286335e-01,
+	 8.730949784182901e-01,
+	 8.670462455156926e-01,
+	 8.608669386377673e-01,
+	 8.545579883654005e-01,
+	 8.481203448032972e-01,
+	 8.415549774368984e-01,
+	 8.348628749863800e-01,
+	 8.280450452577558e-01,
+	 8.211025149911046e-01,
+	 8.140363297059484e-01,
+	 8.068475535437993e-01,
+	 7.995372691079050e-01,
+	 7.921065773002124e-01,
+	 7.845565971555752e-01,
+	 7.768884656732324e-01,
+	 7.691033376455797e-01,
+	 7.612023854842618e-01,
+	 7.531867990436125e-01,
+	 7.450577854414661e-01,
+	 7.368165688773699e-01,
+	 7.284643904482252e-01,
+	 7.200025079613817e-01,
+	 7.114321957452164e-01,
+	 7.027547444572253e-01,
+	 6.939714608896540e-01,
+	 6.850836677727004e-01,
+	 6.760927035753160e-01,
+	 6.669999223036375e-01,
+	 6.578066932970786e-01,
+	 6.485144010221126e-01,
+	 6.391244448637757e-01,
+	 6.296382389149271e-01,
+	 6.200572117632892e-01,
+	 6.103828062763095e-01,
+	 6.006164793838690e-01,
+	 5.907597018588743e-01,
+	 5.808139580957645e-01,
+	 5.707807458869674e-01,
+	 5.606615761973360e-01,
+	 5.504579729366048e-01,
+	 5.401714727298930e-01,
+	 5.298036246862948e-01,
+	 5.193559901655895e-01,
+	 5.088301425431070e-01,
+	 4.982276669727819e-01,
+	 4.875501601484361e-01,
+	 4.767992300633223e-01,
+	 4.659764957679661e-01,
+	 4.550835871263438e-01,
+	 4.441221445704293e-01,
+	 4.330938188531520e-01,
+	 4.220002707997998e-01,
+	 4.108431710579039e-01,
+	 3.996241998456468e-01,
+	 3.883450466988263e-01,
+	 3.770074102164183e-01,
+	 3.656129978047740e-01,
+	 3.541635254204905e-01,
+	 3.426607173119944e-01,
+	 3.311063057598764e-01,
+	 3.195020308160157e-01,
+	 3.078496400415350e-01,
+	 2.961508882436240e-01,
+	 2.844075372112718e-01,
+	 2.726213554499490e-01,
+	 2.607941179152756e-01,
+	 2.489276057457203e-01,
+	 2.370236059943673e-01,
+	 2.250839113597928e-01,
+	 2.131103199160914e-01,
+	 2.011046348420920e-01,
+	 1.890686641498063e-01,
+	 1.770042204121489e-01,
+	 1.649131204899701e-01,
+	 1.527971852584434e-01,
+	 1.406582393328492e-01,
+	 1.284981107937932e-01,
+	 1.163186309119049e-01,
+	 1.041216338720547e-01,
+	 9.190895649713270e-02,
+	 7.968243797143013e-02,
+	 6.744391956366411e-02,
+	 5.519524434969003e-02,
+	 4.293825693494096e-02,
+	 3.067480317663658e-02,
+	 1.840672990580482e-02,
+	 6.135884649154515e-03,
+	 9.999952938095762e-01,
+	 9.999576445519639e-01,
+	 9.998823474542126e-01,
+	 9.997694053512153e-01,
+	 9.996188224951786e-01,
+	 9.994306045554617e-01,
+	 9.992047586183639e-01,
+	 9.989412931868569e-01,
+	 9.986402181802653e-01,
+	 9.983015449338929e-01,
+	 9.979252861985960e-01,
+	 9.975114561403035e-01,
+	 9.970600703394830e-01,
+	 9.965711457905548e-01,
+	 9.960447009012520e-01,
+	 9.954807554919269e-01,
+	 9.948793307948056e-01,
+	 9.942404494531879e-01,
+	 9.935641355205953e-01,
+	 9.928504144598651e-01,
+	 9.920993131421918e-01,
+	 9.913108598461154e-01,
+	 9.904850842564571e-01,
+	 9.896220174632009e-01,
+	 9.887216919603238e-01,
+	 9.877841416445722e-01,
+	 9.868094018141855e-01,
+	 9.857975091675675e-01,
+	 9.847485018019042e-01,
+	 9.836624192117303e-01,
+	 9.825393022874412e-01,
+	 9.813791933137546e-01,
+	 9.801821359681174e-01,
+	 9.789481753190622e-01,
+	 9.776773578245099e-01,
+	 9.763697313300211e-01,
+	 9.750253450669941e-01,
+	 9.736442496508120e-01,
+	 9.722264970789363e-01,
+	 9.707721407289504e-01,
+	 9.692812353565485e-01,
+	 9.677538370934755e-01,
+	 9.661900034454125e-01,
+	 9.645897932898128e-01,
+	 9.629532668736839e-01,
+	 9.612804858113206e-01,
+	 9.595715130819845e-01,
+	 9.578264130275329e-01,
+	 9.560452513499964e-01,
+	 9.542280951091057e-01,
+	 9.523750127197659e-01,
+	 9.504860739494817e-01,
+	 9.485613499157303e-01,
+	 9.466009130832835e-01,
+	 9.446048372614803e-01,
+	 9.425731976014469e-01,
+	 9.405060705932683e-01,
+	 9.384035340631081e-01,
+	 9.362656671702783e-01,
+	 9.340925504042590e-01,
+	 9.318842655816681e-01,
+	 9.296408958431813e-01,
+	 9.273625256504011e-01,
+	 9.250492407826776e-01,
+	 9.227011283338786e-01,
+	 9.203182767091106e-01,
+	 9.179007756213905e-01,
+	 9.154487160882678e-01,
+	 9.129621904283982e-01,
+	 9.104412922580672e-01,
+	 9.078861164876663e-01,
+	 9.052967593181188e-01,
+	 9.026733182372588e-01,
+	 9.000158920161603e-01,
+	 8.973245807054183e-01,
+	 8.945994856313827e-01,
+	 8.918407093923427e-01,
+	 8.890483558546646e-01,
+	 8.862225301488806e-01,
+	 8.833633386657316e-01,
+	 8.804708890521608e-01,
+	 8.775452902072614e-01,
+	 8.745866522781761e-01,
+	 8.715950866559510e-01,
+	 8.685707059713409e-01,
+	 8.655136240905691e-01,
+	 8.624239561110406e-01,
+	 8.593018183570085e-01,
+	 8.561473283751945e-01,
+	 8.529606049303636e-01,
+	 8.497417680008525e-01,
+	 8.464909387740521e-01,
+	 8.432082396418454e-01,
+	 8.398937941959995e-01,
+	 8.365477272235120e-01,
+	 8.331701647019132e-01,
+	 8.297612337945230e-01,
+	 8.263210628456635e-01,
+	 8.228497813758264e-01,
+	 8.193475200767969e-01,
+	 8.158144108067338e-01,
+	 8.122505865852039e-01,
+	 8.086561815881750e-01,
+	 8.050313311429637e-01,
+	 8.013761717231402e-01,
+	 7.976908409433912e-01,
+	 7.939754775543372e-01,
+	 7.902302214373100e-01,
+	 7.864552135990858e-01,
+	 7.826505961665757e-01,
+	 7.788165123814760e-01,
+	 7.749531065948739e-01,
+	 7.710605242618138e-01,
+	 7.671389119358204e-01,
+	 7.631884172633813e-01,
+	 7.592091889783881e-01,
+	 7.552013768965365e-01,
+	 7.511651319096865e-01,
+	 7.471006059801801e-01,
+	 7.430079521351217e-01,
+	 7.388873244606151e-01,
+	 7.347388780959635e-01,
+	 7.305627692278276e-01,
+	 7.263591550843460e-01,
+	 7.221281939292153e-01,
+	 7.178700450557317e-01,
+	 7.135848687807936e-01,
+	 7.092728264388657e-01,
+	 7.049340803759050e-01,
+	 7.005687939432484e-01,
+	 6.961771314914630e-01,
+	 6.917592583641577e-01,
+	 6.873153408917592e-01,
+	 6.828455463852481e-01,
+	 6.783500431298616e-01,
+	 6.738290003787561e-01,
+	 6.692825883466360e-01,
+	 6.647109782033449e-01,
+	 6.601143420674205e-01,
+	 6.554928529996155e-01,
+	 6.508466849963810e-01,
+	 6.461760129833164e-01,
+	 6.414810128085832e-01,
+	 6.367618612362842e-01,
+	 6.320187359398091e-01,
+	 6.272518154951442e-01,
+	 6.224612793741501e-01,
+	 6.176473079378040e-01,
+	 6.128100824294097e-01,
+	 6.079497849677737e-01,
+	 6.030665985403483e-01,
+	 5.981607069963424e-01,
+	 5.932322950397998e-01,
+	 5.882815482226453e-01,
+	 5.833086529376983e-01,
+	 5.783137964116556e-01,
+	 5.732971666980423e-01,
+	 5.682589526701315e-01,
+	 5.631993440138341e-01,
+	 5.581185312205561e-01,
+	 5.530167055800276e-01,
+	 5.478940591731002e-01,
+	 5.427507848645160e-01,
+	 5.375870762956455e-01,
+	 5.324031278771980e-01,
+	 5.271991347819014e-01,
+	 5.219752929371544e-01,
+	 5.167317990176500e-01,
+	 5.114688504379705e-01,
+	 5.061866453451555e-01,
+	 5.008853826112409e-01,
+	 4.955652618257725e-01,
+	 4.902264832882911e-01,
+	 4.848692480007911e-01,
+	 4.794937576601530e-01,
+	 4.741002146505500e-01,
+	 4.686888220358280e-01,
+	 4.632597835518603e-01,
+	 4.578133035988773e-01,
+	 4.523495872337710e-01,
+	 4.468688401623743e-01,
+	 4.413712687317166e-01,
+	 4.358570799222555e-01,
+	 4.303264813400826e-01,
+	 4.247796812091088e-01,
+	 4.192168883632240e-01,
+	 4.136383122384346e-01,
+	 4.080441628649787e-01,
+	 4.024346508594185e-01,
+	 3.968099874167104e-01,
+	 3.911703843022540e-01,
+	 3.855160538439190e-01,
+	 3.798472089240511e-01,
+	 3.741640629714580e-01,
+	 3.684668299533723e-01,
+	 3.627557243673972e-01,
+	 3.570309612334300e-01,
+	 3.512927560855671e-01,
+	 3.455413249639891e-01,
+	 3.397768844068270e-01,
+	 3.339996514420095e-01,
+	 3.282098435790927e-01,
+	 3.224076788010700e-01,
+	 3.165933755561658e-01,
+	 3.107671527496115e-01,
+	 3.049292297354024e-01,
+	 2.990798263080405e-01,
+	 2.932191626942587e-01,
+	 2.873474595447296e-01,
+	 2.814649379257581e-01,
+	 2.755718193109583e-01,
+	 2.696683255729152e-01,
+	 2.637546789748315e-01,
+	 2.578311021621589e-01,
+	 2.518978181542169e-01,
+	 2.459550503357946e-01,
+	 2.400030224487415e-01,
+	 2.340419585835435e-01,
+	 2.280720831708858e-01,
+	 2.220936209732036e-01,
+	 2.161067970762196e-01,
+	 2.101118368804697e-01,
+	 2.041089660928170e-01,
+	 1.980984107179537e-01,
+	 1.920803970498924e-01,
+	 1.860551516634466e-01,
+	 1.800229014056995e-01,
+	 1.739838733874638e-01,
+	 1.679382949747312e-01,
+	 1.618863937801119e-01,
+	 1.558283976542653e-01,
+	 1.497645346773216e-01,
+	 1.436950331502946e-01,
+	 1.376201215864862e-01,
+	 1.315400287028833e-01,
+	 1.254549834115462e-01,
+	 1.193652148109914e-01,
+	 1.132709521775644e-01,
+	 1.071724249568089e-01,
+	 1.010698627548279e-01,
+	 9.496349532963906e-02,
+	 8.885355258252468e-02,
+	 8.274026454937580e-02,
+	 7.662386139203162e-02,
+	 7.050457338961401e-02,
+	 6.438263092985741e-02,
+	 5.825826450043573e-02,
+	 5.213170468028332e-02,
+	 4.600318213091464e-02,
+	 3.987292758773985e-02,
+	 3.374117185137764e-02,
+	 2.760814577896582e-02,
+	 2.147408027546961e-02,
+	 1.533920628498822e-02,
+	 9.203754782059960e-03,
+	 3.067956762966138e-03
+};
+constant double ORIENT_SIN_PHI[508]={
+	 1.950903220161282e-01,
+	 5.555702330196022e-01,
+	 8.314696123025452e-01,
+	 9.807852804032304e-01,
+	 9.801714032956060e-02,
+	 2.902846772544623e-01,
+	 4.713967368259976e-01,
+	 6.343932841636455e-01,
+	 7.730104533627370e-01,
+	 8.819212643483549e-01,
+	 9.569403357322089e-01,
+	 9.951847266721968e-01,
+	 4.906767432741801e-02,
+	 1.467304744553617e-01,
+	 2.429801799032639e-01,
+	 3.368898533922201e-01,
+	 4.275550934302821e-01,
+	 5.141027441932217e-01,
+	 5.956993044924334e-01,
+	 6.715589548470183e-01,
+	 7.409511253549591e-01,
+	 8.032075314806448e-01,
+	 8.577286100002721e-01,
+	 9.039892931234433e-01,
+	 9.415440651830208e-01,
+	 9.700312531945440e-01,
+	 9.891765099647810e-01,
+	 9.987954562051724e-01,
+	 2.454122852291229e-02,
+	 7.356456359966743e-02,
+	 1.224106751992162e-01,
+	 1.709618887603012e-01,
+	 2.191012401568698e-01,
+	 2.667127574748984e-01,
+	 3.136817403988915e-01,
+	 3.598950365349881e-01,
+	 4.052413140049899e-01,
+	 4.496113296546065e-01,
+	 4.928981922297840e-01,
+	 5.349976198870972e-01,
+	 5.758081914178453e-01,
+	 6.152315905806268e-01,
+	 6.531728429537768e-01,
+	 6.895405447370668e-01,
+	 7.242470829514669e-01,
+	 7.572088465064845e-01,
+	 7.883464276266062e-01,
+	 8.175848131515837e-01,
+	 8.448535652497070e-01,
+	 8.700869911087113e-01,
+	 8.932243011955153e-01,
+	 9.142097557035307e-01,
+	 9.329927988347388e-01,
+	 9.495281805930367e-01,
+	 9.637760657954398e-01,
+	 9.757021300385286e-01,
+	 9.852776423889412e-01,
+	 9.924795345987100e-01,
+	 9.972904566786902e-01,
+	 9.996988186962042e-01,
+	 1.227153828571993e-02,
+	 3.680722294135883e-02,
+	 6.132073630220858e-02,
+	 8.579731234443989e-02,
+	 1.102222072938831e-01,
+	 1.345807085071262e-01,
+	 1.588581433338614e-01,
+	 1.830398879551410e-01,
+	 2.071113761922186e-01,
+	 2.310581082806711e-01,
+	 2.548656596045146e-01,
+	 2.785196893850531e-01,
+	 3.020059493192281e-01,
+	 3.253102921622629e-01,
+	 3.484186802494346e-01,
+	 3.713171939518375e-01,
+	 3.939920400610481e-01,
+	 4.164295600976372e-01,
+	 4.386162385385277e-01,
+	 4.605387109582400e-01,
+	 4.821837720791227e-01,
+	 5.035383837257176e-01,
+	 5.245896826784689e-01,
+	 5.453249884220465e-01,
+	 5.657318107836131e-01,
+	 5.857978574564389e-01,
+	 6.055110414043255e-01,
+	 6.248594881423863e-01,
+	 6.438315428897914e-01,
+	 6.624157775901718e-01,
+	 6.806009977954530e-01,
+	 6.983762494089729e-01,
+	 7.157308252838186e-01,
+	 7.326542716724128e-01,
+	 7.491363945234593e-01,
+	 7.651672656224590e-01,
+	 7.807372285720944e-01,
+	 7.958369046088835e-01,
+	 8.104571982525948e-01,
+	 8.245893027850253e-01,
+	 8.382247055548380e-01,
+	 8.513551931052652e-01,
+	 8.639728561215867e-01,
+	 8.760700941954066e-01,
+	 8.876396204028539e-01,
+	 8.986744656939538e-01,
+	 9.091679830905223e-01,
+	 9.191138516900578e-01,
+	 9.285060804732155e-01,
+	 9.373390119125750e-01,
+	 9.456073253805213e-01,
+	 9.533060403541938e-01,
+	 9.604305194155658e-01,
+	 9.669764710448521e-01,
+	 9.729399522055601e-01,
+	 9.783173707196277e-01,
+	 9.831054874312163e-01,
+	 9.873014181578584e-01,
+	 9.909026354277800e-01,
+	 9.939069700023561e-01,
+	 9.963126121827780e-01,
+	 9.981181129001492e-01,
+	 9.993223845883495e-01,
+	 9.999247018391445e-01,
+	 6.135884649154475e-03,
+	 1.840672990580482e-02,
+	 3.067480317663663e-02,
+	 4.293825693494082e-02,
+	 5.519524434968993e-02,
+	 6.744391956366405e-02,
+	 7.968243797143013e-02,
+	 9.190895649713272e-02,
+	 1.041216338720546e-01,
+	 1.163186309119048e-01,
+	 1.284981107937932e-01,
+	 1.406582393328492e-01,
+	 1.527971852584434e-01,
+	 1.649131204899699e-01,
+	 1.770042204121487e-01,
+	 1.890686641498062e-01,
+	 2.011046348420919e-01,
+	 2.131103199160914e-01,
+	 2.250839113597928e-01,
+	 2.370236059943672e-01,
+	 2.489276057457201e-01,
+	 2.607941179152755e-01,
+	 2.726213554499490e-01,
+	 2.844075372112719e-01,
+	 2.961508882436238e-01,
+	 3.078496400415349e-01,
+	 3.195020308160157e-01,
+	 3.311063057598764e-01,
+	 3.426607173119944e-01,
+	 3.541635254204903e-01,
+	 3.656129978047739e-01,
+	 3.770074102164183e-01,
+	 3.883450466988262e-01,
+	 3.996241998456468e-01,
+	 4.108431710579039e-01,
+	 4.220002707997997e-01,
+	 4.330938188531520e-01,
+	 4.441221445704292e-01,
+	 4.550835871263438e-01,
+	 4.659764957679662e-01,
+	 4.767992300633221e-01,
+	 4.875501601484360e-01,
+	 4.982276669727819e-01,
+	 5.088301425431070e-01,
+	 5.193559901655896e-01,
+	 5.298036246862946e-01,
+	 5.401714727298929e-01,
+	 5.504579729366048e-01,
+	 5.606615761973360e-01,
+	 5.707807458869673e-01,
+	 5.808139580957645e-01,
+	 5.907597018588742e-01,
+	 6.006164793838690e-01,
+	 6.103828062763095e-01,
+	 6.200572117632891e-01,
+	 6.296382389149270e-01,
+	 6.391244448637757e-01,
+	 6.485144010221124e-01,
+	 6.578066932970786e-01,
+	 6.669999223036375e-01,
+	 6.760927035753159e-01,
+	 6.850836677727004e-01,
+	 6.939714608896540e-01,
+	 7.027547444572253e-01,
+	 7.114321957452164e-01,
+	 7.200025079613817e-01,
+	 7.284643904482252e-01,
+	 7.368165688773698e-01,
+	 7.450577854414659e-01,
+	 7.531867990436124e-01,
+	 7.612023854842618e-01,
+	 7.691033376455796e-01,
+	 7.768884656732324e-01,
+	 7.845565971555752e-01,
+	 7.921065773002124e-01,
+	 7.995372691079050e-01,
+	 8.068475535437992e-01,
+	 8.140363297059483e-01,
+	 8.211025149911046e-01,
+	 8.280450452577558e-01,
+	 8.348628749863800e-01,
+	 8.415549774368983e-01,
+	 8.481203448032971e-01,
+	 8.545579883654005e-01,
+	 8.608669386377673e-01,
+	 8.670462455156926e-01,
+	 8.730949784182901e-01,
+	 8.790122264286334e-01,
+	 8.847970984309378e-01,
+	 8.904487232447579e-01,
+	 8.959662497561851e-01,
+	 9.013488470460220e-01,
+	 9.065957045149153e-01,
+	 9.117060320054299e-01,
+	 9.166790599210427e-01,
+	 9.215140393420419e-01,
+	 9.262102421383113e-01,
+	 9.307669610789837e-01,
+	 9.351835099389475e-01,
+	 9.394592236021899e-01,
+	 9.435934581619604e-01,
+	 9.475855910177411e-01,
+	 9.514350209690083e-01,
+	 9.551411683057707e-01,
+	 9.587034748958716e-01,
+	 9.621214042690416e-01,
+	 9.653944416976894e-01,
+	 9.685220942744173e-01,
+	 9.715038909862518e-01,
+	 9.743393827855759e-01,
+	 9.770281426577544e-01,
+	 9.795697656854405e-01,
+	 9.819638691095552e-01,
+	 9.842100923869290e-01,
+	 9.863080972445987e-01,
+	 9.882575677307495e-01,
+	 9.900582102622971e-01,
+	 9.917097536690995e-01,
+	 9.932119492347945e-01,
+	 9.945645707342554e-01,
+	 9.957674144676598e-01,
+	 9.968202992911657e-01,
+	 9.977230666441916e-01,
+	 9.984755805732948e-01,
+	 9.990777277526454e-01,
+	 9.995294175010931e-01,
+	 9.998305817958234e-01,
+	 9.999811752826011e-01,
+	 3.067956762965976e-03,
+	 9.203754782059819e-03,
+	 1.533920628498810e-02,
+	 2.147408027546951e-02,
+	 2.760814577896574e-02,
+	 3.374117185137758e-02,
+	 3.987292758773981e-02,
+	 4.600318213091462e-02,
+	 5.213170468028332e-02,
+	 5.825826450043575e-02,
+	 6.438263092985747e-02,
+	 7.050457338961386e-02,
+	 7.662386139203149e-02,
+	 8.274026454937569e-02,
+	 8.885355258252460e-02,
+	 9.496349532963899e-02,
+	 1.010698627548278e-01,
+	 1.071724249568088e-01,
+	 1.132709521775643e-01,
+	 1.193652148109914e-01,
+	 1.254549834115462e-01,
+	 1.315400287028831e-01,
+	 1.376201215864860e-01,
+	 1.436950331502945e-01,
+	 1.497645346773215e-01,
+	 1.558283976542652e-01,
+	 1.618863937801118e-01,
+	 1.679382949747312e-01,
+	 1.739838733874638e-01,
+	 1.800229014056995e-01,
+	 1.860551516634466e-01,
+	 1.920803970498924e-01,
+	 1.980984107179536e-01,
+	 2.041089660928169e-01,
+	 2.101118368804696e-01,
+	 2.161067970762195e-01,
+	 2.220936209732035e-01,
+	 2.280720831708857e-01,
+	 2.340419585835434e-01,
+	 2.400030224487415e-01,
+	 2.459550503357946e-01,
+	 2.518978181542170e-01,
+	 2.578311021621590e-01,
+	 2.637546789748313e-01,
+	 2.696683255729151e-01,
+	 2.755718193109581e-01,
+	 2.814649379257579e-01,
+	 2.873474595447295e-01,
+	 2.932191626942586e-01,
+	 2.990798263080405e-01,
+	 3.049292297354024e-01,
+	 3.107671527496115e-01,
+	 3.165933755561658e-01,
+	 3.224076788010699e-01,
+	 3.282098435790925e-01,
+	 3.339996514420094e-01,
+	 3.397768844068269e-01,
+	 3.455413249639891e-01,
+	 3.512927560855671e-01,
+	 3.570309612334300e-01,
+	 3.627557243673972e-01,
+	 3.684668299533723e-01,
+	 3.741640629714579e-01,
+	 3.798472089240512e-01,
+	 3.855160538439188e-01,
+	 3.911703843022539e-01,
+	 3.968099874167103e-01,
+	 4.024346508594184e-01,
+	 4.080441628649787e-01,
+	 4.136383122384345e-01,
+	 4.192168883632239e-01,
+	 4.247796812091088e-01,
+	 4.303264813400826e-01,
+	 4.358570799222555e-01,
+	 4.413712687317167e-01,
+	 4.468688401623742e-01,
+	 4.523495872337709e-01,
+	 4.578133035988772e-01,
+	 4.632597835518601e-01,
+	 4.686888220358279e-01,
+	 4.741002146505500e-01,
+	 4.794937576601530e-01,
+	 4.848692480007911e-01,
+	 4.902264832882912e-01,
+	 4.955652618257725e-01,
+	 5.008853826112407e-01,
+	 5.061866453451552e-01,
+	 5.114688504379703e-01,
+	 5.167317990176499e-01,
+	 5.219752929371544e-01,
+	 5.271991347819013e-01,
+	 5.324031278771979e-01,
+	 5.375870762956454e-01,
+	 5.427507848645159e-01,
+	 5.478940591731002e-01,
+	 5.530167055800275e-01,
+	 5.581185312205561e-01,
+	 5.631993440138341e-01,
+	 5.682589526701315e-01,
+	 5.732971666980422e-01,
+	 5.783137964116556e-01,
+	 5.833086529376983e-01,
+	 5.882815482226452e-01,
+	 5.932322950397998e-01,
+	 5.981607069963423e-01,
+	 6.030665985403482e-01,
+	 6.079497849677736e-01,
+	 6.128100824294097e-01,
+	 6.176473079378039e-01,
+	 6.224612793741500e-01,
+	 6.272518154951441e-01,
+	 6.320187359398091e-01,
+	 6.367618612362842e-01,
+	 6.414810128085832e-01,
+	 6.461760129833163e-01,
+	 6.508466849963809e-01,
+	 6.554928529996153e-01,
+	 6.601143420674205e-01,
+	 6.647109782033448e-01,
+	 6.692825883466360e-01,
+	 6.738290003787560e-01,
+	 6.783500431298615e-01,
+	 6.828455463852481e-01,
+	 6.873153408917591e-01,
+	 6.917592583641577e-01,
+	 6.961771314914630e-01,
+	 7.005687939432483e-01,
+	 7.049340803759049e-01,
+	 7.092728264388656e-01,
+	 7.135848687807935e-01,
+	 7.178700450557317e-01,
+	 7.221281939292153e-01,
+	 7.263591550843460e-01,
+	 7.305627692278276e-01,
+	 7.347388780959634e-01,
+	 7.388873244606151e-01,
+	 7.430079521351217e-01,
+	 7.471006059801801e-01,
+	 7.511651319096864e-01,
+	 7.552013768965365e-01,
+	 7.592091889783880e-01,
+	 7.631884172633813e-01,
+	 7.671389119358204e-01,
+	 7.710605242618137e-01,
+	 7.749531065948738e-01,
+	 7.788165123814759e-01,
+	 7.826505961665757e-01,
+	 7.864552135990858e-01,
+	 7.902302214373100e-01,
+	 7.939754775543372e-01,
+	 7.976908409433910e-01,
+	 8.013761717231401e-01,
+	 8.050313311429637e-01,
+	 8.086561815881750e-01,
+	 8.122505865852039e-01,
+	 8.158144108067338e-01,
+	 8.193475200767969e-01,
+	 8.228497813758263e-01,
+	 8.263210628456634e-01,
+	 8.297612337945230e-01,
+	 8.331701647019132e-01,
+	 8.365477272235119e-01,
+	 8.398937941959994e-01,
+	 8.432082396418454e-01,
+	 8.464909387740520e-01,
+	 8.497417680008524e-01,
+	 8.529606049303636e-01,
+	 8.561473283751945e-01,
+	 8.593018183570084e-01,
+	 8.624239561110405e-01,
+	 8.655136240905690e-01,
+	 8.685707059713409e-01,
+	 8.715950866559511e-01,
+	 8.745866522781761e-01,
+	 8.775452902072612e-01,
+	 8.804708890521608e-01,
+	 8.833633386657316e-01,
+	 8.862225301488806e-01,
+	 8.890483558546646e-01,
+	 8.918407093923427e-01,
+	 8.945994856313826e-01,
+	 8.973245807054183e-01,
+	 9.000158920161603e-01,
+	 9.026733182372588e-01,
+	 9.052967593181188e-01,
+	 9.078861164876662e-01,
+	 9.104412922580671e-01,
+	 9.129621904283981e-01,
+	 9.154487160882678e-01,
+	 9.179007756213904e-01,
+	 9.203182767091105e-01,
+	 9.227011283338785e-01,
+	 9.250492407826776e-01,
+	 9.273625256504011e-01,
+	 9.296408958431813e-01,
+	 9.318842655816681e-01,
+	 9.340925504042589e-01,
+	 9.362656671702783e-01,
+	 9.384035340631081e-01,
+	 9.405060705932683e-01,
+	 9.425731976014469e-01,
+	 9.446048372614803e-01,
+	 9.466009130832835e-01,
+	 9.485613499157303e-01,
+	 9.504860739494817e-01,
+	 9.523750127197659e-01,
+	 9.542280951091057e-01,
+	 9.560452513499964e-01,
+	 9.578264130275329e-01,
+	 9.595715130819845e-01,
+	 9.612804858113206e-01,
+	 9.629532668736839e-01,
+	 9.645897932898126e-01,
+	 9.661900034454126e-01,
+	 9.677538370934755e-01,
+	 9.692812353565485e-01,
+	 9.707721407289504e-01,
+	 9.722264970789363e-01,
+	 9.736442496508119e-01,
+	 9.750253450669941e-01,
+	 9.763697313300211e-01,
+	 9.776773578245099e-01,
+	 9.789481753190622e-01,
+	 9.801821359681173e-01,
+	 9.813791933137546e-01,
+	 9.825393022874412e-01,
+	 9.836624192117303e-01,
+	 9.847485018019042e-01,
+	 9.857975091675674e-01,
+	 9.868094018141854e-01,
+	 9.877841416445722e-01,
+	 9.887216919603238e-01,
+	 9.896220174632008e-01,
+	 9.904850842564570e-01,
+	 9.913108598461154e-01,
+	 9.920993131421918e-01,
+	 9.928504144598651e-01,
+	 9.935641355205953e-01,
+	 9.942404494531879e-01,
+	 9.948793307948056e-01,
+	 9.954807554919269e-01,
+	 9.960447009012520e-01,
+	 9.965711457905548e-01,
+	 9.970600703394830e-01,
+	 9.975114561403035e-01,
+	 9.979252861985960e-01,
+	 9.983015449338929e-01,
+	 9.986402181802653e-01,
+	 9.989412931868569e-01,
+	 9.992047586183639e-01,
+	 9.994306045554617e-01,
+	 9.996188224951786e-01,
+	 9.997694053512153e-01,
+	 9.998823474542126e-01,
+	 9.999576445519639e-01,
+	 9.999952938095762e-01
+};
+#endif // ORIENT_RESOLUTION
@@ -0,0 +1,99 @@
+// Paracrystal lattice factor Z(q) for the sc, bcc and fcc paracrystal models.
+//
+// The lattice is selected by one of the PARACRYSTAL_* constants below.  It
+// is always passed as a literal so the compiler can fold the lattice
+// selection away, leaving a separate specialized function for each model.
+//
+// Equations from Matsuoka et al., with the lattice given by the projection
+// of q onto the primitive vectors (sc 9-10-11, bcc 26-27-28, fcc 17-18-19)
+// and the spacing d_a along those vectors.  The orientation averaged Z(q)
+// depends on q and dnn only through x = q*dnn, so models can tabulate
+// paracrystal_Zq_average(lattice, x, 1.0, d_factor) in x using fq_table.c.
+
+#define PARACRYSTAL_SC 0
+#define PARACRYSTAL_BCC 1
+#define PARACRYSTAL_FCC 2
+
+static double
+paracrystal_Zq(int lattice, double qa, double qb, double qc,
+    double dnn, double d_factor)
+{
+    double a1, a2, a3, d_a;
+    if (lattice == PARACRYSTAL_BCC) {
+        a1 = (-qa + qb + qc)/2.0;
+        a2 = (+qa - qb + qc)/2.0;
+        a3 = (+qa + qb - qc)/2.0;
+        d_a = dnn/sqrt(0.75);
+    } else if (lattice == PARACRYSTAL_FCC) {
+        a1 = ( qa + qb)/2.0;
+        a2 = ( qa + qc)/2.0;
+        a3 = ( qb + qc)/2.0;
+        d_a = dnn*sqrt(2.0);
+    } else { // PARACRYSTAL_SC
+        a1 = qa;
+        a2 = qb;
+        a3 = qc;
+        d_a = dnn;
+    }
+
+    // Matsuoka 13-14-15, 23-24-25 and 29-30-31 for sc, fcc and bcc
+    //     Z_k numerator: 1 - exp(a)^2
+    //     Z_k denominator: 1 - 2 cos(d a_k) exp(a) + exp(2a)
+    // Rewriting numerator
+    //         => -(exp(2a) - 1)
+    //         => -expm1(2a)
+    // Rewriting denominator with 1 - cos(t) = 2 sin^2(t/2)
+    //         => (1 - exp(a))^2 + 4 exp(a) sin^2(d a_k/2)
+    //         => expm1(a)^2 + 4 exp(a) sin^2(d a_k/2)
+    // which keeps its precision as q -> 0, where 1 - 2 cos + exp(2a)
+    // cancels to zero and the table samples would overflow.
+    const double arg = -0.5*square(dnn*d_factor)*(a1*a1 + a2*a2 + a3*a3);
+    const double exp_arg = exp(arg);
+    const double em1 = square(expm1(arg));
+    const double Zq = -cube(expm1(2.0*arg))
+        / ( (em1 + 4.0*exp_arg*square(sin(0.5*d_a*a1)))
+          * (em1 + 4.0*exp_arg*square(sin(0.5*d_a*a2)))
+          * (em1 + 4.0*exp_arg*square(sin(0.5*d_a*a3))));
+
+    return Zq;
+}
+
+// Orientation average of Z(q) using GAUSS_N points in theta and phi.  The
+// sc lattice is symmetric under reflection in each axis, so only the first
+// octant is needed.  The bcc and fcc primitive vectors do not share this
+// symmetry, so they are averaged over the whole sphere.
+static double
+paracrystal_Zq_average(int lattice, double q, double dnn, double d_factor)
+{
+    const int octant = (lattice == PARACRYSTAL_SC);
+    // translate a point in [-1,1] to a point in [0, pi/2] or [0, 2 pi]
+    const double phi_m = octant ? M_PI_4 : M_PI;
+    const double phi_b = phi_m;
+    // translate a point in [-1,1] to a point in [0, pi/2] or [0, pi]
+    const double theta_m = octant ? M_PI_4 : M_PI_2;
+    const double theta_b = theta_m;
+
+    double outer_sum = 0.0;
+    for(int i=0; i<GAUSS_N; i++) {
+        double inner_sum = 0.0;
+        const double theta = GAUSS_Z[i]*theta_m + theta_b;
+        double sin_theta, cos_theta;
+        SINCOS(theta, sin_theta, cos_theta);
+        const double qc = q*cos_theta;
+        const double qab = q*sin_theta;
+        for(int j=0;j<GAUSS_N;j++) {
+            const double phi = GAUSS_Z[j]*phi_m + phi_b;
+            double sin_phi, cos_phi;
+            SINCOS(phi, sin_phi, cos_phi);
+            const double qa = qab*cos_phi;
+            const double qb = qab*sin_phi;
+            const double form = paracrystal_Zq(lattice, qa, qb, qc, dnn, d_factor);
+            inner_sum += GAUSS_W[j] * form;
+        }
+        inner_sum *= phi_m;  // sum(f(x)dx) = sum(f(x)) dx
+        outer_sum += GAUSS_W[i] * inner_sum * sin_theta;
+    }
+    outer_sum *= theta_m;
+    // divide by the solid angle covered
+    return octant ? outer_sum/M_PI_2 : outer_sum/(4.0*M_PI);
+}
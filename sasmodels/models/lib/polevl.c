@@ -53,11 +53,9 @@ static
 double polevl( double x, pconstant double *coef, int N )
 {
 
-    int i = 0;
-    double ans = coef[i];
-
-    while (i < N) {
-        i++;
+    // Counted loop so that it unrolls completely for constant N.
+    double ans = coef[0];
+    for (int i = 1; i <= N; i++) {
         ans = ans * x + coef[i];
     }
 
@@ -73,11 +71,8 @@ double polevl( double x, pconstant double *coef, int N )
 static
 double p1evl( double x, pconstant double *coef, int N )
 {
-    int i=0;
-    double ans = x+coef[i];
-
-    while (i < N-1) {
-        i++;
+    double ans = x+coef[0];
+    for (int i = 1; i < N; i++) {
         ans = ans*x + coef[i];
     }
 
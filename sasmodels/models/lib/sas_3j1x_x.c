@@ -6,7 +6,10 @@
 * in this case it is likely cancellation errors in the original expression
 * using double precision that are the source.
 */
+SIMD_FUNCTION
 double sas_3j1x_x(double q);
+SIMD_FUNCTION
+double sas_3j1x_x_sincos(double q, double sin_q, double cos_q);
 
 // The choice of the number of terms in the series and the cutoff value for
 // switching between series and direct calculation depends on the numeric
@@ -43,9 +46,24 @@ double sas_3j1x_x(double q);
 #define SPH_J1C_CUTOFF 0.7
 #endif
 
+// As sas_3j1x_x(q) given sin(q) and cos(q), so that models which also need
+// them, or which step them along a series of radii, only compute them once.
+double sas_3j1x_x_sincos(double q, double sin_q, double cos_q)
+{
+    // 2017-05-18 PAK - support negative q
+    // Both forms are evaluated and the result selected without a branch
+    // so that the dll q loop can be vectorized.  The direct form is NaN
+    // at q=0, but the series is selected there.
+    const double q2 = q*q;
+    const double series = 1.0 + q2*(-3./30. + q2*(3./840. + q2*(-3./45360.)));// + q2*(3./3991680.)))));
+    const double direct = 3.0*(sin_q/q - cos_q)/q2;
+    return (fabs(q) < SPH_J1C_CUTOFF ? series : direct);
+}
+
 double sas_3j1x_x(double q)
 {
     // 2017-05-18 PAK - support negative q
+    // Only the direct form needs sin and cos, so skip them for the series.
     if (fabs(q) < SPH_J1C_CUTOFF) {
         const double q2 = q*q;
         return (1.0 + q2*(-3./30. + q2*(3./840. + q2*(-3./45360.))));// + q2*(3./3991680.)))));
@@ -53,7 +53,9 @@ Copyright 1984, 1987, 1989, 2000 by Stephen L. Moshier
 
 #if FLOAT_SIZE>4
 //Cephes double precission
+#if !defined(USE_BRANCHLESS_SPECIAL)
 double cephes_j0(double x);
+#endif // !USE_BRANCHLESS_SPECIAL
 
  constant double PPJ0[8] = {
         7.96936729297347051624E-4,
@@ -145,6 +147,7 @@ double cephes_j0(double x);
         1.71086294081043136091E18,
   };
 
+#if !defined(USE_BRANCHLESS_SPECIAL)
 double cephes_j0(double x)
 {
     double w, z, p, q, xn;
@@ -182,9 +185,12 @@ double cephes_j0(double x)
 
     return( p * SQ2OPI / sqrt(x) );
 }
+#endif // !USE_BRANCHLESS_SPECIAL
 #else
 //Cephes single precission
+#if !defined(USE_BRANCHLESS_SPECIAL)
 float cephes_j0f(float x);
+#endif // !USE_BRANCHLESS_SPECIAL
 
  constant float MOJ0[8] = {
         -6.838999669318810E-002,
@@ -219,6 +225,7 @@ float cephes_j0f(float x);
         0.0
  };
 
+#if !defined(USE_BRANCHLESS_SPECIAL)
 float cephes_j0f(float x)
 {
     float xx, w, z, p, q, xn;
@@ -253,9 +260,77 @@ float cephes_j0f(float x)
     p = p * cos(xn + xx);
     return(p);
 }
+#endif // !USE_BRANCHLESS_SPECIAL
 #endif
 
+#if defined(USE_BRANCHLESS_SPECIAL)
+// Branch-free J0 for GPU and SIMD builds.  The approximations for both
+// ranges of the cephes function above are evaluated and the result is
+// selected, so there is no divergence between GPU threads and no branch
+// to stop the compiler from vectorizing the dll q loop.  The argument is
+// clamped to the range of each approximation so that the unused one stays
+// finite.  Results are identical to the cephes function.
+SIMD_FUNCTION
+static double sas_J0_select(double x);
+
 #if FLOAT_SIZE>4
+static double sas_J0_select(double x)
+{
+    const double SQ2OPI = 7.9788456080286535587989E-1;
+    const double PIO4 = 7.85398163397448309616E-1;
+    const double DR1 = 5.78318596294678452118E0;
+    const double DR2 = 3.04712623436620863991E1;
+
+    const double ax = fabs(x);
+
+    // |x| <= 5
+    const double xs = fmin(ax, 5.0);
+    const double z = xs * xs;
+    const double series = 1.0 - z/4.0;
+    const double rational = (z - DR1) * (z - DR2)
+        * polevl( z, RPJ0, 3)/p1evl( z, RQJ0, 8 );
+    const double small = (ax < 1.0e-5 ? series : rational);
+
+    // |x| > 5
+    const double xl = fmax(ax, 5.0);
+    const double w = 5.0/xl;
+    const double q = 25.0/(xl*xl);
+    const double p = polevl( q, PPJ0, 6)/polevl( q, PQJ0, 6 );
+    const double r = polevl( q, QPJ0, 7)/p1evl( q, QQJ0, 7 );
+    double sn, cn;
+    SINCOS(xl - PIO4, sn, cn);
+    const double large = (p * cn - w * r * sn) * SQ2OPI / sqrt(xl);
+
+    return (ax <= 5.0 ? small : large);
+}
+#else
+static float sas_J0_select(float x)
+{
+    const float DR1 =  5.78318596294678452118;
+    const float PIO4F = 0.7853981633974483096;
+
+    const float ax = fabs(x);
+
+    // |x| <= 2
+    const float xs = fmin(ax, 2.0f);
+    const float z = xs * xs;
+    const float series = 1.0 - 0.25*z;
+    const float poly = (z-DR1) * polevl( z, JPJ0, 4);
+    const float small = (ax < 1.0e-3 ? series : poly);
+
+    // |x| > 2
+    const float xl = fmax(ax, 2.0f);
+    const float q = 1.0/xl;
+    const float p = sqrt(q) * polevl( q, MOJ0, 7);
+    const float xn = q * polevl( q*q, PHJ0, 7) - PIO4F;
+    const float large = p * cos(xn + xl);
+
+    return (ax <= 2.0 ? small : large);
+}
+#endif
+#define sas_J0 sas_J0_select
+
+#elif FLOAT_SIZE>4
 #define sas_J0 cephes_j0
 #else
 #define sas_J0 cephes_j0f
@@ -104,6 +104,7 @@ constant double QQJ1[8] = {
     3.36093607810698293419E2,
     0.0 };
 
+#if !defined(USE_BRANCHLESS_SPECIAL)
 static
 double cephes_j1(double x)
 {
@@ -151,6 +152,7 @@ double cephes_j1(double x)
     p = p*(sin_x - cos_x) + w*q*(sin_x + cos_x);
     return( sign_x * p * SQRT1_PI / sqrt(abs_x) );
 }
+#endif // !USE_BRANCHLESS_SPECIAL
 
 #else
 //Single precission version of cephes
@@ -187,6 +189,7 @@ constant float PH1J1[8] = {
     3.749989509080821E-001
     };
 
+#if !defined(USE_BRANCHLESS_SPECIAL)
 static
 float cephes_j1f(float xx)
 {
@@ -229,9 +232,74 @@ float cephes_j1f(float xx)
 
     return( xx < 0. ? -p : p );
 }
+#endif // !USE_BRANCHLESS_SPECIAL
 #endif
 
+#if defined(USE_BRANCHLESS_SPECIAL)
+// Branch-free J1 for GPU and SIMD builds.  See sas_J0_select for details.
+SIMD_FUNCTION
+static double sas_J1_select(double x);
+
 #if FLOAT_SIZE>4
+static double sas_J1_select(double x)
+{
+    const double Z1 = 1.46819706421238932572E1;
+    const double Z2 = 4.92184563216946036703E1;
+    const double SQRT1_PI = 0.56418958354775628;
+
+    const double ax = fabs(x);
+
+    // |x| <= 5
+    const double xs = fmin(ax, 5.0);
+    const double z = xs * xs;
+    const double small = polevl( z, RPJ1, 3 ) / p1evl( z, RQJ1, 8 )
+        * xs * (z - Z1) * (z - Z2);
+
+    // |x| > 5
+    const double xl = fmax(ax, 5.0);
+    const double w = 5.0/xl;
+    const double zl = w * w;
+    const double p = polevl( zl, PPJ1, 6)/polevl( zl, PQJ1, 6 );
+    const double q = polevl( zl, QPJ1, 7)/p1evl( zl, QQJ1, 7 );
+    double sin_x, cos_x;
+    SINCOS(xl, sin_x, cos_x);
+    const double large = (p*(sin_x - cos_x) + w*q*(sin_x + cos_x))
+        * SQRT1_PI / sqrt(xl);
+
+    const double result = (ax <= 5.0 ? small : large);
+    return (x < 0 ? -result : result);
+}
+#else
+static float sas_J1_select(float x)
+{
+    const float Z1 = 1.46819706421238932572E1;
+
+    const float ax = fabs(x);
+
+    // |x| <= 2
+    const float xs = fmin(ax, 2.0f);
+    const float z = xs * xs;
+    const float small = (z-Z1) * xs * polevl( z, JPJ1, 4 );
+
+    // |x| > 2
+    const float xl = fmax(ax, 2.0f);
+    const float q = 1.0/xl;
+    const float p = sqrt(q) * polevl( q, MO1J1, 7);
+    const float xn = q * polevl( q*q, PH1J1, 7);
+    float cos_xn, sin_xn;
+    float cos_x, sin_x;
+    SINCOS(xn, sin_xn, cos_xn);
+    SINCOS(xl, sin_x, cos_x);
+    const float large =
+        p * M_SQRT1_2*(sin_xn*(sin_x+cos_x) + cos_xn*(sin_x-cos_x));
+
+    const float result = (ax <= 2.0 ? small : large);
+    return (x < 0. ? -result : result);
+}
+#endif
+#define sas_J1 sas_J1_select
+
+#elif FLOAT_SIZE>4
 #define sas_J1 cephes_j1
 #else
 #define sas_J1 cephes_j1f
@@ -73,11 +73,11 @@ double cephes_jn( int n, double x ) {
     }
 
     if( n == 0 )
-        return( sign * cephes_j0(x) );
+        return( sign * sas_J0(x) );
     if( n == 1 )
-        return( sign * cephes_j1(x) );
+        return( sign * sas_J1(x) );
     if( n == 2 )
-        return( sign * (2.0 * cephes_j1(x) / x  -  cephes_j0(x)) );
+        return( sign * (2.0 * sas_J1(x) / x  -  sas_J0(x)) );
 
     if( x < MACHEP )
         return( 0.0 );
@@ -110,9 +110,9 @@ double cephes_jn( int n, double x ) {
     } while( --k > 0 );
 
     if( fabs(pk) > fabs(pkm1) )
-        ans = cephes_j1(x)/pk;
+        ans = sas_J1(x)/pk;
     else
-        ans = cephes_j0(x)/pkm1;
+        ans = sas_J0(x)/pkm1;
 
     return( sign * ans );
 }
@@ -144,11 +144,11 @@ float cephes_jnf(int n, float x)
     }
 
     if( n == 0 )
-        return( sign * cephes_j0f(x) );
+        return( sign * sas_J0(x) );
     if( n == 1 )
-        return( sign * cephes_j1f(x) );
+        return( sign * sas_J1(x) );
     if( n == 2 )
-        return( sign * (2.0 * cephes_j1f(x) / x  -  cephes_j0f(x)) );
+        return( sign * (2.0 * sas_J1(x) / x  -  sas_J0(x)) );
 
     if( x < MACHEP )
         return( 0.0 );
@@ -187,9 +187,9 @@ float cephes_jnf(int n, float x)
         ans = -ans;
 
     if( r > ans )  /* if( fabs(pk) > fabs(pkm1) ) */
-        ans = sign * cephes_j1f(x)/pk;
+        ans = sign * sas_J1(x)/pk;
     else
-        ans = sign * cephes_j0f(x)/pkm1;
+        ans = sign * sas_J0(x)/pkm1;
     return( ans );
 }
 #endif
@@ -199,3 +199,78 @@ float cephes_jnf(int n, float x)
 #else
 #define sas_JN cephes_jnf
 #endif
+
+/* Bessel functions of all integer orders 0 through nmax.
+ *
+ * sas_JN_all(nmax, x, out) sets out[k] = J_k(x) for k = 0, ..., nmax
+ * using a single recurrence, so this is much cheaper than calling sas_JN
+ * for each order.  For |x| <= nmax this is the backward recurrence from
+ * order nmax used in cephes_jn, which produces the ratio of each lower
+ * order to J_nmax as a byproduct.  For |x| > nmax the forward recurrence
+ * from J0 and J1 is stable, and it stays accurate for large x where the
+ * continued fraction in cephes_jn does not converge.  out must have room
+ * for nmax+1 values.
+ *
+ * Not suitable for large n.
+ */
+static void
+sas_JN_all(int nmax, double x, double *out)
+{
+#if FLOAT_SIZE > 4
+    const double MACHEP = 1.11022302462515654042E-16;
+    const double BIG = 1e150;
+    int k = 53;
+#else
+    const double MACHEP = 5.9604645e-08;
+    const double BIG = 1e20;
+    int k = 24;
+#endif
+    // J_k(-x) = (-1)^k J_k(x)
+    const double ax = fabs(x);
+    const double j0 = sas_J0(ax);
+    const double j1 = nmax >= 1 ? sas_J1(ax) : 0.0;
+
+    out[0] = j0;
+    if (nmax >= 1) {
+        out[1] = j1;
+    }
+    if (nmax >= 2) {
+        if (ax < MACHEP) {
+            for (int n = 2; n <= nmax; n++) out[n] = 0.0;
+        } else if (ax > nmax) {
+            // forward recurrence is stable for orders below x
+            for (int n = 1; n < nmax; n++) {
+                out[n+1] = out[n] * 2 * n / ax - out[n-1];
+            }
+        } else {
+            // continued fraction for J_nmax/J_nmax-1
+            double pk = 2 * (nmax + k);
+            double ans = pk;
+            const double xk = ax * ax;
+            do {
+                pk -= 2.0;
+                ans = pk - (xk/ans);
+            } while( --k > 0 );
+
+            // backward recurrence of J_n/J_nmax, stored in out[n]
+            out[nmax] = 1.0;
+            out[nmax-1] = ans/ax;
+            for (int n = nmax-1; n > 0; n--) {
+                out[n-1] = (out[n] * 2 * n - out[n+1] * ax) / ax;
+                // rescale to avoid overflow when x is small
+                if (fabs(out[n-1]) > BIG) {
+                    for (int m = n-1; m <= nmax; m++) out[m] /= BIG;
+                }
+            }
+
+            // normalize by whichever of J0 and J1 is better conditioned
+            const double scale = fabs(out[1]) > fabs(out[0])
+                ? j1/out[1] : j0/out[0];
+            for (int n = 0; n <= nmax; n++) out[n] *= scale;
+        }
+    }
+    if (x < 0.0) {
+        for (int n = 1; n <= nmax; n += 2) out[n] = -out[n];
+    }
+}
+
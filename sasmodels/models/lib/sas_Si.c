@@ -1,5 +1,29 @@
 // integral of sin(x)/x Taylor series approximated to w/i 0.1%
 double sas_Si(double x);
+#if defined(USE_BRANCHLESS_SPECIAL)
+// Branch-free version for GPU and SIMD builds, which evaluates both the
+// asymptotic form and the series and selects the result.
+double sas_Si(double x)
+{
+    const double xl = fmax(x, M_PI*6.2/4.0);
+    const double xxinv = 1./(xl*xl);
+    const double out_cos = (((-720.*xxinv + 24.)*xxinv - 2.)*xxinv + 1.)/xl;
+    const double out_sin = (((-5040.*xxinv + 120.)*xxinv - 6.)*xxinv + 1)*xxinv;
+    double sin_x, cos_x;
+    SINCOS(xl, sin_x, cos_x);
+    const double large = M_PI_2 - cos_x*out_cos - sin_x*out_sin;
+
+    const double xx = x*x;
+    const double small = (((((-1./439084800.*xx
+        + 1./3265920.)*xx
+        - 1./35280.)*xx
+        + 1./600.)*xx
+        - 1./18.)*xx
+        + 1.)*x;
+
+    return (x >= M_PI*6.2/4.0 ? large : small);
+}
+#else
 double sas_Si(double x)
 {
     if (x >= M_PI*6.2/4.0) {
@@ -22,3 +46,4 @@ double sas_Si(double x)
             + 1.)*x;
     }
 }
+#endif
@@ -46,10 +46,8 @@ double linear_pearls_kernel(double q,
     double psi = sas_3j1x_x(q * radius);
 
     // N pearls interaction terms
-    double structure_factor = (double)num_pearls;
-    for(int num=1; num<num_pearls; num++) {
-        structure_factor += 2.0*(num_pearls-num)*sas_sinx_x(q*separation*num);
-    }
+    double structure_factor = num_pearls
+        + 2.0*lattice_sinc_sum(num_pearls, q*separation);
     // form factor for num_pearls
     double form_factor = 1.0e-4 * structure_factor * square(m_s*psi) / tot_vol;
 
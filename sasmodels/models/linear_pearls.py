@@ -68,7 +68,8 @@ parameters = [
 # pylint: enable=bad-whitespace, line-too-long
 single = False
 
-source = ["lib/sas_3j1x_x.c", "linear_pearls.c"]
+source = ["lib/sas_3j1x_x.c", "lib/lattice_reinsch.c", "lib/lattice_sinc_sum.c",
+          "linear_pearls.c"]
 
 def random():
     """Return a random parameter set for the model."""
@@ -82,6 +83,23 @@ def random():
     )
     return pars
 
+# Long necklaces from low q, where q*separation is near zero, past the
+# pearl form factor minima.
+tests = [
+    [{'num_pearls': 10.0,
+      'scale': 1.0,
+      'background': 0.0,
+     }, [1e-4, 0.001, 0.01, 0.1, 0.5],
+     [59814., 33370.8, 3403.23, 0.99893, 0.00993481]],
+    [{'radius': 10.0,
+      'edge_sep': 20.0,
+      'num_pearls': 1000.0,
+      'scale': 1.0,
+      'background': 0.0,
+     }, [1e-4, 0.001, 0.01, 0.1, 0.5],
+     [7911.62, 909.115, 92.0832, 7.54494, 0.0421109]],
+    ]
+
 _ = """
 Tests temporarily disabled, until single-double precision accuracy issue solved.
 
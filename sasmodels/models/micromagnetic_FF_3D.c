@@ -45,54 +45,51 @@ static double reduced_field(double q, double Ms, double Hi,
 //the two transversal magnetisation components, reacting to a magnetic field.
 //The micromagnetic solution for the magnetisation are from Michels et al. PRB 94, 054424 (2016).
 
-static double fqMxreal( double qx, double qy, double qz, double Mz, double Hkx, double Hky, double Hi, double Ms, double A, double D)
+// The four transverse components are linear in the anisotropy field and
+// Mz, with coefficients which depend only on q and the material, so they
+// are collected once per q and shared by all orientations of the
+// anisotropy axis.  Each component is
+//     M = (Hkx*hkx + Hky*hky + Mz*mz)/denominator
+// for Mx real, Mx imag, My real and My imag in that order.
+typedef struct {
+  double hkx[4];
+  double hky[4];
+  double mz[4];
+  double denominator;
+} MicromagneticTerms;
+
+static MicromagneticTerms
+micromagnetic_terms(double qx, double qy, double qz, double Hi, double Ms, double A, double D)
 {
-  double qsq = qx * qx + qy * qy + qz * qz;
-  double q = sqrt(qsq); 
-  double Hr = reduced_field(q, Ms, Hi, A);
-  double DMI = DMI_length(Ms, D,q);
-  double DMIz = DMI_length(Ms, D,qz);
-  double denominator = (qsq + Hr * (qx * qx + qy * qy) - square(Hr * DMIz * q)) / Hr;
-  double f = (Hkx * (qsq + Hr * qy * qy) - Ms * Mz * qx * qz * (1.0 + Hr * square(DMI)) - Hky * Hr * qx * qy) / denominator;
-  return f;
-}
-
-static double fqMximag(double qx, double qy, double qz, double Mz, double Hkx, double Hky, double Hi, double Ms, double A, double D)
-{
-  double qsq = qx * qx + qy * qy + qz * qz;
-  double q = sqrt(qsq);   
-  double Hr = reduced_field(q, Ms, Hi, A);
-  double DMI = DMI_length(Ms, D,q);
-  double DMIz = DMI_length(Ms, D,qz);
-  double DMIy = DMI_length(Ms, D,qy);
-  double denominator = (qsq + Hr * (qx * qx + qy * qy) - square(Hr * DMIz * q)) / Hr;
-  double f = - qsq * (Ms * Mz * (1.0 + Hr) * DMIy + Hky * Hr * DMIz) / denominator;
-  return f;
-}
-
-static double fqMyreal( double qx, double qy, double qz, double Mz, double Hkx, double Hky, double Hi, double Ms, double A, double D)
-{
-  double qsq = qx * qx + qy * qy + qz * qz;
-  double q = sqrt(qsq); 
-  double Hr = reduced_field(q, Ms, Hi, A);
-  double DMI = DMI_length(Ms, D,q);
-  double DMIz = DMI_length(Ms, D,qz);
-  double denominator = (qsq + Hr * (qx * qx + qy * qy) - square(Hr * DMIz * q))/Hr;
-  double f = (Hky * (qsq + Hr * qx * qx) - Ms * Mz * qy * qz * (1.0 + Hr * square(DMI)) - Hkx * Hr * qx * qy)/denominator;
-  return f;
-}
-
-static double fqMyimag( double qx, double qy, double qz, double Mz, double Hkx, double Hky, double Hi, double Ms, double A, double D)
-{
-  double qsq = qx * qx + qy * qy + qz * qz;
-  double q = sqrt(qsq);  
-  double Hr = reduced_field(q, Ms, Hi, A);
-  double DMI = DMI_length(Ms, D,q);
-  double DMIx = DMI_length(Ms, D,qx);
-  double DMIz = DMI_length(Ms, D,qz);
-  double denominator = (qsq + Hr * (qx * qx + qy * qy) - square(Hr * DMIz * q))/Hr;
-  double f = qsq * (Ms * Mz * (1.0 + Hr) * DMIx - Hkx * Hr * DMIz)/denominator;
-  return f;
+  const double qsq = qx * qx + qy * qy + qz * qz;
+  const double q = sqrt(qsq);
+  const double Hr = reduced_field(q, Ms, Hi, A);
+  const double DMI = DMI_length(Ms, D, q);
+  const double DMIx = DMI_length(Ms, D, qx);
+  const double DMIy = DMI_length(Ms, D, qy);
+  const double DMIz = DMI_length(Ms, D, qz);
+  const double Mz_real = -Ms * (1.0 + Hr * square(DMI));
+  const double Mz_imag = qsq * Ms * (1.0 + Hr);
+
+  MicromagneticTerms t;
+  t.denominator = (qsq + Hr * (qx * qx + qy * qy) - square(Hr * DMIz * q)) / Hr;
+  // Mx real
+  t.hkx[0] = qsq + Hr * qy * qy;
+  t.hky[0] = -Hr * qx * qy;
+  t.mz[0] = Mz_real * qx * qz;
+  // Mx imag
+  t.hkx[1] = 0.0;
+  t.hky[1] = -qsq * Hr * DMIz;
+  t.mz[1] = -Mz_imag * DMIy;
+  // My real
+  t.hkx[2] = -Hr * qx * qy;
+  t.hky[2] = qsq + Hr * qx * qx;
+  t.mz[2] = Mz_real * qy * qz;
+  // My imag
+  t.hkx[3] = -qsq * Hr * DMIz;
+  t.hky[3] = 0.0;
+  t.mz[3] = Mz_imag * DMIx;
+  return t;
 }
 
 static double
@@ -108,37 +105,40 @@ Calculate_Scattering(double q, double cos_theta, double sin_theta, double radius
     double nuc = fq(q, radius, thickness, nuc_sld_core, nuc_sld_shell, nuc_sld_solvent);
 	double hk = fq(q, radius, 0, hk_sld_core, 0, 0);
 
-    double cos_gamma, sin_gamma;
-    double sld[8];
-    //loop over random anisotropy axis with isotropic orientation gamma for Hkx and Hky
+    const MicromagneticTerms terms = micromagnetic_terms(qrot[0], qrot[1], qrot[2], Hi, Ms, A, D);
+
+    //Only the core of the defect/particle in the matrix has an effective
+    //anisotropy (for simplicity), for the effect of different, more complex
+    // spatial profile of the anisotropy see Michels PRB 82, 024433 (2010)
+    //With Hkx = hk sin(gamma) and Hky = hk cos(gamma) the magnetisation is
+    //M0 + sin(gamma) Mx + cos(gamma) My, and since the slds are affine in the
+    //magnetisation they are sld0 + sin(gamma) sldx + cos(gamma) sldy.
+    double M0[4], Mx[4], My[4];
+    for (int k = 0; k < 4; k++) {
+      M0[k] = mz * terms.mz[k] / terms.denominator;
+      Mx[k] = hk * terms.hkx[k] / terms.denominator;
+      My[k] = hk * terms.hky[k] / terms.denominator;
+    }
+    double sld0[8], sldx[8], sldy[8];
+    mag_sld(qrot[0], qrot[1], qrot[2], M0[0], M0[1], M0[2], M0[3], mz, 0, nuc, sld0);
+    mag_sld(qrot[0], qrot[1], qrot[2], Mx[0], Mx[1], Mx[2], Mx[3], 0, 0, 0, sldx);
+    mag_sld(qrot[0], qrot[1], qrot[2], My[0], My[1], My[2], My[3], 0, 0, 0, sldy);
+
+    //average over random anisotropy axis with isotropic orientation gamma for Hkx and Hky
     //To be modified for textured material see also Weissmueller et al. PRB 63, 214414 (2001)
+    //The sld is linear in sin(gamma) and cos(gamma), so the average of its
+    //square over gamma in [0, 2 pi] is sld0^2 + (sldx^2 + sldy^2)/2.  The
+    //factor of 2 is the normalization of a gauss rule over gamma, whose
+    //weights sum to 2.
     double total_F2 = 0.0;
-    for (int i = 0; i<GAUSS_N ;i++) {
-      const double gamma = M_PI * (GAUSS_Z[i] + 1.0); // 0 .. 2 pi
-      SINCOS(gamma, sin_gamma, cos_gamma);	
-      //Only the core of the defect/particle in the matrix has an effective
-      //anisotropy (for simplicity), for the effect of different, more complex
-      // spatial profile of the anisotropy see Michels PRB 82, 024433 (2010)
-      double Hkx = hk * sin_gamma;
-      double Hky = hk * cos_gamma;
-
-      double mxreal = fqMxreal(qrot[0], qrot[1], qrot[2], mz, Hkx, Hky, Hi, Ms, A, D);
-      double mximag = fqMximag(qrot[0], qrot[1], qrot[2], mz, Hkx, Hky, Hi, Ms, A, D);
-      double myreal = fqMyreal(qrot[0], qrot[1], qrot[2], mz, Hkx, Hky, Hi, Ms, A, D);
-      double myimag = fqMyimag(qrot[0], qrot[1], qrot[2], mz, Hkx, Hky, Hi, Ms, A, D);
-
-      mag_sld(qrot[0], qrot[1], qrot[2], mxreal, mximag, myreal, myimag, mz, 0, nuc, sld);
-      double form = 0.0;
-      for (unsigned int xs = 0; xs<8; xs++) {
-        if (weights[xs] > 1.0e-8) {
-          // Since the cross section weight is significant, set the slds
-          // to the effective slds for this cross section, call the
-          // kernel, and add according to weight.
-          // loop over uu, ud real, du real, dd, ud imag, du imag 
-          form += weights[xs] * sld[xs] * sld[xs];
-        }
+    for (unsigned int xs = 0; xs<8; xs++) {
+      if (weights[xs] > 1.0e-8) {
+        // Since the cross section weight is significant, set the slds
+        // to the effective slds for this cross section, call the
+        // kernel, and add according to weight.
+        // loop over uu, ud real, du real, dd, ud imag, du imag 
+        total_F2 += weights[xs] * (2.0 * square(sld0[xs]) + square(sldx[xs]) + square(sldy[xs]));
       }
-      total_F2 += GAUSS_W[i] * form ;      
     }
     return total_F2;
 }
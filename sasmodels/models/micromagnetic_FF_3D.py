@@ -178,4 +178,24 @@ def random():
 tests = [
      [{},1.002266990452620e-03, 7.461046163627724e+03],
      [{},(0.0688124,  -0.0261013),  22.024],
+     # Spin flip with DMI, a tilted field with a weak internal field, and
+     # a polarised non spin flip cross section along the beam.
+     [{'D': 2.0, 'up_i': 1.0, 'up_f': 0.0, 'background': 0.0},
+      [1e-4, 0.001, 0.01, 0.1, 0.5],
+      [115.765, 115.847, 116.633, 0.0714244, 9.2512e-05]],
+     [{'D': 2.0, 'up_i': 1.0, 'up_f': 0.0, 'background': 0.0},
+      [(0.001, -0.003), (0.0688124, -0.0261013), (-0.02, 0.05), (0.2, -0.1)],
+      [92.1224, 0.236158, 0.0105316, 0.000592598]],
+     [{'D': 1.0, 'up_i': 0.0, 'up_f': 0.0, 'alpha': 45.0, 'beta': 30.0,
+       'Hi': 0.1, 'hk_sld_core': 3.0, 'background': 0.0},
+      [1e-4, 0.001, 0.01, 0.1, 0.5],
+      [3704.09, 3693.18, 3190.48, 5.37851, 0.00284759]],
+     [{'D': 1.0, 'up_i': 0.0, 'up_f': 0.0, 'alpha': 45.0, 'beta': 30.0,
+       'Hi': 0.1, 'hk_sld_core': 3.0, 'background': 0.0},
+      [(0.001, -0.003), (0.0688124, -0.0261013), (-0.02, 0.05), (0.2, -0.1)],
+      [3649.27, 17.5817, 6.75849, 0.019536]],
+     [{'up_i': 1.0, 'up_f': 1.0, 'alpha': 0.0, 'Ms': 2.0, 'A': 3.0,
+       'background': 0.0},
+      [(0.001, -0.003), (0.0688124, -0.0261013), (-0.02, 0.05), (0.2, -0.1)],
+      [11704.1, 32.8083, 7.21891, 0.0469954]],
 ]
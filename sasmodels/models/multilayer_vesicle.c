@@ -18,24 +18,34 @@ multilayer_vesicle_kernel(double q,
           double sld,
           int n_shells)
 {
+    // sin(q r) and cos(q r) are stepped from one bilayer to the next by
+    // angle addition, so there are three sincos calls per q rather than
+    // two for each bilayer.
+    const double sldi = sld_solvent-sld;
+    double sin_step, cos_step, sin_shell, cos_shell, sin_r, cos_r;
+    SINCOS(q*(thick_shell + thick_solvent), sin_step, cos_step);
+    SINCOS(q*thick_shell, sin_shell, cos_shell);
+    SINCOS(q*radius, sin_r, cos_r);
+
     //calculate with a loop, two shells at a time
     int ii = 0;
     double fval = 0.0;
-    double voli = 0.0;
-    const double sldi = sld_solvent-sld;
-
     do {
-        double ri = radius + (double)ii*(thick_shell + thick_solvent);
+        const double ri = radius + (double)ii*(thick_shell + thick_solvent);
+        const double ro = ri + thick_shell;
+        const double sin_ro = sin_r*cos_shell + cos_r*sin_shell;
+        const double cos_ro = cos_r*cos_shell - sin_r*sin_shell;
 
         // layer 1
-        voli = M_4PI_3*ri*ri*ri;
-        fval += voli*sldi*sas_3j1x_x(ri*q);
-
-        ri += thick_shell;
+        fval += M_4PI_3*ri*ri*ri*sldi*sas_3j1x_x_sincos(ri*q, sin_r, cos_r);
 
         // layer 2
-        voli = M_4PI_3*ri*ri*ri;
-        fval -= voli*sldi*sas_3j1x_x(ri*q);
+        fval -= M_4PI_3*ro*ro*ro*sldi*sas_3j1x_x_sincos(ro*q, sin_ro, cos_ro);
+
+        // move to the next bilayer
+        const double sin_next = sin_r*cos_step + cos_r*sin_step;
+        cos_r = cos_r*cos_step - sin_r*sin_step;
+        sin_r = sin_next;
 
         //do 2 layers at a time
         ii++;
@@ -191,4 +191,16 @@ tests = [
       'scale': 1.0,
       'background': 0.001,
      }, (0.001, 0.30903), 1.61873],
+
+    # Many bilayers, where sin and cos are stepped from one to the next.
+    [{'volfraction': 1.0,
+      'radius': 200.0,
+      'thick_shell': 30.0,
+      'thick_solvent': 20.0,
+      'sld_solvent': 6.4,
+      'sld': 0.4,
+      'n_shells': 100.0,
+      'scale': 1.0,
+      'background': 0.0,
+     }, [1e-4, 0.01, 0.1, 0.5], [7.23046e+08, 2.67774, 0.519823, 0.0721092]],
     ]
@@ -1,31 +1,78 @@
 
-static double
-f_exp(double q, double r, double sld_in, double sld_out,
-    double thickness, double A, double side)
+// Each boundary between layers, from the core out to the solvent, keeps
+// the following values in the setup scratch buffer:
+//   r      radius of the boundary
+//   flat   volume times the change in the flat sld across the boundary
+//   e_in   volume times the exponential amplitude of the inner shell
+//   a_in   decay of the inner shell at the boundary, A r/thickness
+//   e_out  volume times the exponential amplitude of the outer shell
+//   a_out  decay of the outer shell at the boundary
+// With up to 10 shells there are at most 11 boundaries, so setup_size in
+// onion.py is 11*ONION_BOUNDARY.
+#define ONION_BOUNDARY 6
+
+// Split the sld for a shell into the flat and exponential parts at a
+// radius, so that sld(r) = flat + amp*exp(A (r-r_in)/thickness).
+static void
+_onion_shell(double r, double sld_in, double sld_out, double thickness,
+    double A, double side, double *flat, double *amp, double *alpha)
 {
-  const double vol = M_4PI_3 * cube(r);
-  const double qr = q * r;
-  const double bes = sas_3j1x_x(qr);
-  const double alpha = A * r/thickness;
-  double result;
-  if (qr == 0.0) {
-    result = 1.0;
-  } else if (fabs(A) > 0.0) {
-    const double qrsq = qr * qr;
-    const double alphasq = alpha * alpha;
-    const double sumsq = alphasq + qrsq;
-    double sinqr, cosqr;
-    SINCOS(qr, sinqr, cosqr);
-    const double t1 = (alphasq - qrsq)*sinqr/qr - 2.0*alpha*cosqr;
-    const double t2 = alpha*sinqr/qr - cosqr;
-    const double fun = -3.0*(t1/sumsq - t2)/sumsq;
+  if (fabs(A) > 0.0) {
     const double slope = (sld_out - sld_in)/expm1(A);
-    const double contrast = slope*exp(A*side);
-    result = contrast*fun + (sld_in-slope)*bes;
+    *flat = sld_in - slope;
+    *amp = slope*exp(A*side);
+    *alpha = A*r/thickness;
   } else {
-    result = sld_in*bes;
+    *flat = sld_in;
+    *amp = 0.0;
+    *alpha = 0.0;
   }
-  return vol * result;
+}
+
+static void
+setup(double sld_core, double radius_core, double sld_solvent,
+    double n_shells, double sld_in[], double sld_out[], double thickness[],
+    double A[], double scratch[])
+{
+  const int n = (int)(n_shells+0.5);
+  double r = radius_core;
+  double flat_in = sld_core, amp_in = 0.0, alpha_in = 0.0;
+  for (int k=0; k <= n; k++) {
+    double flat_out, amp_out, alpha_out;
+    if (k < n) {
+      _onion_shell(r, sld_in[k], sld_out[k], thickness[k], A[k], 0.0,
+                   &flat_out, &amp_out, &alpha_out);
+    } else {
+      flat_out = sld_solvent;
+      amp_out = alpha_out = 0.0;
+    }
+    const double vol = M_4PI_3 * cube(r);
+    double *b = scratch + ONION_BOUNDARY*k;
+    b[0] = r;
+    b[1] = vol*(flat_in - flat_out);
+    b[2] = vol*amp_in;
+    b[3] = alpha_in;
+    b[4] = vol*amp_out;
+    b[5] = alpha_out;
+    if (k < n) {
+      r += thickness[k];
+      _onion_shell(r, sld_in[k], sld_out[k], thickness[k], A[k], 1.0,
+                   &flat_in, &amp_in, &alpha_in);
+    }
+  }
+}
+
+// Transform of the exponential shell profile up to radius r, relative to
+// the amplitude at r, given sin(qr)/qr and cos(qr).
+static double
+_onion_exp(double qr, double sinc, double cos_qr, double alpha)
+{
+  const double qrsq = qr * qr;
+  const double alphasq = alpha * alpha;
+  const double sumsq = alphasq + qrsq;
+  const double t1 = (alphasq - qrsq)*sinc - 2.0*alpha*cos_qr;
+  const double t2 = alpha*sinc - cos_qr;
+  return -3.0*(t1/sumsq - t2)/sumsq;
 }
 
 static double
@@ -55,18 +102,20 @@ radius_effective(int mode, double radius_core, double n_shells, double thickness
 static void
 Fq(double q, double *F1, double *F2, double sld_core, double radius_core, double sld_solvent,
     double n_shells, double sld_in[], double sld_out[], double thickness[],
-    double A[])
+    double A[], const double scratch[])
 {
-  int n = (int)(n_shells+0.5);
-  double r_out = radius_core;
-  double f = f_exp(q, r_out, sld_core, 0.0, 0.0, 0.0, 0.0);
-  for (int i=0; i < n; i++){
-    const double r_in = r_out;
-    r_out += thickness[i];
-    f -= f_exp(q, r_in, sld_in[i], sld_out[i], thickness[i], A[i], 0.0);
-    f += f_exp(q, r_out, sld_in[i], sld_out[i], thickness[i], A[i], 1.0);
+  const int n = (int)(n_shells+0.5);
+  double f = 0.0;
+  for (int k=0; k <= n; k++) {
+    const double *b = scratch + ONION_BOUNDARY*k;
+    const double qr = q*b[0];
+    double sin_qr, cos_qr;
+    SINCOS(qr, sin_qr, cos_qr);
+    const double sinc = qr == 0.0 ? 1.0 : sin_qr/qr;
+    const double e_in = b[2] == 0.0 ? 0.0 : b[2]*_onion_exp(qr, sinc, cos_qr, b[3]);
+    const double e_out = b[4] == 0.0 ? 0.0 : b[4]*_onion_exp(qr, sinc, cos_qr, b[5]);
+    f += b[1]*sas_3j1x_x_sincos(qr, sin_qr, cos_qr) + e_in - e_out;
   }
-  f -= f_exp(q, r_out, sld_solvent, 0.0, 0.0, 0.0, 0.0);
 
   *F1 = 1e-2 * f;
   *F2 = 1e-4 * f * f;
@@ -337,6 +337,8 @@ parameters = [
 source = ["lib/sas_3j1x_x.c", "onion.c"]
 single = False
 have_Fq = True
+# 6 values for each of up to 11 shell boundaries; see onion.c
+setup_size = 66
 radius_effective_modes = ["outer radius"]
 
 profile_axes = ['Radius (A)', 'SLD (1e-6/A^2)']
@@ -411,3 +413,23 @@ demo = {
     #"thickness4_pd_n": 10,
     #"thickness4_pd": 0.4,
     }
+
+# Values from a long double build of the kernel that preceded the setup
+# stage.  The shells cover rising, flat and falling exponentials, and the
+# ten shell case reaches the limit of the boundary table.
+tests = [
+    [{"scale": 1.0, "background": 0.0, "n_shells": 3,
+      "sld_core": 1.0, "radius_core": 100.0, "sld_solvent": 6.4,
+      "sld_in": [1.7, 4.0, 3.0], "sld_out": [4.0, 2.0, 6.4],
+      "thickness": [40.0, 30.0, 50.0], "A": [1.0, 0.0, -3.0],
+     }, [1e-5, 0.001, 0.01, 0.1, 0.5],
+     [18469.3, 18352.7, 9583.14, 0.511986, 0.000392095]],
+    [{"scale": 1.0, "background": 0.0, "n_shells": 10,
+      "sld_core": 2.0, "radius_core": 50.0, "sld_solvent": 1.0,
+      "sld_in": [1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 5.0, 4.0, 3.0, 2.0],
+      "sld_out": [2.0, 3.0, 4.0, 5.0, 6.0, 5.0, 4.0, 3.0, 2.0, 1.0],
+      "thickness": [10.0]*10,
+      "A": [2.0, -2.0, 0.1, -0.1, 5.0, -5.0, 0.0, 1e-3, 3.0, -1.0],
+     }, [1e-5, 0.001, 0.01, 0.1, 0.5],
+     [8006.85, 7974.9, 5294.11, 0.441908, 2.32698e-08]],
+]
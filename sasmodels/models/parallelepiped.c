@@ -59,6 +59,32 @@ radius_effective(int mode, double length_a, double length_b, double length_c)
     }
 }
 
+#if defined(GK_TOLERANCE)
+// Outer integrand for the adaptive rule, with the inner integral over
+// the cross section still done with the fixed gauss rule.
+static void
+_orient(double sigma, double mu, double a_scaled, double c_scaled,
+    double *f1, double *f2)
+{
+    const double mu_proj = mu * sqrt(1.0-sigma*sigma);
+    double inner_total_F1 = 0.0;
+    double inner_total_F2 = 0.0;
+    for(int j=0; j<GAUSS_N; j++) {
+        const double uu = 0.5 * ( GAUSS_Z[j] + 1.0 );
+        double sin_uu, cos_uu;
+        SINCOS(M_PI_2*uu, sin_uu, cos_uu);
+        const double si1 = sas_sinx_x(mu_proj * sin_uu * a_scaled);
+        const double si2 = sas_sinx_x(mu_proj * cos_uu);
+        const double fq = si1 * si2;
+        inner_total_F1 += GAUSS_W[j] * fq;
+        inner_total_F2 += GAUSS_W[j] * fq * fq;
+    }
+    const double si = sas_sinx_x(mu * c_scaled * sigma);
+    *f1 = 0.5 * inner_total_F1 * si;
+    *f2 = 0.5 * inner_total_F2 * si * si;
+}
+#endif
+
 static void
 Fq(double q,
     double *F1,
@@ -75,6 +101,11 @@ Fq(double q,
     const double a_scaled = length_a / length_b;
     const double c_scaled = length_c / length_b;
 
+#if defined(GK_TOLERANCE)
+    double outer_total_F1, outer_total_F2;
+    GK_INTEGRATE(0.0, 1.0, outer_total_F1, outer_total_F2, _orient,
+                 mu, a_scaled, c_scaled);
+#else
     // outer integral (with gauss points), integration limits = 0, 1
     double outer_total_F1 = 0.0; //initialize integral
     double outer_total_F2 = 0.0; //initialize integral
@@ -107,6 +138,7 @@ Fq(double q,
     // now complete change of outer integration variable (1-0)/(1-(-1))= 0.5
     outer_total_F1 *= 0.5;
     outer_total_F2 *= 0.5;
+#endif
 
     // Multiply by contrast^2 and convert from [1e-12 A-1] to [cm-1]
     const double V = form_volume(length_a, length_b, length_c);
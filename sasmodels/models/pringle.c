@@ -10,49 +10,44 @@ double Iq(double q,
 
 
 static
-void _integrate_bessel(
+double _sum_bessel_orders(
     double radius,
     double alpha,
     double beta,
     double q_sin_psi,
-    double q_cos_psi,
-    double n,
-    double *Sn,
-    double *Cn)
+    double q_cos_psi)
 {
+    // Integrate S_n and C_n for n = 0 to 3 over r in [0, radius], with
+    //     S_n = int r J_n(beta q r^2 cos psi) J_2n(q r sin psi) sin(alpha q r^2 cos psi) dr
+    // and similarly for C_n with cos.  All orders are accumulated at
+    // once, with one Bessel recurrence for each argument at each point.
+
     // translate gauss point z in [-1,1] to a point in [0, radius]
     const double zm = 0.5*radius;
     const double zb = 0.5*radius;
 
     // evaluate at Gauss points
-    double sumS = 0.0;		// initialize integral
-    double sumC = 0.0;		// initialize integral
-    double r;
+    double Sn[4] = {0.0, 0.0, 0.0, 0.0};  // initialize integrals
+    double Cn[4] = {0.0, 0.0, 0.0, 0.0};  // initialize integrals
     for (int i=0; i < GAUSS_N; i++) {
-        r = GAUSS_Z[i]*zm + zb;
+        const double r = GAUSS_Z[i]*zm + zb;
 
         const double qrs = r*q_sin_psi;
         const double qrrc = r*r*q_cos_psi;
 
-        double y = GAUSS_W[i] * r * sas_JN(n, beta*qrrc) * sas_JN(2*n, qrs);
+        double Jbeta[4], Jqrs[7];
+        sas_JN_all(3, beta*qrrc, Jbeta);
+        sas_JN_all(6, qrs, Jqrs);
         double S, C;
         SINCOS(alpha*qrrc, S, C);
-        sumS += y*S;
-        sumC += y*C;
+        const double wr = GAUSS_W[i] * r;
+        for (int n=0; n < 4; n++) {
+            const double y = wr * Jbeta[n] * Jqrs[2*n];
+            Sn[n] += y*S;
+            Cn[n] += y*C;
+        }
     }
 
-    *Sn = zm*sumS / (radius*radius);
-    *Cn = zm*sumC / (radius*radius);
-}
-
-static
-double _sum_bessel_orders(
-    double radius,
-    double alpha,
-    double beta,
-    double q_sin_psi,
-    double q_cos_psi)
-{
     //calculate sum term from n = -3 to 3
     //Note 1:
     //    S_n(-x) = (-1)^S_n(x)
@@ -61,15 +56,15 @@ double _sum_bessel_orders(
     //Note 2:
     //    better precision to sum terms from smaller to larger
     //    though it doesn't seem to make a difference in this case.
-    double Sn, Cn, sum;
-    sum = 0.0;
+    double sum = 0.0;
     for (int n=3; n>0; n--) {
-      _integrate_bessel(radius, alpha, beta, q_sin_psi, q_cos_psi, n, &Sn, &Cn);
-      sum += 2.0*(Sn*Sn + Cn*Cn);
+      sum += 2.0*(Sn[n]*Sn[n] + Cn[n]*Cn[n]);
     }
-    _integrate_bessel(radius, alpha, beta, q_sin_psi, q_cos_psi, 0, &Sn, &Cn);
-    sum += Sn*Sn+ Cn*Cn;
-    return sum;
+    sum += Sn[0]*Sn[0] + Cn[0]*Cn[0];
+
+    // complete the change of variables and scale by 1/radius^2
+    const double norm = zm / (radius*radius);
+    return norm*norm*sum;
 }
 
 static
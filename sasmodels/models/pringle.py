@@ -125,4 +125,26 @@ tests = [
       'sld_solvent': 6.3,
       'background': 0.001,
      }, 0.001, 317.40847],
+
+    # Large beta*q*r^2, where the Bessel orders come from the forward
+    # recurrence; checked against the C library jn in long double.
+    [{'scale' : 1.0,
+      'radius': 100.0,
+      'thickness': 10.0,
+      'alpha': 0.001,
+      'beta': 0.2,
+      'sld': 1.0,
+      'sld_solvent': 6.3,
+      'background': 0.0,
+     }, [0.01, 0.1, 0.5], [82.8734, 0.772625, 0.0108714]],
+
+    [{'scale' : 1.0,
+      'radius': 150.0,
+      'thickness': 20.0,
+      'alpha': -0.01,
+      'beta': -0.05,
+      'sld': 1.0,
+      'sld_solvent': 6.3,
+      'background': 0.0,
+     }, [0.005, 0.05, 0.2, 0.5], [1372.63, 17.6955, 0.433338, 0.0169472]],
 ]
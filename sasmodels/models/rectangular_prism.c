@@ -36,6 +36,21 @@ radius_effective(int mode, double length_a, double b2a_ratio, double c2a_ratio)
     }
 }
 
+#if defined(ORIENT_RESOLUTION)
+// Oriented amplitude for the orientation average sized to q.
+static void
+_orient(double qa, double qb, double qc,
+    double a_half, double b_half, double c_half,
+    double *f1, double *f2)
+{
+    const double AP = sas_sinx_x(qa * a_half)
+        * sas_sinx_x(qb * b_half)
+        * sas_sinx_x(qc * c_half);
+    *f1 = AP;
+    *f2 = AP * AP;
+}
+#endif
+
 static double
 Iq(double q,
     double sld,
@@ -50,6 +65,13 @@ Iq(double q,
     const double b_half = 0.5 * length_b;
     const double c_half = 0.5 * length_c;
 
+#if defined(ORIENT_RESOLUTION)
+    const double radius = sqrt(a_half*a_half + b_half*b_half + c_half*c_half);
+    double answer, ignored;
+    ORIENT_AVERAGE(q, radius, ignored, answer, _orient,
+                   a_half, b_half, c_half);
+    (void)ignored; // only <F^2> is needed
+#else
    //Integration limits to use in Gaussian quadrature
     const double v1a = 0.0;
     const double v1b = M_PI_2;  //theta integration limits
@@ -88,6 +110,7 @@ Iq(double q,
     // The factor 2 appears because the theta integral has been defined between
     // 0 and pi/2, instead of 0 to pi.
     answer /= M_PI_2; //Form factor P(q)
+#endif
 
     // Multiply by contrast^2 and volume^2
     const double volume = length_a * length_b * length_c;
@@ -115,6 +138,12 @@ Fq(double q,
     const double b_half = 0.5 * length_b;
     const double c_half = 0.5 * length_c;
 
+#if defined(ORIENT_RESOLUTION)
+    const double radius = sqrt(a_half*a_half + b_half*b_half + c_half*c_half);
+    double outer_sum_F1, outer_sum_F2;
+    ORIENT_AVERAGE(q, radius, outer_sum_F1, outer_sum_F2, _orient,
+                   a_half, b_half, c_half);
+#else
    //Integration limits to use in Gaussian quadrature
     const double v1a = 0.0;
     const double v1b = M_PI_2;  //theta integration limits
@@ -160,6 +189,7 @@ Fq(double q,
     // 0 and pi/2, instead of 0 to pi.
     outer_sum_F1 /= M_PI_2;
     outer_sum_F2 /= M_PI_2;
+#endif
 
     // Multiply by contrast and volume
     const double s = (sld-solvent_sld) * (length_a * length_b * length_c);
@@ -140,6 +140,8 @@ parameters = [
 
 source = ["rpa.c"]
 single = False
+# q independent terms computed once per parameter set; see rpa.c
+setup_size = 34
 
 control = "case_num"
 HIDE_ALL = set("Phi4".split())
@@ -158,3 +160,37 @@ def hidden(case_num):
         return HIDE_ALL
 
 # TODO: no random parameters generated for RPA
+
+# Every case with distinct components, so that a component swapped or
+# left out shows up.  The values match the scalar form of the model that
+# preceded the matrix form, and q spans the Guinier limit to the tail.
+_TEST_PARS = {
+    "N": [1000., 1200., 800., 1500.], "Phi": [0.3, 0.25, 0.2, 0.25],
+    "v": [100., 110., 90., 120.], "L": [10., 8., -3., 6.],
+    "b": [5., 5.5, 6., 4.5],
+    "K12": -0.0004, "K13": -0.0003, "K14": -0.0002,
+    "K23": -0.0005, "K24": -0.0001, "K34": -0.0006,
+}
+_TEST_Q = [0.001, 0.01, 0.05, 0.2, 1.0]
+tests = [
+    [dict(_TEST_PARS, case_num=0),
+     _TEST_Q, [0.033761, 0.0334398, 0.0255672, 0.00585814, 0.00122546]],
+    [dict(_TEST_PARS, case_num=1),
+     _TEST_Q, [0.00313655, 0.0294306, 0.0253666, 0.00585186, 0.00122545]],
+    [dict(_TEST_PARS, case_num=2),
+     _TEST_Q, [0.0724383, 0.0706229, 0.0415403, 0.00716788, 0.00127659]],
+    [dict(_TEST_PARS, case_num=3),
+     _TEST_Q, [0.0599591, 0.0699552, 0.0416115, 0.00716527, 0.00127658]],
+    [dict(_TEST_PARS, case_num=4),
+     _TEST_Q, [0.00248254, 0.0498032, 0.0408576, 0.00715488, 0.00127656]],
+    [dict(_TEST_PARS, case_num=5),
+     _TEST_Q, [0.745587, 0.635979, 0.129956, 0.0123367, 0.00147385]],
+    [dict(_TEST_PARS, case_num=6),
+     _TEST_Q, [0.941618, 0.807942, 0.132436, 0.0123446, 0.00147386]],
+    [dict(_TEST_PARS, case_num=7),
+     _TEST_Q, [0.0633813, 0.37389, 0.130345, 0.0123374, 0.00147385]],
+    [dict(_TEST_PARS, case_num=8),
+     _TEST_Q, [1.26083, 1.08608, 0.1344, 0.01235, 0.00147387]],
+    [dict(_TEST_PARS, case_num=9),
+     _TEST_Q, [0.0113386, 0.447846, 0.13235, 0.0123429, 0.00147386]],
+]
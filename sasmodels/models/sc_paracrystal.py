@@ -189,7 +189,8 @@ parameters = [["dnn",         "Ang",       220.0, [0.0, inf],  "",            "N
              ]
 # pylint: enable=bad-whitespace, line-too-long
 
-source = ["lib/sas_3j1x_x.c", "lib/sphere_form.c", "lib/gauss150.c", "sc_paracrystal.c"]
+source = ["lib/sas_3j1x_x.c", "lib/gauss150.c", "lib/sphere_form.c",
+          "lib/fq_table.c", "lib/paracrystal.c", "sc_paracrystal.c"]
 
 def random():
     """Return a random parameter set for the model."""
@@ -213,4 +214,10 @@ tests = [
     [{}, 0.414467, 0.001313289],
     [{'theta': 10.0, 'phi': 20, 'psi': 30.0}, (0.045, -0.035), 18.0397138402],
     [{'theta': 10.0, 'phi': 20, 'psi': 30.0}, (0.023, 0.045), 0.0177333171285],
+    # Sharp (d_factor 0.01) and broad (0.3) peaks from low to high q, with
+    # long double references from the form that keeps precision as q -> 0.
+    [{'d_factor': 0.01, 'background': 0.0},
+     [0.002, 0.01, 0.05, 0.3], [0.0249271, 0.00460345, 0.089574, 0.00255227]],
+    [{'d_factor': 0.3, 'dnn': 160.0, 'radius': 30.0, 'background': 0.0},
+     [0.002, 0.01, 0.05, 0.3], [56.728, 2.6947, 2.21617, 0.00427167]],
     ]
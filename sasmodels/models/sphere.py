@@ -174,6 +174,15 @@ tests = [
       "structure_factor_mode": 0,  # normal decoupling approximation
       "radius_effective_mode": 0   # this used 50 the default for hardsphere
      }, [0.01, 0.1, 0.2], [7.82803598e+02, 6.85943611e-01, 4.71586457e-02]],
+    [{"@S": "hardsphere",
+      "radius": 120., "radius_pd": 0.2, "radius_pd_n": 45,
+      "volfraction": 0.2,
+      # With radius_effective_mode 0, S uses the hardsphere default Reff=50
+      # at every mesh point rather than the sphere radius, so the local
+      # monodisperse result matches the decoupling result above.
+      "structure_factor_mode": 2,  # local monodisperse approximation
+      "radius_effective_mode": 0   # use radius_effective from S
+     }, [0.01, 0.1, 0.2], [7.82803598e+02, 6.85943611e-01, 4.71586457e-02]],
 
 
     # Check returned intermediate results.
@@ -45,74 +45,143 @@ static double blend(int shape, double nu, double z)
     }
 }
 
-static double f_linear(double q, double r, double contrast, double slope)
+// The profile is a series of slabs, a uniform slab for each shell followed
+// by n_steps linear sub-slabs across its interface.  Each slab contributes
+// F(outer) - F(inner) to the transform, so the contributions of the slabs
+// on either side of a boundary are combined into one term per boundary:
+//   r   radius of the boundary
+//   vc  volume times the change in contrast across the boundary
+//   vs  4 pi r^4 times the change in slope across the boundary
+// A boundary where both are negligible, such as within a linear stretch of
+// the profile or between layers with the same sld, adds nothing and is
+// dropped, so the number of terms adapts to the curvature of the profile.
+// The first value in the scratch buffer is the number of boundaries, or
+// -1 if they do not fit, in which case Fq walks the profile for each q.
+// setup_size in spherical_sld.py is 1 + SLD_BOUNDARY*SLD_MAX_BOUNDARIES,
+// which holds 10 shells at n_steps=50 with no boundaries dropped.  On the
+// GPU setup runs for every q, so the table would only take private memory
+// and Fq always walks the profile; gpu_setup_size is 1.
+#define SLD_BOUNDARY 3
+#if defined(USE_GPU)
+#define SLD_MAX_BOUNDARIES 0
+#else
+#define SLD_MAX_BOUNDARIES 511
+#endif
+// boundaries are dropped below this fraction of the largest sld * volume
+#define SLD_TOLERANCE 1e-12
+
+// Transform of a linear slope rho(r) = r up to radius r, relative to
+// 4 pi r^4, with the r independent 8 pi/q^4 term removed.  That term
+// cancels in the sum over boundaries since the slope changes sum to zero.
+//     g(x) = (2 x sin x - (x^2-2) cos x - 2) / x^4
+// The series is used below x=1 to avoid the cancellation in the numerator.
+static double
+_sld_slope(double qr, double sin_qr, double cos_qr)
 {
-    const double qr = q * r;
-    const double qrsq = qr * qr;
-    const double bes = sas_3j1x_x(qr);
-    double sinqr, cosqr;
-    SINCOS(qr, sinqr, cosqr);
-    const double fun = 3.0*r*(2.0*qr*sinqr - (qrsq-2.0)*cosqr)/(qrsq*qrsq);
-    const double vol = M_4PI_3 * cube(r);
-    return vol*(bes*contrast + fun*slope);
+    const double x2 = qr*qr;
+    if (qr < 1.0) {
+        return 1./4. + x2*(-1./36. + x2*(1./960. + x2*(-1./50400.
+            + x2*(1./4354560. + x2*(-1./558835200. + x2*(1./99632332800.
+            + x2*(-1./23538138624000.)))))));
+    } else {
+        return (2.0*qr*sin_qr - (x2-2.0)*cos_qr - 2.0)/(x2*x2);
+    }
 }
 
-static double Iq(
-    double q,
-    double fp_n_shells,
-    double sld_solvent,
-    double sld[],
-    double thickness[],
-    double interface[],
-    double shape[],
-    double nu[],
-    double fp_n_steps)
+static double
+_sld_term(double q, double r, double vc, double vs)
 {
-    // iteration for # of shells + core + solvent
-    int n_shells = (int)(fp_n_shells + 0.5);
-    int n_steps = (int)(fp_n_steps + 0.5);
-    double f=0.0;
-    double r=0.0;
-    for (int shell=0; shell<n_shells; shell++){
-        const double sld_l = sld[shell];
-
-        // uniform shell; r=0 => r^3=0 => f=0, so works for core as well.
-        f -= M_4PI_3 * cube(r) * sld_l * sas_3j1x_x(q*r);
-        r += thickness[shell];
-        f += M_4PI_3 * cube(r) * sld_l * sas_3j1x_x(q*r);
+    const double qr = q * r;
+    double sin_qr, cos_qr;
+    SINCOS(qr, sin_qr, cos_qr);
+    return vc*sas_3j1x_x_sincos(qr, sin_qr, cos_qr)
+        + vs*_sld_slope(qr, sin_qr, cos_qr);
+}
 
-        // iterate over sub_shells in the interface
-        const double dr = interface[shell]/n_steps;
-        const double delta = (shell==n_shells-1 ? sld_solvent : sld[shell+1]) - sld_l;
-        const double nu_shell = fmax(fabs(nu[shell]), 1.e-14);
-        const int shape_shell = (int)(shape[shell]);
+// Walk the slabs from the core out to the solvent.  With scratch, store
+// the boundary terms up to SLD_MAX_BOUNDARIES; with f, accumulate the
+// transform at q.  Returns the number of boundaries kept.
+static int
+_sld_boundaries(double q, double *f, double scratch[],
+    double fp_n_shells, double sld_solvent, double sld[], double thickness[],
+    double interface[], double shape[], double nu[], double fp_n_steps)
+{
+    const int n_shells = (int)(fp_n_shells + 0.5);
+    const int n_steps = (int)(fp_n_steps + 0.5);
 
-        // if there is no interface the equations don't work
-        if (dr == 0.) continue;
+    double sld_max = fabs(sld_solvent);
+    for (int shell=0; shell<n_shells; shell++) {
+        sld_max = fmax(sld_max, fabs(sld[shell]));
+    }
+    const double cutoff = SLD_TOLERANCE * sld_max
+        * form_volume(fp_n_shells, thickness, interface);
 
+    int count = 0;
+    double r = 0.0;
+    double contrast_in = sld[0], slope_in = 0.0;
+    for (int shell=0; shell<=n_shells; shell++) {
+        // the solvent is the last slab, with no interface
+        const int is_solvent = (shell == n_shells);
+        const double sld_l = is_solvent ? sld_solvent : sld[shell];
+        const double dr = is_solvent || n_steps < 1 ? 0.0 : interface[shell]/n_steps;
+        const double delta = (shell>=n_shells-1 ? sld_solvent : sld[shell+1]) - sld_l;
+        const double nu_shell = is_solvent ? 0.0 : fmax(fabs(nu[shell]), 1.e-14);
+        const int shape_shell = is_solvent ? 0 : (int)(shape[shell]);
+
+        // step 0 is the uniform part of the shell, followed by the linear
+        // sub-slabs in the interface; if there is no interface the
+        // equations don't work so it is skipped.
+        const int last_step = (dr == 0.) ? 0 : n_steps;
         double sld_in = sld_l;
-        for (int step=1; step <= n_steps; step++) {
-            // find sld_i at the outer boundary of sub-shell step
-            //const double z = (double)step/(double)n_steps;
-            const double z = (double)step/(double)n_steps;
-            const double fraction = blend(shape_shell, nu_shell, z);
-            const double sld_out = fraction*delta + sld_l;
-            // calculate slope
-            const double slope = (sld_out - sld_in)/dr;
-            const double contrast = sld_in - slope*r;
-
-            // iteration for the left and right boundary of the shells
-            f -= f_linear(q, r, contrast, slope);
-            r += dr;
-            f += f_linear(q, r, contrast, slope);
-            sld_in = sld_out;
+        for (int step=0; step <= last_step; step++) {
+            double contrast_out = sld_l, slope_out = 0.0;
+            if (step > 0) {
+                // find sld_i at the outer boundary of sub-shell step
+                const double z = (double)step/(double)n_steps;
+                const double fraction = blend(shape_shell, nu_shell, z);
+                const double sld_out = fraction*delta + sld_l;
+                slope_out = (sld_out - sld_in)/dr;
+                contrast_out = sld_in - slope_out*r;
+                sld_in = sld_out;
+            }
+
+            const double vc = M_4PI_3 * cube(r) * (contrast_in - contrast_out);
+            const double vs = 4.0*M_PI * square(square(r)) * (slope_in - slope_out);
+            if (fabs(vc) + fabs(vs) > cutoff) {
+                if (scratch != NULL && count < SLD_MAX_BOUNDARIES) {
+                    double *b = scratch + 1 + SLD_BOUNDARY*count;
+                    b[0] = r;
+                    b[1] = vc;
+                    b[2] = vs;
+                }
+                if (f != NULL) {
+                    *f += _sld_term(q, r, vc, vs);
+                }
+                count++;
+            }
+            contrast_in = contrast_out;
+            slope_in = slope_out;
+
+            if (is_solvent) break;
+            r += (step == 0 ? thickness[shell] : dr);
         }
     }
-    // add in solvent effect
-    f -= M_4PI_3 * cube(r) * sld_solvent * sas_3j1x_x(q*r);
+    return count;
+}
 
-    const double f2 = f * f * 1.0e-4;
-    return f2;
+static void
+setup(double fp_n_shells, double sld_solvent, double sld[],
+    double thickness[], double interface[], double shape[], double nu[],
+    double fp_n_steps, double scratch[])
+{
+    if (SLD_MAX_BOUNDARIES == 0) {
+        scratch[0] = -1.0;
+        return;
+    }
+    const int count = _sld_boundaries(0.0, NULL, scratch,
+        fp_n_shells, sld_solvent, sld, thickness, interface, shape, nu,
+        fp_n_steps);
+    scratch[0] = (count <= SLD_MAX_BOUNDARIES ? (double)count : -1.0);
 }
 
 static void Fq(
@@ -126,50 +195,20 @@ static void Fq(
     double interface[],
     double shape[],
     double nu[],
-    double fp_n_steps)
+    double fp_n_steps,
+    const double scratch[])
 {
-    // iteration for # of shells + core + solvent
-    int n_shells = (int)(fp_n_shells + 0.5);
-    int n_steps = (int)(fp_n_steps + 0.5);
-    double f=0.0;
-    double r=0.0;
-    for (int shell=0; shell<n_shells; shell++){
-        const double sld_l = sld[shell];
-
-        // uniform shell; r=0 => r^3=0 => f=0, so works for core as well.
-        f -= M_4PI_3 * cube(r) * sld_l * sas_3j1x_x(q*r);
-        r += thickness[shell];
-        f += M_4PI_3 * cube(r) * sld_l * sas_3j1x_x(q*r);
-
-        // iterate over sub_shells in the interface
-        const double dr = interface[shell]/n_steps;
-        const double delta = (shell==n_shells-1 ? sld_solvent : sld[shell+1]) - sld_l;
-        const double nu_shell = fmax(fabs(nu[shell]), 1.e-14);
-        const int shape_shell = (int)(shape[shell]);
-
-        // if there is no interface the equations don't work
-        if (dr == 0.) continue;
-
-        double sld_in = sld_l;
-        for (int step=1; step <= n_steps; step++) {
-            // find sld_i at the outer boundary of sub-shell step
-            //const double z = (double)step/(double)n_steps;
-            const double z = (double)step/(double)n_steps;
-            const double fraction = blend(shape_shell, nu_shell, z);
-            const double sld_out = fraction*delta + sld_l;
-            // calculate slope
-            const double slope = (sld_out - sld_in)/dr;
-            const double contrast = sld_in - slope*r;
-
-            // iteration for the left and right boundary of the shells
-            f -= f_linear(q, r, contrast, slope);
-            r += dr;
-            f += f_linear(q, r, contrast, slope);
-            sld_in = sld_out;
+    double f = 0.0;
+    const int count = (int)scratch[0];
+    if (count >= 0) {
+        for (int k=0; k < count; k++) {
+            const double *b = scratch + 1 + SLD_BOUNDARY*k;
+            f += _sld_term(q, b[0], b[1], b[2]);
         }
+    } else {
+        _sld_boundaries(q, &f, NULL, fp_n_shells, sld_solvent, sld,
+            thickness, interface, shape, nu, fp_n_steps);
     }
-    // add in solvent effect
-    f -= M_4PI_3 * cube(r) * sld_solvent * sas_3j1x_x(q*r);
 
     *F1 = 1e-2*f;
     *F2 = 1e-4*f*f;
@@ -268,6 +268,10 @@ parameters = [["n_shells",             "",           1,      [1, 10],        "vo
              ]
 # pylint: enable=bad-whitespace, line-too-long
 source = ["lib/polevl.c", "lib/sas_erf.c", "lib/sas_3j1x_x.c", "spherical_sld.c"]
+# boundary count plus 3 values for each of up to 511 boundaries; see spherical_sld.c
+setup_size = 1 + 3*511
+# the GPU only stores the count, and Fq walks the profile for each q
+gpu_setup_size = 1
 single = False  # TODO: fix low q behaviour
 have_Fq = True
 radius_effective_modes = ["outer radius"]
@@ -341,4 +345,26 @@ tests = [
       "shape": [0]*5,
       "nu": [2.5]*5,
      }, 0.001, 750697.238],
+    # Ten shells with every interface shape.  At 51 steps the profile has
+    # more boundaries than the setup table holds, so Fq walks the profile,
+    # and at 35 steps it uses the table.  Low q checks the slope series.
+    [{"scale": 1.0, "background": 0.0, "n_shells": 10, "n_steps": 51,
+      "sld_solvent": 6.4,
+      "sld": [1.0, 2.0, 3.0, 4.0, 5.0, 0.5, 1.5, 2.5, 3.5, 4.5],
+      "thickness": [20.0]*10, "interface": [10.0]*10,
+      "shape": [0, 1, 2, 3, 4, 5, 0, 1, 2, 3],
+      "nu": [2.5, 1.5, 3.0, 2.0, 4.0, 6.0, 1.2, 2.5, 3.5, 2.0],
+     }, [1e-4, 0.01, 0.05, 0.2], [102373., 16833.3, 3.63154, 0.0609752]],
+    [{"scale": 1.0, "background": 0.0, "n_shells": 10, "n_steps": 35,
+      "sld_solvent": 6.4,
+      "sld": [1.0, 2.0, 3.0, 4.0, 5.0, 0.5, 1.5, 2.5, 3.5, 4.5],
+      "thickness": [20.0]*10, "interface": [10.0]*10,
+      "shape": [0, 1, 2, 3, 4, 5, 0, 1, 2, 3],
+      "nu": [2.5, 1.5, 3.0, 2.0, 4.0, 6.0, 1.2, 2.5, 3.5, 2.0],
+     }, [1e-4, 0.01, 0.05, 0.2], [102375., 16833.7, 3.63271, 0.0609636]],
+    # A single shell with no interface is a sphere, from low to high qr.
+    [{"scale": 1.0, "background": 0.0, "n_shells": 1, "n_steps": 35,
+      "sld_solvent": 1.0, "sld": [4.0], "thickness": [60.0],
+      "interface": [0.0], "shape": [0], "nu": [2.5],
+     }, [1e-5, 0.001, 0.1, 1.0], [814.301, 813.715, 5.73135, 0.00050749]],
 ]
@@ -76,6 +76,7 @@ description = """\
 """
 category = "structure-factor"
 structure_factor = True
+scale_invariant = True
 single = False
 
 #single = False
@@ -41,16 +41,12 @@ stacked_disks_kernel(
 
     double pq = square(t1 + t2);
 
-    // loop for the structure factor S(q)
+    // structure factor S(q) from the pairs of disks in the stack
     double qd_cos_alpha = d*qc;
     //d*cos_alpha is the projection of d onto q (in other words the component
     //of d that is parallel to q.
     double debye_arg = -0.5*square(qd_cos_alpha*sigma_dnn);
-    double sq=0.0;
-    for (int kk=1; kk<n_stacking; kk++) {
-        sq += (n_stacking-kk) * cos(qd_cos_alpha*kk) * exp(debye_arg*kk);
-    }
-    // end of loop for S(q)
+    double sq = lattice_cos_sum(n_stacking, qd_cos_alpha, exp(debye_arg));
     sq = 1.0 + 2.0*sq/n_stacking;
 
     return pq * sq * n_stacking;
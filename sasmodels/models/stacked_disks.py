@@ -146,7 +146,8 @@ parameters = [
     ]
 # pylint: enable=bad-whitespace, line-too-long
 
-source = ["lib/polevl.c", "lib/sas_J1.c", "lib/gauss76.c", "stacked_disks.c"]
+source = ["lib/polevl.c", "lib/sas_J1.c", "lib/gauss76.c",
+          "lib/lattice_reinsch.c", "lib/lattice_cos_sum.c", "stacked_disks.c"]
 
 def random():
     """Return a random parameter set for the model."""
@@ -268,6 +269,21 @@ tests = [
       'scale': 0.01,
       'background': 0.001,
      }, ([0.4, 0.5]), [0.00105074, 0.00121761]],
+
+    # Tall stacks with and without spacing disorder, from low q where
+    # q*d is near zero up to several Bragg orders.
+    [{'n_stacking': 1000.0,
+      'sigma_d': 0.0,
+      'scale': 1.0,
+      'background': 0.0,
+     }, [1e-4, 0.001, 0.01, 0.1, 0.5],
+     [22529., 2924.13, 297.597, 15.5853, 0.0021248]],
+    [{'n_stacking': 1000.0,
+      'sigma_d': 2.0,
+      'scale': 1.0,
+      'background': 0.0,
+     }, [1e-4, 0.001, 0.01, 0.1, 0.5],
+     [22507.8, 3023.65, 396.768, 35.9356, 0.031294]],
     #[{'thick_core': 10.0,
     #  'thick_layer': 15.0,
     #  'radius': 3000.0,
@@ -104,6 +104,7 @@ description = """\
 """
 category = "structure-factor"
 structure_factor = True
+scale_invariant = True
 
 single = False
 #             ["name", "units", default, [lower, upper], "type","description"],
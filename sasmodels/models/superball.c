@@ -83,6 +83,65 @@ static double oriented_superball(
   return 0.5 * outer_integral;
 }
 
+#if defined(ORIENT_RESOLUTION)
+// Oriented amplitude for the orientation average sized to q.
+static void
+_orient(double qa, double qb, double qc, double length_a, double exponent_p,
+   double *f1, double *f2)
+{
+  const double f_oriented = oriented_superball(qa, qb, qc, length_a, exponent_p);
+  *f1 = f_oriented;
+  *f2 = square(f_oriented);
+}
+#else
+static void
+_orient_row(double x, double q, double length_a, double exponent_p,
+   double *row)
+{
+  row[0] = q * sqrt(1.0 - square(x));
+  row[1] = q * x;
+}
+
+static void
+_orient_point(const double *row, double cos_phi, double sin_phi,
+   double q, double length_a, double exponent_p, double *f1, double *f2)
+{
+  const double f_oriented = oriented_superball(
+      row[0] * cos_phi, row[0] * sin_phi, row[1], length_a, exponent_p);
+  *f1 = f_oriented;
+  *f2 = square(f_oriented);
+}
+#endif
+
+// Orientation averaged <F> and <F^2> for unit contrast.
+static void
+_orient_average(double q, double length_a, double exponent_p,
+   double *F1, double *F2)
+{
+#if defined(ORIENT_RESOLUTION)
+  // the superball fits in a cube of side length_a
+  const double radius = 0.5 * sqrt(3.0) * length_a;
+  ORIENT_AVERAGE(q, radius, *F1, *F2, _orient, length_a, exponent_p);
+#else
+  // average over the octant, with x = cos(theta) and phi in [0, pi/2];
+  // the superball is unchanged when a and b are exchanged, but the gauss
+  // rule in oriented_superball is not, so don't fold in phi
+  GAUSS_2D(*F1, *F2, 0, _orient_row, _orient_point, q, length_a, exponent_p);
+#endif
+}
+
+#if defined(HAVE_FQ_TABLE)
+// The oriented form factor scales as length_a^3 with q*length_a fixed, so
+// tabulate the form factor for length_a = 1 in x = q*length_a.
+FQ_TABLE(superball_table)
+
+static void
+_unit_orient_average(double x, double exponent_p, double *F1, double *F2)
+{
+  _orient_average(x, 1.0, exponent_p, F1, F2);
+}
+#endif
+
 static void
 Fq(double q,
    double *F1,
@@ -92,56 +151,22 @@ Fq(double q,
    double length_a,
    double exponent_p)
 {
+  double total_F1, total_F2;
+#if defined(HAVE_FQ_TABLE)
+  fq_table_eval(&superball_table, _unit_orient_average, q*length_a, exponent_p,
+                &total_F1, &total_F2);
+  const double volume_scale = cube(length_a);
+  total_F1 *= volume_scale;
+  total_F2 *= square(volume_scale);
+#else
+  _orient_average(q, length_a, exponent_p, &total_F1, &total_F2);
+#endif
 
-  // translate a point in [-1,1] to a point in [0, pi/2]
-  const double zm = M_PI_4;
-  const double zb = M_PI_4;
-
-  double orient_averaged_outer_total_F1 = 0.0; //initialize integral
-  double orient_averaged_outer_total_F2 = 0.0; //initialize integral
-  // phi integral
-  for (int i_phi = 0; i_phi < GAUSS_N; i_phi++)
-  {
-
-    const double phi = GAUSS_Z[i_phi]*zm +zb; // integrate 0 .. pi/2
-
-    double sin_phi, cos_phi;
-    SINCOS(phi, sin_phi, cos_phi);
-
-    double orient_averaged_inner_total_F1 = 0.0; //initialize integral
-    double orient_averaged_inner_total_F2 = 0.0; //initialize integral
-    // theta integral
-    for (int i_theta = 0; i_theta < GAUSS_N; i_theta++)
-    {
-
-      const double cos_theta = GAUSS_Z[i_theta]*0.5 + 0.5; // integrate 0, 1
-      const double sin_theta = sqrt( 1.0 - square(cos_theta) );
-
-
-      const double qx = q * cos_phi * sin_theta;
-      const double qy = q * sin_phi * sin_theta;
-      const double qz = q * cos_theta;
-
-      const double f_oriented = oriented_superball(qx, qy, qz, length_a, exponent_p);
-
-
-      orient_averaged_inner_total_F1 += GAUSS_W[i_theta] * f_oriented;
-      orient_averaged_inner_total_F2 += GAUSS_W[i_theta] * square(f_oriented);
-
-    }
-    orient_averaged_outer_total_F1 += GAUSS_W[i_phi] * orient_averaged_inner_total_F1;
-    orient_averaged_outer_total_F2 += GAUSS_W[i_phi] * orient_averaged_inner_total_F2;
-  }
-
-
-  // integration factors for phi and theta integral, divided by solid angle of pi/2
-  orient_averaged_outer_total_F1 *= 0.25;
-  orient_averaged_outer_total_F2 *= 0.25;
   // Multiply by contrast^2 and convert from [1e-12 A-1] to [cm-1]
   const double s =  (sld - solvent_sld) ;
 
-  *F1 = 1.0e-2 * s * orient_averaged_outer_total_F1;
-  *F2 = 1.0e-4 * s * s * orient_averaged_outer_total_F2;
+  *F1 = 1.0e-2 * s * total_F1;
+  *F2 = 1.0e-4 * s * s * total_F2;
 }
 
 static double
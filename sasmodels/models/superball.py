@@ -151,7 +151,9 @@ parameters = [["sld", "1e-6/Ang^2", 4, [-inf, inf], "sld",
               ]
 # lib/gauss76.c
 # lib/gauss20.c
-source = ["lib/gauss20.c", "lib/sas_gamma.c", "superball.c"]
+source = ["lib/gauss20.c", "lib/gauss_2d.c", "lib/sas_gamma.c",
+          "lib/fq_table.c", "lib/orient_table.c", "lib/orient_average.c",
+          "superball.c"]
 have_Fq = True
 radius_effective_modes = [
     "radius of gyration",
@@ -189,4 +191,8 @@ tests = [
     [{"length_a": 100., "exponent_p": 2.5, "sld": 6., "sld_solvent": 1.,
       "length_a_pd": 0.1, "length_a_pd_n": 10},
      0.2, 0.49551865],
+    # From the Guinier region to high q.
+    [{"length_a": 100., "exponent_p": 2.5, "background": 0.},
+     [1e-4, 0.001, 0.01, 0.05, 0.2, 0.5],
+     [779.871, 779.311, 725.106, 94.2673, 0.100795, 0.0041209]],
 ]
\ No newline at end of file
@@ -88,6 +88,25 @@ radius_effective(int mode, double radius_equat_minor, double radius_equat_major,
     }
 }
 
+static void
+_fq_row(double x, double q, double radius_equat_major, double pa, double pc,
+    double *row)
+{
+    const double usq = x*x;
+    row[0] = pa*(1.0 - usq);
+    row[1] = 1.0 + pc*usq;
+}
+
+static void
+_fq_point(const double *row, double cos_phi, double sin_phi,
+    double q, double radius_equat_major, double pa, double pc,
+    double *f1, double *f2)
+{
+    const double r = radius_equat_major*sqrt(row[0]*square(sin_phi) + row[1]);
+    *f1 = sas_3j1x_x(q*r);
+    *f2 = square(*f1);
+}
+
 static void
 Fq(double q,
     double *F1,
@@ -100,34 +119,10 @@ Fq(double q,
 {
     const double pa = square(radius_equat_minor/radius_equat_major) - 1.0;
     const double pc = square(radius_polar/radius_equat_major) - 1.0;
-    // translate a point in [-1,1] to a point in [0, pi/2]
-    const double zm = M_PI_4;
-    const double zb = M_PI_4;
-    double outer_sum_F1 = 0.0;
-    double outer_sum_F2 = 0.0;
-    for (int i=0;i<GAUSS_N;i++) {
-        //const double u = GAUSS_Z[i]*(upper-lower)/2 + (upper + lower)/2;
-        const double phi = GAUSS_Z[i]*zm + zb;
-        const double pa_sinsq_phi = pa*square(sin(phi));
-
-        double inner_sum_F1 = 0.0;
-        double inner_sum_F2 = 0.0;
-        const double um = 0.5;
-        const double ub = 0.5;
-        for (int j=0;j<GAUSS_N;j++) {
-            // translate a point in [-1,1] to a point in [0, 1]
-            const double usq = square(GAUSS_Z[j]*um + ub);
-            const double r = radius_equat_major*sqrt(pa_sinsq_phi*(1.0-usq) + 1.0 + pc*usq);
-            const double fq = sas_3j1x_x(q*r);
-            inner_sum_F1 += GAUSS_W[j] * fq;
-            inner_sum_F2 += GAUSS_W[j] * fq * fq;
-        }
-        outer_sum_F1 += GAUSS_W[i] * inner_sum_F1;  // correcting for dx later
-        outer_sum_F2 += GAUSS_W[i] * inner_sum_F2;  // correcting for dx later
-    }
-    // translate integration ranges from [-1,1] to [lower,upper] and normalize by 4 pi
-    outer_sum_F1 *= 0.25;  // = outer*um*zm*8.0/(4.0*M_PI);
-    outer_sum_F2 *= 0.25;  // = outer*um*zm*8.0/(4.0*M_PI);
+    // average over the octant, with x = cos(theta) and phi in [0, pi/2]
+    double outer_sum_F1, outer_sum_F2;
+    GAUSS_2D(outer_sum_F1, outer_sum_F2, 0, _fq_row, _fq_point,
+        q, radius_equat_major, pa, pc);
 
     const double volume = form_volume(radius_equat_minor, radius_equat_major, radius_polar);
     const double contrast = (sld - sld_solvent);
@@ -158,7 +158,8 @@ parameters = [["sld", "1e-6/Ang^2", 4, [-inf, inf], "sld",
                "rotation about polar axis"],
              ]
 
-source = ["lib/sas_3j1x_x.c", "lib/gauss76.c", "triaxial_ellipsoid.c"]
+source = ["lib/sas_3j1x_x.c", "lib/gauss76.c", "lib/gauss_2d.c",
+          "triaxial_ellipsoid.c"]
 # Equations do not require Ra <= Rb <= Rc so don't test for it.
 #valid = ("radius_equat_minor <= radius_equat_major"
 #         " && radius_equat_major <= radius_polar")
@@ -187,5 +188,10 @@ qy = q*sin(pi/6.0)
 tests = [
     [{}, 0.05, 24.8839548033],
     [{'theta':80., 'phi':10.}, (qx, qy), 166.712060266],
+    # Three very different radii, from the Guinier region to high q.
+    [{'radius_equat_minor': 20.0, 'radius_equat_major': 200.0,
+      'radius_polar': 60.0, 'background': 0.0},
+     [1e-4, 0.001, 0.01, 0.05, 0.2, 0.5],
+     [904.752, 902.13, 685.988, 66.3838, 0.239901, 0.00696656]],
     ]
 del qx, qy  # not necessary to delete, but cleaner
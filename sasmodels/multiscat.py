@@ -126,7 +126,7 @@ except ImportError:
 
 # pylint: disable=unused-import,ungrouped-imports
 try:
-    from typing import Dict
+    from typing import Dict, Tuple, Any
     from sasmodels.modelinfo import ModelInfo
 except ImportError:
     pass
@@ -162,6 +162,31 @@ class ICalculator(object):
         """
         raise NotImplementedError()
 
+    def set_profile(self, radius, q, edges, norm):
+        r"""
+        Prepare for 1-D multiple scattering.
+
+        The 1-D theory at *q* is interpolated into the pixels at distance
+        *radius* from the origin, and the multiple scattering pattern is
+        averaged over the annuli with bin edges *edges*.  *norm* is the
+        number of pixels in each annulus.
+        """
+        raise NotImplementedError()
+
+    def multiple_scattering_profile(self, theory, p, coverage=0.99):
+        r"""
+        Compute the multiple scattering radial profile for the 1-D *theory*
+        given scattering probability p.  See :meth:`set_profile`.
+        """
+        raise NotImplementedError()
+
+    def result(self):
+        """
+        Return the 2-D multiple scattering pattern from the most recent call
+        to :meth:`multiple_scattering` or :meth:`multiple_scattering_profile`.
+        """
+        raise NotImplementedError()
+
 class NumpyCalculator(ICalculator):
     """
     Multiple scattering calculator using numpy fft.
@@ -169,6 +194,18 @@ class NumpyCalculator(ICalculator):
     def __init__(self, dims=None, dtype=PRECISION):
         self.dtype = dtype
         self.complex_dtype = np.dtype('F') if dtype == np.dtype('f') else np.dtype('D')
+        self._profile = None
+        self._result = None
+        # Workspace reused from call to call.  The padded frame is only ever
+        # written in its corners, so the zero padding survives between calls.
+        # The frame is real, so its transform is held in the Hermitian half
+        # produced by rfft2, with dims[1]//2 + 1 columns.
+        if dims is not None:
+            self._frame = np.zeros(dims, dtype=self.dtype)
+            self._total = np.empty((dims[0], dims[1]//2 + 1),
+                                   dtype=self.complex_dtype)
+        else:
+            self._frame = self._total = None
 
     def fft(self, Iq):
         #t0 = time.time()
@@ -189,22 +226,64 @@ class NumpyCalculator(ICalculator):
         coeffs = scattering_coeffs(p, coverage)
         poly = np.asarray(coeffs[::-1], dtype=self.dtype)
         scale = np.sum(Iq)
-        frame = _forward_shift(Iq/scale, dtype=self.dtype)
-        fourier_frame = np.fft.fft2(frame)
-        convolved = fourier_frame * np.polyval(poly, fourier_frame)
-        frame = np.fft.ifft2(convolved)
-        result = scale * _inverse_shift(frame.real, dtype=self.dtype)
+        nq = Iq.shape[0]
+        if self._frame is None or self._frame.shape[0] != 2*nq:
+            self._frame = np.zeros((2*nq, 2*nq), dtype=self.dtype)
+            self._total = np.empty((2*nq, nq + 1), dtype=self.complex_dtype)
+        frame = _forward_shift(Iq, dtype=self.dtype, out=self._frame)
+        # Normalize in Fourier space rather than copying Iq/scale.
+        fourier_frame = np.fft.rfft2(frame)
+        fourier_frame *= 1/scale
+        convolved = _polyval1(poly, fourier_frame, out=self._total)
+        frame = np.fft.irfft2(convolved, s=frame.shape)
+        result = _inverse_shift(frame, dtype=self.dtype)
+        result *= scale
         #print("numpy multiscat time", time.time()-t0)
+        self._result = result
         return result
 
+    def set_profile(self, radius, q, edges, norm):
+        index, frac = _interp_table(radius.flatten(), q)
+        bins = _bin_index(radius.flatten(), edges)
+        self._profile = index, frac, bins, norm, radius.shape
+
+    def multiple_scattering_profile(self, theory, p, coverage=0.99):
+        index, frac, bins, norm, shape = self._profile
+        theory = np.asarray(theory)
+        lo, hi = theory[index], theory[index+1]
+        Iq = (lo + frac*(hi - lo)).reshape(shape)
+        Iqxy = self.multiple_scattering(Iq, p, coverage)
+        # circular average, no anti-aliasing
+        return _bin_sum(bins, len(norm), Iqxy.flatten())/norm
+
+    def result(self):
+        return self._result
+
+# OpenCL kernels for the multiple scattering calculator.  The pattern stays
+# on the device from the interpolated theory to the annular average, so only
+# the theory values and the final profile cross the bus.
+#
 # polyval1(c, x) computes (...((c0 x + c1) x + c2) x ... + cn) x
 # where c is an array of length *degree* and x is an array of
 # complex values (type double2) of length *n*. 2-D arrays can of
 # course be treated as 1-D arrays of length *nx* X *ny*.
+#
+# forward_shift and inverse_shift are _forward_shift and _inverse_shift
+# for an *nq* x *nq* image in a 2*nq* x 2*nq* complex frame, normalizing
+# by or restoring the total intensity held in scale[0], which is left on
+# the device by the sum.
+#
+# interp(n, index, frac, y, yo) computes yo = y[index] + frac*(y[index+1] -
+# y[index]), which gives numpy.interp when *index* and *frac* are filled in
+# as by _interp_table.
+#
+# radial_sum is the annular average, with the pixels of bin k listed in
+# order[offset[k]:offset[k+1]] as by _bin_table.
+#
 # When compiling with sasmodels.kernelcl.compile_model the double precision
 # types are converted to single precision as needed.  See the code in
 # sasmodels.generate._convert_type for details.
-POLYVAL1_KERNEL = """
+MULTISCAT_KERNELS = """
 kernel void polyval1(
     const int degree,
     global const double *coeff,
@@ -221,38 +300,118 @@ kernel void polyval1(
         array[index] = total * x;
     }
 }
+
+kernel void forward_shift(
+    const int nq,
+    global const double *Iq,
+    global const double *scale,
+    global double2 *frame)
+{
+    const int n = 2*nq;
+    const int index = get_global_id(0);
+    if (index < n*n) {
+        const int i = (index/n + nq/2) % n;
+        const int j = (index%n + nq/2) % n;
+        const double value = (i < nq && j < nq) ? Iq[i*nq + j]/scale[0] : 0.0;
+        frame[index] = (double2)(value, 0.0);
+    }
+}
+
+kernel void inverse_shift(
+    const int nq,
+    global const double2 *frame,
+    global const double *scale,
+    global double *Iq)
+{
+    const int n = 2*nq;
+    const int index = get_global_id(0);
+    if (index < nq*nq) {
+        const int i = (index/nq - nq/2 + n) % n;
+        const int j = (index%nq - nq/2 + n) % n;
+        Iq[index] = scale[0] * frame[i*n + j].x;
+    }
+}
+
+kernel void interp(
+    const int n,
+    global const int *index,
+    global const double *frac,
+    global const double *y,
+    global double *yo)
+{
+    const int k = get_global_id(0);
+    if (k < n) {
+        const int j = index[k];
+        yo[k] = y[j] + frac[k]*(y[j+1] - y[j]);
+    }
+}
+
+kernel void radial_sum(
+    const int nbins,
+    global const int *offset,
+    global const int *order,
+    global const double *norm,
+    global const double *Iq,
+    global double *profile)
+{
+    const int k = get_global_id(0);
+    if (k < nbins) {
+        double total = 0.0;
+        for (int p=offset[k]; p < offset[k+1]; p++) {
+            total += Iq[order[p]];
+        }
+        profile[k] = total/norm[k];
+    }
+}
 """
 
 class OpenclCalculator(ICalculator):
     """
     Multiple scattering calculator using OpenCL via pyfft.
+
+    The image passed to :meth:`multiple_scattering` and the theory passed
+    to :meth:`multiple_scattering_profile` may be *pyopencl.array.Array*
+    objects on the calculator queue, in which case they are used in place.
     """
-    polyval1f = None
-    polyval1d = None
+    programf = None
+    programd = None
+    # FFT plan and frame buffer for each (dims, dtype), shared by all
+    # calculators since the frame is only used within a call and all calls
+    # go through the same in-order queue.
+    workspace = {}  # type: Dict[Tuple[Tuple[int, int], str], Tuple[Any, Any]]
     def __init__(self, dims, dtype=PRECISION):
         dtype = np.dtype(dtype)
         env = sasmodels.kernelcl.environment()
         context = env.context[dtype]
         if dtype == np.dtype('f'):
-            if OpenclCalculator.polyval1f is None:
-                program = sasmodels.kernelcl.compile_model(
-                    context, POLYVAL1_KERNEL, dtype, fast=USE_FAST)
+            if OpenclCalculator.programf is None:
                 # Assume context is always the same for a given dtype
-                OpenclCalculator.polyval1f = program.polyval1
+                OpenclCalculator.programf = sasmodels.kernelcl.compile_model(
+                    context, MULTISCAT_KERNELS, dtype, fast=USE_FAST)
             self.dtype = dtype
             self.complex_dtype = np.dtype('F')
-            self.polyval1 = OpenclCalculator.polyval1f
+            self.program = OpenclCalculator.programf
         else:
-            if OpenclCalculator.polyval1d is None:
-                program = sasmodels.kernelcl.compile_model(
-                    context, POLYVAL1_KERNEL, dtype, fast=False)
+            if OpenclCalculator.programd is None:
                 # Assume context is always the same for a given dtype
-                OpenclCalculator.polyval1d = program.polyval1
+                OpenclCalculator.programd = sasmodels.kernelcl.compile_model(
+                    context, MULTISCAT_KERNELS, dtype, fast=False)
             self.dtype = dtype
-            self.complex_type = np.dtype('D')
-            self.polyval1 = OpenclCalculator.polyval1d
+            self.complex_dtype = np.dtype('D')
+            self.program = OpenclCalculator.programd
+        self.polyval1 = self.program.polyval1
         self.queue = env.queue[dtype]
-        self.plan = pyfft.cl.Plan(dims, queue=self.queue)
+        key = tuple(dims), dtype.char
+        if key not in OpenclCalculator.workspace:
+            plan = pyfft.cl.Plan(dims, dtype=self.complex_dtype,
+                                 queue=self.queue)
+            frame = cl_array.empty(self.queue, dims, self.complex_dtype)
+            OpenclCalculator.workspace[key] = plan, frame
+        self.plan, self._frame = OpenclCalculator.workspace[key]
+        # Device buffers reused from call to call.
+        self.nq = dims[0]//2
+        self._result = cl_array.empty(self.queue, (self.nq, self.nq), dtype)
+        self._profile = None
 
     def fft(self, Iq):
         # forward transform
@@ -276,23 +435,113 @@ class OpenclCalculator(ICalculator):
 
     def multiple_scattering(self, Iq, p, coverage=0.99):
         #t0 = time.time()
+        self._convolve(self._to_device(Iq), p, coverage)
+        result = self._result.get()
+        #print("OpenCL multiscat time", time.time()-t0)
+        return result
+
+    def set_profile(self, radius, q, edges, norm):
+        queue, dtype = self.queue, self.dtype
+        index, frac = _interp_table(radius.flatten(), q)
+        offset, order = _bin_table(radius.flatten(), edges)
+        self._profile = (
+            cl_array.to_device(queue, index),
+            cl_array.to_device(queue, np.asarray(frac, dtype)),
+            cl_array.to_device(queue, offset),
+            cl_array.to_device(queue, order),
+            cl_array.to_device(queue, np.asarray(norm, dtype)),
+            cl_array.empty(queue, (self.nq, self.nq), dtype),
+            cl_array.empty(queue, len(norm), dtype),
+            )
+
+    def multiple_scattering_profile(self, theory, p, coverage=0.99):
+        #t0 = time.time()
+        index, frac, offset, order, norm, Iq, profile = self._profile
+        gpu_theory = self._to_device(theory)
+        self.program.interp(
+            self.queue, [Iq.size], None,
+            np.int32(Iq.size), index.data, frac.data, gpu_theory.data, Iq.data)
+        self._convolve(Iq, p, coverage)
+        self.program.radial_sum(
+            self.queue, [profile.size], None,
+            np.int32(profile.size), offset.data, order.data, norm.data,
+            self._result.data, profile.data)
+        result = profile.get()
+        #print("OpenCL multiscat profile time", time.time()-t0)
+        return result
+
+    def result(self):
+        return self._result.get()
+
+    def _to_device(self, data):
+        if isinstance(data, cl_array.Array):
+            return data if data.dtype == self.dtype else data.astype(self.dtype)
+        data = np.ascontiguousarray(data, self.dtype)
+        return cl_array.to_device(self.queue, data)
+
+    def _convolve(self, gpu_Iq, p, coverage):
+        # Multiple scattering of the nq x nq image in gpu_Iq into self._result
+        # without leaving the device.
         coeffs = scattering_coeffs(p, coverage)
-        scale = np.sum(Iq)
         poly = np.asarray(coeffs[::-1], self.dtype)
-        frame = _forward_shift(Iq/scale, dtype=self.complex_dtype)
-        gpu_data = cl_array.to_device(self.queue, frame)
         gpu_poly = cl_array.to_device(self.queue, poly)
-        self.plan.execute(gpu_data.data)
-        degree, data_size = poly.shape[0], frame.shape[0]*frame.shape[1]
+        gpu_scale = cl_array.sum(gpu_Iq, queue=self.queue)
+        nq, frame = np.int32(self.nq), self._frame
+        self.program.forward_shift(
+            self.queue, [frame.size], None,
+            nq, gpu_Iq.data, gpu_scale.data, frame.data)
+        self.plan.execute(frame.data)
         self.polyval1(
-            self.queue, [data_size], None,
-            np.int32(degree), gpu_poly.data, np.int32(data_size), gpu_data.data)
-        self.plan.execute(gpu_data.data, inverse=True)
-        frame = gpu_data.get()
-        #result = scale * _inverse_shift(frame.real, dtype=self.dtype)
-        result = scale * _inverse_shift(frame.real, dtype=self.dtype)
-        #print("OpenCL multiscat time", time.time()-t0)
-        return result
+            self.queue, [frame.size], None,
+            np.int32(poly.shape[0]), gpu_poly.data, np.int32(frame.size),
+            frame.data)
+        self.plan.execute(frame.data, inverse=True)
+        self.program.inverse_shift(
+            self.queue, [self._result.size], None,
+            nq, frame.data, gpu_scale.data, self._result.data)
+
+def _interp_table(x, xp):
+    """
+    Return *index* and *frac* such that numpy.interp(x, xp, fp) is
+    fp[index] + frac*(fp[index+1] - fp[index]).
+    """
+    index = np.searchsorted(xp, x, side='right') - 1
+    index = np.clip(index, 0, len(xp)-2)
+    frac = np.clip((x - xp[index])/(xp[index+1] - xp[index]), 0., 1.)
+    return np.asarray(index, np.int32), frac
+
+def _bin_index(x, edges):
+    """
+    Return the bin of numpy.histogram(x, bins=edges) holding each value of
+    *x*, or len(edges)-1 for values outside the bins.
+    """
+    nbins = len(edges) - 1
+    index = np.searchsorted(edges, x, side='right') - 1
+    # histogram includes the right edge in the last bin
+    index[x == edges[-1]] = nbins - 1
+    # values past the last edge already map to nbins
+    index[index < 0] = nbins
+    return index
+
+def _bin_sum(index, nbins, weights=None):
+    """
+    Return numpy.histogram(x, bins=edges, weights=weights)[0] given
+    index = _bin_index(x, edges).
+    """
+    return np.bincount(index, weights=weights, minlength=nbins+1)[:nbins]
+
+def _bin_table(x, edges):
+    """
+    Return *offset* and *order* such that x[order[offset[k]:offset[k+1]]]
+    are the values in bin k of numpy.histogram(x, bins=edges).
+    """
+    nbins = len(edges) - 1
+    index = _bin_index(x, edges)
+    keep = np.nonzero(index < nbins)[0]
+    order = keep[np.argsort(index[keep], kind='stable')]
+    counts = _bin_sum(index, nbins)
+    offset = np.hstack(([0], np.cumsum(counts)))
+    return np.asarray(offset, np.int32), np.asarray(order, np.int32)
 
 Calculator = OpenclCalculator if HAVE_OPENCL else NumpyCalculator
 
@@ -341,11 +590,24 @@ def truncated_poisson_invcdf(coverage, L):
         cdf += pmf
     return k
 
-def _forward_shift(Iq, dtype=PRECISION):
-    # Prepare padded array and forward transform
+def _polyval1(poly, x, out):
+    """
+    Return x*polyval(poly, x) computed in place in *out* by Horner's rule.
+    """
+    out[...] = poly[0]
+    for c in poly[1:]:
+        out *= x
+        out += c
+    out *= x
+    return out
+
+def _forward_shift(Iq, dtype=PRECISION, out=None):
+    # Prepare padded array and forward transform.  If *out* is given it is
+    # filled in place and must be zero outside the corners, as it will be
+    # if it is only ever used by _forward_shift for images of the same size.
     nq = Iq.shape[0]
     half_nq = nq//2
-    frame = np.zeros((2*nq, 2*nq), dtype=dtype)
+    frame = np.zeros((2*nq, 2*nq), dtype=dtype) if out is None else out
     frame[:half_nq, :half_nq] = Iq[half_nq:, half_nq:]
     frame[-half_nq:, :half_nq] = Iq[:half_nq, half_nq:]
     frame[:half_nq, -half_nq:] = Iq[half_nq:, :half_nq]
@@ -474,7 +736,10 @@ class MultipleScattering(Resolution):
             # function (if any) or for the raw q values desired
             self._q = np.linspace(qmin, qmax, int(nq//(2*window)))
             self._edges = bin_edges(self._q)
-            self._norm, _ = np.histogram(self._radius, bins=self._edges)
+            # The pixel to bin map is fixed by the grid, so the radial
+            # profile is a single bincount over the pixels.
+            self._bins = _bin_index(self._radius.flatten(), self._edges)
+            self._norm = _bin_sum(self._bins, len(self._q))
             if resolution is not None:
                 self.q = resolution.q
             else:
@@ -483,40 +748,47 @@ class MultipleScattering(Resolution):
 
         # Prepare the multiple scattering calculator (either numpy or OpenCL)
         self.transform = Calculator((2*nq, 2*nq), dtype=dtype)
+        if not is2d:
+            self.transform.set_profile(
+                self._radius, q_to_corner, self._edges, self._norm)
 
-        # Iq and Iqxy will be set during apply
+        # Iq will be set during apply
         self.Iq = None # type: np.ndarray
-        self.Iqxy = None # type: np.ndarray
 
         # Label probability as a fittable parameter, and give its external name
         # Note that the external name must be a valid python identifier, since
         # is will be set as an experiment attribute.
         self.fittable = {'probability': 'scattering_probability'}
 
-    def apply(self, theory):
-        if self.is2d:
-            Iq_calc = theory
-        else:
-            Iq_calc = np.interp(self._radius, self.q_calc[0], theory)
-        Iq_calc = Iq_calc.reshape(self.nq, self.nq)
+    @property
+    def Iqxy(self):
+        """
+        The 2-D multiple scattering pattern from the last call to apply.
+        For OpenCL this is copied from the device on demand.
+        """
+        return self.transform.result()
 
+    def apply(self, theory):
         # CRUFT: don't need probability as a function anymore
         probability = self.probability() if callable(self.probability) else self.probability
         coverage = self.coverage
-        #t0 = time.time()
-        Iqxy = self.transform.multiple_scattering(Iq_calc, probability, coverage)
-        #print("multiple scattering calc time", time.time()-t0)
-
-        # remember the intermediate result in case we want to see it later
-        self.Iqxy = Iqxy
 
         if self.is2d:
+            Iq_calc = theory.reshape(self.nq, self.nq)
+            #t0 = time.time()
+            Iqxy = self.transform.multiple_scattering(Iq_calc, probability, coverage)
+            #print("multiple scattering calc time", time.time()-t0)
             if self.resolution is not None:
                 Iqxy = self.resolution.apply(Iqxy)
             return Iqxy
         else:
+            # interpolation, convolution and annular average all happen
+            # in the calculator, so the 2-D pattern need not be copied back.
+            #t0 = time.time()
+            Iq = self.transform.multiple_scattering_profile(
+                theory, probability, coverage)
+            #print("multiple scattering calc time", time.time()-t0)
             # remember the intermediate result in case we want to see it later
-            Iq = self.radial_profile(Iqxy)
             self.Iq = Iq
             if self.resolution is not None:
                 q = self._q
@@ -545,7 +817,7 @@ class MultipleScattering(Resolution):
         be defined as for
         """
         # circular average, no anti-aliasing
-        Iq = np.histogram(self._radius, bins=self._edges, weights=Iqxy)[0]/self._norm
+        Iq = _bin_sum(self._bins, len(self._norm), Iqxy.flatten())/self._norm
         return Iq
 
     def plot_and_save_powers(self, theory, result, plot=True,
@@ -622,7 +894,6 @@ def annular_average(qxy, Iqxy, qbins):
     qxy, Iqxy = qxy.flatten(), Iqxy.flatten()
     index = np.argsort(qxy)
     qxy, Iqxy = qxy[index], Iqxy[index]
-    print(qxy.shape, Iqxy.shape, index.shape, qbins.shape)
     #values = rebin(np.vstack((0., qxy)), Iqxy, qbins)
     integral = np.cumsum(Iqxy)
     Io = np.diff(np.interp(qbins, qxy, integral, left=0.))
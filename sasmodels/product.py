@@ -74,12 +74,18 @@ The special parameters are:
     If P@S supports beta approximation (i.e., if it has the *Fq* function that
     returns <FF*> and <F><F*>), then *structure_factor_mode* will be added
     to the P@S parameters right after the S parameters.  This mode may be 0
-    for the monodisperse approximation or 1 for the beta approximation.  We
-    will add more values here as we implemented more complicated operations,
-    but for now P and S must be computed separately.  If beta, then we
-    return *I = scale volfrac/volume ( <FF> + <F>^2 (S-1)) + background*.
-    If not beta then return *I = scale/volume P S + background* .  In both
-    cases, return the appropriate immediate values.
+    for the monodisperse approximation or 1 for the beta approximation.  If
+    beta, then we return *I = scale volfrac/volume ( <FF> + <F>^2 (S-1)) +
+    background*.  If not beta then return *I = scale/volume P S + background*.
+    In both cases, return the appropriate immediate values.
+
+    When P and S are both C models, mode 2 selects the local monodisperse
+    approximation *I = scale/volume <FF S(R_eff)> + background*, with S
+    evaluated for the effective radius and volume fraction of each point
+    in the dispersity mesh rather than for the ensemble averages.  This
+    uses a single kernel with P and S compiled together, as described in
+    :func:`make_fused_info`, where modes 0 and 1 need separate P and S
+    kernels since S depends on the averages over the whole mesh.
 
 * *radius_effective_mode*
     If P defines the *radius_effective* function (and therefore
@@ -119,16 +125,20 @@ from collections import OrderedDict
 from copy import copy
 import numpy as np  # type: ignore
 
+from . import profiling
+from . import sftable
 from .modelinfo import ParameterTable, ModelInfo, parse_parameter
+from .generate import model_sources, gpu_setup_size
 from .modelinfo import NUM_MAGFIELD_PARS, NUM_MAGNETIC_PARS, NUM_COMMON_PARS
-from .kernel import KernelModel, Kernel
-from .details import make_details
+from .modelinfo import NUM_SPIN_VALUES
+from .kernel import KernelModel, Kernel, KernelFuture
+from .details import make_details, dependency_key
 
 # pylint: disable=unused-import
 try:
     from typing import OrderedDict as OrderedDictType
     import typing
-    from typing import Tuple, Callable, Union, List, Optional, Dict
+    from typing import Tuple, Callable, Union, List, Optional, Dict, Any
     from .modelinfo import ParameterSet, Parameter
     from .details import CallDetails
     Parts = Dict[str, Union[float, np.ndarray, Tuple[np.ndarray, np.ndarray]]]
@@ -146,18 +156,26 @@ STRUCTURE_MODE_ID = "structure_factor_mode"
 RADIUS_MODE_ID = "radius_effective_mode"
 RADIUS_ID = "radius_effective"
 VOLFRAC_ID = "volfraction"
-def make_extra_pars(p_info):
-    # type: (ModelInfo) -> List[Parameter]
+#: structure_factor_mode value for the local monodisperse approximation.
+LOCAL_MODE = 2
+def make_extra_pars(p_info, s_info=None):
+    # type: (ModelInfo, Optional[ModelInfo]) -> List[Parameter]
     """
     Create parameters for structure factor and effective radius modes.
+
+    The local monodisperse mode is only offered if *s_info* is given and
+    P and S can be compiled into a single kernel.
     """
     pars = []
     if p_info.have_Fq:
+        choices = ["P*S", "P*(1+beta*(S-1))"]
+        if s_info is not None and can_fuse(p_info, s_info):
+            choices.append("P*S local")
         par = parse_parameter(
             STRUCTURE_MODE_ID,
             "",
             0,
-            [["P*S", "P*(1+beta*(S-1))"]],
+            [choices],
             "",
             "Structure factor calculation")
         pars.append(par)
@@ -208,7 +226,8 @@ def make_product_info(p_info, s_info):
     s_list = [pair[0] for pair in s_pairs]
 
     # Build combined parameter table
-    combined_pars = p_pars.kernel_parameters + s_list + make_extra_pars(p_info)
+    combined_pars = (p_pars.kernel_parameters + s_list
+                     + make_extra_pars(p_info, s_info))
     parameters = ParameterTable(combined_pars)
     # Allow for the scenario in which each component has all its PD parameters
     # active simultaneously.  details.make_details() will throw an error if
@@ -268,6 +287,82 @@ def make_product_info(p_info, s_info):
     #print(parlist(model_info, values, is2d=True))
     return model_info
 
+def can_fuse(p_info, s_info):
+    # type: (ModelInfo, ModelInfo) -> bool
+    """
+    Return True if P and S can be compiled into a single fused kernel.
+
+    P must be a C model with *Fq* and S a C model without a setup stage.
+    Neither may be reparameterized, since the fused kernel calls the
+    underlying model functions directly with the P@S parameters.
+    """
+    return (p_info.have_Fq and p_info.Iq is None and s_info.setup_size == 0
+            and not callable(s_info.Iq)
+            and not p_info.translation and not s_info.translation
+            and p_info.composition is None and s_info.composition is None)
+
+def make_fused_info(model_info):
+    # type: (ModelInfo) -> Optional[ModelInfo]
+    """
+    Create the info block for P@S compiled into a single kernel, or None
+    if P and S cannot be fused.
+
+    The fused model uses a copy of the P@S parameter table, so it accepts
+    the P@S call details and values unchanged.  The S parameters are not
+    volume parameters of the fused model, so only P contributes to the
+    form volume and effective radius.  The kernel source is built by
+    :func:`.generate.make_source`, which evaluates R_eff and the volume
+    fraction for each point in the dispersity mesh in the model *setup*
+    and returns <F> and <F^2 S> from *Fq*.
+    """
+    p_info, s_info = model_info.composition[1]
+    if not can_fuse(p_info, s_info):
+        return None
+    p_ids = set(p.id for p in p_info.parameters.kernel_parameters)
+    pars = []
+    for par in model_info.parameters.kernel_parameters:
+        if par.type == 'volume' and par.id not in p_ids:
+            par = copy(par)
+            par.type = ''
+        pars.append(par)
+    # Note: max_pd is limited by the kernel, unlike the P@S table.
+    parameters = ParameterTable(pars)
+
+    fused_id = '%s_%s_fused' % (p_info.id, s_info.id)
+    p_files = model_sources(p_info)
+    s_files = [f for f in model_sources(s_info) if f not in p_files]
+
+    fused_info = ModelInfo()
+    fused_info.id = fused_info.name = fused_id
+    fused_info.filename = None
+    fused_info.basefile = p_info.basefile
+    fused_info.title = model_info.title
+    fused_info.description = model_info.description
+    fused_info.docs = model_info.docs
+    fused_info.category = model_info.category
+    fused_info.parameters = fused_info.base = parameters
+    fused_info.translation = None
+    fused_info.composition = ('fused', [p_info, s_info])
+    fused_info.structure_factor = False
+    fused_info.have_Fq = True
+    # R_eff and the scaled volume fraction come first in the setup buffer.
+    fused_info.setup_size = 2 + p_info.setup_size
+    fused_info.gpu_setup_size = 2 + gpu_setup_size(p_info)
+    fused_info.source = p_files + s_files
+    fused_info.c_code = None
+    fused_info.valid = p_info.valid
+    # The P functions, including any given as strings, are generated along
+    # with the P sources.
+    fused_info.form_volume = fused_info.shell_volume = None
+    fused_info.radius_effective_modes = p_info.radius_effective_modes
+    fused_info.Iq = fused_info.Iqxy = None
+    fused_info.Iqac = fused_info.Iqabc = None
+    fused_info.lineno = {}
+    fused_info.single = p_info.single and s_info.single
+    fused_info.opencl = p_info.opencl and s_info.opencl
+    fused_info.hidden = p_info.hidden
+    return fused_info
+
 def _tag_parameter(par):
     """
     Tag the parameter name with _S to indicate that the parameter comes from
@@ -313,14 +408,18 @@ class ProductModel(KernelModel):
     P = None  # type: KernelModel
     S = None  # type: KernelModel
     dtype = None  # type: np.dtype
-    def __init__(self, model_info, P, S):
-        # type: (ModelInfo, KernelModel, KernelModel) -> None
+    def __init__(self, model_info, P, S, fused=None):
+        # type: (ModelInfo, KernelModel, KernelModel, Optional[Callable[[], KernelModel]]) -> None
         #: Combined info plock for the product model
         self.info = model_info
         #: Form factor modelling individual particles.
         self.P = P
         #: Structure factor modelling interaction between particles.
         self.S = S
+        # Builder for the fused P@S model used by the local monodisperse
+        # approximation.  It is only compiled when that mode is first used.
+        self._fused_builder = fused
+        self._fused = None  # type: Optional[KernelModel]
 
         #: Model precision. This is not really relevant, since it is the
         #: individual P and S models that control the effective dtype,
@@ -342,9 +441,26 @@ class ProductModel(KernelModel):
 
         p_kernel = self.P.make_kernel(q_vectors)
         s_kernel = self.S.make_kernel(q_vectors)
-        return ProductKernel(self.info, p_kernel, s_kernel, q_vectors)
+        make_fused = (None if self._fused_builder is None
+                      else lambda: self.fused.make_kernel(q_vectors))
+        table = sftable.get_table(self.S)
+        s_table = (None if table is None
+                   else lambda *args: table.evaluate(self.S, *args))
+        return ProductKernel(self.info, p_kernel, s_kernel, q_vectors,
+                             make_fused, s_table)
     make_kernel.__doc__ = KernelModel.make_kernel.__doc__
 
+    @property
+    def fused(self):
+        # type: () -> KernelModel
+        """
+        The P@S model compiled as a single kernel, or None if P and S
+        cannot be fused.
+        """
+        if self._fused is None and self._fused_builder is not None:
+            self._fused = self._fused_builder()
+        return self._fused
+
     def release(self):
         # type: (None) -> None
         """
@@ -352,20 +468,36 @@ class ProductModel(KernelModel):
         """
         self.P.release()
         self.S.release()
+        if self._fused is not None:
+            self._fused.release()
+            self._fused = None
 
 
 class ProductKernel(Kernel):
     """
     Instantiated kernel for product model.
     """
-    def __init__(self, model_info, p_kernel, s_kernel, q):
-        # type: (ModelInfo, Kernel, Kernel, Tuple[np.ndarray]) -> None
+    def __init__(self, model_info, p_kernel, s_kernel, q, make_fused=None,
+                 s_table=None):
+        # type: (ModelInfo, Kernel, Kernel, Tuple[np.ndarray], Optional[Callable[[], Kernel]], Optional[Callable[..., np.ndarray]]) -> None
         self.info = model_info
         self.q = q
         self.p_kernel = p_kernel
         self.s_kernel = s_kernel
+        self._make_fused = make_fused
+        # Interpolator for S from sftable, called as
+        # s_table(|q|, radius_effective, state, direct) with the other S
+        # parameters in state and a function which computes S directly.
+        self._s_table = s_table
+        self._q_abs = (q[0] if len(q) == 1
+                       else np.sqrt(sum(np.asarray(v, 'd')**2 for v in q)))
+        self._fused_kernel = None  # type: Optional[Kernel]
         self.dtype = p_kernel.dtype
         self.results = None  # type: Callable[[], OrderedDict]
+        # Form factor inputs and outputs from the previous call.  Fits often
+        # move only scale, background or structure factor parameters, in
+        # which case the form factor doesn't need to be computed again.
+        self._p_cache = None  # type: Tuple[Any, Tuple, Any]
 
         # Find index of volfraction parameter in parameter list
         for k, p in enumerate(model_info.parameters.call_parameters):
@@ -424,15 +556,27 @@ class ProductKernel(Kernel):
 
     def Iq(self, call_details, values, cutoff, magnetic):
         # type: (CallDetails, np.ndarray, float, bool) -> np.ndarray
-        p_info, s_info = self.info.composition[1]
+        return self.Iq_async(call_details, values, cutoff, magnetic).result()
+
+    Iq.__doc__ = Kernel.Iq.__doc__
+    __call__ = Iq
+
+    def Iq_async(self, call_details, values, cutoff, magnetic):
+        # type: (CallDetails, np.ndarray, float, bool) -> KernelFuture
+        p_info, _ = self.info.composition[1]
 
         # Retrieve values from the data vector
         scale, background = values[0], values[1]
         volfrac = values[self._volfrac_index]
         er_mode = (int(values[self._er_mode_index])
                    if self._er_mode_index > 0 else 0)
-        beta_mode = (values[self._beta_mode_index] > 0
-                     if self._beta_mode_index > 0 else False)
+        sf_mode = (int(values[self._beta_mode_index])
+                   if self._beta_mode_index > 0 else 0)
+        if sf_mode == LOCAL_MODE:
+            return self._local_Iq_async(call_details, values, cutoff,
+                                        magnetic, scale, background, volfrac,
+                                        er_mode)
+        beta_mode = sf_mode > 0
 
         nvalues = self.info.parameters.nvalues
         nweights = call_details.num_weights
@@ -451,17 +595,96 @@ class ProductKernel(Kernel):
             values[self._p_value_slice],
             values[self._magentic_slice],
             weights]
+        if p_info.parameters.nmagnetic:
+            # The derived polarization values follow the weights.
+            spin_start = nvalues + 2*nweights
+            p_values.append(values[spin_start:spin_start + NUM_SPIN_VALUES])
         spacer = (32 - sum(len(v) for v in p_values)%32)%32
         p_values.append([0.]*spacer)
         p_values = np.hstack(p_values).astype(self.p_kernel.dtype)
 
-        # Call the form factor kernel to compute <F> and <F^2>.
-        # If the model doesn't support Fq the returned <F> will be None.
-        F, Fsq, radius_effective, shell_volume, volume_ratio \
-            = self.p_kernel.Fq(p_details, p_values, cutoff, magnetic, er_mode)
-        p_intermediate = getattr(self.p_kernel, 'results', None)
+        # Reuse the form factor from the previous call if none of its
+        # inputs have changed.
+        p_key = (dependency_key(p_details, p_values, p_info.parameters.nvalues),
+                 cutoff, magnetic, er_mode)
+        if self._p_cache is not None and self._p_cache[0] == p_key:
+            p_result = self._p_cache[1]
+            p_future = KernelFuture(lambda: p_result)
+        else:
+            # Start the form factor kernel to compute <F> and <F^2>.  S
+            # depends on R_eff and the volume ratio from P, so it can't
+            # start until P is complete, but the caller is free to queue
+            # other work while P is running.
+            self._p_cache = None
+            p_future = self.p_kernel.Fq_async(p_details, p_values, cutoff,
+                                              magnetic, er_mode)
+        return KernelFuture(lambda: self._finish_Iq(
+            p_future, p_key, call_details, values, cutoff, p_offset, nweights,
+            weights, scale, background, volfrac, er_mode, beta_mode))
+
+    Iq_async.__doc__ = Kernel.Iq_async.__doc__
+
+    def _local_Iq_async(self, call_details, values, cutoff, magnetic,
+                        scale, background, volfrac, er_mode):
+        # type: (CallDetails, np.ndarray, float, bool, float, float, float, int) -> KernelFuture
+        """
+        Start the local monodisperse approximation in the fused P@S kernel.
 
-        # TODO: async call to the GPU
+        The fused model shares the P@S parameter layout, so the values are
+        passed through unchanged apart from scale and background, which are
+        applied here.  The call details are rebuilt since the fused kernel
+        has fewer dispersity loops than the P@S table allows.
+        """
+        if self._make_fused is None:
+            raise NotImplementedError(
+                "local monodisperse approximation needs C models for P and S")
+        if self.p_kernel.dim == '2d':
+            raise NotImplementedError(
+                "local monodisperse approximation not yet supported for 2D")
+        if self._fused_kernel is None:
+            self._fused_kernel = self._make_fused()
+        fused_details = make_details(
+            self._fused_kernel.info, call_details.length, call_details.offset,
+            call_details.num_weights)
+        fused_values = values.astype(self._fused_kernel.dtype)
+        fused_values[0], fused_values[1] = 1., 0.
+        future = self._fused_kernel.Fq_async(fused_details, fused_values,
+                                             cutoff, magnetic, er_mode)
+        def finish():
+            # type: () -> np.ndarray
+            _, FsqS, radius_effective, shell_volume, volume_ratio \
+                = future.result()
+            combined_scale = scale/shell_volume
+            if not self._volfrac_in_p:
+                combined_scale *= volfrac
+            def results():
+                # type: () -> Parts
+                parts = OrderedDict()  # type: Parts
+                parts["P(Q) S(Q)"] = (self.q, combined_scale*FsqS)
+                parts["volume"] = shell_volume
+                parts["volume_ratio"] = volume_ratio
+                parts["radius_effective"] = radius_effective
+                return parts
+            self.results = results
+            return combined_scale*FsqS + background
+        return KernelFuture(finish)
+
+    def _finish_Iq(self, p_future, p_key, call_details, values, cutoff,
+                   p_offset, nweights, weights, scale, background, volfrac,
+                   er_mode, beta_mode):
+        # type: (KernelFuture, Any, CallDetails, np.ndarray, float, np.ndarray, int, np.ndarray, float, float, float, int, bool) -> np.ndarray
+        """
+        Complete the product calculation given the pending form factor.
+        """
+        _, s_info = self.info.composition[1]
+
+        # If the model doesn't support Fq the returned <F> will be None.
+        p_result = p_future.result()
+        if self._p_cache is None or self._p_cache[0] != p_key:
+            p_intermediate = getattr(self.p_kernel, 'results', None)
+            self._p_cache = (p_key, p_result, p_intermediate)
+        p_intermediate = self._p_cache[2]
+        F, Fsq, radius_effective, shell_volume, volume_ratio = p_result
 
         # Construct the calling parameters for S.
         s_length = call_details.length[self._s_detail_slice]
@@ -505,26 +728,35 @@ class ProductKernel(Kernel):
         s_values[NUM_COMMON_PARS+1] = s_dist[s_offset[1]] = volfrac*volume_ratio
         s_dist[s_offset[1]+nweights] = 1.0
 
-        # Call the structure factor kernel to compute S.
-        S = self.s_kernel.Iq(s_details, s_values, cutoff, False)
+        # Call the structure factor kernel to compute S, or interpolate it
+        # from the shared table when S is monodisperse.
+        direct = lambda: self.s_kernel.Iq(s_details, s_values, cutoff, False)
+        if self._s_table is not None and np.all(s_length == 1):
+            s_npars = s_info.parameters.npars
+            S = self._s_table(
+                self._q_abs, s_values[NUM_COMMON_PARS],
+                s_values[NUM_COMMON_PARS+1:NUM_COMMON_PARS+s_npars], direct)
+        else:
+            S = direct()
         #print("P", Fsq[:10])
         #print("S", S[:10])
         #print(radius_effective, volfrac*volume_ratio)
 
         # Combine form factor and structure factor
         #print("beta", beta_mode, F, Fsq, S)
-        PS = Fsq + F**2*(S-1) if beta_mode else Fsq*S
-
-        # Determine overall scale factor. Hollow shapes are weighted by
-        # shell_volume, so that is needed for number density estimation.
-        # For solid shapes we can use shell_volume as well since it is
-        # equal to form volume.  If P already has a volfraction parameter,
-        # then assume that it is already on absolute scale, and don't
-        # include volfrac in the combined_scale.
-        combined_scale = scale/shell_volume
-        if not self._volfrac_in_p:
-            combined_scale *= volfrac
-        final_result = combined_scale*PS + background
+        with profiling.stage("combine", self.info.name):
+            PS = Fsq + F**2*(S-1) if beta_mode else Fsq*S
+
+            # Determine overall scale factor. Hollow shapes are weighted by
+            # shell_volume, so that is needed for number density estimation.
+            # For solid shapes we can use shell_volume as well since it is
+            # equal to form volume.  If P already has a volfraction
+            # parameter, then assume that it is already on absolute scale,
+            # and don't include volfrac in the combined_scale.
+            combined_scale = scale/shell_volume
+            if not self._volfrac_in_p:
+                combined_scale *= volfrac
+            final_result = combined_scale*PS + background
 
         # Capture intermediate values so user can see them.  These are
         # returned as a lazy evaluator since they are only needed in the
@@ -541,11 +773,11 @@ class ProductKernel(Kernel):
 
         return final_result
 
-    Iq.__doc__ = Kernel.Iq.__doc__
-    __call__ = Iq
-
     def release(self):
         # type: () -> None
         """Free resources associated with the kernel."""
         self.p_kernel.release()
         self.s_kernel.release()
+        if self._fused_kernel is not None:
+            self._fused_kernel.release()
+            self._fused_kernel = None
@@ -0,0 +1,197 @@
+"""
+Stage timing
+============
+
+Hooks for timing the stages of a model evaluation, so that the cost of a
+calculation can be split between building the dispersity mesh, moving
+data to and from the device, running the kernel, applying the resolution
+function and combining the parts of product and mixture models.
+
+Register a profiler with :func:`add_profiler`.  It is called with a
+:class:`StageTime` at the end of each stage.  For example, to accumulate
+the time spent in each stage during a fit::
+
+    from collections import defaultdict
+    from sasmodels import profiling
+
+    totals = defaultdict(float)
+    def accumulate(entry):
+        totals[entry.stage] += entry.device or entry.wall
+    profiling.add_profiler(accumulate)
+    ...
+    profiling.remove_profiler(accumulate)
+
+or use :func:`collect` to gather the records for a block of code::
+
+    with profiling.collect() as records:
+        theory = model.theory()
+    print(profiling.summarize(records))
+
+The stages are:
+
+    *mesh* : building the dispersity mesh and the kernel arguments
+    *transfer* : copying details, values and results to and from the device
+    *kernel* : evaluating the kernel over the dispersity mesh
+    *smear* : applying the resolution function
+    *combine* : combining P and S for product models, or the parts of a
+    mixture
+
+*wall* is the elapsed host time in seconds.  *device* is the time measured
+on the device from the OpenCL or CUDA event timers, or None for the
+stages run on the host.  Transfers queued without blocking have *wall* set
+to None since only the device knows how long they took.  For asynchronous
+kernel calls, *wall* runs from when the kernel is queued until the caller
+retrieves the result.
+
+Apart from the transfers, stages do not nest, so the sum of the wall times
+is close to the total time for the evaluation.  The kernel wall time
+includes the transfers for the GPU kernels, which block on the copy back of
+the result.  The mesh stage for product and mixture models is recorded
+once for the whole model, with the kernel stage recorded for each part.
+Profiling costs a single test for each stage when no profiler is
+registered.
+"""
+
+from __future__ import print_function
+
+from collections import namedtuple, OrderedDict
+from contextlib import contextmanager
+from time import perf_counter
+
+# pylint: disable=unused-import
+try:
+    from typing import Callable, Dict, Iterator, List, Optional, Tuple
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Timing for one stage of an evaluation.  *model* is the name of the
+#: model being evaluated.
+StageTime = namedtuple("StageTime", "stage model wall device")
+
+#: Names of the stages in the order they occur in an evaluation.
+STAGES = ("mesh", "transfer", "kernel", "smear", "combine")
+
+_PROFILERS = []  # type: List[Callable[[StageTime], None]]
+
+
+def add_profiler(profiler):
+    # type: (Callable[[StageTime], None]) -> None
+    """
+    Call *profiler(record)* with the :class:`StageTime` for each stage.
+    """
+    _PROFILERS.append(profiler)
+
+
+def remove_profiler(profiler):
+    # type: (Callable[[StageTime], None]) -> None
+    """
+    Stop calling *profiler*.
+    """
+    _PROFILERS.remove(profiler)
+
+
+def enabled():
+    # type: () -> bool
+    """
+    Return True if there are profilers registered.  Use this to skip the
+    work of measuring device times when nobody is listening.
+    """
+    return bool(_PROFILERS)
+
+
+def record(stage, model, wall, device=None):
+    # type: (str, str, Optional[float], Optional[float]) -> None
+    """
+    Send the time for *stage* of *model* to the registered profilers.
+    """
+    if _PROFILERS:
+        entry = StageTime(stage, model, wall, device)
+        for profiler in _PROFILERS:
+            profiler(entry)
+
+
+class stage(object):
+    """
+    Context manager which records the wall time for *stage* of *model*.
+
+    Set *device* on the returned object within the block to record the
+    device time as well::
+
+        with profiling.stage("kernel", name) as timer:
+            ...
+            timer.device = elapsed
+    """
+    # pylint: disable=invalid-name
+    def __init__(self, stage_name, model):
+        # type: (str, str) -> None
+        self.stage = stage_name
+        self.model = model
+        self.device = None  # type: Optional[float]
+        self._start = None  # type: Optional[float]
+
+    def __enter__(self):
+        # type: () -> "stage"
+        if _PROFILERS:
+            self._start = perf_counter()
+        return self
+
+    def __exit__(self, *args):
+        if self._start is not None:
+            record(self.stage, self.model, perf_counter() - self._start,
+                   self.device)
+
+
+@contextmanager
+def collect():
+    # type: () -> Iterator[List[StageTime]]
+    """
+    Gather the :class:`StageTime` records for the stages run within the
+    block into a list.
+    """
+    records = []  # type: List[StageTime]
+    add_profiler(records.append)
+    try:
+        yield records
+    finally:
+        remove_profiler(records.append)
+
+
+def summarize(records):
+    # type: (List[StageTime]) -> Dict[str, Tuple[float, float, int]]
+    """
+    Return the total wall time, total device time and number of records
+    for each stage in *records*, with the stages in evaluation order.
+    Missing times count as zero.
+    """
+    totals = OrderedDict((name, [0., 0., 0]) for name in STAGES)
+    for entry in records:
+        total = totals.setdefault(entry.stage, [0., 0., 0])
+        total[0] += entry.wall or 0.
+        total[1] += entry.device or 0.
+        total[2] += 1
+    return OrderedDict((name, tuple(total)) for name, total in totals.items()
+                       if total[2])
+
+
+def test_profiling():
+    # type: () -> None
+    """
+    Check that the stages are recorded and summarized.
+    """
+    assert not enabled()
+    with collect() as records:
+        assert enabled()
+        with stage("kernel", "sphere") as timer:
+            timer.device = 0.5
+        record("transfer", "sphere", None, 0.25)
+        record("transfer", "sphere", 0.125, 0.25)
+    assert not enabled()
+    with stage("mesh", "sphere"):
+        pass
+    assert [entry.stage for entry in records] == [
+        "kernel", "transfer", "transfer"]
+    assert records[0].wall >= 0. and records[0].device == 0.5
+    summary = summarize(records)
+    assert list(summary) == ["transfer", "kernel"]
+    assert summary["transfer"] == (0.125, 0.5, 2)
@@ -0,0 +1,166 @@
+"""
+Quasi-Monte Carlo dispersity integration
+========================================
+
+The dispersity calculation in the kernel is a full tensor product over the
+distributions of the polydisperse parameters, so the cost is the product
+of the number of points in each distribution.  With orientation and size
+dispersity in 2D this can be many millions of evaluations for each q.
+
+:func:`call_kernel_qmc` instead draws sample points from the product of
+the weight distributions using a randomly shifted Halton sequence, and
+evaluates them as a batch of monodisperse parameter sets.  The raw kernel sums for the
+samples are accumulated just as they would be for the dispersity loop, so
+that the volume normalization is the same as for the full mesh.  Because the
+samples are drawn from the discrete distributions returned by
+:func:`.weights.get_weights`, the estimate converges to the full mesh result
+rather than the continuous integral.
+
+The error is estimated from the spread of several independently shifted
+sequences.  The number of samples is doubled until the estimated relative
+error at every q is below the tolerance.  For a few dispersity parameters
+with small meshes the full calculation is cheaper, so use this only when
+the mesh is large.
+"""
+from __future__ import print_function, division
+
+import logging
+
+import numpy as np  # type: ignore
+
+from .details import _make_kernel_args
+from .direct_model import get_mesh, call_kernel
+from .modelinfo import NUM_COMMON_PARS
+
+# pylint: disable=unused-import
+try:
+    from typing import List, Tuple
+    from .kernel import Kernel
+    from .modelinfo import ParameterSet
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Prime bases for the Halton sequence, one for each dispersity parameter.
+PRIMES = (2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37)
+
+#: Number of parameter sets sent to the kernel at once.  This bounds the
+#: size of the result matrix.
+BLOCK_SIZE = 1024
+
+
+def halton(index, base):
+    # type: (np.ndarray, int) -> np.ndarray
+    """
+    Return the radical inverse of the integer *index* values in *base*,
+    which is the Halton sequence for that base.
+    """
+    index = np.array(index, dtype='int64')
+    result = np.zeros(index.shape)
+    scale = 1.0/base
+    while np.any(index > 0):
+        result += scale*(index % base)
+        index //= base
+        scale /= base
+    return result
+
+
+def call_kernel_qmc(calculator, pars, tol=1e-3, replicates=8, start=256,
+                    max_points=1 << 16, seed=1):
+    # type: (Kernel, ParameterSet, float, int, int, int, int) -> np.ndarray
+    """
+    Like :func:`.direct_model.call_kernel`, but using quasi-Monte Carlo
+    integration over the dispersity mesh.
+
+    *tol* is the target relative error at each q, estimated from
+    *replicates* independently shifted Halton sequences.  Each sequence
+    starts with *start* points, and the number of points is doubled until
+    the error is within tolerance or *max_points* is reached, in which case
+    a warning is logged.  *seed* sets the random shifts, so that repeated
+    calls with the same parameters give the same result.
+
+    Composite models are not supported since their parts need separate
+    meshes.
+    """
+    if calculator.info.composition is not None:
+        raise NotImplementedError("QMC integration is not available for %s"
+                                  % calculator.info.name)
+    mesh = get_mesh(calculator.info, pars, dim=calculator.dim)
+    active = [k for k, (_, _, w) in enumerate(mesh) if len(w) > 1]
+    if not active:
+        return call_kernel(calculator, pars)
+    if len(active) > len(PRIMES):
+        raise ValueError("too many dispersity parameters for QMC")
+
+    # Monodisperse template for the kernel arguments.  With a single point
+    # in every distribution the dispersity value for parameter k is at
+    # position k after the fixed values, and the weight is one.
+    mono_mesh = [(value, [d[0] if len(d) else value], [1.0])
+                 for value, d, _ in mesh]
+    call_details, template, is_magnetic = _make_kernel_args(
+        calculator, mono_mesh)
+    nvalues = calculator.info.parameters.nvalues
+    slots = [nvalues + k - NUM_COMMON_PARS for k in active]
+    points = [np.asarray(mesh[k][1], 'd') for k in active]
+    cdfs = [np.cumsum(mesh[k][2])/np.sum(mesh[k][2]) for k in active]
+
+    shifts = np.random.RandomState(seed).uniform(size=(replicates, len(active)))
+    sums = np.zeros((replicates, calculator.result.size))
+    done, target = 0, start
+    while True:
+        index = np.arange(done+1, target+1)
+        for r in range(replicates):
+            rows = np.tile(template, (len(index), 1))
+            for slot, base, x, cdf, shift in zip(
+                    slots, PRIMES, points, cdfs, shifts[r]):
+                u = (halton(index, base) + shift) % 1.0
+                pick = np.minimum(np.searchsorted(cdf, u, side='right'),
+                                  len(x)-1)
+                rows[:, slot] = x[pick]
+            for block in range(0, len(rows), BLOCK_SIZE):
+                part = rows[block:block+BLOCK_SIZE]
+                result = calculator._call_kernel_batch(
+                    [call_details]*len(part), part, 0., is_magnetic, 0)
+                sums[r] += np.sum(result, axis=0, dtype='d')
+        done = target
+
+        estimates = np.array([_Iq(calculator, template, s) for s in sums])
+        Iq = _Iq(calculator, template, np.sum(sums, axis=0))
+        err = np.std(estimates, axis=0, ddof=1)/np.sqrt(replicates)
+        nonzero = (Iq != 0.)
+        relerr = (np.max(abs(err[nonzero]/Iq[nonzero])) if nonzero.any()
+                  else 0.)
+        if relerr <= tol:
+            return Iq
+        if 2*done > max_points:
+            logging.warning("QMC for %s stopped at %d points with error %g",
+                            calculator.info.name, done*replicates, relerr)
+            return Iq
+        target = 2*done
+
+
+def _Iq(calculator, values, sums):
+    # type: (Kernel, np.ndarray, np.ndarray) -> np.ndarray
+    """
+    Return I(q) from the accumulated raw kernel *sums* using scale and
+    background from *values*.
+    """
+    _, F2, _, shell_volume, _ = calculator._unpack_result(sums)
+    return (values[0]/shell_volume)*F2 + values[1]
+
+
+def test_qmc():
+    # type: () -> None
+    """Check that QMC integration converges to the full dispersity mesh"""
+    from .core import load_model
+    q = np.logspace(-3, -1, 20)
+    kernel = load_model('cylinder', dtype='double').make_kernel([q])
+    pars = dict(radius=30, radius_pd=0.1, radius_pd_n=35,
+                length=200, length_pd=0.1, length_pd_n=35)
+    target = call_kernel(kernel, pars)
+    Iq = call_kernel_qmc(kernel, pars, tol=1e-4)
+    assert np.allclose(Iq, target, rtol=1e-3, atol=0)
+
+
+if __name__ == "__main__":
+    test_qmc()
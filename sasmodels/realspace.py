@@ -0,0 +1,770 @@
+r"""
+Real space scattering from point clouds
+=======================================
+
+Computes the scattering from a shape represented by a cloud of points, each
+with a scattering length density *rho* and a volume.  This can be used for
+shapes that have no analytic form, and to check the analytic models against
+a direct calculation with realistic point densities.
+
+The oriented pattern is the sum over the points
+
+.. math::
+
+    I(\mathbf q) = \frac{10^{-4}}{\sum V_j}
+        \left| \sum_j \rho_j V_j e^{i \mathbf q \cdot \mathbf r_j} \right|^2
+
+which :func:`calc_Iqxy` evaluates for each $(q_x, q_y)$ detector pixel.  The
+orientation average is the Debye sum over pairs of points,
+
+.. math::
+
+    I(q) = \frac{10^{-4}}{\sum V_j} \left(
+        \sum_j (\rho_j V_j)^2 + 2 \sum_k P(r_k) \frac{\sin q r_k}{q r_k}
+        \right)
+
+where $P(r_k)$ from :func:`calc_Pr` is the sum of $\rho_i V_i \rho_j V_j$ over
+the pairs $i < j$ whose separation falls in bin $k$.  Binning the distances
+makes the cost of each extra $q$ value independent of the number of points.
+:func:`calc_Iq` puts the two steps together, choosing bins fine enough that
+the binning error is well below the sampling noise.
+
+Both sums are $O(n^2)$ in the number of points (or $O(n\,n_q)$ for the
+oriented pattern) and are evaluated by one of the following engines:
+
+    *opencl* : work groups stage tiles of points in local memory, with each
+    group accumulating a local distance histogram in single precision which
+    is summed across groups in double precision on the host
+    *numba* : multithreaded loops with a separate histogram for each thread
+    *numpy* : vectorized over blocks of rows, so the memory use is bounded
+
+The default is OpenCL if it is available, then numba if *SAS_NUMBA* is set
+in the environment, then numpy.  Bins that are not uniformly spaced are
+only supported by the numpy engine.
+
+Shapes are sampled uniformly with :class:`Box`, :class:`Superball` and
+:class:`EllipticalCylinder`, and can be combined with :class:`Composite`.
+For example, to compare a sampled box with the parallelepiped model::
+
+    import numpy as np
+    from sasmodels import realspace
+    shape = realspace.Box(20, 40, 100, value=2.)
+    rho, points = shape.sample(density=0.1)
+    q = np.logspace(-3, -0.5, 200)
+    Iq = realspace.calc_Iq(q, rho, points, volume=1/0.1)
+"""
+from __future__ import division, print_function
+
+import os
+
+import numpy as np  # type: ignore
+from numpy import pi, radians, sin, cos, sqrt
+from numpy.random import poisson, uniform
+
+from .resolution import bin_edges
+
+try:
+    from numba import njit, prange
+except ImportError:
+    njit = prange = None
+
+# pylint: disable=unused-import
+try:
+    from typing import Any, Dict, Optional, Tuple
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Use numba for the CPU calculation if it is available.  Set *SAS_NUMBA=1*
+#: in the environment to enable it.
+USE_NUMBA = (njit is not None
+             and int(os.environ.get("SAS_NUMBA", "0") or "0") > 0)
+
+#: Work items in each OpenCL group, and so points in each local memory tile.
+GROUP_SIZE = 64
+
+#: Maximum number of pair (or q, point) terms held at once by the numpy
+#: engine.  Each term uses about 40 bytes of temporary storage.
+NUMPY_BLOCK = 1 << 20
+
+# Definition of rotation matrices comes from wikipedia:
+#    https://en.wikipedia.org/wiki/Rotation_matrix#Basic_rotations
+def Rx(angle):
+    """Construct a matrix to rotate points about *x* by *angle* degrees."""
+    a = radians(angle)
+    R = [[1, 0, 0],
+         [0, +cos(a), -sin(a)],
+         [0, +sin(a), +cos(a)]]
+    return np.array(R)
+
+def Ry(angle):
+    """Construct a matrix to rotate points about *y* by *angle* degrees."""
+    a = radians(angle)
+    R = [[+cos(a), 0, +sin(a)],
+         [0, 1, 0],
+         [-sin(a), 0, +cos(a)]]
+    return np.array(R)
+
+def Rz(angle):
+    """Construct a matrix to rotate points about *z* by *angle* degrees."""
+    a = radians(angle)
+    R = [[+cos(a), -sin(a), 0],
+         [+sin(a), +cos(a), 0],
+         [0, 0, 1]]
+    return np.array(R)
+
+def rotation(theta, phi, psi):
+    r"""
+    Return a rotation matrix to apply to a set of points.
+    View is in degrees using a $z$-$y$-$z$ rotation sequence of Euler angles
+    $\phi$-$\theta$-$\psi$.  The $c$-axis of the shape starts along $z$ and
+    the $b$-axis starts along $y$.
+    """
+    return Rz(phi) @ Ry(theta) @ Rz(psi)
+
+def invert_view(qx, qy, view):
+    r"""
+    Return $(q_a, q_b, q_c)$ for the $(\theta, \phi, \psi)$ view angle at
+    detector pixel corresponding to $(q_x, q_y)$.  View is in degrees using
+    a $z$-$y$-$z$ sequence of Euler angles $\phi$-$\theta$-$\psi$.
+    """
+    theta, phi, psi = view
+    Rinv = Rz(-psi) @ Ry(-theta) @ Rz(-phi)
+    q = np.vstack((qx.flatten(), qy.flatten(), 0*qx.flatten()))
+    return Rinv @ q
+
+
+class Shape(object):
+    """
+    Base class for sampled shapes.
+
+    Subclasses set *volume*, *dims* (the extent along $a$, $b$ and $c$) and
+    *r_max*, which is an upper bound on the distance between any two points
+    in the shape.
+    """
+    rotation = np.eye(3)
+    center = np.array([0., 0., 0.])[:, None]
+    r_max = None  # type: float
+    volume = None  # type: float
+    dims = None  # type: Tuple[float, float, float]
+
+    def sample(self, density):
+        # type: (float) -> Tuple[np.ndarray, np.ndarray]
+        """
+        Returns arrays (rho[N], points[N, 3]) for a uniform random sample
+        with *density* points per cubic Angstrom.
+        """
+        raise NotImplementedError()
+
+    def rotate(self, theta, phi, psi):
+        """See :func:`rotation` for details on the rotation matrix."""
+        self.rotation = rotation(theta, phi, psi) @ self.rotation
+        return self
+
+    def shift(self, x, y, z):
+        """Move the center of the shape to (*x*, *y*, *z*)."""
+        self.center = self.center + np.array([x, y, z])[:, None]
+        return self
+
+    def _adjust(self, points):
+        points = self.rotation @ points.T + self.center
+        return points.T
+
+    def r_bins(self, q, over_sampling=1, r_step=None):
+        """See :func:`r_bins` for details on the bins."""
+        return r_bins(q, r_max=self.r_max, r_step=r_step,
+                      over_sampling=over_sampling)
+
+
+class Composite(Shape):
+    """
+    Shape made from a list of *shapes*, each with its own position and
+    orientation, which is then moved and rotated as a whole.
+    """
+    def __init__(self, shapes, center=(0, 0, 0), orientation=(0, 0, 0)):
+        self.shapes = shapes
+        self.rotate(*orientation)
+        self.shift(*center)
+
+        # Find the worst case distance between any two points amongst a set
+        # of shapes independent of orientation.  This could easily be a
+        # factor of two worse than necessary, e.g., a pair of thin rods
+        # end-to-end vs the same pair side-by-side.
+        distances = [((s1.r_max + s2.r_max)/2
+                      + sqrt(np.sum((s1.center - s2.center)**2)))
+                     for s1 in shapes
+                     for s2 in shapes]
+        self.r_max = max(distances + [s.r_max for s in shapes])
+        self.volume = sum(shape.volume for shape in self.shapes)
+
+    def sample(self, density):
+        values, points = zip(*(shape.sample(density) for shape in self.shapes))
+        return np.hstack(values), self._adjust(np.vstack(points))
+
+
+class Box(Shape):
+    """
+    Rectangular prism with sides *a*, *b*, *c* and density *value*.
+    """
+    def __init__(self, a, b, c,
+                 value, center=(0, 0, 0), orientation=(0, 0, 0)):
+        self.value = np.asarray(value)
+        self.rotate(*orientation)
+        self.shift(*center)
+        self.a, self.b, self.c = a, b, c
+        self._scale = np.array([a/2, b/2, c/2])[None, :]
+        self.r_max = sqrt(a**2 + b**2 + c**2)
+        self.dims = a, b, c
+        self.volume = a*b*c
+
+    def sample(self, density):
+        num_points = poisson(density*self.volume)
+        points = self._scale*uniform(-1, 1, size=(num_points, 3))
+        values = self.value.repeat(points.shape[0])
+        return values, self._adjust(points)
+
+
+class Superball(Shape):
+    r"""
+    Superball $x^{2p} + y^{2p} + z^{2p} \le (a/2)^{2p}$ with density *value*.
+    """
+    def __init__(self, a, p,
+                 value, center=(0, 0, 0), orientation=(0, 0, 0)):
+        from scipy.special import gamma
+        self.value = np.asarray(value)
+        self.rotate(*orientation)
+        self.shift(*center)
+        self.a, self.p = a, p
+        self._scale = a/2
+        # The corners of the enclosing cube bound the distances.
+        self.r_max = sqrt(3)*a
+        self.dims = a, a, a
+        g1 = gamma(1.0 / (2.0 * p))
+        g3 = gamma(3.0 / (2.0 * p))
+        self.volume = a**3 / 12.0 / p**2 * g1**3 / g3
+
+    def sample(self, density):
+        # Sample from cube[-a/2, a/2]
+        num_points = poisson(density*self.a**3)
+        points = uniform(-1, 1, size=(num_points, 3))
+        # Trim points outside maximum "squared radius", x^2p + y^2p + z^2p < 1
+        radius_sq = np.sum((points**2)**self.p, axis=1)
+        points = points[radius_sq <= 1]
+        values = self.value.repeat(points.shape[0])
+        return values, self._adjust(self._scale*points)
+
+
+class EllipticalCylinder(Shape):
+    """
+    Cylinder with elliptical cross section of radii *ra*, *rb* and axis
+    *length* along $c$, with density *value*.
+    """
+    def __init__(self, ra, rb, length,
+                 value, center=(0, 0, 0), orientation=(0, 0, 0)):
+        self.value = np.asarray(value)
+        self.rotate(*orientation)
+        self.shift(*center)
+        self.ra, self.rb, self.length = ra, rb, length
+        self._scale = np.array([ra, rb, length/2])[None, :]
+        self.r_max = sqrt(4*max(ra, rb)**2 + length**2)
+        self.dims = 2*ra, 2*rb, length
+        self.volume = pi*ra*rb*length
+
+    def sample(self, density):
+        # randomly sample from a box of side length 2*r, excluding anything
+        # not in the cylinder
+        num_points = poisson(density*4*self.ra*self.rb*self.length)
+        points = uniform(-1, 1, size=(num_points, 3))
+        radius_sq = points[:, 0]**2 + points[:, 1]**2
+        points = points[radius_sq <= 1]
+        values = self.value.repeat(points.shape[0])
+        return values, self._adjust(self._scale*points)
+
+
+# OpenCL kernels for the point sums.  Each work group steps through the
+# points in tiles of one point per work item, copying the tile to local
+# memory so that every point is read from global memory once per group.
+#
+# pair_histogram adds w_i w_j for the pairs i < j into the bins
+# [bin_start, bin_start + nbins) of width r_step starting from r_lo.  Work
+# item i in the group takes row i, so the group covers the rows from
+# group*size and only needs the tiles which start at or after its rows.
+# Each group writes its histogram to its row of partial, and the host adds
+# the rows.  OpenCL 1.2 has no atomic float add, so local_add swaps in the
+# new sum with compare and exchange until no other work item has changed
+# it in between.  The histogram stays in single precision to fit more bins
+# in local memory and since 64-bit local atomics are an extension.
+#
+# scatter_sum computes |sum w_j exp(i q.r_j)|^2 with work item i taking q_i.
+#
+# Points are packed as (x, y, z, w) with w = rho*volume, and q as (qa, qb,
+# qc, 0).  When compiling with sasmodels.kernelcl.compile_model the double
+# precision types are converted to single precision as needed.
+REALSPACE_KERNELS = """
+void local_add(volatile local float *address, const float x)
+{
+    union { unsigned int bits; float value; } old_sum, new_sum;
+    do {
+        old_sum.value = *address;
+        new_sum.value = old_sum.value + x;
+    } while (atomic_cmpxchg((volatile local unsigned int *)address,
+                            old_sum.bits, new_sum.bits) != old_sum.bits);
+}
+
+kernel void pair_histogram(
+    const int n,
+    global const double4 *points,
+    const double r_lo,
+    const double r_step,
+    const int bin_start,
+    const int nbins,
+    local double4 *tile,
+    local float *hist,
+    global float *partial)
+{
+    const int i = get_global_id(0);
+    const int lid = get_local_id(0);
+    const int size = get_local_size(0);
+    const int group = get_group_id(0);
+    const double4 zero = (double4)(0.0, 0.0, 0.0, 0.0);
+    for (int k=lid; k < nbins; k += size) hist[k] = 0.0f;
+    const double4 p = (i < n ? points[i] : zero);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int base=group*size; base < n; base += size) {
+        tile[lid] = (base + lid < n ? points[base + lid] : zero);
+        barrier(CLK_LOCAL_MEM_FENCE);
+        const int count = min(size, n - base);
+        for (int t=max(i - base + 1, 0); t < count; t++) {
+            const double dx = p.x - tile[t].x;
+            const double dy = p.y - tile[t].y;
+            const double dz = p.z - tile[t].z;
+            const double d = sqrt(dx*dx + dy*dy + dz*dz);
+            const int bin = (int)floor((d - r_lo)/r_step) - bin_start;
+            if (bin >= 0 && bin < nbins) {
+                local_add(hist + bin, (float)(p.w*tile[t].w));
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    for (int k=lid; k < nbins; k += size) partial[group*nbins + k] = hist[k];
+}
+
+kernel void scatter_sum(
+    const int nq,
+    global const double4 *q,
+    const int n,
+    global const double4 *points,
+    local double4 *tile,
+    global double *Iq)
+{
+    const int i = get_global_id(0);
+    const int lid = get_local_id(0);
+    const int size = get_local_size(0);
+    const double4 zero = (double4)(0.0, 0.0, 0.0, 0.0);
+    const double4 qi = (i < nq ? q[i] : zero);
+    double real = 0.0, imag = 0.0;
+    for (int base=0; base < n; base += size) {
+        tile[lid] = (base + lid < n ? points[base + lid] : zero);
+        barrier(CLK_LOCAL_MEM_FENCE);
+        const int count = min(size, n - base);
+        for (int t=0; t < count; t++) {
+            const double4 p = tile[t];
+            double c;
+            const double s = sincos(qi.x*p.x + qi.y*p.y + qi.z*p.z, &c);
+            real += p.w*c;
+            imag += p.w*s;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (i < nq) Iq[i] = real*real + imag*imag;
+}
+"""
+
+_PROGRAMS = {}  # type: Dict[str, Any]
+
+def _opencl_dtype(dtype):
+    # type: (Optional[str]) -> np.dtype
+    """
+    Return the precision for the OpenCL engine, which is *dtype* if given,
+    otherwise double precision if the device supports it.
+    """
+    from . import kernelcl
+    if dtype is None:
+        env = kernelcl.environment()
+        return np.dtype('d' if env.has_type(np.dtype('d')) else 'f')
+    return np.dtype(dtype)
+
+
+def _opencl_program(dtype):
+    """
+    Return the context, queue and compiled program for *dtype*.
+    """
+    from . import kernelcl
+    env = kernelcl.environment()
+    context = env.context.get(dtype, None)
+    if context is None:
+        raise RuntimeError("%s not supported by the OpenCL devices" % dtype)
+    if dtype.char not in _PROGRAMS:
+        _PROGRAMS[dtype.char] = kernelcl.compile_model(
+            context, REALSPACE_KERNELS, dtype)
+    return context, env.queue[dtype], _PROGRAMS[dtype.char]
+
+
+def _group_size(kernel, device):
+    import pyopencl as cl
+    limit = kernel.get_work_group_info(
+        cl.kernel_work_group_info.WORK_GROUP_SIZE, device)
+    return max(min(GROUP_SIZE, limit), 1)
+
+
+def _pair_histogram_opencl(points, r_lo, r_step, nbins, dtype):
+    # type: (np.ndarray, float, float, int, np.dtype) -> np.ndarray
+    import pyopencl as cl
+    context, queue, program = _opencl_program(dtype)
+    kernel = program.pair_histogram
+    size = _group_size(kernel, queue.device)
+    n = points.shape[0]
+    num_groups = (n + size - 1)//size
+    points = np.ascontiguousarray(points, dtype)
+    tile_bytes = size*points.itemsize*4
+    # Bins in each launch are limited by the local memory left after the
+    # tile, keeping half in reserve for the driver.
+    max_bins = max((queue.device.local_mem_size//2 - tile_bytes)//4, 1)
+    real = dtype.type
+    Pr = np.zeros(nbins, 'd')
+    mf = cl.mem_flags
+    points_b = cl.Buffer(context, mf.READ_ONLY | mf.COPY_HOST_PTR,
+                         hostbuf=points)
+    try:
+        for start in range(0, nbins, max_bins):
+            count = min(max_bins, nbins - start)
+            partial = np.empty((num_groups, count), 'f')
+            partial_b = cl.Buffer(context, mf.WRITE_ONLY, partial.nbytes)
+            try:
+                kernel(queue, [num_groups*size], [size],
+                       np.int32(n), points_b, real(r_lo), real(r_step),
+                       np.int32(start), np.int32(count),
+                       cl.LocalMemory(tile_bytes), cl.LocalMemory(4*count),
+                       partial_b)
+                cl.enqueue_copy(queue, partial, partial_b)
+            finally:
+                partial_b.release()
+            Pr[start:start+count] = np.sum(partial, axis=0, dtype='d')
+    finally:
+        points_b.release()
+    return Pr
+
+
+def _scatter_sum_opencl(q, points, dtype):
+    # type: (np.ndarray, np.ndarray, np.dtype) -> np.ndarray
+    import pyopencl as cl
+    context, queue, program = _opencl_program(dtype)
+    kernel = program.scatter_sum
+    size = _group_size(kernel, queue.device)
+    nq, n = q.shape[0], points.shape[0]
+    q4 = np.zeros((nq, 4), dtype)
+    q4[:, :3] = q
+    points = np.ascontiguousarray(points, dtype)
+    Iq = np.empty(nq, dtype)
+    mf = cl.mem_flags
+    q_b = cl.Buffer(context, mf.READ_ONLY | mf.COPY_HOST_PTR, hostbuf=q4)
+    points_b = cl.Buffer(context, mf.READ_ONLY | mf.COPY_HOST_PTR,
+                         hostbuf=points)
+    Iq_b = cl.Buffer(context, mf.WRITE_ONLY, Iq.nbytes)
+    try:
+        kernel(queue, [((nq + size - 1)//size)*size], [size],
+               np.int32(nq), q_b, np.int32(n), points_b,
+               cl.LocalMemory(size*points.itemsize*4), Iq_b)
+        cl.enqueue_copy(queue, Iq, Iq_b)
+    finally:
+        for buf in (q_b, points_b, Iq_b):
+            buf.release()
+    return np.asarray(Iq, 'd')
+
+
+def _pair_histogram_numpy(points, edges):
+    # type: (np.ndarray, np.ndarray) -> np.ndarray
+    n, nbins = points.shape[0], len(edges) - 1
+    xyz, weight = points[:, :3], points[:, 3]
+    # Bin 0 and bin nbins+1 collect the distances outside the edges.
+    Pr = np.zeros(nbins + 2, 'd')
+    block = max(NUMPY_BLOCK//max(n, 1), 1)
+    for start in range(0, n - 1, block):
+        stop = min(start + block, n)
+        rows = np.arange(start, stop)[:, None]
+        cols = np.arange(start, n)[None, :]
+        distance = np.sqrt(np.sum(
+            (xyz[start:stop, None, :] - xyz[None, start:, :])**2, axis=2))
+        pair = cols > rows
+        index = np.searchsorted(edges, distance[pair], side='right')
+        pair_weight = (weight[start:stop, None]*weight[None, start:])[pair]
+        # Note: indices may be duplicated, so "Pr[index] += w" will not work!!
+        Pr += np.bincount(index, pair_weight, nbins + 2)
+    return Pr[1:-1]
+
+
+def _scatter_sum_numpy(q, points):
+    # type: (np.ndarray, np.ndarray) -> np.ndarray
+    nq, n = q.shape[0], points.shape[0]
+    xyz, weight = points[:, :3], points[:, 3]
+    Iq = np.empty(nq, 'd')
+    block = max(NUMPY_BLOCK//max(n, 1), 1)
+    for start in range(0, nq, block):
+        phase = q[start:start+block] @ xyz.T
+        real, imag = np.cos(phase) @ weight, np.sin(phase) @ weight
+        Iq[start:start+block] = real**2 + imag**2
+    return Iq
+
+
+if njit is not None:
+    @njit(parallel=True, fastmath=True)
+    def _pair_histogram_numba(points, r_lo, r_step, nbins, num_parts):
+        # Each part takes every num_parts-th row so the short rows at the
+        # end of the triangle are spread evenly across the threads.
+        n = points.shape[0]
+        partial = np.zeros((num_parts, nbins))
+        for part in prange(num_parts):
+            for i in range(part, n - 1, num_parts):
+                xi, yi, zi, wi = points[i, 0], points[i, 1], points[i, 2], points[i, 3]
+                for j in range(i + 1, n):
+                    distance = sqrt((xi - points[j, 0])**2
+                                    + (yi - points[j, 1])**2
+                                    + (zi - points[j, 2])**2)
+                    index = int(np.floor((distance - r_lo)/r_step))
+                    if 0 <= index < nbins:
+                        partial[part, index] += wi*points[j, 3]
+        Pr = np.zeros(nbins)
+        for part in range(num_parts):
+            for index in range(nbins):
+                Pr[index] += partial[part, index]
+        return Pr
+
+    @njit(parallel=True, fastmath=True)
+    def _scatter_sum_numba(q, points):
+        nq, n = q.shape[0], points.shape[0]
+        Iq = np.empty(nq)
+        for k in prange(nq):
+            real = imag = 0.
+            for j in range(n):
+                phase = (q[k, 0]*points[j, 0] + q[k, 1]*points[j, 1]
+                         + q[k, 2]*points[j, 2])
+                real += points[j, 3]*np.cos(phase)
+                imag += points[j, 3]*np.sin(phase)
+            Iq[k] = real*real + imag*imag
+        return Iq
+
+
+def _engine(engine):
+    # type: (Optional[str]) -> str
+    """
+    Return the engine to use, which is *engine* if it is given.
+    """
+    if engine is None:
+        from . import kernelcl
+        if kernelcl.use_opencl():
+            engine = "opencl"
+        elif USE_NUMBA:
+            engine = "numba"
+        else:
+            engine = "numpy"
+    if engine == "numba" and njit is None:
+        raise ValueError("numba is not available")
+    if engine not in ("opencl", "numba", "numpy"):
+        raise ValueError("unknown realspace engine %r" % engine)
+    return engine
+
+
+def _pack(rho, points, volume):
+    # type: (np.ndarray, np.ndarray, np.ndarray) -> Tuple[np.ndarray, np.ndarray]
+    """
+    Return the points as rows of (x, y, z, rho*volume) and the volume of
+    each point.
+    """
+    points = np.asarray(points, 'd')
+    npoints = points.shape[0]
+    rho = np.broadcast_to(np.asarray(rho, 'd'), npoints)
+    volume = np.broadcast_to(np.asarray(volume, 'd'), npoints)
+    packed = np.empty((npoints, 4), 'd')
+    packed[:, :3] = points
+    packed[:, 3] = rho*volume
+    return packed, volume
+
+
+def r_bins(q, r_max=None, r_step=None, over_sampling=1):
+    """
+    Return the centers of uniform distance bins from 0 to *r_max*.
+
+    The default *r_max* is $2\\pi/q_\\text{min}$, which is only large enough
+    if the shape is smaller than that; :attr:`Shape.r_max` gives a safe
+    value.  The default *r_step* is $2\\pi/q_\\text{max}$ divided by
+    *over_sampling*.
+    """
+    if r_max is None:
+        r_max = 2 * pi / q[0]
+    if r_step is None:
+        r_step = 2 * pi / q[-1] / over_sampling
+    return np.arange(0.5*r_step, r_max + r_step, r_step)
+
+
+def calc_Pr(r, rho, points, volume=1.0, engine=None, dtype=None):
+    """
+    Return the pair distance histogram $P(r)$ for the bins centered on *r*.
+
+    *points* are three columns (x, y, z), one for each sample in the shape.
+    *rho* (1e-6/Ang) is the scattering length density of each point and
+    *volume* is the volume represented by each point, usually 1/density.
+    Each pair $i < j$ adds $10^{-4} \\rho_i V_i \\rho_j V_j$ to the bin
+    containing its separation, with the bin edges half way between the
+    centers.  Pairs outside the bins are ignored.
+
+    *engine* is 'opencl', 'numba' or 'numpy', with the default as described
+    in the module documentation.  *dtype* is the precision used by the
+    OpenCL engine, which defaults to double if the device supports it.
+    The other engines always use double.  Bins which are not uniform always
+    use numpy.
+    """
+    r = np.asarray(r, 'd')
+    packed, _ = _pack(rho, points, volume)
+    edges = bin_edges(r)
+    step = edges[1] - edges[0]
+    uniform_bins = np.max(np.abs(np.diff(edges) - step)) <= step*1e-6
+    engine = _engine(engine) if uniform_bins else "numpy"
+    if engine == "opencl":
+        Pr = _pair_histogram_opencl(packed, edges[0], step, len(r),
+                                    _opencl_dtype(dtype))
+    elif engine == "numba":
+        num_parts = 4*(os.cpu_count() or 1)
+        Pr = _pair_histogram_numba(packed, edges[0], step, len(r), num_parts)
+    else:
+        Pr = _pair_histogram_numpy(packed, edges)
+    # Note: 1e-4 because (1e-6 rho)^2 = 1e-12 rho^2 time 1e-8 for 1/A to 1/cm
+    return Pr * 1e-4
+
+
+def j0(x):
+    """Spherical Bessel function of order 0, $\\sin x / x$."""
+    # use q/pi since np.sinc = sin(pi x)/(pi x)
+    return np.sinc(x/np.pi)
+
+
+def calc_Iq_from_Pr(q, r, Pr):
+    """
+    Return the pair sum $\\sum_k P(r_k) \\sin(q r_k)/(q r_k)$ for each *q*.
+    """
+    q, r, Pr = (np.asarray(v, 'd') for v in (q, r, Pr))
+    Iq = np.empty(q.shape, 'd')
+    block = max(NUMPY_BLOCK//max(len(r), 1), 1)
+    for start in range(0, q.size, block):
+        qk = q.flat[start:start+block]
+        Iq.flat[start:start+block] = j0(qk[:, None]*r[None, :]) @ Pr
+    return Iq
+
+
+def calc_Iq(q, rho, points, volume=1.0, r=None, over_sampling=20,
+            engine=None, dtype=None):
+    """
+    Return the orientation averaged $I(q)$ for the points from the Debye
+    sum over a histogram of pair distances.
+
+    *rho*, *points* and *volume* are as for :func:`calc_Pr`.  The distance
+    bins *r* default to :func:`r_bins` out to the diagonal of the bounding
+    box of the points.  Binning damps the pair sum by about
+    $(q\\,\\Delta r)^2/24$, which is 0.4% at $q_\\text{max}$ for the
+    default *over_sampling*.
+    """
+    q = np.asarray(q, 'd')
+    packed, volume = _pack(rho, points, volume)
+    if r is None:
+        xyz = packed[:, :3]
+        r_max = np.linalg.norm(np.max(xyz, axis=0) - np.min(xyz, axis=0))
+        r = r_bins(q, r_max=r_max, over_sampling=over_sampling)
+    Pr = calc_Pr(r, packed[:, 3], packed[:, :3], volume=1.0, engine=engine,
+                 dtype=dtype)
+    self_term = 1e-4*np.sum(packed[:, 3]**2)
+    return (self_term + 2*calc_Iq_from_Pr(q, r, Pr))/np.sum(volume)
+
+
+def calc_Iqxy(qx, qy, rho, points, volume=1.0, view=(0, 0, 0),
+              engine=None, dtype=None):
+    """
+    *qx*, *qy* correspond to the detector pixels at which to calculate the
+    scattering, relative to the beam along the negative z axis.
+    *points* are three columns (x, y, z), one for each sample in the shape.
+    *rho* (1e-6/Ang) is the scattering length density of each point.
+    *volume* should be 1/number_density.  That is, each of n particles in the
+    total value represents volume/n contribution to the scattering.
+    *view* rotates the points about the axes using Euler angles for pitch
+    yaw and roll for a beam travelling along the negative z axis.
+    *engine* and *dtype* are as for :func:`calc_Pr`.
+    """
+    qx, qy = np.broadcast_arrays(np.asarray(qx, 'd'), np.asarray(qy, 'd'))
+    q = np.ascontiguousarray(invert_view(qx, qy, view).T)
+    packed, volume = _pack(rho, points, volume)
+    engine = _engine(engine)
+    if engine == "opencl":
+        Iq = _scatter_sum_opencl(q, packed, _opencl_dtype(dtype))
+    elif engine == "numba":
+        Iq = _scatter_sum_numba(q, packed)
+    else:
+        Iq = _scatter_sum_numpy(q, packed)
+    # The scale factor 1e-4 is due to the conversion from rho = 1e-6 squared
+    # times the conversion of 1e-8 from inverse angstroms to inverse cm.
+    return Iq.reshape(qx.shape) * (1e-4 / np.sum(volume))
+
+
+def test_realspace():
+    # type: () -> None
+    """
+    Check the binned sums against the direct sums over the points.
+    """
+    state = np.random.get_state()
+    try:
+        np.random.seed(1)
+        shape = Composite([
+            Box(10, 20, 30, value=2.),
+            EllipticalCylinder(5, 8, 20, value=-1., center=(0, 0, 25)),
+            ])
+        rho, points = shape.sample(density=0.05)
+    finally:
+        np.random.set_state(state)
+    volume = 1/0.05
+    packed, _ = _pack(rho, points, volume)
+    distance = np.linalg.norm(points[:, None, :] - points[None, :, :], axis=2)
+    weight = packed[:, 3][:, None]*packed[:, 3][None, :]
+    upper = np.triu(np.ones(distance.shape, bool), k=1)
+
+    # Pair histogram matches a direct count for uniform and nonuniform bins.
+    r = r_bins([0.01, 0.5], r_max=shape.r_max, over_sampling=4)
+    edges = bin_edges(r)
+    index = np.searchsorted(edges, distance[upper], side='right')
+    target = np.bincount(index, weight[upper], len(r)+2)[1:-1]*1e-4
+    assert np.allclose(calc_Pr(r, rho, points, volume, engine="numpy"),
+                       target)
+    r_log = np.logspace(-1, np.log10(shape.r_max), 50)
+    edges = bin_edges(r_log)
+    index = np.searchsorted(edges, distance[upper], side='right')
+    target = np.bincount(index, weight[upper], len(r_log)+2)[1:-1]*1e-4
+    assert np.allclose(calc_Pr(r_log, rho, points, volume), target)
+
+    # Binned Debye sum is close to the exact Debye sum.
+    q = np.linspace(0.01, 0.2, 20)
+    target = np.array([np.sum(weight*j0(qk*distance)) for qk in q])
+    target *= 1e-4/(volume*len(rho))
+    Iq = calc_Iq(q, rho, points, volume, engine="numpy")
+    assert np.max(abs(Iq - target)/target) < 1e-2
+
+    # Oriented sum matches the direct sum.
+    qx, qy = np.meshgrid(np.linspace(-0.3, 0.3, 7), np.linspace(-0.2, 0.2, 5))
+    view = (30, 20, 10)
+    qa, qb, qc = invert_view(qx, qy, view)
+    phase = np.exp(1j*(np.outer(qa, points[:, 0]) + np.outer(qb, points[:, 1])
+                       + np.outer(qc, points[:, 2])))
+    target = abs(phase @ packed[:, 3])**2*(1e-4/(volume*len(rho)))
+    Iqxy = calc_Iqxy(qx, qy, rho, points, volume, view=view, engine="numpy")
+    assert Iqxy.shape == qx.shape
+    assert np.allclose(Iqxy.flatten(), target)
+    if njit is not None:
+        assert np.allclose(calc_Pr(r, rho, points, volume, engine="numba"),
+                           calc_Pr(r, rho, points, volume, engine="numpy"))
+        assert np.allclose(calc_Iqxy(qx, qy, rho, points, volume, view=view,
+                                     engine="numba").flatten(), target)
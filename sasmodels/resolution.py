@@ -6,15 +6,20 @@ This defines classes for 1D and 2D resolution calculations.
 from __future__ import division
 
 import unittest
+from os.path import getmtime
 
+from scipy import sparse  # type: ignore
 from scipy.special import erf  # type: ignore
 from numpy import sqrt, log, log10, exp, pi  # type: ignore
 import numpy as np  # type: ignore
 
+from . import kernelcache
+
 __all__ = ["Resolution", "Perfect1D", "Pinhole1D", "Slit1D",
            "apply_resolution_matrix", "pinhole_resolution", "slit_resolution",
            "pinhole_extend_q", "slit_extend_q", "bin_edges",
            "interpolate", "linear_extrapolation", "geometric_extrapolation",
+           "adaptive_q_calc",
           ]
 
 MINIMUM_RESOLUTION = 1e-8
@@ -23,6 +28,10 @@ MINIMUM_ABSOLUTE_Q = 0.02  # relative to the minimum q in the data
 # According to simulations with github.com:scattering/sansresolution.git
 # it is better to use asymmetric bounds (2.5, 3.0)
 PINHOLE_N_SIGMA = (2.5, 3.0)
+#: Relative accuracy of the interpolated theory for :func:`adaptive_q_calc`.
+ADAPTIVE_TOLERANCE = 1e-3
+#: Number of times :func:`adaptive_q_calc` can halve the coarse steps.
+ADAPTIVE_LEVELS = 10
 
 class Resolution(object):
     """
@@ -35,11 +44,16 @@ class Resolution(object):
 
     *apply* is the method to call with I(q_calc) to compute the resolution
     smeared theory I(q).
-    
+
+    *weight_matrix* is the matrix *W* of shape (len(q_calc), len(q)) such
+    that *apply(theory)* is *W^T theory*, or None if the resolution is not
+    a simple weighted sum.  Kernels can apply these weights themselves
+    (see :meth:`.kernel.Kernel.set_resolution`).
     """
 
     q = None  # type: np.ndarray
     q_calc = None  # type: np.ndarray
+    weight_matrix = None  # type: Optional[sparse.spmatrix]
     def apply(self, theory):
         """
         Smear *theory* by the resolution function, returning *Iq*.
@@ -85,7 +99,7 @@ class Pinhole1D(Resolution):
         # constructing the weight matrix to avoid division by zero errors.
         # In practice this should never be needed, since resolution should
         # default to Perfect1D if the pinhole geometry is not defined.
-        self.q, self.q_width = q, q_width
+        self.q, self.q_width, self.nsigma = q, q_width, nsigma
         self.q_calc = (pinhole_extend_q(q, q_width, nsigma=nsigma)
                        if q_calc is None else np.sort(q_calc))
 
@@ -106,6 +120,22 @@ class Pinhole1D(Resolution):
     def apply(self, theory):
         return apply_resolution_matrix(self.weight_matrix, theory)
 
+    def adapt(self, theory, tol=ADAPTIVE_TOLERANCE):
+        """
+        Return the resolution on the points from :func:`adaptive_q_calc`
+        for the model *theory(q)*, with steps of at most one *q_width*.
+        """
+        q_width = np.broadcast_to(np.asarray(self.q_width, 'd'), self.q.shape)
+        q_calc = _rule_points(pinhole_extend_q(self.q, q_width, self.nsigma),
+                              self.q)
+        order = np.argsort(self.q)
+        max_step = np.interp(abs(q_calc), self.q[order], q_width[order])
+        q_calc = adaptive_q_calc(q_calc, lambda q: theory(abs(q)), tol=tol,
+                                 max_step=max_step,
+                                 keep=self.q[q_width <= 0.])
+        return Pinhole1D(self.q, self.q_width, q_calc=q_calc,
+                         nsigma=self.nsigma)
+
 
 class Slit1D(Resolution):
     """
@@ -164,12 +194,48 @@ class Slit1D(Resolution):
     def apply(self, theory):
         return apply_resolution_matrix(self.weight_matrix, theory)
 
+    def adapt(self, theory, tol=ADAPTIVE_TOLERANCE):
+        """
+        Return the resolution on the points from :func:`adaptive_q_calc`
+        for the model *theory(q)*, with at least four steps across the
+        range of q integrated for each point.
+        """
+        width = np.broadcast_to(np.asarray(
+            0. if self.q_width is None else self.q_width, 'd'), self.q.shape)
+        length = np.broadcast_to(np.asarray(
+            0. if self.q_length is None else self.q_length, 'd'), self.q.shape)
+        q_calc = _rule_points(slit_extend_q(self.q, width, length), self.q)
+        span = np.maximum(2*width, np.sqrt(self.q**2 + length**2) - self.q)
+        order = np.argsort(self.q)
+        max_step = np.interp(q_calc, self.q[order], 0.25*span[order])
+        q_calc = adaptive_q_calc(q_calc, theory, tol=tol, max_step=max_step,
+                                 keep=self.q[(width <= 0.) & (length <= 0.)])
+        return Slit1D(self.q, q_length=self.q_length, q_width=self.q_width,
+                      q_calc=q_calc)
+
+
+def _rule_points(q_calc, q):
+    """
+    Return the points *q_calc* from the fixed rules which are above the
+    smallest q evaluated by the resolution functions.
+    """
+    q_calc = np.sort(q_calc)
+    return q_calc[abs(q_calc) >= MINIMUM_ABSOLUTE_Q*np.min(q)]
+
 
 def apply_resolution_matrix(weight_matrix, theory):
     """
     Apply the resolution weight matrix to the computed theory function.
+
+    *weight_matrix* has shape (len(q_calc), len(q)) and may be either a
+    dense array or a scipy sparse matrix such as those returned by
+    :func:`pinhole_resolution` and :func:`slit_resolution`.
     """
     #print("apply shapes", theory.shape, weight_matrix.shape)
+    if sparse.issparse(weight_matrix):
+        # The transpose of the CSC weight matrix is in CSR format, so this
+        # is a sparse matrix-vector product over the non-zero weights.
+        return np.asarray(weight_matrix.T.dot(np.asarray(theory))).flatten()
     Iq = np.dot(theory[None, :], weight_matrix)
     #print("result shape",Iq.shape)
     return Iq.flatten()
@@ -191,6 +257,12 @@ def pinhole_resolution(q_calc, q, q_width, nsigma=PINHOLE_N_SIGMA):
 
     *q_calc* must be increasing.  *q_width* must be greater than zero.
 
+    The weights are returned as a sparse matrix in CSC format with shape
+    (len(q_calc), len(q)).  Only the points within the limits contribute
+    to each column, so the storage and the cost of applying the weights
+    grow with the number of points times the width of the resolution
+    rather than with the product of the number of points.
+
     [1] Barker, J. G., and J. S. Pedersen. 1995. Instrumental Smearing Effects
     in Radially Symmetric Small-Angle Neutron Scattering by Numerical and
     Analytical Methods. Journal of Applied Crystallography 28 (2): 105--14.
@@ -200,8 +272,8 @@ def pinhole_resolution(q_calc, q, q_width, nsigma=PINHOLE_N_SIGMA):
     # neither trapezoid nor Simpson's rule improved the accuracy.
     edges = bin_edges(q_calc)
     #edges[edges < 0.0] = 0.0 # clip edges below zero
-    cdf = erf((edges[:, None] - q[None, :]) / (sqrt(2.0)*q_width)[None, :])
-    weights = cdf[1:] - cdf[:-1]
+    q = np.asarray(q, 'd')
+    q_width = np.broadcast_to(np.asarray(q_width, 'd'), q.shape)
     # Limit q range to (-2.5,+3) sigma
     try:
         nsigma_low, nsigma_high = nsigma
@@ -210,10 +282,22 @@ def pinhole_resolution(q_calc, q, q_width, nsigma=PINHOLE_N_SIGMA):
     qhigh = q + nsigma_high*q_width
     qlow = q - nsigma_low*q_width  # linear limits
     ##qlow = q*q/qhigh  # log limits
-    weights[q_calc[:, None] < qlow[None, :]] = 0.
-    weights[q_calc[:, None] > qhigh[None, :]] = 0.
-    weights /= np.sum(weights, axis=0)[None, :]
-    return weights
+    # Since q_calc is sorted the points qlow <= q_calc <= qhigh for each
+    # q form a contiguous band from start to stop.  List the (row, column)
+    # pairs for all bands, with the bands stored one after the other.
+    start = np.searchsorted(q_calc, qlow, side='left')
+    stop = np.searchsorted(q_calc, qhigh, side='right')
+    counts = np.maximum(stop - start, 0)
+    band_offset = np.cumsum(counts) - counts
+    cols = np.repeat(np.arange(len(q)), counts)
+    rows = (np.arange(counts.sum()) - np.repeat(band_offset, counts)
+            + np.repeat(start, counts))
+    scale = sqrt(2.0)*q_width[cols]
+    weights = (erf((edges[rows+1] - q[cols])/scale)
+               - erf((edges[rows] - q[cols])/scale))
+    weights /= np.bincount(cols, weights, minlength=len(q))[cols]
+    return sparse.csc_matrix((weights, (rows, cols)),
+                             shape=(len(q_calc), len(q)))
 
 
 def slit_resolution(q_calc, q, width, length, n_length=30):
@@ -337,52 +421,123 @@ def slit_resolution(q_calc, q, width, length, n_length=30):
             \sum_{k=-L}^L \Delta u_{jk}
                 \left(\frac{\Delta q_\parallel}{2 L + 1}\right)
 
+    The weights are returned as a sparse matrix in CSC format with shape
+    (len(q_calc), len(q)), as for :func:`pinhole_resolution`.  They are
+    kept in the :mod:`.kernelcache` directory keyed by *q_calc*, *q*,
+    *width*, *length* and *n_length*, so repeated fits to data with the
+    same slit geometry don't have to rebuild them.
 
     """
 
-    # np.set_printoptions(precision=6, linewidth=10000)
+    q_calc, q = np.asarray(q_calc, 'd'), np.asarray(q, 'd')
+    width = np.broadcast_to(np.asarray(width, 'd'), q.shape)
+    length = np.broadcast_to(np.asarray(length, 'd'), q.shape)
+    shape = (len(q_calc), len(q))
+    path = kernelcache.cache_path("slit", [repr(n_length)] + [
+        v.tobytes().hex() for v in (q_calc, q, width, length)])
+    cached = kernelcache.load_binaries(path, getmtime(__file__))
+    if cached is not None:
+        data, indices, indptr = (np.frombuffer(v, t).copy() for v, t in
+                                 zip(cached, ('d', 'i8', 'i8')))
+        return sparse.csc_matrix((data, indices, indptr), shape=shape)
+    weights = _slit_weights(q_calc, q, width, length, n_length)
+    kernelcache.save_binaries(path, [
+        weights.data.tobytes(), weights.indices.astype('i8').tobytes(),
+        weights.indptr.astype('i8').tobytes()])
+    return weights
 
-    # The current algorithm is a midpoint rectangle rule.
-    q_edges = bin_edges(q_calc) # Note: requires q > 0
-    # q_edges[q_edges < 0.0] = 0.0 # clip edges below zero
-    weights = np.zeros((len(q), len(q_calc)), 'd')
 
-    #print(q_calc)
-    for i, (qi, w, l) in enumerate(zip(q, width, length)):
-        if w == 0. and l == 0.:
-            # Perfect resolution, so return the theory value directly.
-            # Note: assumes that q is a subset of q_calc.  If qi need not be
-            # in q_calc, then we can do a weighted interpolation by looking
-            # up qi in q_calc, then weighting the result by the relative
-            # distance to the neighbouring points.
-            weights[i, :] = (q_calc == qi)
-        elif l == 0:
-            weights[i, :] = _q_perp_weights(q_edges, qi, w)
-        elif w == 0:
-            in_x = 1.0 * ((q_calc >= qi-l) & (q_calc <= qi+l))
-            abs_x = 1.0*(q_calc < abs(qi - l)) if qi < l else 0.
-            #print(qi - l, qi + l)
-            #print(in_x + abs_x)
-            weights[i, :] = (in_x + abs_x) * np.diff(q_edges) / (2*l)
-        else:
-            for k in range(-n_length, n_length+1):
-                weights[i, :] += _q_perp_weights(q_edges, qi+k*l/n_length, w)
-            weights[i, :] /= 2*n_length + 1
+def _slit_weights(q_calc, q, width, length, n_length):
+    """
+    Return the weight matrix for :func:`slit_resolution`.
 
-    return weights.T
+    The weights for all *q* are computed together.  Each point only sees
+    the bins of *q_calc* within its integration limits, which are found by
+    bisection on the bin edges, so the work is proportional to the number
+    of non-zero weights rather than to *len(q) x len(q_calc)*.
+    """
+    # The current algorithm is a midpoint rectangle rule.
+    q_edges = bin_edges(q_calc) # Note: requires q > 0
+    rows, cols, values = [], [], []
+    def _add(index, owner, weights):
+        keep = weights != 0.
+        rows.append(index[keep])
+        cols.append(owner[keep])
+        values.append(weights[keep])
+
+    # Perfect resolution, so return the theory value directly.
+    # Note: assumes that q is a subset of q_calc.  If qi need not be
+    # in q_calc, then we can do a weighted interpolation by looking
+    # up qi in q_calc, then weighting the result by the relative
+    # distance to the neighbouring points.
+    point = np.flatnonzero((width == 0.) & (length == 0.))
+    qi = q[point]
+    index, owner = _ranges(np.searchsorted(q_calc, qi, 'left'),
+                           np.searchsorted(q_calc, qi, 'right'))
+    _add(index, point[owner], np.ones(len(index)))
+
+    # Slit width only.
+    point = np.flatnonzero((width != 0.) & (length == 0.))
+    index, owner, weights = _q_perp_weights(q_edges, q[point], width[point])
+    _add(index, point[owner], weights)
+
+    # Slit length only, with the bins for q_calc in [qi-l, qi+l] and, if
+    # qi < l, those for q_calc < l-qi which are reflected about 0.
+    point = np.flatnonzero((width == 0.) & (length != 0.))
+    qi, l = q[point], length[point]
+    in_x = _ranges(np.searchsorted(q_calc, qi-l, 'left'),
+                   np.searchsorted(q_calc, qi+l, 'right'))
+    abs_x = _ranges(np.zeros(len(qi), int),
+                    np.where(qi < l, np.searchsorted(q_calc, l-qi, 'left'), 0))
+    dq = np.diff(q_edges)
+    for index, owner in (in_x, abs_x):
+        _add(index, point[owner], dq[index]/(2*l[owner]))
+
+    # Both width and length, integrating the width at 2*n_length+1 steps
+    # across the length.  Repeated entries are summed by csc_matrix.
+    point = np.flatnonzero((width != 0.) & (length != 0.))
+    k = np.arange(-n_length, n_length+1)
+    qk = (q[point][:, None] + k[None, :]*length[point][:, None]/n_length)
+    wk = np.repeat(width[point], len(k))
+    index, owner, weights = _q_perp_weights(q_edges, qk.ravel(), wk)
+    _add(index, point[owner//len(k)], weights/(2*n_length + 1))
+
+    return sparse.csc_matrix(
+        (np.hstack(values), (np.hstack(rows), np.hstack(cols))),
+        shape=(len(q_calc), len(q)))
+
+
+def _ranges(start, stop):
+    """
+    Return *(index, owner)* listing *start[k] <= index < stop[k]* for each
+    *k*, with *owner* set to *k* for each index.
+    """
+    counts = np.maximum(stop - start, 0)
+    owner = np.repeat(np.arange(len(counts)), counts)
+    offset = np.arange(len(owner)) - np.repeat(np.cumsum(counts) - counts, counts)
+    return np.repeat(start, counts) + offset, owner
 
 
 def _q_perp_weights(q_edges, qi, w):
-    # Convert bin edges from q to u
+    """
+    Return *(index, owner, weights)* for the integral over the slit width
+    *w[k]* at each *qi[k]*, with the bins from the edges between *|qi|* and
+    *sqrt(qi^2 + w^2)*.
+    """
     u_limit = np.sqrt(qi**2 + w**2)
-    u_edges = q_edges**2 - qi**2
-    u_edges[q_edges < abs(qi)] = 0.
-    u_edges[q_edges > u_limit] = u_limit**2 - qi**2
-    weights = np.diff(np.sqrt(u_edges))/w
-    #print("i, qi",i,qi,qi+width)
-    #print(q_calc)
-    #print(weights)
-    return weights
+    nbins = len(q_edges) - 1
+    start = np.clip(np.searchsorted(q_edges, abs(qi), 'right') - 1, 0, nbins)
+    stop = np.clip(np.searchsorted(q_edges, u_limit, 'left'), 0, nbins)
+    index, owner = _ranges(start, stop)
+    qk, uk = qi[owner], u_limit[owner]
+    # Convert bin edges from q to u
+    def _u(edges):
+        u_edges = edges**2 - qk**2
+        u_edges[edges < abs(qk)] = 0.
+        u_edges[edges > uk] = uk[edges > uk]**2 - qk[edges > uk]**2
+        return np.sqrt(u_edges)
+    weights = (_u(q_edges[index+1]) - _u(q_edges[index]))/w[owner]
+    return index, owner, weights
 
 
 def pinhole_extend_q(q, q_width, nsigma=PINHOLE_N_SIGMA):
@@ -530,6 +685,67 @@ def geometric_extrapolation(q, q_min, q_max, points_per_decade=None):
     return np.concatenate([q_low, q, q_high])
 
 
+def adaptive_q_calc(q_calc, theory, tol=ADAPTIVE_TOLERANCE, max_step=np.inf,
+                    keep=(), coarse=4, levels=ADAPTIVE_LEVELS):
+    """
+    Return the points at which to evaluate *theory* over the range of
+    *q_calc* so that it can be interpolated to within *tol*.
+
+    *q_calc* are the points chosen by fixed rules such as
+    :func:`pinhole_extend_q`.  Starting from every *coarse* point of
+    *q_calc*, a step is halved if the theory at its mid-point differs from
+    the line between its ends by more than *tol* relative to the largest
+    of the three values.  The difference is a quarter of the second
+    difference, so the steps are refined where the second derivative of
+    the theory is large, such as near the minima of a form factor, and
+    left coarse where the theory is flat.  Each step is halved at most
+    *levels* times.
+
+    *max_step* is the largest step at each point of *q_calc*, such as the
+    width of the resolution, so that every smeared point has enough
+    support.  Steps are never forced below the spacing of *q_calc* itself.
+    Points in *keep*, such as data points with perfect resolution, are
+    always included.
+
+    *theory(q)* returns the unsmeared model at the points *q*.  It is
+    called once for the coarse points and once for the mid-points at
+    each level, so each level is one kernel call for all of its steps.
+    The points suit the model parameters used by *theory*, and should be
+    recomputed if the parameters move far enough to shift the features
+    of the model.
+    """
+    q_calc = np.sort(np.asarray(q_calc, 'd'))
+    if len(q_calc) < 2:
+        return q_calc
+    spacing = np.diff(q_calc)
+    spacing = np.hstack((spacing, spacing[-1:]))
+    max_step = np.maximum(np.broadcast_to(max_step, q_calc.shape), spacing)
+    points = np.union1d(q_calc[::coarse], q_calc[-1:])
+    if len(keep):
+        points = np.union1d(points, np.asarray(keep, 'd'))
+    values = np.asarray(theory(points), 'd')
+    low, high = points[:-1], points[1:]
+    low_value, high_value = values[:-1], values[1:]
+    refined = [points]
+    for _ in range(levels):
+        mid = 0.5*(low + high)
+        mid_value = np.asarray(theory(mid), 'd')
+        scale = np.maximum(np.maximum(abs(low_value), abs(high_value)),
+                           abs(mid_value))
+        error = abs(mid_value - 0.5*(low_value + high_value))
+        split = ((high - low > np.interp(mid, q_calc, max_step))
+                 | (error > tol*scale))
+        if not split.any():
+            break
+        refined.append(mid[split])
+        low, high = (np.hstack((low[split], mid[split])),
+                     np.hstack((mid[split], high[split])))
+        low_value, high_value = (
+            np.hstack((low_value[split], mid_value[split])),
+            np.hstack((mid_value[split], high_value[split])))
+    return np.unique(np.hstack(refined))
+
+
 ############################################################################
 # unit tests
 ############################################################################
@@ -727,6 +943,25 @@ class ResolutionTest(unittest.TestCase):
             ]
         np.testing.assert_allclose(output, answer, atol=1e-4)
 
+    def test_slit_cache(self):
+        """
+        Slit weights reloaded from the cache match the computed weights.
+        """
+        import shutil
+        import tempfile
+        q = np.logspace(-4, -1, 40)
+        saved = kernelcache.SAS_KERNEL_CACHE
+        kernelcache.SAS_KERNEL_CACHE = tempfile.mkdtemp()
+        try:
+            first = Slit1D(q, q_length=0.002, q_width=0.0005).weight_matrix
+            second = Slit1D(q, q_length=0.002, q_width=0.0005).weight_matrix
+            other = Slit1D(q, q_length=0.003, q_width=0.0005).weight_matrix
+        finally:
+            shutil.rmtree(kernelcache.SAS_KERNEL_CACHE, ignore_errors=True)
+            kernelcache.SAS_KERNEL_CACHE = saved
+        np.testing.assert_equal(second.toarray(), first.toarray())
+        assert (other != first).nnz > 0
+
     def test_pinhole_zero(self):
         """
         Pinhole smearing with perfect resolution
@@ -736,6 +971,52 @@ class ResolutionTest(unittest.TestCase):
         output = resolution.apply(theory)
         np.testing.assert_equal(output, self.y)
 
+    def test_pinhole_sparse(self):
+        """
+        Sparse pinhole weights match the dense calculation
+        """
+        q = np.logspace(-3, -1, 50)
+        q_width = 0.05*q
+        q_calc = pinhole_extend_q(q, q_width)
+        weights = pinhole_resolution(q_calc, q, q_width)
+        edges = bin_edges(q_calc)
+        cdf = erf((edges[:, None] - q[None, :]) / (sqrt(2.0)*q_width)[None, :])
+        dense = cdf[1:] - cdf[:-1]
+        dense[q_calc[:, None] < (q - 2.5*q_width)[None, :]] = 0.
+        dense[q_calc[:, None] > (q + 3.0*q_width)[None, :]] = 0.
+        dense /= np.sum(dense, axis=0)[None, :]
+        np.testing.assert_allclose(weights.toarray(), dense, rtol=1e-12)
+        theory = self.Iq(q_calc)
+        np.testing.assert_allclose(
+            apply_resolution_matrix(weights, theory),
+            apply_resolution_matrix(dense, theory), rtol=1e-12)
+
+    def test_adaptive(self):
+        """
+        Adaptive points follow the minima of the form factor, use fewer
+        points than the fixed rules and keep the smeared theory accurate.
+        """
+        def sphere(q, radius=100.):
+            qr = q*radius
+            return (3*(np.sin(qr) - qr*np.cos(qr))/qr**3)**2
+        q = np.logspace(-3, -0.5, 400)
+        q_width = 0.05*q
+        fixed = Pinhole1D(q, q_width)
+        adaptive = fixed.adapt(sphere, tol=1e-4)
+        assert len(adaptive.q_calc) < len(fixed.q_calc)
+        exact = Pinhole1D(q, q_width, q_calc=interpolate(
+            fixed.q_calc, 0.02*np.min(q_width)))
+        target = exact.apply(sphere(exact.q_calc))
+        np.testing.assert_allclose(
+            adaptive.apply(sphere(adaptive.q_calc)), target, rtol=1e-2)
+
+        slit = Slit1D(q, q_length=np.where(q < 0.003, 0., 0.01), q_width=0.)
+        adaptive = slit.adapt(sphere, tol=1e-4)
+        assert np.all(np.isin(q[q < 0.003], adaptive.q_calc))
+        np.testing.assert_allclose(
+            adaptive.apply(sphere(adaptive.q_calc)),
+            slit.apply(sphere(slit.q_calc)), rtol=1e-2)
+
     # TODO: turn pinhole/slit demos into tests
 
     @unittest.skip("suppress comparison with old version; pinhole calc changed")
@@ -6,8 +6,12 @@
 """
 from __future__ import division
 
+from collections import OrderedDict
+import hashlib
+
 import numpy as np  # type: ignore
 from numpy import pi, cos, sin, sqrt  # type: ignore
+from scipy import sparse  # type: ignore
 
 from . import resolution
 from .resolution import Resolution
@@ -21,15 +25,56 @@ NSIGMA = 3.0
 NR = {'xhigh':10, 'high':5, 'med':5, 'low':3}
 NPHI = {'xhigh':20, 'high':12, 'med':6, 'low':4}
 
+## Expanded q grids and weights for Pinhole2D, shared between instances
+## with the same detector geometry, resolution and accuracy.  The oldest
+## entries are dropped when there are more than GRID_CACHE_SIZE of them.
+GRID_CACHE = OrderedDict()  # type: OrderedDict
+GRID_CACHE_SIZE = 8
+
 ## Defaults
 N_SLIT_PERP = {'xhigh':1000, 'high':500, 'med':200, 'low':50}
 N_SLIT_PERP_DOC = ", ".join("%s=%d"%(name, value)
                             for value, name in
                             sorted((2*v+1, k) for k, v in N_SLIT_PERP.items()))
 
+def fold_q(qx, qy):
+    """
+    Fold the points *qx*, *qy* into a distinct set, returning
+    *(qx_fold, qy_fold, unfold)* such that the theory at the original
+    points is *theory_fold[unfold]*.
+
+    Without magnetism the theory is unchanged by inversion through the
+    origin, I(-qx, -qy) = I(qx, qy), so each point is replaced by the one
+    of the pair with qx > 0, or qx = 0 and qy >= 0, before removing the
+    points which repeat.  On a detector with the beam near the centre this
+    keeps about half of the points.
+    """
+    flip = (qx < 0) | ((qx == 0) & (qy < 0))
+    # Adding zero turns -0 into 0 so that the two compare equal as rows.
+    points = np.column_stack((np.where(flip, -qx, qx),
+                              np.where(flip, -qy, qy))) + 0.
+    unique, unfold = np.unique(points, axis=0, return_inverse=True)
+    return (np.ascontiguousarray(unique[:, 0]),
+            np.ascontiguousarray(unique[:, 1]), unfold.ravel())
+
+def fold_weights(weight_matrix, unfold, size):
+    """
+    Return the resolution *weight_matrix* for the *size* points returned
+    by :func:`fold_q`, with the rows for points which fold together summed.
+    """
+    fold = sparse.csr_matrix(
+        (np.ones(len(unfold)), (unfold, np.arange(len(unfold)))),
+        shape=(size, len(unfold)))
+    return sparse.csc_matrix(fold.dot(weight_matrix))
+
+
 class Pinhole2D(Resolution):
     """
     Gaussian Q smearing class for SAS 2d data
+
+    The expanded q grid is kept in :data:`GRID_CACHE` so that calculators
+    for data with the same detector geometry, resolution and accuracy share
+    it rather than building it again.
     """
 
     def __init__(self, data=None, index=None,
@@ -73,14 +118,14 @@ class Pinhole2D(Resolution):
         dqy = getattr(data, 'dqy_data', None)
         if dqx is not None and dqy is not None:
             # Here dqx and dqy mean dq_parr and dq_perp
-            self.dqx_data = dqx[self.index]
-            self.dqy_data = dqy[self.index]
-            ## Remove singular points if exists
-            self.dqx_data[self.dqx_data < SIGMA_ZERO] = SIGMA_ZERO
-            self.dqy_data[self.dqy_data < SIGMA_ZERO] = SIGMA_ZERO
-            qx_calc, qy_calc, weights = self._calc_res()
+            ## Remove singular points if exists.  This makes new arrays, so
+            ## the data is not changed when index is a slice.
+            self.dqx_data = np.maximum(dqx[self.index], SIGMA_ZERO)
+            self.dqy_data = np.maximum(dqy[self.index], SIGMA_ZERO)
+            qx_calc, qy_calc, weights, weight_matrix = self._cached_res()
             self.q_calc = [qx_calc, qy_calc]
             self.q_calc_weights = weights
+            self.weight_matrix = weight_matrix
         else:
             # No resolution information
             self.dqx_data = self.dqy_data = None
@@ -89,65 +134,86 @@ class Pinhole2D(Resolution):
 
         #self.phi_data = np.arctan(self.qx_data / self.qy_data)
 
+    def _cached_res(self):
+        """
+        Return the expanded q grid, the bin weights and the weight matrix,
+        reusing them from :data:`GRID_CACHE` if the same detector geometry,
+        resolution and accuracy has been seen before.
+
+        The returned arrays are shared between instances so they are marked
+        read-only.
+        """
+        digest = hashlib.sha1()
+        for v in (self.qx_data, self.qy_data, self.dqx_data, self.dqy_data):
+            v = np.ascontiguousarray(v, 'd')
+            digest.update(str(v.shape).encode('ascii'))
+            digest.update(v.tobytes())
+        digest.update(("%d %d %r %s" % (self.nr, self.nphi, self.nsigma,
+                                        self.coords)).encode('ascii'))
+        key = digest.hexdigest()
+        if key in GRID_CACHE:
+            GRID_CACHE.move_to_end(key)
+            return GRID_CACHE[key]
+
+        qx_calc, qy_calc, weights = self._calc_res()
+        # Point i is the weighted average of q_calc[b*nq + i] over the
+        # bins b, which as a matrix is one weight per calculated point.
+        nq, nbins = len(self.qx_data), len(weights)
+        weight_matrix = sparse.csc_matrix(
+            (np.repeat(weights/np.sum(weights), nq),
+             (np.arange(nbins*nq), np.tile(np.arange(nq), nbins))),
+            shape=(nbins*nq, nq))
+        for v in (qx_calc, qy_calc, weights):
+            v.setflags(write=False)
+        GRID_CACHE[key] = qx_calc, qy_calc, weights, weight_matrix
+        while len(GRID_CACHE) > GRID_CACHE_SIZE:
+            GRID_CACHE.popitem(last=False)
+        return GRID_CACHE[key]
+
     def _calc_res(self):
         """
         Over sampling of r_nbins times phi_nbins, calculate Gaussian weights,
         then find smeared intensity
         """
         nr, nphi = self.nr, self.nphi
-        # Total number of bins = # of bins
-        nbins = nr * nphi
         # Number of bins in the dqr direction (polar coordinate of dqx and dqy)
         bin_size = self.nsigma / nr
-        # in dq_r-direction times # of bins in dq_phi-direction
-        # data length in the range of self.index
-        nq = len(self.qx_data)
 
-        # Mean values of dqr at each bins
-        # starting from the half of bin size
+        # The bins are ordered by angle then by radius.  Each array below
+        # has one row per bin and one column per data point, so that the
+        # flattened values are the data points for the first bin, followed
+        # by those for the second bin, etc.
+        # Mean values of dqr at each bins starting from the half of bin size,
+        # and mean values of qphi at each bin.
         r = bin_size / 2.0 + np.arange(nr) * bin_size
-        # mean values of qphi at each bines
-        phi = np.arange(nphi)
-        dphi = phi * 2.0 * pi / nphi
-        dphi = dphi.repeat(nr)
-
-        ## Transform to polar coordinate,
-        #  and set dphi at each data points ; 1d array
-        dphi = dphi.repeat(nq)
-        q_phi = self.qy_data / self.qx_data
+        dr = np.tile(r, nphi)[:, None]
+        dphi = np.repeat(np.arange(nphi) * 2.0 * pi / nphi, nr)[:, None]
 
-        # Starting angle is different between polar
-        #  and cartesian coordinates.
-        #if self.coords != 'polar':
-        #    dphi += np.arctan( q_phi * self.dqx_data/ \
-        #                  self.dqy_data).repeat(nbins).reshape(nq,\
-        #                                nbins).transpose().flatten()
-
-        # The angle (phi) of the original q point
-        q_phi = np.arctan(q_phi).repeat(nbins)\
-            .reshape([nq, nbins]).transpose().flatten()
         ## Find Gaussian weight for each dq bins: The weight depends only
         #  on r-direction (The integration may not need)
         weight_res = (np.exp(-0.5 * (r - bin_size / 2.0)**2)  -
                       np.exp(-0.5 * (r + bin_size / 2.0)**2))
         # No needs of normalization here.
         #weight_res /= np.sum(weight_res)
-        weight_res = weight_res.repeat(nphi).reshape(nr, nphi)
-        weight_res = weight_res.transpose().flatten()
+        weight_res = np.tile(weight_res, nphi)
 
-        ## Set dr for all dq bins for averaging
-        dr = r.repeat(nphi).reshape(nr, nphi).transpose().flatten()
         ## Set dqr for all data points
-        dqx = np.outer(dr, self.dqx_data).flatten()
-        dqy = np.outer(dr, self.dqy_data).flatten()
+        dqx = dr * self.dqx_data[None, :]
+        dqy = dr * self.dqy_data[None, :]
+        qx = self.qx_data[None, :]
+        qy = self.qy_data[None, :]
 
-        qx = self.qx_data.repeat(nbins)\
-            .reshape(nq, nbins).transpose().flatten()
-        qy = self.qy_data.repeat(nbins)\
-            .reshape(nq, nbins).transpose().flatten()
+        # Starting angle is different between polar
+        #  and cartesian coordinates.
+        #if self.coords != 'polar':
+        #    dphi += np.arctan( q_phi * self.dqx_data/ \
+        #                  self.dqy_data).repeat(nbins).reshape(nq,\
+        #                                nbins).transpose().flatten()
 
-        # The polar needs rotation by -q_phi
+        # The polar needs rotation by -q_phi, the angle of the original
+        # q point.
         if self.coords == 'polar':
+            q_phi = np.arctan(qy / qx)
             q_r = sqrt(qx**2 + qy**2)
             qx_res = ((dqx*cos(dphi) + q_r) * cos(-q_phi)
                       + dqy*sin(dphi) * sin(-q_phi))
@@ -158,7 +224,7 @@ class Pinhole2D(Resolution):
             qy_res = qy + dqy*sin(dphi)
 
 
-        return qx_res, qy_res, weight_res
+        return qx_res.flatten(), qy_res.flatten(), weight_res
 
     def apply(self, theory):
         if self.q_calc_weights is not None:
@@ -29,7 +29,8 @@ from . import product
 from . import generate
 from . import weights
 from . import modelinfo
-from .details import make_kernel_args, dispersion_mesh
+from . import modelindex
+from .details import make_kernel_args, dispersion_mesh, flatten_mesh
 
 # Hack: load in any custom distributions
 # Uses ~/.sasview/weights/*.py unless SASMODELS_WEIGHTS is set in the environ.
@@ -42,7 +43,7 @@ try:
                         List, Optional, Union, Callable)
     from types import ModuleType
     from .modelinfo import ModelInfo, Parameter
-    from .kernel import KernelModel
+    from .kernel import KernelModel, Kernel
     MultiplicityInfoType = NamedTuple(
         'MultiplicityInfo',
         [("number", int), ("control", str), ("choices", List[str]),
@@ -74,6 +75,8 @@ MODEL_BY_PATH = {}  # type: Dict[str, SasviewModelType]
 #: Track modules that we have loaded so we can determine whether the model
 #: has changed since we last reloaded.
 _CACHED_MODULE = {}  # type: Dict[str, ModuleType]
+#: Number of q vector sets for which each model class keeps its kernel.
+KERNEL_CACHE_SIZE = 4
 
 def reset_environment():
     # type: () -> None
@@ -85,6 +88,7 @@ def reset_environment():
     """
     kernelcl.reset_environment()
     for model in MODELS.values():
+        model._release_kernels()
         model._model = None
 
 def find_model(modelname):
@@ -111,12 +115,24 @@ def load_standard_models():
 
     If there is an error loading a model, then a traceback is logged and the
     model is not returned.
+
+    The model classes are built from the :mod:`.modelindex` entries, so the
+    model modules are only imported when a model is first created.  Set
+    *SAS_MODEL_INDEX=0* to import them all here instead.
     """
-    for name in core.list_models():
-        try:
-            MODELS[name] = _make_standard_model(name)
-        except Exception:
-            logger.error(traceback.format_exc())
+    names = core.list_models()
+    if modelindex.USE_INDEX:
+        for name, summary in modelindex.summaries(names).items():
+            try:
+                MODELS[name] = _make_indexed_model(summary)
+            except Exception:
+                logger.error(traceback.format_exc())
+    else:
+        for name in names:
+            try:
+                MODELS[name] = _make_standard_model(name)
+            except Exception:
+                logger.error(traceback.format_exc())
     if SUPPORT_OLD_STYLE_PLUGINS:
         _register_old_models()
 
@@ -205,6 +221,39 @@ def _make_standard_model(name):
     return make_model_from_info(model_info)
 
 
+class _LazyModelInfo(object):
+    """
+    Class attribute which imports the model and replaces itself with the
+    model info on first access.
+    """
+    def __init__(self, name):
+        # type: (str) -> None
+        self.name = name
+
+    def __get__(self, instance, owner):
+        # type: (Any, type) -> ModelInfo
+        kernel_module = generate.load_kernel_module(self.name)
+        model_info = modelinfo.make_model_info(kernel_module)
+        owner._model_info = model_info
+        return model_info
+
+
+def _make_indexed_model(summary):
+    # type: (modelindex.ModelSummary) -> SasviewModelType
+    """
+    Build the sasview model class from the index *summary* of a standard
+    model, delaying the import of the model until it is needed.
+    """
+    def __init__(self, multiplicity=None):
+        SasviewModel.__init__(self, multiplicity=multiplicity)
+    attrs = _generate_model_attributes(summary)
+    attrs['_model_info'] = _LazyModelInfo(summary.id)
+    attrs['__init__'] = __init__
+    attrs['filename'] = summary.filename
+    ConstructedModel = type(summary.name, (SasviewModel,), attrs) # type: SasviewModelType
+    return ConstructedModel
+
+
 def _register_old_models():
     # type: () -> None
     """
@@ -376,6 +425,10 @@ class SasviewModel(object):
     multiplicity = None     # type: Optional[int]
     #: memory for polydispersity array if using ArrayDispersion (used by sasview).
     _persistency_dict = None # type: Dict[str, Tuple[np.ndarray, np.ndarray]]
+    #: (state, weights) for the most recent parameters and dispersion
+    _weights_cache = None # type: Tuple[Tuple, List[Tuple[float, np.ndarray, np.ndarray]]]
+    #: (state, info, dtype, kernel args) for the most recent call
+    _args_cache = None    # type: Tuple[Tuple, ModelInfo, np.dtype, Tuple[Any, np.ndarray, bool]]
 
     def __init__(self, multiplicity=None):
         # type: (Optional[int]) -> None
@@ -646,6 +699,29 @@ class SasviewModel(object):
             raise TypeError("evalDistribution expects q or [qx, qy], not %r"
                             % type(qdist))
 
+    def evalDistributions(self, qdists):
+        # type: (Sequence[Union[np.ndarray, Tuple[np.ndarray, np.ndarray]]]) -> List[np.ndarray]
+        """
+        Evaluate several distributions of q-values with the current
+        parameters, returning a list with I(q) for each.
+
+        Each item of *qdists* is either *q* or *[qx, qy]* as accepted by
+        :meth:`evalDistribution`, and all must be the same kind.  The
+        distributions are joined and evaluated in one kernel call, which
+        is faster than separate calls when the pieces are small, such as
+        the q values above and below the fitting range.
+        """
+        if not qdists:
+            return []
+        is2d = [isinstance(qdist, (list, tuple)) for qdist in qdists]
+        if any(is2d) and not all(is2d):
+            raise TypeError("evalDistributions needs all q or all [qx, qy]")
+        q_inputs = [list(qdist) if is2d[0] else [qdist] for qdist in qdists]
+        with calculation_lock:
+            result, _ = self._evaluate(q_inputs)
+        sizes = [np.size(q_input[0]) for q_input in q_inputs]
+        return np.split(result, np.cumsum(sizes)[:-1])
+
     def calc_composition_models(self, qx):
         """
         returns parts of the composition model or None if not a composition
@@ -713,26 +789,23 @@ class SasviewModel(object):
             return self._calculate_Iq(qx, qy)
 
     def _calculate_Iq(self, qx, qy=None):
+        return self._evaluate([[qx] if qy is None else [qx, qy]])
+
+    def _evaluate(self, q_inputs):
+        # type: (List[List[np.ndarray]]) -> Tuple[np.ndarray, Callable[[], collections.OrderedDict[str, np.ndarray]]]
+        """
+        Evaluate the model on the q vectors in *q_inputs*, joined end to
+        end.  Each item is [q] or [qx, qy].
+        """
         if self._model is None:
             # Only need one copy of the compiled kernel regardless of how many
             # times it is used, so store it in the class.  Also, to reset the
             # compute engine, need to clear out all existing compiled kernels,
             # which is much easier to do if we store them in the class.
             self.__class__._model = core.build_model(self._model_info)
-        if qy is not None:
-            q_vectors = [np.asarray(qx), np.asarray(qy)]
-        else:
-            q_vectors = [np.asarray(qx)]
-        calculator = self._model.make_kernel(q_vectors)
-        parameters = self._model_info.parameters
-        pairs = [self._get_weights(p) for p in parameters.call_parameters]
-        #weights.plot_weights(self._model_info, pairs)
-        call_details, values, is_magnetic = make_kernel_args(calculator, pairs)
+        calculator, cached = self._get_kernel(q_inputs)
+        call_details, values, is_magnetic = self._kernel_args(calculator)
         #call_details.show()
-        #print("================ parameters ==================")
-        #for p, v in zip(parameters.call_parameters, pairs): print(p.name, v[0])
-        #for k, p in enumerate(self._model_info.parameters.call_parameters):
-        #    print(k, p.name, *pairs[k])
         #print("params", self.params)
         #print("values", values)
         #print("is_mag", is_magnetic)
@@ -742,11 +815,116 @@ class SasviewModel(object):
                                lambda: collections.OrderedDict())
         #print("result", result)
 
-        calculator.release()
+        if not cached:
+            calculator.release()
         #self._model.release()
 
         return result, lazy_results
 
+    def _get_kernel(self, q_inputs):
+        # type: (List[List[np.ndarray]]) -> Tuple[Kernel, bool]
+        """
+        Return the kernel for *q_inputs* and whether it is kept in the cache.
+
+        The GUI evaluates the same data over and over as the parameters
+        change, so the kernels for the last few sets of q arrays are kept
+        on the class, along with their copy of q on the device and their
+        result buffers.  Arrays are matched by identity, and then by value
+        in case they were changed in place.  Inputs which are not arrays,
+        such as the single points from :meth:`run`, are not cached.
+        """
+        vectors = [v for q_input in q_inputs for v in q_input]
+        if len(q_inputs) == 1:
+            q_vectors = [np.asarray(v) for v in q_inputs[0]]
+        else:
+            q_vectors = [np.hstack([np.asarray(q_input[k]).flatten()
+                                    for q_input in q_inputs])
+                         for k in range(len(q_inputs[0]))]
+        if not all(isinstance(v, np.ndarray) for v in vectors):
+            return self._model.make_kernel(q_vectors), False
+
+        cls = self.__class__
+        if '_kernels' not in cls.__dict__:
+            cls._kernels = collections.OrderedDict()
+        kernels = cls._kernels
+        key = tuple(id(v) for v in vectors)
+        entry = kernels.pop(key, None)
+        if entry is not None:
+            model, _, saved, kernel = entry
+            if (model is self._model
+                    and all(np.array_equal(a, b)
+                            for a, b in zip(saved, vectors))):
+                kernels[key] = entry
+                return kernel, True
+            kernel.release()
+        kernel = self._model.make_kernel(q_vectors)
+        # Keep the arrays alive so that their ids are not reused, along
+        # with a copy to detect changes.
+        kernels[key] = (self._model, vectors, [v.copy() for v in vectors],
+                        kernel)
+        while len(kernels) > KERNEL_CACHE_SIZE:
+            kernels.popitem(last=False)[1][3].release()
+        return kernel, True
+
+    @classmethod
+    def _release_kernels(cls):
+        # type: () -> None
+        """
+        Release the kernels cached by :meth:`_get_kernel`.
+        """
+        kernels = cls.__dict__.get('_kernels', None)
+        while kernels:
+            kernels.popitem()[1][3].release()
+
+    def _state(self):
+        # type: () -> Tuple
+        """
+        Return a hashable snapshot of the parameters and dispersion.
+        """
+        state = [self.multiplicity, tuple(self.params.items())]
+        for name, dis in self.dispersion.items():
+            for field, value in sorted(dis.items()):
+                if isinstance(value, (np.ndarray, list, tuple)):
+                    value = np.asarray(value, 'd').tobytes()
+                state.append((name, field, value))
+        return tuple(state)
+
+    def _call_weights(self, state=None):
+        # type: (Optional[Tuple]) -> List[Tuple[float, np.ndarray, np.ndarray]]
+        """
+        Return (value, dispersity, weight) for each call parameter, reusing
+        the previous result if the parameters and dispersion are unchanged.
+        """
+        if state is None:
+            state = self._state()
+        if self._weights_cache is None or self._weights_cache[0] != state:
+            parameters = self._model_info.parameters
+            pairs = [self._get_weights(p) for p in parameters.call_parameters]
+            #weights.plot_weights(self._model_info, pairs)
+            self._weights_cache = (state, pairs)
+        return self._weights_cache[1]
+
+    def _kernel_args(self, calculator):
+        # type: (Kernel) -> Tuple[Any, np.ndarray, bool]
+        """
+        Return the call details, values and magnetic flag for *calculator*
+        with the current parameters, reusing the previous result if the
+        parameters and dispersion are unchanged.
+        """
+        state = (self._state(), self.cutoff)
+        cached = self._args_cache
+        if (cached is not None and cached[0] == state
+                and cached[1] is calculator.info
+                and cached[2] == calculator.dtype):
+            return cached[3]
+        pairs = self._call_weights(state[0])
+        call_details, values, is_magnetic = make_kernel_args(calculator, pairs)
+        if calculator.supports_flat:
+            call_details, values = flatten_mesh(call_details, values,
+                                                self.cutoff)
+        args = call_details, values, is_magnetic
+        self._args_cache = (state, calculator.info, calculator.dtype, args)
+        return args
 
     def calculate_ER(self, mode=1):
         # type: (int) -> float
@@ -825,8 +1003,8 @@ class SasviewModel(object):
         and w is a vector containing the products for weights for each
         parameter set in the vector.
         """
-        pars = [self._get_weights(p)
-                for p in self._model_info.parameters.call_parameters
+        call_parameters = self._model_info.parameters.call_parameters
+        pars = [pair for p, pair in zip(call_parameters, self._call_weights())
                 if p.type == 'volume']
         return dispersion_mesh(self._model_info, pars)
 
@@ -923,6 +1101,38 @@ def test_empty_distribution():
     Iq = cylinder.evalDistribution(np.asarray([0.1]))
     assert Iq[0] == 0., "empty distribution fails"
 
+def test_evaluation_cache():
+    # type: () -> None
+    """
+    Check that cached kernels and weights track changes to q and parameters.
+    """
+    Cylinder = _make_standard_model('cylinder')
+    cylinder = Cylinder()
+    cylinder.setParam('radius_pd', 0.1)
+    q = np.linspace(0.001, 0.5, 50)
+    first = cylinder.evalDistribution(q)
+    kernel = cylinder._get_kernel([[q]])[0]
+    # The cache holds q itself so that its id can't be reused.
+    assert Cylinder._kernels[(id(q),)][1][0] is q
+    assert cylinder.evalDistribution(q) is not first
+    assert np.array_equal(cylinder.evalDistribution(q), first)
+    assert cylinder._get_kernel([[q]])[0] is kernel
+    cylinder.setParam('radius', 30.)
+    changed = cylinder.evalDistribution(q)
+    assert not np.array_equal(changed, first)
+    q[:] *= 2
+    assert not np.array_equal(cylinder.evalDistribution(q), changed)
+    assert cylinder._get_kernel([[q]])[0] is not kernel
+    q[:] /= 2
+
+    # Several distributions in one call match separate calls.
+    qx, qy = np.linspace(-0.1, 0.1, 7), np.linspace(0.1, -0.1, 7)
+    parts = cylinder.evalDistributions([q[:10], q[10:]])
+    assert np.allclose(np.hstack(parts), changed, rtol=1e-13)
+    [part2d] = cylinder.evalDistributions([[qx, qy]])
+    assert np.allclose(part2d, cylinder.evalDistribution([qx, qy]))
+    Cylinder._release_kernels()
+
 def test_model_list():
     # type: () -> None
     """
@@ -0,0 +1,199 @@
+"""
+Model selection
+===============
+
+Automated analysis often fits a list of candidate models to each new
+dataset and ranks them by how well they fit.  With a separate
+:class:`.direct_model.DirectModel` for each candidate, the data is
+interpreted, the resolution is built and the q vectors are copied to the
+compute engine once per model.  :class:`ModelSelection` does these once
+for the dataset: each candidate gets a calculator from
+:meth:`.direct_model.DirectModel.with_model`, which shares the resolution
+of the first, and a :class:`.direct_model.SharedInputs` registry gives
+all models of the same engine and precision one copy of the q vectors.
+
+The candidates are loaded and fit in a pool of threads.  The kernels run
+outside the Python interpreter lock, so fits on the CPU use separate cores
+while the OpenCL and CUDA kernels share the devices in the pool.  Each fit
+is a Levenberg-Marquardt fit from :class:`.series.SeriesFit`, and the
+ranking so far is passed to the callback as each one completes.
+
+Example::
+
+    from sasmodels.data import load_data
+    from sasmodels.selection import ModelSelection
+
+    data = load_data("sample.dat")
+    selection = ModelSelection(data, ["sphere", "cylinder", "ellipsoid"])
+    for result in selection.rank():
+        print(result)
+"""
+from __future__ import print_function, division
+
+import os
+from concurrent.futures import ThreadPoolExecutor, as_completed
+from time import perf_counter
+
+import numpy as np  # type: ignore
+
+from .core import load_model
+from .direct_model import DirectModel, SharedInputs
+from .series import SeriesFit
+
+# pylint: disable=unused-import
+try:
+    from typing import Any, Callable, Dict, List, Optional, Sequence, Union
+    from .data import Data
+    from .kernel import KernelModel
+    from .modelinfo import ModelInfo
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Parameters fitted for every candidate unless *fitted* says otherwise.
+#: The scalar volume parameters of each model are fitted as well.
+DEFAULT_FITTED = ("scale", "background")
+
+
+class SelectionResult(object):
+    """
+    Fit of one candidate model.
+
+    *name* is the model name and *chisq* is the normalized chi^2 of the
+    fit, or inf if it failed with *error*.  *fit* is the
+    :class:`.series.SeriesResult`, with the fitted parameters in
+    *fit.pars*, and *time* is the wall clock time for loading and fitting
+    the model in seconds.
+    """
+    def __init__(self, name, fit=None, error=None, time=0.):
+        # type: (str, Any, Optional[Exception], float) -> None
+        self.name = name
+        self.fit = fit
+        self.error = error
+        self.chisq = fit.chisq if fit is not None else np.inf
+        self.time = time
+
+    def __repr__(self):
+        # type: () -> str
+        if self.error is not None:
+            return "SelectionResult(%r, error=%r)" % (self.name, self.error)
+        return "SelectionResult(%r, chisq=%g)" % (self.name, self.chisq)
+
+
+class ModelSelection(object):
+    """
+    Fit every model in *models* to *data* and rank them by chi^2.
+
+    *models* holds model names, which are loaded with *dtype* and
+    *platform* as for :func:`.core.load_model`, or models which are
+    already loaded.  *pars* maps model names to the starting values for
+    that model, with the model defaults for the rest, and *fitted* maps
+    model names to the parameters to fit, which defaults to
+    :data:`DEFAULT_FITTED` and the scalar volume parameters.
+
+    *workers* is the number of candidates fit at the same time, which
+    defaults to the number of cores.  *max_steps* limits the number of
+    steps in each fit.
+    """
+    def __init__(self, data, models, pars=None, fitted=None, dtype=None,
+                 platform="ocl", cutoff=1e-5, workers=None, max_steps=50):
+        # type: (Data, Sequence[Union[str, KernelModel]], Optional[Dict[str, Dict[str, float]]], Optional[Dict[str, Sequence[str]]], Optional[str], str, float, Optional[int], int) -> None
+        self.models = list(models)
+        self.pars = dict(pars) if pars is not None else {}
+        self.fitted = dict(fitted) if fitted is not None else {}
+        self.dtype = dtype
+        self.platform = platform
+        self.cutoff = cutoff
+        self.workers = workers if workers else (os.cpu_count() or 1)
+        self.max_steps = max_steps
+        # The data is interpreted once, without a model, and each candidate
+        # gets a copy of this calculator with its own model.
+        self._template = DirectModel(data, None, cutoff=cutoff)
+        measured = (data.data if self._template.data_type == 'Iqxy'
+                    else data.y)
+        if measured is None:
+            raise ValueError("model selection needs measured data")
+        self._measured = measured
+
+    def rank(self, callback=None):
+        # type: (Optional[Callable[[List[SelectionResult]], None]]) -> List[SelectionResult]
+        """
+        Fit the candidates and return their results from best to worst,
+        with failed fits last.  *callback(ranking)* is called with the
+        ranking of the completed fits as each one finishes.
+        """
+        inputs = SharedInputs()
+        ranking = []  # type: List[SelectionResult]
+        try:
+            workers = max(1, min(self.workers, len(self.models)))
+            with ThreadPoolExecutor(max_workers=workers) as pool:
+                futures = [pool.submit(self._fit, model, inputs)
+                           for model in self.models]
+                for future in as_completed(futures):
+                    ranking.append(future.result())
+                    ranking.sort(key=lambda r: (r.error is not None, r.chisq))
+                    if callback is not None:
+                        callback(list(ranking))
+        finally:
+            inputs.release()
+        return ranking
+
+    def _fit(self, model, inputs):
+        # type: (Union[str, KernelModel], SharedInputs) -> SelectionResult
+        # pylint: disable=protected-access
+        start = perf_counter()
+        name = model if isinstance(model, str) else model.info.id
+        loaded = isinstance(model, str)
+        calculator = None
+        try:
+            if loaded:
+                model = load_model(model, dtype=self.dtype,
+                                   platform=self.platform)
+            calculator = self._template.with_model(model, inputs)
+            fitted = self.fitted.get(name, None)
+            if fitted is None:
+                fitted = list(DEFAULT_FITTED) + _volume_parameters(model.info)
+            series = SeriesFit(None, model, self.pars.get(name, {}), fitted,
+                               cutoff=self.cutoff, batch=1,
+                               calculator=calculator)
+            fit = series.fit([self._measured], max_steps=self.max_steps)[0]
+            return SelectionResult(name, fit=fit, time=perf_counter() - start)
+        except Exception as exc:
+            return SelectionResult(name, error=exc,
+                                   time=perf_counter() - start)
+        finally:
+            if calculator is not None:
+                calculator._release_kernel()
+            if loaded and not isinstance(model, str):
+                model.release()
+
+
+def _volume_parameters(info):
+    # type: (ModelInfo) -> List[str]
+    return [p.name for p in info.parameters.kernel_parameters
+            if p.type == 'volume' and p.length == 1]
+
+
+def test_model_selection():
+    # type: () -> None
+    """
+    Check that the model used to simulate the data ranks first.
+    """
+    from .data import empty_data1D
+
+    data = empty_data1D(np.logspace(-3, -0.5, 80))
+    truth = DirectModel(data, load_model('sphere', dtype='double',
+                                         platform='dll'))
+    data.y = truth(radius=42., scale=0.02, background=0.1)
+    data.dy = 0.01*data.y
+    rankings = []
+    selection = ModelSelection(
+        data, ['cylinder', 'sphere', 'lamellar'],
+        pars={'sphere': {'radius': 38.}}, dtype='double', platform='dll',
+        workers=2)
+    ranking = selection.rank(callback=rankings.append)
+    assert [len(r) for r in rankings] == [1, 2, 3]
+    assert ranking[0].name == 'sphere', ranking
+    assert ranking[0].error is None
+    assert abs(ranking[0].fit.pars['radius'] - 42.) < 1e-3*42.
+    assert ranking[0].chisq < ranking[1].chisq
@@ -0,0 +1,300 @@
+"""
+Series fits
+===========
+
+Kinetic experiments, such as stopped-flow or rheo-SANS measurements, record
+hundreds of frames on the same q grid, each fit with the same model.  With
+a new :class:`.direct_model.DirectModel` or :class:`.bumps_model.Experiment`
+for each frame, building the kernel and the resolution costs more than the
+fit.  :class:`SeriesFit` builds them once for a template dataset and only
+swaps the measured values between frames.
+
+The frames are fit in blocks of *batch* frames, each starting from the
+best fit to the last frame of the previous block.  The frames in a block
+are fit together with Levenberg-Marquardt, so each step evaluates the
+model and its forward difference derivatives for every frame in the block
+with a single batch call to the kernel (see
+:func:`.direct_model.call_kernel_batch`).  The theory is linear in *scale*
+and *background*, so their derivatives don't need the kernel.
+
+Example::
+
+    from sasmodels.core import load_model
+    from sasmodels.data import load_frames
+    from sasmodels.series import SeriesFit
+
+    stack = load_frames("run42.h5")
+    series = SeriesFit(stack[0], load_model("sphere"),
+                       pars={"radius": 50, "scale": 0.01},
+                       fitted=["radius", "scale", "background"])
+    results = series.fit(stack.frames, stack.err_frames)
+    radius = [r.pars["radius"] for r in results]
+"""
+from __future__ import print_function, division
+
+import numpy as np  # type: ignore
+
+from .direct_model import DirectModel
+
+# pylint: disable=unused-import
+try:
+    from typing import (Callable, Dict, Iterable, List, Optional, Sequence,
+                        Tuple)
+    from .data import Data
+    from .kernel import KernelModel
+    from .modelinfo import ModelInfo
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+
+class SeriesResult(object):
+    """
+    Fit to one frame of a series.
+
+    *pars* has the values of all the parameters, with the fitted ones
+    replaced by their best values, and *dpars* has the uncertainty in each
+    fitted parameter from the curvature of chi^2.  *chisq* is the
+    normalized chi^2, *steps* is the number of Levenberg-Marquardt steps
+    and *converged* is False if the fit stopped at the step limit.
+    """
+    def __init__(self, pars, dpars, chisq, steps, converged):
+        # type: (Dict[str, float], Dict[str, float], float, int, bool) -> None
+        self.pars = pars
+        self.dpars = dpars
+        self.chisq = chisq
+        self.steps = steps
+        self.converged = converged
+
+    def __repr__(self):
+        # type: () -> str
+        return "SeriesResult(chisq=%g, steps=%d)" % (self.chisq, self.steps)
+
+
+class SeriesFit(object):
+    """
+    Fit frames measured on the grid of *data* with *model*.
+
+    *data* is the template dataset.  Its q values, resolution and mask are
+    used for every frame, and its measured values are ignored.  *pars* are
+    the starting values for the first block of frames, with model defaults
+    for the rest, and *fitted* names the parameters to fit.  *bounds* maps
+    fitted parameter names to *(low, high)*, and defaults to the limits in
+    the model definition.
+
+    *batch* is the number of frames fit together, and *step* is the
+    relative step for the derivatives.  *calculator* is a
+    :class:`.direct_model.DirectModel` for *data* and *model* to use rather
+    than building a new one.
+    """
+    def __init__(self, data, model, pars, fitted, bounds=None, cutoff=1e-5,
+                 batch=8, step=1e-6, calculator=None):
+        # type: (Data, KernelModel, Dict[str, float], Sequence[str], Optional[Dict[str, Tuple[float, float]]], float, int, float, Optional[DirectModel]) -> None
+        self.calculator = (calculator if calculator is not None
+                           else DirectModel(data, model, cutoff=cutoff))
+        self.pars = dict(pars)
+        self.fitted = list(fitted)
+        bounds = bounds if bounds is not None else {}
+        self.bounds = np.array([bounds.get(name, _limits(model.info, name))
+                                for name in self.fitted], 'd')
+        self.batch = batch
+        self.step = step
+        self.cutoff = cutoff
+
+    def fit(self, frames, errors=None, max_steps=50, ftol=1e-8, callback=None):
+        # type: (Iterable[np.ndarray], Optional[Iterable[np.ndarray]], int, float, Optional[Callable[[int, SeriesResult], None]]) -> List[SeriesResult]
+        """
+        Fit each of the *frames*, returning a list of :class:`SeriesResult`.
+
+        The frames, and the *errors* if given, have the shape of the
+        template data.  Each row of a :class:`.data.Data2DFrames` will do,
+        so the frames are read one block at a time.  With no *errors*, the
+        uncertainty in the template data is used.
+
+        A fit stops when chi^2 improves by less than *ftol* relative to its
+        value, or after *max_steps* steps.  *callback(k, result)* is called
+        as each frame *k* completes.
+        """
+        index = self.calculator.index
+        default_error = self.calculator.dIq
+        if errors is None and default_error is None:
+            raise ValueError("need frame errors if the template has none")
+        errors = iter(errors) if errors is not None else None
+        start = np.array([self._value(name) for name in self.fitted], 'd')
+        results = []  # type: List[SeriesResult]
+        block = []  # type: List[Tuple[np.ndarray, np.ndarray]]
+        for frame in frames:
+            y = np.reshape(frame, -1)[index]
+            dy = (np.reshape(next(errors), -1)[index] if errors is not None
+                  else default_error)
+            block.append((y, dy))
+            if len(block) == self.batch:
+                start = self._fit_block(block, start, max_steps, ftol,
+                                        results, callback)
+                block = []
+        if block:
+            self._fit_block(block, start, max_steps, ftol, results, callback)
+        return results
+
+    def _value(self, name):
+        # type: (str) -> float
+        if name in self.pars:
+            return self.pars[name]
+        if name.endswith('_pd'):
+            return 0.
+        return self.calculator.model.info.parameters[name].default
+
+    def _state(self, values):
+        # type: (np.ndarray) -> Dict[str, float]
+        pars = dict(self.pars)
+        pars.update(zip(self.fitted, values))
+        return pars
+
+    def _theory(self, points):
+        # type: (List[np.ndarray]) -> List[np.ndarray]
+        return self.calculator._calc_theory_batch(
+            [self._state(p) for p in points], cutoff=self.cutoff)
+
+    def _fit_block(self, block, start, max_steps, ftol, results, callback):
+        # type: (List[Tuple[np.ndarray, np.ndarray]], np.ndarray, int, float, List[SeriesResult], Optional[Callable[[int, SeriesResult], None]]) -> np.ndarray
+        """
+        Fit the frames in *block* from *start*, appending to *results*.
+        Returns the best fit to the last frame.
+        """
+        num = len(block)
+        # Points which are missing from a frame get zero weight.
+        w = [np.where(np.isfinite(v) & (dv > 0), 1/np.where(dv > 0, dv, 1), 0)
+             for v, dv in block]
+        y = [np.where(wk > 0, v, 0.) for (v, _), wk in zip(block, w)]
+        p = [start.copy() for _ in range(num)]
+        chisq = [_chisq(t, yk, wk) for t, yk, wk in zip(self._theory(p), y, w)]
+        lam = [1e-3]*num
+        steps = [0]*num
+        J = [None]*num  # type: List[Optional[np.ndarray]]
+        active = list(range(num))
+        while active:
+            # Theory and derivatives at the current point for all active
+            # frames, from one batch call.
+            columns = [_steps(self.fitted, p[k], self.step) for k in active]
+            points = []
+            for k, cols in zip(active, columns):
+                points.append(p[k])
+                points.extend(point for _, point, h in cols if h is not None)
+            theory = iter(self._theory(points))
+            trials = []
+            for k, cols in zip(active, columns):
+                base = next(theory)
+                pars = self._state(p[k])
+                derivs = [(next(theory) - base)/h if h is not None
+                          else _linear_derivative(name, base, pars)
+                          for name, _, h in cols]
+                J[k] = np.array(derivs).T*w[k][:, None]
+                alpha = J[k].T.dot(J[k])
+                beta = J[k].T.dot((y[k] - base)*w[k])
+                try:
+                    delta = np.linalg.solve(
+                        alpha + lam[k]*np.diag(np.diag(alpha)), beta)
+                except np.linalg.LinAlgError:
+                    delta = np.zeros_like(beta)
+                trials.append(np.clip(p[k] + delta, self.bounds[:, 0],
+                                      self.bounds[:, 1]))
+
+            # Evaluate the steps for all active frames in one batch call.
+            remaining = []
+            for k, trial, t in zip(active, trials, self._theory(trials)):
+                steps[k] += 1
+                trial_chisq = _chisq(t, y[k], w[k])
+                improvement = chisq[k] - trial_chisq
+                if improvement >= 0:
+                    p[k], chisq[k] = trial, trial_chisq
+                    lam[k] = max(lam[k]/10, 1e-12)
+                else:
+                    lam[k] = min(lam[k]*10, 1e12)
+                done = (0 <= improvement <= ftol*chisq[k]
+                        or lam[k] >= 1e12 or steps[k] >= max_steps)
+                if not done:
+                    remaining.append(k)
+            active = remaining
+
+        for k in range(num):
+            dof = max(np.count_nonzero(w[k]) - len(self.fitted), 1)
+            reduced = chisq[k]/dof
+            try:
+                cov = np.linalg.inv(J[k].T.dot(J[k]))*reduced
+                dp = np.sqrt(np.abs(np.diag(cov)))
+            except np.linalg.LinAlgError:
+                dp = np.full(len(self.fitted), np.inf)
+            result = SeriesResult(
+                pars=self._state(p[k]), dpars=dict(zip(self.fitted, dp)),
+                chisq=reduced, steps=steps[k],
+                converged=steps[k] < max_steps)
+            results.append(result)
+            if callback is not None:
+                callback(len(results) - 1, result)
+        return p[-1]
+
+
+def _chisq(theory, y, w):
+    # type: (np.ndarray, np.ndarray, np.ndarray) -> float
+    return float(np.sum(((y - theory)*w)**2))
+
+
+def _steps(names, values, step):
+    # type: (List[str], np.ndarray, float) -> List[Tuple[str, np.ndarray, Optional[float]]]
+    """
+    Return *(name, point, h)* for the derivative with respect to each
+    parameter, where *point* is *values* stepped by *h*.  *h* is None for
+    *scale* and *background*, which don't need the kernel.
+    """
+    cols = []
+    for j, name in enumerate(names):
+        if name in ('scale', 'background') and (name != 'scale' or values[j]):
+            cols.append((name, values, None))
+            continue
+        h = step*abs(values[j]) if values[j] != 0. else step
+        point = values.copy()
+        point[j] += h
+        cols.append((name, point, h))
+    return cols
+
+
+def _linear_derivative(name, theory, pars):
+    # type: (str, np.ndarray, Dict[str, float]) -> np.ndarray
+    background = pars.get('background', 0.)
+    if name == 'background':
+        return np.ones_like(theory)
+    return (theory - background)/pars['scale']
+
+
+def _limits(info, name):
+    # type: (ModelInfo, str) -> Tuple[float, float]
+    """
+    Return the fitting limits for *name* from the model definition.
+    """
+    if name.endswith('_pd'):
+        return (0., np.inf)
+    return tuple(info.parameters[name].limits)
+
+
+def test_series_fit():
+    # type: () -> None
+    """
+    Check that a series of simulated frames is recovered.
+    """
+    from .core import load_model
+    from .data import empty_data1D
+
+    data = empty_data1D(np.logspace(-3, -0.5, 80))
+    model = load_model('sphere', dtype='double')
+    truth = DirectModel(data, model)
+    radius = np.linspace(40., 46., 11)
+    frames = [truth(radius=r, scale=0.02, background=0.1) for r in radius]
+    errors = [0.01*f for f in frames]
+    series = SeriesFit(data, model, pars={'radius': 38., 'scale': 0.015},
+                       fitted=['radius', 'scale', 'background'], batch=4)
+    results = series.fit(frames, errors)
+    assert len(results) == len(radius)
+    for r, result in zip(radius, results):
+        assert abs(result.pars['radius'] - r) < 1e-4*r, (r, result.pars)
+        assert abs(result.pars['scale'] - 0.02) < 1e-4*0.02
+        assert result.converged
@@ -11,9 +11,30 @@ Wim Bouwman (w.g.bouwman@tudelft.nl), June 2013
 
 from __future__ import division
 
+import os
+from os.path import getmtime
+
 import numpy as np  # type: ignore
 from numpy import pi  # type: ignore
 from scipy.special import j0
+try:
+    from scipy.fft import fht, fhtoffset
+except ImportError:  # scipy < 1.7
+    fht = fhtoffset = None
+
+from . import kernelcache
+
+# pylint: disable=unused-import
+try:
+    from typing import List, Tuple
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Default transform method, "dense" or "fht".  Set *SAS_SESANS_FHT=1* to
+#: use the fast Hankel transform when scipy provides it.
+DEFAULT_METHOD = ("fht" if os.environ.get("SAS_SESANS_FHT", "0") not in ("", "0")
+                  else "dense")
 
 
 class SesansTransform(object):
@@ -29,6 +50,14 @@ class SesansTransform(object):
 
     *Rmax* (A) is the maximum size sensitivity; larger radius requires more
     computation time.
+
+    *method* is "dense" to form the Hankel matrix over *q_calc* and
+    *SElength*, or "fht" to use the FFTLog fast Hankel transform on the
+    log-spaced *q_calc* followed by interpolation in $\log \delta$.  The
+    fast transform needs memory proportional to *q_calc* alone rather than
+    *q_calc* times *SElength*.  The default comes from *SAS_SESANS_FHT*.
+    The dense matrix is kept in the :mod:`.kernelcache` directory keyed by
+    the transform inputs so later sessions can reload it.
     """
     #: SElength from the data in the original data units; not used by transform
     #: but the GUI uses it, so make sure that it is present.
@@ -41,25 +70,40 @@ class SesansTransform(object):
     _H = None   # type: np.ndarray
     _H0 = None  # type: np.ndarray
 
-    def __init__(self, z, SElength, lam, zaccept, Rmax, log_spacing=1.0003):
-        # type: (np.ndarray, float, float, float, float, float) -> None
+    # fast transform: (mask, columns) for each group of spin echo lengths
+    # sharing the same acceptance mask
+    _groups = None  # type: List[Tuple[np.ndarray, np.ndarray]]
+
+    def __init__(self, z, SElength, lam, zaccept, Rmax, log_spacing=1.0003,
+                 method=None):
+        # type: (np.ndarray, float, float, float, float, float, str) -> None
         self.q = z
         self.log_spacing = log_spacing
-        self._set_hankel(SElength, lam, zaccept, Rmax)
+        self.method = DEFAULT_METHOD if method is None else method
+        if self.method not in ("dense", "fht"):
+            raise ValueError("unknown SESANS transform method %r" % method)
+        if self.method == "fht" and fht is None:
+            self.method = "dense"
+        if self.method == "fht":
+            self._set_fht(SElength, lam, zaccept)
+        else:
+            self._set_hankel(SElength, lam, zaccept, Rmax)
 
     def apply(self, Iq):
         # type: (np.ndarray) -> np.ndarray
         """
         Apply the SESANS transform to the computed I(q).
         """
+        if self.method == "fht":
+            return self._apply_fht(Iq)
         G0 = np.dot(self._H0, Iq)
         G = np.dot(self._H.T, Iq)
         P = G - G0
         return P
 
-    def _set_hankel(self, SElength, lam, zaccept, Rmax):
-        # type: (np.ndarray, float, float, float) -> None
-        SElength = np.asarray(SElength)
+    @staticmethod
+    def _q_range(SElength):
+        # type: (np.ndarray) -> Tuple[float, float]
         if len(SElength) == 1:
             # TODO: Do we care that this fails for xi = 0?
             q_min, q_max = 0.01 * 2*pi/SElength[-1], 10*2*pi / SElength[0]
@@ -68,6 +112,94 @@ class SesansTransform(object):
             # TODO: Why does q_max depend on the correlation step size?
             q_min = 0.1 * 2*pi / (np.size(SElength) * SElength[-1])
             q_max = 2*pi / (SElength[1] - SElength[0])
+        return q_min, q_max
+
+    @staticmethod
+    def _acceptance(q, lam, zaccept):
+        # type: (np.ndarray, np.ndarray, float) -> np.ndarray
+        # Return the mask of rejected q for each wavelength.
+        reptheta = np.outer(q, lam/(2*pi))
+        # Note: Using inplace update with reptheta => arcsin(reptheta).
+        # When q L / 2 pi > 1 that means wavelength is too large to
+        # reach that q value at any angle. These should produce theta = NaN
+        # without any warnings.
+        with np.errstate(invalid='ignore'):
+            np.arcsin(reptheta, out=reptheta)
+        # Reverse the condition to protect against NaN. We can't use
+        # theta > zaccept since all comparisons with NaN return False.
+        return ~(reptheta <= zaccept)
+
+    def _set_fht(self, SElength, lam, zaccept):
+        # type: (np.ndarray, float, float) -> None
+        # The SESANS correlation is
+        #     G(d) = 1/(2 pi) int q J0(q d) I(q) dq = A(d) / (2 pi d)
+        # with A(d) = int a(q) J0(q d) d dq the order 0 Hankel transform
+        # computed by scipy.fft.fht for a(q) = q I(q) on the log q grid.
+        # The output lands on the reciprocal log grid in d, which is
+        # interpolated at the measured spin echo lengths.  G0 uses the same
+        # log space quadrature, dq = q dln, so that P = G - G0 is consistent.
+        SElength = np.asarray(SElength, 'd')
+        q_min, q_max = self._q_range(SElength)
+        dln = np.log(self.log_spacing)
+        q = np.exp(np.arange(np.log(q_min), np.log(q_max), dln))
+        offset = fhtoffset(dln, mu=0)
+        q_c = np.exp(0.5*(np.log(q[0]) + np.log(q[-1])))
+        index = np.arange(len(q)) - (len(q)-1)/2
+        self._delta_log = np.log(np.exp(offset)/q_c) + index*dln
+        self._dln, self._offset = dln, offset
+
+        # Group the spin echo lengths by acceptance mask so that one
+        # transform serves all wavelengths which accept the same q.
+        lam = np.broadcast_to(np.asarray(lam, 'd'), SElength.shape)
+        groups = {}
+        for k, lam_k in enumerate(lam):
+            mask = self._acceptance(q, np.array([lam_k]), zaccept)[:, 0]
+            groups.setdefault(mask.tobytes(), (mask, []))[1].append(k)
+        self._groups = [(~mask, np.array(columns))
+                        for mask, columns in groups.values()]
+        self._SElength = SElength
+
+        self.q_calc = q
+        self._H0 = dln/(2*pi) * q**2
+
+    def _apply_fht(self, Iq):
+        # type: (np.ndarray) -> np.ndarray
+        q, SElength = self.q_calc, self._SElength
+        G = np.empty(SElength.shape)
+        a = q*Iq
+        for accept, columns in self._groups:
+            A = fht(a*accept, self._dln, mu=0, offset=self._offset)
+            G_grid = A/(2*pi*np.exp(self._delta_log))
+            d = SElength[columns]
+            with np.errstate(divide='ignore'):
+                G[columns] = np.interp(np.log(d), self._delta_log, G_grid)
+            # J0(0) = 1 so G(0) is the masked integral of q I(q)
+            G[columns[d == 0]] = np.dot(self._H0, Iq*accept)
+        G0 = np.dot(self._H0, Iq)
+        return G - G0
+
+    def _set_hankel(self, SElength, lam, zaccept, Rmax):
+        # type: (np.ndarray, float, float, float) -> None
+        SElength = np.asarray(SElength)
+        path = kernelcache.cache_path("hankel", [
+            repr(self.log_spacing), repr(zaccept), repr(Rmax),
+            np.asarray(SElength, 'd').tobytes().hex(),
+            np.asarray(lam, 'd').tobytes().hex(),
+            ])
+        cached = kernelcache.load_binaries(path, getmtime(__file__))
+        if cached is not None:
+            q, H0, H = (np.frombuffer(v, 'd') for v in cached)
+            self.q_calc = q
+            self._H0, self._H = H0, H.reshape(len(q), -1)
+            return
+        q, H0, H = self._hankel_matrix(SElength, lam, zaccept)
+        kernelcache.save_binaries(path, [q.tobytes(), H0.tobytes(), H.tobytes()])
+        self.q_calc = q
+        self._H, self._H0 = H, H0
+
+    def _hankel_matrix(self, SElength, lam, zaccept):
+        # type: (np.ndarray, float, float) -> Tuple[np.ndarray, np.ndarray, np.ndarray]
+        q_min, q_max = self._q_range(SElength)
         #print("Hankel xi, Qmin, Qmax", SElength[0], q_min, q_max, len(SElength))
         q = np.exp(np.arange(np.log(q_min), np.log(q_max),
                              np.log(self.log_spacing)))
@@ -82,18 +214,35 @@ class SesansTransform(object):
         j0(H, out=H)
         H *= (dq * q / (2*pi)).reshape((-1, 1))
 
-        reptheta = np.outer(q, lam/(2*pi))
-        # Note: Using inplace update with reptheta => arcsin(reptheta).
-        # When q L / 2 pi > 1 that means wavelength is too large to
-        # reach that q value at any angle. These should produce theta = NaN
-        # without any warnings.
-        with np.errstate(invalid='ignore'):
-            np.arcsin(reptheta, out=reptheta)
-        # Reverse the condition to protect against NaN. We can't use
-        # theta > zaccept since all comparisons with NaN return False.
-        mask = ~(reptheta <= zaccept)
+        mask = self._acceptance(q, lam, zaccept)
         H[mask] = 0
         #print("number of masked points", np.sum(mask))
 
-        self.q_calc = q
-        self._H, self._H0 = H, H0
+        return q, H0, H
+
+
+def test_gaussian():
+    # type: () -> None
+    """
+    Check both transform methods against the analytic SESANS correlation
+    of a gaussian, I(q) = exp(-q^2 s^2/2), for which
+    G(d) = exp(-d^2/(2 s^2))/(2 pi s^2).
+    """
+    s = 50.
+    SElength = np.linspace(0., 1000., 101)
+    G0 = 1/(2*pi*s**2)
+    target = G0*(np.exp(-0.5*SElength**2/s**2) - 1)
+    # The fast transform picks up some ringing from the ends of the q range.
+    tolerance = {"dense": 1e-3, "fht": 1e-2}
+    methods = ["dense"] + (["fht"] if fht is not None else [])
+    saved, kernelcache.SAS_KERNEL_CACHE = kernelcache.SAS_KERNEL_CACHE, "none"
+    try:
+        for method in methods:
+            transform = SesansTransform(SElength, SElength, 1., 1., 1e7,
+                                        method=method)
+            q = transform.q_calc
+            P = transform.apply(np.exp(-0.5*q**2*s**2))
+            err = np.max(abs(P - target))/G0
+            assert err < tolerance[method], "%s error %g" % (method, err)
+    finally:
+        kernelcache.SAS_KERNEL_CACHE = saved
@@ -0,0 +1,283 @@
+"""
+Structure factor tables
+=======================
+
+Fits with a product model P@S vary *radius_effective* and *volfraction*
+continuously, and the beta approximation needs S at a new effective radius
+for every call, so S is computed again at every *q* for each evaluation.
+Structure factors such as :ref:`hardsphere`, :ref:`stickyhardsphere` and
+:ref:`squarewell` set *scale_invariant* in the model file to say that they
+depend on *q* and *radius_effective* only through *x = q radius_effective*,
+and that their other parameters are dimensionless.  For these,
+:class:`StructureTable` interpolates S from values on a grid in *x* and
+the remaining parameters, which are computed the first time they are
+needed.
+
+Each node of the grid in the parameters other than *radius_effective*
+holds S on a uniform grid in *x*.  Interpolation is by four point Lagrange
+polynomials along each axis, so each cell of the parameter grid needs
+4^d nodes for *d* parameters.  The first time a cell is used the
+interpolated S is compared with S computed directly, and if the error is
+larger than *tol* the steps are halved on all axes and the table is built
+again.  After :data:`TABLE_LEVELS` halvings, or for cells where S is
+negative, which the models use to flag an unphysical state, S is always
+computed directly.
+
+The tables are kept in :data:`TABLES` by model and precision, so that all
+products which use the same structure factor share them.  Set
+:data:`TABULATE` to False to compute S directly.
+"""
+from __future__ import division
+
+from itertools import product as cartesian
+
+import numpy as np  # type: ignore
+
+# pylint: disable=unused-import
+try:
+    from typing import Callable, Dict, List, Optional, Tuple
+    from .kernel import KernelModel
+    from .modelinfo import ModelInfo
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Interpolate structure factors which are *scale_invariant*.
+TABULATE = True
+#: Largest relative error in S allowed before the table steps are refined.
+TABLE_TOLERANCE = 1e-5
+#: Number of times the steps may be halved before giving up on the table.
+TABLE_LEVELS = 4
+#: Starting step in *x = q radius_effective*.
+TABLE_X_STEP = 0.05
+#: Starting step for the other parameters, as a fraction of the default.
+TABLE_STEP_FRACTION = 0.05
+#: Largest number of nodes kept for each table, after which the nodes are
+#: dropped and computed again as they are needed.
+TABLE_NODES = 4096
+
+#: Tables shared between products, by model id and precision.
+TABLES = {}  # type: Dict[Tuple[str, str], StructureTable]
+
+
+def get_table(model):
+    # type: (KernelModel) -> Optional[StructureTable]
+    """
+    Return the shared :class:`StructureTable` for the structure factor
+    *model*, or None if it can't be tabulated.
+    """
+    if not TABULATE or not getattr(model.info, 'scale_invariant', False):
+        return None
+    key = model.info.id, np.dtype(model.dtype).char
+    if key not in TABLES:
+        TABLES[key] = StructureTable(model.info)
+    return TABLES[key]
+
+
+def _lagrange(t):
+    # type: (np.ndarray) -> np.ndarray
+    """
+    Weights of the four point Lagrange polynomial through nodes at 0, 1, 2
+    and 3 evaluated at *t*, with one row for each *t*.
+    """
+    t = np.asarray(t, 'd')[..., None]
+    nodes = np.arange(4.)
+    weights = np.ones(t.shape[:-1] + (4,))
+    for k in range(4):
+        for j in range(4):
+            if j != k:
+                weights[..., k] *= (t[..., 0] - nodes[j])/(nodes[k] - nodes[j])
+    return weights
+
+
+class StructureTable(object):
+    """
+    Interpolation table for the *scale_invariant* structure factor
+    described by *model_info*.
+
+    Use :meth:`evaluate` for each call.  The table state is reset by
+    :meth:`reset`.
+    """
+    def __init__(self, model_info, tol=TABLE_TOLERANCE):
+        # type: (ModelInfo, float) -> None
+        pars = model_info.parameters.kernel_parameters[1:]
+        self.names = [p.name for p in pars]
+        self.lower = np.array([p.limits[0] for p in pars], 'd')
+        self.upper = np.array([p.limits[1] for p in pars], 'd')
+        self.origin = np.where(np.isfinite(self.lower), self.lower, 0.)
+        self.base_steps = TABLE_STEP_FRACTION*np.array(
+            [abs(p.default) if p.default != 0. else 1. for p in pars], 'd')
+        self.tol = tol
+        self.reset()
+
+    def reset(self):
+        # type: () -> None
+        """
+        Drop the nodes and go back to the starting steps.
+        """
+        self.level = 0
+        self.steps = self.base_steps.copy()
+        self.x_step = TABLE_X_STEP
+        self.x_max = 0.
+        self._clear()
+
+    def _clear(self):
+        # type: () -> None
+        self._nodes = {}  # type: Dict[Tuple[int, ...], np.ndarray]
+        self._cells = {}  # type: Dict[Tuple[int, ...], bool]
+
+    def evaluate(self, model, q, radius_effective, state, direct):
+        # type: (KernelModel, np.ndarray, float, np.ndarray, Callable[[], np.ndarray]) -> np.ndarray
+        """
+        Return S at *q* for *radius_effective* and the other parameters in
+        *state*, in table order.  *model* computes the nodes, and *direct()*
+        returns S computed directly, which is used to check new cells and
+        for points which are not in the table.
+        """
+        state = np.asarray(state, 'd')
+        if (self.level > TABLE_LEVELS or not radius_effective > 0.
+                or not np.all(np.isfinite(state))
+                or np.any(state < self.lower) or np.any(state > self.upper)):
+            return direct()
+        x = abs(np.asarray(q, 'd'))*radius_effective
+        x_max = float(np.max(x)) if x.size else 0.
+        if x_max > self.x_max:
+            # Leave room so that small increases in R_eff don't rebuild.
+            self.x_max = 1.5*x_max
+            self._clear()
+        start, offset = self._cell(state)
+        if start is None:
+            return direct()
+        cell = tuple(start)
+        if self._cells.get(cell) is False:
+            return direct()
+        table = self._interpolate_nodes(model, cell, offset)
+        if table is None:
+            self._cells[cell] = False
+            return direct()
+        result = self._interpolate_x(table, x)
+        if cell not in self._cells:
+            exact = np.asarray(direct(), 'd')
+            error = np.max(abs(result - exact)/np.maximum(abs(exact), 1e-8))
+            if error > self.tol:
+                self.level += 1
+                self.steps /= 2.
+                self.x_step /= 2.
+                self._clear()
+                return (exact if self.level > TABLE_LEVELS else
+                        self.evaluate(model, q, radius_effective, state,
+                                      lambda: exact))
+            self._cells[cell] = True
+        return result
+
+    def _cell(self, state):
+        # type: (np.ndarray) -> Tuple[Optional[np.ndarray], np.ndarray]
+        """
+        Return the index of the first node on each axis for the four point
+        rule around *state* and the position of *state* from that node, in
+        steps.  The rule is kept within the parameter limits, and the index
+        is None if the limits are closer than four steps.
+        """
+        t = (state - self.origin)/self.steps
+        first = np.floor(t).astype(int) - 1
+        last = np.where(np.isfinite(self.upper),
+                        np.floor((self.upper - self.origin)/self.steps), np.inf)
+        if np.any(last < 3):
+            return None, t
+        first = np.maximum(first, np.where(np.isfinite(self.lower), 0, first))
+        first = np.minimum(first, last - 3).astype(int)
+        return first, t - first
+
+    def _interpolate_nodes(self, model, cell, offset):
+        # type: (KernelModel, Tuple[int, ...], np.ndarray) -> Optional[np.ndarray]
+        """
+        Return S on the *x* grid at *offset* steps from the first node of
+        *cell*, computing the nodes which are missing.
+        """
+        nodes = [tuple(c + k for c, k in zip(cell, index))
+                 for index in cartesian(range(4), repeat=len(cell))]
+        missing = [node for node in nodes if node not in self._nodes]
+        if missing:
+            if len(self._nodes) + len(missing) > TABLE_NODES:
+                self._nodes = {}
+                missing = nodes
+            self._compute_nodes(model, missing)
+        weights = [_lagrange(t) for t in offset]
+        table = 0.
+        for index, node in zip(cartesian(range(4), repeat=len(cell)), nodes):
+            values = self._nodes[node]
+            if values is None:
+                return None
+            table = table + np.prod([w[k] for w, k in zip(weights, index)])*values
+        return table
+
+    def _compute_nodes(self, model, nodes):
+        # type: (KernelModel, List[Tuple[int, ...]]) -> None
+        from .direct_model import call_kernel_batch
+        x = np.arange(int(np.ceil(self.x_max/self.x_step)) + 4)*self.x_step
+        # Start just above zero, where the models have series expansions.
+        x[0] = 1e-3*self.x_step
+        pars_list = []
+        for node in nodes:
+            pars = dict(zip(self.names, self.origin + np.array(node)*self.steps))
+            pars.update(scale=1., background=0., radius_effective=1.)
+            pars_list.append(pars)
+        kernel = model.make_kernel([x])
+        try:
+            values = call_kernel_batch(kernel, pars_list)
+        finally:
+            kernel.release()
+        for node, row in zip(nodes, values):
+            row = np.asarray(row, 'd')
+            ok = np.all(np.isfinite(row)) and np.all(row >= 0.)
+            self._nodes[node] = row if ok else None
+
+    def _interpolate_x(self, table, x):
+        # type: (np.ndarray, np.ndarray) -> np.ndarray
+        t = x/self.x_step
+        first = np.clip(np.floor(t).astype(int) - 1, 0, len(table) - 4)
+        weights = _lagrange(t - first)
+        index = first[..., None] + np.arange(4)
+        return np.sum(weights*table[index], axis=-1)
+
+
+def test_structure_table():
+    # type: () -> None
+    """
+    Check that tabulated structure factors in product models match the
+    direct calculation.
+    """
+    global TABULATE
+    from .core import load_model
+    from .direct_model import DirectModel
+    from .data import empty_data1D
+
+    data = empty_data1D(np.logspace(-3, -0.5, 80))
+    pars = {
+        'sphere@hardsphere': dict(radius=40, volfraction=0.3,
+                                  radius_pd=0.1, radius_pd_n=5,
+                                  structure_factor_mode=1),
+        'sphere@stickyhardsphere': dict(radius=40, volfraction=0.2,
+                                        perturb=0.05, stickiness=0.3),
+        'sphere@squarewell': dict(radius=40, volfraction=0.04,
+                                  welldepth=1.0, wellwidth=1.3),
+    }
+    for name, base in pars.items():
+        TABLES.clear()
+        model = load_model(name, dtype='double')
+        exact, tabulated = [], []
+        saved = TABULATE
+        try:
+            TABULATE = False
+            calculator = DirectModel(data, model)
+            for radius in (40., 41.5, 43.3):
+                exact.append(calculator(**dict(base, radius=radius,
+                                              radius_effective_mode=1)))
+        finally:
+            TABULATE = saved
+        calculator = DirectModel(data, load_model(name, dtype='double'))
+        for radius in (40., 41.5, 43.3):
+            tabulated.append(calculator(**dict(base, radius=radius,
+                                               radius_effective_mode=1)))
+        assert TABLES, name
+        assert np.allclose(tabulated, exact, rtol=1e-4, atol=0), name
@@ -0,0 +1,272 @@
+"""
+Surrogate models
+================
+
+Exploring a model with sliders needs the theory for each new set of values
+as fast as the sliders move, which is not possible for models with
+polydispersity that take tenths of a second for each evaluation.  A
+:class:`Surrogate` is trained once for a :class:`.direct_model.DirectModel`
+over a box of parameter values, after which it returns the theory on the
+same data in about a millisecond.
+
+The theory is sampled on a tensor product of Chebyshev nodes in the box,
+usually as log I, and the samples are compressed with an SVD over q to
+the few components needed for the requested accuracy.  Each component is
+then a Chebyshev series in the box parameters, so evaluation is the series
+sum for each component followed by the sum over components.  The cost of
+training grows as *nodes^d* for *d* parameters, so six parameters with six
+nodes each needs 46656 kernel calls, which are done in batches.
+
+The theory is linear in *scale* and *background*, so these are always
+applied after the interpolation and can vary without limit.  The
+surrogate calls the exact calculator if any parameter is outside the box,
+if a parameter which is not in the box differs from the training value,
+or if *exact* is set, which should be used for final fits.
+
+Use :meth:`Surrogate.save` and :func:`load_surrogate` to keep a trained
+surrogate for the same data and model.  In :mod:`.compare`, *-edit* with
+*-surrogate=p1,p2,...* explores the model with a surrogate over the given
+parameters.
+"""
+from __future__ import print_function, division
+
+import numpy as np  # type: ignore
+
+# pylint: disable=unused-import
+try:
+    from typing import Any, Dict, List, Optional, Sequence, Tuple, Union
+    from .direct_model import DirectModel
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Parameters which are applied after the interpolation.
+LINEAR_PARAMETERS = ("scale", "background")
+
+#: Number of parameter sets to evaluate in each batch while training.
+TRAINING_BATCH = 256
+
+
+def chebyshev_nodes(n):
+    # type: (int) -> np.ndarray
+    """
+    Return the *n* Chebyshev points of the first kind on [-1, 1].
+    """
+    return np.cos(np.pi*(np.arange(n) + 0.5)/n)
+
+
+def _transform(n):
+    # type: (int) -> np.ndarray
+    """
+    Return the matrix which converts values at :func:`chebyshev_nodes` to
+    the coefficients of the interpolating Chebyshev series.
+    """
+    j = np.arange(n)[:, None]
+    k = np.arange(n)[None, :]
+    matrix = (2./n)*np.cos(np.pi*j*(k + 0.5)/n)
+    matrix[0] *= 0.5
+    return matrix
+
+
+class Surrogate(object):
+    """
+    Interpolant for *calculator* over the parameter *box*.
+
+    *box* maps parameter names to *(low, high)* limits.  *fixed* holds the
+    values of the other parameters, which defaults to the model defaults.
+    *nodes* is the number of Chebyshev nodes for each box parameter,
+    either as one number for all or as a mapping by name.  Components of
+    the SVD below *rank_tol* relative to the largest are dropped.
+
+    After training, *error* is the largest relative error at *validate*
+    random points in the box.
+    """
+    #: Use the exact calculator for every call.
+    exact = False
+
+    def __init__(self, calculator, box, fixed=None, nodes=6, rank_tol=1e-6,
+                 validate=16, train=True):
+        # type: (DirectModel, Dict[str, Tuple[float, float]], Optional[Dict[str, Any]], Union[int, Dict[str, int]], float, int, bool) -> None
+        self.calculator = calculator
+        self.names = [k for k in box if k not in LINEAR_PARAMETERS]
+        self.limits = np.array([box[k] for k in self.names], 'd')
+        self.fixed = dict(fixed) if fixed is not None else {}
+        if isinstance(nodes, dict):
+            self.nodes = [int(nodes.get(k, 6)) for k in self.names]
+        else:
+            self.nodes = [int(nodes)]*len(self.names)
+        self.rank_tol = rank_tol
+        self.engine = "SURROGATE[%s]" % getattr(calculator, 'engine', 'exact')
+        self.error = None  # type: Optional[float]
+        self.log = False
+        self.mean = None  # type: Optional[np.ndarray]
+        self.basis = None  # type: Optional[np.ndarray]
+        self.coeffs = None  # type: Optional[np.ndarray]
+        if train:
+            self._train()
+            if validate:
+                self.error = self._validate(validate)
+
+    def _pars(self, point):
+        # type: (Sequence[float]) -> Dict[str, Any]
+        pars = dict(self.fixed)
+        pars.update(zip(self.names, point))
+        pars['scale'], pars['background'] = 1., 0.
+        return pars
+
+    def _exact(self, points):
+        # type: (np.ndarray) -> np.ndarray
+        cutoff = getattr(self.calculator, 'cutoff', 0.)
+        theory = []
+        for start in range(0, len(points), TRAINING_BATCH):
+            pars_list = [self._pars(p)
+                         for p in points[start:start + TRAINING_BATCH]]
+            theory.extend(self.calculator._calc_theory_batch(pars_list,
+                                                             cutoff))
+        return np.array(theory)
+
+    def _train(self):
+        # type: () -> None
+        lo, hi = self.limits[:, 0], self.limits[:, 1]
+        axes = [lo[k] + (hi[k] - lo[k])*0.5*(chebyshev_nodes(n) + 1.)
+                for k, n in enumerate(self.nodes)]
+        grid = np.meshgrid(*axes, indexing='ij')
+        points = np.stack([v.ravel() for v in grid], axis=-1)
+        values = self._exact(points)
+        self.log = bool(np.all(values > 0.))
+        if self.log:
+            values = np.log(values)
+        self.mean = values.mean(axis=0)
+        _, s, vt = np.linalg.svd(values - self.mean, full_matrices=False)
+        rank = max(int(np.sum(s > self.rank_tol*s[0])), 1) if s[0] > 0 else 1
+        self.basis = vt[:rank]
+        coeffs = (values - self.mean).dot(self.basis.T)
+        coeffs = coeffs.reshape(tuple(self.nodes) + (rank,))
+        for axis, n in enumerate(self.nodes):
+            coeffs = np.moveaxis(
+                np.tensordot(_transform(n), coeffs, axes=(1, axis)), 0, axis)
+        self.coeffs = coeffs
+
+    def _validate(self, count):
+        # type: (int) -> float
+        rng = np.random.RandomState(0)
+        lo, hi = self.limits[:, 0], self.limits[:, 1]
+        points = lo + (hi - lo)*rng.rand(count, len(self.names))
+        exact = self._exact(points)
+        approx = np.array([self._interpolate(p) for p in points])
+        scale = np.where(exact != 0., abs(exact), 1.)
+        return float(np.max(abs(approx - exact)/scale))
+
+    def _interpolate(self, point):
+        # type: (Sequence[float]) -> np.ndarray
+        lo, hi = self.limits[:, 0], self.limits[:, 1]
+        t = np.clip(2.*(np.asarray(point) - lo)/(hi - lo) - 1., -1., 1.)
+        result = self.coeffs
+        for k, n in enumerate(self.nodes):
+            # Contract the leading axis with the Chebyshev polynomials.
+            basis = np.cos(np.arange(n)*np.arccos(t[k]))
+            result = np.tensordot(basis, result, axes=(0, 0))
+        values = self.mean + result.dot(self.basis)
+        return np.exp(values) if self.log else values
+
+    def covers(self, pars):
+        # type: (Dict[str, Any]) -> bool
+        """
+        Return True if the surrogate can be used for *pars*.
+        """
+        for k, v in pars.items():
+            if k in LINEAR_PARAMETERS:
+                continue
+            if k in self.names:
+                lo, hi = self.limits[self.names.index(k)]
+                if not lo <= v <= hi:
+                    return False
+            elif k in self.fixed and self.fixed[k] != v:
+                return False
+            elif k not in self.fixed:
+                return False
+        return True
+
+    def __call__(self, **pars):
+        # type: (**Any) -> np.ndarray
+        if self.exact or self.coeffs is None or not self.covers(pars):
+            return self.calculator(**pars)
+        point = [pars.get(k, (lo + hi)/2)
+                 for k, (lo, hi) in zip(self.names, self.limits)]
+        scale = pars.get('scale', self.fixed.get('scale', 1.))
+        background = pars.get('background', self.fixed.get('background', 0.))
+        if getattr(self.calculator, 'data_type', None) == 'sesans':
+            background = 0.
+        return scale*self._interpolate(point) + background
+
+    def save(self, path):
+        # type: (str) -> None
+        """
+        Save the trained surrogate to the .npz file *path*.
+        """
+        np.savez(path, names=np.array(self.names), limits=self.limits,
+                 nodes=np.array(self.nodes), log=self.log, mean=self.mean,
+                 basis=self.basis, coeffs=self.coeffs,
+                 error=np.nan if self.error is None else self.error,
+                 fixed_names=np.array(list(self.fixed), dtype=str),
+                 fixed_values=np.array([repr(v) for v in self.fixed.values()],
+                                       dtype=str))
+
+
+def load_surrogate(path, calculator):
+    # type: (str, DirectModel) -> Surrogate
+    """
+    Load a surrogate saved by :meth:`Surrogate.save` for *calculator*,
+    which must use the same model and data as the one it was trained on.
+    """
+    import ast
+    with np.load(path) as saved:
+        names = [str(k) for k in saved['names']]
+        limits = saved['limits']
+        fixed = {str(k): ast.literal_eval(str(v)) for k, v in
+                 zip(saved['fixed_names'], saved['fixed_values'])}
+        surrogate = Surrogate(calculator, dict(zip(names, limits)),
+                              fixed=fixed, train=False)
+        surrogate.nodes = [int(n) for n in saved['nodes']]
+        surrogate.log = bool(saved['log'])
+        surrogate.mean = saved['mean']
+        surrogate.basis = saved['basis']
+        surrogate.coeffs = saved['coeffs']
+        error = float(saved['error'])
+        surrogate.error = None if np.isnan(error) else error
+    return surrogate
+
+
+def test_surrogate():
+    # type: () -> None
+    """
+    Check that the surrogate matches the exact theory within the box and
+    falls back to the exact theory outside it.
+    """
+    import os
+    import tempfile
+    from .core import load_model
+    from .data import empty_data1D
+    from .direct_model import DirectModel
+
+    data = empty_data1D(np.logspace(-3, -1, 60))
+    calculator = DirectModel(data, load_model('sphere', dtype='double'))
+    fixed = {'sld': 4., 'sld_solvent': 1., 'radius_pd': 0.1,
+             'radius_pd_n': 15}
+    surrogate = Surrogate(calculator, {'radius': (20., 30.)}, fixed=fixed,
+                          nodes=12)
+    assert surrogate.error < 1e-4, surrogate.error
+    pars = dict(fixed, radius=23.3, scale=0.5, background=0.1)
+    assert np.allclose(surrogate(**pars), calculator(**pars), rtol=1e-4)
+    outside = dict(pars, radius=35.)
+    assert np.array_equal(surrogate(**outside), calculator(**outside))
+    assert not surrogate.covers(dict(pars, sld=5.))
+
+    fd, path = tempfile.mkstemp(suffix='.npz')
+    os.close(fd)
+    try:
+        surrogate.save(path)
+        loaded = load_surrogate(path, calculator)
+        assert np.array_equal(loaded(**pars), surrogate(**pars))
+    finally:
+        os.unlink(path)
@@ -0,0 +1,252 @@
+"""
+Model watcher
+=============
+
+Developing a plugin model means editing the model file or its C sources
+and evaluating it again, over and over.  :func:`watch_model` returns a
+:class:`WatchedModel` which checks the files in a background thread and,
+when they change, loads and compiles the new version while the old one
+keeps running.  The new build is then swapped in for the next kernel, so
+a calculator which holds the model picks up the edit on its next call
+without waiting for the compiler.
+
+If the new version fails to load or compile, the error is kept in
+*error* and logged, and the last good build stays in use until the files
+change again.
+
+Compiled dlls and GPU programs are named by a hash of the generated
+source (see :func:`.kerneldll.make_dll` and :mod:`.kernelcache`), so going
+back to an earlier version of a model reuses its build rather than
+compiling it again.
+
+Example::
+
+    from sasmodels.data import empty_data1D
+    from sasmodels.direct_model import DirectModel
+    from sasmodels.watch import watch_model
+
+    model = watch_model("~/models/my_sphere.py", dtype="double")
+    calculator = DirectModel(empty_data1D(q), model)
+    Iq = calculator(radius=50)
+    # ... edit my_sphere.py or my_sphere.c ...
+    Iq = calculator(radius=50)  # uses the latest good build
+"""
+from __future__ import print_function
+
+import os
+import threading
+import logging
+
+import numpy as np  # type: ignore
+
+from . import core
+from . import custom
+from .kernel import KernelModel
+
+# pylint: disable=unused-import
+try:
+    from typing import Callable, List, Optional
+    from .kernel import Kernel
+    from .modelinfo import ModelInfo
+except ImportError:
+    pass
+# pylint: enable=unused-import
+
+#: Seconds between checks of the model files.
+WATCH_INTERVAL = 0.5
+
+
+class WatchedModel(KernelModel):
+    """
+    Model loaded from the plugin file *path* and rebuilt when it changes.
+
+    *dtype* and *platform* are as for :func:`.core.build_model`.  The files
+    are checked every *interval* seconds.  After each rebuild, successful
+    or not, *callback(model)* is called from the watcher thread if given.
+
+    *generation* counts the builds which have been swapped in, so that
+    holders of kernels can tell when to make new ones.  Kernels made from
+    an earlier build continue to work with that build.
+
+    The first build happens in the constructor, and raises an error if the
+    model does not load.  Call :meth:`release` to stop watching.
+    """
+    #: Number of builds swapped in since the first one.
+    generation = 0  # type: int
+    #: Error from the last failed rebuild, or None if it succeeded.
+    error = None  # type: Optional[Exception]
+
+    def __init__(self, path, dtype=None, platform="ocl",
+                 interval=WATCH_INTERVAL, callback=None):
+        # type: (str, Optional[str], str, float, Optional[Callable[[WatchedModel], None]]) -> None
+        self.path = os.path.abspath(os.path.expanduser(path))
+        self.platform = platform
+        self.interval = interval
+        self.callback = callback
+        self._dtype = dtype
+        self._lock = threading.Lock()
+        self._done = threading.Event()
+        self._stamp = None  # type: Optional[float]
+        self._model = self._build()
+        self._thread = threading.Thread(target=self._watch)
+        self._thread.daemon = True
+        self._thread.start()
+
+    @property
+    def info(self):
+        # type: () -> ModelInfo
+        return self._model.info
+
+    @property
+    def dtype(self):
+        # type: () -> np.dtype
+        return self._model.dtype
+
+    def _files_stamp(self):
+        # type: () -> float
+        """
+        Newest modification time of the model file and its C sources.
+        """
+        files = custom._MODULE_DEPENDS.get(self.path, [self.path])
+        return max(os.path.getmtime(f) for f in files)
+
+    def _build(self):
+        # type: () -> KernelModel
+        """
+        Load and compile the model from the current files.
+        """
+        self._stamp = self._files_stamp()
+        info = core.load_model_info(self.path)
+        model = core.build_model(info, dtype=self._dtype,
+                                 platform=self.platform)
+        if self.gauss_order:
+            model.set_integration_order(self.gauss_order)
+        # Compile now rather than on the first kernel call, which would be
+        # on the caller's thread.
+        model.make_kernel([np.array([0.1])]).release()
+        return model
+
+    def _watch(self):
+        # type: () -> None
+        while not self._done.wait(self.interval):
+            try:
+                changed = self._files_stamp() != self._stamp
+            except OSError:
+                # Editors may remove the file briefly while saving it.
+                continue
+            if changed:
+                self.reload()
+
+    def reload(self):
+        # type: () -> None
+        """
+        Rebuild the model from its files now, and swap in the new build if
+        it succeeds.  This is called by the watcher thread when the files
+        change.
+        """
+        try:
+            model = self._build()
+        except Exception as exc:
+            logging.warning("rebuild of %s failed: %s", self.path, exc)
+            self.error = exc
+        else:
+            with self._lock:
+                self._model = model
+                self.generation += 1
+            self.error = None
+            logging.info("rebuilt %s", self.path)
+        if self.callback is not None:
+            self.callback(self)
+
+    def set_integration_order(self, n):
+        # type: (int) -> None
+        with self._lock:
+            self._model.set_integration_order(n)
+            self.gauss_order = n
+
+    def make_kernel(self, q_vectors):
+        # type: (List[np.ndarray]) -> Kernel
+        with self._lock:
+            model = self._model
+        return model.make_kernel(q_vectors)
+
+    def release(self):
+        # type: () -> None
+        """
+        Stop watching the files and release the current build.
+        """
+        self._done.set()
+        if self._thread is not threading.current_thread():
+            self._thread.join()
+        self._model.release()
+
+
+def watch_model(path, dtype=None, platform="ocl", interval=WATCH_INTERVAL,
+                callback=None):
+    # type: (str, Optional[str], str, float, Optional[Callable[[WatchedModel], None]]) -> WatchedModel
+    """
+    Load the plugin model at *path* and rebuild it in the background
+    whenever the model file or its C sources change.
+
+    See :class:`WatchedModel` for the arguments.
+    """
+    return WatchedModel(path, dtype=dtype, platform=platform,
+                        interval=interval, callback=callback)
+
+
+_TEST_MODEL = '''\
+name = "watch_test"
+title = "Line with a slope from the C source"
+description = "Model for testing the model watcher"
+category = "plugin"
+parameters = [["a", "", 1.0, [-float("inf"), float("inf")], "", "slope"]]
+Iq = "return %s*a*q;"
+'''
+
+def test_watch_model():
+    # type: () -> None
+    """
+    Check that edits to a watched model are swapped in, and that a broken
+    edit keeps the last good build.
+    """
+    import shutil
+    import tempfile
+    import time
+    from .data import empty_data1D
+    from .direct_model import DirectModel
+
+    def write(factor, stamp):
+        # type: (str, float) -> None
+        with open(path, 'w') as fid:
+            fid.write(_TEST_MODEL % factor)
+        # Step the time so that coarse file system clocks see the edit.
+        os.utime(path, (stamp, stamp))
+
+    def wait(check):
+        # type: (Callable[[], bool]) -> None
+        deadline = time.time() + 60.
+        while not check() and time.time() < deadline:
+            time.sleep(0.05)
+        assert check()
+
+    model_dir = tempfile.mkdtemp()
+    path = os.path.join(model_dir, "watch_test.py")
+    stamp = time.time() - 100.
+    write("1.0", stamp)
+    model = watch_model(path, dtype="double", platform="dll", interval=0.05)
+    try:
+        calculator = DirectModel(empty_data1D(np.array([0.1, 0.2])), model)
+        before = calculator(a=2., scale=1., background=0.)
+        write("3.0", stamp + 10.)
+        wait(lambda: model.generation == 1)
+        assert np.allclose(calculator(a=2., scale=1., background=0.),
+                           3.*before)
+
+        write("(", stamp + 20.)
+        wait(lambda: model.error is not None)
+        assert model.generation == 1
+        assert np.allclose(calculator(a=2., scale=1., background=0.),
+                           3.*before)
+    finally:
+        model.release()
+        shutil.rmtree(model_dir, ignore_errors=True)
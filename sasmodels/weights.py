@@ -4,8 +4,10 @@ SAS distributions for polydispersity.
 # TODO: include dispersion docs with the disperser models
 from __future__ import division, print_function
 
+import os
 from math import sqrt  # type: ignore
 from collections import OrderedDict
+from functools import lru_cache
 
 import numpy as np  # type: ignore
 from scipy.special import gammaln  # type: ignore
@@ -20,6 +22,13 @@ except ImportError:
 
 # TODO: include dispersion docs with the disperser models
 
+#: Compute the weights in C for the distributions which support it, using
+#: the dll from :func:`.kerneldll.load_weights_dll`.  This avoids
+#: the numpy overhead when a fit rebuilds the weights for every change in
+#: width.  Enable with SAS_NATIVE_WEIGHTS=1 in the environment, or set
+#: weights.USE_NATIVE_WEIGHTS.
+USE_NATIVE_WEIGHTS = os.environ.get("SAS_NATIVE_WEIGHTS", "0") not in ("", "0")
+
 class Dispersion(object):
     """
     Base dispersion object.
@@ -170,7 +179,11 @@ class SchulzDispersion(Dispersion):
     type = "schulz"
     default = dict(npts=80, width=0, nsigmas=8)
     def _weights(self, center, sigma, lb, ub):
-        x = self._linspace(center, sigma, max(lb, 1e-8), max(ub, 1e-8))
+        lb, ub = max(lb, 1e-8), max(ub, 1e-8)
+        if USE_NATIVE_WEIGHTS:
+            return _native_weights("schulz_weights", self.npts, center, sigma,
+                                   self.nsigmas, lb, ub)
+        x = self._linspace(center, sigma, lb, ub)
         R = x/center
         z = (center/sigma)**2
         arg = z*np.log(z) + (z-1)*np.log(R) - R*z - np.log(center) - gammaln(z)
@@ -178,6 +191,18 @@ class SchulzDispersion(Dispersion):
         return x, px
 
 
+def _native_weights(name, npts, *args):
+    """
+    Call the weights function *name* from kernel_weights.c for *npts*
+    points, returning the points kept within the bounds and their weights.
+    """
+    from .kerneldll import load_weights_dll
+    x, w = np.empty(npts, 'd'), np.empty(npts, 'd')
+    fn = getattr(load_weights_dll(), name)
+    n = fn(npts, *args, x.ctypes.data, w.ctypes.data)
+    return x[:n], w[:n]
+
+
 class ArrayDispersion(Dispersion):
     r"""
     Empirical dispersion curve.
@@ -282,14 +307,26 @@ def get_weights(disperser, n, width, nsigmas, value, limits, relative):
     of the parameter, and false if it is an absolute width.
 
     Returns *(value, weight)*, where *value* and *weight* are vectors.
+
+    Results are memoized since fits evaluate the same distributions many
+    times, and some of them are expensive to compute.  The returned vectors
+    are shared between calls, and so are marked read-only.
     """
     if disperser == "array":
         raise NotImplementedError("Don't handle arrays through get_weights;"
                                   " use values and weights directly")
+    # The class is part of the key in case load_weights replaces it.
     cls = DISTRIBUTIONS[disperser]
+    return _cached_weights(cls, n, width, nsigmas, value,
+                           float(limits[0]), float(limits[1]), bool(relative))
+
+@lru_cache(maxsize=256)
+def _cached_weights(cls, n, width, nsigmas, value, lb, ub, relative):
     obj = cls(n, width, nsigmas)
-    v, w = obj.get_weights(value, limits[0], limits[1], relative)
-    return v, w/np.sum(w)
+    v, w = obj.get_weights(value, lb, ub, relative)
+    v, w = np.asarray(v, 'd'), np.asarray(w, 'd')/np.sum(w)
+    v.flags.writeable = w.flags.writeable = False
+    return v, w
 
 
 def plot_weights(model_info, mesh):
@@ -321,3 +358,21 @@ def plot_weights(model_info, mesh):
         plt.grid(True)
         plt.legend()
         #plt.show()
+
+
+def test_native_schulz():
+    """
+    Check that the schulz weights from the dll match the numpy version.
+    """
+    global USE_NATIVE_WEIGHTS
+    saved = USE_NATIVE_WEIGHTS
+    try:
+        for center, width, lb in ((20., 0.1, 0.), (400., 0.4, 100.), (5., 0.9, 0.)):
+            USE_NATIVE_WEIGHTS = False
+            x0, w0 = SchulzDispersion(width=width).get_weights(center, lb, np.inf, True)
+            USE_NATIVE_WEIGHTS = True
+            x1, w1 = SchulzDispersion(width=width).get_weights(center, lb, np.inf, True)
+            np.testing.assert_allclose(x1, x0, rtol=1e-14)
+            np.testing.assert_allclose(w1, w0, rtol=1e-12)
+    finally:
+        USE_NATIVE_WEIGHTS = saved